@@ -62,29 +62,49 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
 
   ESL_RANDOMNESS    *rnd        = NULL;
   ESL_SQFILE        *sqfp       = NULL;
+  P7_DSQDB          *dsqdb      = NULL;
   ESL_SQ            *sq         = NULL;
   ESL_ALPHABET      *abc        = NULL;
   ESL_SQASCII_DATA  *ascii      = NULL;
 
   if (errbuf) errbuf[0] = '\0';	/* CURRENTLY UNUSED. FIXME */
 
-  /* Open the target sequence database */
-  if ((status = esl_sqfile_Open(seqfile, eslSQFILE_FASTA, NULL, &sqfp)) != eslOK) return status;
-
-  /* This is a bit of a hack.  The first line contains database information.
-   *
-   * #<res_count> <seq_count> <db_count> <db_sequences_1> <db_sequences_before_removing_duplicates_1> <db_sequences_2> <db_sequences_before_removing_duplicates_2>  ... <date_stamp>
-   *
-   * The rest of the file is a fasta format.  The fasta header is just
-   * sequence number followed by a binary number indicating which
-   * database this sequence occurs in.
-   *
-   * The header line will be read in, parsed and saved.  Then the
-   * parser will be repositioned after the line and used normally.
+  /* A snapshot written by makeseqcache is mapped and used as is. */
+  status = p7_seqcache_OpenSnapshot(seqfile, 0, 1, ret_cache, errbuf);
+  if (status != eslENOTFOUND) return status;
+  if (errbuf) errbuf[0] = '\0';
+
+  /* A database pressed by makedsqdb keeps the first line (below) in its
+   * names file, and its residues are used in place rather than copied.
    */
-  ascii = &sqfp->data.ascii;
-  fseek(ascii->fp, 0L, SEEK_SET);
-  if (fgets(buffer, sizeof(buffer), ascii->fp) == NULL) return eslEFORMAT;
+  status = p7_dsqdb_Open(seqfile, &dsqdb, errbuf);
+  if (status == eslOK)
+    {
+      if (dsqdb->alphatype != eslAMINO || dsqdb->dbinfo == NULL) { p7_dsqdb_Close(dsqdb); return eslEFORMAT; }
+      strncpy(buffer, dsqdb->dbinfo, sizeof(buffer)-1);
+      buffer[sizeof(buffer)-1] = '\0';
+    }
+  else if (status != eslENOTFOUND) return status;
+  else
+    {
+      /* Open the target sequence database */
+      if ((status = esl_sqfile_Open(seqfile, eslSQFILE_FASTA, NULL, &sqfp)) != eslOK) return status;
+
+      /* This is a bit of a hack.  The first line contains database information.
+       *
+       * #<res_count> <seq_count> <db_count> <db_sequences_1> <db_sequences_before_removing_duplicates_1> <db_sequences_2> <db_sequences_before_removing_duplicates_2>  ... <date_stamp>
+       *
+       * The rest of the file is a fasta format.  The fasta header is just
+       * sequence number followed by a binary number indicating which
+       * database this sequence occurs in.
+       *
+       * The header line will be read in, parsed and saved.  Then the
+       * parser will be repositioned after the line and used normally.
+       */
+      ascii = &sqfp->data.ascii;
+      fseek(ascii->fp, 0L, SEEK_SET);
+      if (fgets(buffer, sizeof(buffer), ascii->fp) == NULL) return eslEFORMAT;
+    }
   if (buffer[0] != '#')                                 return eslEFORMAT;
 
   ptr = buffer + 1;
@@ -97,6 +117,9 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
   total_mem = sizeof(P7_SEQCACHE);
   ESL_ALLOC(cache, sizeof(P7_SEQCACHE));
   memset(cache, 0, sizeof(P7_SEQCACHE));
+  cache->dsqdb   = dsqdb;
+  cache->shard   = 0;
+  cache->nshards = 1;
 
   if (esl_strdup(seqfile, -1, &cache->name) != eslOK)   goto ERROR;
 
@@ -106,12 +129,16 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
 
   total_mem += (sizeof(SEQ_DB) * db_cnt);
   ESL_ALLOC(db, sizeof(SEQ_DB) * db_cnt);
+  memset(db, 0, sizeof(SEQ_DB) * db_cnt);
   for (i = 0; i < db_cnt; ++i) {
     db[i].count  = strtol(ptr, &ptr, 10);
     db[i].K      = strtol(ptr, &ptr, 10);
+    db[i].rescum = NULL;
     total_mem   += (sizeof(HMMER_SEQ *) * db[i].count);
     ESL_ALLOC(db[i].list, sizeof(HMMER_SEQ *) * db[i].count);
     memset(db[i].list, 0, sizeof(HMMER_SEQ *) * db[i].count);
+    total_mem   += (sizeof(uint64_t) * (db[i].count + 1));
+    ESL_ALLOC(db[i].rescum, sizeof(uint64_t) * (db[i].count + 1));
   }
 
   /* grab the unique identifier */
@@ -121,18 +148,20 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
   strcpy(cache->id, ptr);
   while (--i > 0 && isspace(cache->id[i])) cache->id[i] = 0;
 
-  res_size = res_cnt + seq_cnt + 1;
+  res_size = (dsqdb ? 0 : res_cnt + seq_cnt + 1);
   hdr_size = seq_cnt * 10;
 
   total_mem += res_size + hdr_size;
-  ESL_ALLOC(cache->residue_mem, res_size);
+  if (! dsqdb) ESL_ALLOC(cache->residue_mem, res_size);
   ESL_ALLOC(cache->header_mem, hdr_size);
 
   /* position the sequence file to the start of the first sequence.
    * this will force any buffers associated with the file to be reset.
    */
-  offset = ftell(ascii->fp);
-  if ((status = esl_sqfile_Position(sqfp, offset)) != eslOK) goto ERROR;
+  if (sqfp) {
+    offset = ftell(ascii->fp);
+    if ((status = esl_sqfile_Position(sqfp, offset)) != eslOK) goto ERROR;
+  }
 
   abc = esl_alphabet_Create(eslAMINO);
   sq  = esl_sq_CreateDigital(abc);
@@ -151,11 +180,11 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
   strcpy(buffer, "000000001");
   
   inx = 0;
-  while ((status = esl_sqio_Read(sqfp, sq)) == eslOK) {
+  while ((status = (dsqdb ? p7_dsqdb_Read(dsqdb, sq) : esl_sqio_Read(sqfp, sq))) == eslOK) {
 
     /* sanity checks */
     if (inx >= seq_cnt)       { printf("inx: %d\n", inx); return eslEFORMAT; }
-    if (sq->n + 1 > res_size) { printf("inx: %d size %d %d\n", inx, (int)sq->n + 1, (int)res_size); return eslEFORMAT; }
+    if (! dsqdb && sq->n + 1 > res_size) { printf("inx: %d size %d %d\n", inx, (int)sq->n + 1, (int)res_size); return eslEFORMAT; }
     if (hdr_size <= 0)        { printf("inx: %d hdr %d\n", inx, (int)hdr_size); return eslEFORMAT; }
 
     /* generate the database key - modified to take the first word in the desc line.
@@ -179,16 +208,18 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
     if (db_key >= (1 << (db_cnt + 1))) { printf("inx: %d db %d %s\n", inx, db_key, sq->desc); return eslEFORMAT; }
 
     cache->list[inx].name   = hdr_ptr;
-    cache->list[inx].dsq    = (ESL_DSQ *)res_ptr;
+    cache->list[inx].dsq    = (dsqdb ? sq->dsq : (ESL_DSQ *)res_ptr);
     cache->list[inx].n      = sq->n;
     cache->list[inx].idx    = inx;
     cache->list[inx].db_key = db_key;
     if(desc_ptr != NULL) esl_strdup(desc_ptr, -1, &(cache->list[inx].desc));
 
-    /* copy the digitized sequence */
-    memcpy(res_ptr, sq->dsq, sq->n + 1);
-    res_ptr  += (sq->n + 1);
-    res_size -= (sq->n + 1);
+    /* copy the digitized sequence, unless it's mapped */
+    if (! dsqdb) {
+      memcpy(res_ptr, sq->dsq, sq->n + 1);
+      res_ptr  += (sq->n + 1);
+      res_size -= (sq->n + 1);
+    }
 
     /* copy the index to the header */
     strcpy(hdr_ptr, buffer);
@@ -204,18 +235,21 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
       }
     }
 
-    esl_sq_Reuse(sq);
+    if (dsqdb) p7_dsqdb_ReuseSeq(sq);
+    else       esl_sq_Reuse(sq);
     ++inx;    
   }
   if (status != eslEOF) { printf("Unexpected error %d at %d\n", status, inx); return status; }
 
   if (inx != seq_cnt) { printf("inx:: %d %" PRIu64 "\n", inx, seq_cnt);  return eslEFORMAT; }
   if (hdr_size != 0)  { printf("inx:: %d hdr %d\n", inx, (int)hdr_size); return eslEFORMAT; }
-  if (res_size != 1)  { printf("inx:: %d size %d %d\n", inx, (int)sq->n + 1, (int)res_size); return eslEFORMAT; }
+  if (! dsqdb) {
+    if (res_size != 1)  { printf("inx:: %d size %d %d\n", inx, (int)sq->n + 1, (int)res_size); return eslEFORMAT; }
 
-  /* copy the final sentinel character */
-  *res_ptr++ = eslDSQ_SENTINEL;
-  --res_size;
+    /* copy the final sentinel character */
+    *res_ptr++ = eslDSQ_SENTINEL;
+    --res_size;
+  }
 
   /* sort the order of the database sequences */
   rnd = esl_randomness_CreateFast(seq_cnt);
@@ -243,13 +277,21 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
     cache->list[i].idx = (cache->list[i].name - cache->header_mem) / 10 + 1;
   }
 
+  /* running residue counts, so the workers can share out a block of a database by its cost */
+  for (i = 0; i < cache->db_cnt; ++i) {
+    SEQ_DB *db = cache->db + i;
+    db->rescum[0] = 0;
+    for (inx = 0; inx < db->count; ++inx)
+      db->rescum[inx+1] = db->rescum[inx] + db->list[inx]->n;
+  }
+
   for (i = 0; i < cache->db_cnt; ++i) {
     printf("sequence database (%d):: %d %d\n", i, cache->db[i].count, db_inx[i]);
   }
 
   printf("\nLoaded sequence db file %s; total memory %" PRId64 "\n", seqfile, total_mem);
 
-  esl_sqfile_Close(sqfp);
+  if (sqfp) esl_sqfile_Close(sqfp);
   esl_sq_Destroy(sq);
 
   *ret_cache = cache;
@@ -259,6 +301,7 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
  ERROR:
   if (sq    != NULL) esl_sq_Destroy(sq);
   if (abc   != NULL) esl_alphabet_Destroy(abc);
+  if (dsqdb != NULL) p7_dsqdb_Close(dsqdb);
   if (cache != NULL) {
     if (cache->header_mem  != NULL) free(cache->header_mem);
     if (cache->residue_mem != NULL) free(cache->residue_mem);
@@ -267,7 +310,8 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
     free(cache);
   }
   for (i = 0; i < db_cnt; ++i) {
-    if (db[i].list != NULL) free(db[i].list);
+    if (db[i].list   != NULL) free(db[i].list);
+    if (db[i].rescum != NULL) free(db[i].rescum);
   }
   return eslEMEM;
 }
@@ -282,20 +326,453 @@ p7_seqcache_Close(P7_SEQCACHE *cache)
   if (cache->db) 
     {
       for (i = 0; i < cache->db_cnt; ++i) {
-	if (cache->db[i].list != NULL) free(cache->db[i].list);
+	if (cache->db[i].list   != NULL) free(cache->db[i].list);
+	if (cache->db[i].rescum != NULL && ! cache->snapmem) free(cache->db[i].rescum);
       }
       free(cache->db);
     }
   if (cache->abc)         esl_alphabet_Destroy(cache->abc);
   if (cache->list)        free(cache->list);
-  if (cache->residue_mem) free(cache->residue_mem);
-  if (cache->header_mem)  free(cache->header_mem);
+  if (cache->snapmem)     p7_dsqdb_UnmapFile(cache->snapmem, cache->snapsize, cache->snapmapped);
+  else {
+    if (cache->residue_mem) free(cache->residue_mem);
+    if (cache->header_mem)  free(cache->header_mem);
+  }
+  if (cache->dsqdb)       p7_dsqdb_Close(cache->dsqdb);
   free(cache);
 }
 
 
 
 
+/*****************************************************************
+ * Snapshots of a sequence cache.
+ *****************************************************************/
+
+/* A snapshot is the loaded, sorted cache written out by makeseqcache
+ * as a single file <seqfile>.h3c (<seqfile>.<shard>.h3c for one shard
+ * of a sharded database), in native byte order:
+ *
+ *   SNAP_HEADER
+ *   the unique identifier string
+ *   the "#..." database line of the source, to tell when it's stale
+ *   SNAP_DB[db_cnt]
+ *   for each database: uint32_t list[0..count-1], indices of its
+ *     sequences in the SNAP_SEQ's; uint64_t rescum[0..count]
+ *   SNAP_SEQ[count], in the cache's (sorted) order
+ *   residues: each dsq[0..n] back to back, sharing sentinels, then a
+ *     final sentinel
+ *   names, then descriptions, each \0-terminated, back to back
+ *
+ * Every section starts on an 8-byte boundary, and everything refers
+ * to everything else by offset or index, so the file can be mapped
+ * anywhere and used in place. Loading it only has to rebuild the
+ * pointer lists.
+ *
+ * A snapshot whose source database line or file size no longer
+ * matches <seqfile> is out of date, and is passed over.
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t db_cnt;                 /* number of sub databases               */
+  uint32_t count;                  /* number of sequences                   */
+  int32_t  shard;                  /* shard held, 0..nshards-1              */
+  uint64_t nshards;                /* number of shards; 1 if not sharded    */
+  uint64_t res_size;               /* sizes of the residue, name and ...    */
+  uint64_t hdr_size;
+  uint64_t desc_size;              /* ... description sections              */
+  uint64_t src_size;               /* size of the source database file      */
+  uint64_t id_off;                 /* offsets of the sections in the file   */
+  uint64_t info_off;
+  uint64_t db_off;
+  uint64_t seq_off;
+  uint64_t res_off;
+  uint64_t hdr_off;
+  uint64_t desc_off;
+  uint64_t size;                   /* size of the file                      */
+} SNAP_HEADER;
+
+typedef struct {
+  uint32_t count;                  /* number of entries                     */
+  uint32_t K;                      /* original number of entries            */
+  uint64_t list_off;               /* offset of its list[]                  */
+  uint64_t cum_off;                /* offset of its rescum[]                */
+} SNAP_DB;
+
+typedef struct {
+  uint64_t doff;                   /* offset of dsq[0] in the residues      */
+  int64_t  n;                      /* length of dsq                         */
+  int64_t  idx;                    /* ctr for this seq                      */
+  uint64_t db_key;                 /* flag for included databases           */
+  uint64_t noff;                   /* offset of the name in the names       */
+  uint64_t descoff;                /* offset of the desc, or SNAP_NODESC    */
+} SNAP_SEQ;
+
+#define SNAP_NODESC    UINT64_MAX
+#define SNAP_ALIGN(x)  (((x) + 7) & ~((uint64_t) 7))
+
+static uint32_t v3a_cmagic = 0xb3e1e3f3; /* 3/a sequence cache snapshot: "3acs" = 0x 33 61 63 73 + 0x80808080 */
+
+static uint32_t
+byteswap32(uint32_t x)
+{
+  return ((x & 0xff) << 24) | ((x & 0xff00) << 8) | ((x >> 8) & 0xff00) | (x >> 24);
+}
+
+/* snap_fits()
+ * TRUE if <n> elements of <elemsize> bytes starting at offset <off>
+ * fit in a file of <size> bytes. Compares by division, so corrupt
+ * offsets and counts can't wrap around.
+ */
+static int
+snap_fits(uint64_t size, uint64_t off, uint64_t n, uint64_t elemsize)
+{
+  return (off <= size && n <= (size - off) / elemsize);
+}
+
+/* source_info()
+ * Copy the hmmpgmd "#..." database line of <seqfile> (its first line,
+ * or the one kept by makedsqdb in a pressed database) into <buf>,
+ * without its newline, and return the size of <seqfile> in
+ * <*ret_size>. Returns <eslENOTFOUND> if <seqfile> can't be read or
+ * has no such line.
+ */
+static int
+source_info(const char *seqfile, char *buf, size_t len, uint64_t *ret_size)
+{
+  P7_DSQDB *dsqdb = NULL;
+  FILE     *fp;
+  off_t     size;
+  size_t    n;
+
+  if ((fp = fopen(seqfile, "rb")) == NULL) return eslENOTFOUND;
+  if (fseeko(fp, 0, SEEK_END) != 0 || (size = ftello(fp)) < 0 || fseeko(fp, 0, SEEK_SET) != 0) { fclose(fp); return eslENOTFOUND; }
+  if (fgets(buf, len, fp) == NULL) buf[0] = '\0';
+  fclose(fp);
+
+  if (buf[0] != '#') {
+    if (p7_dsqdb_Open(seqfile, &dsqdb, NULL) != eslOK) return eslENOTFOUND;
+    if (dsqdb->dbinfo) { strncpy(buf, dsqdb->dbinfo, len-1); buf[len-1] = '\0'; }
+    p7_dsqdb_Close(dsqdb);
+    if (buf[0] != '#') return eslENOTFOUND;
+  }
+
+  n = strlen(buf);
+  while (n > 0 && (buf[n-1] == '\n' || buf[n-1] == '\r')) buf[--n] = '\0';
+  *ret_size = (uint64_t) size;
+  return eslOK;
+}
+
+/* snap_write()
+ * Write <n> bytes of <p> to <fp>, first padding with zeros up to
+ * offset <off>; <*pos> tracks the current offset.
+ */
+static int
+snap_write(FILE *fp, uint64_t *pos, uint64_t off, const void *p, size_t n)
+{
+  for (; *pos < off; (*pos)++)
+    if (fputc(0, fp) == EOF) return eslEWRITE;
+  if (n > 0 && fwrite(p, 1, n, fp) != n) return eslEWRITE;
+  *pos += n;
+  return eslOK;
+}
+
+/* Function:  p7_seqcache_SnapshotName()
+ * Synopsis:  Name of the snapshot of a sequence database.
+ *
+ * Purpose:   Return in <*ret_name> the name of the snapshot of shard
+ *            <shard> of <nshards> of <seqfile>: <seqfile>.h3c if the
+ *            database isn't sharded (<nshards> is 1), else
+ *            <seqfile>.<shard>.h3c. Caller frees <*ret_name>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seqcache_SnapshotName(const char *seqfile, int shard, uint64_t nshards, char **ret_name)
+{
+  if (nshards > 1) return esl_sprintf(ret_name, "%s.%d.h3c", seqfile, shard);
+  else             return esl_sprintf(ret_name, "%s.h3c", seqfile);
+}
+
+/* Function:  p7_seqcache_WriteSnapshot()
+ * Synopsis:  Write a loaded sequence cache as a snapshot.
+ *
+ * Purpose:   Write <cache> to the open binary stream <fp> as a
+ *            snapshot that <p7_seqcache_OpenSnapshot()> can map.
+ *            The sequences are written in the cache's sorted order
+ *            with their residues, wherever those are held, so the
+ *            snapshot stands alone.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEWRITE> on a write error; <errbuf> contains a
+ *            user-directed message.
+ */
+int
+p7_seqcache_WriteSnapshot(P7_SEQCACHE *cache, FILE *fp, char *errbuf)
+{
+  SNAP_HEADER  hdr;
+  SNAP_DB     *sdb = NULL;
+  SNAP_SEQ     rec;
+  HMMER_SEQ   *seq;
+  uint64_t     pos = 0;
+  uint64_t     off;
+  uint64_t     cum;
+  uint64_t     noff;
+  uint64_t     descoff;
+  uint32_t     i, j;
+  uint32_t     k;
+  ESL_DSQ      sentinel = eslDSQ_SENTINEL;
+  char         info[512];
+  int          status;
+
+  if (errbuf) errbuf[0] = '\0';
+
+  memset(&hdr, 0, sizeof(SNAP_HEADER));
+  hdr.magic   = v3a_cmagic;
+  hdr.db_cnt  = cache->db_cnt;
+  hdr.count   = cache->count;
+  hdr.shard   = cache->shard;
+  hdr.nshards = (cache->nshards > 0 ? cache->nshards : 1);
+  if (source_info(cache->name, info, sizeof(info), &hdr.src_size) != eslOK)
+    ESL_XFAIL(eslEFORMAT, errbuf, "can't read the hmmpgmd database line of %s", cache->name);
+
+  hdr.res_size = 1;
+  for (i = 0; i < cache->count; ++i) {
+    seq = cache->list + i;
+    hdr.res_size  += seq->n + 1;
+    hdr.hdr_size  += strlen(seq->name) + 1;
+    if (seq->desc) hdr.desc_size += strlen(seq->desc) + 1;
+  }
+
+  /* lay out the file */
+  ESL_ALLOC(sdb, sizeof(SNAP_DB) * ESL_MAX(1, cache->db_cnt));
+  off        = sizeof(SNAP_HEADER);
+  hdr.id_off   = off;
+  off          = SNAP_ALIGN(off + strlen(cache->id) + 1);
+  hdr.info_off = off;
+  off          = SNAP_ALIGN(off + strlen(info) + 1);
+  hdr.db_off   = off;
+  off       += sizeof(SNAP_DB) * cache->db_cnt;
+  for (i = 0; i < cache->db_cnt; ++i) {
+    sdb[i].count    = cache->db[i].count;
+    sdb[i].K        = cache->db[i].K;
+    sdb[i].list_off = off;
+    off             = SNAP_ALIGN(off + sizeof(uint32_t) * sdb[i].count);
+    sdb[i].cum_off  = off;
+    off            += sizeof(uint64_t) * (sdb[i].count + 1);
+  }
+  hdr.seq_off  = off;
+  off         += sizeof(SNAP_SEQ) * cache->count;
+  hdr.res_off  = off;
+  off          = SNAP_ALIGN(off + hdr.res_size);
+  hdr.hdr_off  = off;
+  off          = SNAP_ALIGN(off + hdr.hdr_size);
+  hdr.desc_off = off;
+  hdr.size     = off + hdr.desc_size;
+
+  if (snap_write(fp, &pos, 0,          &hdr,      sizeof(SNAP_HEADER))      != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot header");
+  if (snap_write(fp, &pos, hdr.id_off, cache->id, strlen(cache->id) + 1)    != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot identifier");
+  if (snap_write(fp, &pos, hdr.info_off, info,    strlen(info) + 1)         != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot database line");
+  if (snap_write(fp, &pos, hdr.db_off, sdb,       sizeof(SNAP_DB) * cache->db_cnt) != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot databases");
+
+  for (i = 0; i < cache->db_cnt; ++i) {
+    SEQ_DB *db = cache->db + i;
+
+    for (j = 0; j < db->count; ++j) {
+      k = db->list[j] - cache->list;
+      if (snap_write(fp, &pos, (j == 0 ? sdb[i].list_off : pos), &k, sizeof(uint32_t)) != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot database list");
+    }
+    cum = 0;
+    if (snap_write(fp, &pos, sdb[i].cum_off, &cum, sizeof(uint64_t)) != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot residue counts");
+    for (j = 0; j < db->count; ++j) {
+      cum += db->list[j]->n;
+      if (snap_write(fp, &pos, pos, &cum, sizeof(uint64_t)) != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot residue counts");
+    }
+  }
+
+  off     = 0;
+  noff    = 0;
+  descoff = 0;
+  for (i = 0; i < cache->count; ++i) {
+    seq = cache->list + i;
+    rec.doff    = off;
+    rec.n       = seq->n;
+    rec.idx     = seq->idx;
+    rec.db_key  = seq->db_key;
+    rec.noff    = noff;
+    rec.descoff = (seq->desc ? descoff : SNAP_NODESC);
+    if (snap_write(fp, &pos, (i == 0 ? hdr.seq_off : pos), &rec, sizeof(SNAP_SEQ)) != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot sequence index");
+    off     += seq->n + 1;
+    noff    += strlen(seq->name) + 1;
+    if (seq->desc) descoff += strlen(seq->desc) + 1;
+  }
+
+  for (i = 0; i < cache->count; ++i) {
+    seq = cache->list + i;
+    if (snap_write(fp, &pos, (i == 0 ? hdr.res_off : pos), seq->dsq, seq->n + 1) != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot residues");
+  }
+  if (snap_write(fp, &pos, (cache->count == 0 ? hdr.res_off : pos), &sentinel, 1) != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot residues");
+
+  for (i = 0; i < cache->count; ++i) {
+    seq = cache->list + i;
+    if (snap_write(fp, &pos, (i == 0 ? hdr.hdr_off : pos), seq->name, strlen(seq->name) + 1) != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot names");
+  }
+  if (snap_write(fp, &pos, hdr.desc_off, NULL, 0) != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot names");
+  for (i = 0; i < cache->count; ++i) {
+    seq = cache->list + i;
+    if (seq->desc && snap_write(fp, &pos, pos, seq->desc, strlen(seq->desc) + 1) != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to write snapshot descriptions");
+  }
+  if (pos != hdr.size) ESL_XFAIL(eslEWRITE, errbuf, "snapshot size %" PRIu64 " doesn't match its layout (%" PRIu64 ")", pos, hdr.size);
+
+  free(sdb);
+  return eslOK;
+
+ ERROR:
+  if (sdb) free(sdb);
+  return status;
+}
+
+/* Function:  p7_seqcache_OpenSnapshot()
+ * Synopsis:  Load a sequence cache from its snapshot.
+ *
+ * Purpose:   Map the snapshot of shard <shard> of <nshards> of
+ *            <seqfile> (see <p7_seqcache_SnapshotName()>) and return
+ *            a cache that uses its residues, names, descriptions
+ *            and residue counts in place. Only the sequence list and
+ *            the per-database pointer lists are allocated.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslENOTFOUND> if there is no snapshot; callers then
+ *            load <seqfile> itself.
+ *
+ *            <eslEFORMAT> if the snapshot is corrupt, was written on
+ *            a machine of the other byte order, or holds a different
+ *            shard; <errbuf> contains a user-directed message.
+ *
+ *            On any error, <*ret_cache> is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seqcache_OpenSnapshot(char *seqfile, int shard, uint64_t nshards, P7_SEQCACHE **ret_cache, char *errbuf)
+{
+  P7_SEQCACHE    *cache    = NULL;
+  char           *snapfile = NULL;
+  char           *mem;
+  SNAP_HEADER     hdr;
+  SNAP_DB         sdb;
+  const SNAP_SEQ *rec;
+  const uint32_t *lst;
+  uint32_t        i, j;
+  uint64_t        src_size;
+  char            info[512];
+  int             status;
+
+  if (errbuf) errbuf[0] = '\0';
+  if ((status = p7_seqcache_SnapshotName(seqfile, shard, nshards, &snapfile)) != eslOK) goto ERROR;
+
+  ESL_ALLOC(cache, sizeof(P7_SEQCACHE));
+  memset(cache, 0, sizeof(P7_SEQCACHE));
+
+  status = p7_dsqdb_MapFile(snapfile, &cache->snapmem, &cache->snapsize, &cache->snapmapped);
+  if      (status == eslENOTFOUND) ESL_XFAIL(eslENOTFOUND, errbuf, "no snapshot %s", snapfile);
+  else if (status != eslOK)        goto ERROR;
+  mem = cache->snapmem;
+
+  if (cache->snapsize >= sizeof(SNAP_HEADER)) memcpy(&hdr, mem, sizeof(SNAP_HEADER));
+  else                                        hdr.magic = 0;
+  if (hdr.magic == byteswap32(v3a_cmagic)) ESL_XFAIL(eslEFORMAT, errbuf, "%s was written on a machine of the other byte order; rebuild it here with makeseqcache", snapfile);
+  if (hdr.magic != v3a_cmagic)             ESL_XFAIL(eslEFORMAT, errbuf, "%s is not a sequence cache snapshot", snapfile);
+  if (hdr.size  != cache->snapsize)        ESL_XFAIL(eslEFORMAT, errbuf, "%s is truncated", snapfile);
+  if (hdr.shard != shard || hdr.nshards != nshards)
+    ESL_XFAIL(eslEFORMAT, errbuf, "%s holds shard %d of %" PRIu64 ", not shard %d of %" PRIu64, snapfile, hdr.shard, hdr.nshards, shard, nshards);
+
+  /* every offset is checked against the file size before it's used */
+  if (hdr.db_cnt > 64 ||
+      hdr.id_off < sizeof(SNAP_HEADER) || hdr.id_off >= hdr.info_off || hdr.info_off >= hdr.db_off || hdr.db_off > hdr.size ||
+      memchr(mem + hdr.id_off,   '\0', hdr.info_off - hdr.id_off)   == NULL ||
+      memchr(mem + hdr.info_off, '\0', hdr.db_off   - hdr.info_off) == NULL ||
+      hdr.db_off  % 8 || ! snap_fits(hdr.size, hdr.db_off,  hdr.db_cnt, sizeof(SNAP_DB))  ||
+      hdr.seq_off % 8 || ! snap_fits(hdr.size, hdr.seq_off, hdr.count,  sizeof(SNAP_SEQ)) ||
+      hdr.res_size < 1 || ! snap_fits(hdr.size, hdr.res_off,  hdr.res_size,  1) ||
+      ! snap_fits(hdr.size, hdr.hdr_off,  hdr.hdr_size,  1) || (hdr.hdr_size  > 0 && mem[hdr.hdr_off  + hdr.hdr_size  - 1] != '\0') ||
+      ! snap_fits(hdr.size, hdr.desc_off, hdr.desc_size, 1) || (hdr.desc_size > 0 && mem[hdr.desc_off + hdr.desc_size - 1] != '\0'))
+    ESL_XFAIL(eslEFORMAT, errbuf, "%s is corrupt: bad header", snapfile);
+
+  /* a snapshot left behind when the database changed is passed over, not used */
+  if (source_info(seqfile, info, sizeof(info), &src_size) != eslOK || src_size != hdr.src_size || strcmp(info, mem + hdr.info_off) != 0)
+    {
+      printf("Snapshot %s is out of date with %s; loading the database itself\n", snapfile, seqfile);
+      ESL_XFAIL(eslENOTFOUND, errbuf, "snapshot %s is out of date with %s", snapfile, seqfile);
+    }
+
+  if ((status = esl_strdup(seqfile, -1, &cache->name))         != eslOK) goto ERROR;
+  if ((status = esl_strdup(mem + hdr.id_off, -1, &cache->id))  != eslOK) goto ERROR;
+  cache->abc         = esl_alphabet_Create(eslAMINO);
+  cache->count       = hdr.count;
+  cache->residue_mem = mem + hdr.res_off;
+  cache->header_mem  = mem + hdr.hdr_off;
+  cache->res_size    = hdr.res_size;
+  cache->hdr_size    = hdr.hdr_size;
+  cache->shard       = hdr.shard;
+  cache->nshards     = hdr.nshards;
+
+  ESL_ALLOC(cache->list, sizeof(HMMER_SEQ) * ESL_MAX(1, hdr.count));
+  rec = (const SNAP_SEQ *) (mem + hdr.seq_off);
+  for (i = 0; i < hdr.count; ++i) {
+    if (rec[i].n < 0 || ! snap_fits(hdr.res_size, rec[i].doff, (uint64_t) rec[i].n + 2, 1) || rec[i].noff >= hdr.hdr_size ||
+        (rec[i].descoff != SNAP_NODESC && rec[i].descoff >= hdr.desc_size))
+      ESL_XFAIL(eslEFORMAT, errbuf, "%s is corrupt: bad entry for sequence %u", snapfile, i);
+    cache->list[i].name   = cache->header_mem + rec[i].noff;
+    cache->list[i].dsq    = (ESL_DSQ *) cache->residue_mem + rec[i].doff;
+    cache->list[i].n      = rec[i].n;
+    cache->list[i].idx    = rec[i].idx;
+    cache->list[i].db_key = rec[i].db_key;
+    cache->list[i].desc   = (rec[i].descoff == SNAP_NODESC ? NULL : mem + hdr.desc_off + rec[i].descoff);
+  }
+
+  ESL_ALLOC(cache->db, sizeof(SEQ_DB) * ESL_MAX(1, hdr.db_cnt));
+  memset(cache->db, 0, sizeof(SEQ_DB) * ESL_MAX(1, hdr.db_cnt));
+  cache->db_cnt = hdr.db_cnt;
+  for (i = 0; i < hdr.db_cnt; ++i) {
+    SEQ_DB *db = cache->db + i;
+
+    memcpy(&sdb, mem + hdr.db_off + sizeof(SNAP_DB) * i, sizeof(SNAP_DB));
+    if (sdb.count > hdr.count ||
+        sdb.list_off % 8 || ! snap_fits(hdr.size, sdb.list_off, sdb.count,                  sizeof(uint32_t)) ||
+        sdb.cum_off  % 8 || ! snap_fits(hdr.size, sdb.cum_off,  (uint64_t) sdb.count + 1,   sizeof(uint64_t)))
+      ESL_XFAIL(eslEFORMAT, errbuf, "%s is corrupt: bad entry for database %u", snapfile, i);
+
+    db->count  = sdb.count;
+    db->K      = sdb.K;
+    db->rescum = (uint64_t *) (mem + sdb.cum_off);
+    ESL_ALLOC(db->list, sizeof(HMMER_SEQ *) * ESL_MAX(1, sdb.count));
+    lst = (const uint32_t *) (mem + sdb.list_off);
+    for (j = 0; j < sdb.count; ++j) {
+      if (lst[j] >= hdr.count) ESL_XFAIL(eslEFORMAT, errbuf, "%s is corrupt: bad list entry in database %u", snapfile, i);
+      db->list[j] = &cache->list[lst[j]];
+    }
+  }
+
+  for (i = 0; i < cache->db_cnt; ++i) {
+    printf("sequence database (%d):: %d\n", i, cache->db[i].count);
+  }
+  printf("\nLoaded sequence db snapshot %s; %" PRIu64 " bytes %s\n", snapfile, (uint64_t) cache->snapsize, (cache->snapmapped ? "mapped" : "read"));
+
+  free(snapfile);
+  *ret_cache = cache;
+  return eslOK;
+
+ ERROR:
+  if (snapfile) free(snapfile);
+  if (cache)    p7_seqcache_Close(cache);
+  *ret_cache = NULL;
+  return status;
+}
+
+
+
 /*****************************************************************
  * x. Unit test
  *****************************************************************/
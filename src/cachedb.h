@@ -1,6 +1,8 @@
 #ifndef P7_CACHEDB_INCLUDED
 #define P7_CACHEDB_INCLUDED
 
+#include "p7_dsqdb.h"
+
 typedef struct {
   char    *name;                   /* name; ("\0" if no name)               */
   ESL_DSQ *dsq;                    /* digitized sequence [1..n]             */
@@ -14,6 +16,7 @@ typedef struct {
   uint32_t            count;       /* number of entries                     */
   uint32_t            K;           /* original number of entries            */
   HMMER_SEQ         **list;        /* list of sequences [0 .. count-1]      */
+  uint64_t           *rescum;      /* residues in list[0..i-1]; [0 .. count] */
 } SEQ_DB;
 
 typedef struct {
@@ -31,6 +34,15 @@ typedef struct {
 
   uint64_t            res_size;    /* size of residue memory allocation     */
   uint64_t            hdr_size;    /* size of header memory allocation      */
+
+  P7_DSQDB           *dsqdb;       /* pressed db the residues are mapped from, or NULL */
+
+  int                 shard;       /* shard of the database held, 0..nshards-1 */
+  uint64_t            nshards;     /* number of shards; 1 if not sharded    */
+
+  char               *snapmem;     /* snapshot this cache was loaded from, or NULL */
+  size_t              snapsize;    /* size of <snapmem> in bytes            */
+  int                 snapmapped;  /* TRUE if <snapmem> is mmap()'ed        */
 } P7_SEQCACHE;
 
 
@@ -38,5 +50,9 @@ typedef struct {
 extern int    p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf);
 extern void   p7_seqcache_Close(P7_SEQCACHE *cache);
 
+extern int    p7_seqcache_SnapshotName(const char *seqfile, int shard, uint64_t nshards, char **ret_name);
+extern int    p7_seqcache_WriteSnapshot(P7_SEQCACHE *cache, FILE *fp, char *errbuf);
+extern int    p7_seqcache_OpenSnapshot(char *seqfile, int shard, uint64_t nshards, P7_SEQCACHE **ret_cache, char *errbuf);
+
 #endif /*P7_CACHEDB_INCLUDED*/
 
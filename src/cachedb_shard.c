@@ -347,6 +347,11 @@ p7_seqcache_Open_shard(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf, int
   uint64_t *db_seq_count, *seq_in_db;
   if (errbuf) errbuf[0] = '\0'; /* CURRENTLY UNUSED. FIXME */
 
+  /* A snapshot of this shard, written by makeseqcache, is mapped and used as is. */
+  status = p7_seqcache_OpenSnapshot(seqfile, my_shard, num_shards, ret_cache, errbuf);
+  if (status != eslENOTFOUND) return status;
+  if (errbuf) errbuf[0] = '\0';
+
   /* Open the target sequence database */
   if ((status = esl_sqfile_Open(seqfile, eslSQFILE_FASTA, NULL, &sqfp)) != eslOK) return status;
 
@@ -378,6 +383,8 @@ p7_seqcache_Open_shard(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf, int
   memset(cache, 0, sizeof(P7_SEQCACHE));
 
   if (esl_strdup(seqfile, -1, &cache->name) != eslOK)   goto ERROR;
+  cache->shard   = my_shard;
+  cache->nshards = num_shards;
 
   total_mem += (sizeof(HMMER_SEQ) * seq_cnt);
   ESL_ALLOC(cache->list, sizeof(HMMER_SEQ) * seq_cnt);
@@ -385,6 +392,7 @@ p7_seqcache_Open_shard(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf, int
 
   total_mem += (sizeof(SEQ_DB) * db_cnt);
   ESL_ALLOC(db, sizeof(SEQ_DB) * db_cnt);
+  memset(db, 0, sizeof(SEQ_DB) * db_cnt);
   for (i = 0; i < db_cnt; ++i) {
     db[i].count  = strtol(ptr, &ptr, 10);  // this will get overwritten later
     db[i].K      = strtol(ptr, &ptr, 10);
@@ -582,13 +590,22 @@ p7_seqcache_Open_shard(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf, int
     cache->list[i].idx = strtol(cache->list[i].name, NULL, 10);
   }
 
+  /* running residue counts, so the workers can share out a block of a database by its cost */
+  for (i = 0; i < cache->db_cnt; ++i) {
+    SEQ_DB *db = cache->db + i;
+    ESL_ALLOC(db->rescum, sizeof(uint64_t) * (db->count + 1));
+    db->rescum[0] = 0;
+    for (inx = 0; inx < db->count; ++inx)
+      db->rescum[inx+1] = db->rescum[inx] + db->list[inx]->n;
+  }
+
   for (i = 0; i < cache->db_cnt; ++i) {
     printf("sequence database (%d):: %d %d\n", i, cache->db[i].count, db_inx[i]);
   }
  // re-update these with the computed values
   cache->res_size    = res_mem_used;
   cache->hdr_size    = hdr_mem_used;
-  //cache->count       = inx;
+  cache->count       = seq_cnt;   // only this shard's sequences are in the list
 
   total_mem += (res_mem_used + hdr_mem_used);
   printf("\nLoaded sequence db file %s; total memory %" PRId64 "\n", seqfile, total_mem);
@@ -613,7 +630,8 @@ p7_seqcache_Open_shard(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf, int
     free(cache);
   }
   for (i = 0; i < db_cnt; ++i) {
-    if (db[i].list != NULL) free(db[i].list);
+    if (db[i].list   != NULL) free(db[i].list);
+    if (db[i].rescum != NULL) free(db[i].rescum);
   }
   return eslEMEM;
 }
@@ -85,6 +85,7 @@ static ESL_OPTIONS searchOpts[] = {
   { "--hmmdb",      eslARG_INT,         NULL,  NULL, "n>0",   NULL,  NULL,  "--seqdb",       "hmm database to search",                                      12 },
   { "--seqdb",      eslARG_INT,         NULL,  NULL, "n>0",   NULL,  NULL,  "--hmmdb",       "protein database to search",                                  12 },
   { "--seqdb_ranges",eslARG_STRING,     NULL,  NULL,  NULL,   NULL, "--seqdb", NULL,         "range(s) of sequences within --seqdb that will be searched",  12 },
+  { "--profile",    eslARG_NONE,        FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "time each pipeline stage; print the profile as JSON",           12 },
 
   /* name           type        default  env  range toggles reqs incomp  help                                          docgroup*/
   { "-c",         eslARG_INT,       "1", NULL, NULL, NULL,  NULL, "--seqdb",  "use alt genetic code of NCBI transl table <n>", 15 },
@@ -536,6 +537,10 @@ int main(int argc, char *argv[])
         if (ali)    { p7_tophits_Domains(stdout, th, pli, 120); fprintf(stdout, "\n\n"); }
         p7_pli_Statistics(stdout, pli, w);  
 
+        /* with --profile, a line of JSON with the pipeline profile follows the hits */
+        if (buf_offset < sstatus.msg_size && buf[sstatus.msg_size-1] == '\0')
+          fprintf(stdout, "Pipeline profile: %s\n", (char *) buf + buf_offset);
+
         p7_pipeline_Destroy(pli); 
         p7_tophits_Destroy(th);
         free(buf);
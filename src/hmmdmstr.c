@@ -31,7 +31,6 @@
 #include "esl_getopts.h"
 #include "esl_sq.h"
 #include "esl_sqio.h"
-#include "esl_stack.h"
 #include "esl_stopwatch.h"
 #include "esl_threads.h"
 
@@ -55,11 +54,78 @@ typedef struct {
   int                 errors;
 } SEARCH_RESULTS;
 
+/* Commands that clients want done, waiting for the master to start
+ * them. Searches start oldest first, or with --sched priority, highest
+ * --priority first and oldest first among equals. Up to <maxrun>
+ * searches run on the workers at once, each on its own share of them.
+ * A client never has two searches in progress, so it gets its results
+ * back in the order it sent its queries.
+ *
+ * With <maxbatch> > 1, searches of the same sequence database that are
+ * waiting at the same time are coalesced: up to <maxbatch> of them go
+ * to the workers as one batch, so that each worker sweeps its part of
+ * the database once for all of them. A batch counts as one search
+ * against <maxrun>.
+ */
+typedef struct {
+  QUEUE_DATA     **cmd;		/* waiting commands, oldest first, [0..n-1]        */
+  int              n;
+  int              nalloc;
+  int              by_priority;	/* TRUE to start the highest priority first        */
+
+  int              maxrun;	/* most searches to run on the workers at once     */
+  int              nrun;	/* # of searches running on the workers now        */
+  int              maxbatch;	/* most --seqdb searches to coalesce into one      */
+  int             *busy;	/* sockets of clients with a search in progress    */
+  int              nbusy;
+  int              nbusyalloc;
+
+  pthread_mutex_t  mutex;	/* guards all of the above                         */
+  pthread_cond_t   cond;	/* signalled on a new command, or a search ending  */
+} CMD_QUEUE;
+
+/* The results of recent searches, exactly as they were sent to their
+ * clients, so that a repeat of a search is answered without the
+ * workers. Searches are the same if their keys are: the database
+ * version, the database, the options (other than --priority) and the
+ * query. The least recently used results are dropped to keep the cache
+ * under <maxmem> bytes.
+ */
+typedef struct rescache_entry_s {
+  uint64_t                  hash;	/* hash of <key>                            */
+  char                     *key;	/* see search_key()                         */
+  uint32_t                  keylen;
+  uint8_t                  *data;	/* serialized status, stats and hits        */
+  uint64_t                  datalen;
+
+  struct rescache_entry_s  *hnext;	/* next in its hash bucket                  */
+  struct rescache_entry_s  *prev;	/* LRU list, most recently used first       */
+  struct rescache_entry_s  *next;
+} RESCACHE_ENTRY;
+
+typedef struct {
+  RESCACHE_ENTRY **bucket;		/* hash table, [0..nbuckets-1]              */
+  int              nbuckets;
+  int              n;			/* # of results cached                      */
+  RESCACHE_ENTRY  *head;		/* most recently used                       */
+  RESCACHE_ENTRY  *tail;		/* least recently used, next to go          */
+
+  uint64_t         mem;			/* bytes used by the entries                */
+  uint64_t         maxmem;
+  int              db_version;		/* version of the databases being searched  */
+
+  uint64_t         nhit;
+  uint64_t         nmiss;
+
+  pthread_mutex_t  mutex;		/* guards all of the above                  */
+} RESULT_CACHE;
+
 typedef struct {
   int             sock_fd;
   char            ip_addr[64];
 
-  ESL_STACK      *cmdstack;	/* stack of commands that clients want done */
+  CMD_QUEUE      *cmdq;		/* commands that clients want done */
+  RESULT_CACHE   *cache;	/* results of recent searches, or NULL */
 } CLIENTSIDE_ARGS;
 
 typedef struct {
@@ -84,11 +150,27 @@ typedef struct {
   int              idle_cnt;
   struct worker_s *idling;
 
-  RANGE_LIST       *range_list;  /* (optional) list of ranges searched within the seqdb */
-
   int              completed;
+
+  RESULT_CACHE    *cache;	/* results of recent searches, or NULL */
 } WORKERSIDE_ARGS;
 
+/* The workers that one search is running on. */
+typedef struct {
+  struct worker_s **worker;	/* [0..n-1]                                  */
+  int               n;
+  int               completed;	/* # of them that have finished, or failed   */
+} WORKER_SHARE;
+
+/* What a worker sent back for one query of the command it ran. */
+typedef struct {
+  HMMD_SEARCH_STATS     stats;
+  HMMD_SEARCH_STATUS    status;
+  char                 *err_buf;
+  P7_HIT              **hits;
+  uint32_t              allocated_hits;
+} WORKER_RESULT;
+
 typedef struct worker_s {
   int                   sock_fd;
   char                  ip_addr[64];
@@ -100,19 +182,26 @@ typedef struct worker_s {
   uint32_t              srch_inx;
   uint32_t              srch_cnt;
 
-  HMMD_SEARCH_STATS     stats;
-  HMMD_SEARCH_STATUS    status;
-  char                 *err_buf;
-  P7_HIT               **hits;
-  uint32_t             allocated_hits;
+  WORKER_RESULT        *res;	/* one per query of <cmd>, [0..nres-1]         */
+  int                   nres;
+  int                   nresalloc;
   int                   total;
 
   WORKERSIDE_ARGS      *parent;
+  WORKER_SHARE         *share;	/* the search it's running, or NULL if it's free */
 
   struct worker_s      *next;
   struct worker_s      *prev;
 } WORKER_DATA;
 
+/* What a search thread needs: one search, or a batch of them coalesced. */
+typedef struct {
+  WORKERSIDE_ARGS *comm;
+  CMD_QUEUE       *cmdq;
+  QUEUE_DATA     **query;	/* [0..nquery-1] */
+  int              nquery;
+} SEARCH_ARGS;
+
 
 static void setup_clientside_comm(ESL_GETOPTS *opts, CLIENTSIDE_ARGS  *args);
 static void setup_workerside_comm(ESL_GETOPTS *opts, WORKERSIDE_ARGS  *args);
@@ -120,9 +209,9 @@ static void setup_workerside_comm(ESL_GETOPTS *opts, WORKERSIDE_ARGS  *args);
 static void destroy_worker(WORKER_DATA *worker);
 
 static void init_results(SEARCH_RESULTS *results);
-static void clear_results(WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results);
-static void gather_results(QUEUE_DATA *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results);
-static void forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results);
+static void clear_results(SEARCH_RESULTS *results);
+static void gather_results(QUEUE_DATA **query, int nquery, WORKERSIDE_ARGS *comm, WORKER_SHARE *share, SEARCH_RESULTS *results);
+static void forward_results(RESULT_CACHE *cache, QUEUE_DATA *query, SEARCH_RESULTS *results);
 
 static void
 print_client_msg(int fd, int status, char *format, va_list ap)
@@ -180,6 +269,566 @@ client_msg_longjmp(int fd, int status, jmp_buf *env, char *format, ...)
   longjmp(*env, 1);
 }
 
+static CMD_QUEUE *
+cmdqueue_Create(int maxrun, int maxbatch, int by_priority)
+{
+  CMD_QUEUE *cq = NULL;
+  int        n;
+
+  if ((cq = malloc(sizeof(CMD_QUEUE))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  cq->nalloc      = 16;
+  cq->n           = 0;
+  cq->by_priority = by_priority;
+  cq->maxrun      = maxrun;
+  cq->nrun        = 0;
+  cq->maxbatch    = maxbatch;
+  cq->nbusyalloc  = 16;
+  cq->nbusy       = 0;
+  if ((cq->cmd  = malloc(sizeof(QUEUE_DATA *) * cq->nalloc))   == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((cq->busy = malloc(sizeof(int)          * cq->nbusyalloc)) == NULL) LOG_FATAL_MSG("malloc", errno);
+
+  if ((n = pthread_mutex_init(&cq->mutex, NULL)) != 0) LOG_FATAL_MSG("mutex init", n);
+  if ((n = pthread_cond_init (&cq->cond,  NULL)) != 0) LOG_FATAL_MSG("cond init", n);
+  return cq;
+}
+
+static void
+cmdqueue_Push(CMD_QUEUE *cq, QUEUE_DATA *query)
+{
+  int n;
+
+  if ((n = pthread_mutex_lock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (cq->n == cq->nalloc) {
+    cq->nalloc *= 2;
+    if ((cq->cmd = realloc(cq->cmd, sizeof(QUEUE_DATA *) * cq->nalloc)) == NULL) LOG_FATAL_MSG("realloc", errno);
+  }
+  cq->cmd[cq->n++] = query;
+  if ((n = pthread_cond_broadcast(&cq->cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* is_busy()
+ * TRUE if the client on socket <sock> has a search in progress.
+ * Caller holds the queue's mutex.
+ */
+static int
+is_busy(CMD_QUEUE *cq, int sock)
+{
+  int i;
+
+  for (i = 0; i < cq->nbusy; i++)
+    if (cq->busy[i] == sock) return TRUE;
+  return FALSE;
+}
+
+/* can_coalesce()
+ * TRUE if <query> can go to the workers in a batch with other
+ * searches: a --seqdb search of the whole database.
+ */
+static int
+can_coalesce(QUEUE_DATA *query)
+{
+  return (query->cmd_type == HMMD_CMD_SEARCH && ! esl_opt_IsUsed(query->opts, "--seqdb_ranges"));
+}
+
+/* cmdqueue_Next()
+ * Wait for the next command that can start, take it off the queue,
+ * and return it in <batch>[0]. A search can start when fewer than
+ * <maxrun> are running and its client has none in progress. A shutdown
+ * waits for every search in progress to finish, and no new search
+ * starts while one is waiting.
+ *
+ * If the command is a search that can be coalesced, other waiting
+ * searches of the same database, from other clients, join it, oldest
+ * first, up to <maxbatch> in all. <batch> has room for <maxbatch>;
+ * the number of commands in it is returned in <*ret_n>.
+ */
+static void
+cmdqueue_Next(CMD_QUEUE *cq, QUEUE_DATA **batch, int *ret_n)
+{
+  QUEUE_DATA *query = NULL;
+  int         nb    = 0;
+  int         best;
+  int         i, j, k, n;
+
+  if ((n = pthread_mutex_lock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  for ( ;; ) {
+    best = -1;
+    for (i = 0; i < cq->n; i++)
+      if (cq->cmd[i]->cmd_type == HMMD_CMD_SHUTDOWN) break;
+
+    if (i < cq->n) {
+      if (cq->nbusy == 0) best = i;
+    } else {
+      for (i = 0; i < cq->n; i++) {
+        if (cq->cmd[i]->cmd_type != HMMD_CMD_SEARCH && cq->cmd[i]->cmd_type != HMMD_CMD_SCAN) { best = i; break; }
+        if (cq->nrun >= cq->maxrun) continue;
+        if (is_busy(cq, cq->cmd[i]->sock)) continue;
+        if (best == -1 || (cq->by_priority && cq->cmd[i]->priority > cq->cmd[best]->priority)) best = i;
+        if (! cq->by_priority) break;
+      }
+    }
+    if (best >= 0) break;
+
+    if ((n = pthread_cond_wait(&cq->cond, &cq->mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+  }
+
+  query = cq->cmd[best];
+  memmove(cq->cmd + best, cq->cmd + best + 1, sizeof(QUEUE_DATA *) * (cq->n - best - 1));
+  cq->n--;
+  batch[nb++] = query;
+
+  if (can_coalesce(query)) {
+    for (i = 0, j = 0; i < cq->n; i++) {
+      if (nb < cq->maxbatch && can_coalesce(cq->cmd[i]) && cq->cmd[i]->dbx == query->dbx && ! is_busy(cq, cq->cmd[i]->sock)) {
+        for (k = 0; k < nb; k++)
+          if (batch[k]->sock == cq->cmd[i]->sock) break;
+        if (k == nb) { batch[nb++] = cq->cmd[i]; continue; }
+      }
+      cq->cmd[j++] = cq->cmd[i];
+    }
+    cq->n = j;
+  }
+
+  if (query->cmd_type == HMMD_CMD_SEARCH || query->cmd_type == HMMD_CMD_SCAN) {
+    for (i = 0; i < nb; i++) {
+      if (cq->nbusy == cq->nbusyalloc) {
+        cq->nbusyalloc *= 2;
+        if ((cq->busy = realloc(cq->busy, sizeof(int) * cq->nbusyalloc)) == NULL) LOG_FATAL_MSG("realloc", errno);
+      }
+      cq->busy[cq->nbusy++] = batch[i]->sock;
+    }
+    cq->nrun++;
+  }
+
+  if ((n = pthread_mutex_unlock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+  *ret_n = nb;
+}
+
+/* cmdqueue_Release()
+ * A search is done with the workers, so another can start on them
+ * while it sends its results.
+ */
+static void
+cmdqueue_Release(CMD_QUEUE *cq)
+{
+  int n;
+
+  if ((n = pthread_mutex_lock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  cq->nrun--;
+  if ((n = pthread_cond_broadcast(&cq->cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* cmdqueue_Done()
+ * A search from the client on socket <sock> is finished and its
+ * results sent, so the client's next search can start.
+ */
+static void
+cmdqueue_Done(CMD_QUEUE *cq, int sock)
+{
+  int i, n;
+
+  if ((n = pthread_mutex_lock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for (i = 0; i < cq->nbusy; i++)
+    if (cq->busy[i] == sock) {
+      cq->busy[i] = cq->busy[--cq->nbusy];
+      break;
+    }
+  if ((n = pthread_cond_broadcast(&cq->cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* cmdqueue_Discard()
+ * Remove and free all the waiting commands from the client on
+ * socket <sock>, because we're closing that client down.
+ */
+static void
+cmdqueue_Discard(CMD_QUEUE *cq, int sock)
+{
+  int i, j, n;
+
+  if ((n = pthread_mutex_lock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for (i = 0, j = 0; i < cq->n; i++) {
+    if (cq->cmd[i]->sock == sock) free_QueueData(cq->cmd[i]);
+    else                          cq->cmd[j++] = cq->cmd[i];
+  }
+  cq->n = j;
+  if ((n = pthread_mutex_unlock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+static void
+cmdqueue_Destroy(CMD_QUEUE *cq)
+{
+  int i;
+
+  if (cq == NULL) return;
+  for (i = 0; i < cq->n; i++) free_QueueData(cq->cmd[i]);
+  pthread_mutex_destroy(&cq->mutex);
+  pthread_cond_destroy(&cq->cond);
+  free(cq->cmd);
+  free(cq->busy);
+  free(cq);
+}
+
+/* cmdqueue_Idle()
+ * TRUE if the client on socket <sock> has no search in progress and
+ * no command waiting, so that whatever it is sent next is the answer
+ * to its next query.
+ */
+static int
+cmdqueue_Idle(CMD_QUEUE *cq, int sock)
+{
+  int idle;
+  int i, n;
+
+  if ((n = pthread_mutex_lock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  idle = ! is_busy(cq, sock);
+  for (i = 0; idle && i < cq->n; i++)
+    if (cq->cmd[i]->sock == sock) idle = FALSE;
+  if ((n = pthread_mutex_unlock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+  return idle;
+}
+
+/* rescache_Create()
+ * Create a cache for up to <maxmem> bytes of results of searches
+ * of databases at version <db_version>.
+ */
+static RESULT_CACHE *
+rescache_Create(uint64_t maxmem, int db_version)
+{
+  RESULT_CACHE *rc = NULL;
+  int           n;
+
+  if ((rc = malloc(sizeof(RESULT_CACHE))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  rc->nbuckets   = 1024;
+  rc->n          = 0;
+  rc->head       = NULL;
+  rc->tail       = NULL;
+  rc->mem        = 0;
+  rc->maxmem     = maxmem;
+  rc->db_version = db_version;
+  rc->nhit       = 0;
+  rc->nmiss      = 0;
+  if ((rc->bucket = calloc(rc->nbuckets, sizeof(RESCACHE_ENTRY *))) == NULL) LOG_FATAL_MSG("calloc", errno);
+
+  if ((n = pthread_mutex_init(&rc->mutex, NULL)) != 0) LOG_FATAL_MSG("mutex init", n);
+  return rc;
+}
+
+static int
+rescache_Version(RESULT_CACHE *rc)
+{
+  int version;
+  int n;
+
+  if ((n = pthread_mutex_lock (&rc->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  version = rc->db_version;
+  if ((n = pthread_mutex_unlock (&rc->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+  return version;
+}
+
+/* rescache_find()
+ * Return the entry for <key>, or NULL. Caller holds the cache's mutex.
+ */
+static RESCACHE_ENTRY *
+rescache_find(RESULT_CACHE *rc, uint64_t hash, char *key, uint32_t keylen)
+{
+  RESCACHE_ENTRY *e;
+
+  for (e = rc->bucket[hash % rc->nbuckets]; e != NULL; e = e->hnext)
+    if (e->hash == hash && e->keylen == keylen && memcmp(e->key, key, keylen) == 0) return e;
+  return NULL;
+}
+
+/* rescache_unlink()
+ * Take entry <e> out of the hash table and the LRU list. Caller holds
+ * the cache's mutex.
+ */
+static void
+rescache_unlink(RESULT_CACHE *rc, RESCACHE_ENTRY *e)
+{
+  RESCACHE_ENTRY **pp;
+
+  for (pp = &rc->bucket[e->hash % rc->nbuckets]; *pp != e; pp = &(*pp)->hnext) ;
+  *pp = e->hnext;
+
+  if (e->prev) e->prev->next = e->next; else rc->head = e->next;
+  if (e->next) e->next->prev = e->prev; else rc->tail = e->prev;
+
+  rc->mem -= sizeof(RESCACHE_ENTRY) + e->keylen + e->datalen;
+  rc->n--;
+}
+
+static void
+rescache_free_entry(RESCACHE_ENTRY *e)
+{
+  free(e->key);
+  free(e->data);
+  free(e);
+}
+
+/* rescache_Get()
+ * If the results of the search <query> are cached, return a copy of
+ * them in <*ret_data>, <*ret_len> bytes, and make them the most
+ * recently used. Returns TRUE on a hit, FALSE on a miss. A miss is
+ * counted only if <is_last>, the last look before the search goes to
+ * the workers.
+ */
+static int
+rescache_Get(RESULT_CACHE *rc, QUEUE_DATA *query, int is_last, uint8_t **ret_data, uint64_t *ret_len)
+{
+  RESCACHE_ENTRY *e;
+  int             n;
+
+  *ret_data = NULL;
+  *ret_len  = 0;
+  if (query->key == NULL) return FALSE;
+
+  if ((n = pthread_mutex_lock (&rc->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if ((e = rescache_find(rc, query->hash, query->key, query->keylen)) != NULL) {
+    if (e != rc->head) {
+      e->prev->next = e->next;
+      if (e->next) e->next->prev = e->prev; else rc->tail = e->prev;
+      e->prev        = NULL;
+      e->next        = rc->head;
+      rc->head->prev = e;
+      rc->head       = e;
+    }
+    if ((*ret_data = malloc(e->datalen)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    memcpy(*ret_data, e->data, e->datalen);
+    *ret_len = e->datalen;
+    rc->nhit++;
+  } else if (is_last) {
+    rc->nmiss++;
+  }
+  if ((n = pthread_mutex_unlock (&rc->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  return (e != NULL);
+}
+
+/* rescache_Put()
+ * Cache <len> bytes of results, <data>, of the search <query>, making
+ * room for them by dropping the least recently used. The cache takes
+ * <data> over. Results bigger than the whole cache aren't kept.
+ */
+static void
+rescache_Put(RESULT_CACHE *rc, QUEUE_DATA *query, uint8_t *data, uint64_t len)
+{
+  RESCACHE_ENTRY  *e     = NULL;
+  RESCACHE_ENTRY  *old   = NULL;
+  int              ndrop = 0;
+  uint64_t         size;
+  int              i, n;
+
+  size = sizeof(RESCACHE_ENTRY) + query->keylen + len;
+  if (query->key == NULL || size > rc->maxmem) { free(data); return; }
+
+  if ((e = malloc(sizeof(RESCACHE_ENTRY))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((e->key  = malloc(query->keylen))    == NULL) LOG_FATAL_MSG("malloc", errno);
+  memcpy(e->key,  query->key, query->keylen);
+  e->data    = data;
+  e->hash    = query->hash;
+  e->keylen  = query->keylen;
+  e->datalen = len;
+
+  if ((n = pthread_mutex_lock (&rc->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  /* two of the same search may have run at once; keep the newer */
+  if ((old = rescache_find(rc, e->hash, e->key, e->keylen)) != NULL) {
+    rescache_unlink(rc, old);
+    rescache_free_entry(old);
+  }
+
+  /* drop the least recently used until there's room */
+  while (rc->mem + size > rc->maxmem) {
+    RESCACHE_ENTRY *lru = rc->tail;
+    rescache_unlink(rc, lru);
+    rescache_free_entry(lru);
+    ndrop++;
+  }
+
+  /* keep the hash chains short */
+  if (rc->n + 1 > 2 * rc->nbuckets) {
+    RESCACHE_ENTRY **bucket;
+    RESCACHE_ENTRY  *p, *next;
+
+    if ((bucket = calloc(rc->nbuckets * 2, sizeof(RESCACHE_ENTRY *))) == NULL) LOG_FATAL_MSG("calloc", errno);
+    for (i = 0; i < rc->nbuckets; i++)
+      for (p = rc->bucket[i]; p != NULL; p = next) {
+        next     = p->hnext;
+        p->hnext = bucket[p->hash % (rc->nbuckets * 2)];
+        bucket[p->hash % (rc->nbuckets * 2)] = p;
+      }
+    free(rc->bucket);
+    rc->bucket    = bucket;
+    rc->nbuckets *= 2;
+  }
+
+  e->hnext = rc->bucket[e->hash % rc->nbuckets];
+  rc->bucket[e->hash % rc->nbuckets] = e;
+  e->prev  = NULL;
+  e->next  = rc->head;
+  if (rc->head) rc->head->prev = e; else rc->tail = e;
+  rc->head = e;
+  rc->mem += size;
+  rc->n++;
+
+  if ((n = pthread_mutex_unlock (&rc->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if (ndrop > 0) printf("Result cache dropped %d old results\n", ndrop);
+}
+
+/* rescache_Log()
+ * Print the cache's hit and miss counts and its size.
+ */
+static void
+rescache_Log(RESULT_CACHE *rc)
+{
+  int n;
+
+  if ((n = pthread_mutex_lock (&rc->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  printf("Result cache: %" PRIu64 " hits  %" PRIu64 " misses  %d results  %" PRIu64 " bytes\n", rc->nhit, rc->nmiss, rc->n, rc->mem);
+  if ((n = pthread_mutex_unlock (&rc->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+  fflush(stdout);
+}
+
+static void
+rescache_Destroy(RESULT_CACHE *rc)
+{
+  RESCACHE_ENTRY *e, *next;
+
+  if (rc == NULL) return;
+  for (e = rc->head; e != NULL; e = next) {
+    next = e->next;
+    rescache_free_entry(e);
+  }
+  pthread_mutex_destroy(&rc->mutex);
+  free(rc->bucket);
+  free(rc);
+}
+
+/* rescache_Send()
+ * If the results of the search <query> are cached, send them to its
+ * client and return TRUE; else return FALSE. <is_last> as for
+ * rescache_Get().
+ */
+static int
+rescache_Send(RESULT_CACHE *rc, QUEUE_DATA *query, int is_last)
+{
+  uint8_t  *data = NULL;
+  uint64_t  len;
+
+  if (! rescache_Get(rc, query, is_last, &data, &len)) return FALSE;
+
+  if (writen(query->sock, data, len) != len)
+    p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
+  else
+    printf("Cached results for %s (%d) sent %" PRIu64 " bytes\n", query->ip_addr, query->sock, len);
+  rescache_Log(rc);
+
+  free(data);
+  return TRUE;
+}
+
+static void
+key_append(char **key, uint32_t *len, uint32_t *nalloc, const void *p, uint32_t n)
+{
+  while (*len + n > *nalloc) {
+    *nalloc *= 2;
+    if ((*key = realloc(*key, *nalloc)) == NULL) LOG_FATAL_MSG("realloc", errno);
+  }
+  memcpy(*key + *len, p, n);
+  *len += n;
+}
+
+static void
+key_append_string(char **key, uint32_t *len, uint32_t *nalloc, const char *s)
+{
+  if (s == NULL) s = "";
+  key_append(key, len, nalloc, s, strlen(s) + 1);
+}
+
+/* search_key()
+ * Set the result cache key of the search <query>, and its hash: the
+ * database version <db_version>, the command and database, the value
+ * of every search option that can change the results, and everything
+ * in the query that a worker uses. Options that default are spelled
+ * out, so searches that differ only in which defaults they name share
+ * a key. A search whose results can't be reused (--profile timings,
+ * or a --mxfile that could change on disk) gets no key.
+ */
+static void
+search_key(QUEUE_DATA *query, int db_version)
+{
+  ESL_GETOPTS *go     = query->opts;
+  char        *key    = NULL;
+  uint32_t     len    = 0;
+  uint32_t     nalloc = 1024;
+  uint64_t     hash   = 14695981039346656037ULL;  /* FNV-1a */
+  char         hdr[64];
+  uint32_t     i;
+
+  query->key    = NULL;
+  query->keylen = 0;
+  query->hash   = 0;
+
+  if (query->cmd_type != HMMD_CMD_SEARCH && query->cmd_type != HMMD_CMD_SCAN) return;
+  if (esl_opt_GetBoolean(go, "--profile") || esl_opt_IsUsed(go, "--mxfile"))  return;
+
+  if ((key = malloc(nalloc)) == NULL) LOG_FATAL_MSG("malloc", errno);
+
+  snprintf(hdr, sizeof(hdr), "%d %u %d", db_version, query->cmd_type, query->dbx);
+  key_append_string(&key, &len, &nalloc, hdr);
+
+  for (i = 0; i < go->nopts; i++) {
+    if (strcmp(go->opt[i].name, "--priority") == 0) continue;
+    if (go->val[i] == NULL) continue;
+    key_append_string(&key, &len, &nalloc, go->opt[i].name);
+    key_append_string(&key, &len, &nalloc, go->val[i]);
+  }
+
+  if (query->seq != NULL) {
+    ESL_SQ *sq = query->seq;
+    key_append_string(&key, &len, &nalloc, sq->name);
+    key_append_string(&key, &len, &nalloc, sq->desc);
+    key_append(&key, &len, &nalloc, &sq->n,  sizeof(sq->n));
+    key_append(&key, &len, &nalloc, sq->dsq, sq->n + 2);
+  } else {
+    P7_HMM *hmm = query->hmm;
+    int     K   = query->abc->K;
+    int     n   = hmm->M + 2;
+    key_append_string(&key, &len, &nalloc, hmm->name);
+    key_append_string(&key, &len, &nalloc, hmm->acc);
+    key_append_string(&key, &len, &nalloc, hmm->desc);
+    key_append(&key, &len, &nalloc, &hmm->M,         sizeof(hmm->M));
+    key_append(&key, &len, &nalloc, &hmm->flags,     sizeof(hmm->flags));
+    key_append(&key, &len, &nalloc, &hmm->max_length, sizeof(hmm->max_length));
+    key_append(&key, &len, &nalloc, hmm->evparam,    sizeof(hmm->evparam));
+    key_append(&key, &len, &nalloc, hmm->cutoff,     sizeof(hmm->cutoff));
+    key_append(&key, &len, &nalloc, hmm->compo,      sizeof(hmm->compo));
+    key_append(&key, &len, &nalloc, *hmm->t,   sizeof(float) * (hmm->M + 1) * p7H_NTRANSITIONS);
+    key_append(&key, &len, &nalloc, *hmm->mat, sizeof(float) * (hmm->M + 1) * K);
+    key_append(&key, &len, &nalloc, *hmm->ins, sizeof(float) * (hmm->M + 1) * K);
+    if (hmm->flags & p7H_RF)    key_append(&key, &len, &nalloc, hmm->rf,        n);
+    if (hmm->flags & p7H_MMASK) key_append(&key, &len, &nalloc, hmm->mm,        n);
+    if (hmm->flags & p7H_CONS)  key_append(&key, &len, &nalloc, hmm->consensus, n);
+    if (hmm->flags & p7H_CS)    key_append(&key, &len, &nalloc, hmm->cs,        n);
+    if (hmm->flags & p7H_CA)    key_append(&key, &len, &nalloc, hmm->ca,        n);
+    if (hmm->flags & p7H_MAP)   key_append(&key, &len, &nalloc, hmm->map,       sizeof(int) * (hmm->M + 1));
+  }
+
+  for (i = 0; i < len; i++) {
+    hash ^= (uint8_t) key[i];
+    hash *= 1099511628211ULL;
+  }
+
+  query->key    = key;
+  query->keylen = len;
+  query->hash   = hash;
+}
+
 static int
 validate_workers(WORKERSIDE_ARGS *args)
 {
@@ -262,11 +911,11 @@ update_workers(WORKERSIDE_ARGS *args)
     args->ready++;
   }
 
-  /* remove any workers who have failed */
+  /* remove any workers who have failed, unless a search has yet to gather them */
   worker = args->head;
   while (args->failed > 0 && worker != NULL) {
     WORKER_DATA *next =  worker->next;
-    if (worker->terminated) {
+    if (worker->terminated && worker->share == NULL) {
       --args->failed;
       --args->ready;
       if (args->head == worker && args->tail == worker) {
@@ -290,36 +939,158 @@ update_workers(WORKERSIDE_ARGS *args)
   assert(validate_workers(args));
 }
 
+/* acquire_workers()
+ * Give a search its share of the workers: an equal split of the live
+ * ones between the <maxrun> searches that may run at once, or as many
+ * of those as are free. Waits for a worker to come free if none is.
+ * Caller holds <work_mutex>. <share->n> is 0 on return only if there
+ * are no live workers at all.
+ */
 static void
-process_search(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
+acquire_workers(WORKERSIDE_ARGS *args, int maxrun, WORKER_SHARE *share)
+{
+  WORKER_DATA *worker;
+  int          nlive;
+  int          nfree;
+  int          want;
+  int          n;
+
+  share->n         = 0;
+  share->completed = 0;
+
+  for ( ;; ) {
+    /* build a list of the currently available workers */
+    update_workers(args);
+
+    nlive = nfree = 0;
+    for (worker = args->head; worker != NULL; worker = worker->next)
+      if (! worker->terminated) {
+        nlive++;
+        if (worker->share == NULL) nfree++;
+      }
+    if (nlive == 0) return;
+    if (nfree > 0)  break;
+
+    if ((n = pthread_cond_wait(&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+  }
+
+  want = ESL_MIN(nfree, (nlive + maxrun - 1) / maxrun);
+  if ((share->worker = malloc(sizeof(WORKER_DATA *) * want)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  for (worker = args->head; worker != NULL && share->n < want; worker = worker->next)
+    if (! worker->terminated && worker->share == NULL) {
+      worker->share = share;
+      share->worker[share->n++] = worker;
+    }
+}
+
+/* release_workers()
+ * Return a search's workers to the free pool, freeing anything of
+ * theirs that gather_results() didn't take. Caller holds <work_mutex>.
+ */
+static void
+release_workers(WORKERSIDE_ARGS *args, WORKER_SHARE *share)
+{
+  WORKER_DATA   *worker;
+  WORKER_RESULT *wr;
+  int            i, j, q, n;
+
+  for (i = 0; i < share->n; i++) {
+    worker = share->worker[i];
+    for (q = 0; q < worker->nres; q++) {
+      wr = &worker->res[q];
+      if (wr->err_buf != NULL) free(wr->err_buf);
+      if (wr->hits    != NULL) {
+        for (j = 0; j < wr->allocated_hits; j++) p7_hit_Destroy(wr->hits[j]);
+        free(wr->hits);
+      }
+      wr->err_buf = NULL;
+      wr->hits    = NULL;
+    }
+    worker->nres      = 0;
+    worker->completed = 0;
+    worker->share     = NULL;
+  }
+  free(share->worker);
+  share->worker    = NULL;
+  share->n         = 0;
+  share->completed = 0;
+
+  /* wake up any search waiting for a worker */
+  if ((n = pthread_cond_broadcast(&args->complete_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+}
+
+/* batch_command()
+ * Build the one command that runs the <nquery> searches in <query> on
+ * the workers: a HMMD_CMD_BATCH carrying each search's own command.
+ */
+static HMMD_COMMAND *
+batch_command(QUEUE_DATA **query, int nquery)
+{
+  HMMD_COMMAND *cmd = NULL;
+  char         *p;
+  int           size;
+  int           q;
+
+  size = sizeof(HMMD_HEADER) + sizeof(HMMD_BATCH_CMD);
+  for (q = 0; q < nquery; q++) size += MSG_SIZE(query[q]->cmd);
+
+  if ((cmd = malloc(size)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(cmd, 0, size);		/* avoid uninitialized bytes. remove this, if we ever serialize/deserialize structures properly */
+
+  cmd->hdr.length    = size - sizeof(HMMD_HEADER);
+  cmd->hdr.command   = HMMD_CMD_BATCH;
+  cmd->batch.db_inx  = query[0]->dbx;
+  cmd->batch.nquery  = nquery;
+
+  p = cmd->batch.data;
+  for (q = 0; q < nquery; q++) {
+    memcpy(p, query[q]->cmd, MSG_SIZE(query[q]->cmd));
+    p += MSG_SIZE(query[q]->cmd);
+  }
+  return cmd;
+}
+
+/* process_search()
+ * Run the <nquery> searches in <query> on a share of the workers and
+ * send each client its results. More than one is a batch of --seqdb
+ * searches of the same database, which the workers run in one sweep.
+ */
+static void
+process_search(WORKERSIDE_ARGS *args, CMD_QUEUE *cmdq, QUEUE_DATA **query, int nquery, RANGE_LIST *range_list)
 {
   ESL_STOPWATCH  *w          = NULL;      /* timer used for profiling statistics             */
   WORKER_DATA    *worker     = NULL;
-  SEARCH_RESULTS  results;
+  WORKER_SHARE    share;                  /* the workers this search is running on           */
+  SEARCH_RESULTS *results    = NULL;      /* one per query                                   */
+  HMMD_COMMAND   *cmd        = NULL;      /* what the workers run                            */
   int n;
   int cnt;
   int inx;
   int ready_workers;    /* counter variable used to track the number of workers currently available to receive work; short for "remaining", I imagine */
+  int nworkers;
   int tries;
-  int i;
+  int i, q;
 
 
-  memset(&results, 0, sizeof(SEARCH_RESULTS)); /* avoid valgrind bitching about uninit bytes; remove, if we ever serialize structs properly */
+  memset(&share,   0, sizeof(WORKER_SHARE));
 
   /* figure out the size of the database we are searching */
-  if (query->cmd_type == HMMD_CMD_SEARCH) {
-    if((args->seq_db == NULL)||(args->seq_db->db == NULL)|| (query->dbx >= args->seq_db->db_cnt) || (query->dbx < 0)){
+  if (query[0]->cmd_type == HMMD_CMD_SEARCH) {
+    if((args->seq_db == NULL)||(args->seq_db->db == NULL)|| (query[0]->dbx >= args->seq_db->db_cnt) || (query[0]->dbx < 0)){
       // Client is attempting to search a database that does not exist, complain and abort search
-      client_msg(query->sock, eslFAIL, "Specified sequence database has not been loaded into the daemon. \n");
+      cmdqueue_Release(cmdq);
+      for (q = 0; q < nquery; q++)
+        client_msg(query[q]->sock, eslFAIL, "Specified sequence database has not been loaded into the daemon. \n");
       return;
     }
     else{ 
-      cnt = args->seq_db->db[query->dbx].count;
+      cnt = args->seq_db->db[query[0]->dbx].count;
     }
   } else {
     if(args->hmm_db == NULL){
       // Client is attempting to search a database that does not exist, complain and abort search
-      client_msg(query->sock, eslFAIL, "No HMM database has been loaded into the daemon. \n");
+      cmdqueue_Release(cmdq);
+      client_msg(query[0]->sock, eslFAIL, "No HMM database has been loaded into the daemon. \n");
       return;
     }
     else{ 
@@ -330,13 +1101,18 @@ process_search(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
   // start timer after we make sure the relevant database exists to make cleanup easier on error
   w = esl_stopwatch_Create();
   esl_stopwatch_Start(w);
-  init_results(&results);
+
+  if ((results = malloc(sizeof(SEARCH_RESULTS) * nquery)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(results, 0, sizeof(SEARCH_RESULTS) * nquery); /* avoid valgrind bitching about uninit bytes; remove, if we ever serialize structs properly */
+  for (q = 0; q < nquery; q++) init_results(&results[q]);
+
+  cmd = (nquery > 1) ? batch_command(query, nquery) : query[0]->cmd;
 
   //if range(s) are given, count how many of the seqdb's sequences are within supplied range(s)
-  if (args->range_list) { // can only happen in HMMD_CMD_SEARCH case
+  if (range_list) { // can only happen in HMMD_CMD_SEARCH case
     int range_cnt = 0; // this will now count how many of the seqs in the db are within the range
     for (i=0; i<cnt; i++) {
-      if ( hmmpgmd_IsWithinRanges(args->seq_db->list[i].idx, args->range_list ) )
+      if ( hmmpgmd_IsWithinRanges(args->seq_db->list[i].idx, range_list ) )
         range_cnt++;
     }
     cnt = range_cnt;
@@ -346,33 +1122,41 @@ process_search(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
   inx = 0;
   tries = 0;
   do {
-    /* process any changes to the available workers */
+    for (q = 0; q < nquery; q++) results[q].errors = 0;
+
     if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
-    /* build a list of the currently available workers */
-    update_workers(args);
+    /* take this search's share of the workers; if there are none, report an error */
+    acquire_workers(args, cmdq->maxrun, &share);
+    nworkers = share.n;
 
-    /* if there are no workers, report an error */
-    if (args->ready > 0) {
-      ready_workers = args->ready;
+    if (nworkers > 0) {
+      ready_workers = nworkers;
 
       /* update the workers search information */
-      worker = args->head;
-
-      while (worker != NULL) {
-        worker->cmd        = query->cmd;
+      for (i = 0; i < nworkers; i++) {
+        worker             = share.worker[i];
+        worker->cmd        = cmd;
         worker->completed  = 0;
         worker->total      = 0;
 
+        /* room for what it sends back for each query */
+        if (worker->nresalloc < nquery) {
+          if ((worker->res = realloc(worker->res, sizeof(WORKER_RESULT) * nquery)) == NULL) LOG_FATAL_MSG("realloc", errno);
+          worker->nresalloc = nquery;
+        }
+        memset(worker->res, 0, sizeof(WORKER_RESULT) * nquery);
+        worker->nres = nquery;
+
         /* assign each worker a portion of the database */
         worker->srch_inx = inx;
-        if (args->range_list) {
+        if (range_list) {
           // if ranges are given, need to split the db list based on which elements in the list are within the given range(s)
           int goal = cnt / ready_workers; //how many within-range sequences do I want to ask this worker to handle
           int curr = 0;                   //how many within-range sequences have I seen since the start of this full-db range
           worker->srch_cnt = 0;
           while (curr < goal) {
-            if ( hmmpgmd_IsWithinRanges (args->seq_db->list[inx].idx, args->range_list ) )
+            if ( hmmpgmd_IsWithinRanges (args->seq_db->list[inx].idx, range_list ) )
                 curr++;
             worker->srch_cnt++;
             inx++;
@@ -386,61 +1170,122 @@ process_search(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
         }
 
         --ready_workers;
-        worker            = worker->next;
       }
 
-      args->completed = 0;
-
       /* notify all the worker threads of the new query */
       if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
-    }
-
-    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
-
-    if (args->ready > 0) {
-      /* Wait for all the workers to complete */
-      if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
-      while (args->completed < args->ready) {
+      /* Wait for all our workers to complete */
+      while (share.completed < share.n) {
         if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
       }
-
-      if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
     }
 
-    /* gather up the results from all the workers */
-    gather_results(query, args, &results);
+    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
+
+    if (nworkers == 0) break;
+
+    /* gather up the results from our workers, and free them for the next search */
+    gather_results(query, nquery, args, &share, results);
 
     /* we can recover from one worker crashing.  get the block that worker ran on
      * and redistribute its load to all the remaining workers.
      */
-    inx = results.db_inx;
-    cnt = results.db_cnt;
+    inx = results[0].db_inx;
+    cnt = results[0].db_cnt;
     ++tries;
 
-  } while (args->ready > 0 && results.errors == 1 && tries < 2);
+  } while (results[0].errors == 1 && tries < 2);
 
+  /* the next search can have the workers while we send these results */
+  cmdqueue_Release(cmdq);
 
   esl_stopwatch_Stop(w);
 
-  /* copy the search stats */
-  results.stats.elapsed = w->elapsed;
-  results.stats.user    = w->user;
-  results.stats.sys     = w->sys;
-  results.stats.hit_offsets = NULL; // set this to make sure we allocate memory later
-  /* TODO: check for errors */
-  if (args->ready == 0) {
-    client_msg(query->sock, eslFAIL, "No compute nodes available\n");
-  } else if (args->failed > 0) {
-    client_msg(query->sock, eslFAIL, "Errors running search\n");
-    clear_results(args, &results);
-  } else {
-    forward_results(query, &results);  
+  for (q = 0; q < nquery; q++) {
+    /* copy the search stats */
+    results[q].stats.elapsed = w->elapsed;
+    results[q].stats.user    = w->user;
+    results[q].stats.sys     = w->sys;
+    results[q].stats.hit_offsets = NULL; // set this to make sure we allocate memory later
+    /* TODO: check for errors */
+    if (nworkers == 0) {
+      client_msg(query[q]->sock, eslFAIL, "No compute nodes available\n");
+      clear_results(&results[q]);
+    } else if (results[q].errors > 0) {
+      client_msg(query[q]->sock, eslFAIL, "Errors running search\n");
+      clear_results(&results[q]);
+    } else {
+      forward_results(args->cache, query[q], &results[q]);  
+    }
   }
 
+  if (cmd != query[0]->cmd) free(cmd);
+  free(results);
   esl_stopwatch_Destroy(w);
 }
 
+/* search_thread()
+ * Run one search, or a batch of them, and send the results back to the
+ * clients, on a thread of its own so that other searches can run at
+ * the same time.
+ */
+static void *
+search_thread(void *arg)
+{
+  SEARCH_ARGS *data       = (SEARCH_ARGS *) arg;
+  QUEUE_DATA  *query      = NULL;
+  RANGE_LIST  *range_list = NULL;  /* (optional) list of ranges searched within the seqdb; never in a batch */
+  int          sock;
+  int          nquery;
+  int          q;
+
+  /* Guarantees that thread resources are deallocated upon return */
+  pthread_detach(pthread_self()); 
+
+  /* answer repeats of recent searches from the result cache: ones that
+   * waited behind their client's earlier searches, or whose first copy
+   * finished while they waited
+   */
+  for (q = 0, nquery = 0; q < data->nquery; q++) {
+    if (data->comm->cache != NULL && rescache_Send(data->comm->cache, data->query[q], TRUE)) {
+      sock = data->query[q]->sock;
+      free_QueueData(data->query[q]);
+      cmdqueue_Done(data->cmdq, sock);
+    } else {
+      data->query[nquery++] = data->query[q];
+    }
+  }
+  data->nquery = nquery;
+
+  if (nquery == 0) {
+    cmdqueue_Release(data->cmdq);
+  } else {
+    query = data->query[0];
+    if (query->cmd_type == HMMD_CMD_SEARCH && esl_opt_IsUsed(query->opts, "--seqdb_ranges")) {
+      if ((range_list = malloc(sizeof(RANGE_LIST))) == NULL) LOG_FATAL_MSG("malloc", errno);
+      hmmpgmd_GetRanges(range_list, esl_opt_GetString(query->opts, "--seqdb_ranges"));
+    }
+
+    process_search(data->comm, data->cmdq, data->query, data->nquery, range_list);
+  }
+
+  if (range_list) {
+    if (range_list->starts)  free(range_list->starts);
+    if (range_list->ends)    free(range_list->ends);
+    free (range_list);
+  }
+  for (q = 0; q < data->nquery; q++) {
+    sock = data->query[q]->sock;
+    free_QueueData(data->query[q]);
+    cmdqueue_Done(data->cmdq, sock);
+  }
+  free(data->query);
+  free(data);
+
+  pthread_exit(NULL);
+}
+
 static void
 process_shutdown(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
 {
@@ -514,11 +1359,19 @@ master_process(ESL_GETOPTS *go)
 {
   P7_SEQCACHE        *seq_db     = NULL;
   P7_HMMCACHE        *hmm_db     = NULL;
-  ESL_STACK          *cmdstack   = NULL; /* stack of commands that clients want done */
+  CMD_QUEUE          *cmdq       = NULL; /* commands that clients want done */
+  RESULT_CACHE       *cache      = NULL; /* results of recent searches, if --cache */
   QUEUE_DATA         *query      = NULL;
+  QUEUE_DATA        **batch      = NULL; /* commands to start together */
+  int                 nbatch;
+  int                 maxbatch   = esl_opt_GetInteger(go, "--coalesce");
+  SEARCH_ARGS        *sargs      = NULL;
   CLIENTSIDE_ARGS     client_comm;
   WORKERSIDE_ARGS     worker_comm;
-  int                 n;
+  pthread_t           thread_id;
+  char               *sched      = esl_opt_GetString(go, "--sched");
+  int                 by_priority;
+  int                 n, q;
   int                 shutdown;
   char                errbuf[eslERRBUFSIZE]; 
   int                 status     = eslOK;
@@ -526,6 +1379,10 @@ master_process(ESL_GETOPTS *go)
   impl_Init();
   p7_FLogsumInit();     /* we're going to use table-driven Logsum() approximations at times */
 
+  if      (strcmp(sched, "fifo")     == 0) by_priority = FALSE;
+  else if (strcmp(sched, "priority") == 0) by_priority = TRUE;
+  else    p7_Fail("--sched must be fifo or priority\n");
+
   if (esl_opt_IsUsed(go, "--seqdb")) {
     char *name = esl_opt_GetString(go, "--seqdb");
     if ((status = p7_seqcache_Open(name, &seq_db, errbuf)) != eslOK) 
@@ -556,13 +1413,17 @@ master_process(ESL_GETOPTS *go)
   printf("Data loaded into memory. Master is ready.\n");
   setvbuf (stdout, NULL, _IOFBF, BUFSIZ);
 
-  /* initialize the search stack, set it up for interthread communication  */
-  cmdstack = esl_stack_PCreate();
-  esl_stack_UseMutex(cmdstack);
-  esl_stack_UseCond(cmdstack);
+  /* initialize the command queue, shared by the client threads and the searches */
+  cmdq = cmdqueue_Create(esl_opt_GetInteger(go, "--nqueries"), maxbatch, by_priority);
+  if ((batch = malloc(sizeof(QUEUE_DATA *) * maxbatch)) == NULL) LOG_FATAL_MSG("malloc", errno);
+
+  /* the result cache, for searches of the databases as loaded: version 1 */
+  if (esl_opt_GetInteger(go, "--cache") > 0)
+    cache = rescache_Create((uint64_t) esl_opt_GetInteger(go, "--cache") * 1024 * 1024, 1);
 
   /* start the communications with the web clients */
-  client_comm.cmdstack = cmdstack;
+  client_comm.cmdq  = cmdq;
+  client_comm.cache = cache;
   setup_clientside_comm(go, &client_comm);
 
   /* initialize the worker structure */
@@ -578,6 +1439,7 @@ master_process(ESL_GETOPTS *go)
   worker_comm.seq_db     = seq_db;
   worker_comm.hmm_db     = hmm_db;
   worker_comm.db_version = 1;
+  worker_comm.cache      = cache;
 
   worker_comm.ready      = 0;
   worker_comm.failed     = 0;
@@ -587,79 +1449,59 @@ master_process(ESL_GETOPTS *go)
   setup_workerside_comm(go, &worker_comm);
 
   /* read query hmm/sequence 
-   * the PPop() will wait until a client pushes a command to the queue
+   * cmdqueue_Next() waits until a client pushes a command that can start.
+   * Each search runs on a thread of its own, so we can go straight on
+   * to the next one. Searches that were coalesced run on one thread.
    */
   shutdown = 0;
-  while (!shutdown &&  esl_stack_PPop(cmdstack, (void **) &query) == eslOK) {
-    printf("Processing command %d from %s\n", query->cmd_type, query->ip_addr);
+  while (!shutdown) {
+    cmdqueue_Next(cmdq, batch, &nbatch);
+    query = batch[0];
+    for (q = 0; q < nbatch; q++)
+      printf("Processing command %d from %s\n", batch[q]->cmd_type, batch[q]->ip_addr);
+    if (nbatch > 1) printf("Coalesced %d searches of seqdb %d\n", nbatch, query->dbx);
     fflush(stdout);
 
-    worker_comm.range_list = NULL;
-
     switch(query->cmd_type) {
     case HMMD_CMD_SEARCH:      
-      if (esl_opt_IsUsed(query->opts, "--seqdb_ranges")) {
-        ESL_ALLOC(worker_comm.range_list, sizeof(RANGE_LIST));
-        hmmpgmd_GetRanges(worker_comm.range_list, esl_opt_GetString(query->opts, "--seqdb_ranges"));
-      }
-      process_search(&worker_comm, query); 
+    case HMMD_CMD_SCAN:        
+      if ((sargs = malloc(sizeof(SEARCH_ARGS))) == NULL) LOG_FATAL_MSG("malloc", errno);
+      if ((sargs->query = malloc(sizeof(QUEUE_DATA *) * nbatch)) == NULL) LOG_FATAL_MSG("malloc", errno);
+      memcpy(sargs->query, batch, sizeof(QUEUE_DATA *) * nbatch);
+      sargs->nquery = nbatch;
+      sargs->comm   = &worker_comm;
+      sargs->cmdq   = cmdq;
+      if ((n = pthread_create(&thread_id, NULL, search_thread, sargs)) != 0) LOG_FATAL_MSG("thread create", n);
       break;
-    case HMMD_CMD_SCAN:        process_search(&worker_comm, query); break;
     case HMMD_CMD_SHUTDOWN:    
       process_shutdown(&worker_comm, query);
       p7_syslog(LOG_ERR,"[%s:%d] - shutting down...\n", __FILE__, __LINE__);
       shutdown = 1;
+      free_QueueData(query);
       break;
     default:
       p7_syslog(LOG_ERR,"[%s:%d] - unknown command %d from %s\n", __FILE__, __LINE__, query->cmd_type, query->ip_addr);
+      free_QueueData(query);
       break;
     }
-
-    free_QueueData(query);
   }
 
-  esl_stack_ReleaseCond(cmdstack);
-
   if (hmm_db) p7_hmmcache_Close(hmm_db);
   if (seq_db) p7_seqcache_Close(seq_db);
 
-  esl_stack_Destroy(cmdstack);
+  cmdqueue_Destroy(cmdq);
+  if (cache) rescache_Log(cache);
+  rescache_Destroy(cache);
+  free(batch);
 
   pthread_mutex_destroy(&worker_comm.work_mutex);
   pthread_cond_destroy(&worker_comm.start_cond);
   pthread_cond_destroy(&worker_comm.complete_cond);
 
-
-  if (worker_comm.range_list) {
-    if (worker_comm.range_list->starts)  free(worker_comm.range_list->starts);
-    if (worker_comm.range_list->ends)    free(worker_comm.range_list->ends);
-    free (worker_comm.range_list);
-  }
-
   return;
-
-
-ERROR:
-  p7_Fail("Memory allocation error. Code: %d\n",    status);
-
 }
 
 
-// Qsort comparison function to sort a list of pointers to P7_HITs
-static int
-hit_sorter2(const void *p1, const void *p2)
-{
-  int cmp;
-
-  const P7_HIT *h1 = *((P7_HIT **) p1);
-  const P7_HIT *h2 = *((P7_HIT **) p2);
-
-  cmp  = (h1->sortkey < h2->sortkey);
-  cmp -= (h1->sortkey > h2->sortkey);
-
-  return cmp;
-}
-
 static void
 init_results(SEARCH_RESULTS *results)
 {
@@ -676,6 +1518,7 @@ init_results(SEARCH_RESULTS *results)
   results->stats.n_past_bias = 0;
   results->stats.n_past_vit  = 0;
   results->stats.n_past_fwd  = 0;
+  memset(results->stats.prof, 0, sizeof(P7_PLI_PROFILE) * p7_PLI_NSTAGES);
   results->stats.Z           = 0;
 
   results->hits              = NULL;
@@ -687,90 +1530,175 @@ init_results(SEARCH_RESULTS *results)
 }
 
 static void
-gather_results(QUEUE_DATA *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results)
+gather_results(QUEUE_DATA **query, int nquery, WORKERSIDE_ARGS *comm, WORKER_SHARE *share, SEARCH_RESULTS *results)
 {
-  int cnt;
   int n;
-  int i0, i1;
-  WORKER_DATA *worker;
-
-  /* allocate spaces to hold all the hits */
-  cnt = results->nhits + MAX_WORKERS;
-  if ((results->hits = realloc(results->hits, sizeof(P7_HIT *) * cnt)) == NULL) LOG_FATAL_MSG("malloc", errno);
-
-  /* lock the workers until we have merged the results */
+  int i, j, q;
+  int nw     = share->n;
+  int k;			/* # of sorted hit arrays to merge                    */
+  int first;			/* lists[first..k-1] are workers' arrays, ours to free */
+  P7_HIT   ***whits  = NULL;	/* each worker's sorted hits for each query, [q*nw+i]  */
+  uint64_t   *wnhits = NULL;
+  P7_HIT   ***lists  = NULL;	/* hits so far (from an earlier try), and each worker's */
+  uint64_t   *nlist  = NULL;
+  uint64_t    nprev;
+  P7_HIT    **merged = NULL;
+  WORKER_DATA    *worker;
+  WORKER_RESULT  *wr;
+  SEARCH_RESULTS *r;
+
+  if ((whits  = calloc(nquery * nw + 1, sizeof(P7_HIT **))) == NULL) LOG_FATAL_MSG("calloc", errno);
+  if ((wnhits = calloc(nquery * nw + 1, sizeof(uint64_t)))  == NULL) LOG_FATAL_MSG("calloc", errno);
+
+  /* lock the workers until we have taken their results */
   if ((n = pthread_mutex_lock (&comm->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
-  /* count the number of hits */
-  cnt = results->nhits;
-  worker = comm->head;
-  while (worker != NULL) {
+  for (i = 0; i < nw; i++) {
+    worker = share->worker[i];
     if (worker->completed) {
-      uint32_t previous_hits = results->stats.nhits;
-
-      results->stats.nhits        += worker->stats.nhits;
-      results->stats.nreported    += worker->stats.nreported;
-      results->stats.nincluded    += worker->stats.nincluded;
-
-      results->stats.n_past_msv   += worker->stats.n_past_msv;
-      results->stats.n_past_bias  += worker->stats.n_past_bias;
-      results->stats.n_past_vit   += worker->stats.n_past_vit;
-      results->stats.n_past_fwd   += worker->stats.n_past_fwd;
-
-      results->stats.Z_setby       = worker->stats.Z_setby;
-      results->stats.domZ_setby    = worker->stats.domZ_setby;
-      results->stats.domZ          = worker->stats.domZ;
-      results->stats.Z             = worker->stats.Z;
-
-      results->status.msg_size    += worker->status.msg_size - sizeof(HMMD_SEARCH_STATS);
-
-      if((results->stats.nhits- previous_hits) >0){ // There are new hits to deal with
-        // Add enough space to the list of hits for all the hits from this worker
-        results->hits = realloc(results->hits, results->stats.nhits * sizeof (P7_HIT *));
-        if(results->hits == NULL){
-          LOG_FATAL_MSG("malloc", n);
+      for (q = 0; q < nquery; q++) {
+        r  = &results[q];
+        wr = &worker->res[q];
+
+        r->stats.nhits        += wr->stats.nhits;
+        r->stats.nreported    += wr->stats.nreported;
+        r->stats.nincluded    += wr->stats.nincluded;
+
+        r->stats.n_past_msv   += wr->stats.n_past_msv;
+        r->stats.n_past_bias  += wr->stats.n_past_bias;
+        r->stats.n_past_vit   += wr->stats.n_past_vit;
+        r->stats.n_past_fwd   += wr->stats.n_past_fwd;
+        for (j = 0; j < p7_PLI_NSTAGES; j++) {
+          r->stats.prof[j].ncalls += wr->stats.prof[j].ncalls;
+          r->stats.prof[j].ns     += wr->stats.prof[j].ns;
+          r->stats.prof[j].ncells += wr->stats.prof[j].ncells;
         }
 
-        // copy this worker's hits into the global list
-        for(i0 = 0, i1 = previous_hits; i1 < results->stats.nhits; i0++, i1++){
-          results->hits[i1] = worker->hits[i0];
-        }
+        r->stats.Z_setby       = wr->stats.Z_setby;
+        r->stats.domZ_setby    = wr->stats.domZ_setby;
+        r->stats.domZ          = wr->stats.domZ;
+        r->stats.Z             = wr->stats.Z;
 
-        free(worker->hits); //  Free the worker's array of pointers to hits.  The hits themselves
-        // will be freed by forward_results()
+        r->status.msg_size    += wr->status.msg_size - sizeof(HMMD_SEARCH_STATS);
 
-        worker->hits = NULL;  
+        if (wr->stats.nhits > 0) { // There are new hits to deal with
+          // Take over this worker's array of pointers to hits, which it sent in rank order.
+          // The hits themselves will be freed by forward_results()
+          whits[q*nw+i]  = wr->hits;
+          wnhits[q*nw+i] = wr->stats.nhits;
+          wr->hits = NULL;
+        }
+        ++r->nhits;
       }
       worker->completed   = 0;
-      ++cnt;
     } else {
-      results->errors++;
-      results->db_inx            = worker->srch_inx;
-      results->db_cnt            = worker->srch_cnt;
+      for (q = 0; q < nquery; q++) {
+        results[q].errors++;
+        results[q].db_inx      = worker->srch_inx;
+        results[q].db_cnt      = worker->srch_cnt;
+      }
     }
-
-    worker = worker->next;
   }
 
+  /* we have what we need from the workers; the next search can have them while we merge */
+  release_workers(comm, share);
+
   if ((n = pthread_mutex_unlock (&comm->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-  if (query->cmd_type == HMMD_CMD_SEARCH) {
-    results->stats.nmodels = 1;
-    results->stats.nseqs   = comm->seq_db->db[query->dbx].K;
-  } else {
-    results->stats.nseqs   = 1;
-    results->stats.nmodels = comm->hmm_db->n;
-  }
+  /* room for the sorted hit arrays of a query: what we already have, and one per worker */
+  if ((lists = malloc(sizeof(P7_HIT **) * (nw + 1))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((nlist = malloc(sizeof(uint64_t)  * (nw + 1))) == NULL) LOG_FATAL_MSG("malloc", errno);
+
+  for (q = 0; q < nquery; q++) {
+    r     = &results[q];
+    k     = 0;
+    first = 0;
+
+    nprev = r->stats.nhits;
+    for (i = 0; i < nw; i++) nprev -= wnhits[q*nw+i];
+    if (nprev > 0) {
+      lists[k]   = r->hits;
+      nlist[k++] = nprev;
+      first      = k;
+    }
+    for (i = 0; i < nw; i++)
+      if (whits[q*nw+i] != NULL) {
+        lists[k]   = whits[q*nw+i];
+        nlist[k++] = wnhits[q*nw+i];
+      }
+
+    /* k-way merge of the sorted arrays into one ranked list, instead of appending and sorting them all */
+    if (k > first) {
+      if ((merged = malloc(sizeof(P7_HIT *) * r->stats.nhits)) == NULL) LOG_FATAL_MSG("malloc", errno);
+      if (p7_tophits_MergeHitArrays(lists, nlist, k, merged, esl_threads_GetCPUCount()) != eslOK) LOG_FATAL_MSG("merge hits", ENOMEM);
+      for (j = first; j < k; j++) free(lists[j]);
+      free(r->hits);
+      r->hits = merged;
+    }
+
+    if (query[q]->cmd_type == HMMD_CMD_SEARCH) {
+      r->stats.nmodels = 1;
+      r->stats.nseqs   = comm->seq_db->db[query[q]->dbx].K;
+    } else {
+      r->stats.nseqs   = 1;
+      r->stats.nmodels = comm->hmm_db->n;
+    }
     
-  if (results->stats.Z_setby == p7_ZSETBY_NTARGETS) {
-    results->stats.Z = (query->cmd_type == HMMD_CMD_SEARCH) ? results->stats.nseqs : results->stats.nmodels;
+    if (r->stats.Z_setby == p7_ZSETBY_NTARGETS) {
+      r->stats.Z = (query[q]->cmd_type == HMMD_CMD_SEARCH) ? r->stats.nseqs : r->stats.nmodels;
+    }
+  }
+
+  free(lists);
+  free(nlist);
+  free(whits);
+  free(wnhits);
+}
+
+/* append_profile()
+ * With --profile, a search's results end with the pipeline profile
+ * its workers sent, summed, as a '\0'-terminated line of JSON (see
+ * p7_pli_ProfileJSON()) after the hits. Clients that don't ask for
+ * the profile get the same stream as ever.
+ */
+static void
+append_profile(QUEUE_DATA *query, SEARCH_RESULTS *results, enum p7_pipemodes_e mode, uint8_t **buf, uint32_t *n, uint32_t *nalloc)
+{
+  P7_PIPELINE   *pli   = p7_pipeline_Create(query->opts, 100, 100, FALSE, mode);
+  ESL_STOPWATCH *w     = esl_stopwatch_Create();
+  char          *json  = NULL;
+  char          *qname = NULL;
+  uint32_t       len;
+
+  if (pli == NULL || w == NULL) LOG_FATAL_MSG("malloc", errno);
+  if      (query->seq != NULL) qname = query->seq->name;
+  else if (query->hmm != NULL) qname = query->hmm->name;
+
+  pli->nmodels = results->stats.nmodels;
+  pli->nseqs   = results->stats.nseqs;
+  memcpy(pli->prof, results->stats.prof, sizeof(P7_PLI_PROFILE) * p7_PLI_NSTAGES);
+  w->elapsed   = results->stats.elapsed;
+  if (p7_pli_ProfileJSON(pli, qname, w, &json) != eslOK) LOG_FATAL_MSG("pipeline profile", ENOMEM);
+
+  len = strlen(json) + 1;
+  if (*n + len > *nalloc) {
+    if ((*buf = realloc(*buf, *n + len)) == NULL) LOG_FATAL_MSG("realloc", errno);
+    *nalloc = *n + len;
   }
+  memcpy(*buf + *n, json, len);
+  *n += len;
 
-  results->nhits = cnt;
+  free(json);
+  esl_stopwatch_Destroy(w);
+  p7_pipeline_Destroy(pli);
 }
 
+/* forward_results()
+ * Send a search's results to its client, and keep a copy in <cache>,
+ * if there is one.
+ */
 static void
-forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
+forward_results(RESULT_CACHE *cache, QUEUE_DATA *query, SEARCH_RESULTS *results)
 {
   P7_TOPHITS         th;
   P7_PIPELINE        *pli   = NULL;
@@ -803,13 +1731,15 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
       if ((results->stats.hit_offsets = malloc(results->stats.nhits * sizeof(uint64_t))) == NULL) LOG_FATAL_MSG("malloc", errno);
     }
 
-    // sort the hits 
-    qsort(results->hits, results->stats.nhits, sizeof(P7_HIT *), hit_sorter2);
+    // the hits are already in rank order: gather_results() merged the workers' sorted lists
 
     th.unsrt     = NULL;
+    th.arena     = NULL;
     th.N         = results->stats.nhits;
     th.nreported = 0;
     th.nincluded = 0;
+    th.maxhits   = 0;
+    th.ntrimmed  = 0;
     th.is_sorted_by_sortkey = 0;
     th.is_sorted_by_seqidx  = 0;
       
@@ -820,6 +1750,7 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
     pli->n_past_bias = results->stats.n_past_bias;
     pli->n_past_vit  = results->stats.n_past_vit;
     pli->n_past_fwd  = results->stats.n_past_fwd;
+    memcpy(pli->prof, results->stats.prof, sizeof(P7_PLI_PROFILE) * p7_PLI_NSTAGES);
 
     pli->Z           = results->stats.Z;
     pli->domZ        = results->stats.domZ;
@@ -861,6 +1792,9 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
     results->stats.hit_offsets = NULL;
   }
 
+  // With --profile, the summed pipeline profile follows the hits
+  if (esl_opt_GetBoolean(query->opts, "--profile")) append_profile(query, results, mode, buf, &buf_offset, &nalloc);
+
   // Second, the buffer with the HMMD_SEARCH_STATS object
 
   buf_offset2 = 0;
@@ -906,6 +1840,18 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
   printf("Hits:%"PRId64 "  reported:%" PRId64 "  included:%"PRId64 "\n", results->stats.nhits, results->stats.nreported, results->stats.nincluded);
   fflush(stdout);
 
+  /* keep the stream we just sent, status, stats and hits, for repeats of this search */
+  if (cache != NULL && query->key != NULL) {
+    uint8_t *stream;
+    uint64_t len = (uint64_t) buf_offset3 + buf_offset2 + buf_offset;
+
+    if ((stream = malloc(len)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    memcpy(stream,                             buf3_ptr, buf_offset3);
+    memcpy(stream + buf_offset3,               buf2_ptr, buf_offset2);
+    if (buf_offset > 0) memcpy(stream + buf_offset3 + buf_offset2, buf_ptr, buf_offset);
+    rescache_Put(cache, query, stream, len);
+  }
+
  CLEAR:
   /* free all the data */
   for(i = 0; i < results->stats.nhits; i++){
@@ -937,53 +1883,31 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
 static void
 destroy_worker(WORKER_DATA *worker)
 {
-  int i;
+  int i, q;
   if (worker == NULL)
   {
-    if (worker->err_buf  != NULL) free(worker->err_buf);
-    if (worker->hits != NULL){
-      for(i = 0; i < worker->allocated_hits; i++){
-        p7_hit_Destroy(worker->hits[i]);
+    for (q = 0; q < worker->nres; q++) {
+      if (worker->res[q].err_buf  != NULL) free(worker->res[q].err_buf);
+      if (worker->res[q].hits != NULL){
+        for(i = 0; i < worker->res[q].allocated_hits; i++){
+          p7_hit_Destroy(worker->res[q].hits[i]);
+        }
+        free(worker->res[q].hits);
       }
-      free(worker->hits);
     }
+    if (worker->res != NULL) free(worker->res);
     memset(worker, 0, sizeof(WORKER_DATA));
     free(worker);
   }
 }
 
+/* the workers' own leftovers were freed when gather_results() released them */
 static void
-clear_results(WORKERSIDE_ARGS *args, SEARCH_RESULTS *results)
+clear_results(SEARCH_RESULTS *results)
 {
   int i;
-  int n;
-  WORKER_DATA *worker;
-
-  /* lock the workers until we have freed the results */
-  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
-
-  assert(validate_workers(args));
 
-  /* free all the results */
-  worker = args->head;
-  while (worker != NULL) {
-    if (worker->err_buf  != NULL) free(worker->err_buf);
-    if(worker->hits != NULL){
-      for(i =0; i < worker->allocated_hits; i++){
-        p7_hit_Destroy(worker->hits[i]);
-      }
-      free(worker->hits);
-      worker->hits = NULL;
-    }
-    worker->err_buf  = NULL;
-      
-    worker->completed = 0;
-    worker = worker->next;
-  }
-
-  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
-
-  for (i = 0; i < results->nhits; ++i) {
+  for (i = 0; i < results->stats.nhits; ++i) {
     if (results->hits[i]  != NULL) p7_hit_Destroy(results->hits[i]);
     results->hits[i]  = NULL;
   }
@@ -998,7 +1922,7 @@ process_ServerCmd(char *ptr, CLIENTSIDE_ARGS *data)
   QUEUE_DATA    *parms    = NULL;     /* cmd to queue           */
   HMMD_COMMAND  *cmd      = NULL;     /* parsed cmd to process  */
   int            fd       = data->sock_fd;
-  ESL_STACK     *cmdstack = data->cmdstack;
+  CMD_QUEUE     *cmdq     = data->cmdq;
   char          *s;
   time_t         date;
   char           timestamp[32];
@@ -1036,6 +1960,7 @@ process_ServerCmd(char *ptr, CLIENTSIDE_ARGS *data)
   parms->opts = NULL;
   parms->dbx  = -1;
   parms->cmd  = cmd;
+  parms->priority = 0;
 
   strcpy(parms->ip_addr, data->ip_addr);
   parms->sock       = fd;
@@ -1048,7 +1973,7 @@ process_ServerCmd(char *ptr, CLIENTSIDE_ARGS *data)
   printf("Queuing command %d from %s (%d)\n", cmd->hdr.command, parms->ip_addr, parms->sock);
   fflush(stdout);
 
-  esl_stack_PPush(cmdstack, parms);
+  cmdqueue_Push(cmdq, parms);
 }
 
 static int
@@ -1075,7 +2000,7 @@ clientside_loop(CLIENTSIDE_ARGS *data)
   ESL_GETOPTS       *opts    = NULL;     /* search specific options        */
   HMMD_COMMAND      *cmd     = NULL;     /* search cmd to send to workers  */
 
-  ESL_STACK         *cmdstack = data->cmdstack;
+  CMD_QUEUE         *cmdq     = data->cmdq;
   QUEUE_DATA        *parms;
   jmp_buf            jmp_env;
   time_t             date;
@@ -1321,12 +2246,16 @@ clientside_loop(CLIENTSIDE_ARGS *data)
   parms->opts = opts;
   parms->dbx  = dbx - 1;
   parms->cmd  = cmd;
+  parms->priority = esl_opt_GetInteger(opts, "--priority");
 
   strcpy(parms->ip_addr, data->ip_addr);
   parms->sock       = data->sock_fd;
   parms->cmd_type   = cmd->hdr.command;
   parms->query_type = (seq != NULL) ? HMMD_SEQUENCE : HMMD_HMM;
 
+  parms->key        = NULL;
+  if (data->cache != NULL) search_key(parms, rescache_Version(data->cache));
+
   date = time(NULL);
   ctime_r(&date, timestamp);
   printf("\n%s", timestamp);	/* note ctime_r() leaves \n on end of timestamp */
@@ -1339,34 +2268,22 @@ clientside_loop(CLIENTSIDE_ARGS *data)
   printf("%s", opt_str);	/* note opt_str already has trailing \n */
   fflush(stdout);
 
-  esl_stack_PPush(cmdstack, parms);
+  /* a repeat of a recent search is answered straight from the result
+   * cache, unless that would overtake an answer the client is waiting for
+   */
+  if (data->cache != NULL && cmdqueue_Idle(cmdq, parms->sock) && rescache_Send(data->cache, parms, FALSE)) {
+    free_QueueData(parms);
+    free(buffer);
+    return 0;
+  }
+
+  cmdqueue_Push(cmdq, parms);
 
   free(buffer);
   return 0;
 }
 
 
-/* discard_function()
- * function handed to esl_stack_DiscardSelected() to remove
- * all commands in the stack that are associated with a
- * particular client socket, because we're closing that
- * client down. Prototype to this is dictate by the generalized
- * interface to esl_stack_DiscardSelected().
- */
-static int
-discard_function(void *elemp, void *args)
-{
-  QUEUE_DATA  *elem = (QUEUE_DATA *) elemp;
-  int          fd   = * (int *) args;
-
-  if (elem->sock == fd) 
-    {
-      free_QueueData(elem);
-      return TRUE;
-    }
-  return FALSE;
-}
-
 static void *
 clientside_thread(void *arg)
 {
@@ -1381,8 +2298,8 @@ clientside_thread(void *arg)
     eof = clientside_loop(data);
   }
 
-  /* remove any commands in stack associated with this client's socket */
-  esl_stack_DiscardSelected(data->cmdstack, discard_function, &(data->sock_fd));
+  /* remove any commands in the queue associated with this client's socket */
+  cmdqueue_Discard(data->cmdq, data->sock_fd);
 
   printf("Closing %s (%d)\n", data->ip_addr, data->sock_fd);
   fflush(stdout);
@@ -1413,7 +2330,8 @@ client_comm_thread(void *arg)
     if ((fd = accept(data->sock_fd, (struct sockaddr *)&addr, (unsigned int *)&n)) < 0) LOG_FATAL_MSG("accept", errno);
 
     if ((targs = malloc(sizeof(CLIENTSIDE_ARGS))) == NULL) LOG_FATAL_MSG("malloc", errno);
-    targs->cmdstack   = data->cmdstack;
+    targs->cmdq       = data->cmdq;
+    targs->cache      = data->cache;
     targs->sock_fd    = fd;
 
     addrlen = sizeof(targs->ip_addr);
@@ -1474,8 +2392,9 @@ workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
 {
   ESL_STOPWATCH      *w     = NULL;
   HMMD_SEARCH_STATS  *stats = NULL;
+  WORKER_RESULT      *wr    = NULL;
   HMMD_COMMAND        cmd;
-  int    n, i;
+  int    n, i, q;
   int    size;
   int    total;
   char  *ptr;
@@ -1537,10 +2456,17 @@ workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
     esl_stopwatch_Start(w);
 
     /* write search message in two parts */
-    n = sizeof(HMMD_HEADER) + sizeof(HMMD_SEARCH_CMD);
-    memcpy(&cmd, worker->cmd, n);
-    cmd.srch.inx = worker->srch_inx;
-    cmd.srch.cnt = worker->srch_cnt;
+    if (worker->cmd->hdr.command == HMMD_CMD_BATCH) {
+      n = sizeof(HMMD_HEADER) + sizeof(HMMD_BATCH_CMD);
+      memcpy(&cmd, worker->cmd, n);
+      cmd.batch.inx = worker->srch_inx;
+      cmd.batch.cnt = worker->srch_cnt;
+    } else {
+      n = sizeof(HMMD_HEADER) + sizeof(HMMD_SEARCH_CMD);
+      memcpy(&cmd, worker->cmd, n);
+      cmd.srch.inx = worker->srch_inx;
+      cmd.srch.cnt = worker->srch_cnt;
+    }
     if (writen(worker->sock_fd, &cmd, n) != n) {
       p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
       break;
@@ -1558,71 +2484,85 @@ workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
     total = 0;
     worker->total = 0;
 
-    n = HMMD_SEARCH_STATUS_SERIAL_SIZE;
-    buf = malloc(n);
-    if (buf == NULL){
-      LOG_FATAL_MSG("malloc", errno);
-    }
-
-    total += n;
-    if ((size = readn(worker->sock_fd, buf, n)) == -1) {
-      p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-      break;
-    }
-
-    buf_position = 0;
-    if(hmmd_search_status_Deserialize(buf, &buf_position, &(worker->status)) != eslOK){
-       LOG_FATAL_MSG("Couldn't deserialize HMMD_SEARCH_STATUS", errno);
-    }
-
-    if (worker->status.status != eslOK) {
-      n = worker->status.msg_size;
-      total += n; 
-      if ((worker->err_buf = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
-      worker->err_buf[0] = 0;
-      if ((size = readn(worker->sock_fd, worker->err_buf, n)) == -1) {
-        p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-        break;
-      }
-    } else {
+    /* read back one result per query, in the order of the batch */
+    for (q = 0; q < worker->nres; q++) {
+      wr = &worker->res[q];
 
-      // receive the results from the worker
-      buf = realloc(buf, worker->status.msg_size);
-      if(buf == NULL){
+      n = HMMD_SEARCH_STATUS_SERIAL_SIZE;
+      buf = malloc(n);
+      if (buf == NULL){
         LOG_FATAL_MSG("malloc", errno);
       }
 
-      total += worker->status.msg_size;
-      if ((size = readn(worker->sock_fd, buf, worker->status.msg_size)) == -1) {
+      total += n;
+      if ((size = readn(worker->sock_fd, buf, n)) == -1) {
         p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+        free(buf);
         break;
       }
 
-      buf_position = 0; // start at beginning of new buffer of data
-      // Now, serialize the data structures out of it
-      if(p7_hmmd_search_stats_Deserialize(buf, &buf_position, &(worker->stats)) != eslOK){
-        LOG_FATAL_MSG("Couldn't deserialize HMMD_SEARCH_STATS", errno);
+      buf_position = 0;
+      if(hmmd_search_status_Deserialize(buf, &buf_position, &(wr->status)) != eslOK){
+         LOG_FATAL_MSG("Couldn't deserialize HMMD_SEARCH_STATUS", errno);
       }
-      stats = &worker->stats;
-      if(stats->nhits > 0){
-        worker->hits = malloc(stats->nhits * sizeof(P7_HIT *));
-        if(worker->hits == NULL){
+
+      if (wr->status.status != eslOK) {
+        free(buf);
+        n = wr->status.msg_size;
+        total += n; 
+        if ((wr->err_buf = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+        wr->err_buf[0] = 0;
+        if ((size = readn(worker->sock_fd, wr->err_buf, n)) == -1) {
+          p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+          break;
+        }
+      } else {
+
+        // receive the results from the worker
+        buf = realloc(buf, wr->status.msg_size);
+        if(buf == NULL){
           LOG_FATAL_MSG("malloc", errno);
         }
-        worker->allocated_hits = stats->nhits;  // Need this if we have to destroy the worker because of an error
-        /* read in the hits */
-        for(i = 0; i < stats->nhits; i++){
-          worker->hits[i] = p7_hit_Create_empty();
-          if(worker->hits[i] == NULL){
+
+        total += wr->status.msg_size;
+        if ((size = readn(worker->sock_fd, buf, wr->status.msg_size)) == -1) {
+          p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+          free(buf);
+          break;
+        }
+
+        buf_position = 0; // start at beginning of new buffer of data
+        // Now, serialize the data structures out of it
+        if(p7_hmmd_search_stats_Deserialize(buf, &buf_position, &(wr->stats)) != eslOK){
+          LOG_FATAL_MSG("Couldn't deserialize HMMD_SEARCH_STATS", errno);
+        }
+        stats = &wr->stats;
+        if(stats->nhits > 0){
+          wr->hits = malloc(stats->nhits * sizeof(P7_HIT *));
+          if(wr->hits == NULL){
             LOG_FATAL_MSG("malloc", errno);
           }
-          if(p7_hit_Deserialize(buf, &buf_position, worker->hits[i]) != eslOK){
-            LOG_FATAL_MSG("Couldn't deserialize P7_HIT", errno);
-          } 
+          wr->allocated_hits = stats->nhits;  // Need this if we have to destroy the worker because of an error
+          /* read in the hits */
+          for(i = 0; i < stats->nhits; i++){
+            wr->hits[i] = p7_hit_Create_empty();
+            if(wr->hits[i] == NULL){
+              LOG_FATAL_MSG("malloc", errno);
+            }
+            if(p7_hit_Deserialize(buf, &buf_position, wr->hits[i]) != eslOK){
+              LOG_FATAL_MSG("Couldn't deserialize P7_HIT", errno);
+            } 
+          }
+        }
+        // a worker searching with --profile sends its pipeline profile after the hits
+        if(wr->status.msg_size - buf_position >= HMMD_SEARCH_PROFILE_SERIAL_SIZE &&
+           p7_hmmd_search_stats_DeserializeProfile(buf, &buf_position, &(wr->stats)) != eslOK){
+          LOG_FATAL_MSG("Couldn't deserialize pipeline profile", errno);
         }
+        free(buf);
       }
-      free(buf);
     }
+    if (q < worker->nres) break;   /* lost the worker partway through */
 
     /* We've just allocated an array of pointers to P7_HIT objects and a bunch of P7_HIT 
       objects that we don't free in this function.  Here's what happens to them.  gather_results() assembles
@@ -1638,6 +2578,7 @@ workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
     worker->cmd       = NULL;
     worker->completed = 1;
     worker->total     = total;
+    ++worker->share->completed;
     ++data->completed;
 
     /* notify the master that a worker has completed */
@@ -1804,6 +2745,7 @@ workerside_thread(void *arg)
   worker->terminated = 1;
   worker->total      = 0;
   worker->sock_fd    = -1;
+  if (worker->share != NULL) ++worker->share->completed;
 
   assert(validate_workers(parent));
 
@@ -1845,8 +2787,9 @@ worker_comm_thread(void *arg)
 
     worker->parent     = data;
     worker->sock_fd    = fd;
-    worker->allocated_hits = 0; // These may be redundant because of the memset earlier, but better safe than sorry
-    worker->hits = NULL;
+    worker->res        = NULL; // These may be redundant because of the memset earlier, but better safe than sorry
+    worker->nres       = 0;
+    worker->nresalloc  = 0;
 
     addrlen = sizeof(worker->ip_addr);
     strncpy(worker->ip_addr, inet_ntoa(addr.sin_addr), addrlen);
@@ -682,21 +682,6 @@ ERROR:
 
 }
 
-// Qsort comparison function to sort a list of pointers to P7_HITs
-static int
-hit_sorter2(const void *p1, const void *p2)
-{
-  int cmp;
-
-  const P7_HIT *h1 = *((P7_HIT **) p1);
-  const P7_HIT *h2 = *((P7_HIT **) p2);
-
-  cmp  = (h1->sortkey < h2->sortkey);
-  cmp -= (h1->sortkey > h2->sortkey);
-
-  return cmp;
-}
-
 
 static void
 init_results(SEARCH_RESULTS *results)
@@ -714,6 +699,7 @@ init_results(SEARCH_RESULTS *results)
   results->stats.n_past_bias = 0;
   results->stats.n_past_vit  = 0;
   results->stats.n_past_fwd  = 0;
+  memset(results->stats.prof, 0, sizeof(P7_PLI_PROFILE) * p7_PLI_NSTAGES);
   results->stats.Z           = 0;
 
   results->hits              = NULL;
@@ -729,16 +715,27 @@ gather_results(QUEUE_DATA_SHARD *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *r
 {
   int cnt;
   int n;
-  int i0, i1;
+  int j;
+  int k     = 0;		/* # of sorted hit arrays to merge                    */
+  int first = 0;		/* lists[first..k-1] are workers' arrays, ours to free */
+  P7_HIT   ***lists  = NULL;	/* hits so far (from an earlier try), and each worker's */
+  uint64_t   *nlist  = NULL;
+  P7_HIT    **merged = NULL;
   WORKER_DATA *worker;
 
-  /* allocate spaces to hold all the hits */
-  cnt = results->nhits + MAX_WORKERS;
-  if ((results->hits = realloc(results->hits, sizeof(P7_HIT *) * cnt)) == NULL) LOG_FATAL_MSG("malloc", errno);
-
   /* lock the workers until we have merged the results */
   if ((n = pthread_mutex_lock (&comm->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
+  /* room for the sorted hit arrays: what we already have, and one per worker */
+  for (n = 1, worker = comm->head; worker != NULL; worker = worker->next) n++;
+  if ((lists = malloc(sizeof(P7_HIT **) * n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((nlist = malloc(sizeof(uint64_t)  * n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  if (results->stats.nhits > 0) {
+    lists[k]   = results->hits;
+    nlist[k++] = results->stats.nhits;
+    first      = k;
+  }
+
   /* count the number of hits */
   cnt = results->nhits;
   worker = comm->head;
@@ -754,6 +751,11 @@ gather_results(QUEUE_DATA_SHARD *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *r
       results->stats.n_past_bias  += worker->stats.n_past_bias;
       results->stats.n_past_vit   += worker->stats.n_past_vit;
       results->stats.n_past_fwd   += worker->stats.n_past_fwd;
+      for (j = 0; j < p7_PLI_NSTAGES; j++) {
+        results->stats.prof[j].ncalls += worker->stats.prof[j].ncalls;
+        results->stats.prof[j].ns     += worker->stats.prof[j].ns;
+        results->stats.prof[j].ncells += worker->stats.prof[j].ncells;
+      }
 
       results->stats.Z_setby       = worker->stats.Z_setby;
       results->stats.domZ_setby    = worker->stats.domZ_setby;
@@ -761,22 +763,12 @@ gather_results(QUEUE_DATA_SHARD *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *r
       results->stats.Z             = worker->stats.Z;
 
       results->status.msg_size    += worker->status.msg_size - sizeof(HMMD_SEARCH_STATS);
-      if((results->stats.nhits- previous_hits) >0){ // There are new hits to deal with
-        // Add enough space to the list of hits for all the hits from this worker
-       results->hits = realloc(results->hits, results->stats.nhits * sizeof (P7_HIT *));
-        if(results->hits == NULL){
-         LOG_FATAL_MSG("malloc", n);
-       }
-
-       // copy this worker's hits into the global list
-        for(i0 = 0, i1 = previous_hits; i1 < results->stats.nhits; i0++, i1++){
-          results->hits[i1] = worker->hits[i0];
-       }
-
-        free(worker->hits); //  Free the worker's array of pointers to hits.  The hits themselves
-       // will be freed by forward_results()
-
-       worker->hits = NULL;  
+      if (results->stats.nhits - previous_hits > 0) { // There are new hits to deal with
+        // Take over this worker's array of pointers to hits, which it sent in rank order.
+        // The hits themselves will be freed by forward_results()
+        lists[k]   = worker->hits;
+        nlist[k++] = results->stats.nhits - previous_hits;
+        worker->hits = NULL;
       }
       worker->completed   = 0;
       ++cnt;
@@ -791,6 +783,17 @@ gather_results(QUEUE_DATA_SHARD *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *r
 
   if ((n = pthread_mutex_unlock (&comm->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
+  /* k-way merge of the sorted arrays into one ranked list, instead of appending and sorting them all */
+  if (k > first) {
+    if ((merged = malloc(sizeof(P7_HIT *) * results->stats.nhits)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    if (p7_tophits_MergeHitArrays(lists, nlist, k, merged, esl_threads_GetCPUCount()) != eslOK) LOG_FATAL_MSG("merge hits", ENOMEM);
+    for (j = first; j < k; j++) free(lists[j]);
+    free(results->hits);
+    results->hits = merged;
+  }
+  free(lists);
+  free(nlist);
+
   if (query->cmd_type == HMMD_CMD_SEARCH) {
     results->stats.nmodels = 1;
     results->stats.nseqs   = comm->seq_db->db[query->dbx].K;
@@ -807,6 +810,44 @@ gather_results(QUEUE_DATA_SHARD *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *r
 
 }
 
+/* append_profile()
+ * With --profile, a search's results end with the pipeline profile
+ * its workers sent, summed, as a '\0'-terminated line of JSON (see
+ * p7_pli_ProfileJSON()) after the hits. Clients that don't ask for
+ * the profile get the same stream as ever.
+ */
+static void
+append_profile(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results, enum p7_pipemodes_e mode, uint8_t **buf, uint32_t *n, uint32_t *nalloc)
+{
+  P7_PIPELINE   *pli   = p7_pipeline_Create(query->opts, 100, 100, FALSE, mode);
+  ESL_STOPWATCH *w     = esl_stopwatch_Create();
+  char          *json  = NULL;
+  char          *qname = NULL;
+  uint32_t       len;
+
+  if (pli == NULL || w == NULL) LOG_FATAL_MSG("malloc", errno);
+  if      (query->seq != NULL) qname = query->seq->name;
+  else if (query->hmm != NULL) qname = query->hmm->name;
+
+  pli->nmodels = results->stats.nmodels;
+  pli->nseqs   = results->stats.nseqs;
+  memcpy(pli->prof, results->stats.prof, sizeof(P7_PLI_PROFILE) * p7_PLI_NSTAGES);
+  w->elapsed   = results->stats.elapsed;
+  if (p7_pli_ProfileJSON(pli, qname, w, &json) != eslOK) LOG_FATAL_MSG("pipeline profile", ENOMEM);
+
+  len = strlen(json) + 1;
+  if (*n + len > *nalloc) {
+    if ((*buf = realloc(*buf, *n + len)) == NULL) LOG_FATAL_MSG("realloc", errno);
+    *nalloc = *n + len;
+  }
+  memcpy(*buf + *n, json, len);
+  *n += len;
+
+  free(json);
+  esl_stopwatch_Destroy(w);
+  p7_pipeline_Destroy(pli);
+}
+
 static void
 forward_results(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results)
 {
@@ -842,13 +883,15 @@ forward_results(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results)
       if ((results->stats.hit_offsets = malloc(results->stats.nhits * sizeof(uint64_t))) == NULL) LOG_FATAL_MSG("malloc", errno);
     }
 
-    // sort the hits 
-    qsort(results->hits, results->stats.nhits, sizeof(P7_HIT *), hit_sorter2);
+    // the hits are already in rank order: gather_results() merged the workers' sorted lists
 
     th.unsrt     = NULL;
+    th.arena     = NULL;
     th.N         = results->stats.nhits;
     th.nreported = 0;
     th.nincluded = 0;
+    th.maxhits   = 0;
+    th.ntrimmed  = 0;
     th.is_sorted_by_sortkey = 0;
     th.is_sorted_by_seqidx  = 0;
       
@@ -859,6 +902,7 @@ forward_results(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results)
     pli->n_past_bias = results->stats.n_past_bias;
     pli->n_past_vit  = results->stats.n_past_vit;
     pli->n_past_fwd  = results->stats.n_past_fwd;
+    memcpy(pli->prof, results->stats.prof, sizeof(P7_PLI_PROFILE) * p7_PLI_NSTAGES);
 
     pli->Z           = results->stats.Z;
     pli->domZ        = results->stats.domZ;
@@ -900,6 +944,9 @@ forward_results(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results)
     results->stats.hit_offsets = NULL;
   }
 
+  // With --profile, the summed pipeline profile follows the hits
+  if (esl_opt_GetBoolean(query->opts, "--profile")) append_profile(query, results, mode, buf, &buf_offset, &nalloc);
+
   // Second, the buffer with the HMMD_SEARCH_STATS object
 
   buf_offset2 = 0;
@@ -1661,6 +1708,11 @@ workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
           } 
         }
       }
+      // a worker searching with --profile sends its pipeline profile after the hits
+      if(worker->status.msg_size - buf_position >= HMMD_SEARCH_PROFILE_SERIAL_SIZE &&
+         p7_hmmd_search_stats_DeserializeProfile(buf, &buf_position, &(worker->stats)) != eslOK){
+        LOG_FATAL_MSG("Couldn't deserialize pipeline profile", errno);
+      }
       free(buf);
     }
 
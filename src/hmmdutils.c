@@ -93,6 +93,8 @@ static ESL_OPTIONS searchOpts[] = {
   { "--hmmdb",      eslARG_INT,       NULL,  NULL, "n>0",   NULL,  NULL,  "--seqdb",       "hmm database to search",                                      12 },
   { "--seqdb",      eslARG_INT,         NULL,  NULL, "n>0",   NULL,  NULL,  "--hmmdb",       "protein database to search",                                  12 },
   { "--seqdb_ranges",eslARG_STRING,     NULL,  NULL,  NULL,   NULL, "--seqdb", NULL,         "range(s) of sequences within --seqdb that will be searched",  12 },
+  { "--profile",    eslARG_NONE,      FALSE, NULL, NULL,      NULL,  NULL, NULL,        "time each pipeline stage; return the profile as JSON", 12 },
+  { "--priority",   eslARG_INT,         "0", NULL, NULL,      NULL,  NULL, NULL,        "scheduling priority of this search, higher first (master --sched priority)", 12 },
   
 
   /* name           type        default  env  range toggles reqs incomp  help                                          docgroup*/
@@ -214,6 +216,7 @@ free_QueueData(QUEUE_DATA *data)
   if (data->hmm != NULL) p7_hmm_Destroy(data->hmm);
   if (data->seq != NULL) esl_sq_Destroy(data->seq);
   if (data->cmd != NULL) free(data->cmd);
+  if (data->key != NULL) free(data->key);
   memset(data, 0, sizeof(*data));
   free(data);
 }
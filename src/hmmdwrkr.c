@@ -40,23 +40,47 @@
 #define MAX_WORKERS  64
 #define MAX_BUFFER   4096
 
+/* A worker's search threads share out the block of targets it was
+ * given, items [0..n-1], a chunk at a time. Chunks are sized by cost
+ * (residues of target sequences, or lengths of target profiles, plus
+ * <itemcost> for each target), not by count, since a block of long
+ * sequences costs far more than one of short ones. Each chunk is a
+ * 1/(2*nthreads) share of the cost still left, but no less than
+ * <mincost>, so chunks shrink toward the end and the threads finish
+ * together. A claim is one compare-and-swap on <next>.
+ */
+typedef struct {
+  const uint64_t  *cum;          /* cum[i] - cum[0]: residues in items [0..i-1]; [0..n] */
+  int              n;
+  uint64_t         itemcost;     /* fixed cost of each item, in residues             */
+  uint64_t         mincost;      /* smallest chunk worth a claim                      */
+  int              nthreads;
+  int              base;         /* absolute index of item 0, for <align>             */
+  int              align;        /* chunks end at (absolute) multiples of this, or at n */
+  int              next;         /* first unclaimed item                              */
+#if ! defined(__GNUC__)
+  pthread_mutex_t  mutex;        /* no compare-and-swap: claims take a lock           */
+#endif
+} WORK_CHUNKS;
+
 #define CONF_FILE "/etc/hmmpgmd.conf"
 
 typedef struct {
+  int               nquery;      /* # of queries this thread searches, in info[0..nquery-1] */
+
   HMMER_SEQ       **sq_list;     /* list of sequences to process     */
   int               sq_cnt;      /* number of sequences              */
   int               db_Z;        /* true number of sequences         */
 
-  P7_OPROFILE     **om_list;     /* list of profiles to process      */
+  P7_HMMCACHE      *hmm_db;      /* cached profiles to process...    */
+  int               om_inx;      /* ... starting from this one       */
   int               om_cnt;      /* number of profiles               */
 
-  pthread_mutex_t  *inx_mutex;   /* protect data                     */
-  int              *blk_size;    /* sequences per block              */
-  int              *limit;       /* point to decrease block size     */
-  int              *inx;         /* next index to process            */
+  WORK_CHUNKS      *work;        /* shared by all threads: who does which targets */
 
   P7_HMM           *hmm;         /* query HMM                        */
   ESL_SQ           *seq;         /* query sequence                   */
+  P7_OPROFILE      *om;          /* query profile, shared read-only  */
   ESL_ALPHABET     *abc;         /* digital alphabet                 */
   ESL_GETOPTS      *opts;        /* search specific options          */
 
@@ -80,18 +104,26 @@ typedef struct {
 } WORKER_ENV;
 
 static void process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
-static void process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query);
+static void process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA **qlist, int nquery);
 static void process_Shutdown(HMMD_COMMAND *cmd, WORKER_ENV *env);
 
-static QUEUE_DATA *process_QueryCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
+static QUEUE_DATA  *process_QueryCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
+static QUEUE_DATA **process_BatchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, int *ret_nquery);
 
 static int  setup_masterside_comm(ESL_GETOPTS *opts);
 
 static void send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli);
 
 #define BLOCK_SIZE 1000
+
+#define WORK_SEQCOST  64         /* per-target cost of a sequence, in residues   */
+#define WORK_SEQMIN   (1 << 16)  /* smallest chunk of sequences, in residues      */
+#define WORK_HMMCOST  16         /* per-target cost of a profile, in model nodes  */
+#define WORK_HMMMIN   (1 << 12)  /* smallest chunk of profiles, in model nodes    */
+static P7_OPROFILE *build_query_profile(QUEUE_DATA *query);
 static void search_thread(void *arg);
 static void scan_thread(void *arg);
+static void scan_profiles(WORKER_INFO *info, int inx, int count, P7_PIPELINE *pli, P7_BG *bg, P7_TOPHITS *th);
 
 static void
 print_timings(int i, double elapsed, P7_PIPELINE *pli)
@@ -109,6 +141,107 @@ print_timings(int i, double elapsed, P7_PIPELINE *pli)
            i, pli->nseqs, pli->nres, pli->n_past_msv, pli->n_past_bias, pli->n_past_vit, pli->n_past_fwd, buf1);
 }
 
+/* work_Init()
+ * Share out items [0..n-1], whose running residue counts are <cum>,
+ * between <nthreads> threads. See WORK_CHUNKS.
+ */
+static void
+work_Init(WORK_CHUNKS *wc, const uint64_t *cum, int n, uint64_t itemcost, uint64_t mincost, int nthreads, int base, int align)
+{
+  wc->cum      = cum;
+  wc->n        = n;
+  wc->itemcost = itemcost;
+  wc->mincost  = mincost;
+  wc->nthreads = nthreads;
+  wc->base     = base;
+  wc->align    = (align > 1) ? align : 1;
+  wc->next     = 0;
+#if ! defined(__GNUC__)
+  if (pthread_mutex_init(&wc->mutex, NULL) != 0) p7_Fail("mutex init failed");
+#endif
+}
+
+static void
+work_Destroy(WORK_CHUNKS *wc)
+{
+#if ! defined(__GNUC__)
+  pthread_mutex_destroy(&wc->mutex);
+#endif
+}
+
+static uint64_t
+work_cost(const WORK_CHUNKS *wc, int a, int b)
+{
+  return (wc->cum[b] - wc->cum[a]) + wc->itemcost * (uint64_t) (b - a);
+}
+
+/* work_claim_from()
+ * Try to move the first unclaimed item from <*start> to <end>. If
+ * another thread got there first, return FALSE, with <*start> now the
+ * first unclaimed item.
+ */
+static int
+work_claim_from(WORK_CHUNKS *wc, int *start, int end)
+{
+#if defined(__GNUC__)
+  return __atomic_compare_exchange_n(&wc->next, start, end, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+#else
+  int ok;
+
+  if (pthread_mutex_lock(&wc->mutex) != 0) p7_Fail("mutex lock failed");
+  if ((ok = (wc->next == *start)) == TRUE) wc->next = end;
+  else                                     *start  = wc->next;
+  if (pthread_mutex_unlock(&wc->mutex) != 0) p7_Fail("mutex unlock failed");
+  return ok;
+#endif
+}
+
+/* work_Claim()
+ * Claim the next chunk of items for the calling thread. Returns the
+ * number of items in it, with the first in <*ret_start>, or 0 when
+ * there are none left.
+ */
+static int
+work_Claim(WORK_CHUNKS *wc, int *ret_start)
+{
+  int      start;
+  int      end;
+  int      lo, hi, mid;
+  uint64_t want;
+
+#if defined(__GNUC__)
+  start = __atomic_load_n(&wc->next, __ATOMIC_RELAXED);
+#else
+  if (pthread_mutex_lock(&wc->mutex) != 0) p7_Fail("mutex lock failed");
+  start = wc->next;
+  if (pthread_mutex_unlock(&wc->mutex) != 0) p7_Fail("mutex unlock failed");
+#endif
+
+  do {
+    if (start >= wc->n) return 0;
+
+    want = ESL_MAX(work_cost(wc, start, wc->n) / (2 * wc->nthreads), wc->mincost);
+
+    /* the fewest items from <start> that cost at least <want> */
+    lo = start + 1;
+    hi = wc->n;
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (work_cost(wc, start, mid) >= want) hi = mid;
+      else                                   lo = mid + 1;
+    }
+    end = lo;
+
+    if (wc->align > 1 && end < wc->n) {
+      end = ((wc->base + end + wc->align - 1) / wc->align) * wc->align - wc->base;
+      if (end > wc->n) end = wc->n;
+    }
+  } while (! work_claim_from(wc, &start, end));
+
+  *ret_start = start;
+  return end - start;
+}
+
 static int
 read_Command(HMMD_COMMAND **ret_cmd, WORKER_ENV *env)
 {
@@ -148,6 +281,9 @@ worker_process(ESL_GETOPTS *go)
   int           status;
    
   QUEUE_DATA      *query      = NULL;   
+  QUEUE_DATA     **qlist      = NULL;   /* the searches of a batch */
+  int              nquery;
+  int              q;
   
   /* Initializations */
   impl_Init();
@@ -168,15 +304,21 @@ worker_process(ESL_GETOPTS *go)
       case HMMD_CMD_SCAN: 
 	  {	  
  		   query = process_QueryCmd(cmd, &env);
- 		   process_SearchCmd(cmd, &env, query);
+ 		   process_SearchCmd(cmd, &env, &query, 1);
  		   free_QueueData(query);
 	  }
 		 break;
       case HMMD_CMD_SEARCH:
 		   query = process_QueryCmd(cmd, &env);
-	     process_SearchCmd(cmd, &env, query);
+	     process_SearchCmd(cmd, &env, &query, 1);
        free_QueueData(query);
          break;
+      case HMMD_CMD_BATCH:
+        qlist = process_BatchCmd(cmd, &env, &nquery);
+        process_SearchCmd(cmd, &env, qlist, nquery);
+        for (q = 0; q < nquery; q++) free_QueueData(qlist[q]);
+        free(qlist);
+        break;
       case HMMD_CMD_SHUTDOWN:  process_Shutdown (cmd, &env);  shutdown = 1; break;
       default: p7_syslog(LOG_ERR,"[%s:%d] - unknown command %d (%d)\n", __FILE__, __LINE__, cmd->hdr.command, cmd->hdr.length);
       }
@@ -193,27 +335,30 @@ worker_process(ESL_GETOPTS *go)
 
 
 static void 
-process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
+process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA **qlist, int nquery)
 { 
-  int              i;
-  int              cnt;
-  int              limit;
+  QUEUE_DATA      *query      = qlist[0];   /* all the queries of a batch share its database, block, and range */
+  int              i, q;
   int              status;
-  int              blk_size;
+  int              align;
+  WORK_CHUNKS      work;                    /* how the threads share out the block */
+  uint64_t        *modcum     = NULL;       /* running lengths of the target profiles of a scan */
   WORKER_INFO     *info       = NULL;
+  P7_TOPHITS     **thv        = NULL;
+  P7_OPROFILE    **om         = NULL;
   ESL_ALPHABET    *abc;
   ESL_STOPWATCH   *w;
   ESL_THREADS     *threadObj  = NULL;
-  pthread_mutex_t  inx_mutex;
-  int              current_index;
+  RANGE_LIST      *range_list = NULL;
   time_t           date;
   char             timestamp[32];
 
   w = esl_stopwatch_Create();
   abc = esl_alphabet_Create(eslAMINO);
 
-  if (pthread_mutex_init(&inx_mutex, NULL) != 0) p7_Fail("mutex init failed");
-  ESL_ALLOC(info, sizeof(*info) * env->ncpus);
+  ESL_ALLOC(info, sizeof(*info) * env->ncpus * nquery);
+  ESL_ALLOC(thv,  sizeof(P7_TOPHITS *) * env->ncpus);
+  ESL_ALLOC(om,   sizeof(P7_OPROFILE *) * nquery);
 
   /* Log the current time (at search start) */
   date = time(NULL);
@@ -223,82 +368,96 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
   /* initialize thread data */
   esl_stopwatch_Start(w);
 
-  info->range_list = NULL;
   if (esl_opt_IsUsed(query->opts, "--seqdb_ranges")) {
-    ESL_ALLOC(info->range_list, sizeof(RANGE_LIST));
-    hmmpgmd_GetRanges(info->range_list, esl_opt_GetString(query->opts, "--seqdb_ranges"));
+    ESL_ALLOC(range_list, sizeof(RANGE_LIST));
+    hmmpgmd_GetRanges(range_list, esl_opt_GetString(query->opts, "--seqdb_ranges"));
   }
 
 
   if (query->cmd_type == HMMD_CMD_SEARCH) threadObj = esl_threads_Create(&search_thread);
   else                                    threadObj = esl_threads_Create(&scan_thread);
 
-  if (query->query_type == HMMD_SEQUENCE) {
-    fprintf(stdout, "Search seq %s  [L=%ld]", query->seq->name, (long) query->seq->n);
-  } else {
-    fprintf(stdout, "Search hmm %s  [M=%d]", query->hmm->name, query->hmm->M);
-  }
-  fprintf(stdout, " vs %s DB %d [%d - %d]",
-          (query->cmd_type == HMMD_CMD_SEARCH) ? "SEQ" : "HMM", 
-          query->dbx, query->inx, query->inx + query->cnt - 1);
+  if (nquery > 1) fprintf(stdout, "Batch of %d searches\n", nquery);
+  for (q = 0; q < nquery; q++) {
+    if (qlist[q]->query_type == HMMD_SEQUENCE) {
+      fprintf(stdout, "Search seq %s  [L=%ld]", qlist[q]->seq->name, (long) qlist[q]->seq->n);
+    } else {
+      fprintf(stdout, "Search hmm %s  [M=%d]", qlist[q]->hmm->name, qlist[q]->hmm->M);
+    }
+    fprintf(stdout, " vs %s DB %d [%d - %d]",
+            (query->cmd_type == HMMD_CMD_SEARCH) ? "SEQ" : "HMM", 
+            query->dbx, query->inx, query->inx + query->cnt - 1);
 
-  if (info->range_list)
-    fprintf(stdout, " in range(s) %s", esl_opt_GetString(query->opts, "--seqdb_ranges"));
+    if (range_list)
+      fprintf(stdout, " in range(s) %s", esl_opt_GetString(query->opts, "--seqdb_ranges"));
 
-  fprintf(stdout, "\n");
+    fprintf(stdout, "\n");
+  }
 
-  /* Create processing pipeline and hit list */
-  for (i = 0; i < env->ncpus; ++i) {
-    info[i].abc   = query->abc;
-    info[i].hmm   = query->hmm;
-    info[i].seq   = query->seq;
-    info[i].opts  = query->opts;
-
-    info[i].range_list  = info[0].range_list;
-
-    info[i].th    = NULL;
-    info[i].pli   = NULL;
-
-    info[i].inx_mutex = &inx_mutex;
-    info[i].inx       = &current_index;/* this is confusing trickery - to share a single variable across all threads */
-    info[i].blk_size  = &blk_size;     /* ditto */
-    info[i].limit     = &limit;	       /* ditto. TODO: come back and clean this up. */
-
-    if (query->cmd_type == HMMD_CMD_SEARCH) {
-      HMMER_SEQ **list  = env->seq_db->db[query->dbx].list;
-      info[i].sq_list   = &list[query->inx];
-      info[i].sq_cnt    = query->cnt;
-      info[i].db_Z      = env->seq_db->db[query->dbx].K;
-      info[i].om_list   = NULL;
-      info[i].om_cnt    = 0;
-    } else {
-      info[i].sq_list   = NULL;
-      info[i].sq_cnt    = 0;
-      info[i].db_Z      = 0;
-      info[i].om_list   = &env->hmm_db->list[query->inx];
-      info[i].om_cnt    = query->cnt;
-    }
+  /* build each query profile once, for all search threads */
+  for (q = 0; q < nquery; q++)
+    om[q] = (query->cmd_type == HMMD_CMD_SEARCH) ? build_query_profile(qlist[q]) : NULL;
 
-    esl_threads_AddThread(threadObj, &info[i]);
+  /* share out the block by its cost: the residues of the target
+   * sequences, counted when the database was cached, or the lengths
+   * of the target profiles. A scan keeps to whole windows of packed
+   * profiles if there are enough of them to go round.
+   */
+  if (query->cmd_type == HMMD_CMD_SEARCH) {
+    work_Init(&work, env->seq_db->db[query->dbx].rescum + query->inx, query->cnt, WORK_SEQCOST, WORK_SEQMIN, env->ncpus, query->inx, 1);
+  } else {
+    ESL_ALLOC(modcum, sizeof(uint64_t) * (query->cnt + 1));
+    modcum[0] = 0;
+    for (i = 0; i < query->cnt; i++) modcum[i+1] = modcum[i] + env->hmm_db->list[query->inx + i]->M;
+    align = 1;
+#if defined (eslENABLE_SSE)
+    if (env->hmm_db->pack && query->cnt / p7_HMMCACHE_PACKWIN >= 4 * env->ncpus) align = p7_HMMCACHE_PACKWIN;
+#endif
+    work_Init(&work, modcum, query->cnt, WORK_HMMCOST, WORK_HMMMIN, env->ncpus, query->inx, align);
   }
 
-  /* try block size of 5000.  we will need enough sequences for four
-   * blocks per thread or better.
+  /* Create processing pipeline and hit list.
+   * Each thread gets <nquery> consecutive WORKER_INFOs, one per query
+   * in the batch: thread i searches query q with info[i*nquery + q].
    */
-  blk_size = 5000;
-  cnt = query->cnt / env->ncpus / blk_size;
-  limit = query->cnt * 2 / 3;
-  if (cnt < 4) {
-    /* try block size of 1000  */
-    blk_size /= 5;
-    cnt = query->cnt / env->ncpus / blk_size;
-    if (cnt < 4) {
-      /* still not enough.  just divide it up into one block per thread */
-      blk_size = query->cnt / env->ncpus + 1;
-      limit = query->cnt * 2;
+  for (i = 0; i < env->ncpus; ++i) {
+    for (q = 0; q < nquery; q++) {
+      WORKER_INFO *qi = &(info[i*nquery + q]);
+
+      qi->nquery = nquery;
+      qi->abc    = qlist[q]->abc;
+      qi->hmm    = qlist[q]->hmm;
+      qi->seq    = qlist[q]->seq;
+      qi->om     = om[q];
+      qi->opts   = qlist[q]->opts;
+
+      qi->range_list  = range_list;
+
+      qi->th     = NULL;
+      qi->pli    = NULL;
+
+      qi->work   = &work;
+
+      if (query->cmd_type == HMMD_CMD_SEARCH) {
+        HMMER_SEQ **list  = env->seq_db->db[query->dbx].list;
+        qi->sq_list   = &list[query->inx];
+        qi->sq_cnt    = query->cnt;
+        qi->db_Z      = env->seq_db->db[query->dbx].K;
+        qi->hmm_db    = NULL;
+        qi->om_inx    = 0;
+        qi->om_cnt    = 0;
+      } else {
+        qi->sq_list   = NULL;
+        qi->sq_cnt    = 0;
+        qi->db_Z      = 0;
+        qi->hmm_db    = env->hmm_db;
+        qi->om_inx    = query->inx;
+        qi->om_cnt    = query->cnt;
+      }
     }
+
+    esl_threads_AddThread(threadObj, &info[i*nquery]);
   }
-  current_index = 0;
 
   esl_threads_WaitForStart(threadObj);
   esl_threads_WaitForFinish(threadObj);
@@ -307,35 +466,44 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
 #if 1
   fprintf (stdout, "   Sequences  Residues                              Elapsed\n");
   for (i = 0; i < env->ncpus; ++i) {
-    print_timings(i, info[i].elapsed, info[i].pli);
+    print_timings(i, info[i*nquery].elapsed, info[i*nquery].pli);
   }
 #endif
-  /* merge the results of the search results */
-  for (i = 1; i < env->ncpus; ++i) {
-    p7_tophits_Merge(info[0].th, info[i].th);
-    p7_pipeline_Merge(info[0].pli, info[i].pli);
-    p7_pipeline_Destroy(info[i].pli);
-    p7_tophits_Destroy(info[i].th);
-  }
+  /* merge the results of the search results for each query, and send
+   * them back in the order of the batch; each thread sorted its own hits
+   */
+  for (q = 0; q < nquery; q++) {
+    for (i = 1; i < env->ncpus; ++i) {
+      thv[i-1] = info[i*nquery + q].th;
+      p7_pipeline_Merge(info[q].pli, info[i*nquery + q].pli);
+      p7_pipeline_Destroy(info[i*nquery + q].pli);
+    }
+    if (p7_tophits_MergeN(info[q].th, thv, env->ncpus-1, env->ncpus) != eslOK) LOG_FATAL_MSG("merge hits", ENOMEM);
+    for (i = 1; i < env->ncpus; ++i) p7_tophits_Destroy(thv[i-1]);
 
-  print_timings(99, w->elapsed, info[0].pli);
-  send_results(env->fd, w, info[0].th, info[0].pli);
+    print_timings(99, w->elapsed, info[q].pli);
+    send_results(env->fd, w, info[q].th, info[q].pli);
 
-  /* free the last of the pipeline data */
-  p7_pipeline_Destroy(info->pli);
-  p7_tophits_Destroy(info->th);
+    /* free the last of the pipeline data */
+    p7_pipeline_Destroy(info[q].pli);
+    p7_tophits_Destroy(info[q].th);
+    p7_oprofile_Destroy(om[q]);
+  }
 
   esl_threads_Destroy(threadObj);
 
-  pthread_mutex_destroy(&inx_mutex);
+  work_Destroy(&work);
+  if (modcum) free(modcum);
 
-  if (info->range_list) {
-    if (info->range_list->starts)  free(info->range_list->starts);
-    if (info->range_list->ends)    free(info->range_list->ends);
-    free (info->range_list);
+  if (range_list) {
+    if (range_list->starts)  free(range_list->starts);
+    if (range_list->ends)    free(range_list->ends);
+    free (range_list);
   }
 
   free(info);
+  free(thv);
+  free(om);
 
   esl_stopwatch_Destroy(w);
   esl_alphabet_Destroy(abc);
@@ -346,6 +514,47 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
   LOG_FATAL_MSG("malloc", errno);
 }
 
+/* process_BatchCmd()
+ * Unpack the searches of an HMMD_CMD_BATCH command, each to search the
+ * batch's block of the database. Returns an array of them, and their
+ * number in <*ret_nquery>.
+ */
+static QUEUE_DATA **
+process_BatchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, int *ret_nquery)
+{
+  QUEUE_DATA   **qlist = NULL;
+  HMMD_COMMAND  *sub   = NULL;
+  HMMD_HEADER    hdr;
+  char          *p     = cmd->batch.data;
+  char          *end   = (char *) cmd + MSG_SIZE(cmd);
+  uint32_t       q;
+  int            n;
+
+  if (cmd->batch.nquery == 0) LOG_FATAL_MSG("empty search batch", EINVAL);
+  if ((qlist = malloc(sizeof(QUEUE_DATA *) * cmd->batch.nquery)) == NULL) LOG_FATAL_MSG("malloc", errno);
+
+  for (q = 0; q < cmd->batch.nquery; q++) {
+    /* copy each search out of the batch, so that its fields are aligned */
+    if (p + sizeof(HMMD_HEADER) > end) LOG_FATAL_MSG("truncated search batch", EINVAL);
+    memcpy(&hdr, p, sizeof(HMMD_HEADER));
+    n = MSG_SIZE(&hdr);
+    if (p + n > end || hdr.command != HMMD_CMD_SEARCH) LOG_FATAL_MSG("bad search batch", EINVAL);
+
+    if ((sub = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    memcpy(sub, p, n);
+    sub->srch.db_inx = cmd->batch.db_inx;
+    sub->srch.inx    = cmd->batch.inx;
+    sub->srch.cnt    = cmd->batch.cnt;
+
+    qlist[q] = process_QueryCmd(sub, env);
+    free(sub);
+    p += n;
+  }
+
+  *ret_nquery = cmd->batch.nquery;
+  return qlist;
+}
+
 static QUEUE_DATA *
 process_QueryCmd(HMMD_COMMAND *cmd, WORKER_ENV *env)
 {
@@ -506,6 +715,11 @@ process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
       LOG_FATAL_MSG("cache hmmdb error", status);
     }
 
+    if ( (status = p7_hmmcache_Pack(hcache)) != eslOK){
+      p7_syslog(LOG_ERR,"[%s:%d] - p7_hmmcache_Pack %s error %d\n", __FILE__, __LINE__, p, status);
+      LOG_FATAL_MSG("cache hmmdb error", status);
+    }
+
     /* validate the hmm database */
     cmd->init.hid[MAX_INIT_DESC-1] = 0;
     /* TODO: come up with a new pressed format with an id to compare - strcmp (cmd->init.hid, hdb->id) != 0 */
@@ -539,103 +753,104 @@ process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
 }
 
 
+/* build_query_profile()
+ * Build the optimized profile for a search command's query sequence
+ * or HMM. Done once per search in the main thread; each search thread
+ * then works on a p7_oprofile_Clone() of it, which shares the striped
+ * scores and only carries its own length configuration, instead of
+ * building (and for a sequence query, calibrating) a private copy.
+ */
+static P7_OPROFILE *
+build_query_profile(QUEUE_DATA *query)
+{
+  int          seed;
+  int          status;
+  P7_BUILDER  *bld = NULL;
+  P7_BG       *bg  = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+
+  bg = p7_bg_Create(query->abc);
+
+  if (query->seq != NULL) {
+    bld = p7_builder_Create(NULL, query->abc);
+    if ((seed = esl_opt_GetInteger(query->opts, "--seed")) > 0) {
+      esl_randomness_Init(bld->r, seed);
+      bld->do_reseeding = TRUE;
+    }
+    bld->EmL = esl_opt_GetInteger(query->opts, "--EmL");
+    bld->EmN = esl_opt_GetInteger(query->opts, "--EmN");
+    bld->EvL = esl_opt_GetInteger(query->opts, "--EvL");
+    bld->EvN = esl_opt_GetInteger(query->opts, "--EvN");
+    bld->EfL = esl_opt_GetInteger(query->opts, "--EfL");
+    bld->EfN = esl_opt_GetInteger(query->opts, "--EfN");
+    bld->Eft = esl_opt_GetReal   (query->opts, "--Eft");
+
+    if (esl_opt_IsOn(query->opts, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(query->opts, "--mxfile"), NULL, esl_opt_GetReal(query->opts, "--popen"), esl_opt_GetReal(query->opts, "--pextend"), bg);
+    else                                       status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(query->opts, "--mx"),           esl_opt_GetReal(query->opts, "--popen"), esl_opt_GetReal(query->opts, "--pextend"), bg); 
+    if (status != eslOK) p7_Fail("hmmpgmd: failed to set single query sequence score system: %s", bld->errbuf);
+
+    p7_SingleBuilder(bld, query->seq, bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
+    p7_builder_Destroy(bld);
+  } else {
+    gm = p7_profile_Create (query->hmm->M, query->abc);
+    om = p7_oprofile_Create(query->hmm->M, query->abc);
+    p7_ProfileConfig(query->hmm, bg, gm, 100, p7_LOCAL);
+    p7_oprofile_Convert(gm, om);
+    p7_profile_Destroy(gm);
+  }
+
+  p7_bg_Destroy(bg);
+  return om;
+}
+
 static void 
 search_thread(void *arg)
 {
-  int               i;
+  int               i, q;
+  int               inx;
   int               count;
-  int               seed;
-  int               status;
   int               workeridx;
   WORKER_INFO      *info;
   ESL_THREADS      *obj;
   ESL_SQ            dbsq;
   ESL_STOPWATCH    *w        = NULL;         /* timing stopwatch               */
-  P7_BUILDER       *bld      = NULL;         /* HMM construction configuration */
-  P7_BG            *bg       = NULL;         /* null model                     */
-  P7_PIPELINE      *pli      = NULL;         /* work pipeline                  */
-  P7_TOPHITS       *th       = NULL;         /* top hit results                */
-  P7_PROFILE       *gm       = NULL;         /* generic model                  */
-  P7_OPROFILE      *om       = NULL;         /* optimized query profile        */
+  P7_BG           **bg       = NULL;         /* null model, one per query      */
+  P7_OPROFILE     **om       = NULL;         /* this thread's clones of the query profiles */
 
   obj = (ESL_THREADS *) arg;
   esl_threads_Started(obj, &workeridx);
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
   w    = esl_stopwatch_Create();
-  bg   = p7_bg_Create(info->abc);
   esl_stopwatch_Start(w);
 
   /* set up the dummy description and accession fields */
   dbsq.desc = "";
   dbsq.acc  = "";
 
-  /* process a query sequence or hmm */
-  if (info->seq != NULL) {
-    bld = p7_builder_Create(NULL, info->abc);
-    if ((seed = esl_opt_GetInteger(info->opts, "--seed")) > 0) {
-      esl_randomness_Init(bld->r, seed);
-      bld->do_reseeding = TRUE;
-    }
-    bld->EmL = esl_opt_GetInteger(info->opts, "--EmL");
-    bld->EmN = esl_opt_GetInteger(info->opts, "--EmN");
-    bld->EvL = esl_opt_GetInteger(info->opts, "--EvL");
-    bld->EvN = esl_opt_GetInteger(info->opts, "--EvN");
-    bld->EfL = esl_opt_GetInteger(info->opts, "--EfL");
-    bld->EfN = esl_opt_GetInteger(info->opts, "--EfN");
-    bld->Eft = esl_opt_GetReal   (info->opts, "--Eft");
-
-    if (esl_opt_IsOn(info->opts, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(info->opts, "--mxfile"), NULL, esl_opt_GetReal(info->opts, "--popen"), esl_opt_GetReal(info->opts, "--pextend"), bg);
-    else                                      status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(info->opts, "--mx"),           esl_opt_GetReal(info->opts, "--popen"), esl_opt_GetReal(info->opts, "--pextend"), bg); 
-    if (status != eslOK) {
-      //client_error(info->sock, status, "hmmgpmd: failed to set single query sequence score system: %s", bld->errbuf);
-      fprintf(stderr, "hmmpgmd: failed to set single query sequence score system: %s", bld->errbuf);
-      pthread_exit(NULL);
-      return;
-    }
-    p7_SingleBuilder(bld, info->seq, bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
-    p7_builder_Destroy(bld);
-  } else {
-    gm = p7_profile_Create (info->hmm->M, info->abc);
-    om = p7_oprofile_Create(info->hmm->M, info->abc);
-    p7_ProfileConfig(info->hmm, bg, gm, 100, p7_LOCAL);
-    p7_oprofile_Convert(gm, om);
-  }
+  if ((bg = malloc(sizeof(P7_BG *)       * info->nquery)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((om = malloc(sizeof(P7_OPROFILE *) * info->nquery)) == NULL) LOG_FATAL_MSG("malloc", errno);
 
-  /* Create processing pipeline and hit list */
-  th  = p7_tophits_Create(); 
-  pli = p7_pipeline_Create(info->opts, om->M, 100, FALSE, p7_SEARCH_SEQS);
-  p7_pli_NewModel(pli, om, bg);
+  for (q = 0; q < info->nquery; q++) {
+    /* all threads share the query profile's scores; a clone carries
+     * only its own target length configuration
+     */
+    bg[q] = p7_bg_Create(info[q].abc);
+    if ((om[q] = p7_oprofile_Clone(info[q].om)) == NULL) LOG_FATAL_MSG("malloc", errno);
 
-  if (pli->Z_setby == p7_ZSETBY_NTARGETS) pli->Z = info->db_Z;
-
-  /* loop until all sequences have been processed */
-  count = 1;
-  while (count > 0) {
-    int          inx;
-    int          blksz;
-    HMMER_SEQ  **sq;
-
-    /* grab the next block of sequences */
-    if (pthread_mutex_lock(info->inx_mutex) != 0) p7_Fail("mutex lock failed");
-    inx = *info->inx;
-    blksz = *info->blk_size;
-    if (inx > *info->limit) {
-      blksz /= 5;
-      if (blksz < 1000) {
-        *info->limit = info->sq_cnt * 2;
-      } else {
-        *info->limit = inx + (info->sq_cnt - inx) * 2 / 3; 
-      }
-    }
-    *info->blk_size = blksz;
-    *info->inx += blksz;
-    if (pthread_mutex_unlock(info->inx_mutex) != 0) p7_Fail("mutex unlock failed");
+    /* Create processing pipeline and hit list */
+    info[q].th  = p7_tophits_Create(); 
+    info[q].pli = p7_pipeline_Create(info[q].opts, om[q]->M, 100, FALSE, p7_SEARCH_SEQS);
+    info[q].pli->do_profile = esl_opt_GetBoolean(info[q].opts, "--profile");
+    p7_pli_NewModel(info[q].pli, om[q], bg[q]);
 
-    sq = info->sq_list + inx;
+    if (info[q].pli->Z_setby == p7_ZSETBY_NTARGETS) info[q].pli->Z = info[q].db_Z;
+  }
 
-    count = info->sq_cnt - inx;
-    if (count > blksz) count = blksz;
+  /* loop until all sequences have been processed, a chunk at a time */
+  while ((count = work_Claim(info->work, &inx)) > 0) {
+    HMMER_SEQ  **sq = info->sq_list + inx;
 
     /* Main loop: */
     for (i = 0; i < count; ++i, ++sq) {
@@ -646,25 +861,29 @@ search_thread(void *arg)
         dbsq.idx   = (*sq)->idx;
         if((*sq)->desc != NULL) dbsq.desc  = (*sq)->desc;
 
-        p7_bg_SetLength(bg, dbsq.n);
-        p7_oprofile_ReconfigLength(om, dbsq.n);
+        /* every query of a batch while the target is in cache */
+        for (q = 0; q < info->nquery; q++) {
+          p7_bg_SetLength(bg[q], dbsq.n);
+          p7_oprofile_ReconfigLength(om[q], dbsq.n);
 
-        p7_Pipeline(pli, om, bg, &dbsq, NULL, th);
+          p7_Pipeline(info[q].pli, om[q], bg[q], &dbsq, NULL, info[q].th);
 
-        p7_pipeline_Reuse(pli);
+          p7_pipeline_Reuse(info[q].pli);
+        }
       }
     }
   }
 
-  /* make available the pipeline objects to the main thread */
-  info->th = th;
-  info->pli = pli;
-
-  /* clean up */
-  p7_bg_Destroy(bg);
-  p7_oprofile_Destroy(om);
+  /* make available the pipeline objects to the main thread, hits sorted here so it only merges them */
+  for (q = 0; q < info->nquery; q++) {
+    p7_tophits_SortBySortkey(info[q].th);
 
-  if (gm != NULL)  p7_profile_Destroy(gm);
+    /* clean up */
+    p7_bg_Destroy(bg[q]);
+    p7_oprofile_Destroy(om[q]);
+  }
+  free(bg);
+  free(om);
 
   esl_stopwatch_Stop(w);
   info->elapsed = w->elapsed;
@@ -680,7 +899,7 @@ search_thread(void *arg)
 static void 
 scan_thread(void *arg)
 {
-  int               i;
+  int               inx;
   int               count;
   int               workeridx;
   WORKER_INFO      *info;
@@ -706,48 +925,16 @@ scan_thread(void *arg)
   /* Create processing pipeline and hit list */
   th  = p7_tophits_Create(); 
   pli = p7_pipeline_Create(info->opts, 100, 100, FALSE, p7_SCAN_MODELS);
+  pli->do_profile = esl_opt_GetBoolean(info->opts, "--profile");
 
   p7_pli_NewSeq(pli, info->seq);
 
-  /* loop until all sequences have been processed */
-  count = 1;
-  while (count > 0) {
-    int           inx;
-    int          blksz;
-    P7_OPROFILE **om;
-
-    /* grab the next block of sequences */
-    if (pthread_mutex_lock(info->inx_mutex) != 0) p7_Fail("mutex lock failed");
-    inx   = *info->inx;
-    blksz = *info->blk_size;
-    if (inx > *info->limit) {
-      blksz /= 5;
-      if (blksz < 1000) {
-        *info->limit = info->om_cnt * 2;
-      } else {
-        *info->limit = inx + (info->om_cnt - inx) * 2 / 3; 
-      }
-    }
-    *info->blk_size = blksz;
-    *info->inx += blksz;
-    if (pthread_mutex_unlock(info->inx_mutex) != 0) p7_Fail("mutex unlock failed");
-
-    om    = info->om_list + inx;
-    count = info->om_cnt - inx;
-    if (count > blksz) count = blksz;
+  /* loop until all profiles have been processed, a chunk at a time */
+  while ((count = work_Claim(info->work, &inx)) > 0)
+    scan_profiles(info, inx, count, pli, bg, th);
 
-    /* Main loop: */
-    for (i = 0; i < count; ++i, ++om) {
-      p7_pli_NewModel(pli, *om, bg);
-      p7_bg_SetLength(bg, info->seq->n);
-      p7_oprofile_ReconfigLength(*om, info->seq->n);
-	      
-      p7_Pipeline(pli, *om, bg, info->seq, NULL, th);
-      p7_pipeline_Reuse(pli);
-    }
-  }
-
-  /* make available the pipeline objects to the main thread */
+  /* make available the pipeline objects to the main thread, hits sorted here so it only merges them */
+  p7_tophits_SortBySortkey(th);
   info->th = th;
   info->pli = pli;
 
@@ -765,6 +952,72 @@ scan_thread(void *arg)
   return;
 }
 
+/* scan_profile()
+ * Run the scan pipeline for query sequence <sq> against one profile <om>.
+ */
+static void
+scan_profile(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, P7_TOPHITS *th)
+{
+  p7_pli_NewModel(pli, om, bg);
+  p7_bg_SetLength(bg, sq->n);
+  p7_oprofile_ReconfigLength(om, sq->n);
+
+  p7_Pipeline(pli, om, bg, sq, NULL, th);
+  p7_pipeline_Reuse(pli);
+}
+
+/* scan_profiles()
+ * Run the scan pipeline for the query sequence against profiles
+ * <inx..inx+count-1> of the worker's range of the cache. Each pack
+ * window of the cache that lies entirely inside that block is done
+ * with the window's packs first (see p7_hmmcache_Pack(),
+ * p7_pli_SSVPack()): profiles that the multi-model SSV filter says
+ * fail are only counted. Everything else goes one profile at a time.
+ */
+static void
+scan_profiles(WORKER_INFO *info, int inx, int count, P7_PIPELINE *pli, P7_BG *bg, P7_TOPHITS *th)
+{
+  P7_HMMCACHE  *cache = info->hmm_db;
+  int           a     = info->om_inx + inx;   /* block is cache->list[a..b-1] */
+  int           b     = a + count;
+  int           lo, hi, k;
+#if defined (eslENABLE_SSE)
+  P7_OPROFILE  *lane[p7O_PACK_LANES];
+  P7_OM_PACK   *pk;
+  int           w, p, s;
+  int           status;
+#endif
+
+  for (lo = a; lo < b; lo = hi)
+    {
+      hi = ESL_MIN(b, (lo / p7_HMMCACHE_PACKWIN + 1) * p7_HMMCACHE_PACKWIN);
+
+#if defined (eslENABLE_SSE)
+      w = lo / p7_HMMCACHE_PACKWIN;
+      if (cache->pack && lo == w * p7_HMMCACHE_PACKWIN && hi == ESL_MIN((int) cache->n, (w+1) * p7_HMMCACHE_PACKWIN))
+	{
+	  k = lo;
+	  for (p = cache->wpack[w]; p < cache->wpack[w+1]; p++, k += pk->n)
+	    {
+	      pk = cache->pack[p];
+	      for (s = 0; s < pk->n; s++) lane[s] = cache->list[cache->perm[k+s]];
+
+	      status = p7_pli_SSVPack(pli, lane, pk, bg, info->seq);
+	      if (status != eslOK && status != eslENORESULT) p7_Fail("multi-model SSV filter failed");
+
+	      for (s = 0; s < pk->n; s++)
+		if (status == eslOK && pli->ssv_fail[s]) p7_pli_NewModel(pli, lane[s], bg);
+		else                                     scan_profile(pli, lane[s], bg, info->seq, th);
+	    }
+	  for ( ; k < hi; k++) scan_profile(pli, cache->list[cache->perm[k]], bg, info->seq, th);
+	  continue;
+	}
+#endif
+
+      for (k = lo; k < hi; k++) scan_profile(pli, cache->list[k], bg, info->seq, th);
+    }
+}
+
 
 static void
 send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
@@ -798,6 +1051,7 @@ send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
   stats.n_past_bias = pli->n_past_bias;
   stats.n_past_vit  = pli->n_past_vit;
   stats.n_past_fwd  = pli->n_past_fwd;
+  memcpy(stats.prof, pli->prof, sizeof(P7_PLI_PROFILE) * p7_PLI_NSTAGES);
 
   stats.Z           = pli->Z;
   stats.domZ        = pli->domZ;
@@ -812,13 +1066,19 @@ send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
     LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATS failed", errno);
   }
 
-  // and then the hits
+  // and then the hits, in rank order: the master merges the sorted lists of its workers
+  p7_tophits_SortBySortkey(th);
   for(i =0; i< stats.nhits; i++){
-    if(p7_hit_Serialize(&(th->unsrt[i]), buf, &n, &nalloc) != eslOK){
+    if(p7_hit_Serialize(th->hit[i], buf, &n, &nalloc) != eslOK){
       LOG_FATAL_MSG("Serializing P7_HIT failed", errno);
     }
   }
 
+  // and with --profile, our pipeline profile, which the master sums and passes on as JSON
+  if(pli->do_profile && p7_hmmd_search_stats_SerializeProfile(&stats, buf, &n, &nalloc) != eslOK){
+    LOG_FATAL_MSG("Serializing pipeline profile failed", errno);
+  }
+
   status.msg_size = n; // n will have the number of bytes used to serialize the main data block
   n = 0;
   nalloc = 0; // reset these to serialize status object
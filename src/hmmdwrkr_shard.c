@@ -42,6 +42,29 @@
 #define MAX_WORKERS  64
 #define MAX_BUFFER   4096
 
+/* A worker's search threads share out the block of targets it was
+ * given, items [0..n-1], a chunk at a time. Chunks are sized by cost
+ * (residues of target sequences, or lengths of target profiles, plus
+ * <itemcost> for each target), not by count, since a block of long
+ * sequences costs far more than one of short ones. Each chunk is a
+ * 1/(2*nthreads) share of the cost still left, but no less than
+ * <mincost>, so chunks shrink toward the end and the threads finish
+ * together. A claim is one compare-and-swap on <next>.
+ */
+typedef struct {
+  const uint64_t  *cum;          /* cum[i] - cum[0]: residues in items [0..i-1]; [0..n] */
+  int              n;
+  uint64_t         itemcost;     /* fixed cost of each item, in residues             */
+  uint64_t         mincost;      /* smallest chunk worth a claim                      */
+  int              nthreads;
+  int              base;         /* absolute index of item 0, for <align>             */
+  int              align;        /* chunks end at (absolute) multiples of this, or at n */
+  int              next;         /* first unclaimed item                              */
+#if ! defined(__GNUC__)
+  pthread_mutex_t  mutex;        /* no compare-and-swap: claims take a lock           */
+#endif
+} WORK_CHUNKS;
+
 #define CONF_FILE "/etc/hmmpgmd.conf"
 
 typedef struct {
@@ -52,13 +75,11 @@ typedef struct {
   P7_OPROFILE     **om_list;     /* list of profiles to process      */
   int               om_cnt;      /* number of profiles               */
 
-  pthread_mutex_t  *inx_mutex;   /* protect data                     */
-  int              *blk_size;    /* sequences per block              */
-  int              *limit;       /* point to decrease block size     */
-  int              *inx;         /* next index to process            */
+  WORK_CHUNKS      *work;        /* shared by all threads: who does which targets */
 
   P7_HMM           *hmm;         /* query HMM                        */
   ESL_SQ           *seq;         /* query sequence                   */
+  P7_OPROFILE      *om;          /* query profile, shared read-only  */
   ESL_ALPHABET     *abc;         /* digital alphabet                 */
   ESL_GETOPTS      *opts;        /* search specific options          */
 
@@ -107,6 +128,12 @@ static int  setup_masterside_comm(ESL_GETOPTS *opts);
 static void send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli);
 
 #define BLOCK_SIZE 1000
+
+#define WORK_SEQCOST  64         /* per-target cost of a sequence, in residues   */
+#define WORK_SEQMIN   (1 << 16)  /* smallest chunk of sequences, in residues      */
+#define WORK_HMMCOST  16         /* per-target cost of a profile, in model nodes  */
+#define WORK_HMMMIN   (1 << 12)  /* smallest chunk of profiles, in model nodes    */
+static P7_OPROFILE *build_query_profile(QUEUE_DATA_SHARD *query);
 static void search_thread(void *arg);
 static void scan_thread(void *arg);
 
@@ -126,6 +153,107 @@ print_timings(int i, double elapsed, P7_PIPELINE *pli)
            i, pli->nseqs, pli->nres, pli->n_past_msv, pli->n_past_bias, pli->n_past_vit, pli->n_past_fwd, buf1);
 }
 
+/* work_Init()
+ * Share out items [0..n-1], whose running residue counts are <cum>,
+ * between <nthreads> threads. See WORK_CHUNKS.
+ */
+static void
+work_Init(WORK_CHUNKS *wc, const uint64_t *cum, int n, uint64_t itemcost, uint64_t mincost, int nthreads, int base, int align)
+{
+  wc->cum      = cum;
+  wc->n        = n;
+  wc->itemcost = itemcost;
+  wc->mincost  = mincost;
+  wc->nthreads = nthreads;
+  wc->base     = base;
+  wc->align    = (align > 1) ? align : 1;
+  wc->next     = 0;
+#if ! defined(__GNUC__)
+  if (pthread_mutex_init(&wc->mutex, NULL) != 0) p7_Fail("mutex init failed");
+#endif
+}
+
+static void
+work_Destroy(WORK_CHUNKS *wc)
+{
+#if ! defined(__GNUC__)
+  pthread_mutex_destroy(&wc->mutex);
+#endif
+}
+
+static uint64_t
+work_cost(const WORK_CHUNKS *wc, int a, int b)
+{
+  return (wc->cum[b] - wc->cum[a]) + wc->itemcost * (uint64_t) (b - a);
+}
+
+/* work_claim_from()
+ * Try to move the first unclaimed item from <*start> to <end>. If
+ * another thread got there first, return FALSE, with <*start> now the
+ * first unclaimed item.
+ */
+static int
+work_claim_from(WORK_CHUNKS *wc, int *start, int end)
+{
+#if defined(__GNUC__)
+  return __atomic_compare_exchange_n(&wc->next, start, end, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+#else
+  int ok;
+
+  if (pthread_mutex_lock(&wc->mutex) != 0) p7_Fail("mutex lock failed");
+  if ((ok = (wc->next == *start)) == TRUE) wc->next = end;
+  else                                     *start  = wc->next;
+  if (pthread_mutex_unlock(&wc->mutex) != 0) p7_Fail("mutex unlock failed");
+  return ok;
+#endif
+}
+
+/* work_Claim()
+ * Claim the next chunk of items for the calling thread. Returns the
+ * number of items in it, with the first in <*ret_start>, or 0 when
+ * there are none left.
+ */
+static int
+work_Claim(WORK_CHUNKS *wc, int *ret_start)
+{
+  int      start;
+  int      end;
+  int      lo, hi, mid;
+  uint64_t want;
+
+#if defined(__GNUC__)
+  start = __atomic_load_n(&wc->next, __ATOMIC_RELAXED);
+#else
+  if (pthread_mutex_lock(&wc->mutex) != 0) p7_Fail("mutex lock failed");
+  start = wc->next;
+  if (pthread_mutex_unlock(&wc->mutex) != 0) p7_Fail("mutex unlock failed");
+#endif
+
+  do {
+    if (start >= wc->n) return 0;
+
+    want = ESL_MAX(work_cost(wc, start, wc->n) / (2 * wc->nthreads), wc->mincost);
+
+    /* the fewest items from <start> that cost at least <want> */
+    lo = start + 1;
+    hi = wc->n;
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (work_cost(wc, start, mid) >= want) hi = mid;
+      else                                   lo = mid + 1;
+    }
+    end = lo;
+
+    if (wc->align > 1 && end < wc->n) {
+      end = ((wc->base + end + wc->align - 1) / wc->align) * wc->align - wc->base;
+      if (end > wc->n) end = wc->n;
+    }
+  } while (! work_claim_from(wc, &start, end));
+
+  *ret_start = start;
+  return end - start;
+}
+
 static int
 read_Command(HMMD_COMMAND_SHARD **ret_cmd, WORKER_ENV *env)
 {
@@ -214,24 +342,23 @@ static void
 process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *query)
 { 
   int              i;
-  int              cnt;
-  int              limit;
   int              status;
-  int              blk_size;
   WORKER_INFO     *info       = NULL;
+  P7_TOPHITS     **thv        = NULL;
   ESL_ALPHABET    *abc;
   ESL_STOPWATCH   *w;
   ESL_THREADS     *threadObj  = NULL;
-  pthread_mutex_t  inx_mutex;
-  int              current_index;
+  P7_OPROFILE     *om         = NULL;
+  WORK_CHUNKS      work;                    /* how the threads share out the shard */
+  uint64_t        *modcum     = NULL;       /* running model lengths of the target profiles, for a scan */
   time_t           date;
   char             timestamp[32];
 
   w = esl_stopwatch_Create();
   abc = esl_alphabet_Create(eslAMINO);
 
-  if (pthread_mutex_init(&inx_mutex, NULL) != 0) p7_Fail("mutex init failed");
   ESL_ALLOC(info, sizeof(*info) * env->ncpus);
+  ESL_ALLOC(thv,  sizeof(P7_TOPHITS *) * env->ncpus);
 
   /* Log the current time (at search start) */
   date = time(NULL);
@@ -273,11 +400,28 @@ process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *qu
 
   fprintf(stdout, "\n");
 
+  /* build the query profile once, for all search threads */
+  if (query->cmd_type == HMMD_CMD_SEARCH) om = build_query_profile(query);
+
+  /* share out the targets by their cost: the residues of the shard's
+   * sequences, counted when it was cached, or the lengths of the
+   * target profiles. A search always covers the whole shard.
+   */
+  if (query->cmd_type == HMMD_CMD_SEARCH) {
+    work_Init(&work, env->seq_db->db[query->dbx].rescum, env->seq_db->db[query->dbx].count, WORK_SEQCOST, WORK_SEQMIN, env->ncpus, 0, 1);
+  } else {
+    ESL_ALLOC(modcum, sizeof(uint64_t) * (query->cnt + 1));
+    modcum[0] = 0;
+    for (i = 0; i < query->cnt; i++) modcum[i+1] = modcum[i] + env->hmm_db->list[query->inx + i]->M;
+    work_Init(&work, modcum, query->cnt, WORK_HMMCOST, WORK_HMMMIN, env->ncpus, query->inx, 1);
+  }
+
   /* Create processing pipeline and hit list */
   for (i = 0; i < env->ncpus; ++i) {
     info[i].abc   = query->abc;
     info[i].hmm   = query->hmm;
     info[i].seq   = query->seq;
+    info[i].om    = om;
     info[i].opts  = query->opts;
 
     info[i].range_list  = info[0].range_list;
@@ -285,10 +429,7 @@ process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *qu
     info[i].th    = NULL;
     info[i].pli   = NULL;
 
-    info[i].inx_mutex = &inx_mutex;
-    info[i].inx       = &current_index;/* this is confusing trickery - to share a single variable across all threads */
-    info[i].blk_size  = &blk_size;     /* ditto */
-    info[i].limit     = &limit;	       /* ditto. TODO: come back and clean this up. */
+    info[i].work  = &work;
 
     if (query->cmd_type == HMMD_CMD_SEARCH) {
       HMMER_SEQ **list  = env->seq_db->db[query->dbx].list;
@@ -309,24 +450,6 @@ process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *qu
     esl_threads_AddThread(threadObj, &info[i]);
   }
 
-  /* try block size of 5000.  we will need enough sequences for four
-   * blocks per thread or better.
-   */
-  blk_size = 5000;
-  cnt = query->cnt / env->ncpus / blk_size;
-  limit = query->cnt * 2 / 3;
-  if (cnt < 4) {
-    /* try block size of 1000  */
-    blk_size /= 5;
-    cnt = query->cnt / env->ncpus / blk_size;
-    if (cnt < 4) {
-      /* still not enough.  just divide it up into one block per thread */
-      blk_size = query->cnt / env->ncpus + 1;
-      limit = query->cnt * 2;
-    }
-  }
-  current_index = 0;
-
   esl_threads_WaitForStart(threadObj);
   esl_threads_WaitForFinish(threadObj);
 
@@ -337,13 +460,14 @@ process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *qu
     print_timings(i, info[i].elapsed, info[i].pli);
   }
 #endif
-  /* merge the results of the search results */
+  /* merge the results of the search results; each thread sorted its own hits */
   for (i = 1; i < env->ncpus; ++i) {
-    p7_tophits_Merge(info[0].th, info[i].th);
+    thv[i-1] = info[i].th;
     p7_pipeline_Merge(info[0].pli, info[i].pli);
     p7_pipeline_Destroy(info[i].pli);
-    p7_tophits_Destroy(info[i].th);
   }
+  if (p7_tophits_MergeN(info[0].th, thv, env->ncpus-1, env->ncpus) != eslOK) LOG_FATAL_MSG("merge hits", ENOMEM);
+  for (i = 1; i < env->ncpus; ++i) p7_tophits_Destroy(thv[i-1]);
 
   print_timings(99, w->elapsed, info[0].pli);
   send_results(env->fd, w, info[0].th, info[0].pli);
@@ -353,8 +477,10 @@ process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *qu
   p7_tophits_Destroy(info->th);
 
   esl_threads_Destroy(threadObj);
+  p7_oprofile_Destroy(om);
 
-  pthread_mutex_destroy(&inx_mutex);
+  work_Destroy(&work);
+  if (modcum) free(modcum);
 
   if (info->range_list) {
     if (info->range_list->starts)  free(info->range_list->starts);
@@ -363,6 +489,7 @@ process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *qu
   }
 
   free(info);
+  free(thv);
 
   esl_stopwatch_Destroy(w);
   esl_alphabet_Destroy(abc);
@@ -568,24 +695,72 @@ process_InitCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV  *env)
 }
 
 
+/* build_query_profile()
+ * Build the optimized profile for a search command's query sequence
+ * or HMM. Done once per search in the main thread; each search thread
+ * then works on a p7_oprofile_Clone() of it, which shares the striped
+ * scores and only carries its own length configuration, instead of
+ * building (and for a sequence query, calibrating) a private copy.
+ */
+static P7_OPROFILE *
+build_query_profile(QUEUE_DATA_SHARD *query)
+{
+  int          seed;
+  int          status;
+  P7_BUILDER  *bld = NULL;
+  P7_BG       *bg  = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+
+  bg = p7_bg_Create(query->abc);
+
+  if (query->seq != NULL) {
+    bld = p7_builder_Create(NULL, query->abc);
+    if ((seed = esl_opt_GetInteger(query->opts, "--seed")) > 0) {
+      esl_randomness_Init(bld->r, seed);
+      bld->do_reseeding = TRUE;
+    }
+    bld->EmL = esl_opt_GetInteger(query->opts, "--EmL");
+    bld->EmN = esl_opt_GetInteger(query->opts, "--EmN");
+    bld->EvL = esl_opt_GetInteger(query->opts, "--EvL");
+    bld->EvN = esl_opt_GetInteger(query->opts, "--EvN");
+    bld->EfL = esl_opt_GetInteger(query->opts, "--EfL");
+    bld->EfN = esl_opt_GetInteger(query->opts, "--EfN");
+    bld->Eft = esl_opt_GetReal   (query->opts, "--Eft");
+
+    if (esl_opt_IsOn(query->opts, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(query->opts, "--mxfile"), NULL, esl_opt_GetReal(query->opts, "--popen"), esl_opt_GetReal(query->opts, "--pextend"), bg);
+    else                                       status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(query->opts, "--mx"),           esl_opt_GetReal(query->opts, "--popen"), esl_opt_GetReal(query->opts, "--pextend"), bg); 
+    if (status != eslOK) p7_Fail("hmmpgmd: failed to set single query sequence score system: %s", bld->errbuf);
+
+    p7_SingleBuilder(bld, query->seq, bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
+    p7_builder_Destroy(bld);
+  } else {
+    gm = p7_profile_Create (query->hmm->M, query->abc);
+    om = p7_oprofile_Create(query->hmm->M, query->abc);
+    p7_ProfileConfig(query->hmm, bg, gm, 100, p7_LOCAL);
+    p7_oprofile_Convert(gm, om);
+    p7_profile_Destroy(gm);
+  }
+
+  p7_bg_Destroy(bg);
+  return om;
+}
+
 static void 
 search_thread(void *arg)
 {
   int               i;
   int               count;
-  int               seed;
-  int               status;
+  int               inx;
   int               workeridx;
   WORKER_INFO      *info;
   ESL_THREADS      *obj;
   ESL_SQ            dbsq;
   ESL_STOPWATCH    *w        = NULL;         /* timing stopwatch               */
-  P7_BUILDER       *bld      = NULL;         /* HMM construction configuration */
   P7_BG            *bg       = NULL;         /* null model                     */
   P7_PIPELINE      *pli      = NULL;         /* work pipeline                  */
   P7_TOPHITS       *th       = NULL;         /* top hit results                */
-  P7_PROFILE       *gm       = NULL;         /* generic model                  */
-  P7_OPROFILE      *om       = NULL;         /* optimized query profile        */
+  P7_OPROFILE      *om       = NULL;         /* this thread's clone of the query profile */
 
   obj = (ESL_THREADS *) arg;
   esl_threads_Started(obj, &workeridx);
@@ -599,41 +774,15 @@ search_thread(void *arg)
   dbsq.desc = "";
   dbsq.acc  = "";
 
-  /* process a query sequence or hmm */
-  if (info->seq != NULL) {
-    bld = p7_builder_Create(NULL, info->abc);
-    if ((seed = esl_opt_GetInteger(info->opts, "--seed")) > 0) {
-      esl_randomness_Init(bld->r, seed);
-      bld->do_reseeding = TRUE;
-    }
-    bld->EmL = esl_opt_GetInteger(info->opts, "--EmL");
-    bld->EmN = esl_opt_GetInteger(info->opts, "--EmN");
-    bld->EvL = esl_opt_GetInteger(info->opts, "--EvL");
-    bld->EvN = esl_opt_GetInteger(info->opts, "--EvN");
-    bld->EfL = esl_opt_GetInteger(info->opts, "--EfL");
-    bld->EfN = esl_opt_GetInteger(info->opts, "--EfN");
-    bld->Eft = esl_opt_GetReal   (info->opts, "--Eft");
-
-    if (esl_opt_IsOn(info->opts, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(info->opts, "--mxfile"), NULL, esl_opt_GetReal(info->opts, "--popen"), esl_opt_GetReal(info->opts, "--pextend"), bg);
-    else                                      status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(info->opts, "--mx"),           esl_opt_GetReal(info->opts, "--popen"), esl_opt_GetReal(info->opts, "--pextend"), bg); 
-    if (status != eslOK) {
-      //client_error(info->sock, status, "hmmgpmd: failed to set single query sequence score system: %s", bld->errbuf);
-      fprintf(stderr, "hmmpgmd: failed to set single query sequence score system: %s", bld->errbuf);
-      pthread_exit(NULL);
-      return;
-    }
-    p7_SingleBuilder(bld, info->seq, bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
-    p7_builder_Destroy(bld);
-  } else {
-    gm = p7_profile_Create (info->hmm->M, info->abc);
-    om = p7_oprofile_Create(info->hmm->M, info->abc);
-    p7_ProfileConfig(info->hmm, bg, gm, 100, p7_LOCAL);
-    p7_oprofile_Convert(gm, om);
-  }
+  /* all threads share the query profile's scores; a clone carries
+   * only its own target length configuration
+   */
+  if ((om = p7_oprofile_Clone(info->om)) == NULL) LOG_FATAL_MSG("malloc", errno);
 
   /* Create processing pipeline and hit list */
   th  = p7_tophits_Create(); 
   pli = p7_pipeline_Create(info->opts, om->M, 100, FALSE, p7_SEARCH_SEQS);
+  pli->do_profile = esl_opt_GetBoolean(info->opts, "--profile");
   p7_pli_NewModel(pli, om, bg);
 
   if (pli->Z_setby == p7_ZSETBY_NTARGETS) pli->Z = info->db_Z;
@@ -641,32 +790,8 @@ search_thread(void *arg)
   //  printf("Worker thread starting range-list search\n");
   }
   /* loop until all sequences have been processed */
-  count = 1;
-  while (count > 0) {
-    int          inx;
-    int          blksz;
-    HMMER_SEQ  **sq;
-
-    /* grab the next block of sequences */
-    if (pthread_mutex_lock(info->inx_mutex) != 0) p7_Fail("mutex lock failed");
-    inx = *info->inx;
-    blksz = *info->blk_size;
-    if (inx > *info->limit) {
-      blksz /= 5;
-      if (blksz < 1000) {
-        *info->limit = info->sq_cnt * 2;
-      } else {
-        *info->limit = inx + (info->sq_cnt - inx) * 2 / 3; 
-      }
-    }
-    *info->blk_size = blksz;
-    *info->inx += blksz;
-    if (pthread_mutex_unlock(info->inx_mutex) != 0) p7_Fail("mutex unlock failed");
-
-    sq = info->sq_list + inx;
-
-    count = info->sq_cnt - inx;
-    if (count > blksz) count = blksz;
+  while ((count = work_Claim(info->work, &inx)) > 0) {
+    HMMER_SEQ  **sq = info->sq_list + inx;
 
     /* Main loop: */
     for (i = 0; i < count; ++i, ++sq) {
@@ -690,7 +815,8 @@ search_thread(void *arg)
     }
   }
 
-  /* make available the pipeline objects to the main thread */
+  /* make available the pipeline objects to the main thread, hits sorted here so it only merges them */
+  p7_tophits_SortBySortkey(th);
   info->th = th;
   info->pli = pli;
 
@@ -698,8 +824,6 @@ search_thread(void *arg)
   p7_bg_Destroy(bg);
   p7_oprofile_Destroy(om);
 
-  if (gm != NULL)  p7_profile_Destroy(gm);
-
   esl_stopwatch_Stop(w);
   info->elapsed = w->elapsed;
 
@@ -716,6 +840,7 @@ scan_thread(void *arg)
 {
   int               i;
   int               count;
+  int               inx;
   int               workeridx;
   WORKER_INFO      *info;
   ESL_THREADS      *obj;
@@ -740,35 +865,13 @@ scan_thread(void *arg)
   /* Create processing pipeline and hit list */
   th  = p7_tophits_Create(); 
   pli = p7_pipeline_Create(info->opts, 100, 100, FALSE, p7_SCAN_MODELS);
+  pli->do_profile = esl_opt_GetBoolean(info->opts, "--profile");
 
   p7_pli_NewSeq(pli, info->seq);
 
-  /* loop until all sequences have been processed */
-  count = 1;
-  while (count > 0) {
-    int           inx;
-    int          blksz;
-    P7_OPROFILE **om;
-
-    /* grab the next block of sequences */
-    if (pthread_mutex_lock(info->inx_mutex) != 0) p7_Fail("mutex lock failed");
-    inx   = *info->inx;
-    blksz = *info->blk_size;
-    if (inx > *info->limit) {
-      blksz /= 5;
-      if (blksz < 1000) {
-        *info->limit = info->om_cnt * 2;
-      } else {
-        *info->limit = inx + (info->om_cnt - inx) * 2 / 3; 
-      }
-    }
-    *info->blk_size = blksz;
-    *info->inx += blksz;
-    if (pthread_mutex_unlock(info->inx_mutex) != 0) p7_Fail("mutex unlock failed");
-
-    om    = info->om_list + inx;
-    count = info->om_cnt - inx;
-    if (count > blksz) count = blksz;
+  /* loop until all profiles have been processed */
+  while ((count = work_Claim(info->work, &inx)) > 0) {
+    P7_OPROFILE **om = info->om_list + inx;
 
     /* Main loop: */
     for (i = 0; i < count; ++i, ++om) {
@@ -781,7 +884,8 @@ scan_thread(void *arg)
     }
   }
 
-  /* make available the pipeline objects to the main thread */
+  /* make available the pipeline objects to the main thread, hits sorted here so it only merges them */
+  p7_tophits_SortBySortkey(th);
   info->th = th;
   info->pli = pli;
 
@@ -832,6 +936,7 @@ send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
   stats.n_past_bias = pli->n_past_bias;
   stats.n_past_vit  = pli->n_past_vit;
   stats.n_past_fwd  = pli->n_past_fwd;
+  memcpy(stats.prof, pli->prof, sizeof(P7_PLI_PROFILE) * p7_PLI_NSTAGES);
 
   stats.Z           = pli->Z;
   stats.domZ        = pli->domZ;
@@ -848,13 +953,19 @@ send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
     LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATS failed", errno);
   }
 
-  // and then the hits
+  // and then the hits, in rank order: the master merges the sorted lists of its workers
+  p7_tophits_SortBySortkey(th);
   for(i =0; i< stats.nhits; i++){
-    if(p7_hit_Serialize(&(th->unsrt[i]), buf, &n, &nalloc) != eslOK){
+    if(p7_hit_Serialize(th->hit[i], buf, &n, &nalloc) != eslOK){
       LOG_FATAL_MSG("Serializing P7_HIT failed", errno);
     }
   }
 
+  // and with --profile, our pipeline profile, which the master sums and passes on as JSON
+  if(pli->do_profile && p7_hmmd_search_stats_SerializeProfile(&stats, buf, &n, &nalloc) != eslOK){
+    LOG_FATAL_MSG("Serializing pipeline profile failed", errno);
+  }
+
   status.msg_size = n; // n will have the number of bytes used to serialize the main data block
   n = 0;
   nalloc = 0; // reset these to serialize status object
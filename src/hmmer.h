@@ -10,7 +10,7 @@
  *    6. P7_GMX:         a "generic" dynamic programming matrix
  *    7. P7_PRIOR:       mixture Dirichlet prior for profile HMMs
  *    8. P7_SPENSEMBLE:  segment pair ensembles for domain locations
- *    9. P7_ALIDISPLAY:  an alignment formatted for printing
+ *    9. P7_ALIDISPLAY:  an alignment formatted for printing; P7_ARENA, bulk storage for hits
  *   10. P7_DOMAINDEF:   reusably managing workflow in annotating domains
  *   11. P7_TOPHITS:     ranking lists of top-scoring hits
  *   12. P7_SCOREDATA:     data used in diagonal recovery and extension
@@ -427,6 +427,15 @@ typedef struct p7_hmmfile_s {
   FILE         *ffp;		/* MSV part of the optimized profile */
   FILE         *pfp;		/* rest of the optimized profile     */
 
+  /* Optionally, p7_oprofile_Map() maps both pressed files into memory; then
+   * profiles are parsed from the maps, and their score vectors point into them.
+   */
+  char         *fmap;		/* mmap() of the .h3f file, or NULL           */
+  size_t        fmapsize;	/* size of <fmap> in bytes                    */
+  off_t         fmapoff;	/* offset of the next MSV record in <fmap>    */
+  char         *pmap;		/* mmap() of the .h3p file, or NULL           */
+  size_t        pmapsize;	/* size of <pmap> in bytes                    */
+
 #ifdef HMMER_THREADS
   int              syncRead;
   pthread_mutex_t  readMutex;
@@ -569,6 +578,32 @@ typedef struct p7_spensemble_s {
  * 9. P7_ALIDISPLAY: an alignment formatted for printing
  *****************************************************************/
 
+/* Structure: P7_ARENA
+ *
+ * Bulk storage for the many small allocations that a hit list
+ * accumulates: target names, domain lists, alignment displays.
+ * Allocation just bumps a pointer in the current block; nothing is
+ * freed individually. Everything goes at once, when the arena is
+ * reset or destroyed, or is handed to another arena when hit lists
+ * are merged. An arena is used by one thread at a time.
+ */
+#define p7_ARENA_BLOCKSIZE  65536     /* size of the first block, in bytes            */
+#define p7_ARENA_MAXBLOCK   1048576   /* blocks double in size up to this             */
+
+typedef struct p7_arenablock_s {
+  struct p7_arenablock_s *next;	/* next older block; NULL at the end of the chain */
+  size_t  size;			/* usable bytes in <mem>                          */
+  size_t  used;			/* bytes handed out so far                        */
+  char   *mem;
+} P7_ARENABLOCK;
+
+typedef struct p7_arena_s {
+  P7_ARENABLOCK *head;		/* block being allocated from; NULL if none yet      */
+  size_t         blocksize;	/* size of the next block we create                  */
+  P7_ARENABLOCK *markblk;	/* p7_arena_Mark() position: block, or NULL if none  */
+  size_t         markused;	/*   ... and its <used> at the time                  */
+} P7_ARENA;
+
 /* Structure: P7_ALIDISPLAY
  * 
  * Alignment of a sequence domain to an HMM, formatted for printing.
@@ -627,6 +662,22 @@ typedef struct p7_dom_s {
   P7_ALIDISPLAY *ad; 
 } P7_DOMAIN;
 
+/* Pipeline profiling: time and work in each stage of the comparison
+ * pipeline, kept in a P7_PIPELINE when its <do_profile> is set (see
+ * p7_pipeline.c). Domain definition times its null2 and alidisplay
+ * steps separately; the p7_PLI_DOMDEF stage is the rest of it.
+ */
+enum p7_plistage_e { p7_PLI_NULLONE = 0, p7_PLI_MSV    = 1, p7_PLI_BIAS  = 2, p7_PLI_VIT        = 3, p7_PLI_FWD = 4,
+		     p7_PLI_BCK     = 5, p7_PLI_DOMDEF = 6, p7_PLI_NULL2 = 7, p7_PLI_ALIDISPLAY = 8 };
+#define p7_PLI_NSTAGES 9
+
+typedef struct {
+  uint64_t ncalls;		/* # of times the stage ran                          */
+  uint64_t ns;			/* total wall clock time in it (nanoseconds)         */
+  uint64_t ncells;		/* DP cells it computed: M*L; or residues, for NullOne
+				 * and the bias filter; or trace length, for alidisplays */
+} P7_PLI_PROFILE;
+
 /* Structure: P7_DOMAINDEF
  * 
  * This is a container for all the necessary information for domain
@@ -676,6 +727,8 @@ typedef struct p7_domaindef_s {
   P7_DOMAIN *dcl;
   int        ndom;	 /* number of domains defined, in the end.         */
   int        nalloc;     /* number of domain structures allocated in <dcl> */
+  P7_ARENA  *arena;      /* if non-NULL, alidisplays are made here (a hit list's; not ours) */
+  P7_PLI_PROFILE *prof;  /* if non-NULL, null2 and alidisplay times are added to prof[] (a pipeline's; not ours) */
 
   /* Additional results storage */
   float  nexpected;     /* posterior expected number of domains in the sequence (from posterior arrays) */
@@ -739,10 +792,17 @@ typedef struct p7_hit_s {
   int64_t  subseq_start; /*used to track which subsequence of a full_length target this hit came from, for purposes of removing duplicates */
 
   P7_DOMAIN *dcl;	/* domain coordinate list and alignment display */
+  int        in_arena;  /* TRUE if name, acc, desc, dcl and its alidisplays are in the hit list's arena */
   esl_pos_t  offset;	/* used in socket communications, in serialized communication: offset of P7_DOMAIN msg for this P7_HIT */
 } P7_HIT;
 
 
+/* Fewest hits per thread for p7_tophits_MergeHitArrays() to merge in parallel */
+#define p7_TOPHITS_MERGECHUNK 65536
+
+/* Reported hits per chunk when a report is formatted on several threads */
+#define p7_TOPHITS_REPORTCHUNK 256
+
 /* Structure: P7_TOPHITS
  * merging when we prepare to output results. "hit" list is NULL and
  * unavailable until after we do a sort.  
@@ -756,6 +816,10 @@ typedef struct p7_tophits_s {
   uint64_t nincluded;	/* number of hits that are includable       */
   int      is_sorted_by_sortkey; /* TRUE when hits sorted by sortkey and th->hit valid for all N hits */
   int      is_sorted_by_seqidx; /* TRUE when hits sorted by seq_idx, position, and th->hit valid for all N hits */
+  P7_ARENA *arena;      /* storage for hits that are <in_arena>; or NULL */
+  uint64_t maxhits;     /* if >0, keep only the top <maxhits> hits (see p7_tophits_SetMaxHits()) */
+  double   minkey;      /* when bounded: sortkey of the worst hit kept at the last trim; else -inf */
+  uint64_t ntrimmed;    /* number of reportable hits dropped because the list was full */
 } P7_TOPHITS;
 
 
@@ -1184,6 +1248,14 @@ typedef struct p7_pipeline_s {
   P7_OMX     *fwd;		/* full Fwd matrix for domain envelopes     */
   P7_OMX     *bck;		/* full Bck matrix for domain envelopes     */
 
+  /* SSV prefilters, p7_pli_SSVBlock() and p7_pli_SSVPack(), and length
+   * ordering of a block of target seqs, p7_pli_SortByLength()             */
+  char       *ssv_fail;		/* [i]: TRUE if seq/model i surely fails F1 */
+  int64_t    *ssv_key;		/* length-sorting keys for the block        */
+  int        *order;		/* [j]: index of the j'th shortest seq      */
+  int         ssv_nalloc;	/* allocated size of all three              */
+  int         cfgL;		/* length p7_pli_SetLength() last set, or -1 */
+
   /* Domain postprocessing                                                  */
   ESL_RANDOMNESS *r;		/* random number generator                  */
   int             do_reseeding; /* TRUE: reseed for reproducible results    */
@@ -1240,6 +1312,17 @@ typedef struct p7_pipeline_s {
   uint64_t      pos_past_fwd;	/* # positions that pass ForwardFilter()  (used for nhmmer) */
   uint64_t      pos_output;	    /* # positions that make it to the final output (used for nhmmer) */
 
+  /* Staged search (p7_pstage.c): filter and postprocessing thread pools    */
+  int           nfilter_thr;	/* # of filter threads; 0 if not staged     */
+  int           npost_thr;	/* # of postprocessing threads              */
+  int64_t       n_qfull;	/* # of waits by filter threads on a full queue        */
+  int64_t       n_qempty;	/* # of waits by postproc threads on an empty queue    */
+  int           qpeak;		/* most targets waiting in the queue at once */
+
+  /* Profiling: p7_pli_Statistics() and p7_pli_WriteProfile() report it     */
+  int            do_profile;	/* TRUE to time each stage of the pipeline  */
+  P7_PLI_PROFILE prof[p7_PLI_NSTAGES];
+
   enum p7_pipemodes_e mode;    	/* p7_SCAN_MODELS | p7_SEARCH_SEQS          */
   int           long_targets;   /* TRUE if the target sequences are expected to be very long (e.g. dna chromosome search in nhmmer) */
   int           strands;         /*  p7_STRAND_TOPONLY  | p7_STRAND_BOTTOMONLY |  p7_STRAND_BOTH */
@@ -1248,6 +1331,7 @@ typedef struct p7_pipeline_s {
 
   int           show_accessions;/* TRUE to output accessions not names      */
   int           show_alignments;/* TRUE to output alignments (default)      */
+  int           report_thr;	/* # of threads formatting reports; <=1: serial */
 
   P7_HMMFILE   *hfp;		/* COPY of open HMM database (if scan mode) */
   char          errbuf[eslERRBUFSIZE];
@@ -1469,8 +1553,10 @@ extern int p7_tracealign_getMSAandStats(P7_HMM *hmm, ESL_SQ  **sq, int N, ESL_MS
 
 /* p7_alidisplay.c */
 extern P7_ALIDISPLAY *p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq);
+extern P7_ALIDISPLAY *p7_alidisplay_CreateIn(P7_ARENA *arena, const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq);
 extern P7_ALIDISPLAY *p7_alidisplay_Create_empty();
 extern P7_ALIDISPLAY *p7_alidisplay_Clone(const P7_ALIDISPLAY *ad);
+extern P7_ALIDISPLAY *p7_alidisplay_CloneIn(P7_ARENA *arena, const P7_ALIDISPLAY *ad);
 extern size_t         p7_alidisplay_Sizeof(const P7_ALIDISPLAY *ad);
 extern int            p7_alidisplay_Serialize(const P7_ALIDISPLAY *obj, uint8_t **buf, uint32_t *n, uint32_t *nalloc);
 extern int            p7_alidisplay_Deserialize(const uint8_t *buf, uint32_t *n, P7_ALIDISPLAY *ret_obj);
@@ -1490,6 +1576,17 @@ extern int            p7_alidisplay_Sample(ESL_RANDOMNESS *rng, int N, P7_ALIDIS
 extern int            p7_alidisplay_Dump(FILE *fp, const P7_ALIDISPLAY *ad);
 extern int            p7_alidisplay_Compare(const P7_ALIDISPLAY *ad1, const P7_ALIDISPLAY *ad2);
 
+/* p7_arena.c */
+extern P7_ARENA *p7_arena_Create (void);
+extern void     *p7_arena_Alloc  (P7_ARENA *arena, size_t n);
+extern int       p7_arena_Strdup (P7_ARENA *arena, const char *s, int64_t n, char **ret_s);
+extern void      p7_arena_Mark   (P7_ARENA *arena);
+extern void      p7_arena_Rewind (P7_ARENA *arena);
+extern void      p7_arena_Reset  (P7_ARENA *arena);
+extern void      p7_arena_Adopt  (P7_ARENA *dst, P7_ARENA *src);
+extern size_t    p7_arena_Sizeof (const P7_ARENA *arena);
+extern void      p7_arena_Destroy(P7_ARENA *arena);
+
 /* p7_bg.c */
 extern P7_BG *p7_bg_Create(const ESL_ALPHABET *abc);
 extern P7_BG *p7_bg_CreateUniform(const ESL_ALPHABET *abc);
@@ -1645,7 +1742,15 @@ extern int p7_pli_DomainIncludable  (P7_PIPELINE *pli, float dom_score, double l
 extern int p7_pli_NewModel          (P7_PIPELINE *pli, const P7_OPROFILE *om, P7_BG *bg);
 extern int p7_pli_NewModelThresholds(P7_PIPELINE *pli, const P7_OPROFILE *om);
 extern int p7_pli_NewSeq            (P7_PIPELINE *pli, const ESL_SQ *sq);
+extern int p7_pli_SetLength         (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, int L);
+extern int p7_pli_SortByLength      (P7_PIPELINE *pli, const ESL_SQ *sq, int nseq);
+extern int p7_pli_SSVBlock          (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, int nseq);
+#if defined (eslENABLE_SSE)
+extern int p7_pli_SSVPack           (P7_PIPELINE *pli, P7_OPROFILE **om, P7_OM_PACK *pk, P7_BG *bg, const ESL_SQ *sq);
+#endif
 extern int p7_Pipeline              (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_TOPHITS *th);
+extern int p7_pli_Filter            (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, float *ret_fwdsc);
+extern int p7_pli_Postprocess       (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, float fwdsc, P7_TOPHITS *th);
 extern int p7_Pipeline_LongTarget   (P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
                                      P7_BG *bg, P7_TOPHITS *hitlist, int64_t seqidx,
                                      const ESL_SQ *sq, int complementarity,
@@ -1654,7 +1759,10 @@ extern int p7_Pipeline_LongTarget   (P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCORE
 
 
 
-extern int p7_pli_Statistics(FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w);
+extern int      p7_pli_Statistics  (FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w);
+extern uint64_t p7_pli_Clock       (void);
+extern int      p7_pli_ProfileJSON (const P7_PIPELINE *pli, const char *qname, const ESL_STOPWATCH *w, char **ret_json);
+extern int      p7_pli_WriteProfile(FILE *ofp, const char *qname, const P7_PIPELINE *pli, const ESL_STOPWATCH *w);
 
 
 /* p7_prior.c */
@@ -1711,6 +1819,11 @@ extern int         p7_tophits_SortBySeqidxAndAlipos(P7_TOPHITS *h);
 extern int         p7_tophits_SortByModelnameAndAlipos(P7_TOPHITS *h);
 
 extern int         p7_tophits_Merge(P7_TOPHITS *h1, P7_TOPHITS *h2);
+extern int         p7_tophits_MergeN(P7_TOPHITS *h1, P7_TOPHITS **hv, int k, int nthreads);
+extern int         p7_tophits_MergeHitArrays(P7_HIT ***lists, const uint64_t *nlist, int k, P7_HIT **out, int nthreads);
+extern int         p7_tophits_SetMaxHits(P7_TOPHITS *h, uint64_t maxhits);
+extern int         p7_tophits_Admit(P7_TOPHITS *h, double sortkey);
+extern int         p7_tophits_Trim(P7_TOPHITS *h);
 extern int         p7_tophits_GetMaxPositionLength(P7_TOPHITS *h);
 extern int         p7_tophits_GetMaxNameLength(P7_TOPHITS *h);
 extern int         p7_tophits_GetMaxAccessionLength(P7_TOPHITS *h);
@@ -34,6 +34,10 @@ static ESL_OPTIONS cmdlineOpts[] = {
   { "--seqdb",      eslARG_INFILE,  NULL,     NULL, NULL,           NULL,  NULL,  "--worker",      "protein database to cache for searches",                      12 },
   { "--hmmdb",      eslARG_INFILE,  NULL,     NULL, NULL,           NULL,  NULL,  "--worker",      "hmm database to cache for searches",                          12 },
   { "--cpu",        eslARG_INT,  p7_NCPU,"HMMER_NCPU","n>0",        NULL,  NULL,  "--master",      "number of parallel CPU workers to use for multithreads",      12 },
+  { "--nqueries",   eslARG_INT,     "1",      NULL, "n>0",          NULL,  NULL,  "--worker",      "number of searches to run at once, each on a share of the workers", 12 },
+  { "--sched",      eslARG_STRING,  "fifo",   NULL, NULL,           NULL,  NULL,  "--worker",      "order to start queued searches in: fifo or priority",         12 },
+  { "--cache",      eslARG_INT,     "0",      NULL, "n>=0",         NULL,  NULL,  "--worker",      "keep up to <n> MB of recent results to answer repeat searches", 12 },
+  { "--coalesce",   eslARG_INT,     "1",      NULL, "n>0",          NULL,  NULL,  "--worker",      "coalesce up to <n> queued searches of a seqdb into one sweep", 12 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 
   };
@@ -30,6 +30,7 @@ typedef struct {
   uint64_t   nhits;           	/* number of hits in list now               */
   uint64_t   nreported;       	/* number of hits that are reportable       */
   uint64_t   nincluded;       	/* number of hits that are includable       */
+  P7_PLI_PROFILE prof[p7_PLI_NSTAGES]; /* per-stage pipeline profile, zeros unless --profile; not serialized with the rest */
   uint64_t   *hit_offsets;      /* either NULL or an array of nhits values that define the offset from the start of this 
                                    search's array of serialized hits to each hit in the array.  I.e. hit_offsets[0] will always be 0
                                    if the array exists, hit_offsets[1] will be the number of bytes between the start of the 
@@ -44,6 +45,7 @@ typedef struct {
 #define HMMD_CMD_SCAN       10002
 #define HMMD_CMD_INIT       10003
 #define HMMD_CMD_SHUTDOWN   10004
+#define HMMD_CMD_BATCH      10005
 
 #define MAX_INIT_DESC 32
 
@@ -59,6 +61,19 @@ typedef struct {
   char        data[];              /* search data                              */
 } HMMD_SEARCH_CMD;
 
+/* HMMD_CMD_BATCH: several searches of the same sequence database, which
+ * the worker runs in one sweep over its share of it, sending back one
+ * result per search in the order given.
+ */
+typedef struct {
+  uint32_t    db_inx;               /* database index to search                 */
+  uint32_t    inx;                  /* index to begin search                    */
+  uint32_t    cnt;                  /* number of sequences to search            */
+  uint32_t    nquery;               /* number of searches                       */
+  char        data[];              /* <nquery> HMMD_CMD_SEARCH commands, each  */
+                                    /* MSG_SIZE() bytes, one after the other    */
+} HMMD_BATCH_CMD;
+
 /* HMMD_CMD_INIT */
 typedef struct {
   char        sid[MAX_INIT_DESC];   /* unique id for sequence database          */
@@ -90,6 +105,7 @@ typedef struct {
   union {
     HMMD_INIT_CMD   init;
     HMMD_SEARCH_CMD srch;
+    HMMD_BATCH_CMD  batch;
     HMMD_INIT_RESET reset;
   };
 } HMMD_COMMAND;
@@ -97,6 +113,7 @@ typedef struct {
 #define HMMD_SEARCH_STATUS_SERIAL_SIZE sizeof(uint32_t) + sizeof(uint64_t)
 #define HMMD_SEARCH_STATS_SERIAL_BASE (5 * sizeof(double)) + (9 * sizeof(uint64_t)) + 2
 // The 2 is two enums at one byte/enum as we serialize them
+#define HMMD_SEARCH_PROFILE_SERIAL_SIZE (3 * p7_PLI_NSTAGES * sizeof(uint64_t))
 #define MSG_SIZE(x) (sizeof(HMMD_HEADER) + ((HMMD_HEADER *)(x))->length)
 
 size_t writen(int fd, const void *vptr, size_t n);
@@ -117,6 +134,11 @@ typedef struct queue_data_s {
   int            dbx;         /* database index to search       */
   int            inx;         /* sequence index to start search */
   int            cnt;         /* number of sequences to search  */
+  int            priority;    /* scheduling priority, higher first (--priority) */
+
+  char          *key;         /* result cache key, or NULL (master only) */
+  uint32_t       keylen;
+  uint64_t       hash;        /* hash of <key>                  */
 
 } QUEUE_DATA;
 
@@ -138,6 +160,8 @@ extern void master_process(ESL_GETOPTS *go);
 
 extern int p7_hmmd_search_stats_Serialize(const HMMD_SEARCH_STATS *obj, uint8_t **buf, uint32_t *n, uint32_t *nalloc);
 extern int p7_hmmd_search_stats_Deserialize(const uint8_t *buf, uint32_t *pos, HMMD_SEARCH_STATS *ret_obj);
+extern int p7_hmmd_search_stats_SerializeProfile(const HMMD_SEARCH_STATS *obj, uint8_t **buf, uint32_t *n, uint32_t *nalloc);
+extern int p7_hmmd_search_stats_DeserializeProfile(const uint8_t *buf, uint32_t *pos, HMMD_SEARCH_STATS *ret_obj);
 
 #define LOG_FATAL_MSG(str, err) {                                               \
     p7_syslog(LOG_CRIT,"[%s:%d] - %s error %d - %s\n", __FILE__, __LINE__, str, err, strerror(err)); \
@@ -267,6 +267,7 @@ int hmmpgmd2stats_old(void *data, P7_HMM *hmm, float** statsOut)
   th.N = 0;
   th.unsrt = NULL;
   th.hit   = NULL;
+  th.arena = NULL;
 
   //storage for output
   ESL_ALLOC( *statsOut,   sizeof(float) * hmm->M * 3);
@@ -321,6 +322,8 @@ int hmmpgmd2stats_old(void *data, P7_HMM *hmm, float** statsOut)
   th.N         = stats->nhits;
   th.nreported = 0;
   th.nincluded = 0;
+  th.maxhits   = 0;
+  th.ntrimmed  = 0;
   th.is_sorted_by_sortkey = 0;
   th.is_sorted_by_seqidx  = 0;
 
@@ -588,6 +591,7 @@ void hmmpgmd2msa_utest(int ntrials, char *hmmfile){
     stats.n_past_bias = pli->n_past_bias;
     stats.n_past_vit = pli->n_past_vit;
     stats.n_past_fwd = pli->n_past_fwd;
+    memset(stats.prof, 0, sizeof(stats.prof));
     stats.nhits = hitlist->N;
     stats.nreported = hitlist->nreported;
     stats.nincluded = hitlist->nreported;
@@ -39,6 +39,7 @@ typedef struct {
   P7_BG            *bg;	         /* null model                              */
   P7_PIPELINE      *pli;         /* work pipeline                           */
   P7_TOPHITS       *th;          /* top hit results                         */
+  int               nquery;      /* # of queries this worker searches, in info[0..nquery-1] */
 } WORKER_INFO;
 
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
@@ -63,6 +64,7 @@ static ESL_OPTIONS options[] = {
   { "--tblout",     eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-sequence hits to file <f>",         2 },
   { "--domtblout",  eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-domain hits to file <f>",           2 },
   { "--pfamtblout", eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save table of hits and domains to file, in Pfam format <f>",    2 },
+  { "--pjson",      eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "time each pipeline stage; save profiles to <f> as JSON lines",  2 },
   { "--acc",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "prefer accessions over names in output",                        2 },
   { "--noali",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "don't output alignments, so output is smaller",                 2 },
   { "--notextw",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--textw",        "unlimit ASCII text output line width",                          2 },
@@ -93,9 +95,13 @@ static ESL_OPTIONS options[] = {
   { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",    12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",          12 },
   { "--qformat",    eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL,  NULL,            "assert input <seqfile> is in format <s>: no autodetection",    12 },
+  { "--qbatch",     eslARG_INT,     "1",  NULL, "n>0",   NULL,  NULL,  NULL,            "search <n> query seqs per pass over <hmmdb> (not with MPI)",   12 },
 #ifdef HMMER_THREADS
   { "--cpu",        eslARG_INT,"0","HMMER_NCPU","n>=0",NULL,  NULL, CPUOPTS,            "number of parallel CPU workers to use for multithreads",       12 },  // multithread parallelization off by default. hmmscan is i/o bound on almost all systems.
 #endif
+#ifdef eslENABLE_SSE
+  { "--simd",       eslARG_STRING,  NULL, "HMMER_SIMD", NULL, NULL, NULL, NULL,         "vector instructions to use: sse, avx2, avx512, or auto",       12 },
+#endif
 #ifdef HMMER_MPI
   { "--stall",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,"--mpi", NULL,            "arrest after start: for debugging MPI under gdb",              12 },  
   { "--mpi",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  MPIOPTS,         "run as an MPI parallel program",                               12 },
@@ -123,6 +129,8 @@ static char banner[] = "search sequence(s) against a profile database";
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  serial_loop  (WORKER_INFO *info, P7_HMMFILE *hfp);
+static int  output_query (FILE *ofp, FILE *tblfp, FILE *domtblfp, FILE *pfamtblfp, FILE *pjfp, int textw,
+			  WORKER_INFO *info, ESL_STOPWATCH *w, int is_first);
 
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
@@ -216,6 +224,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--tblout")    && fprintf(ofp, "# per-seq hits tabular output:     %s\n",            esl_opt_GetString(go, "--tblout"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domtblout") && fprintf(ofp, "# per-dom hits tabular output:     %s\n",            esl_opt_GetString(go, "--domtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--pfamtblout")&& fprintf(ofp, "# pfam-style tabular hit output:   %s\n",            esl_opt_GetString(go, "--pfamtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--pjson")     && fprintf(ofp, "# per-stage profile (JSON):        %s\n",            esl_opt_GetString(go, "--pjson"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--acc")       && fprintf(ofp, "# prefer accessions over names:    yes\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--noali")     && fprintf(ofp, "# show alignments in output:       no\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--notextw")   && fprintf(ofp, "# max ASCII text line length:      unlimited\n")                                           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -244,6 +253,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
     else if (                                  fprintf(ofp, "# random number seed set to:       %d\n",        esl_opt_GetInteger(go, "--seed"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   }
   if (esl_opt_IsUsed(go, "--qformat")   && fprintf(ofp, "# input seqfile format asserted:   %s\n",            esl_opt_GetString(go, "--qformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--qbatch")    && fprintf(ofp, "# query seqs per database pass:    %d\n",            esl_opt_GetInteger(go, "--qbatch"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
                                            
 #ifdef HMMER_THREADS
   if (esl_opt_IsUsed(go, "--cpu")) {
@@ -251,6 +261,9 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
     else                                      { if (fprintf(ofp, "# multithread parallelization:     %d workers\n", esl_opt_GetInteger(go, "--cpu")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
   }
 #endif
+#ifdef eslENABLE_SSE
+  if (esl_opt_IsUsed(go, "--simd")       && p7_simd_Report(ofp)                                                                                      != eslOK) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+#endif
 #ifdef HMMER_MPI
   if (esl_opt_IsUsed(go, "--mpi")       && fprintf(ofp, "# MPI:                             on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
@@ -278,6 +291,15 @@ main(int argc, char **argv)
 
   process_commandline(argc, argv, &go, &cfg.hmmfile, &cfg.seqfile);    
 
+#ifdef eslENABLE_SSE
+  /* choose vector kernels before any profiles are created */
+  if (esl_opt_IsOn(go, "--simd")) {
+    int level;
+    if (p7_simd_Parse(esl_opt_GetString(go, "--simd"), &level) != eslOK) p7_Fail("--simd must be one of sse, avx2, avx512, or auto\n");
+    p7_simd_Set(level);
+  }
+#endif
+
   /* Figure out who we are, and send control there: 
    * we might be an MPI master, an MPI worker, or a serial program.
    */
@@ -325,19 +347,23 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;		 /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;	  	 /* output stream for tabular per-seq (--domtblout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam tabular output (--pfamtblout)    */
+  FILE            *pjfp     = NULL;              /* output stream for pipeline profiles (--pjson)   */
   int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
   ESL_SQFILE      *sqfp     = NULL;              /* open seqfile                                    */
   P7_HMMFILE      *hfp      = NULL;		 /* open HMM database file                          */
   ESL_ALPHABET    *abc      = NULL;              /* sequence alphabet                               */
   P7_OPROFILE     *om       = NULL;		 /* target profile                                  */
   ESL_STOPWATCH   *w        = NULL;              /* timing                                          */
-  ESL_SQ          *qsq      = NULL;		 /* query sequence                                  */
+  ESL_SQ         **qsqlist  = NULL;		 /* current batch of query sequences                */
+  int              qbatch   = esl_opt_GetInteger(go, "--qbatch");
+  int              nbatch   = 0;                 /* # of queries in the current batch               */
   int              nquery   = 0;
   int              textw;
   int              status   = eslOK;
   int              hstatus  = eslOK;
   int              sstatus  = eslOK;
   int              i;
+  int              q;
 
   int              ncpus    = 0;
 
@@ -382,13 +408,16 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",        cfg->seqfile);
   else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
   else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, cfg->seqfile);
-  qsq = esl_sq_CreateDigital(abc);
+  ESL_ALLOC(qsqlist, sizeof(ESL_SQ *) * qbatch);
+  for (q = 0; q < qbatch; q++)
+    qsqlist[q] = esl_sq_CreateDigital(abc);
 
   /* Open the results output files */
   if (esl_opt_IsOn(go, "-o"))          { if ((ofp      = fopen(esl_opt_GetString(go, "-o"),          "w")) == NULL)  esl_fatal("Failed to open output file %s for writing\n",                 esl_opt_GetString(go, "-o")); }
   if (esl_opt_IsOn(go, "--tblout"))    { if ((tblfp    = fopen(esl_opt_GetString(go, "--tblout"),    "w")) == NULL)  esl_fatal("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
   if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
   if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+  if (esl_opt_IsOn(go, "--pjson"))     { if ((pjfp     = fopen(esl_opt_GetString(go, "--pjson"),     "w")) == NULL)  esl_fatal("Failed to open pipeline profile output file %s for writing\n", esl_opt_GetString(go, "--pjson")); }
 
   output_header(ofp, go, cfg->hmmfile, cfg->seqfile);
 
@@ -402,14 +431,18 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     }
 #endif
 
+  /* Each worker gets <qbatch> consecutive WORKER_INFOs, one per query
+   * in a batch: worker i searches query q with info[i*qbatch + q].
+   */
   infocnt = (ncpus == 0) ? 1 : ncpus;
-  ESL_ALLOC(info, (ptrdiff_t) sizeof(*info) * infocnt);
+  ESL_ALLOC(info, (ptrdiff_t) sizeof(*info) * infocnt * qbatch);
 
-  for (i = 0; i < infocnt; ++i)
+  for (i = 0; i < infocnt * qbatch; ++i)
     {
-      info[i].bg    = p7_bg_Create(abc);
+      info[i].bg     = p7_bg_Create(abc);
+      info[i].nquery = 1;
 #ifdef HMMER_THREADS
-      info[i].queue = queue;
+      info[i].queue  = queue;
 #endif
     }
 
@@ -424,15 +457,23 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     }
 #endif
 
-  /* Outside loop: over each query sequence in <seqfile>. */
-  while ((sstatus = esl_sqio_Read(sqfp, qsq)) == eslOK)
+  /* Outside loop: over batches of up to <qbatch> query sequences in <seqfile>.
+   * Each batch costs one pass over the profile database.
+   */
+  while (sstatus == eslOK)
     {
-      nquery++;
+      for (nbatch = 0; nbatch < qbatch; nbatch++)
+	if ((sstatus = esl_sqio_Read(sqfp, qsqlist[nbatch])) != eslOK) break;
+      if (nbatch == 0) break;
+
       esl_stopwatch_Start(w);	                          
 
       /* Open the target profile database */
       status = p7_hmmfile_Open(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
       if (status != eslOK)        p7_Fail("Unexpected error %d in opening hmm file %s.\n",           status, cfg->hmmfile);  
+#ifdef eslENABLE_SSE
+      p7_oprofile_Map(hfp);	/* zero-copy profiles if the pressed files can be mapped; else read them as usual */
+#endif
   
 #ifdef HMMER_THREADS
       /* if we are threaded, create a lock to prevent multiple readers */
@@ -443,22 +484,26 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	}
 #endif
 
-      if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsq->name, (long) qsq->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (qsq->acc[0]  != 0 && fprintf(ofp, "Accession:   %s\n", qsq->acc)     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (qsq->desc[0] != 0 && fprintf(ofp, "Description: %s\n", qsq->desc)    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-
       for (i = 0; i < infocnt; ++i)
 	{
-	  /* Create processing pipeline and hit list */
-	  info[i].th  = p7_tophits_Create(); 
-	  info[i].pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
-	  info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
+	  for (q = 0; q < nbatch; q++)
+	    {
+	      WORKER_INFO *qi = &(info[i*qbatch + q]);
 
-	  p7_pli_NewSeq(info[i].pli, qsq);
-	  info[i].qsq = qsq;
+	      /* Create processing pipeline and hit list */
+	      qi->th  = p7_tophits_Create(); 
+	      qi->pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
+	      qi->pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
+	      qi->pli->report_thr = infocnt;
+	      qi->pli->do_profile = (pjfp != NULL);
+
+	      p7_pli_NewSeq(qi->pli, qsqlist[q]);
+	      qi->qsq = qsqlist[q];
+	    }
+	  info[i*qbatch].nquery = nbatch;
 
 #ifdef HMMER_THREADS
-	  if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+	  if (ncpus > 0) esl_threads_AddThread(threadObj, &(info[i*qbatch]));
 #endif
 	}
 
@@ -476,36 +521,28 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	default: 	   p7_Fail("Unexpected error in reading HMMs from %s",   cfg->hmmfile); 
 	}
 
-      /* merge the results of the search results */
-      for (i = 1; i < infocnt; ++i)
+      /* merge the search results of each query, and print them */
+      for (q = 0; q < nbatch; q++)
 	{
-	  p7_tophits_Merge(info[0].th, info[i].th);
-	  p7_pipeline_Merge(info[0].pli, info[i].pli);
-
-	  p7_pipeline_Destroy(info[i].pli);
-	  p7_tophits_Destroy(info[i].th);
-	}
-
-      /* Print results */
-      p7_tophits_SortBySortkey(info->th);
-      p7_tophits_Threshold(info->th, info->pli);
+	  for (i = 1; i < infocnt; ++i)
+	    {
+	      p7_tophits_Merge(info[q].th, info[i*qbatch + q].th);
+	      p7_pipeline_Merge(info[q].pli, info[i*qbatch + q].pli);
 
-      p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      p7_tophits_Domains(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+	      p7_pipeline_Destroy(info[i*qbatch + q].pli);
+	      p7_tophits_Destroy(info[i*qbatch + q].th);
+	    }
 
-      if (tblfp)     p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
-      if (domtblfp)  p7_tophits_TabularDomains(domtblfp, qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
-      if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, qsq->name, qsq->acc, info->th, info->pli);
+	  nquery++;
+	  status = output_query(ofp, tblfp, domtblfp, pfamtblfp, pjfp, textw, &(info[q]), w, (nquery == 1));
+	  if (status != eslOK) goto ERROR;
 
-      esl_stopwatch_Stop(w);
-      p7_pli_Statistics(ofp, info->pli, w);
-      if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      fflush(ofp);
+	  p7_pipeline_Destroy(info[q].pli);
+	  p7_tophits_Destroy(info[q].th);
+	  esl_sq_Reuse(qsqlist[q]);
+	}
 
       p7_hmmfile_Close(hfp);
-      p7_pipeline_Destroy(info->pli);
-      p7_tophits_Destroy(info->th);
-      esl_sq_Reuse(qsq);
     }
   if      (sstatus == eslEFORMAT) esl_fatal("Parse failed (sequence file %s):\n%s\n",
 					    sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
@@ -521,7 +558,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   /* Cleanup - prepare for successful exit
    */
-  for (i = 0; i < infocnt; ++i)
+  for (i = 0; i < infocnt * qbatch; ++i)
     p7_bg_Destroy(info[i].bg);
 
 #ifdef HMMER_THREADS
@@ -537,7 +574,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   free(info);
 
-  esl_sq_Destroy(qsq);
+  for (q = 0; q < qbatch; q++)
+    esl_sq_Destroy(qsqlist[q]);
+  free(qsqlist);
   esl_stopwatch_Destroy(w);
   esl_alphabet_Destroy(abc);
   esl_sqfile_Close(sqfp);
@@ -546,12 +585,48 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (pjfp)          fclose(pjfp);
   return eslOK;
 
  ERROR:
   return status;
 }
 
+/* output_query()
+ * Print the results of one query's search, once its hits and
+ * pipeline have been merged into <info>: query line, ranked target
+ * and domain lists, tabular outputs, and pipeline statistics (and
+ * the --pjson profile). <is_first> is TRUE for the first query of the run, so the tabular
+ * outputs get their column headers.
+ */
+static int
+output_query(FILE *ofp, FILE *tblfp, FILE *domtblfp, FILE *pfamtblfp, FILE *pjfp, int textw,
+	     WORKER_INFO *info, ESL_STOPWATCH *w, int is_first)
+{
+  ESL_SQ *qsq = info->qsq;
+
+  if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsq->name, (long) qsq->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (qsq->acc[0]  != 0 && fprintf(ofp, "Accession:   %s\n", qsq->acc)     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (qsq->desc[0] != 0 && fprintf(ofp, "Description: %s\n", qsq->desc)    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  p7_tophits_SortBySortkey(info->th);
+  p7_tophits_Threshold(info->th, info->pli);
+
+  p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  p7_tophits_Domains(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  if (tblfp)     p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, info->th, info->pli, is_first);
+  if (domtblfp)  p7_tophits_TabularDomains(domtblfp, qsq->name, qsq->acc, info->th, info->pli, is_first);
+  if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, qsq->name, qsq->acc, info->th, info->pli);
+
+  esl_stopwatch_Stop(w);
+  p7_pli_Statistics(ofp, info->pli, w);
+  if (pjfp)      p7_pli_WriteProfile(pjfp, qsq->name, info->pli, w);
+  if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  fflush(ofp);
+  return eslOK;
+}
+
 #ifdef HMMER_MPI
 
 /* Define common tags used by the MPI master/slave processes */
@@ -724,6 +799,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;		 /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;	  	 /* output stream for tabular per-seq (--domtblout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam-style tabular output  (--pfamtblout) */
+  FILE            *pjfp     = NULL;              /* output stream for pipeline profiles (--pjson)   */
   int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
   P7_BG           *bg       = NULL;	         /* null model                                      */
   ESL_SQFILE      *sqfp     = NULL;              /* open seqfile                                    */
@@ -791,6 +867,9 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     mpi_failure("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblfp"));
   if (esl_opt_IsOn(go, "--pfamtblout") && (pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)
     mpi_failure("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout"));
+
+  if (esl_opt_IsOn(go, "--pjson") && (pjfp = fopen(esl_opt_GetString(go, "--pjson"), "w")) == NULL)
+    mpi_failure("Failed to open pipeline profile output file %s for writing\n", esl_opt_GetString(go, "--pjson"));
  
   ESL_ALLOC(list, sizeof(MSV_BLOCK));
   list->complete = 0;
@@ -828,6 +907,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       th  = p7_tophits_Create(); 
       pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
       pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
+      pli->do_profile = esl_opt_IsOn(go, "--pjson");
 
       p7_pli_NewSeq(pli, qsq);
 
@@ -930,6 +1010,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
       esl_stopwatch_Stop(w);
       p7_pli_Statistics(ofp, pli, w);
+      if (pjfp) p7_pli_WriteProfile(pjfp, qsq->name, pli, w);
       if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
       p7_hmmfile_Close(hfp);
@@ -986,6 +1067,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (pjfp)          fclose(pjfp);
 
   return eslOK;
 
@@ -1063,6 +1145,7 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
       th  = p7_tophits_Create(); 
       pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
       pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
+      pli->do_profile = esl_opt_IsOn(go, "--pjson");
 
       p7_pli_NewSeq(pli, qsq);
 
@@ -1160,21 +1243,26 @@ static int
 serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
 {
   int            status;
+  int            q;
 
   P7_OPROFILE   *om;
   ESL_ALPHABET  *abc = NULL;
-  /* Main loop: */
+  /* Main loop: each profile is read once, and scored against every query in the batch */
   while ((status = p7_oprofile_ReadMSV(hfp, &abc, &om)) == eslOK)
     {
-      p7_pli_NewModel(info->pli, om, info->bg);
-      p7_bg_SetLength(info->bg, info->qsq->n);
-      p7_oprofile_ReconfigLength(om, info->qsq->n);
+      for (q = 0; q < info->nquery; q++)
+	{
+	  p7_pli_NewModel(info[q].pli, om, info[q].bg);
+	  p7_bg_SetLength(info[q].bg, info[q].qsq->n);
+	  p7_oprofile_ReconfigLength(om, info[q].qsq->n);
+
+	  status = p7_Pipeline(info[q].pli, om, info[q].bg, info[q].qsq, NULL, info[q].th);
+	  if (status == eslEINVAL) p7_Fail(info[q].pli->errbuf);
 
-      status = p7_Pipeline(info->pli, om, info->bg, info->qsq, NULL, info->th);
-      if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
+	  p7_pipeline_Reuse(info[q].pli);
+	}
 
       p7_oprofile_Destroy(om);
-      p7_pipeline_Reuse(info->pli);
     }
 
   esl_alphabet_Destroy(abc);
@@ -1235,9 +1323,11 @@ static void
 pipeline_thread(void *arg)
 {
   int i;
+  int q;
   int status;
   int workeridx;
   WORKER_INFO   *info;
+  WORKER_INFO   *qi;
   ESL_THREADS   *obj;
   P7_OM_BLOCK   *block;
   void          *newBlock;
@@ -1261,15 +1351,22 @@ pipeline_thread(void *arg)
     {
       P7_OPROFILE *om = block->list[i];
 
-      p7_pli_NewModel(info->pli, om, info->bg);
-      p7_bg_SetLength(info->bg, info->qsq->n);
-      p7_oprofile_ReconfigLength(om, info->qsq->n);
+      /* score each profile against every query in the batch while it's in cache */
+      for (q = 0; q < info->nquery; q++)
+      {
+	qi = info + q;
 
-      status = p7_Pipeline(info->pli, om, info->bg, info->qsq, NULL, info->th);
-      if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
+	p7_pli_NewModel(qi->pli, om, qi->bg);
+	p7_bg_SetLength(qi->bg, qi->qsq->n);
+	p7_oprofile_ReconfigLength(om, qi->qsq->n);
+
+	status = p7_Pipeline(qi->pli, om, qi->bg, qi->qsq, NULL, qi->th);
+	if (status == eslEINVAL) p7_Fail(qi->pli->errbuf);
+
+	p7_pipeline_Reuse(qi->pli);
+      }
 
       p7_oprofile_Destroy(om);
-      p7_pipeline_Reuse(info->pli);
 
       block->list[i] = NULL;
     }
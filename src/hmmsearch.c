@@ -32,15 +32,23 @@
 #endif 
 
 #include "hmmer.h"
+#include "p7_dsqdb.h"
+#include "p7_pstage.h"
+#include "p7_wsched.h"
 
 typedef struct {
 #ifdef HMMER_THREADS
   ESL_WORK_QUEUE   *queue;
+  P7_WSCHED        *wsched;      /* work-stealing scheduler over <dsqdb>, or NULL to use <queue> */
+  P7_PSTAGE        *pstage;      /* staged search (--postcpu): queue to postprocessing threads, or NULL */
 #endif 
   P7_BG            *bg;	         /* null model                              */
   P7_PIPELINE      *pli;         /* work pipeline                           */
   P7_TOPHITS       *th;          /* top hit results                         */
   P7_OPROFILE      *om;          /* optimized query profile                 */
+  int               nquery;      /* # of queries this worker searches, in info[0..nquery-1] */
+  P7_DSQDB         *dsqdb;       /* pressed target database, or NULL        */
+  int               do_lsort;    /* TRUE to search each block in order of target length */
 } WORKER_INFO;
 
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
@@ -57,6 +65,12 @@ typedef struct {
 #define MPIOPTS     NULL
 #endif
 
+#ifdef HMMER_MPI
+#define NOMPIOPTS   "--mpi"
+#else
+#define NOMPIOPTS   NULL
+#endif
+
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles   reqs   incomp              help                                                      docgroup*/
   { "-h",           eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "show brief help on version and usage",                         1 },
@@ -66,6 +80,7 @@ static ESL_OPTIONS options[] = {
   { "--tblout",     eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-sequence hits to file <f>",        2 },
   { "--domtblout",  eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-domain hits to file <f>",          2 },
   { "--pfamtblout", eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save table of hits and domains to file, in Pfam format <f>",   2 },
+  { "--pjson",      eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "time each pipeline stage; save profiles to <f> as JSON lines", 2 },
   { "--acc",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "prefer accessions over names in output",                       2 },
   { "--noali",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "don't output alignments, so output is smaller",                2 },
   { "--notextw",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--textw",        "unlimit ASCII text output line width",                         2 },
@@ -95,11 +110,18 @@ static ESL_OPTIONS options[] = {
   { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,    NULL,  NULL,  NULL,            "turn off biased composition score corrections",               12 },
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
+  { "--maxhits",    eslARG_INT,    FALSE, NULL, "n>0",   NULL,  "-Z",  NULL,            "keep only the top <n> hits (bounded memory; requires -Z)",     12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
   { "--tformat",    eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL,  NULL,            "assert target <seqfile> is in format <s>: no autodetection",  12 },
+  { "--qbatch",     eslARG_INT,     "1",  NULL, "n>0",   NULL,  NULL,  NOMPIOPTS,       "search <n> query HMMs per pass over <seqdb> (not with MPI)",   12 },
+  { "--lsort",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "search each block of targets in order of length",             12 },
 
 #ifdef HMMER_THREADS 
   { "--cpu",        eslARG_INT, p7_NCPU,"HMMER_NCPU","n>=0",NULL,  NULL,  CPUOPTS,      "number of parallel CPU workers to use for multithreads",      12 },
+  { "--postcpu",    eslARG_INT,    "0",  NULL, "n>=0",  NULL,  NULL,  CPUOPTS,         "number of separate threads for domain postprocessing",        12 },
+#endif
+#ifdef eslENABLE_SSE
+  { "--simd",       eslARG_STRING,  NULL, "HMMER_SIMD", NULL, NULL, NULL, NULL,         "vector instructions to use: sse, avx2, avx512, or auto",      12 },
 #endif
 #ifdef HMMER_MPI
   { "--stall",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,"--mpi", NULL,            "arrest after start: for debugging MPI under gdb",             12 },  
@@ -139,13 +161,19 @@ struct cfg_s {
 };
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
-static int  serial_loop  (WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs);
+static int  serial_loop  (WORKER_INFO *info, ESL_SQFILE *dbfp, P7_DSQDB *dsqdb, int n_targetseqs);
+static int  output_query (ESL_GETOPTS *go, FILE *ofp, FILE *afp, FILE *tblfp, FILE *domtblfp, FILE *pfamtblfp, FILE *pjfp, int textw,
+			  P7_HMM *hmm, WORKER_INFO *info, ESL_STOPWATCH *w, int is_first);
 
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
 
-static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_targetseqs);
+static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, P7_DSQDB *dsqdb, int n_targetseqs);
+static int  steal_loop (ESL_THREADS *obj, P7_WSCHED *wsched, P7_DSQDB *dsqdb, int n_targetseqs);
 static void pipeline_thread(void *arg);
+static void postproc_thread(void *arg);
+static void sort_hits(WORKER_INFO *info);
+static void search_block(WORKER_INFO *info, ESL_SQ_BLOCK *block);
 #endif 
 
 #ifdef HMMER_MPI
@@ -228,6 +256,7 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--tblout")     && fprintf(ofp, "# per-seq hits tabular output:     %s\n",             esl_opt_GetString(go, "--tblout"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domtblout")  && fprintf(ofp, "# per-dom hits tabular output:     %s\n",             esl_opt_GetString(go, "--domtblout"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--pfamtblout") && fprintf(ofp, "# pfam-style tabular hit output:   %s\n",             esl_opt_GetString(go, "--pfamtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--pjson")      && fprintf(ofp, "# per-stage profile (JSON):        %s\n",             esl_opt_GetString(go, "--pjson"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--acc")        && fprintf(ofp, "# prefer accessions over names:    yes\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--noali")      && fprintf(ofp, "# show alignments in output:       no\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--notextw")    && fprintf(ofp, "# max ASCII text line length:      unlimited\n")                                             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -255,13 +284,19 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--nonull2")    && fprintf(ofp, "# null2 bias corrections:          off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")           && fprintf(ofp, "# sequence search space set to:    %.0f\n",           esl_opt_GetReal(go, "-Z"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")       && fprintf(ofp, "# domain search space set to:      %.0f\n",           esl_opt_GetReal(go, "--domZ"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--maxhits")    && fprintf(ofp, "# max hits kept per query:         %d\n",             esl_opt_GetInteger(go, "--maxhits"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
     if (esl_opt_GetInteger(go, "--seed") == 0 && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                               < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
     else if (                               fprintf(ofp, "# random number seed set to:       %d\n",             esl_opt_GetInteger(go, "--seed"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   }
   if (esl_opt_IsUsed(go, "--tformat")    && fprintf(ofp, "# targ <seqfile> format asserted:  %s\n",             esl_opt_GetString(go, "--tformat"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--qbatch")     && fprintf(ofp, "# query HMMs per database pass:    %d\n",             esl_opt_GetInteger(go, "--qbatch"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_THREADS
   if (esl_opt_IsUsed(go, "--cpu")        && fprintf(ofp, "# number of worker threads:        %d\n",             esl_opt_GetInteger(go, "--cpu"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");  
+  if (esl_opt_IsUsed(go, "--postcpu")    && fprintf(ofp, "# postprocessing threads:          %d\n",             esl_opt_GetInteger(go, "--postcpu"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+#endif
+#ifdef eslENABLE_SSE
+  if (esl_opt_IsUsed(go, "--simd")       && p7_simd_Report(ofp)                                                                                      != eslOK) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
 #ifdef HMMER_MPI
   if (esl_opt_IsUsed(go, "--mpi")        && fprintf(ofp, "# MPI:                             on\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -292,6 +327,15 @@ main(int argc, char **argv)
 
   process_commandline(argc, argv, &go, &cfg.hmmfile, &cfg.dbfile);    
 
+#ifdef eslENABLE_SSE
+  /* choose vector kernels before any profiles are created */
+  if (esl_opt_IsOn(go, "--simd")) {
+    int level;
+    if (p7_simd_Parse(esl_opt_GetString(go, "--simd"), &level) != eslOK) p7_Fail("--simd must be one of sse, avx2, avx512, or auto\n");
+    p7_simd_Set(level);
+  }
+#endif
+
 /* is the range restricted? */
   if (esl_opt_IsUsed(go, "--restrictdb_stkey") )
     if ((cfg.firstseq_key = esl_opt_GetString(go, "--restrictdb_stkey")) == NULL)  p7_Fail("Failure capturing --restrictdb_stkey\n");
@@ -354,8 +398,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;              /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;              /* output stream for tabular per-dom (--domtblout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam tabular output (--pfamtblout)    */
+  FILE            *pjfp     = NULL;              /* output stream for pipeline profiles (--pjson)   */
   P7_HMMFILE      *hfp      = NULL;              /* open input HMM file                             */
   ESL_SQFILE      *dbfp     = NULL;              /* open input sequence file                        */
+  P7_DSQDB        *dsqdb    = NULL;              /* ... or open pressed sequence database           */
   P7_HMM          *hmm      = NULL;              /* one HMM query                                   */
   ESL_ALPHABET    *abc      = NULL;              /* digital alphabet                                */
   int              dbfmt    = eslSQFILE_UNKNOWN; /* format code for sequence database file          */
@@ -366,15 +412,26 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              hstatus  = eslOK;
   int              sstatus  = eslOK;
   int              i;
+  int              q;
 
   int              ncpus    = 0;
+  int              npost    = 0;                 /* # of postprocessing threads, in a staged search */
+
+  int              qbatch   = esl_opt_GetInteger(go, "--qbatch");
+  int              nbatch   = 0;                 /* # of queries in the current batch               */
+  int              npass    = 0;                 /* # of passes made over the target database       */
+  P7_HMM         **hmmlist  = NULL;              /* current batch of query HMMs, [0..nbatch-1]      */
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thv      = NULL;              /* one query's hit lists from workers 1.., for merging */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
   ESL_WORK_QUEUE  *queue    = NULL;
+  P7_WSCHED       *wsched   = NULL;
+  ESL_THREADS     *postObj  = NULL;
+  P7_PSTAGE       *pstage   = NULL;
 #endif
   char             errbuf[eslERRBUFSIZE];
 
@@ -388,15 +445,20 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     if (dbfmt == eslSQFILE_UNKNOWN) p7_Fail("%s is not a recognized sequence database file format\n", esl_opt_GetString(go, "--tformat"));
   }
 
-  /* Open the target sequence database */
-  status = esl_sqfile_Open(cfg->dbfile, dbfmt, p7_SEQDBENV, &dbfp);
+  /* Open the target sequence database: a pressed one (see makedsqdb) if
+   * it is one and no format was given, else an ordinary sequence file.
+   */
+  status = (dbfmt == eslSQFILE_UNKNOWN ? p7_dsqdb_Open(cfg->dbfile, &dsqdb, errbuf) : eslENOTFOUND);
+  if      (status == eslEFORMAT)   p7_Fail("Pressed sequence database %s is corrupt.\n%s\n", cfg->dbfile, errbuf);
+  else if (status == eslENOTFOUND) status = esl_sqfile_Open(cfg->dbfile, dbfmt, p7_SEQDBENV, &dbfp);
+  else if (status != eslOK)        p7_Fail("Unexpected error %d opening pressed sequence database %s\n", status, cfg->dbfile);
   if      (status == eslENOTFOUND) p7_Fail("Failed to open sequence file %s for reading\n",          cfg->dbfile);
   else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",            cfg->dbfile);
   else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
   else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, cfg->dbfile);  
 
 
-  if (esl_opt_IsUsed(go, "--restrictdb_stkey") || esl_opt_IsUsed(go, "--restrictdb_n")) {
+  if (dbfp && (esl_opt_IsUsed(go, "--restrictdb_stkey") || esl_opt_IsUsed(go, "--restrictdb_n"))) {
     if (esl_opt_IsUsed(go, "--ssifile"))
       esl_sqfile_OpenSSI(dbfp, esl_opt_GetString(go, "--ssifile"));
     else
@@ -417,6 +479,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--tblout"))    { if ((tblfp    = fopen(esl_opt_GetString(go, "--tblout"),    "w")) == NULL)  esl_fatal("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
   if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
   if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+  if (esl_opt_IsOn(go, "--pjson"))     { if ((pjfp     = fopen(esl_opt_GetString(go, "--pjson"),     "w")) == NULL)  esl_fatal("Failed to open pipeline profile output file %s for writing\n", esl_opt_GetString(go, "--pjson")); }
 
 #ifdef HMMER_THREADS
   /* initialize thread data */
@@ -425,11 +488,31 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     {
       threadObj = esl_threads_Create(&pipeline_thread);
       queue = esl_workqueue_Create(ncpus * 2);
+
+      /* A pressed database needs no reader: workers fetch their own
+       * targets by index, and steal from each other when they run out.
+       */
+      if (dsqdb && (wsched = p7_wsched_Create(ncpus)) == NULL) esl_fatal("Failed to create work-stealing scheduler");
+
+      /* A staged search: the <ncpus> workers only filter, and hand
+       * the targets that pass to <npost> more that do the rest.
+       */
+      if ((npost = esl_opt_GetInteger(go, "--postcpu")) > 0)
+	{
+	  postObj = esl_threads_Create(&postproc_thread);
+	  if ((pstage = p7_pstage_Create(ncpus, npost)) == NULL) esl_fatal("Failed to create pipeline stage queue");
+	}
     }
 #endif
 
-  infocnt = (ncpus == 0) ? 1 : ncpus;
-  ESL_ALLOC(info, (ptrdiff_t) sizeof(*info) * infocnt);
+  /* Each worker gets <qbatch> consecutive WORKER_INFOs, one per query
+   * in a batch: worker i searches query q with info[i*qbatch + q].
+   * In a staged search, workers ncpus.. are the postprocessing ones.
+   */
+  infocnt = (ncpus == 0) ? 1 : ncpus + npost;
+  ESL_ALLOC(info,    (ptrdiff_t) sizeof(*info) * infocnt * qbatch);
+  ESL_ALLOC(hmmlist, (ptrdiff_t) sizeof(P7_HMM *) * qbatch);
+  ESL_ALLOC(thv,     (ptrdiff_t) sizeof(P7_TOPHITS *) * infocnt);
 
   /* <abc> is not known 'til first HMM is read. */
   hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
@@ -437,13 +520,20 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     {
       /* One-time initializations after alphabet <abc> becomes known */
       output_header(ofp, go, cfg->hmmfile, cfg->dbfile);
-      esl_sqfile_SetDigital(dbfp, abc); //ReadBlock requires knowledge of the alphabet to decide how best to read blocks
+      if (dsqdb && dsqdb->alphatype != abc->type)
+	p7_Fail("Pressed sequence database %s is %s, but query HMMs are %s\n", cfg->dbfile, esl_abc_DecodeType(dsqdb->alphatype), esl_abc_DecodeType(abc->type));
+      if (dbfp) esl_sqfile_SetDigital(dbfp, abc); //ReadBlock requires knowledge of the alphabet to decide how best to read blocks
 
-      for (i = 0; i < infocnt; ++i)
+      for (i = 0; i < infocnt * qbatch; ++i)
 	{
-	  info[i].bg    = p7_bg_Create(abc);
+	  info[i].bg     = p7_bg_Create(abc);
+	  info[i].nquery = 1;
+	  info[i].dsqdb  = dsqdb;
+	  info[i].do_lsort = esl_opt_GetBoolean(go, "--lsort");
 #ifdef HMMER_THREADS
-	  info[i].queue = queue;
+	  info[i].queue  = queue;
+	  info[i].wsched = wsched;
+	  info[i].pstage = pstage;
 #endif
 	}
 
@@ -459,17 +549,22 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
     }
 
-  /* Outer loop: over each query HMM in <hmmfile>. */
+  /* Outer loop: over batches of up to <qbatch> query HMMs in <hmmfile>.
+   * Each batch costs one pass over the target database.
+   */
   while (hstatus == eslOK) 
     {
-      P7_PROFILE      *gm      = NULL;
-      P7_OPROFILE     *om      = NULL;       /* optimized query profile                  */
+      hmmlist[0] = hmm;
+      for (nbatch = 1; nbatch < qbatch; nbatch++)
+	if ((hstatus = p7_hmmfile_Read(hfp, &abc, &(hmmlist[nbatch]))) != eslOK) break;
 
-      nquery++;
+      npass++;
       esl_stopwatch_Start(w);
 
       /* seqfile may need to be rewound (multiquery mode) */
-      if (nquery > 1)
+      if (npass > 1 && dsqdb)
+        p7_dsqdb_Position(dsqdb, 0);
+      else if (npass > 1)
       {
         if (! esl_sqfile_IsRewindable(dbfp))
           esl_fatal("Target sequence file %s isn't rewindable; can't search it with multiple queries", cfg->dbfile);
@@ -479,108 +574,109 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       }
 
       if ( cfg->firstseq_key != NULL ) { //it's tempting to want to do this once and capture the offset position for future passes, but ncbi files make this non-trivial, so this keeps it general
-        sstatus = esl_sqfile_PositionByKey(dbfp, cfg->firstseq_key);
+        sstatus = (dsqdb ? p7_dsqdb_PositionByKey(dsqdb, cfg->firstseq_key) : esl_sqfile_PositionByKey(dbfp, cfg->firstseq_key));
         if (sstatus != eslOK)
           p7_Fail("Failure setting restrictdb_stkey to %d\n", cfg->firstseq_key);
       }
 
-      if (fprintf(ofp, "Query:       %s  [M=%d]\n", hmm->name, hmm->M)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (hmm->acc)  { if (fprintf(ofp, "Accession:   %s\n", hmm->acc)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
-      if (hmm->desc) { if (fprintf(ofp, "Description: %s\n", hmm->desc) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+      for (q = 0; q < nbatch; q++)
+	{
+	  P7_PROFILE      *gm      = NULL;
+	  P7_OPROFILE     *om      = NULL;       /* optimized query profile                  */
 
-      /* Convert to an optimized model */
-      gm = p7_profile_Create (hmm->M, abc);
-      om = p7_oprofile_Create(hmm->M, abc);
-      p7_ProfileConfig(hmm, info->bg, gm, 100, p7_LOCAL); /* 100 is a dummy length for now; and MSVFilter requires local mode */
-      p7_oprofile_Convert(gm, om);                  /* <om> is now p7_LOCAL, multihit */
+	  /* Convert to an optimized model */
+	  gm = p7_profile_Create (hmmlist[q]->M, abc);
+	  om = p7_oprofile_Create(hmmlist[q]->M, abc);
+	  p7_ProfileConfig(hmmlist[q], info[q].bg, gm, 100, p7_LOCAL); /* 100 is a dummy length for now; and MSVFilter requires local mode */
+	  p7_oprofile_Convert(gm, om);                  /* <om> is now p7_LOCAL, multihit */
 
+	  for (i = 0; i < infocnt; ++i)
+	    {
+	      WORKER_INFO *qi = &(info[i*qbatch + q]);
+
+	      /* Create processing pipeline and hit list */
+	      qi->th  = p7_tophits_Create();
+	      if (esl_opt_IsOn(go, "--maxhits")) p7_tophits_SetMaxHits(qi->th, esl_opt_GetInteger(go, "--maxhits"));
+	      qi->om  = p7_oprofile_Clone(om);
+	      qi->pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+	      qi->pli->report_thr = infocnt;
+	      qi->pli->do_profile = (pjfp != NULL);
+	      status = p7_pli_NewModel(qi->pli, qi->om, qi->bg);
+	      if (status == eslEINVAL) p7_Fail(qi->pli->errbuf);
+	    }
+
+	  p7_oprofile_Destroy(om);
+	  p7_profile_Destroy(gm);
+	}
+
+#ifdef HMMER_THREADS
+      if (pstage) p7_pstage_Reset(pstage);
+#endif
       for (i = 0; i < infocnt; ++i)
       {
-        /* Create processing pipeline and hit list */
-        info[i].th  = p7_tophits_Create();
-        info[i].om  = p7_oprofile_Clone(om);
-        info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
-        status = p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
-        if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
-
+        info[i*qbatch].nquery = nbatch;
 #ifdef HMMER_THREADS
-        if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+        if (ncpus > 0) esl_threads_AddThread((i < ncpus ? threadObj : postObj), &(info[i*qbatch]));
 #endif
       }
 
 #ifdef HMMER_THREADS
-      if (ncpus > 0)  sstatus = thread_loop(threadObj, queue, dbfp, cfg->n_targetseq);
-      else            sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
+      if (pstage) esl_threads_WaitForStart(postObj);
+
+      if      (wsched)    sstatus = steal_loop (threadObj, wsched, dsqdb, cfg->n_targetseq);
+      else if (ncpus > 0) sstatus = thread_loop(threadObj, queue, dbfp, dsqdb, cfg->n_targetseq);
+      else                sstatus = serial_loop(info, dbfp, dsqdb, cfg->n_targetseq);
+
+      /* filtering is done; the postprocessing threads finish what's queued */
+      if (pstage && sstatus == eslEOF)
+	{
+	  p7_pstage_Close(pstage);
+	  esl_threads_WaitForFinish(postObj);
+	}
 #else
-      sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
+      sstatus = serial_loop(info, dbfp, dsqdb, cfg->n_targetseq);
 #endif
       switch(sstatus)
       {
       case eslEFORMAT:
         esl_fatal("Parse failed (sequence file %s):\n%s\n",
-            dbfp->filename, esl_sqfile_GetErrorBuf(dbfp));
+            cfg->dbfile, dsqdb ? dsqdb->errbuf : esl_sqfile_GetErrorBuf(dbfp));
         break;
       case eslEOF:
         /* do nothing */
         break;
       default:
-        esl_fatal("Unexpected error %d reading sequence file %s", sstatus, dbfp->filename);
-      }
-
-      /* merge the results of the search results */
-      for (i = 1; i < infocnt; ++i)
-      {
-        p7_tophits_Merge(info[0].th, info[i].th);
-        p7_pipeline_Merge(info[0].pli, info[i].pli);
-
-        p7_pipeline_Destroy(info[i].pli);
-        p7_tophits_Destroy(info[i].th);
-        p7_oprofile_Destroy(info[i].om);
+        esl_fatal("Unexpected error %d reading sequence file %s", sstatus, cfg->dbfile);
       }
 
-      /* Print the results.  */
-      p7_tophits_SortBySortkey(info->th);
-      p7_tophits_Threshold(info->th, info->pli);
-      p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      p7_tophits_Domains(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-
-      if (tblfp)     p7_tophits_TabularTargets(tblfp,    hmm->name, hmm->acc, info->th, info->pli, (nquery == 1));
-      if (domtblfp)  p7_tophits_TabularDomains(domtblfp, hmm->name, hmm->acc, info->th, info->pli, (nquery == 1));
-      if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, hmm->name, hmm->acc, info->th, info->pli);
-  
-      esl_stopwatch_Stop(w);
-      p7_pli_Statistics(ofp, info->pli, w);
-      if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-
-      /* Output the results in an MSA (-A option) */
-      if (afp) {
-	ESL_MSA *msa = NULL;
+      /* merge the search results of each query, and print them */
+      for (q = 0; q < nbatch; q++)
+	{
+	  for (i = 1; i < infocnt; ++i)
+	    {
+	      thv[i-1] = info[i*qbatch + q].th;
+	      p7_pipeline_Merge(info[q].pli, info[i*qbatch + q].pli);
 
-	if (p7_tophits_Alignment(info->th, abc, NULL, NULL, 0, p7_ALL_CONSENSUS_COLS, &msa) == eslOK)
-	  {
-	    esl_msa_SetName     (msa, hmm->name, -1);
-	    esl_msa_SetAccession(msa, hmm->acc,  -1);
-	    esl_msa_SetDesc     (msa, hmm->desc, -1);
-	    esl_msa_FormatAuthor(msa, "hmmsearch (HMMER %s)", HMMER_VERSION);
+	      p7_pipeline_Destroy(info[i*qbatch + q].pli);
+	      p7_oprofile_Destroy(info[i*qbatch + q].om);
+	    }
+	  if (p7_tophits_MergeN(info[q].th, thv, infocnt-1, infocnt) != eslOK) esl_fatal("Failed to merge hit lists");
+	  for (i = 1; i < infocnt; ++i) p7_tophits_Destroy(thv[i-1]);
+#ifdef HMMER_THREADS
+	  if (pstage) p7_pstage_Account(pstage, info[q].pli);
+#endif
 
-	    if (textw > 0) esl_msafile_Write(afp, msa, eslMSAFILE_STOCKHOLM);
-	    else           esl_msafile_Write(afp, msa, eslMSAFILE_PFAM);
-	  
-	    if (fprintf(ofp, "# Alignment of %d hits satisfying inclusion thresholds saved to: %s\n", msa->nseq, esl_opt_GetString(go, "-A")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-	  } 
-	else { if (fprintf(ofp, "# No hits satisfy inclusion thresholds; no alignment saved\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
-	  
-	esl_msa_Destroy(msa);
-      }
+	  nquery++;
+	  status = output_query(go, ofp, afp, tblfp, domtblfp, pfamtblfp, pjfp, textw, hmmlist[q], &(info[q]), w, (nquery == 1));
+	  if (status != eslOK) goto ERROR;
 
-      p7_pipeline_Destroy(info->pli);
-      p7_tophits_Destroy(info->th);
-      p7_oprofile_Destroy(info->om);
-      p7_oprofile_Destroy(om);
-      p7_profile_Destroy(gm);
-      p7_hmm_Destroy(hmm);
+	  p7_pipeline_Destroy(info[q].pli);
+	  p7_tophits_Destroy(info[q].th);
+	  p7_oprofile_Destroy(info[q].om);
+	  p7_hmm_Destroy(hmmlist[q]);
+	}
 
-      hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
+      if (hstatus == eslOK) hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
     } /* end outer loop over query HMMs */
 
   switch(hstatus) {
@@ -601,7 +697,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   /* Cleanup - prepare for exit
    */
-  for (i = 0; i < infocnt; ++i)
+  for (i = 0; i < infocnt * qbatch; ++i)
     p7_bg_Destroy(info[i].bg);
 
 #ifdef HMMER_THREADS
@@ -612,12 +708,18 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	esl_sq_DestroyBlock(block);
       esl_workqueue_Destroy(queue);
       esl_threads_Destroy(threadObj);
+      p7_wsched_Destroy(wsched);
+      if (postObj) esl_threads_Destroy(postObj);
+      p7_pstage_Destroy(pstage);
     }
 #endif
 
   free(info);
+  free(thv);
+  free(hmmlist);
   p7_hmmfile_Close(hfp);
-  esl_sqfile_Close(dbfp);
+  if (dbfp)  esl_sqfile_Close(dbfp);
+  if (dsqdb) p7_dsqdb_Close(dsqdb);
   esl_alphabet_Destroy(abc);
   esl_stopwatch_Destroy(w);
 
@@ -626,6 +728,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (pjfp)          fclose(pjfp);
 
   return eslOK;
 
@@ -633,6 +736,59 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   return eslFAIL;
 }
 
+/* output_query()
+ * Print the results of one query's search, once its hits and
+ * pipeline have been merged into <info>: query line, ranked target
+ * and domain lists, tabular outputs, pipeline statistics (and the
+ * --pjson profile), and the -A alignment. <is_first> is TRUE for the
+ * first query of the run, so the tabular outputs get their column
+ * headers.
+ */
+static int
+output_query(ESL_GETOPTS *go, FILE *ofp, FILE *afp, FILE *tblfp, FILE *domtblfp, FILE *pfamtblfp, FILE *pjfp, int textw,
+	     P7_HMM *hmm, WORKER_INFO *info, ESL_STOPWATCH *w, int is_first)
+{
+  if (fprintf(ofp, "Query:       %s  [M=%d]\n", hmm->name, hmm->M)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (hmm->acc)  { if (fprintf(ofp, "Accession:   %s\n", hmm->acc)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+  if (hmm->desc) { if (fprintf(ofp, "Description: %s\n", hmm->desc) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+
+  p7_tophits_SortBySortkey(info->th);
+  p7_tophits_Threshold(info->th, info->pli);
+  p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  p7_tophits_Domains(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  if (tblfp)     p7_tophits_TabularTargets(tblfp,    hmm->name, hmm->acc, info->th, info->pli, is_first);
+  if (domtblfp)  p7_tophits_TabularDomains(domtblfp, hmm->name, hmm->acc, info->th, info->pli, is_first);
+  if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, hmm->name, hmm->acc, info->th, info->pli);
+  
+  esl_stopwatch_Stop(w);
+  p7_pli_Statistics(ofp, info->pli, w);
+  if (pjfp)      p7_pli_WriteProfile(pjfp, hmm->name, info->pli, w);
+  if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  /* Output the results in an MSA (-A option) */
+  if (afp) {
+    ESL_MSA *msa = NULL;
+
+    if (p7_tophits_Alignment(info->th, hmm->abc, NULL, NULL, 0, p7_ALL_CONSENSUS_COLS, &msa) == eslOK)
+      {
+	esl_msa_SetName     (msa, hmm->name, -1);
+	esl_msa_SetAccession(msa, hmm->acc,  -1);
+	esl_msa_SetDesc     (msa, hmm->desc, -1);
+	esl_msa_FormatAuthor(msa, "hmmsearch (HMMER %s)", HMMER_VERSION);
+
+	if (textw > 0) esl_msafile_Write(afp, msa, eslMSAFILE_STOCKHOLM);
+	else           esl_msafile_Write(afp, msa, eslMSAFILE_PFAM);
+	  
+	if (fprintf(ofp, "# Alignment of %d hits satisfying inclusion thresholds saved to: %s\n", msa->nseq, esl_opt_GetString(go, "-A")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+      } 
+    else { if (fprintf(ofp, "# No hits satisfy inclusion thresholds; no alignment saved\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+	  
+    esl_msa_Destroy(msa);
+  }
+  return eslOK;
+}
+
 #ifdef HMMER_MPI
 
 /* Define common tags used by the MPI master/slave processes */
@@ -808,6 +964,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;              /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;              /* output stream for tabular per-dom (--domtblout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam-style tabular output  (--pfamtblout) */
+  FILE            *pjfp     = NULL;              /* output stream for pipeline profiles (--pjson)   */
   P7_BG           *bg       = NULL;	         /* null model                                      */
   P7_HMMFILE      *hfp      = NULL;              /* open input HMM file                             */
   ESL_SQFILE      *dbfp     = NULL;              /* open input sequence file                        */
@@ -882,6 +1039,9 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--pfamtblout") && (pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)
     mpi_failure("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout"));
 
+  if (esl_opt_IsOn(go, "--pjson") && (pjfp = fopen(esl_opt_GetString(go, "--pjson"), "w")) == NULL)
+    mpi_failure("Failed to open pipeline profile output file %s for writing\n", esl_opt_GetString(go, "--pjson"));
+
   ESL_ALLOC(list, sizeof(BLOCK_LIST));
   list->complete = 0;
   list->size     = 0;
@@ -934,7 +1094,9 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
       /* Create processing pipeline and hit list */
       th  = p7_tophits_Create(); 
+      if (esl_opt_IsOn(go, "--maxhits")) p7_tophits_SetMaxHits(th, esl_opt_GetInteger(go, "--maxhits"));
       pli = p7_pipeline_Create(go, hmm->M, 100, FALSE, p7_SEARCH_SEQS);
+      pli->do_profile = (pjfp != NULL);
       p7_pli_NewModel(pli, om, bg);
 
       /* Main loop: */
@@ -1038,6 +1200,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
       esl_stopwatch_Stop(w);
       p7_pli_Statistics(ofp, pli, w);
+      if (pjfp) p7_pli_WriteProfile(pjfp, hmm->name, pli, w);
       if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
       /* Output the results in an MSA (-A option) */
@@ -1122,6 +1285,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (pjfp)          fclose(pjfp);
 
   return eslOK;
 
@@ -1198,7 +1362,9 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
       p7_oprofile_Convert(gm, om);
 
       th  = p7_tophits_Create(); 
+      if (esl_opt_IsOn(go, "--maxhits")) p7_tophits_SetMaxHits(th, esl_opt_GetInteger(go, "--maxhits"));
       pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+      pli->do_profile = esl_opt_IsOn(go, "--pjson");
       p7_pli_NewModel(pli, om, bg);
 
       /* receive a sequence block from the master */
@@ -1286,26 +1452,32 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif /*HMMER_MPI*/
 
 static int
-serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs)
+serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, P7_DSQDB *dsqdb, int n_targetseqs)
 {
   int      sstatus;
+  int      q;
   ESL_SQ   *dbsq     = NULL;   /* one target sequence (digital)  */
   int seq_cnt = 0;
 
   dbsq = esl_sq_CreateDigital(info->om->abc);
 
-  /* Main loop: */
-  while ( (n_targetseqs==-1 || seq_cnt<n_targetseqs) &&  (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
+  /* Main loop: each sequence is read once, and searched with every query in the batch */
+  while ( (n_targetseqs==-1 || seq_cnt<n_targetseqs) &&
+          (sstatus = (dsqdb ? p7_dsqdb_Read(dsqdb, dbsq) : esl_sqio_Read(dbfp, dbsq))) == eslOK)
   {
-      p7_pli_NewSeq(info->pli, dbsq);
-      p7_bg_SetLength(info->bg, dbsq->n);
-      p7_oprofile_ReconfigLength(info->om, dbsq->n);
+      for (q = 0; q < info->nquery; q++)
+	{
+	  p7_pli_NewSeq(info[q].pli, dbsq);
+	  p7_pli_SetLength(info[q].pli, info[q].om, info[q].bg, dbsq->n);
       
-      p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
+	  p7_Pipeline(info[q].pli, info[q].om, info[q].bg, dbsq, NULL, info[q].th);
+
+	  p7_pipeline_Reuse(info[q].pli);
+	}
 
       seq_cnt++;
-      esl_sq_Reuse(dbsq);
-      p7_pipeline_Reuse(info->pli);
+      if (dsqdb) p7_dsqdb_ReuseSeq(dbsq);
+      else       esl_sq_Reuse(dbsq);
   }
 
   if (n_targetseqs!=-1 && seq_cnt==n_targetseqs)
@@ -1318,7 +1490,7 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs)
 
 #ifdef HMMER_THREADS
 static int
-thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_targetseqs)
+thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, P7_DSQDB *dsqdb, int n_targetseqs)
 {
   int  status  = eslOK;
   int  sstatus = eslOK;
@@ -1342,7 +1514,8 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
         block->count = 0;
         sstatus = eslEOF;
       } else {
-        sstatus = esl_sqio_ReadBlock(dbfp, block, -1, n_targetseqs, /*max_init_window=*/FALSE, FALSE);
+        if (dsqdb) sstatus = p7_dsqdb_ReadBlock(dsqdb, block, n_targetseqs);
+        else       sstatus = esl_sqio_ReadBlock(dbfp, block, -1, n_targetseqs, /*max_init_window=*/FALSE, FALSE);
         n_targetseqs -= block->count;
       }
 
@@ -1372,10 +1545,30 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
   return sstatus;
 }
 
+/* steal_loop()
+ * The threaded search of a pressed database: no reader, no queue.
+ * The range of targets to search, from the current position of
+ * <dsqdb>, is dealt out to the workers' deques in <wsched>, and the
+ * workers fetch their targets themselves (see pipeline_thread()).
+ */
+static int
+steal_loop(ESL_THREADS *obj, P7_WSCHED *wsched, P7_DSQDB *dsqdb, int n_targetseqs)
+{
+  int64_t from = dsqdb->next;
+  int64_t to   = (n_targetseqs < 0 ? dsqdb->nseq : ESL_MIN(dsqdb->nseq, from + n_targetseqs));
+
+  p7_wsched_Reset(wsched, from, to, BLOCK_SIZE);
+
+  esl_threads_WaitForStart(obj);
+  esl_threads_WaitForFinish(obj);
+
+  p7_dsqdb_Position(dsqdb, to);
+  return eslEOF;
+}
+
 static void 
 pipeline_thread(void *arg)
 {
-  int i;
   int status;
   int workeridx;
   WORKER_INFO   *info;
@@ -1383,6 +1576,7 @@ pipeline_thread(void *arg)
 
   ESL_SQ_BLOCK  *block = NULL;
   void          *newBlock;
+  int64_t        lo, hi;
   
   impl_Init();
 
@@ -1391,6 +1585,30 @@ pipeline_thread(void *arg)
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
 
+  /* A pressed database: take ranges of targets from our own deque,
+   * or steal them, and fetch them into our own block.
+   */
+  if (info->wsched)
+    {
+      block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, info->om->abc);
+      if (block == NULL) esl_fatal("Failed to allocate sequence block");
+
+      while ((status = p7_wsched_Next(info->wsched, workeridx, &lo, &hi)) == eslOK)
+	{
+	  status = p7_dsqdb_FetchBlock(info->dsqdb, block, lo, (int) (hi - lo));
+	  if      (status == eslEFORMAT) esl_fatal("Parse failed (sequence file %s):\n%s\n", info->dsqdb->filename, info->dsqdb->errbuf);
+	  else if (status != eslOK)      esl_fatal("Unexpected error %d reading sequence file %s", status, info->dsqdb->filename);
+
+	  search_block(info, block);
+	}
+      if (status != eslEOF) esl_fatal("Work-stealing scheduler failed");
+
+      esl_sq_DestroyBlock(block);
+      sort_hits(info);
+      esl_threads_Finished(obj, workeridx);
+      return;
+    }
+
   status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
@@ -1398,20 +1616,7 @@ pipeline_thread(void *arg)
   block = (ESL_SQ_BLOCK *) newBlock;
   while (block->count > 0)
     {
-      /* Main loop: */
-      for (i = 0; i < block->count; ++i)
-	{
-	  ESL_SQ *dbsq = block->list + i;
-
-	  p7_pli_NewSeq(info->pli, dbsq);
-	  p7_bg_SetLength(info->bg, dbsq->n);
-	  p7_oprofile_ReconfigLength(info->om, dbsq->n);
-	  
-	  p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
-	  
-	  esl_sq_Reuse(dbsq);
-	  p7_pipeline_Reuse(info->pli);
-	}
+      search_block(info, block);
 
       status = esl_workqueue_WorkerUpdate(info->queue, block, &newBlock);
       if (status != eslOK) esl_fatal("Work queue worker failed");
@@ -1422,9 +1627,126 @@ pipeline_thread(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
+  sort_hits(info);
+  esl_threads_Finished(obj, workeridx);
+  return;
+}
+
+/* postproc_thread()
+ * A postprocessing worker of a staged search (--postcpu): finishes
+ * the search of each target that passed some filter worker's
+ * filters, with its own pipeline and copy of the query.
+ */
+static void
+postproc_thread(void *arg)
+{
+  int            status;
+  int            workeridx;
+  WORKER_INFO   *info;
+  WORKER_INFO   *qi;
+  ESL_THREADS   *obj;
+  P7_SURVIVOR    sv;
+
+  impl_Init();
+
+  obj = (ESL_THREADS *) arg;
+  esl_threads_Started(obj, &workeridx);
+
+  info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+
+  while ((status = p7_pstage_Pop(info->pstage, &sv)) == eslOK)
+    {
+      qi = info + sv.q;
+
+      p7_pli_SetLength(qi->pli, qi->om, qi->bg, sv.sq->n);
+      p7_pli_Postprocess(qi->pli, qi->om, qi->bg, sv.sq, NULL, sv.fwdsc, qi->th);
+
+      p7_pipeline_Reuse(qi->pli);
+      esl_sq_Destroy(sv.sq);
+    }
+  if (status != eslEOF) esl_fatal("Pipeline stage queue failed");
+
+  sort_hits(info);
   esl_threads_Finished(obj, workeridx);
   return;
 }
+
+/* sort_hits()
+ * Sort each of a worker's hit lists in the worker's own thread, so
+ * the master only has to merge them (see p7_tophits_MergeN()).
+ */
+static void
+sort_hits(WORKER_INFO *info)
+{
+  int q;
+
+  for (q = 0; q < info->nquery; q++)
+    p7_tophits_SortBySortkey(info[q].th);
+}
+
+/* search_block()
+ * Search every query of a worker's batch against a block of targets,
+ * then recycle the block's sequences.
+ */
+static void
+search_block(WORKER_INFO *info, ESL_SQ_BLOCK *block)
+{
+  WORKER_INFO *qi;
+  ESL_SQ      *dbsq;
+  float        fwdsc;
+  int          i, j;
+  int          q;
+  int          status;
+  int          use_ssv;
+
+  /* Each query in the batch is run over the whole block in turn,
+   * so its profile stays in cache across the block.
+   */
+  for (q = 0; q < info->nquery; q++)
+    {
+      qi = info + q;
+
+      /* For a short query, a first pass of inter-sequence SSV over the
+       * whole block lets us skip the sequences that fail it.
+       */
+      status = p7_pli_SSVBlock(qi->pli, qi->om, qi->bg, block->list, block->count);
+      if      (status == eslOK)        use_ssv = TRUE;
+      else if (status == eslENORESULT) use_ssv = FALSE;
+      else    esl_fatal("Inter-sequence SSV filter failed");
+
+      /* With --lsort, targets of the same length are searched one after
+       * another, and only the first of them reconfigures the length model.
+       */
+      if (qi->do_lsort && p7_pli_SortByLength(qi->pli, block->list, block->count) != eslOK)
+	esl_fatal("Failed to sort target block by length");
+
+      /* Main loop: */
+      for (j = 0; j < block->count; ++j)
+	{
+	  i    = (qi->do_lsort ? qi->pli->order[j] : j);
+	  dbsq = block->list + i;
+
+	  p7_pli_NewSeq(qi->pli, dbsq);
+	  if (! use_ssv || ! qi->pli->ssv_fail[i])
+	    {
+	      p7_pli_SetLength(qi->pli, qi->om, qi->bg, dbsq->n);
+
+	      /* in a staged search, targets that pass the filters go to the postprocessing threads */
+	      if (! info->pstage)
+		p7_Pipeline(qi->pli, qi->om, qi->bg, dbsq, NULL, qi->th);
+	      else if (p7_pli_Filter(qi->pli, qi->om, qi->bg, dbsq, &fwdsc) == eslOK &&
+		       p7_pstage_Push(info->pstage, dbsq, q, fwdsc) != eslOK)
+		esl_fatal("Failed to queue target for postprocessing");
+	    }
+	  
+	  p7_pipeline_Reuse(qi->pli);
+	}
+    }
+
+  for (i = 0; i < block->count; ++i)
+    if (info->dsqdb) p7_dsqdb_ReuseSeq(block->list + i);
+    else             esl_sq_Reuse(block->list + i);
+}
 #endif   /* HMMER_THREADS */
  
 
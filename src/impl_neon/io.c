@@ -10,6 +10,11 @@
  * <hmmfile>.h3p, which nominally stand for "H3 filter" and "H3
  * profile".
  *
+ * hmmpress here writes format 3/f. Format 3/g, written by the SSE
+ * implementation, is the same except that each block of striped
+ * score vectors starts on a 64-byte file offset after zero padding;
+ * it is read too, skipping the padding.
+ *
  * Contents:
  *    1. Writing optimized profiles to two files.
  *    2. Reading optimized profiles in two stages.
@@ -42,6 +47,9 @@
 #include "hmmer.h"
 #include "impl_neon.h"
 
+static uint32_t  v3g_fmagic = 0xb3e7e6f3; /* 3/g binary MSV file, NEON:     "3gfs" = 0x 33 67 66 73  + 0x80808080 */
+static uint32_t  v3g_pmagic = 0xb3e7f0f3; /* 3/g binary profile file, NEON: "3gps" = 0x 33 67 70 73  + 0x80808080 */
+
 static uint32_t  v3f_fmagic = 0xb3e6e6f3; /* 3/f binary MSV file, NEON:     "3ffs" = 0x 33 66 66 73  + 0x80808080 */
 static uint32_t  v3f_pmagic = 0xb3e6f0f3; /* 3/f binary profile file, NEON: "3fps" = 0x 33 66 70 73  + 0x80808080 */
 
@@ -60,6 +68,12 @@ static uint32_t  v3b_pmagic = 0xb3e2f0f3; /* 3/b binary profile file, NEON: "3bp
 static uint32_t  v3a_fmagic = 0xe8b3e6f3; /* 3/a binary MSV file, NEON:     "h3fs" = 0x 68 33 66 73  + 0x80808080 */
 static uint32_t  v3a_pmagic = 0xe8b3f0f3; /* 3/a binary profile file, NEON: "h3ps" = 0x 68 33 70 73  + 0x80808080 */
 
+/* In 3/g files, vector blocks start at multiples of this many bytes */
+#define p7O_FILEALIGN 64
+
+static off_t align_offset(off_t pos);
+static int   read_align  (FILE *fp);
+
 
 /*****************************************************************
  *# 1. Writing optimized profiles to two files.
@@ -232,6 +246,7 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
   P7_OPROFILE  *om = NULL;
   ESL_ALPHABET *abc = NULL;
   uint32_t      magic;
+  uint32_t      fmagic;		/* v3f_fmagic or v3g_fmagic: 3/g has aligned vector blocks */
   off_t         roff;
   int           M, Q16, Q16x;
   int           x,n;
@@ -251,7 +266,8 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
   if (magic == v3c_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
   if (magic == v3d_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
   if (magic == v3e_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
-  if (magic != v3f_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
+  if (magic != v3f_fmagic && magic != v3g_fmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
+  fmagic = magic;
 
   if (! fread( (char *) &M,         sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
   if (! fread( (char *) &alphatype, sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");
@@ -283,8 +299,10 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
   if (! fread((char *) &(om->scale_b),   sizeof(float),   1,           hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read scale");
   if (! fread((char *) &(om->base_b),    sizeof(uint8_t), 1,           hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read base");
   if (! fread((char *) &(om->bias_b),    sizeof(uint8_t), 1,           hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read bias");
+  if (fmagic == v3g_fmagic && read_align(hfp->ffp) != eslOK)                      ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read padding before ssv scores");
   for (x = 0; x < abc->Kp; x++)
     if (! fread((char *) om->sbv[x],     sizeof(uint8x16_t), Q16x,        hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read ssv scores at %d [residue %c]", x, abc->sym[x]);
+  if (fmagic == v3g_fmagic && read_align(hfp->ffp) != eslOK)                      ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read padding before msv scores");
   for (x = 0; x < abc->Kp; x++)
     if (! fread((char *) om->rbv[x],     sizeof(uint8x16_t), Q16,         hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read msv scores at %d [residue %c]", x, abc->sym[x]);
   if (! fread((char *) om->evparam,      sizeof(float),   p7_NEVPARAM, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read stat params");
@@ -293,7 +311,7 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
 
   /* record ends with magic sentinel, for detecting binary file corruption */
   if (! fread( (char *) &magic,     sizeof(uint32_t), 1, hfp->ffp))  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no sentinel magic: .h3f file corrupted?");
-  if (magic != v3f_fmagic)                                           ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3f file corrupted?");
+  if (magic != fmagic)                                               ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3f file corrupted?");
 
   /* keep track of the ending offset of the MSV model */
   om->eoff = ftello(hfp->ffp) - 1;;
@@ -372,7 +390,7 @@ p7_oprofile_ReadInfoMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **r
   if (magic == v3c_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
   if (magic == v3d_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
   if (magic == v3e_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
-  if (magic != v3f_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
+  if (magic != v3f_fmagic && magic != v3g_fmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
 
   if (! fread( (char *) &M,         sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
   if (! fread( (char *) &alphatype, sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");
@@ -399,7 +417,9 @@ p7_oprofile_ReadInfoMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **r
   roff += (sizeof(int) * 5);                      /* magic, model size, alphabet type, max length, name length */
   roff += (sizeof(char) * (n + 1));               /* name string and terminator '\0'                           */
   roff += (sizeof(float) + sizeof(uint8_t) * 5);  /* transition  costs, bias, scale and base                   */
+  if (magic == v3g_fmagic) roff = align_offset(roff);
   roff += (sizeof(uint8x16_t) * abc->Kp * Q16x);     /* ssv scores                                                */
+  if (magic == v3g_fmagic) roff = align_offset(roff);
   roff += (sizeof(uint8x16_t) * abc->Kp * Q16);      /* msv scores                                                */
   roff += (sizeof(float) * p7_NEVPARAM);          /* stat params                                               */
   roff += (sizeof(off_t) * p7_NOFFSETS);          /* hmmscan offsets                                           */
@@ -488,6 +508,7 @@ int
 p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
 {
   uint32_t      magic;
+  uint32_t      pmagic;		/* v3f_pmagic or v3g_pmagic */
   int           M, Q4, Q8;
   int           x,n;
   char         *name = NULL;
@@ -516,7 +537,8 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   if (magic == v3c_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
   if (magic == v3d_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
   if (magic == v3e_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
-  if (magic != v3f_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad magic; not an HMM database file?");
+  if (magic != v3f_pmagic && magic != v3g_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad magic; not an HMM database file?");
+  pmagic = magic;
 
   if (! fread( (char *) &M,              sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read model size M");
   if (! fread( (char *) &alphatype,      sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read alphabet type");
@@ -547,7 +569,9 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   Q4  = p7O_NQF(om->M);
   Q8  = p7O_NQW(om->M);
 
+  if (pmagic == v3g_pmagic && read_align(hfp->pfp) != eslOK)                           ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read padding before <tu>");
   if (! fread((char *) om->twv,             sizeof(int16x8_t),  8*Q8,        hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <tu>, vitfilter transitions");
+  if (pmagic == v3g_pmagic && read_align(hfp->pfp) != eslOK)                           ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read padding before <ru>");
   for (x = 0; x < om->abc->Kp; x++)
     if (! fread( (char *) om->rwv[x],       sizeof(int16x8_t),  Q8,          hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <ru>[%d], vitfilter emissions for sym %c", x, om->abc->sym[x]);
   for (x = 0; x < p7O_NXSTATES; x++)
@@ -557,7 +581,9 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   if (! fread((char *) &(om->ddbound_w),    sizeof(int16_t),  1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read ddbound_w");
   if (! fread((char *) &(om->ncj_roundoff), sizeof(float),    1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read ddbound_w");
 
+  if (pmagic == v3g_pmagic && read_align(hfp->pfp) != eslOK)                        ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read padding before <tf>");
   if (! fread((char *) om->tfv,          sizeof(float32x4_t),   8*Q4,        hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <tf> transitions");
+  if (pmagic == v3g_pmagic && read_align(hfp->pfp) != eslOK)                        ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read padding before <rf>");
   for (x = 0; x < om->abc->Kp; x++)
     if (! fread( (char *) om->rfv[x],    sizeof(float32x4_t),   Q4,          hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <rf>[%d] emissions for sym %c", x, om->abc->sym[x]);
   for (x = 0; x < p7O_NXSTATES; x++)
@@ -570,7 +596,7 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
 
   /* record ends with magic sentinel, for detecting binary file corruption */
   if (! fread( (char *) &magic,     sizeof(uint32_t), 1, hfp->pfp))  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "no sentinel magic: .h3p file corrupted?");
-  if (magic != v3f_pmagic)                                           ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad sentinel magic; .h3p file corrupted?");
+  if (magic != pmagic)                                               ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad sentinel magic; .h3p file corrupted?");
 
 #ifdef HMMER_THREADS
   if (hfp->syncRead)
@@ -696,6 +722,31 @@ p7_oprofile_Position(P7_HMMFILE *hfp, off_t offset)
   return eslOK;
 }
 
+
+/* align_offset(), read_align()
+ * 
+ * In the 3/g format, each block of vectors starts at a file offset
+ * that's a multiple of p7O_FILEALIGN, after zero padding.
+ */
+static off_t
+align_offset(off_t pos)
+{
+  return (pos + p7O_FILEALIGN - 1) & ~((off_t) p7O_FILEALIGN - 1);
+}
+
+static int
+read_align(FILE *fp)
+{
+  char   pad[p7O_FILEALIGN];
+  off_t  pos;
+  size_t n;
+
+  if ((pos = ftello(fp)) < 0) return eslEFORMAT;
+  n = align_offset(pos) - pos;
+  if (n > 0 && fread(pad, sizeof(char), n, fp) != n) return eslEFORMAT;
+  return eslOK;
+}
+
 /*-------------------- end, utility routines ---------------------*/
 
 
@@ -71,9 +71,21 @@
  * 
  * Xref:      [J3/119-121]: for analysis of numeric range issues when
  *            <scaleproduct> overflows.
+ *
+ * Note:      Dispatches to the widest implementation the processor
+ *            supports (see simd.c); this one is <p7_Decoding_sse()>.
  */
 int
 p7_Decoding(const P7_OPROFILE *om, const P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp)
+{
+  return (*p7_simd_Kernels()->Decoding)(om, oxf, oxb, pp);
+}
+
+/* Function:  p7_Decoding_sse()
+ * Synopsis:  SSE implementation of <p7_Decoding()>.
+ */
+int
+p7_Decoding_sse(const P7_OPROFILE *om, const P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp)
 {
   __m128 *ppv;
   __m128 *fv;
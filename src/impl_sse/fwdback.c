@@ -127,9 +127,21 @@ p7_Forward(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *
  *            <eslERANGE> if the score exceeds the limited range of
  *            a probability-space odds ratio.
  *            In either case, <*opt_sc> is undefined.
+ *
+ * Note:      Dispatches to the widest implementation the processor
+ *            supports (see simd.c); this one is <p7_ForwardParser_sse()>.
  */
 int
 p7_ForwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
+{
+  return (*p7_simd_Kernels()->ForwardParser)(dsq, L, om, ox, opt_sc);
+}
+
+/* Function:  p7_ForwardParser_sse()
+ * Synopsis:  SSE implementation of <p7_ForwardParser()>.
+ */
+int
+p7_ForwardParser_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
 {
 #if eslDEBUGLEVEL > 0		
   if (om->M >  ox->allocQ4*4)    ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few columns)");
@@ -231,9 +243,21 @@ p7_Backward(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd,
  *            <eslERANGE> if the score exceeds the limited range of
  *            a probability-space odds ratio.
  *            In either case, <*opt_sc> is undefined.
+ *
+ * Note:      Dispatches to the widest implementation the processor
+ *            supports (see simd.c); this one is <p7_BackwardParser_sse()>.
  */
-int 
+int
 p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
+{
+  return (*p7_simd_Kernels()->BackwardParser)(dsq, L, om, fwd, bck, opt_sc);
+}
+
+/* Function:  p7_BackwardParser_sse()
+ * Synopsis:  SSE implementation of <p7_BackwardParser()>.
+ */
+int
+p7_BackwardParser_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
 {
 #if eslDEBUGLEVEL > 0		
   if (om->M >  bck->allocQ4*4)    ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few columns)");
@@ -0,0 +1,790 @@
+/* Forward/Backward parsers; AVX2/FMA version.
+ *
+ * Same algorithms as the linear-memory "parsing" modes of the SSE
+ * Forward and Backward in fwdback.c, with 8 float lanes per 256-bit
+ * vector instead of 4, and fused multiply-adds in the inner loops.
+ * The profile's Forward/Backward scores are restriped for this width
+ * by p7_oprofile_RestripeFB() (<om->rfv_avx>, <om->tfv_avx>), and the
+ * one MDI row lives in <ox->dpv> rather than <ox->dpf[0]>. Special
+ * states and sparse scale factors are stored in <ox->xmx> exactly as
+ * the SSE parsers store them, so p7_DomainDecoding() and everything
+ * else downstream works the same on either.
+ *
+ * Only the parsers are here. The full-matrix p7_Forward() and
+ * p7_Backward() fill rows that p7_Decoding(), p7_OptimalAccuracy(),
+ * and p7_StochasticTrace() read in the SSE striping, so they stay
+ * SSE.
+ *
+ * The 8-lane striping means a D->D path can wrap around the row
+ * eight times rather than four, so the DD serialization takes up to
+ * 8 passes instead of 4.
+ *
+ * This file is compiled with HMMER_AVX2_CFLAGS. Nothing in it may be
+ * called unless the processor supports AVX2 and FMA.
+ *
+ * Contents:
+ *   1. Forward and Backward parser implementations
+ *   2. Benchmark driver
+ *   3. Unit tests
+ *   4. Test driver
+ */
+#include <p7_config.h>
+#ifdef HMMER_AVX2
+
+#include <stdio.h>
+#include <math.h>
+
+#include <immintrin.h>		/* AVX2, FMA */
+
+#include "easel.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+#include "impl_avx.h"
+
+/*****************************************************************
+ * 1. Forward and Backward parser implementations
+ *****************************************************************/
+
+/* Function:  p7_ForwardParser_avx2()
+ * Synopsis:  AVX2 implementation of <p7_ForwardParser()>.
+ *
+ * Purpose:   Same as <p7_ForwardParser()>: the Forward algorithm for
+ *            sequence <dsq> of length <L> against optimized profile
+ *            <om>, keeping only the special states' values (and sparse
+ *            scale factors) in <ox>, and optionally returning the
+ *            Forward score in nats in <*opt_sc>. <om> must carry AVX2
+ *            scores, and <ox> must have been allocated for them (see
+ *            simd.c).
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small, or if <om>
+ *            has no AVX2 scores.
+ *            <eslERANGE> if the score exceeds the limited range of
+ *            a probability-space odds ratio.
+ *            In either case, <*opt_sc> is undefined.
+ */
+int
+p7_ForwardParser_avx2(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
+{
+  register __m256 mpv, dpv, ipv;   /* previous row values                                       */
+  register __m256 sv;		   /* temp storage of 1 curr row value in progress              */
+  register __m256 dcv;		   /* delayed storage of D(i,q+1)                               */
+  register __m256 xEv;		   /* E state: keeps sum for Mk->E as we go                     */
+  register __m256 xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  __m256   zerov;		   /* splatted 0.0's in a vector                                */
+  float    xN, xE, xB, xC, xJ;	   /* special states' scores                                    */
+  int i;			   /* counter over sequence positions 1..L                      */
+  int q;			   /* counter over vectors 0..nq-1                              */
+  int j;			   /* counter over DD iterations (8 is full serialization)      */
+  int Q       = p7O_NQF_AVX(om->M);/* segment length: # of vectors                              */
+  __m256 *dp  = (__m256 *) ox->dpv;/* the one row, current and previous, {MDI}MO(dp,q) access   */
+  const __m256 *tfv = (const __m256 *) om->tfv_avx;
+  const __m256 *rp;		   /* will point at om->rfv_avx[x] for residue x[i]             */
+  const __m256 *tp;		   /* will point into (and step thru) om->tfv_avx               */
+
+  if (om->rfv_avx == NULL)                                            ESL_EXCEPTION(eslEINVAL, "profile has no AVX2 scores");
+  if ((int64_t) Q * p7X_NSCELLS * sizeof(__m256) > ox->allocV)        ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few columns)");
+#if eslDEBUGLEVEL > 0
+  if (L     >= ox->allocXR)      ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few X rows)");
+  if (! p7_oprofile_IsLocal(om)) ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
+#endif
+
+  /* Initialization. */
+  ox->M  = om->M;
+  ox->L  = L;
+  ox->has_own_scales = TRUE; 	/* all forward matrices control their own scalefactors */
+  zerov  = _mm256_setzero_ps();
+  for (q = 0; q < Q; q++)
+    MMO(dp,q) = IMO(dp,q) = DMO(dp,q) = zerov;
+  xE    = ox->xmx[p7X_E] = 0.;
+  xN    = ox->xmx[p7X_N] = 1.;
+  xJ    = ox->xmx[p7X_J] = 0.;
+  xB    = ox->xmx[p7X_B] = om->xf[p7O_N][p7O_MOVE];
+  xC    = ox->xmx[p7X_C] = 0.;
+
+  ox->xmx[p7X_SCALE] = 1.0;
+  ox->totscale       = 0.0;
+
+  for (i = 1; i <= L; i++)
+    {
+      rp    = (const __m256 *) om->rfv_avx[dsq[i]];
+      tp    = tfv;
+      dcv   = zerov;
+      xEv   = zerov;
+      xBv   = _mm256_set1_ps(xB);
+
+      /* Right shifts by one float; shift zeros on. */
+      mpv   = p7_avx_rightshiftz_ps(MMO(dp,Q-1));
+      dpv   = p7_avx_rightshiftz_ps(DMO(dp,Q-1));
+      ipv   = p7_avx_rightshiftz_ps(IMO(dp,Q-1));
+
+      for (q = 0; q < Q; q++)
+	{
+	  /* Calculate new MMO(i,q); don't store it yet, hold it in sv. */
+	  sv   = _mm256_mul_ps  (xBv, tp[0]);
+	  sv   = _mm256_fmadd_ps(mpv, tp[1], sv);
+	  sv   = _mm256_fmadd_ps(ipv, tp[2], sv);
+	  sv   = _mm256_fmadd_ps(dpv, tp[3], sv);
+	  sv   = _mm256_mul_ps  (sv,  *rp);           rp++;
+	  xEv  = _mm256_add_ps  (xEv, sv);
+
+	  /* Load {MDI}(i-1,q) into mpv, dpv, ipv before the row gets overwritten */
+	  mpv = MMO(dp,q);
+	  dpv = DMO(dp,q);
+	  ipv = IMO(dp,q);
+
+	  /* Do the delayed stores of {MD}(i,q) now that memory is usable */
+	  MMO(dp,q) = sv;
+	  DMO(dp,q) = dcv;
+
+	  /* Calculate the next D(i,q+1) partially: M->D only; delay storage, holding it in dcv */
+	  dcv   = _mm256_mul_ps(sv, tp[4]);
+
+	  /* Calculate and store I(i,q); assumes odds ratio for emission is 1.0 */
+	  IMO(dp,q) = _mm256_fmadd_ps(ipv, tp[6], _mm256_mul_ps(mpv, tp[5]));
+	  tp += 7;
+	}
+
+      /* The DD paths. One complete pass, adding M->D and D->D into DMO(q). */
+      dcv       = p7_avx_rightshiftz_ps(dcv);
+      DMO(dp,0) = zerov;
+      tp        = tfv + 7*Q;	/* set tp to start of the DD's */
+      for (q = 0; q < Q; q++)
+	{
+	  DMO(dp,q) = _mm256_add_ps(dcv, DMO(dp,q));
+	  dcv       = _mm256_mul_ps(DMO(dp,q), *tp); tp++;
+	}
+
+      /* Up to 7 more passes, extending dcv only. As in the SSE
+       * implementation, small models just serialize; larger ones
+       * stop as soon as a pass doesn't change any DMO(q).
+       */
+      if (om->M < 100)
+	{
+	  for (j = 1; j < 8; j++)
+	    {
+	      dcv = p7_avx_rightshiftz_ps(dcv);
+	      tp  = tfv + 7*Q;
+	      for (q = 0; q < Q; q++)
+		{
+		  DMO(dp,q) = _mm256_add_ps(dcv, DMO(dp,q));
+		  dcv       = _mm256_mul_ps(dcv, *tp);   tp++;
+		}
+	    }
+	}
+      else
+	{
+	  for (j = 1; j < 8; j++)
+	    {
+	      register __m256 cv;	/* keeps track of whether any DD's change DMO(q) */
+
+	      dcv = p7_avx_rightshiftz_ps(dcv);
+	      tp  = tfv + 7*Q;
+	      cv  = zerov;
+	      for (q = 0; q < Q; q++)
+		{
+		  sv        = _mm256_add_ps(dcv, DMO(dp,q));
+		  cv        = _mm256_or_ps(cv, _mm256_cmp_ps(sv, DMO(dp,q), _CMP_GT_OQ));
+		  DMO(dp,q) = sv;
+		  dcv       = _mm256_mul_ps(dcv, *tp);   tp++;
+		}
+	      if (! _mm256_movemask_ps(cv)) break;
+	    }
+	}
+
+      /* Add D's to xEv, and sum it: D's contribute to E in Forward */
+      for (q = 0; q < Q; q++) xEv = _mm256_add_ps(DMO(dp,q), xEv);
+      xE = p7_avx_hsum_ps(xEv);
+
+      xN =  xN * om->xf[p7O_N][p7O_LOOP];
+      xC = (xC * om->xf[p7O_C][p7O_LOOP]) +  (xE * om->xf[p7O_E][p7O_MOVE]);
+      xJ = (xJ * om->xf[p7O_J][p7O_LOOP]) +  (xE * om->xf[p7O_E][p7O_LOOP]);
+      xB = (xJ * om->xf[p7O_J][p7O_MOVE]) +  (xN * om->xf[p7O_N][p7O_MOVE]);
+
+      /* Sparse rescaling, same trigger as the SSE implementation. */
+      if (xE > 1.0e4)
+	{
+	  xN  = xN / xE;
+	  xC  = xC / xE;
+	  xJ  = xJ / xE;
+	  xB  = xB / xE;
+	  xEv = _mm256_set1_ps(1.0 / xE);
+	  for (q = 0; q < Q; q++)
+	    {
+	      MMO(dp,q) = _mm256_mul_ps(MMO(dp,q), xEv);
+	      DMO(dp,q) = _mm256_mul_ps(DMO(dp,q), xEv);
+	      IMO(dp,q) = _mm256_mul_ps(IMO(dp,q), xEv);
+	    }
+	  ox->xmx[i*p7X_NXCELLS+p7X_SCALE] = xE;
+	  ox->totscale += log(xE);
+	  xE = 1.0;
+	}
+      else ox->xmx[i*p7X_NXCELLS+p7X_SCALE] = 1.0;
+
+      ox->xmx[i*p7X_NXCELLS+p7X_E] = xE;
+      ox->xmx[i*p7X_NXCELLS+p7X_N] = xN;
+      ox->xmx[i*p7X_NXCELLS+p7X_J] = xJ;
+      ox->xmx[i*p7X_NXCELLS+p7X_B] = xB;
+      ox->xmx[i*p7X_NXCELLS+p7X_C] = xC;
+    } /* end loop over sequence residues 1..L */
+
+  /* finally C->T, and flip total score back to log space (nats) */
+  if       (isnan(xC))        ESL_EXCEPTION(eslERANGE, "forward score is NaN");
+  else if  (L>0 && xC == 0.0) ESL_EXCEPTION(eslERANGE, "forward score underflow (is 0.0)");
+  else if  (isinf(xC) == 1)   ESL_EXCEPTION(eslERANGE, "forward score overflow (is infinity)");
+
+  if (opt_sc != NULL) *opt_sc = ox->totscale + log(xC * om->xf[p7O_C][p7O_MOVE]);
+  return eslOK;
+}
+
+
+/* Function:  p7_BackwardParser_avx2()
+ * Synopsis:  AVX2 implementation of <p7_BackwardParser()>.
+ *
+ * Purpose:   Same as <p7_BackwardParser()>: the Backward algorithm for
+ *            <dsq> of length <L> against <om>, using the sparse scale
+ *            factors of Forward matrix <fwd>, keeping only the special
+ *            states' values in <bck>, and optionally returning the
+ *            Backward score in nats in <*opt_sc>. <fwd> may have been
+ *            calculated by either the SSE or the AVX2 Forward parser.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <bck> allocation is too small, or if <om>
+ *            has no AVX2 scores.
+ *            <eslERANGE> if the score exceeds the limited range of
+ *            a probability-space odds ratio.
+ *            In either case, <*opt_sc> is undefined.
+ */
+int
+p7_BackwardParser_avx2(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
+{
+  register __m256 mpv, ipv, dpv;      /* previous row values                                       */
+  register __m256 mcv, dcv;           /* current row values                                        */
+  register __m256 tmmv, timv, tdmv;   /* tmp vars for accessing rotated transition scores          */
+  register __m256 xBv;		      /* collects B->Mk components of B(i)                         */
+  register __m256 xEv;	              /* splatted E(i)                                             */
+  __m256   zerov;		      /* splatted 0.0's in a vector                                */
+  __m256   sv, cv;                    /* DD convergence test, as in Forward                        */
+  float    xN, xE, xB, xC, xJ;	      /* special states' scores                                    */
+  int      i;			      /* counter over sequence positions 0,1..L                    */
+  int      q;			      /* counter over vectors 0..Q-1                               */
+  int      Q       = p7O_NQF_AVX(om->M);  /* segment length: # of vectors                          */
+  int      j;			      /* DD segment iteration counter (8 = full serialization)     */
+  __m256  *dp      = (__m256 *) bck->dpv; /* the one row, current and next                         */
+  const __m256 *tfv = (const __m256 *) om->tfv_avx;
+  const __m256 *rp;		      /* will point into om->rfv_avx[x] for residue x[i+1]         */
+  const __m256 *tp;	              /* will point into (and step thru) om->tfv_avx               */
+
+  if (om->rfv_avx == NULL)                                            ESL_EXCEPTION(eslEINVAL, "profile has no AVX2 scores");
+  if ((int64_t) Q * p7X_NSCELLS * sizeof(__m256) > bck->allocV)       ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few columns)");
+#if eslDEBUGLEVEL > 0
+  if (L     >= bck->allocXR)      ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few X rows)");
+  if (L     != fwd->L)            ESL_EXCEPTION(eslEINVAL, "fwd matrix size doesn't agree with length L");
+  if (! p7_oprofile_IsLocal(om))  ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
+#endif
+
+  /* initialize the L row. */
+  bck->M = om->M;
+  bck->L = L;
+  bck->has_own_scales = FALSE;	/* backwards scale factors are *usually* given by <fwd> */
+  xJ     = 0.0;
+  xB     = 0.0;
+  xN     = 0.0;
+  xC     = om->xf[p7O_C][p7O_MOVE];      /* C<-T */
+  xE     = xC * om->xf[p7O_E][p7O_MOVE]; /* E<-C, no tail */
+  xEv    = _mm256_set1_ps(xE);
+  zerov  = _mm256_setzero_ps();
+  dcv    = zerov;
+  for (q = 0; q < Q; q++) MMO(dp,q) = DMO(dp,q) = xEv;
+  for (q = 0; q < Q; q++) IMO(dp,q) = zerov;
+
+  /* init row L's DD paths, 1) first segment includes xE, from DMO(q) */
+  tp  = tfv + 8*Q - 1;	                        /* <*tp> now the TDD vector for q=Q-1 */
+  dpv = p7_avx_leftshiftz_ps(DMO(dp,Q-1));
+  for (q = Q-1; q >= 0; q--)
+    {
+      dcv       = _mm256_mul_ps(dpv, *tp);      tp--;
+      DMO(dp,q) = _mm256_add_ps(DMO(dp,q), dcv);
+      dpv       = DMO(dp,q);
+    }
+  /* 2) seven more passes, only extending DD component */
+  for (j = 1; j < 8; j++)
+    {
+      tp  = tfv + 8*Q - 1;
+      dcv = p7_avx_leftshiftz_ps(dcv);
+      for (q = Q-1; q >= 0; q--)
+	{
+	  dcv       = _mm256_mul_ps(dcv, *tp); tp--;
+	  DMO(dp,q) = _mm256_add_ps(DMO(dp,q), dcv);
+	}
+    }
+  /* now MD init */
+  tp  = tfv + 7*Q - 3;	                        /* <*tp> now the Mk->Dk+1 vector for q=Q-1 */
+  dcv = p7_avx_leftshiftz_ps(DMO(dp,0));
+  for (q = Q-1; q >= 0; q--)
+    {
+      MMO(dp,q) = _mm256_fmadd_ps(dcv, *tp, MMO(dp,q)); tp -= 7;
+      dcv       = DMO(dp,q);
+    }
+
+  /* Sparse rescaling: same scale factors as fwd matrix */
+  if (fwd->xmx[L*p7X_NXCELLS+p7X_SCALE] > 1.0)
+    {
+      xE  = xE / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xN  = xN / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xC  = xC / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xJ  = xJ / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xB  = xB / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xEv = _mm256_set1_ps(1.0 / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE]);
+      for (q = 0; q < Q; q++) {
+	MMO(dp,q) = _mm256_mul_ps(MMO(dp,q), xEv);
+	DMO(dp,q) = _mm256_mul_ps(DMO(dp,q), xEv);
+	IMO(dp,q) = _mm256_mul_ps(IMO(dp,q), xEv);
+      }
+    }
+  bck->xmx[L*p7X_NXCELLS+p7X_SCALE] = fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+  bck->totscale                     = log(bck->xmx[L*p7X_NXCELLS+p7X_SCALE]);
+
+  bck->xmx[L*p7X_NXCELLS+p7X_E] = xE;
+  bck->xmx[L*p7X_NXCELLS+p7X_N] = xN;
+  bck->xmx[L*p7X_NXCELLS+p7X_J] = xJ;
+  bck->xmx[L*p7X_NXCELLS+p7X_B] = xB;
+  bck->xmx[L*p7X_NXCELLS+p7X_C] = xC;
+
+  /* main recursion */
+  for (i = L-1; i >= 1; i--)	/* backwards stride */
+    {
+      /* phase 1. B(i) collected. Old row destroyed, new row contains
+       *    complete I(i,k), partial {MD}(i,k) w/ no {MD}->{DE} paths yet.
+       */
+      rp  = (const __m256 *) om->rfv_avx[dsq[i+1]] + Q-1; /* <*rp> is now the match emission vector for q=Q-1 */
+      tp  = tfv + 7*Q - 1;	                           /* <*tp> is now the TII vector for q=Q-1           */
+
+      /* leftshift the first transition vectors */
+      tmmv = p7_avx_leftshiftz_ps(tfv[1]);
+      timv = p7_avx_leftshiftz_ps(tfv[2]);
+      tdmv = p7_avx_leftshiftz_ps(tfv[3]);
+
+      mpv = _mm256_mul_ps(MMO(dp,0), ((const __m256 *) om->rfv_avx[dsq[i+1]])[0]); /* precalc M(i+1,k+1) * e(M_k+1, x_{i+1}) */
+      mpv = p7_avx_leftshiftz_ps(mpv);
+
+      xBv = zerov;
+      for (q = Q-1; q >= 0; q--)     /* backwards stride */
+	{
+	  ipv = IMO(dp,q); /* assumes emission odds ratio of 1.0; i+1's IMO(q) now free */
+	  IMO(dp,q) = _mm256_fmadd_ps(ipv, *tp, _mm256_mul_ps(mpv, timv));   tp--;
+	  DMO(dp,q) =                           _mm256_mul_ps(mpv, tdmv);
+	  mcv       = _mm256_fmadd_ps(ipv, *tp, _mm256_mul_ps(mpv, tmmv));   tp-= 2;
+
+	  mpv       = _mm256_mul_ps(MMO(dp,q), *rp);  rp--;  /* obtain mpv for next q. i+1's MMO(q) is freed  */
+	  MMO(dp,q) = mcv;
+
+	  tdmv = *tp;   tp--;
+	  timv = *tp;   tp--;
+	  tmmv = *tp;   tp--;
+
+	  xBv = _mm256_fmadd_ps(mpv, *tp, xBv); tp--;
+	}
+
+      /* phase 2: now that we have accumulated the B->Mk transitions in xBv, we can do the specials */
+      xB = p7_avx_hsum_ps(xBv);
+
+      xC =  xC * om->xf[p7O_C][p7O_LOOP];
+      xJ = (xB * om->xf[p7O_J][p7O_MOVE]) + (xJ * om->xf[p7O_J][p7O_LOOP]); /* must come after xB */
+      xN = (xB * om->xf[p7O_N][p7O_MOVE]) + (xN * om->xf[p7O_N][p7O_LOOP]); /* must come after xB */
+      xE = (xC * om->xf[p7O_E][p7O_MOVE]) + (xJ * om->xf[p7O_E][p7O_LOOP]); /* must come after xJ, xC */
+      xEv = _mm256_set1_ps(xE);	/* splat */
+
+      /* phase 3: {MD}->E paths and one step of the D->D paths */
+      tp  = tfv + 8*Q - 1;	/* <*tp> now the TDD vector for q=Q-1 */
+      dpv = p7_avx_leftshiftz_ps(_mm256_add_ps(DMO(dp,0), xEv));
+      for (q = Q-1; q >= 0; q--)
+	{
+	  dcv       = _mm256_mul_ps(dpv, *tp); tp--;
+	  DMO(dp,q) = _mm256_add_ps(DMO(dp,q), _mm256_add_ps(dcv, xEv));
+	  dpv       = DMO(dp,q);
+	  MMO(dp,q) = _mm256_add_ps(MMO(dp,q), xEv);
+	}
+
+      /* phase 4: finish extending the DD paths; seven more passes at
+       * most. Small models serialize fully; larger ones stop when a
+       * pass doesn't change any DMO(q), as in Forward.
+       */
+      for (j = 1; j < 8; j++)
+	{
+	  dcv = p7_avx_leftshiftz_ps(dcv);
+	  tp  = tfv + 8*Q - 1;
+	  cv  = zerov;
+	  for (q = Q-1; q >= 0; q--)
+	    {
+	      dcv       = _mm256_mul_ps(dcv, *tp); tp--;
+	      sv        = _mm256_add_ps(DMO(dp,q), dcv);
+	      cv        = _mm256_or_ps(cv, _mm256_cmp_ps(sv, DMO(dp,q), _CMP_GT_OQ));
+	      DMO(dp,q) = sv;
+	    }
+	  if (om->M >= 100 && ! _mm256_movemask_ps(cv)) break;
+	}
+
+      /* phase 5: add M->D paths */
+      dcv = p7_avx_leftshiftz_ps(DMO(dp,0));
+      tp  = tfv + 7*Q - 3;	/* <*tp> is now the Mk->Dk+1 vector for q=Q-1 */
+      for (q = Q-1; q >= 0; q--)
+	{
+	  MMO(dp,q) = _mm256_fmadd_ps(dcv, *tp, MMO(dp,q)); tp -= 7;
+	  dcv       = DMO(dp,q);
+	}
+
+      /* Sparse rescaling; see fwdback.c for when we use our own scale factors [J3/119] */
+      if (xB > 1.0e16) bck->has_own_scales = TRUE;
+
+      if      (bck->has_own_scales)  bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = (xB > 1.0e4) ? xB : 1.0;
+      else                           bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = fwd->xmx[i*p7X_NXCELLS+p7X_SCALE];
+
+      if (bck->xmx[i*p7X_NXCELLS+p7X_SCALE] > 1.0)
+	{
+	  xE /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xN /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xJ /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xB /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xC /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xBv = _mm256_set1_ps(1.0 / bck->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+	  for (q = 0; q < Q; q++) {
+	    MMO(dp,q) = _mm256_mul_ps(MMO(dp,q), xBv);
+	    DMO(dp,q) = _mm256_mul_ps(DMO(dp,q), xBv);
+	    IMO(dp,q) = _mm256_mul_ps(IMO(dp,q), xBv);
+	  }
+	  bck->totscale += log(bck->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+	}
+
+      bck->xmx[i*p7X_NXCELLS+p7X_E] = xE;
+      bck->xmx[i*p7X_NXCELLS+p7X_N] = xN;
+      bck->xmx[i*p7X_NXCELLS+p7X_J] = xJ;
+      bck->xmx[i*p7X_NXCELLS+p7X_B] = xB;
+      bck->xmx[i*p7X_NXCELLS+p7X_C] = xC;
+    } /* thus ends the loop over sequence positions i */
+
+  /* Termination at i=0, where we can only reach N,B states. */
+  tp  = tfv;                                       /* <*tp> is now the TBMk vector for q=0  */
+  rp  = (const __m256 *) om->rfv_avx[dsq[1]];      /* <*rp> is now the match emission for q=0 */
+  xBv = zerov;
+  for (q = 0; q < Q; q++)
+    {
+      mpv = _mm256_mul_ps(MMO(dp,q), *rp);  rp++;
+      xBv = _mm256_fmadd_ps(mpv, *tp, xBv); tp += 7;
+    }
+  xB = p7_avx_hsum_ps(xBv);
+
+  xN = (xB * om->xf[p7O_N][p7O_MOVE]) + (xN * om->xf[p7O_N][p7O_LOOP]);
+
+  bck->xmx[p7X_B]     = xB;
+  bck->xmx[p7X_C]     = 0.0;
+  bck->xmx[p7X_J]     = 0.0;
+  bck->xmx[p7X_N]     = xN;
+  bck->xmx[p7X_E]     = 0.0;
+  bck->xmx[p7X_SCALE] = 1.0;
+
+  if       (isnan(xN))        ESL_EXCEPTION(eslERANGE, "backward score is NaN");
+  else if  (L>0 && xN == 0.0) ESL_EXCEPTION(eslERANGE, "backward score underflow (is 0.0)");
+  else if  (isinf(xN) == 1)   ESL_EXCEPTION(eslERANGE, "backward score overflow (is infinity)");
+
+  if (opt_sc != NULL) *opt_sc = bck->totscale + log(xN);
+  return eslOK;
+}
+/*----------------- end, forward/backward parsers ---------------*/
+
+
+
+
+/*****************************************************************
+ * 2. Benchmark driver.
+ *****************************************************************/
+#ifdef p7FWDBACK_AVX2_BENCHMARK
+/*
+   ./fwdback_avx2_benchmark <hmmfile>          runs benchmark on both Forward and Backward parser
+   ./fwdback_avx2_benchmark -c -N100 <hmmfile> compare scores to SSE parsers
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-c",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "compare scores to SSE implementation (debug)",     0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",        eslARG_INT,    "400", NULL, "n>0", NULL,  NULL, NULL, "length of random target seqs",                     0 },
+  { "-N",        eslARG_INT,  "50000", NULL, "n>0", NULL,  NULL, NULL, "number of random target seqs",                     0 },
+  { "-F",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, "-B", "only benchmark Forward",                           0 },
+  { "-B",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, "-F", "only benchmark Backward",                          0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <hmmfile>";
+static char banner[] = "benchmark driver for AVX2 Forward, Backward parser implementations";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *hmmfile = esl_opt_GetArg(go, 1);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc     = NULL;
+  P7_HMMFILE     *hfp     = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_BG          *bg      = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_OMX         *fwd     = NULL;
+  P7_OMX         *bck     = NULL;
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  ESL_DSQ        *dsq     = malloc(sizeof(ESL_DSQ) * (L+2));
+  int             i;
+  float           fsc, bsc;
+  float           fsc2, bsc2;
+  double          base_time, bench_time, Mcs;
+
+  if (p7_simd_Level() < p7_SIMD_AVX2) p7_Fail("AVX2 isn't supported by this processor (or is disabled by HMMER_SIMD)");
+
+  if (p7_hmmfile_Open(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
+  if (p7_hmmfile_Read(hfp, &abc, &hmm)           != eslOK) p7_Fail("Failed to read HMM");
+
+  bg = p7_bg_Create(abc);
+  p7_bg_SetLength(bg, L);
+  gm = p7_profile_Create(hmm->M, abc);
+  p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+  om = p7_oprofile_Create(gm->M, abc);
+  p7_oprofile_Convert(gm, om);
+  p7_oprofile_ReconfigLength(om, L);
+
+  fwd = p7_omx_Create(gm->M, 0, L);
+  bck = p7_omx_Create(gm->M, 0, L);
+
+  /* Get a baseline time: how long it takes just to generate the sequences */
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++) esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+  esl_stopwatch_Stop(w);
+  base_time = w->user;
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+      if (! esl_opt_GetBoolean(go, "-B"))  p7_ForwardParser_avx2 (dsq, L, om,      fwd, &fsc);
+      if (! esl_opt_GetBoolean(go, "-F"))  p7_BackwardParser_avx2(dsq, L, om, fwd, bck, &bsc);
+
+      if (esl_opt_GetBoolean(go, "-c"))
+	{
+	  p7_ForwardParser_sse (dsq, L, om,      fwd, &fsc2);
+	  p7_BackwardParser_sse(dsq, L, om, fwd, bck, &bsc2);
+	  printf("%.4f %.4f %.4f %.4f\n", fsc, bsc, fsc2, bsc2);
+	}
+    }
+  esl_stopwatch_Stop(w);
+  bench_time = w->user - base_time;
+  Mcs        = (double) N * (double) L * (double) gm->M * 1e-6 / (double) bench_time;
+  esl_stopwatch_Display(stdout, w, "# CPU time: ");
+  printf("# M    = %d\n",   gm->M);
+  printf("# %.1f Mc/s\n", Mcs);
+
+  free(dsq);
+  p7_omx_Destroy(bck);
+  p7_omx_Destroy(fwd);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  p7_hmmfile_Close(hfp);
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7FWDBACK_AVX2_BENCHMARK*/
+/*------------------- end, benchmark driver ---------------------*/
+
+
+
+
+/*****************************************************************
+ * 3. Unit tests
+ *****************************************************************/
+#ifdef p7FWDBACK_AVX2_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* utest_parsers()
+ * The AVX2 parsers must agree with the SSE ones: same scores, and
+ * the same special state values for posterior decoding, to within
+ * float roundoff. Forward and Backward must agree with each other,
+ * and with generic Forward within the tolerance of p7_FLogsum().
+ */
+static void
+utest_parsers(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char        *msg  = "avx2 forward/backward parser unit test failed";
+  P7_HMM      *hmm  = NULL;
+  P7_PROFILE  *gm   = NULL;
+  P7_OPROFILE *om   = NULL;
+  ESL_DSQ     *dsq  = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *fwd1 = p7_omx_Create(M, 0, L);
+  P7_OMX      *bck1 = p7_omx_Create(M, 0, L);
+  P7_OMX      *fwd2 = p7_omx_Create(M, 0, L);
+  P7_OMX      *bck2 = p7_omx_Create(M, 0, L);
+  P7_GMX      *gx   = p7_gmx_Create(M, L);
+  float tolerance;
+  float fsc1, fsc2;
+  float bsc1, bsc2;
+  float generic_sc;
+  int   i, s;
+
+  p7_FLogsumInit();
+  if (p7_FLogsumError(-0.4, -0.5) > 0.0001) tolerance = 1.0;  /* weaker test against GForward()   */
+  else tolerance = 0.0001;   /* stronger test: FLogsum() is in slow exact mode. */
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+
+      p7_ForwardParser_sse  (dsq, L, om, fwd1,       &fsc1);
+      p7_BackwardParser_sse (dsq, L, om, fwd1, bck1, &bsc1);
+      p7_ForwardParser_avx2 (dsq, L, om, fwd2,       &fsc2);
+      p7_BackwardParser_avx2(dsq, L, om, fwd2, bck2, &bsc2);
+      p7_GForward           (dsq, L, gm, gx,         &generic_sc);
+
+      if (fabs(fsc2-bsc2) > 0.0001)          esl_fatal(msg);
+      if (fabs(fsc1-fsc2) > 0.0001)          esl_fatal(msg);
+      if (fabs(bsc1-bsc2) > 0.0001)          esl_fatal(msg);
+      if (fabs(fsc2-generic_sc) > tolerance) esl_fatal(msg);
+
+      /* specials and scale factors, relative to their magnitude */
+      for (i = 0; i <= L; i++)
+	for (s = 0; s < p7X_NXCELLS; s++)
+	  {
+	    if (esl_FCompare(fwd1->xmx[i*p7X_NXCELLS+s], fwd2->xmx[i*p7X_NXCELLS+s], 0.001, 1e-30) != eslOK) esl_fatal(msg);
+	    if (esl_FCompare(bck1->xmx[i*p7X_NXCELLS+s], bck2->xmx[i*p7X_NXCELLS+s], 0.001, 1e-30) != eslOK) esl_fatal(msg);
+	  }
+    }
+
+  free(dsq);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(bck2);
+  p7_omx_Destroy(fwd2);
+  p7_omx_Destroy(bck1);
+  p7_omx_Destroy(fwd1);
+  p7_gmx_Destroy(gx);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+#endif /*p7FWDBACK_AVX2_TESTDRIVE*/
+/*---------------------- end, unit tests ------------------------*/
+
+
+
+
+/*****************************************************************
+ * 4. Test driver
+ *****************************************************************/
+#ifdef p7FWDBACK_AVX2_TESTDRIVE
+/*
+   ./fwdback_avx2_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "size of random sequences to sample",             0 },
+  { "-M",        eslARG_INT,    "145", NULL, NULL,  NULL,  NULL, NULL, "size of random models to sample",                0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for AVX2 Forward, Backward parser implementations";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  /* Nothing to test if this processor can't run AVX2 */
+  if (p7_simd_Level() < p7_SIMD_AVX2) {
+    if (esl_opt_GetBoolean(go, "-v")) printf("AVX2 not supported by this processor; skipping tests\n");
+    esl_getopts_Destroy(go);
+    esl_randomness_Destroy(r);
+    return eslOK;
+  }
+
+  /* First round of tests for DNA alphabets.  */
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("ForwardParser_avx2(), BackwardParser_avx2() tests, DNA\n");
+  utest_parsers(r, abc, bg, M, L, N);   /* normal sized models */
+  utest_parsers(r, abc, bg, 1, L, 10);  /* size 1 models       */
+  utest_parsers(r, abc, bg, M, 1, 10);  /* size 1 sequences    */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  /* Second round of tests for amino alphabets.  */
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("ForwardParser_avx2(), BackwardParser_avx2() tests, protein\n");
+  utest_parsers(r, abc, bg, M,   L, N);
+  utest_parsers(r, abc, bg, 1,   L, 10);
+  utest_parsers(r, abc, bg, M,   1, 10);
+  utest_parsers(r, abc, bg, 9,   L, 10);  /* crosses one 8-lane vector          */
+  utest_parsers(r, abc, bg, 400, L, 10);  /* large enough for the DD early exit */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7FWDBACK_AVX2_TESTDRIVE*/
+/*--------------------- end, test driver ------------------------*/
+
+
+
+#else /*! HMMER_AVX2*/
+/* Provide a test driver that trivially passes, so `make check` works
+ * the same whether or not AVX2 kernels were configured in.
+ */
+#ifdef p7FWDBACK_AVX2_TESTDRIVE
+int main(void) { return 0; }
+#endif
+void p7_fwdback_avx2_silence_hack(void) { return; }
+#endif /*HMMER_AVX2 or not*/
@@ -0,0 +1,159 @@
+/* Inline vector utilities shared by the optional AVX2 and AVX-512
+ * kernels that accompany the SSE implementation (msvfilter_avx2.c,
+ * ssvfilter_avx2.c, fwdback_avx2.c, vitfilter_avx512.c).
+ *
+ * Each section is only visible to files compiled with the matching
+ * HMMER_AVX2_CFLAGS or HMMER_AVX512_CFLAGS, and nothing in it may be
+ * called before the caller has made sure the processor supports
+ * that instruction set.
+ *
+ * Contents:
+ *   1. 256-bit (AVX2) uchar utilities
+ *   2. 256-bit (AVX2) float utilities
+ *   3. 512-bit (AVX-512BW) sword utilities
+ */
+#ifndef P7_IMPL_AVX_INCLUDED
+#define P7_IMPL_AVX_INCLUDED
+
+#include <immintrin.h>
+
+#if defined(HMMER_AVX2) && defined(__AVX2__)
+
+/*****************************************************************
+ * 1. 256-bit (AVX2) uchar utilities
+ *****************************************************************/
+
+/* Function:  p7_avx_leftshift_one()
+ * Synopsis:  Shift a 256-bit vector up by one byte, across lanes.
+ *
+ * Purpose:   Returns <v> shifted up by one byte position, with a zero
+ *            shifted in at element 0: [a b c .. z] becomes
+ *            [0 a b .. y]. This is the striped DP "rightshift" of
+ *            _mm_slli_si128(v, 1) in the SSE filters; unlike
+ *            _mm256_slli_si256(), it carries byte 15 across the
+ *            128-bit lane boundary.
+ */
+static inline __m256i
+p7_avx_leftshift_one(__m256i v)
+{
+  /* 0x08 selects [zero, low lane of v]; alignr then takes the top byte of each lane of that */
+  return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(v, v, 0x08), 15);
+}
+
+/* Function:  p7_avx_hmax_epu8()
+ * Synopsis:  Return the maximum of 32 unsigned bytes in a vector.
+ */
+static inline uint8_t
+p7_avx_hmax_epu8(__m256i v)
+{
+  __m128i t = _mm_max_epu8(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+
+  t = _mm_max_epu8(t, _mm_srli_si128(t, 8));
+  t = _mm_max_epu8(t, _mm_srli_si128(t, 4));
+  t = _mm_max_epu8(t, _mm_srli_si128(t, 2));
+  t = _mm_max_epu8(t, _mm_srli_si128(t, 1));
+  return (uint8_t) (_mm_extract_epi16(t, 0) & 0xff);
+}
+
+
+
+/*****************************************************************
+ * 2. 256-bit (AVX2) float utilities
+ *****************************************************************/
+
+/* Function:  p7_avx_rightshiftz_ps()
+ * Synopsis:  Shift a vector of 8 floats up by one element, shifting in a zero.
+ *
+ * Purpose:   Returns <v> shifted so [a b c d e f g h] becomes
+ *            [0 a b c d e f g]: the 8-lane version of
+ *            <esl_sse_rightshiftz_float()>.
+ */
+static inline __m256
+p7_avx_rightshiftz_ps(__m256 v)
+{
+  const __m256i idx = _mm256_set_epi32(6, 5, 4, 3, 2, 1, 0, 7);
+  return _mm256_blend_ps(_mm256_permutevar8x32_ps(v, idx), _mm256_setzero_ps(), 0x01);
+}
+
+/* Function:  p7_avx_leftshiftz_ps()
+ * Synopsis:  Shift a vector of 8 floats down by one element, shifting in a zero.
+ *
+ * Purpose:   Returns <v> shifted so [a b c d e f g h] becomes
+ *            [b c d e f g h 0]: the 8-lane version of the
+ *            <_mm_move_ss()>, <_mm_shuffle_ps()> pair in the SSE
+ *            Backward implementation.
+ */
+static inline __m256
+p7_avx_leftshiftz_ps(__m256 v)
+{
+  const __m256i idx = _mm256_set_epi32(0, 7, 6, 5, 4, 3, 2, 1);
+  return _mm256_blend_ps(_mm256_permutevar8x32_ps(v, idx), _mm256_setzero_ps(), 0x80);
+}
+
+/* Function:  p7_avx_hsum_ps()
+ * Synopsis:  Return the sum of the 8 floats in a vector.
+ */
+static inline float
+p7_avx_hsum_ps(__m256 v)
+{
+  __m128 t = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+
+  t = _mm_add_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 3, 2, 1)));
+  t = _mm_add_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 3, 2)));
+  return _mm_cvtss_f32(t);
+}
+#endif /*HMMER_AVX2*/
+
+
+
+#if defined(HMMER_AVX512) && defined(__AVX512BW__)
+/*****************************************************************
+ * 3. 512-bit (AVX-512BW) sword utilities
+ *****************************************************************/
+
+/* Function:  p7_avx512_leftshift_epi16()
+ * Synopsis:  Shift a 512-bit vector of swords up by one element.
+ *
+ * Purpose:   Returns <v> shifted up by one 16-bit element, with
+ *            <fill> shifted in at element 0: [a b c .. z] becomes
+ *            [fill a b .. y]. This is the striped DP "rightshift" that
+ *            the SSE Viterbi filter does with _mm_slli_si128(v, 2)
+ *            and an OR of -32768; there's no byte shift across all
+ *            four 128-bit lanes of a 512-bit vector, so use a word
+ *            permute, with element 0 masked in from <fill>.
+ */
+static inline __m512i
+p7_avx512_leftshift_epi16(__m512i v, __m512i fill)
+{
+  const __m512i idx = _mm512_set_epi16(30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15,
+                                       14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0);
+  return _mm512_mask_permutexvar_epi16(fill, (__mmask32) 0xfffffffe, idx, v);
+}
+
+/* Function:  p7_avx512_hmax_epi16()
+ * Synopsis:  Return the maximum of 32 signed swords in a vector.
+ */
+static inline int16_t
+p7_avx512_hmax_epi16(__m512i v)
+{
+  __m256i h = _mm256_max_epi16(_mm512_castsi512_si256(v), _mm512_extracti64x4_epi64(v, 1));
+  __m128i t = _mm_max_epi16(_mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+
+  /* shuffles, not byte shifts: shifted-in zeros would beat negative scores */
+  t = _mm_max_epi16(t, _mm_shuffle_epi32(t, _MM_SHUFFLE(1, 0, 3, 2)));
+  t = _mm_max_epi16(t, _mm_shuffle_epi32(t, _MM_SHUFFLE(2, 3, 0, 1)));
+  t = _mm_max_epi16(t, _mm_shufflelo_epi16(t, _MM_SHUFFLE(2, 3, 0, 1)));
+  return (int16_t) _mm_extract_epi16(t, 0);
+}
+
+/* Function:  p7_avx512_any_gt_epi16()
+ * Synopsis:  Returns TRUE if any a[z] > b[z].
+ */
+static inline int
+p7_avx512_any_gt_epi16(__m512i a, __m512i b)
+{
+  return (_mm512_cmpgt_epi16_mask(a, b) != 0);
+}
+#endif /*HMMER_AVX512*/
+
+#endif /*P7_IMPL_AVX_INCLUDED*/
@@ -27,6 +27,37 @@
 
 #define p7O_EXTRA_SB 17    /* see ssvfilter.c for explanation */
 
+/* The optional AVX2 filters (HMMER_AVX2) use their own, wider striping
+ * of the same MSV scores: 32 uchars per 256-bit vector; and the AVX2
+ * Forward/Backward parsers, of the same float scores: 8 per vector.
+ */
+#define p7O_NQB_AVX(M) ( ESL_MAX(2, ((((M)-1) / 32) + 1)))   /* 32 uchars  */
+#define p7O_NQF_AVX(M) ( ESL_MAX(2, ((((M)-1) / 8)  + 1)))   /*  8 floats  */
+
+/* Likewise the optional AVX-512BW Viterbi filter (HMMER_AVX512):
+ * 32 words per 512-bit vector.
+ */
+#define p7O_NQW_AVX512(M) ( ESL_MAX(2, ((((M)-1) / 32) + 1)))   /* 32 words   */
+
+/* The inter-sequence SSV filter (p7_SSVFilter_Batch()) runs one target
+ * sequence per byte lane instead of striping the model. Its cost grows
+ * with M where the striped filter's stays flat up to one vector, so it
+ * only pays off for very short queries: M <= p7O_ISSV_MAXM.
+ */
+#define p7O_ISSV_LANES 32     /* sequences per batch: uchars in a 256-bit vector    */
+#define p7O_ISSV_MAXM  32     /* longest query it's used (and allocated) for       */
+
+/* The multi-model SSV filter (p7_SSVFilter_Pack()) goes the other way,
+ * for scans: one query sequence against a P7_OM_PACK of up to
+ * p7O_PACK_LANES profiles, one per byte lane, in a single pass. A pack
+ * costs more to make than one scan saves, so it's for profiles that
+ * stay in memory (P7_HMMCACHE), and beats the striped filter only for
+ * short ones.
+ */
+#define p7O_PACK_LANES 32     /* profiles per pack: uchars in a 256-bit vector      */
+#define p7O_PACK_BAND  8      /* model positions held in registers at a time        */
+#define p7O_PACK_MAXM  100    /* longest profile worth packing                      */
+
 
 /*****************************************************************
  * 1. P7_OPROFILE: an optimized score profile
@@ -83,6 +114,11 @@ typedef struct p7_oprofile_s {
   uint8_t   base_b;            /* typically +190: offset of uchar scores            */
   uint8_t   bias_b;    /* positive bias to emission scores, make them >=0   */
 
+  /* AVX2 MSV/SSV filters: the same scores, restriped 32x; NULL unless HMMER_AVX2    */
+  uint8_t **rbv_avx;           /* [x][q*32+z]: rbv restriped to p7O_NQB_AVX(M)     */
+  int8_t  **sbv_avx;           /* [x][q*32+z]: sbv restriped, +p7O_EXTRA_SB vecs   */
+  int8_t   *sbv_isq;           /* [(k-1)*64+j]: sbv by position, for batch SSV     */
+
   /* ViterbiFilter uses scaled swords: 8x signed 16-bit integer vectors              */
   __m128i **rwv;    /* [x][q]: rw, rw[0] are allocated  [Kp][Q8]         */
   __m128i  *twv;    /* transition score blocks          [8*Q8]           */
@@ -92,11 +128,19 @@ typedef struct p7_oprofile_s {
   int16_t   ddbound_w;    /* threshold precalculated for lazy DD evaluation    */
   float     ncj_roundoff;  /* missing precision on NN,CC,JJ after rounding      */
 
+  /* AVX-512BW ViterbiFilter: the same scores, restriped 32x; NULL unless HMMER_AVX512 */
+  int16_t **rwv_avx512;        /* [x][q*32+z]: rwv restriped to p7O_NQW_AVX512(M)  */
+  int16_t  *twv_avx512;        /* [(q*7+t)*32+z], DD's at [(7*Q+q)*32+z]: twv      */
+
   /* Forward, Backward use IEEE754 single-precision floats: 4x vectors               */
   __m128 **rfv;         /* [x][q]:  rf, rf[0] are allocated [Kp][Q4]         */
   __m128  *tfv;          /* transition probability blocks    [8*Q4]           */
   float    xf[p7O_NXSTATES][p7O_NXTRANS]; /* NECJ transition costs                   */
 
+  /* AVX2 Forward/Backward parsers: the same scores, restriped 8x; NULL unless HMMER_AVX2 */
+  float  **rfv_avx;            /* [x][q*8+z]: rfv restriped to p7O_NQF_AVX(M)      */
+  float   *tfv_avx;            /* [(q*7+t)*8+z], DD's at [(7*Q+q)*8+z]: tfv        */
+
   /* Our actual vector mallocs, before we align the memory                           */
   __m128i  *rbv_mem;
   __m128i  *sbv_mem;
@@ -104,7 +148,14 @@ typedef struct p7_oprofile_s {
   __m128i  *twv_mem;
   __m128   *tfv_mem;
   __m128   *rfv_mem;
-  
+  void     *rbv_avx_mem;
+  void     *sbv_avx_mem;
+  void     *sbv_isq_mem;
+  void     *rwv_avx512_mem;
+  void     *twv_avx512_mem;
+  void     *rfv_avx_mem;
+  void     *tfv_avx_mem;
+
   /* Disk offset information for hmmpfam's fast model retrieval                      */
   off_t  offs[p7_NOFFSETS];     /* p7_{MFP}OFFSET, or -1                             */
 
@@ -133,6 +184,9 @@ typedef struct p7_oprofile_s {
   int    allocQ4;    /* p7_NQF(allocM): alloc size for tf, rf             */
   int    allocQ8;    /* p7_NQW(allocM): alloc size for tw, rw             */
   int    allocQ16;    /* p7_NQB(allocM): alloc size for rb                 */
+  int    allocQ32;    /* p7O_NQB_AVX(allocM): rbv_avx size; 0 if none      */
+  int    allocQ32w;   /* p7O_NQW_AVX512(allocM): rwv_avx512 size; 0 if none */
+  int    allocQ8f;    /* p7O_NQF_AVX(allocM): rfv_avx size; 0 if none     */
   int    mode;      /* currently must be p7_LOCAL                        */
   float  nj;      /* expected # of J's: 0 or 1, uni vs. multihit       */
 
@@ -147,6 +201,25 @@ typedef struct {
   P7_OPROFILE  **list;        /* array of <P7_OPROFILE> objects               */
 } P7_OM_BLOCK;
 
+/* A P7_OM_PACK interleaves the SSV scores of up to p7O_PACK_LANES
+ * profiles for the multi-model SSV filter. The 32 bytes at
+ * sbv + (x*M + k)*32 are, in lane s, profile s's SSV score for
+ * residue x at position k+1; or 127, a cost that saturates to the
+ * begin score, past the end of a shorter profile and in unused lanes.
+ */
+typedef struct {
+  int      n;           /* number of profiles in the pack, 0..p7O_PACK_LANES  */
+  int      M;           /* longest profile's M, rounded up to p7O_PACK_BAND   */
+  int      Kp;          /* # of residue codes with a table                    */
+  int8_t  *sbv;         /* [x][k][s] interleaved scores, 32-byte aligned      */
+  void    *sbv_mem;     /* <sbv> memory before alignment                      */
+  int64_t  allocS;      /* allocated size of <sbv>, in bytes                  */
+
+  void    *dpv;         /* DP workspace: one 32-byte vector per row 0..L      */
+  void    *dpv_mem;     /* <dpv> memory before alignment                      */
+  int      allocR;      /* # of rows allocated in <dpv>                       */
+} P7_OM_PACK;
+
 /* retrieve match odds ratio [k][x]
  * this gets used in p7_alidisplay.c, when we're deciding if a residue is conserved or not */
 static inline float 
@@ -196,6 +269,11 @@ typedef struct p7_omx_s {
   int       allocQ16;   /* current set row width in <dpb> 16-mers: allocQ16*16 >= M    */
   int64_t   ncells;     /* current allocation size of <dp_mem>, in accessible cells    */
 
+  /* One row for the wider (AVX) filters, which stripe differently and need 32- or 64-byte alignment */
+  void     *dpv;        /* aligned one-row workspace; NULL if no AVX filters compiled  */
+  void     *dpv_mem;    /* dpv memory before 64-byte alignment                         */
+  int64_t   allocV;     /* current allocation size of <dpv>, in bytes                  */
+
   /* The X states (for full,parser; or NULL, for scorer)                                       */
   float    *xmx;          /* logically [0.1..L][ENJBCS]; indexed [i*p7X_NXCELLS+s]       */
   void     *x_mem;    /* X memory before 16-byte alignment                           */
@@ -251,7 +329,42 @@ p7_omx_FSetMDI(const P7_OMX *ox, int s, int i, int k, float val)
 
 
 /*****************************************************************
- * 3. Declarations of the external API.
+ * 3. P7_SIMD_KERNELS: runtime choice of vector DP kernels
+ *****************************************************************/
+
+/* Vector instruction set levels, in increasing order of capability */
+#define p7_SIMD_SSE     0
+#define p7_SIMD_AVX2    1
+#define p7_SIMD_AVX512  2
+
+/* The public DP entry points (p7_MSVFilter() and friends) call through
+ * this table. simd.c fills it in once, at startup, with the best
+ * implementation of each that the processor supports.
+ */
+typedef struct {
+  int level;                    /* overall SIMD level selected, p7_SIMD_*        */
+  int msv_level;                /* implementation level of SSV/MSV kernels       */
+  int vf_level;                 /*  ... of the Viterbi filter kernels            */
+  int fb_level;                 /*  ... of the Forward/Backward parser kernels   */
+  int decode_level;             /*  ... of the decoding and OA kernels           */
+
+  int (*SSVFilter)               (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+  int (*MSVFilter)               (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+  int (*SSVFilter_Batch)         (const ESL_DSQ **dsq, const int *L, int n, const P7_OPROFILE *om, uint16_t *ret_xE); /* NULL if none */
+  int (*SSVFilter_Pack)          (const ESL_DSQ *dsq, int L, P7_OM_PACK *pk, uint16_t *ret_xE);
+  int (*ViterbiFilter)           (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+  int (*ViterbiFilter_longtarget)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float filtersc, double P, P7_HMM_WINDOWLIST *windowlist);
+  int (*ForwardParser)           (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
+  int (*BackwardParser)          (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+  int (*Decoding)                (const P7_OPROFILE *om, const P7_OMX *oxf, P7_OMX *oxb, P7_OMX *pp);
+  int (*OptimalAccuracy)         (const P7_OPROFILE *om, const P7_OMX *pp,  P7_OMX *ox,  float *ret_e);
+} P7_SIMD_KERNELS;
+
+
+
+
+/*****************************************************************
+ * 4. Declarations of the external API.
  *****************************************************************/
 
 /* p7_omx.c */
@@ -270,6 +383,7 @@ extern int          p7_omx_DumpFBRow(P7_OMX *ox, int logify, int rowi, int width
 
 /* p7_oprofile.c */
 extern P7_OPROFILE *p7_oprofile_Create(int M, const ESL_ALPHABET *abc);
+extern P7_OPROFILE *p7_oprofile_CreateShell(int M, const ESL_ALPHABET *abc);
 extern int          p7_oprofile_IsLocal(const P7_OPROFILE *om);
 extern void         p7_oprofile_Destroy(P7_OPROFILE *om);
 extern size_t       p7_oprofile_Sizeof(P7_OPROFILE *om);
@@ -278,6 +392,13 @@ extern P7_OPROFILE *p7_oprofile_Clone(const P7_OPROFILE *om);
 extern int          p7_oprofile_UpdateFwdEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emissions, float *sc_arr);
 extern int          p7_oprofile_UpdateVitEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emissions, float *sc_arr);
 extern int          p7_oprofile_UpdateMSVEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emissions, float *sc_arr);
+extern int          p7_oprofile_RestripeMSV(P7_OPROFILE *om);
+extern int          p7_oprofile_RestripeVF(P7_OPROFILE *om);
+extern int          p7_oprofile_RestripeFB(P7_OPROFILE *om);
+
+extern P7_OM_PACK  *p7_oprofile_CreatePack(void);
+extern int          p7_oprofile_SetPack(P7_OM_PACK *pk, P7_OPROFILE **om, int n);
+extern void         p7_oprofile_DestroyPack(P7_OM_PACK *pk);
 
 
 extern int          p7_oprofile_Convert(const P7_PROFILE *gm, P7_OPROFILE *om);
@@ -301,6 +422,7 @@ extern int          p7_oprofile_GetFwdEmissionArray(const P7_OPROFILE *om, P7_BG
 
 /* decoding.c */
 extern int p7_Decoding      (const P7_OPROFILE *om, const P7_OMX *oxf,       P7_OMX *oxb, P7_OMX *pp);
+extern int p7_Decoding_sse  (const P7_OPROFILE *om, const P7_OMX *oxf,       P7_OMX *oxb, P7_OMX *pp);
 extern int p7_DomainDecoding(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_DOMAINDEF *ddef);
 
 /* fwdback.c */
@@ -308,6 +430,14 @@ extern int p7_Forward       (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,
 extern int p7_ForwardParser (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
 extern int p7_Backward      (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
 extern int p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+extern int p7_ForwardParser_sse (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
+extern int p7_BackwardParser_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+
+/* fwdback_avx2.c: only present if HMMER_AVX2 */
+#ifdef HMMER_AVX2
+extern int p7_ForwardParser_avx2 (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
+extern int p7_BackwardParser_avx2(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+#endif
 
 /* io.c */
 extern int p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om);
@@ -316,17 +446,41 @@ extern int p7_oprofile_ReadInfoMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_O
 extern int p7_oprofile_ReadBlockMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OM_BLOCK *hmmBlock);
 extern int p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om);
 extern int p7_oprofile_Position(P7_HMMFILE *hfp, off_t offset);
+extern int p7_oprofile_Map(P7_HMMFILE *hfp);
 
 extern P7_OM_BLOCK *p7_oprofile_CreateBlock(int size);
 extern void p7_oprofile_DestroyBlock(P7_OM_BLOCK *block);
 
+/* simd.c */
+extern int                    p7_simd_Init(void);
+extern int                    p7_simd_Set(int level);
+extern int                    p7_simd_Parse(const char *s, int *ret_level);
+extern int                    p7_simd_Level(void);
+extern const char            *p7_simd_Name(int level);
+extern const P7_SIMD_KERNELS *p7_simd_Kernels(void);
+extern int                    p7_simd_Report(FILE *ofp);
+
 /* ssvfilter.c */
 extern int p7_SSVFilter    (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+extern int p7_SSVFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+extern int p7_SSVFilter_Batch (const ESL_DSQ **dsq, const int *L, int n, const P7_OPROFILE *om, uint16_t *ret_xE);
+extern int p7_SSVFilter_Finish(const P7_OPROFILE *om, uint16_t xE, float *ret_sc);
+extern int p7_SSVFilter_Pack    (const ESL_DSQ *dsq, int L, P7_OM_PACK *pk, uint16_t *ret_xE);
+extern int p7_SSVFilter_Pack_sse(const ESL_DSQ *dsq, int L, P7_OM_PACK *pk, uint16_t *ret_xE);
 
 /* msvfilter.c */
 extern int p7_MSVFilter           (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_MSVFilter_sse       (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
 extern int p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox, const P7_SCOREDATA *msvdata, P7_BG *bg, double P, P7_HMM_WINDOWLIST *windowlist);
 
+/* ssvfilter_avx2.c, msvfilter_avx2.c: only present if HMMER_AVX2 */
+#ifdef HMMER_AVX2
+extern int p7_SSVFilter_avx2(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+extern int p7_SSVFilter_Batch_avx2(const ESL_DSQ **dsq, const int *L, int n, const P7_OPROFILE *om, uint16_t *ret_xE);
+extern int p7_SSVFilter_Pack_avx2 (const ESL_DSQ *dsq, int L, P7_OM_PACK *pk, uint16_t *ret_xE);
+extern int p7_MSVFilter_avx2(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+#endif
+
 
 /* null2.c */
 extern int p7_Null2_ByExpectation(const P7_OPROFILE *om, const P7_OMX *pp, float *null2);
@@ -334,6 +488,7 @@ extern int p7_Null2_ByTrace      (const P7_OPROFILE *om, const P7_TRACE *tr, int
 
 /* optacc.c */
 extern int p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp,       P7_OMX *ox, float *ret_e);
+extern int p7_OptimalAccuracy_sse(const P7_OPROFILE *om, const P7_OMX *pp,   P7_OMX *ox, float *ret_e);
 extern int p7_OATrace        (const P7_OPROFILE *om, const P7_OMX *pp, const P7_OMX *ox, P7_TRACE *tr);
 
 /* stotrace.c */
@@ -343,6 +498,16 @@ extern int p7_StochasticTrace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, co
 extern int p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
 extern int p7_ViterbiFilter_longtarget(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox,
                                         float filtersc, double P, P7_HMM_WINDOWLIST *windowlist);
+extern int p7_ViterbiFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_ViterbiFilter_longtarget_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox,
+                                           float filtersc, double P, P7_HMM_WINDOWLIST *windowlist);
+
+/* vitfilter_avx512.c: only present if HMMER_AVX512 */
+#ifdef HMMER_AVX512
+extern int p7_ViterbiFilter_avx512(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_ViterbiFilter_longtarget_avx512(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox,
+                                              float filtersc, double P, P7_HMM_WINDOWLIST *windowlist);
+#endif
 
 
 /* vitscore.c */
@@ -350,11 +515,14 @@ extern int p7_ViterbiScore (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7
 
 
 /*****************************************************************
- * 4. Implementation specific initialization
+ * 5. Implementation specific initialization
  *****************************************************************/
 static inline void
 impl_Init(void)
 {
+  /* Choose vector kernels before any profiles or DP matrices are made */
+  p7_simd_Init();
+
 #ifdef HAVE_FLUSH_ZERO_MODE
   /* In order to avoid the performance penalty dealing with sub-normal
    * values in the floating point calculations, set the processor flag
@@ -9,6 +9,13 @@
  * By convention, hmmpress calls the two files <hmmfile>.h3f and
  * <hmmfile>.h3p, which nominally stand for "H3 filter" and "H3
  * profile".
+ *
+ * In the current format (3/g), each block of striped score vectors
+ * starts on a 64-byte boundary in its file, after zero padding.
+ * Besides being read into newly allocated profiles, such files can
+ * then be memory-mapped (p7_oprofile_Map()), and profiles point
+ * straight into the maps instead of copying their vectors. Format
+ * 3/f, the same thing without the padding, can still be read.
  * 
  * Contents:
  *    1. Writing optimized profiles to two files.
@@ -34,6 +41,10 @@
 #ifdef HMMER_THREADS
 #include <pthread.h>
 #endif
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include <xmmintrin.h>		/* SSE  */
 #include <emmintrin.h>		/* SSE2 */
@@ -43,6 +54,9 @@
 #include "hmmer.h"
 #include "impl_sse.h"
 
+static uint32_t  v3g_fmagic = 0xb3e7e6f3; /* 3/g binary MSV file, SSE:     "3gfs" = 0x 33 67 66 73  + 0x80808080 */
+static uint32_t  v3g_pmagic = 0xb3e7f0f3; /* 3/g binary profile file, SSE: "3gps" = 0x 33 67 70 73  + 0x80808080 */
+
 static uint32_t  v3f_fmagic = 0xb3e6e6f3; /* 3/f binary MSV file, SSE:     "3ffs" = 0x 33 66 66 73  + 0x80808080 */
 static uint32_t  v3f_pmagic = 0xb3e6f0f3; /* 3/f binary profile file, SSE: "3fps" = 0x 33 66 70 73  + 0x80808080 */
 
@@ -61,6 +75,17 @@ static uint32_t  v3b_pmagic = 0xb3e2f0f3; /* 3/b binary profile file, SSE: "3bps
 static uint32_t  v3a_fmagic = 0xe8b3e6f3; /* 3/a binary MSV file, SSE:     "h3fs" = 0x 68 33 66 73  + 0x80808080 */
 static uint32_t  v3a_pmagic = 0xe8b3f0f3; /* 3/a binary profile file, SSE: "h3ps" = 0x 68 33 70 73  + 0x80808080 */
 
+/* In 3/g files, vector blocks start at multiples of this many bytes */
+#define p7O_FILEALIGN 64
+
+static off_t align_offset(off_t pos);
+static int   write_align(FILE *fp);
+static int   read_align (FILE *fp);
+static int   map_read    (const char *map, size_t size, off_t *pos, void *dest, size_t n);
+static char *map_vectors (char *map, size_t size, off_t *pos, size_t n);
+static int   map_ReadMSV (P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_om);
+static int   map_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om);
+
 
 /*****************************************************************
  *# 1. Writing optimized profiles to two files.
@@ -74,6 +99,10 @@ static uint32_t  v3a_pmagic = 0xe8b3f0f3; /* 3/a binary profile file, SSE: "h3ps
  *            streams will typically be <.h3f> and <.h3p> files 
  *            being created by hmmpress.
  *
+ *            The format is 3/g, in which vector blocks are padded
+ *            to 64-byte file offsets. So <ffp> and <pfp> must be
+ *            files that <ftello()> works on, not pipes.
+ *
  * Args:      ffp  - open binary stream for saving MSV filter part
  *            pfp  - open binary stream for saving rest of profile
  *            om   - optimized profile to save
@@ -94,7 +123,7 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   int x;
 
   /* <ffp> is the part of the oprofile that MSVFilter() needs */
-  if (fwrite((char *) &(v3f_fmagic),    sizeof(uint32_t), 1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
+  if (fwrite((char *) &(v3g_fmagic),    sizeof(uint32_t), 1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->M),         sizeof(int),      1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->abc->type), sizeof(int),      1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &n,               sizeof(int),      1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
@@ -107,19 +136,21 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) &(om->base_b),    sizeof(uint8_t),  1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");  
   if (fwrite((char *) &(om->bias_b),    sizeof(uint8_t),  1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");  
 
+  if (write_align(ffp) != eslOK)                                                            ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   for (x = 0; x < om->abc->Kp; x++)
     if (fwrite( (char *) om->sbv[x],    sizeof(__m128i),  Q16x,        ffp) != Q16x)        ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   
+  if (write_align(ffp) != eslOK)                                                            ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   for (x = 0; x < om->abc->Kp; x++)
     if (fwrite( (char *) om->rbv[x],    sizeof(__m128i),  Q16,         ffp) != Q16)         ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   
   if (fwrite((char *) om->evparam,      sizeof(float),    p7_NEVPARAM, ffp) != p7_NEVPARAM) ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) om->offs,         sizeof(off_t),    p7_NOFFSETS, ffp) != p7_NOFFSETS) ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) om->compo,        sizeof(float),    p7_MAXABET,  ffp) != p7_MAXABET)  ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
-  if (fwrite((char *) &(v3f_fmagic),    sizeof(uint32_t), 1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed"); /* sentinel */
+  if (fwrite((char *) &(v3g_fmagic),    sizeof(uint32_t), 1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed"); /* sentinel */
 
   /* <pfp> gets the rest of the oprofile */
-  if (fwrite((char *) &(v3f_pmagic),    sizeof(uint32_t), 1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
+  if (fwrite((char *) &(v3g_pmagic),    sizeof(uint32_t), 1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->M),         sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->abc->type), sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &n,               sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
@@ -149,7 +180,9 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) om->consensus,    sizeof(char),     om->M+2,     pfp) != om->M+2)     ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
 
   /* ViterbiFilter part */
+  if (write_align(pfp) != eslOK)                                                               ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) om->twv,             sizeof(__m128i),  8*Q8,        pfp) != 8*Q8)        ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
+  if (write_align(pfp) != eslOK)                                                               ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   for (x = 0; x < om->abc->Kp; x++)
     if (fwrite( (char *) om->rwv[x],       sizeof(__m128i),  Q8,          pfp) != Q8)          ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   for (x = 0; x < p7O_NXSTATES; x++)
@@ -160,7 +193,9 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) &(om->ncj_roundoff), sizeof(float),    1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
 
   /* Forward/Backward part */
+  if (write_align(pfp) != eslOK)                                                            ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) om->tfv,          sizeof(__m128),   8*Q4,        pfp) != 8*Q4)        ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
+  if (write_align(pfp) != eslOK)                                                            ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   for (x = 0; x < om->abc->Kp; x++)
     if (fwrite( (char *) om->rfv[x],    sizeof(__m128),   Q4,          pfp) != Q4)          ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   for (x = 0; x < p7O_NXSTATES; x++)
@@ -170,7 +205,7 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) &(om->nj),        sizeof(float),    1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->mode),      sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->L)   ,      sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
-  if (fwrite((char *) &(v3f_pmagic),    sizeof(uint32_t), 1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed"); /* sentinel */
+  if (fwrite((char *) &(v3g_pmagic),    sizeof(uint32_t), 1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed"); /* sentinel */
   return eslOK;
 }
 /*---------------- end, writing oprofile ------------------------*/
@@ -233,6 +268,7 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
   P7_OPROFILE  *om = NULL;
   ESL_ALPHABET *abc = NULL;
   uint32_t      magic;
+  uint32_t      fmagic;		/* v3f_fmagic or v3g_fmagic: 3/g has aligned vector blocks */
   off_t         roff;
   int           M, Q16, Q16x;
   int           x,n;
@@ -240,6 +276,7 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
   int           status;
 
   hfp->errbuf[0] = '\0';  // do NOT touch rr_errbuf[]. In thread parallelization, master is exclusively using ReadMSV, workers are using ReadRest
+  if (hfp->fmap != NULL) return map_ReadMSV(hfp, byp_abc, ret_om);
   if (hfp->ffp == NULL) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no MSV profile file; hmmpress probably wasn't run");
   if (feof(hfp->ffp))   { status = eslEOF; goto ERROR; }	/* normal EOF: no more profiles */
   
@@ -252,7 +289,8 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
   if (magic == v3c_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
   if (magic == v3d_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
   if (magic == v3e_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
-  if (magic != v3f_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
+  if (magic != v3f_fmagic && magic != v3g_fmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
+  fmagic = magic;
 
   if (! fread( (char *) &M,         sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
   if (! fread( (char *) &alphatype, sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");  
@@ -284,17 +322,20 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
   if (! fread((char *) &(om->scale_b),   sizeof(float),   1,           hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read scale");
   if (! fread((char *) &(om->base_b),    sizeof(uint8_t), 1,           hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read base");
   if (! fread((char *) &(om->bias_b),    sizeof(uint8_t), 1,           hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read bias");
+  if (fmagic == v3g_fmagic && read_align(hfp->ffp) != eslOK)                      ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read padding before ssv scores");
   for (x = 0; x < abc->Kp; x++)
     if (! fread((char *) om->sbv[x],     sizeof(__m128i), Q16x,        hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read ssv scores at %d [residue %c]", x, abc->sym[x]); 
+  if (fmagic == v3g_fmagic && read_align(hfp->ffp) != eslOK)                      ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read padding before msv scores");
   for (x = 0; x < abc->Kp; x++)
     if (! fread((char *) om->rbv[x],     sizeof(__m128i), Q16,         hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read msv scores at %d [residue %c]", x, abc->sym[x]); 
+  if (p7_oprofile_RestripeMSV(om) != eslOK)                                       ESL_XFAIL(eslEINVAL,  hfp->errbuf, "failed to restripe msv scores");
   if (! fread((char *) om->evparam,      sizeof(float),   p7_NEVPARAM, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read stat params");
   if (! fread((char *) om->offs,         sizeof(off_t),   p7_NOFFSETS, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read hmmpfam offsets");
   if (! fread((char *) om->compo,        sizeof(float),   p7_MAXABET,  hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model composition");
 
   /* record ends with magic sentinel, for detecting binary file corruption */
   if (! fread( (char *) &magic,     sizeof(uint32_t), 1, hfp->ffp))  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no sentinel magic: .h3f file corrupted?");
-  if (magic != v3f_fmagic)                                           ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3f file corrupted?");
+  if (magic != fmagic)                                               ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3f file corrupted?");
 
   /* keep track of the ending offset of the MSV model */
   om->eoff = ftello(hfp->ffp) - 1;
@@ -362,6 +403,7 @@ p7_oprofile_ReadInfoMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **r
 
   hfp->errbuf[0] = '\0';
   if (hfp->ffp == NULL) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no MSV profile file; hmmpress probably wasn't run");
+  if (hfp->fmap != NULL && fseeko(hfp->ffp, hfp->fmapoff, SEEK_SET) != 0) ESL_EXCEPTION(eslESYS, "fseeko() failed"); /* a mapped reader may be ahead of <ffp> */
   if (feof(hfp->ffp))   { status = eslEOF; goto ERROR; }	/* normal EOF: no more profiles */
   
   /* keep track of the starting offset of the MSV model */
@@ -373,7 +415,7 @@ p7_oprofile_ReadInfoMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **r
   if (magic == v3c_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
   if (magic == v3d_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
   if (magic == v3e_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
-  if (magic != v3f_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
+  if (magic != v3f_fmagic && magic != v3g_fmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
 
   if (! fread( (char *) &M,         sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
   if (! fread( (char *) &alphatype, sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");  
@@ -400,7 +442,9 @@ p7_oprofile_ReadInfoMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **r
   roff += (sizeof(int) * 5);                      /* magic, model size, alphabet type, max length, name length */
   roff += (sizeof(char) * (n + 1));               /* name string and terminator '\0'                           */
   roff += (sizeof(float) + sizeof(uint8_t) * 5);  /* transition  costs, bias, scale and base                   */
+  if (magic == v3g_fmagic) roff = align_offset(roff);
   roff += (sizeof(__m128i) * abc->Kp * Q16x);     /* ssv scores                                                */
+  if (magic == v3g_fmagic) roff = align_offset(roff);
   roff += (sizeof(__m128i) * abc->Kp * Q16);      /* msv scores                                                */
   roff += (sizeof(float) * p7_NEVPARAM);          /* stat params                                               */
   roff += (sizeof(off_t) * p7_NOFFSETS);          /* hmmscan offsets                                           */
@@ -498,12 +542,16 @@ int
 p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
 {
   uint32_t      magic;
+  uint32_t      pmagic;		/* v3f_pmagic or v3g_pmagic */
   int           M, Q4, Q8;
   int           x,n;
   char         *name = NULL;
   int           alphatype;
   int           status;
 
+  /* profiles from a mapped database are parsed from the map; see p7_oprofile_Map() */
+  if (hfp->pmap != NULL && om->rwv_mem == NULL) return map_ReadRest(hfp, om);
+
 #ifdef HMMER_THREADS
   /* lock the mutex to prevent other threads from reading from the optimized
    * profile at the same time.
@@ -526,7 +574,8 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   if (magic == v3c_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
   if (magic == v3d_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
   if (magic == v3e_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
-  if (magic != v3f_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad magic; not an HMM database file?");
+  if (magic != v3f_pmagic && magic != v3g_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad magic; not an HMM database file?");
+  pmagic = magic;
 
   if (! fread( (char *) &M,              sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read model size M");
   if (! fread( (char *) &alphatype,      sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read alphabet type");  
@@ -557,7 +606,9 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   Q4  = p7O_NQF(om->M);
   Q8  = p7O_NQW(om->M);
 
+  if (pmagic == v3g_pmagic && read_align(hfp->pfp) != eslOK)                         ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read padding before <tu>");
   if (! fread((char *) om->twv,             sizeof(__m128i),  8*Q8,        hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <tu>, vitfilter transitions");
+  if (pmagic == v3g_pmagic && read_align(hfp->pfp) != eslOK)                         ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read padding before <ru>");
   for (x = 0; x < om->abc->Kp; x++)
     if (! fread( (char *) om->rwv[x],       sizeof(__m128i),  Q8,          hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <ru>[%d], vitfilter emissions for sym %c", x, om->abc->sym[x]);
   for (x = 0; x < p7O_NXSTATES; x++)
@@ -566,10 +617,14 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   if (! fread((char *) &(om->base_w),       sizeof(int16_t),  1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read base_w");
   if (! fread((char *) &(om->ddbound_w),    sizeof(int16_t),  1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read ddbound_w");
   if (! fread((char *) &(om->ncj_roundoff), sizeof(float),    1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read ddbound_w");
+  if (p7_oprofile_RestripeVF(om) != eslOK)                                            ESL_XFAIL(eslEINVAL,  hfp->rr_errbuf, "failed to restripe vitfilter scores");
 
+  if (pmagic == v3g_pmagic && read_align(hfp->pfp) != eslOK)                      ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read padding before <tf>");
   if (! fread((char *) om->tfv,          sizeof(__m128),   8*Q4,        hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <tf> transitions");
+  if (pmagic == v3g_pmagic && read_align(hfp->pfp) != eslOK)                      ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read padding before <rf>");
   for (x = 0; x < om->abc->Kp; x++)
     if (! fread( (char *) om->rfv[x],    sizeof(__m128),   Q4,          hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <rf>[%d] emissions for sym %c", x, om->abc->sym[x]);
+  if (p7_oprofile_RestripeFB(om) != eslOK)                                         ESL_XFAIL(eslEINVAL,  hfp->rr_errbuf, "failed to restripe fwd/bck scores");
   for (x = 0; x < p7O_NXSTATES; x++)
     if (! fread( (char *) om->xf[x],     sizeof(float),    p7O_NXTRANS, hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <xf>[%d] special transitions", x);
 
@@ -580,7 +635,7 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
 
   /* record ends with magic sentinel, for detecting binary file corruption */
   if (! fread( (char *) &magic,     sizeof(uint32_t), 1, hfp->pfp))  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "no sentinel magic: .h3p file corrupted?");
-  if (magic != v3f_pmagic)                                           ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad sentinel magic; .h3p file corrupted?");
+  if (magic != pmagic)                                               ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad sentinel magic; .h3p file corrupted?");
 
 #ifdef HMMER_THREADS
   if (hfp->syncRead)
@@ -604,6 +659,327 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   if (name != NULL) free(name);
   return status;
 }
+
+/* Function:  p7_oprofile_Map()
+ * Synopsis:  Memory-map the pressed profile files of an open HMM file.
+ *
+ * Purpose:   Map the <.h3f> and <.h3p> files associated with an open
+ *            HMM file <hfp> into memory. Subsequent
+ *            <p7_oprofile_ReadMSV()> and <p7_oprofile_ReadRest()>
+ *            calls on <hfp> parse profiles from the maps instead of
+ *            reading them through stdio, and the striped SSE score
+ *            vectors of those profiles point into the maps rather
+ *            than into memory of their own. Many processes scanning
+ *            the same pressed database then share one copy of it in
+ *            the page cache, and a profile costs little more than
+ *            its small annotation to load.
+ *
+ *            The maps are private and copy-on-write; nothing is ever
+ *            written back to the files. They stay valid until
+ *            <p7_hmmfile_Close()>, so every profile read from a mapped
+ *            <hfp> must be destroyed before <hfp> is closed.
+ *
+ *            Only 3/g pressed files (written by this version of
+ *            hmmpress) can be mapped, because they pad each vector
+ *            block to a 64-byte file offset. Callers treat failure
+ *            as harmless: <hfp> is unchanged, and profiles are read
+ *            through stdio as usual.
+ *
+ *            Reading continues from the current position of the
+ *            <.h3f> stream, so <p7_oprofile_Map()> may be called
+ *            either right after <p7_hmmfile_Open()> or after a
+ *            <p7_oprofile_Position()>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEFORMAT> if <hfp> has no pressed files open, or if
+ *            they are in an older format; <hfp->errbuf> says which.
+ *
+ *            <eslESYS> if a system call fails, such as <mmap()>
+ *            running out of address space.
+ *
+ *            <eslEUNIMPLEMENTED> if this system has no <mmap()>.
+ *
+ *            On any failure, <hfp->errbuf> says why.
+ */
+int
+p7_oprofile_Map(P7_HMMFILE *hfp)
+{
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+  struct stat st;
+  uint32_t    magic;
+  int         status;
+
+  hfp->errbuf[0] = '\0';
+  if (hfp->fmap != NULL) return eslOK;	/* already mapped */
+  if (hfp->ffp == NULL || hfp->pfp == NULL) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no pressed profile files; hmmpress probably wasn't run");
+
+  if (fstat(fileno(hfp->ffp), &st) != 0)       ESL_XFAIL(eslESYS, hfp->errbuf, "fstat() of .h3f file failed");
+  if (st.st_size < (off_t) sizeof(uint32_t))   ESL_XFAIL(eslEFORMAT, hfp->errbuf, ".h3f file is empty");
+  hfp->fmapsize = st.st_size;
+  if ((hfp->fmap = mmap(NULL, hfp->fmapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(hfp->ffp), 0)) == MAP_FAILED)
+    { hfp->fmap = NULL; ESL_XFAIL(eslESYS, hfp->errbuf, "mmap() of .h3f file failed"); }
+
+  if (fstat(fileno(hfp->pfp), &st) != 0)       ESL_XFAIL(eslESYS, hfp->errbuf, "fstat() of .h3p file failed");
+  if (st.st_size < (off_t) sizeof(uint32_t))   ESL_XFAIL(eslEFORMAT, hfp->errbuf, ".h3p file is empty");
+  hfp->pmapsize = st.st_size;
+  if ((hfp->pmap = mmap(NULL, hfp->pmapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(hfp->pfp), 0)) == MAP_FAILED)
+    { hfp->pmap = NULL; ESL_XFAIL(eslESYS, hfp->errbuf, "mmap() of .h3p file failed"); }
+
+  memcpy(&magic, hfp->fmap, sizeof(uint32_t));
+  if (magic != v3g_fmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "pressed files are in an older format; hmmpress your HMM file again to map them");
+  memcpy(&magic, hfp->pmap, sizeof(uint32_t));
+  if (magic != v3g_pmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "pressed files are in an older format; hmmpress your HMM file again to map them");
+
+  if ((hfp->fmapoff = ftello(hfp->ffp)) < 0)   ESL_XFAIL(eslESYS, hfp->errbuf, "ftello() on .h3f file failed");
+  return eslOK;
+
+ ERROR:
+  if (hfp->fmap != NULL) munmap(hfp->fmap, hfp->fmapsize);
+  if (hfp->pmap != NULL) munmap(hfp->pmap, hfp->pmapsize);
+  hfp->fmap     = hfp->pmap     = NULL;
+  hfp->fmapsize = hfp->pmapsize = 0;
+  hfp->fmapoff  = 0;
+  return status;
+#else
+  ESL_FAIL(eslEUNIMPLEMENTED, hfp->errbuf, "memory mapping isn't supported on this system");
+#endif
+}
+
+
+/* align_offset(), write_align(), read_align()
+ * 
+ * In the 3/g format, each block of vectors starts at a file offset
+ * that's a multiple of p7O_FILEALIGN. The maps of p7_oprofile_Map()
+ * are page-aligned, so vectors in them are then aligned in memory too.
+ */
+static off_t
+align_offset(off_t pos)
+{
+  return (pos + p7O_FILEALIGN - 1) & ~((off_t) p7O_FILEALIGN - 1);
+}
+
+static int
+write_align(FILE *fp)
+{
+  static const char zeros[p7O_FILEALIGN] = { 0 };
+  off_t             pos;
+  size_t            n;
+
+  if ((pos = ftello(fp)) < 0) return eslEWRITE;
+  n = align_offset(pos) - pos;
+  if (n > 0 && fwrite(zeros, sizeof(char), n, fp) != n) return eslEWRITE;
+  return eslOK;
+}
+
+static int
+read_align(FILE *fp)
+{
+  char   pad[p7O_FILEALIGN];
+  off_t  pos;
+  size_t n;
+
+  if ((pos = ftello(fp)) < 0) return eslEFORMAT;
+  n = align_offset(pos) - pos;
+  if (n > 0 && fread(pad, sizeof(char), n, fp) != n) return eslEFORMAT;
+  return eslOK;
+}
+
+
+/* map_read()
+ * Copy <n> bytes at offset <*pos> of a map of <size> bytes into
+ * <dest>, and advance <*pos>. Return <eslEOF> if the map is too short.
+ */
+static int
+map_read(const char *map, size_t size, off_t *pos, void *dest, size_t n)
+{
+  if (*pos < 0 || (size_t) *pos + n > size) return eslEOF;
+  memcpy(dest, map + *pos, n);
+  *pos += n;
+  return eslOK;
+}
+
+/* map_vectors()
+ * Return a pointer to a block of <n> bytes of vectors in a map of
+ * <size> bytes, at the next aligned offset after <*pos>, and advance
+ * <*pos> past it. Return NULL if the map is too short.
+ */
+static char *
+map_vectors(char *map, size_t size, off_t *pos, size_t n)
+{
+  off_t start = align_offset(*pos);
+
+  if ((size_t) start + n > size) return NULL;
+  *pos = start + n;
+  return map + start;
+}
+
+
+/* map_ReadMSV()
+ * p7_oprofile_ReadMSV() for a mapped <hfp>: parse the MSV record at
+ * <hfp->fmapoff>, with the profile's SSV and MSV score vectors
+ * pointing into the map.
+ */
+static int
+map_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_om)
+{
+  P7_OPROFILE  *om   = NULL;
+  ESL_ALPHABET *abc  = NULL;
+  char         *map  = hfp->fmap;
+  size_t        size = hfp->fmapsize;
+  off_t         pos  = hfp->fmapoff;
+  char         *vp;
+  uint32_t      magic;
+  int           M, Q16, Q16x;
+  int           x,n;
+  int           alphatype;
+  int           status;
+
+  if (map_read(map, size, &pos, &magic, sizeof(uint32_t)) != eslOK) { status = eslEOF; goto ERROR; } /* normal EOF: no more profiles */
+  if (magic != v3g_fmagic)                                                     ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
+  if (map_read(map, size, &pos, &M,         sizeof(int)) != eslOK)             ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
+  if (map_read(map, size, &pos, &alphatype, sizeof(int)) != eslOK)             ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");
+  Q16  = p7O_NQB(M);
+  Q16x = p7O_NQB(M) + p7O_EXTRA_SB;
+
+  /* Set or verify alphabet, as in p7_oprofile_ReadMSV(). */
+  if (byp_abc == NULL || *byp_abc == NULL)	{
+    if ((abc = esl_alphabet_Create(alphatype)) == NULL)  ESL_XFAIL(eslEMEM, hfp->errbuf, "allocation failed: alphabet");
+  } else {
+    abc = *byp_abc;
+    if (abc->type != alphatype) 
+      ESL_XFAIL(eslEINCOMPAT, hfp->errbuf, "Alphabet type mismatch: was %s, but current profile says %s", 
+		esl_abc_DecodeType(abc->type), esl_abc_DecodeType(alphatype));
+  }
+  if ((om = p7_oprofile_CreateShell(M, abc)) == NULL)                          ESL_XFAIL(eslEMEM, hfp->errbuf, "allocation failed: oprofile");
+  om->M    = M;
+  om->roff = hfp->fmapoff;
+
+  if (map_read(map, size, &pos, &n,               sizeof(int))     != eslOK)   ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read name length");
+  ESL_ALLOC(om->name, sizeof(char) * (n+1));
+  if (map_read(map, size, &pos, om->name,         sizeof(char) * (n+1)) != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read name");
+  if (map_read(map, size, &pos, &(om->max_length),sizeof(int))     != eslOK)   ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read max_length");
+  if (map_read(map, size, &pos, &(om->tbm_b),     sizeof(uint8_t)) != eslOK)   ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read tbm");
+  if (map_read(map, size, &pos, &(om->tec_b),     sizeof(uint8_t)) != eslOK)   ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read tec");
+  if (map_read(map, size, &pos, &(om->tjb_b),     sizeof(uint8_t)) != eslOK)   ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read tjb");
+  if (map_read(map, size, &pos, &(om->scale_b),   sizeof(float))   != eslOK)   ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read scale");
+  if (map_read(map, size, &pos, &(om->base_b),    sizeof(uint8_t)) != eslOK)   ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read base");
+  if (map_read(map, size, &pos, &(om->bias_b),    sizeof(uint8_t)) != eslOK)   ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read bias");
+
+  if ((vp = map_vectors(map, size, &pos, sizeof(__m128i) * Q16x * abc->Kp)) == NULL) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read ssv scores");
+  for (x = 0; x < abc->Kp; x++) om->sbv[x] = (__m128i *) vp + x * Q16x;
+  if ((vp = map_vectors(map, size, &pos, sizeof(__m128i) * Q16  * abc->Kp)) == NULL) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read msv scores");
+  for (x = 0; x < abc->Kp; x++) om->rbv[x] = (__m128i *) vp + x * Q16;
+  if (p7_oprofile_RestripeMSV(om) != eslOK)                                    ESL_XFAIL(eslEINVAL,  hfp->errbuf, "failed to restripe msv scores");
+
+  if (map_read(map, size, &pos, om->evparam, sizeof(float) * p7_NEVPARAM) != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read stat params");
+  if (map_read(map, size, &pos, om->offs,    sizeof(off_t) * p7_NOFFSETS) != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read hmmpfam offsets");
+  if (map_read(map, size, &pos, om->compo,   sizeof(float) * p7_MAXABET)  != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model composition");
+
+  if (map_read(map, size, &pos, &magic, sizeof(uint32_t)) != eslOK)            ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no sentinel magic: .h3f file corrupted?");
+  if (magic != v3g_fmagic)                                                     ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3f file corrupted?");
+
+  om->eoff     = pos - 1;
+  hfp->fmapoff = pos;
+
+  if (byp_abc != NULL) *byp_abc = abc;
+  *ret_om = om;
+  return eslOK;
+
+ ERROR:
+  if (abc && (byp_abc == NULL || *byp_abc == NULL)) esl_alphabet_Destroy(abc);
+  p7_oprofile_Destroy(om);
+  *ret_om = NULL;
+  return status;
+}
+
+
+/* map_ReadRest()
+ * p7_oprofile_ReadRest() for a profile that map_ReadMSV() made: parse
+ * the rest of it from the .h3p map, with its ViterbiFilter and
+ * Forward/Backward score vectors pointing into the map. Nothing
+ * here is shared state, so unlike ReadRest(), no lock is needed.
+ */
+static int
+map_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
+{
+  char     *map  = hfp->pmap;
+  size_t    size = hfp->pmapsize;
+  off_t     pos  = om->offs[p7_POFFSET];
+  char     *name = NULL;
+  char     *vp;
+  uint32_t  magic;
+  int       M, Q4, Q8;
+  int       x,n;
+  int       alphatype;
+  int       status;
+
+  hfp->rr_errbuf[0] = '\0';
+  if (map_read(map, size, &pos, &magic,     sizeof(uint32_t)) != eslOK)         ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read magic");
+  if (magic != v3g_pmagic)                                                      ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad magic; not an HMM database file?");
+  if (map_read(map, size, &pos, &M,         sizeof(int)) != eslOK)              ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read model size M");
+  if (map_read(map, size, &pos, &alphatype, sizeof(int)) != eslOK)              ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read alphabet type");
+  if (map_read(map, size, &pos, &n,         sizeof(int)) != eslOK)              ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read name length");
+  if (M         != om->M)                                                       ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "p/f model length mismatch");
+  if (alphatype != om->abc->type)                                               ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "p/f alphabet type mismatch");
+
+  ESL_ALLOC(name, sizeof(char) * (n+1));
+  if (map_read(map, size, &pos, name, sizeof(char) * (n+1)) != eslOK)           ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read name");
+  if (strcmp(name, om->name) != 0)                                              ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "p/f name mismatch");
+
+  if (map_read(map, size, &pos, &n, sizeof(int)) != eslOK)                      ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read accession length");
+  if (n > 0) {
+    ESL_ALLOC(om->acc, sizeof(char) * (n+1));
+    if (map_read(map, size, &pos, om->acc, sizeof(char) * (n+1)) != eslOK)      ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read accession");
+  }
+  if (map_read(map, size, &pos, &n, sizeof(int)) != eslOK)                      ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read description length");
+  if (n > 0) {
+    ESL_ALLOC(om->desc, sizeof(char) * (n+1));
+    if (map_read(map, size, &pos, om->desc, sizeof(char) * (n+1)) != eslOK)     ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read description");
+  }
+  if (map_read(map, size, &pos, om->rf,        sizeof(char) * (M+2)) != eslOK)  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read rf annotation");
+  if (map_read(map, size, &pos, om->mm,        sizeof(char) * (M+2)) != eslOK)  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read mm annotation");
+  if (map_read(map, size, &pos, om->cs,        sizeof(char) * (M+2)) != eslOK)  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read cs annotation");
+  if (map_read(map, size, &pos, om->consensus, sizeof(char) * (M+2)) != eslOK)  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read consensus annotation");
+
+  Q4  = p7O_NQF(om->M);
+  Q8  = p7O_NQW(om->M);
+
+  if ((vp = map_vectors(map, size, &pos, sizeof(__m128i) * 8 * Q8)) == NULL)            ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <tu>, vitfilter transitions");
+  om->twv = (__m128i *) vp;
+  if ((vp = map_vectors(map, size, &pos, sizeof(__m128i) * Q8 * om->abc->Kp)) == NULL) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <ru>, vitfilter emissions");
+  for (x = 0; x < om->abc->Kp; x++) om->rwv[x] = (__m128i *) vp + x * Q8;
+  for (x = 0; x < p7O_NXSTATES; x++)
+    if (map_read(map, size, &pos, om->xw[x], sizeof(int16_t) * p7O_NXTRANS) != eslOK) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <xu>[%d], vitfilter special transitions", x);
+  if (map_read(map, size, &pos, &(om->scale_w),      sizeof(float))   != eslOK)        ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read scale_w");
+  if (map_read(map, size, &pos, &(om->base_w),       sizeof(int16_t)) != eslOK)        ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read base_w");
+  if (map_read(map, size, &pos, &(om->ddbound_w),    sizeof(int16_t)) != eslOK)        ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read ddbound_w");
+  if (map_read(map, size, &pos, &(om->ncj_roundoff), sizeof(float))   != eslOK)        ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read ncj_roundoff");
+  if (p7_oprofile_RestripeVF(om) != eslOK)                                             ESL_XFAIL(eslEINVAL,  hfp->rr_errbuf, "failed to restripe vitfilter scores");
+
+  if ((vp = map_vectors(map, size, &pos, sizeof(__m128) * 8 * Q4)) == NULL)             ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <tf> transitions");
+  om->tfv = (__m128 *) vp;
+  if ((vp = map_vectors(map, size, &pos, sizeof(__m128) * Q4 * om->abc->Kp)) == NULL)  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <rf> emissions");
+  for (x = 0; x < om->abc->Kp; x++) om->rfv[x] = (__m128 *) vp + x * Q4;
+  if (p7_oprofile_RestripeFB(om) != eslOK)                                             ESL_XFAIL(eslEINVAL,  hfp->rr_errbuf, "failed to restripe fwd/bck scores");
+  for (x = 0; x < p7O_NXSTATES; x++)
+    if (map_read(map, size, &pos, om->xf[x], sizeof(float) * p7O_NXTRANS) != eslOK)   ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <xf>[%d] special transitions", x);
+
+  if (map_read(map, size, &pos, om->cutoff,  sizeof(float) * p7_NCUTOFFS) != eslOK)    ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read Pfam score cutoffs");
+  if (map_read(map, size, &pos, &(om->nj),   sizeof(float)) != eslOK)                  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read nj");
+  if (map_read(map, size, &pos, &(om->mode), sizeof(int))   != eslOK)                  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read mode");
+  if (map_read(map, size, &pos, &(om->L),    sizeof(int))   != eslOK)                  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read L");
+
+  if (map_read(map, size, &pos, &magic, sizeof(uint32_t)) != eslOK)                    ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "no sentinel magic: .h3p file corrupted?");
+  if (magic != v3g_pmagic)                                                             ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad sentinel magic; .h3p file corrupted?");
+
+  free(name);
+  return eslOK;
+
+ ERROR:
+  if (name != NULL) free(name);
+  return status;
+}
 /*----------- end, reading optimized profiles -------------------*/
 
 
@@ -702,6 +1078,7 @@ p7_oprofile_Position(P7_HMMFILE *hfp, off_t offset)
   if (offset < 0)        ESL_EXCEPTION(eslEINVAL, "bad offset");
 
   if (fseeko(hfp->ffp, offset, SEEK_SET) != 0) ESL_EXCEPTION(eslESYS, "fseeko() failed");
+  hfp->fmapoff = offset;	/* keep a p7_oprofile_Map()'ed reader in step */
 
   return eslOK;
 }
@@ -853,6 +1230,18 @@ utest_ReadWrite(P7_HMM *hmm, P7_OPROFILE *om)
        
   p7_oprofile_Destroy(om2);
   p7_hmmfile_Close(hfp);
+
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+  /* 4. and so should the same profile, read from the memory-mapped files */
+  if ( p7_hmmfile_Open(tmpfile, NULL, &hfp, NULL)  != eslOK) esl_fatal(msg);
+  if ( p7_oprofile_Map(hfp)                        != eslOK) esl_fatal(msg);
+  if ( p7_oprofile_ReadMSV(hfp, &abc, &om2)        != eslOK) esl_fatal(msg);
+  if ( p7_oprofile_ReadRest(hfp, om2)              != eslOK) esl_fatal(msg);
+  if ( p7_oprofile_Compare(om, om2, tolerance, errbuf) != eslOK) esl_fatal("%s\n%s", msg, errbuf);
+  p7_oprofile_Destroy(om2);
+  if ( p7_oprofile_ReadMSV(hfp, &abc, &om2)        != eslEOF) esl_fatal(msg);
+  p7_hmmfile_Close(hfp);
+#endif
   esl_alphabet_Destroy(abc);
   remove(ssifile);
   remove(ffile);
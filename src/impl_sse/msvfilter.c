@@ -69,9 +69,21 @@
  *            this case, this is a high-scoring hit.
  *
  * Throws:    <eslEINVAL> if <ox> allocation is too small.
+ *
+ * Note:      Dispatches to the widest implementation the processor
+ *            supports (see simd.c); this one is <p7_MSVFilter_sse()>.
  */
 int
 p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+  return (*p7_simd_Kernels()->MSVFilter)(dsq, L, om, ox, ret_sc);
+}
+
+/* Function:  p7_MSVFilter_sse()
+ * Synopsis:  SSE implementation of <p7_MSVFilter()>.
+ */
+int
+p7_MSVFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
 {
   register __m128i mpv;            /* previous row values                                       */
   register __m128i xEv;		   /* E state: keeps max for Mk->E as we go                     */
@@ -100,7 +112,7 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
   ox->M   = om->M;
 
   /* Try highly optimized ssv filter first */
-  status = p7_SSVFilter(dsq, L, om, ret_sc);
+  status = p7_SSVFilter_sse(dsq, L, om, ret_sc);
   if (status != eslENORESULT) return status;
 
   /* Initialization. In offset unsigned arithmetic, -infinity is 0, and 0 is om->base.
@@ -53,9 +53,21 @@
  *            positions in the target sequence (up to <L>).
  *
  * Throws:    (no abnormal error conditions)
+ *
+ * Note:      Dispatches to the widest implementation the processor
+ *            supports (see simd.c); this one is <p7_OptimalAccuracy_sse()>.
  */
 int
 p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, float *ret_e)
+{
+  return (*p7_simd_Kernels()->OptimalAccuracy)(om, pp, ox, ret_e);
+}
+
+/* Function:  p7_OptimalAccuracy_sse()
+ * Synopsis:  SSE implementation of <p7_OptimalAccuracy()>.
+ */
+int
+p7_OptimalAccuracy_sse(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, float *ret_e)
 {
   register __m128 mpv, dpv, ipv;   /* previous row values                                       */
   register __m128 sv;		   /* temp storage of 1 curr row value in progress              */
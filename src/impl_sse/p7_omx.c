@@ -26,6 +26,8 @@
 #include "hmmer.h"
 #include "impl_sse.h"
 
+static int64_t omx_wide_row_size(int allocM);
+
 /*****************************************************************
  * 1. The P7_OMX structure: a dynamic programming matrix
  *****************************************************************/
@@ -72,6 +74,9 @@ p7_omx_Create(int allocM, int allocL, int allocXL)
   ox->dpf    = NULL;
   ox->xmx    = NULL;
   ox->x_mem  = NULL;
+  ox->dpv    = NULL;
+  ox->dpv_mem = NULL;
+  ox->allocV = 0;
 
   /* DP matrix will be allocated for allocL+1 rows 0,1..L; allocQ4*p7X_NSCELLS columns */
   ox->allocR   = allocL+1;
@@ -100,6 +105,13 @@ p7_omx_Create(int allocM, int allocL, int allocXL)
   ESL_ALLOC(ox->x_mem,  sizeof(float) * ox->allocXR * p7X_NXCELLS + 15); 
   ox->xmx = (float *) ( ( (unsigned long int) ((char *) ox->x_mem  + 15) & (~0xf)));
 
+  /* the wide filters' row, if any are compiled in */
+  if ((ox->allocV = omx_wide_row_size(allocM)) > 0)
+    {
+      ESL_ALLOC(ox->dpv_mem, ox->allocV + 63);
+      ox->dpv = (void *) ( ( (unsigned long int) ((char *) ox->dpv_mem + 63) & (~0x3f)));
+    }
+
   ox->M              = 0;
   ox->L              = 0;
   ox->totscale       = 0.0;
@@ -143,9 +155,18 @@ p7_omx_GrowTo(P7_OMX *ox, int allocM, int allocL, int allocXL)
   int     nqb    = p7O_NQB(allocM);	   /* segment length; total # of striped vectors for float */
   int64_t ncells = (int64_t) (allocL+1) * (int64_t) nqf * 4;
   int     reset_row_pointers = FALSE;
+  int64_t nbv    = omx_wide_row_size(allocM);
   int     i;
   int     status;
  
+  /* The wide filters' row only depends on M, and is independent of the rest */
+  if (nbv > ox->allocV)
+    {
+      ESL_RALLOC(ox->dpv_mem, p, nbv + 63);
+      ox->dpv    = (void *) ( ( (unsigned long int) ((char *) ox->dpv_mem + 63) & (~0x3f)));
+      ox->allocV = nbv;
+    }
+
   /* If all possible dimensions are already satisfied, the matrix is fine */
   if (ox->allocQ4*4 >= allocM && ox->validR > allocL && ox->allocXR >= allocXL+1) return eslOK;
 
@@ -299,9 +320,37 @@ p7_omx_Destroy(P7_OMX *ox)
   if (ox->dpf     != NULL) free(ox->dpf);
   if (ox->dpw     != NULL) free(ox->dpw);
   if (ox->dpb     != NULL) free(ox->dpb);
+  if (ox->dpv_mem != NULL) free(ox->dpv_mem);
   free(ox);
   return;
 }
+
+/* omx_wide_row_size()
+ * 
+ * Size of the one-row workspace <ox->dpv>, in bytes, that the
+ * wide-vector (AVX) filters and parsers need for a model of length <allocM>; 0
+ * if none of them are compiled in, or the processor won't use them
+ * (see simd.c). They can't borrow <ox->dpb[0]>
+ * like the SSE filters, because that row is only 16-byte aligned,
+ * and for small models it is also too narrow.
+ */
+static int64_t
+omx_wide_row_size(int allocM)
+{
+  int64_t n = 0;
+
+#ifdef HMMER_AVX2
+  if (p7_simd_Level() >= p7_SIMD_AVX2) {
+    n = ESL_MAX(n, (int64_t) 32 * p7O_NQB_AVX(allocM));               /* MSV: one uchar vector per q         */
+    n = ESL_MAX(n, (int64_t) 32 * p7X_NSCELLS * p7O_NQF_AVX(allocM)); /* parsers: M,D,I float vectors per q  */
+  }
+#endif
+#ifdef HMMER_AVX512
+  if (p7_simd_Level() >= p7_SIMD_AVX512)
+    n = ESL_MAX(n, (int64_t) 64 * p7X_NSCELLS * p7O_NQW_AVX512(allocM)); /* VF: M,D,I sword vectors per q */
+#endif
+  return n;
+}
 /*------------------- end, P7_OMX structure ---------------------*/
 
 
@@ -32,6 +32,7 @@ static uint8_t unbiased_byteify(P7_OPROFILE *om, float sc);
 static uint8_t biased_byteify(P7_OPROFILE *om, float sc);
 static int16_t wordify(P7_OPROFILE *om, float sc);
 static int     sf_conversion(P7_OPROFILE *om);
+static P7_OPROFILE *oprofile_create(int allocM, const ESL_ALPHABET *abc, int own_vectors);
 
 /*****************************************************************
  * 1. The P7_OPROFILE structure: a score profile.
@@ -47,6 +48,38 @@ static int     sf_conversion(P7_OPROFILE *om);
  */
 P7_OPROFILE *
 p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
+{
+  return oprofile_create(allocM, abc, TRUE);
+}
+
+/* Function:  p7_oprofile_CreateShell()
+ * Synopsis:  Allocate an optimized profile without its SSE score vectors.
+ *
+ * Purpose:   Allocate for profiles of up to <allocM> nodes for digital
+ *            alphabet <abc>, like <p7_oprofile_Create()>, except that
+ *            the striped SSE score vectors <rbv>, <sbv>, <rwv>, <twv>,
+ *            <rfv>, <tfv> are not allocated. The row pointer arrays
+ *            <rbv[x]>, <sbv[x]>, <rwv[x]>, <rfv[x]> are allocated, but
+ *            the caller sets them (and <twv>, <tfv>) to point into
+ *            memory it manages, such as a memory-mapped pressed
+ *            database (see <p7_oprofile_Map()>), with the same row
+ *            strides that <p7_oprofile_Create()> uses. That memory
+ *            must outlive the profile.
+ *
+ *            Everything else, including the AVX2/AVX-512 restriped
+ *            copies, is allocated as usual, and <p7_oprofile_Destroy()>
+ *            frees it.
+ *
+ * Throws:    <NULL> on allocation error.
+ */
+P7_OPROFILE *
+p7_oprofile_CreateShell(int allocM, const ESL_ALPHABET *abc)
+{
+  return oprofile_create(allocM, abc, FALSE);
+}
+
+static P7_OPROFILE *
+oprofile_create(int allocM, const ESL_ALPHABET *abc, int own_vectors)
 {
   int          status;
   P7_OPROFILE *om  = NULL;
@@ -54,6 +87,14 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
   int          nqw = p7O_NQW(allocM); /* # of sword vectors needed for query */
   int          nqf = p7O_NQF(allocM); /* # of float vectors needed for query */
   int          nqs = nqb + p7O_EXTRA_SB;
+#ifdef HMMER_AVX2
+  int          nqa = p7O_NQB_AVX(allocM); /* # of 32-uchar vectors needed for query, AVX2 */
+  int          nqt = nqa + p7O_EXTRA_SB;
+  int          nqg = p7O_NQF_AVX(allocM); /* # of 8-float vectors needed for query, AVX2   */
+#endif
+#ifdef HMMER_AVX512
+  int          nqv = p7O_NQW_AVX512(allocM); /* # of 32-sword vectors needed for query, AVX-512 */
+#endif
   int          x;
 
   /* level 0 */
@@ -70,40 +111,116 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
   om->twv     = NULL;
   om->rfv     = NULL;
   om->tfv     = NULL;
+  om->rbv_avx_mem = NULL;
+  om->sbv_avx_mem = NULL;
+  om->rbv_avx     = NULL;
+  om->sbv_avx     = NULL;
+  om->allocQ32    = 0;
+  om->sbv_isq_mem = NULL;
+  om->sbv_isq     = NULL;
+  om->rwv_avx512_mem = NULL;
+  om->twv_avx512_mem = NULL;
+  om->rwv_avx512     = NULL;
+  om->twv_avx512     = NULL;
+  om->allocQ32w      = 0;
+  om->rfv_avx_mem    = NULL;
+  om->tfv_avx_mem    = NULL;
+  om->rfv_avx        = NULL;
+  om->tfv_avx        = NULL;
+  om->allocQ8f       = 0;
   om->clone   = 0;
 
   /* level 1 */
-  ESL_ALLOC(om->rbv_mem, sizeof(__m128i) * nqb  * abc->Kp          +15); /* +15 is for manual 16-byte alignment */
-  ESL_ALLOC(om->sbv_mem, sizeof(__m128i) * nqs  * abc->Kp          +15); 
-  ESL_ALLOC(om->rwv_mem, sizeof(__m128i) * nqw  * abc->Kp          +15);                     
-  ESL_ALLOC(om->twv_mem, sizeof(__m128i) * nqw  * p7O_NTRANS       +15);   
-  ESL_ALLOC(om->rfv_mem, sizeof(__m128)  * nqf  * abc->Kp          +15);                     
-  ESL_ALLOC(om->tfv_mem, sizeof(__m128)  * nqf  * p7O_NTRANS       +15);    
-
   ESL_ALLOC(om->rbv, sizeof(__m128i *) * abc->Kp); 
   ESL_ALLOC(om->sbv, sizeof(__m128i *) * abc->Kp); 
   ESL_ALLOC(om->rwv, sizeof(__m128i *) * abc->Kp); 
   ESL_ALLOC(om->rfv, sizeof(__m128  *) * abc->Kp); 
 
-  /* align vector memory on 16-byte boundaries */
-  om->rbv[0] = (__m128i *) (((unsigned long int) om->rbv_mem + 15) & (~0xf));
-  om->sbv[0] = (__m128i *) (((unsigned long int) om->sbv_mem + 15) & (~0xf));
-  om->rwv[0] = (__m128i *) (((unsigned long int) om->rwv_mem + 15) & (~0xf));
-  om->twv    = (__m128i *) (((unsigned long int) om->twv_mem + 15) & (~0xf));
-  om->rfv[0] = (__m128  *) (((unsigned long int) om->rfv_mem + 15) & (~0xf));
-  om->tfv    = (__m128  *) (((unsigned long int) om->tfv_mem + 15) & (~0xf));
-
-  /* set the rest of the row pointers for match emissions */
-  for (x = 1; x < abc->Kp; x++) {
-    om->rbv[x] = om->rbv[0] + (x * nqb);
-    om->sbv[x] = om->sbv[0] + (x * nqs);
-    om->rwv[x] = om->rwv[0] + (x * nqw);
-    om->rfv[x] = om->rfv[0] + (x * nqf);
-  }
+  if (own_vectors)
+    {
+      ESL_ALLOC(om->rbv_mem, sizeof(__m128i) * nqb  * abc->Kp          +15); /* +15 is for manual 16-byte alignment */
+      ESL_ALLOC(om->sbv_mem, sizeof(__m128i) * nqs  * abc->Kp          +15); 
+      ESL_ALLOC(om->rwv_mem, sizeof(__m128i) * nqw  * abc->Kp          +15);                     
+      ESL_ALLOC(om->twv_mem, sizeof(__m128i) * nqw  * p7O_NTRANS       +15);   
+      ESL_ALLOC(om->rfv_mem, sizeof(__m128)  * nqf  * abc->Kp          +15);                     
+      ESL_ALLOC(om->tfv_mem, sizeof(__m128)  * nqf  * p7O_NTRANS       +15);    
+
+      /* align vector memory on 16-byte boundaries */
+      om->rbv[0] = (__m128i *) (((unsigned long int) om->rbv_mem + 15) & (~0xf));
+      om->sbv[0] = (__m128i *) (((unsigned long int) om->sbv_mem + 15) & (~0xf));
+      om->rwv[0] = (__m128i *) (((unsigned long int) om->rwv_mem + 15) & (~0xf));
+      om->twv    = (__m128i *) (((unsigned long int) om->twv_mem + 15) & (~0xf));
+      om->rfv[0] = (__m128  *) (((unsigned long int) om->rfv_mem + 15) & (~0xf));
+      om->tfv    = (__m128  *) (((unsigned long int) om->tfv_mem + 15) & (~0xf));
+
+      /* set the rest of the row pointers for match emissions */
+      for (x = 1; x < abc->Kp; x++) {
+	om->rbv[x] = om->rbv[0] + (x * nqb);
+	om->sbv[x] = om->sbv[0] + (x * nqs);
+	om->rwv[x] = om->rwv[0] + (x * nqw);
+	om->rfv[x] = om->rfv[0] + (x * nqf);
+      }
+    }
+  else
+    {				/* a shell: caller points these at its own memory */
+      for (x = 0; x < abc->Kp; x++) {
+	om->rbv[x] = om->sbv[x] = om->rwv[x] = NULL;
+	om->rfv[x] = NULL;
+      }
+    }
   om->allocQ16  = nqb;
   om->allocQ8   = nqw;
   om->allocQ4   = nqf;
 
+#ifdef HMMER_AVX2
+  /* the AVX2 filters' copy of the MSV scores, 32-way striped, on 32-byte boundaries;
+   * only if the processor will use them (see simd.c)
+   */
+  if (p7_simd_Level() >= p7_SIMD_AVX2) {
+    ESL_ALLOC(om->rbv_avx_mem, sizeof(uint8_t) * 32 * nqa * abc->Kp +31);
+    ESL_ALLOC(om->sbv_avx_mem, sizeof(int8_t)  * 32 * nqt * abc->Kp +31);
+    ESL_ALLOC(om->rbv_avx,     sizeof(uint8_t *) * abc->Kp);
+    ESL_ALLOC(om->sbv_avx,     sizeof(int8_t  *) * abc->Kp);
+    om->rbv_avx[0] = (uint8_t *) (((unsigned long int) om->rbv_avx_mem + 31) & (~0x1f));
+    om->sbv_avx[0] = (int8_t  *) (((unsigned long int) om->sbv_avx_mem + 31) & (~0x1f));
+    for (x = 1; x < abc->Kp; x++) {
+      om->rbv_avx[x] = om->rbv_avx[0] + (x * nqa * 32);
+      om->sbv_avx[x] = om->sbv_avx[0] + (x * nqt * 32);
+    }
+    om->allocQ32  = nqa;
+
+    /* the inter-sequence SSV filter's tables, for short queries only */
+    if (allocM <= p7O_ISSV_MAXM && abc->Kp < 32) {
+      ESL_ALLOC(om->sbv_isq_mem, sizeof(int8_t) * 64 * allocM +31);
+      om->sbv_isq = (int8_t *) (((unsigned long int) om->sbv_isq_mem + 31) & (~0x1f));
+    }
+
+    /* and the AVX2 parsers' copy of the Forward/Backward scores, 8-way striped */
+    ESL_ALLOC(om->rfv_avx_mem, sizeof(float) * 8 * nqg * abc->Kp    +31);
+    ESL_ALLOC(om->tfv_avx_mem, sizeof(float) * 8 * nqg * p7O_NTRANS +31);
+    ESL_ALLOC(om->rfv_avx,     sizeof(float *) * abc->Kp);
+    om->rfv_avx[0] = (float *) (((unsigned long int) om->rfv_avx_mem + 31) & (~0x1f));
+    om->tfv_avx    = (float *) (((unsigned long int) om->tfv_avx_mem + 31) & (~0x1f));
+    for (x = 1; x < abc->Kp; x++)
+      om->rfv_avx[x] = om->rfv_avx[0] + (x * nqg * 8);
+    om->allocQ8f  = nqg;
+  }
+#endif
+
+#ifdef HMMER_AVX512
+  /* the AVX-512 Viterbi filter's copy of the VF scores, 32-way striped, on 64-byte boundaries */
+  if (p7_simd_Level() >= p7_SIMD_AVX512) {
+    ESL_ALLOC(om->rwv_avx512_mem, sizeof(int16_t) * 32 * nqv * abc->Kp    +63);
+    ESL_ALLOC(om->twv_avx512_mem, sizeof(int16_t) * 32 * nqv * p7O_NTRANS +63);
+    ESL_ALLOC(om->rwv_avx512,     sizeof(int16_t *) * abc->Kp);
+    om->rwv_avx512[0] = (int16_t *) (((unsigned long int) om->rwv_avx512_mem + 63) & (~0x3f));
+    om->twv_avx512    = (int16_t *) (((unsigned long int) om->twv_avx512_mem + 63) & (~0x3f));
+    for (x = 1; x < abc->Kp; x++)
+      om->rwv_avx512[x] = om->rwv_avx512[0] + (x * nqv * 32);
+    om->allocQ32w = nqv;
+  }
+#endif
+
   /* Remaining initializations */
   om->tbm_b     = 0;
   om->tec_b     = 0;
@@ -188,6 +305,17 @@ p7_oprofile_Destroy(P7_OPROFILE *om)
       if (om->sbv       != NULL) free(om->sbv);
       if (om->rwv       != NULL) free(om->rwv);
       if (om->rfv       != NULL) free(om->rfv);
+      if (om->rbv_avx_mem != NULL) free(om->rbv_avx_mem);
+      if (om->sbv_avx_mem != NULL) free(om->sbv_avx_mem);
+      if (om->rbv_avx   != NULL) free(om->rbv_avx);
+      if (om->sbv_avx   != NULL) free(om->sbv_avx);
+      if (om->sbv_isq_mem != NULL) free(om->sbv_isq_mem);
+      if (om->rwv_avx512_mem != NULL) free(om->rwv_avx512_mem);
+      if (om->twv_avx512_mem != NULL) free(om->twv_avx512_mem);
+      if (om->rwv_avx512     != NULL) free(om->rwv_avx512);
+      if (om->rfv_avx_mem    != NULL) free(om->rfv_avx_mem);
+      if (om->tfv_avx_mem    != NULL) free(om->tfv_avx_mem);
+      if (om->rfv_avx        != NULL) free(om->rfv_avx);
       if (om->name      != NULL) free(om->name);
       if (om->acc       != NULL) free(om->acc);
       if (om->desc      != NULL) free(om->desc);
@@ -223,17 +351,38 @@ p7_oprofile_Sizeof(P7_OPROFILE *om)
    * maintainability and clarity.
    */
   n  += sizeof(P7_OPROFILE);
-  n  += sizeof(__m128i) * nqb  * om->abc->Kp +15; /* om->rbv_mem   */
-  n  += sizeof(__m128i) * nqs  * om->abc->Kp +15; /* om->sbv_mem   */
-  n  += sizeof(__m128i) * nqw  * om->abc->Kp +15; /* om->rwv_mem   */
-  n  += sizeof(__m128i) * nqw  * p7O_NTRANS  +15; /* om->twv_mem   */
-  n  += sizeof(__m128)  * nqf  * om->abc->Kp +15; /* om->rfv_mem   */
-  n  += sizeof(__m128)  * nqf  * p7O_NTRANS  +15; /* om->tfv_mem   */
+  if (om->rbv_mem) {	                          /* not in a p7_oprofile_CreateShell() profile */
+    n  += sizeof(__m128i) * nqb  * om->abc->Kp +15; /* om->rbv_mem   */
+    n  += sizeof(__m128i) * nqs  * om->abc->Kp +15; /* om->sbv_mem   */
+    n  += sizeof(__m128i) * nqw  * om->abc->Kp +15; /* om->rwv_mem   */
+    n  += sizeof(__m128i) * nqw  * p7O_NTRANS  +15; /* om->twv_mem   */
+    n  += sizeof(__m128)  * nqf  * om->abc->Kp +15; /* om->rfv_mem   */
+    n  += sizeof(__m128)  * nqf  * p7O_NTRANS  +15; /* om->tfv_mem   */
+  }
   
   n  += sizeof(__m128i *) * om->abc->Kp;          /* om->rbv       */
   n  += sizeof(__m128i *) * om->abc->Kp;          /* om->sbv       */
   n  += sizeof(__m128i *) * om->abc->Kp;          /* om->rwv       */
   n  += sizeof(__m128  *) * om->abc->Kp;          /* om->rfv       */
+
+  if (om->allocQ32) {
+    n  += sizeof(uint8_t) * 32 * om->allocQ32                  * om->abc->Kp +31; /* om->rbv_avx_mem */
+    n  += sizeof(int8_t)  * 32 * (om->allocQ32 + p7O_EXTRA_SB) * om->abc->Kp +31; /* om->sbv_avx_mem */
+    n  += sizeof(uint8_t *) * om->abc->Kp;                                        /* om->rbv_avx     */
+    n  += sizeof(int8_t  *) * om->abc->Kp;                                        /* om->sbv_avx     */
+  }
+  if (om->sbv_isq)
+    n  += sizeof(int8_t) * 64 * om->allocM +31;                                   /* om->sbv_isq_mem */
+  if (om->allocQ32w) {
+    n  += sizeof(int16_t) * 32 * om->allocQ32w * om->abc->Kp    +63;   /* om->rwv_avx512_mem */
+    n  += sizeof(int16_t) * 32 * om->allocQ32w * p7O_NTRANS     +63;   /* om->twv_avx512_mem */
+    n  += sizeof(int16_t *) * om->abc->Kp;                             /* om->rwv_avx512     */
+  }
+  if (om->allocQ8f) {
+    n  += sizeof(float) * 8 * om->allocQ8f * om->abc->Kp        +31;   /* om->rfv_avx_mem    */
+    n  += sizeof(float) * 8 * om->allocQ8f * p7O_NTRANS         +31;   /* om->tfv_avx_mem    */
+    n  += sizeof(float *) * om->abc->Kp;                               /* om->rfv_avx        */
+  }
   
   n  += sizeof(char) * (om->allocM+2);            /* om->rf        */
   n  += sizeof(char) * (om->allocM+2);            /* om->mm        */
@@ -285,6 +434,23 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   om2->twv     = NULL;
   om2->rfv     = NULL;
   om2->tfv     = NULL;
+  om2->rbv_avx_mem = NULL;
+  om2->sbv_avx_mem = NULL;
+  om2->rbv_avx     = NULL;
+  om2->sbv_avx     = NULL;
+  om2->allocQ32    = 0;
+  om2->sbv_isq_mem = NULL;
+  om2->sbv_isq     = NULL;
+  om2->rwv_avx512_mem = NULL;
+  om2->twv_avx512_mem = NULL;
+  om2->rwv_avx512     = NULL;
+  om2->twv_avx512     = NULL;
+  om2->allocQ32w      = 0;
+  om2->rfv_avx_mem    = NULL;
+  om2->tfv_avx_mem    = NULL;
+  om2->rfv_avx        = NULL;
+  om2->tfv_avx        = NULL;
+  om2->allocQ8f       = 0;
 
   /* level 1 */
   ESL_ALLOC(om2->rbv_mem, sizeof(__m128i) * nqb  * abc->Kp    +15);	/* +15 is for manual 16-byte alignment */
@@ -324,6 +490,65 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   om2->allocQ8   = nqw;
   om2->allocQ4   = nqf;
 
+  if (om1->allocQ32)
+    {
+      int nqa = om1->allocQ32;
+      int nqt = nqa + p7O_EXTRA_SB;
+
+      ESL_ALLOC(om2->rbv_avx_mem, sizeof(uint8_t) * 32 * nqa * abc->Kp +31);
+      ESL_ALLOC(om2->sbv_avx_mem, sizeof(int8_t)  * 32 * nqt * abc->Kp +31);
+      ESL_ALLOC(om2->rbv_avx,     sizeof(uint8_t *) * abc->Kp);
+      ESL_ALLOC(om2->sbv_avx,     sizeof(int8_t  *) * abc->Kp);
+      om2->rbv_avx[0] = (uint8_t *) (((unsigned long int) om2->rbv_avx_mem + 31) & (~0x1f));
+      om2->sbv_avx[0] = (int8_t  *) (((unsigned long int) om2->sbv_avx_mem + 31) & (~0x1f));
+      memcpy(om2->rbv_avx[0], om1->rbv_avx[0], sizeof(uint8_t) * 32 * nqa * abc->Kp);
+      memcpy(om2->sbv_avx[0], om1->sbv_avx[0], sizeof(int8_t)  * 32 * nqt * abc->Kp);
+      for (x = 1; x < abc->Kp; x++) {
+	om2->rbv_avx[x] = om2->rbv_avx[0] + (x * nqa * 32);
+	om2->sbv_avx[x] = om2->sbv_avx[0] + (x * nqt * 32);
+      }
+      om2->allocQ32 = nqa;
+    }
+
+  if (om1->sbv_isq)
+    {
+      ESL_ALLOC(om2->sbv_isq_mem, sizeof(int8_t) * 64 * om1->allocM +31);
+      om2->sbv_isq = (int8_t *) (((unsigned long int) om2->sbv_isq_mem + 31) & (~0x1f));
+      memcpy(om2->sbv_isq, om1->sbv_isq, sizeof(int8_t) * 64 * om1->allocM);
+    }
+
+  if (om1->allocQ32w)
+    {
+      int nqv = om1->allocQ32w;
+
+      ESL_ALLOC(om2->rwv_avx512_mem, sizeof(int16_t) * 32 * nqv * abc->Kp    +63);
+      ESL_ALLOC(om2->twv_avx512_mem, sizeof(int16_t) * 32 * nqv * p7O_NTRANS +63);
+      ESL_ALLOC(om2->rwv_avx512,     sizeof(int16_t *) * abc->Kp);
+      om2->rwv_avx512[0] = (int16_t *) (((unsigned long int) om2->rwv_avx512_mem + 63) & (~0x3f));
+      om2->twv_avx512    = (int16_t *) (((unsigned long int) om2->twv_avx512_mem + 63) & (~0x3f));
+      memcpy(om2->rwv_avx512[0], om1->rwv_avx512[0], sizeof(int16_t) * 32 * nqv * abc->Kp);
+      memcpy(om2->twv_avx512,    om1->twv_avx512,    sizeof(int16_t) * 32 * nqv * p7O_NTRANS);
+      for (x = 1; x < abc->Kp; x++)
+	om2->rwv_avx512[x] = om2->rwv_avx512[0] + (x * nqv * 32);
+      om2->allocQ32w = nqv;
+    }
+
+  if (om1->allocQ8f)
+    {
+      int nqg = om1->allocQ8f;
+
+      ESL_ALLOC(om2->rfv_avx_mem, sizeof(float) * 8 * nqg * abc->Kp    +31);
+      ESL_ALLOC(om2->tfv_avx_mem, sizeof(float) * 8 * nqg * p7O_NTRANS +31);
+      ESL_ALLOC(om2->rfv_avx,     sizeof(float *) * abc->Kp);
+      om2->rfv_avx[0] = (float *) (((unsigned long int) om2->rfv_avx_mem + 31) & (~0x1f));
+      om2->tfv_avx    = (float *) (((unsigned long int) om2->tfv_avx_mem + 31) & (~0x1f));
+      memcpy(om2->rfv_avx[0], om1->rfv_avx[0], sizeof(float) * 8 * nqg * abc->Kp);
+      memcpy(om2->tfv_avx,    om1->tfv_avx,    sizeof(float) * 8 * nqg * p7O_NTRANS);
+      for (x = 1; x < abc->Kp; x++)
+	om2->rfv_avx[x] = om2->rfv_avx[0] + (x * nqg * 8);
+      om2->allocQ8f = nqg;
+    }
+
   /* Remaining initializations */
   om2->tbm_b     = om1->tbm_b;
   om2->tec_b     = om1->tec_b;
@@ -379,7 +604,7 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   om2->nj        = om1->nj;
   om2->max_length   = om1->max_length;
 
-  om2->clone     = om1->clone;
+  om2->clone     = 0;		/* a copy owns its memory, even if <om1> is a clone */
 
   return om2;
 
@@ -395,6 +620,15 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
  * Incept:    SRE, Sun Nov 25 12:03:19 2007 [Casa de Gatos]
  *
  * Purpose:   Quick copy of an optimized profile used in mutiple threads.
+ *            Only the structure itself is copied: the striped score
+ *            vectors stay shared and must be treated as read-only.
+ *            What a clone owns is its length configuration (<L> and
+ *            the N/C/J costs in <tjb_b>, <xw>, <xf>), so each thread
+ *            can <p7_oprofile_ReconfigLength()> its clone for its own
+ *            targets while all threads read one copy of the scores.
+ *            The original must outlive its clones, and nothing that
+ *            rewrites scores (e.g. <p7_oprofile_Update*EmissionScores()>)
+ *            may be called on a clone; use <p7_oprofile_Copy()> then.
  *
  * Throws:    <NULL> on allocation error.
  */
@@ -481,7 +715,7 @@ p7_oprofile_UpdateFwdEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emiss
     }
   }
 
-  return eslOK;
+  return p7_oprofile_RestripeFB(om);
 }
 
 
@@ -550,7 +784,7 @@ p7_oprofile_UpdateVitEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emiss
     }
   }
 
-  return eslOK;
+  return p7_oprofile_RestripeVF(om);
 }
 
 
@@ -647,6 +881,129 @@ p7_oprofile_UpdateMSVEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emiss
 }
 
 
+/* Function:  p7_oprofile_CreatePack()
+ * Synopsis:  Allocate an empty <P7_OM_PACK>.
+ *
+ * Purpose:   Allocate a pack for the multi-model SSV filter. It's
+ *            empty; <p7_oprofile_SetPack()> fills it, reallocating
+ *            as needed, so one pack can be reused for many sets of
+ *            profiles.
+ *
+ * Returns:   a pointer to the new pack.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_OM_PACK *
+p7_oprofile_CreatePack(void)
+{
+  P7_OM_PACK *pk = NULL;
+  int         status;
+
+  ESL_ALLOC(pk, sizeof(P7_OM_PACK));
+  pk->n       = 0;
+  pk->M       = 0;
+  pk->Kp      = 0;
+  pk->sbv     = NULL;
+  pk->sbv_mem = NULL;
+  pk->allocS  = 0;
+  pk->dpv     = NULL;
+  pk->dpv_mem = NULL;
+  pk->allocR  = 0;
+  return pk;
+
+ ERROR:
+  p7_oprofile_DestroyPack(pk);
+  return NULL;
+}
+
+/* Function:  p7_oprofile_SetPack()
+ * Synopsis:  Interleave the SSV scores of several profiles.
+ *
+ * Purpose:   Fill pack <pk> with the SSV scores of the <n> profiles
+ *            <om[0..n-1]>, profile <s> in lane <s>, for
+ *            <p7_SSVFilter_Pack()>. The profiles must share an
+ *            alphabet. Only their <sbv> scores are used, so profiles
+ *            that have only been read as far as the MSV filter data
+ *            will do.
+ *
+ *            The kernel's work is set by the longest profile, so the
+ *            caller should pack profiles of similar length together.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <n> is out of range or the alphabets differ.
+ *            <eslEMEM> on allocation failure.
+ */
+int
+p7_oprofile_SetPack(P7_OM_PACK *pk, P7_OPROFILE **om, int n)
+{
+  int64_t  nbytes;
+  int8_t  *sb;			/* one striped row of <om[s]->sbv>       */
+  int      Kp, M, nq;
+  int      s, x, k, j;
+  int      status;
+
+  if (n < 1 || n > p7O_PACK_LANES) ESL_EXCEPTION(eslEINVAL, "bad number of profiles for a pack");
+
+  Kp = om[0]->abc->Kp;
+  for (M = 0, s = 0; s < n; s++)
+    {
+      if (om[s]->abc->Kp != Kp) ESL_EXCEPTION(eslEINVAL, "profiles in a pack must share an alphabet");
+      M = ESL_MAX(M, om[s]->M);
+    }
+  M      = ((M + p7O_PACK_BAND - 1) / p7O_PACK_BAND) * p7O_PACK_BAND;
+  nbytes = (int64_t) Kp * M * p7O_PACK_LANES;
+
+  if (nbytes > pk->allocS)
+    {
+      if (pk->sbv_mem) free(pk->sbv_mem);
+      ESL_ALLOC(pk->sbv_mem, nbytes + 31);
+      pk->sbv    = (int8_t *) (((unsigned long int) pk->sbv_mem + 31) & (~0x1f));
+      pk->allocS = nbytes;
+    }
+  pk->n  = n;
+  pk->M  = M;
+  pk->Kp = Kp;
+
+  /* 127 everywhere the profiles don't reach, then each profile's
+   * scores, reading its striped rows in order: element z of vector
+   * q is position k = q + z*nq.
+   */
+  memset(pk->sbv, 127, nbytes);
+  for (s = 0; s < n; s++)
+    {
+      nq = p7O_NQB(om[s]->M);
+      for (x = 0; x < Kp; x++)
+	{
+	  sb = (int8_t *) om[s]->sbv[x];
+	  for (j = 0; j < nq*16; j++)
+	    {
+	      k = (j / 16) + (j % 16) * nq;
+	      if (k < om[s]->M) pk->sbv[((int64_t) x * M + k) * p7O_PACK_LANES + s] = sb[j];
+	    }
+	}
+    }
+  return eslOK;
+
+ ERROR:
+  pk->allocS = 0;
+  pk->sbv    = NULL;
+  return status;
+}
+
+/* Function:  p7_oprofile_DestroyPack()
+ * Synopsis:  Free a <P7_OM_PACK>.
+ */
+void
+p7_oprofile_DestroyPack(P7_OM_PACK *pk)
+{
+  if (pk == NULL) return;
+  if (pk->sbv_mem) free(pk->sbv_mem);
+  if (pk->dpv_mem) free(pk->dpv_mem);
+  free(pk);
+}
+
+
 /*----------------- end, P7_OPROFILE structure ------------------*/
 
 
@@ -757,7 +1114,7 @@ sf_conversion(P7_OPROFILE *om)
       for (q = nq; q < nq + p7O_EXTRA_SB; q++) om->sbv[x][q] = om->sbv[x][q % nq];
     }
 
-  return eslOK;
+  return p7_oprofile_RestripeMSV(om);
 }
 
 /* mf_conversion(): 
@@ -917,7 +1274,7 @@ vf_conversion(const P7_PROFILE *gm, P7_OPROFILE *om)
       om->ddbound_w = ESL_MAX(om->ddbound_w, ddtmp);
     }
 
-  return eslOK;
+  return p7_oprofile_RestripeVF(om);
 }
 
 
@@ -990,6 +1347,210 @@ fb_conversion(const P7_PROFILE *gm, P7_OPROFILE *om)
   om->xf[p7O_J][p7O_LOOP] = expf(gm->xsc[p7P_J][p7P_LOOP]);
   om->xf[p7O_J][p7O_MOVE] = expf(gm->xsc[p7P_J][p7P_MOVE]);
 
+  return p7_oprofile_RestripeFB(om);
+}
+
+
+/* Function:  p7_oprofile_RestripeMSV()
+ * Synopsis:  Make the AVX2 copy of the MSV/SSV filter scores.
+ *
+ * Purpose:   Copy the 16-way striped MSV match costs in <om->rbv>
+ *            into the 32-way striped <om->rbv_avx> used by the AVX2
+ *            filters, and derive the SSV scores <om->sbv_avx> from
+ *            them (including the <p7O_EXTRA_SB> wraparound vectors)
+ *            the same way that sf_conversion() derives <om->sbv>.
+ *            For a short query, also fill in the inter-sequence SSV
+ *            filter's lookup tables <om->sbv_isq>: for each position
+ *            k, 64 bytes holding the SSV scores of residues 0..15
+ *            twice, then of residues 16..31 twice, so one 256-bit
+ *            byte shuffle can look up a score for every lane. Residue
+ *            codes >= Kp (including the padding code the filter uses
+ *            past the end of a sequence) get 127, which saturates
+ *            any running score to the bottom.
+ *
+ *            Anything that sets <om->rbv> must call this afterwards:
+ *            profile conversion, emission score updates, and input
+ *            from a pressed database or an MPI message. Requires
+ *            <om->M> and <om->bias_b> to be set.
+ *
+ *            If <om> has no AVX2 score arrays (because HMMER was
+ *            compiled without AVX2 support), do nothing.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <om> wasn't allocated big enough.
+ */
+int
+p7_oprofile_RestripeMSV(P7_OPROFILE *om)
+{
+  int      M     = om->M;
+  int      nq    = p7O_NQB(M);     /* # of 16-uchar vectors in rbv     */
+  int      nqa   = p7O_NQB_AVX(M); /* # of 32-uchar vectors in rbv_avx */
+  int      nqt   = nqa + p7O_EXTRA_SB;
+  uint8_t  sbias = om->bias_b + 127;
+  uint8_t *rb;			/* one row of 16-way striped uchars */
+  int      x;			/* counter over residues            */
+  int      j;			/* counter over uchars in a row     */
+  int      k;			/* model position k-1, 0..M-1       */
+
+  if (om->rbv_avx == NULL) return eslOK;
+  if (nqa > om->allocQ32)  ESL_EXCEPTION(eslEINVAL, "optimized profile is too small to hold AVX2 scores");
+
+  for (x = 0; x < om->abc->Kp; x++)
+    {
+      rb = (uint8_t *) om->rbv[x];
+
+      /* element z of vector q holds k = q+1 + z*nqa; unused cells are the +255 "prohibited" cost */
+      for (j = 0; j < nqa*32; j++)
+	{
+	  k = (j / 32) + (j % 32) * nqa;
+	  om->rbv_avx[x][j] = (k < M) ? rb[(k % nq) * 16 + (k / nq)] : 255;
+	}
+
+      /* ((127 + bias) - rbv) ^ 127, with unsigned saturated subtraction; see sf_conversion() */
+      for (j = 0; j < nqa*32; j++)
+	om->sbv_avx[x][j] = (int8_t) (((sbias > om->rbv_avx[x][j]) ? sbias - om->rbv_avx[x][j] : 0) ^ 127);
+      for (j = nqa*32; j < nqt*32; j++)
+	om->sbv_avx[x][j] = om->sbv_avx[x][j % (nqa*32)];
+    }
+
+  if (om->sbv_isq != NULL)
+    {
+      if (M > om->allocM) ESL_EXCEPTION(eslEINVAL, "optimized profile is too small to hold inter-sequence SSV scores");
+      for (k = 0; k < M; k++)
+	for (x = 0; x < 32; x++)
+	  {
+	    j = (x < om->abc->Kp) ? ((uint8_t *) om->rbv[x])[(k % nq) * 16 + (k / nq)] : 255;
+	    j = ((sbias > j) ? sbias - j : 0) ^ 127;
+	    om->sbv_isq[k*64 + (x/16)*32      + x%16] = (int8_t) j;
+	    om->sbv_isq[k*64 + (x/16)*32 + 16 + x%16] = (int8_t) j;
+	  }
+    }
+  return eslOK;
+}
+
+
+/* Function:  p7_oprofile_RestripeVF()
+ * Synopsis:  Make the AVX-512 copy of the Viterbi filter scores.
+ *
+ * Purpose:   Copy the 8-way striped ViterbiFilter match scores
+ *            <om->rwv> and transition scores <om->twv> into the
+ *            32-way striped <om->rwv_avx512> and <om->twv_avx512>
+ *            used by the AVX-512BW Viterbi filter. The transition
+ *            blocks keep the same order as <om->twv>: seven
+ *            interleaved transitions <p7O_BM..p7O_II> for each <q>,
+ *            followed by the <p7O_DD>'s.
+ *
+ *            Like p7_oprofile_RestripeMSV(), anything that sets
+ *            <om->rwv> or <om->twv> must call this afterwards.
+ *            Requires <om->M> to be set.
+ *
+ *            If <om> has no AVX-512 score arrays, do nothing.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <om> wasn't allocated big enough.
+ */
+int
+p7_oprofile_RestripeVF(P7_OPROFILE *om)
+{
+  int      M     = om->M;
+  int      nq    = p7O_NQW(M);        /* # of 8-sword vectors in rwv          */
+  int      nqv   = p7O_NQW_AVX512(M); /* # of 32-sword vectors in rwv_avx512  */
+  int16_t *rw;			/* one row of 8-way striped swords      */
+  int16_t *tw    = (int16_t *) om->twv;
+  int      x;			/* counter over residues                */
+  int      t;			/* counter over transitions p7O_BM..II  */
+  int      q, z;		/* vector, element in the 32-way layout */
+  int      k;			/* cell index q + z*nqv, 0..nqv*32-1    */
+
+  if (om->rwv_avx512 == NULL) return eslOK;
+  if (nqv > om->allocQ32w)    ESL_EXCEPTION(eslEINVAL, "optimized profile is too small to hold AVX-512 scores");
+
+  /* Cell k of either striping (element z of vector q, k = q + z*Q)
+   * holds the same model position. Cells beyond the 8-way row are
+   * unused, and get the same -infinity as unused cells in it.
+   */
+  for (x = 0; x < om->abc->Kp; x++)
+    {
+      rw = (int16_t *) om->rwv[x];
+      for (q = 0; q < nqv; q++)
+	for (z = 0; z < 32; z++)
+	  {
+	    k = q + z*nqv;
+	    om->rwv_avx512[x][q*32+z] = (k < nq*8) ? rw[(k % nq) * 8 + (k / nq)] : -32768;
+	  }
+    }
+
+  for (q = 0; q < nqv; q++)
+    for (z = 0; z < 32; z++)
+      {
+	k = q + z*nqv;
+	for (t = p7O_BM; t <= p7O_II; t++)
+	  om->twv_avx512[(q*7 + t)*32 + z] = (k < nq*8) ? tw[((k % nq)*7 + t) * 8 + (k / nq)] : -32768;
+	om->twv_avx512[(7*nqv + q)*32 + z]  = (k < nq*8) ? tw[(7*nq + (k % nq)) * 8 + (k / nq)] : -32768;
+      }
+  return eslOK;
+}
+
+
+/* Function:  p7_oprofile_RestripeFB()
+ * Synopsis:  Make the AVX2 copy of the Forward/Backward scores.
+ *
+ * Purpose:   Copy the 4-way striped Forward/Backward match emission
+ *            odds <om->rfv> and transition probabilities <om->tfv>
+ *            into the 8-way striped <om->rfv_avx> and <om->tfv_avx>
+ *            used by the AVX2 parsers, in the same block order as
+ *            <om->tfv>.
+ *
+ *            Like p7_oprofile_RestripeMSV(), anything that sets
+ *            <om->rfv> or <om->tfv> must call this afterwards.
+ *            Requires <om->M> to be set.
+ *
+ *            If <om> has no AVX2 score arrays, do nothing.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <om> wasn't allocated big enough.
+ */
+int
+p7_oprofile_RestripeFB(P7_OPROFILE *om)
+{
+  int      M     = om->M;
+  int      nq    = p7O_NQF(M);      /* # of 4-float vectors in rfv          */
+  int      nqg   = p7O_NQF_AVX(M);  /* # of 8-float vectors in rfv_avx      */
+  float   *rf;			/* one row of 4-way striped floats      */
+  float   *tf    = (float *) om->tfv;
+  int      x;			/* counter over residues                */
+  int      t;			/* counter over transitions p7O_BM..II  */
+  int      q, z;		/* vector, element in the 8-way layout  */
+  int      k;			/* cell index q + z*nqg, 0..nqg*8-1     */
+
+  if (om->rfv_avx == NULL) return eslOK;
+  if (nqg > om->allocQ8f)  ESL_EXCEPTION(eslEINVAL, "optimized profile is too small to hold AVX2 parser scores");
+
+  /* As in p7_oprofile_RestripeVF(): cell k means the same model
+   * position in either striping. Unused cells are probability 0.
+   */
+  for (x = 0; x < om->abc->Kp; x++)
+    {
+      rf = (float *) om->rfv[x];
+      for (q = 0; q < nqg; q++)
+	for (z = 0; z < 8; z++)
+	  {
+	    k = q + z*nqg;
+	    om->rfv_avx[x][q*8+z] = (k < nq*4) ? rf[(k % nq) * 4 + (k / nq)] : 0.0f;
+	  }
+    }
+
+  for (q = 0; q < nqg; q++)
+    for (z = 0; z < 8; z++)
+      {
+	k = q + z*nqg;
+	for (t = p7O_BM; t <= p7O_II; t++)
+	  om->tfv_avx[(q*7 + t)*8 + z] = (k < nq*4) ? tf[((k % nq)*7 + t) * 4 + (k / nq)] : 0.0f;
+	om->tfv_avx[(7*nqg + q)*8 + z]  = (k < nq*4) ? tf[(7*nq + (k % nq)) * 4 + (k / nq)] : 0.0f;
+      }
   return eslOK;
 }
 
@@ -0,0 +1,484 @@
+/* Runtime selection of vector DP kernels.
+ *
+ * The SSE implementation may also carry AVX2 and AVX-512 versions of
+ * some of its kernels (see HMMER_AVX2, HMMER_AVX512 in configure).
+ * Which ones we use is decided once, at runtime, from what the
+ * processor supports, so one binary runs at full speed on any x86
+ * host. The public entry points (p7_MSVFilter(), p7_ViterbiFilter(),
+ * etc.) call through a table of function pointers that's filled in
+ * here.
+ *
+ * The choice can be lowered (never raised past what the processor
+ * supports) with the HMMER_SIMD environment variable, or with
+ * p7_simd_Set(): "sse", "avx2", "avx512", or "auto".
+ *
+ * The choice also determines which restriped score arrays
+ * p7_oprofile_Create() allocates, and how big a row p7_omx_Create()
+ * allocates for the wide kernels, so it has to be made before any
+ * profiles or DP matrices are created. Anything that calls one of
+ * those does it automatically; impl_Init() does it explicitly.
+ *
+ * Contents:
+ *   1. Kernel selection
+ *   2. Unit tests
+ *   3. Test driver
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
+#include "easel.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static P7_SIMD_KERNELS kernels;          /* the current selection                         */
+static int             simd_detected;    /* best level the processor supports, p7_SIMD_*  */
+static int             simd_initialized = FALSE;
+#ifdef HMMER_THREADS
+static pthread_once_t  simd_once = PTHREAD_ONCE_INIT;
+#endif
+
+static int  simd_detect(void);
+static int  simd_parse (const char *s, int detected, int *ret_level);
+static void simd_select(int level);
+static void simd_init_once(void);
+
+/*****************************************************************
+ * 1. Kernel selection
+ *****************************************************************/
+
+/* Function:  p7_simd_Init()
+ * Synopsis:  Choose vector kernels for this processor.
+ *
+ * Purpose:   Detect the best vector instruction set the processor
+ *            supports, lower it to the one named by the <HMMER_SIMD>
+ *            environment variable if that's set, and fill in the
+ *            kernel dispatch table accordingly.
+ *
+ *            Only the first call does anything, so it's safe (and
+ *            cheap) to call it from anywhere, including from each
+ *            worker thread's impl_Init(). An unrecognized
+ *            <HMMER_SIMD> value is ignored.
+ *
+ * Returns:   <eslOK>.
+ */
+int
+p7_simd_Init(void)
+{
+#ifdef HMMER_THREADS
+  pthread_once(&simd_once, simd_init_once);
+#else
+  if (! simd_initialized) simd_init_once();
+#endif
+  return eslOK;
+}
+
+
+/* Function:  p7_simd_Set()
+ * Synopsis:  Override the automatic kernel choice.
+ *
+ * Purpose:   Use the kernels for vector instruction set <level>
+ *            (<p7_SIMD_SSE>, <p7_SIMD_AVX2>, <p7_SIMD_AVX512>), or
+ *            the best one the processor supports if that's lower.
+ *
+ *            Must be called before any optimized profiles or DP
+ *            matrices are created, since they're allocated for the
+ *            kernels in use at the time; and not while other threads
+ *            may be running DP.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <level> isn't a valid level.
+ */
+int
+p7_simd_Set(int level)
+{
+  if (level < p7_SIMD_SSE || level > p7_SIMD_AVX512) ESL_EXCEPTION(eslEINVAL, "no such SIMD level %d", level);
+  p7_simd_Init();
+  simd_select(ESL_MIN(level, simd_detected));
+  return eslOK;
+}
+
+
+/* Function:  p7_simd_Parse()
+ * Synopsis:  Convert a SIMD level name to its code.
+ *
+ * Purpose:   Convert <s>, one of "sse", "avx2", "avx512", or "auto"
+ *            (case-insensitive) to <p7_SIMD_SSE>, <p7_SIMD_AVX2>,
+ *            <p7_SIMD_AVX512>, or the best level the processor
+ *            supports, respectively, and return it in <*ret_level>.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEINVAL> if <s> isn't recognized; <*ret_level> is
+ *            unchanged.
+ */
+int
+p7_simd_Parse(const char *s, int *ret_level)
+{
+  p7_simd_Init();
+  return simd_parse(s, simd_detected, ret_level);
+}
+
+
+/* Function:  p7_simd_Level()
+ * Synopsis:  Return the SIMD level in use.
+ */
+int
+p7_simd_Level(void)
+{
+  p7_simd_Init();
+  return kernels.level;
+}
+
+
+/* Function:  p7_simd_Name()
+ * Synopsis:  Return the name of a SIMD level, for output.
+ */
+const char *
+p7_simd_Name(int level)
+{
+  switch (level) {
+  case p7_SIMD_SSE:    return "sse";
+  case p7_SIMD_AVX2:   return "avx2";
+  case p7_SIMD_AVX512: return "avx512";
+  }
+  return "unknown";
+}
+
+
+/* Function:  p7_simd_Kernels()
+ * Synopsis:  Return the kernel dispatch table.
+ *
+ * Purpose:   Return a pointer to the current kernel dispatch table,
+ *            initializing it first if necessary. This is what the
+ *            public DP entry points call through.
+ */
+const P7_SIMD_KERNELS *
+p7_simd_Kernels(void)
+{
+  if (! simd_initialized) p7_simd_Init();
+  return &kernels;
+}
+
+
+/* Function:  p7_simd_Report()
+ * Synopsis:  Report which kernels are in use.
+ *
+ * Purpose:   Print the processor's best supported vector instruction
+ *            set, and the implementation chosen for each dispatched
+ *            kernel, to <ofp>, in the "# name: value" style of the
+ *            search programs' output headers.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> on write failure.
+ */
+int
+p7_simd_Report(FILE *ofp)
+{
+  const P7_SIMD_KERNELS *k = p7_simd_Kernels();
+
+  if (fprintf(ofp, "# vector instructions supported:    %s\n", p7_simd_Name(simd_detected))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(ofp, "# vector instructions selected:     %s\n", p7_simd_Name(k->level))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(ofp, "# SSV/MSV filter kernels:           %s\n", p7_simd_Name(k->msv_level))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(ofp, "# Viterbi filter kernels:           %s\n", p7_simd_Name(k->vf_level))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(ofp, "# Forward/Backward parser kernels:  %s\n", p7_simd_Name(k->fb_level))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(ofp, "# decoding, alignment kernels:      %s\n", p7_simd_Name(k->decode_level))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  return eslOK;
+}
+
+
+/* simd_detect()
+ * Returns the best SIMD level that this processor and OS support,
+ * of the ones HMMER was compiled with. The compiler's cpuid builtins
+ * also check that the OS saves the wide registers (XGETBV).
+ */
+static int
+simd_detect(void)
+{
+  int level = p7_SIMD_SSE;
+
+#if defined(__GNUC__) && (defined(HMMER_AVX2) || defined(HMMER_AVX512))
+  __builtin_cpu_init();
+#ifdef HMMER_AVX2
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) level = p7_SIMD_AVX2;
+#endif
+#ifdef HMMER_AVX512
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    level = p7_SIMD_AVX512;
+#endif
+#endif
+  return level;
+}
+
+
+/* simd_parse()
+ * The body of p7_simd_Parse(), with the processor's best level
+ * <detected> given, so that simd_init_once() can use it before
+ * initialization is done: p7_simd_Init() from there would deadlock
+ * on <simd_once> (or recurse, without threads).
+ */
+static int
+simd_parse(const char *s, int detected, int *ret_level)
+{
+  if      (strcasecmp(s, "sse")    == 0) *ret_level = p7_SIMD_SSE;
+  else if (strcasecmp(s, "avx2")   == 0) *ret_level = p7_SIMD_AVX2;
+  else if (strcasecmp(s, "avx512") == 0) *ret_level = p7_SIMD_AVX512;
+  else if (strcasecmp(s, "auto")   == 0) *ret_level = detected;
+  else return eslEINVAL;
+  return eslOK;
+}
+
+
+/* simd_select()
+ * Fill in the dispatch table for SIMD level <level>, which must
+ * already be known to be supported. Each kernel gets the widest
+ * implementation we have that doesn't exceed <level>.
+ */
+static void
+simd_select(int level)
+{
+  kernels.level                   = level;
+
+  kernels.msv_level               = p7_SIMD_SSE;
+  kernels.SSVFilter               = p7_SSVFilter_sse;
+  kernels.MSVFilter               = p7_MSVFilter_sse;
+  kernels.SSVFilter_Batch         = NULL;             /* no SSE inter-sequence kernel */
+  kernels.SSVFilter_Pack          = p7_SSVFilter_Pack_sse;
+#ifdef HMMER_AVX2
+  if (level >= p7_SIMD_AVX2) {
+    kernels.msv_level             = p7_SIMD_AVX2;
+    kernels.SSVFilter             = p7_SSVFilter_avx2;
+    kernels.MSVFilter             = p7_MSVFilter_avx2;
+    kernels.SSVFilter_Batch       = p7_SSVFilter_Batch_avx2;
+    kernels.SSVFilter_Pack        = p7_SSVFilter_Pack_avx2;
+  }
+#endif
+
+  kernels.vf_level                = p7_SIMD_SSE;
+  kernels.ViterbiFilter           = p7_ViterbiFilter_sse;
+  kernels.ViterbiFilter_longtarget= p7_ViterbiFilter_longtarget_sse;
+#ifdef HMMER_AVX512
+  if (level >= p7_SIMD_AVX512) {
+    kernels.vf_level              = p7_SIMD_AVX512;
+    kernels.ViterbiFilter         = p7_ViterbiFilter_avx512;
+    kernels.ViterbiFilter_longtarget = p7_ViterbiFilter_longtarget_avx512;
+  }
+#endif
+
+  kernels.fb_level                = p7_SIMD_SSE;
+  kernels.ForwardParser           = p7_ForwardParser_sse;
+  kernels.BackwardParser          = p7_BackwardParser_sse;
+#ifdef HMMER_AVX2
+  if (level >= p7_SIMD_AVX2) {
+    kernels.fb_level              = p7_SIMD_AVX2;
+    kernels.ForwardParser         = p7_ForwardParser_avx2;
+    kernels.BackwardParser        = p7_BackwardParser_avx2;
+  }
+#endif
+
+  kernels.decode_level            = p7_SIMD_SSE;
+  kernels.Decoding                = p7_Decoding_sse;
+  kernels.OptimalAccuracy         = p7_OptimalAccuracy_sse;
+}
+
+
+/* simd_init_once()
+ * The body of p7_simd_Init(), which runs exactly once.
+ */
+static void
+simd_init_once(void)
+{
+  char *s     = getenv("HMMER_SIMD");
+  int   level;
+
+  simd_detected = simd_detect();
+  level         = simd_detected;
+  if (s != NULL && simd_parse(s, simd_detected, &level) == eslOK) level = ESL_MIN(level, simd_detected);
+  simd_select(level);
+  simd_initialized = TRUE;
+}
+/*------------------- end, kernel selection ---------------------*/
+
+
+
+
+/*****************************************************************
+ * 2. Unit tests
+ *****************************************************************/
+#ifdef p7SIMD_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* utest_env_auto()
+ * HMMER_SIMD=auto, seen by the first dispatch, selects the best
+ * supported level. Must run before anything initializes the
+ * dispatch table.
+ */
+static void
+utest_env_auto(void)
+{
+  char msg[] = "simd HMMER_SIMD=auto unit test failed";
+  int  level = -1;
+
+  if (setenv("HMMER_SIMD", "auto", 1) != 0)       esl_fatal(msg);
+  if (p7_simd_Kernels()->MSVFilter == NULL)       esl_fatal(msg);
+  if (p7_simd_Parse("auto", &level)  != eslOK)    esl_fatal(msg);
+  if (p7_simd_Level() != level)                   esl_fatal(msg);
+  unsetenv("HMMER_SIMD");
+}
+
+/* utest_selection()
+ * Setting a level gives that level, clamped to what's supported;
+ * names parse back to their codes.
+ */
+static void
+utest_selection(void)
+{
+  char msg[] = "simd selection unit test failed";
+  int  best  = p7_simd_Level();
+  int  level;
+
+  if (p7_simd_Set(p7_SIMD_SSE)    != eslOK)       esl_fatal(msg);
+  if (p7_simd_Level()             != p7_SIMD_SSE) esl_fatal(msg);
+  if (p7_simd_Kernels()->MSVFilter     != p7_MSVFilter_sse)     esl_fatal(msg);
+  if (p7_simd_Kernels()->ViterbiFilter != p7_ViterbiFilter_sse) esl_fatal(msg);
+  if (p7_simd_Set(p7_SIMD_AVX512) != eslOK)       esl_fatal(msg);
+  if (p7_simd_Level()             != best)        esl_fatal(msg);
+
+  for (level = p7_SIMD_SSE; level <= p7_SIMD_AVX512; level++)
+    {
+      int code = -1;
+      if (p7_simd_Parse(p7_simd_Name(level), &code) != eslOK || code != level) esl_fatal(msg);
+    }
+  if (p7_simd_Parse("mmx", &level) != eslEINVAL) esl_fatal(msg);
+}
+
+/* utest_consistency()
+ * Every level this processor supports must give the same filter
+ * scores as plain SSE, for a random model of length <M> and <N>
+ * random sequences of length <L>.
+ */
+static void
+utest_consistency(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char         msg[] = "simd consistency unit test failed";
+  int          best  = p7_simd_Level();
+  P7_HMM      *hmm   = NULL;
+  P7_PROFILE  *gm    = NULL;
+  P7_OPROFILE *om1   = NULL;
+  P7_OPROFILE *om2   = NULL;
+  P7_OMX      *ox1   = NULL;
+  P7_OMX      *ox2   = NULL;
+  ESL_DSQ     *dsq   = malloc(sizeof(ESL_DSQ) * (L+2));
+  float        sc1, sc2;
+  int          st1, st2;
+
+  p7_simd_Set(p7_SIMD_SSE);
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om1);
+  ox1 = p7_omx_Create(M, 0, 0);
+
+  p7_simd_Set(best);
+  om2 = p7_oprofile_Create(gm->M, abc);
+  p7_oprofile_Convert(gm, om2);
+  p7_oprofile_ReconfigLength(om2, L);
+  ox2 = p7_omx_Create(M, 0, 0);
+
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+
+      st1 = p7_MSVFilter_sse(dsq, L, om1, ox1, &sc1);
+      st2 = p7_MSVFilter    (dsq, L, om2, ox2, &sc2);
+      if (st1 != st2 || (st1 == eslOK && sc1 != sc2)) esl_fatal(msg);
+
+      st1 = p7_ViterbiFilter_sse(dsq, L, om1, ox1, &sc1);
+      st2 = p7_ViterbiFilter    (dsq, L, om2, ox2, &sc2);
+      if (st1 != st2 || (st1 == eslOK && sc1 != sc2)) esl_fatal(msg);
+    }
+
+  free(dsq);
+  p7_omx_Destroy(ox1);
+  p7_omx_Destroy(ox2);
+  p7_oprofile_Destroy(om1);
+  p7_oprofile_Destroy(om2);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+}
+#endif /*p7SIMD_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+
+/*****************************************************************
+ * 3. Test driver
+ *****************************************************************/
+#ifdef p7SIMD_TESTDRIVE
+/*
+   ./simd_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "size of random sequences to sample",             0 },
+  { "-M",        eslARG_INT,    "145", NULL, NULL,  NULL,  NULL, NULL, "size of random models to sample",                0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for runtime selection of vector kernels";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  utest_env_auto();	/* first: it tests initialization itself */
+
+  impl_Init();
+  if (esl_opt_GetBoolean(go, "-v")) p7_simd_Report(stdout);
+
+  utest_selection();
+
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  utest_consistency(r, abc, bg, M,  L, N);
+  utest_consistency(r, abc, bg, 1,  L, 10);
+  utest_consistency(r, abc, bg, M,  1, 10);
+  utest_consistency(r, abc, bg, 33, L, 10);
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7SIMD_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
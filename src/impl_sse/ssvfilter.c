@@ -3,6 +3,7 @@
  * Contents:
  *   1. Introduction
  *   2. p7_SSVFilter() implementation
+ *   3. p7_SSVFilter_Pack(): one sequence, many profiles
  * 
  * Bjarne Knudsen, CLC Bio
  */
@@ -406,6 +407,7 @@
 #include <p7_config.h>
 
 #include <math.h>
+#include <stdlib.h>
 
 #include <xmmintrin.h>		/* SSE  */
 #include <emmintrin.h>		/* SSE2 */
@@ -872,20 +874,64 @@ get_xE(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om)
 }
 
 
+/* Function:  p7_SSVFilter()
+ * Synopsis:  Calculates SSV score, or returns <eslENORESULT>.
+ *
+ * Purpose:   Calculates the SSV score of <dsq> of length <L> against
+ *            optimized profile <om>, and returns it in <*ret_sc>.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> if the score overflows; this is a high-scoring hit.
+ *            <eslENORESULT> if the SSV shortcut can't be used for this
+ *            profile, and the full MSV calculation must be done.
+ *
+ * Note:      Dispatches to the widest implementation the processor
+ *            supports (see simd.c); this one is <p7_SSVFilter_sse()>.
+ */
 int
 p7_SSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc)
 {
-  /* Use 16 bit values to avoid overflow due to moved baseline */
-  uint16_t  xE;
-  uint16_t  xJ;
+  return (*p7_simd_Kernels()->SSVFilter)(dsq, L, om, ret_sc);
+}
 
+/* Function:  p7_SSVFilter_sse()
+ * Synopsis:  SSE implementation of <p7_SSVFilter()>.
+ */
+int
+p7_SSVFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc)
+{
   if (om->tjb_b + om->tbm_b + om->tec_b + om->bias_b >= 127) {
     /* the optimizations are not guaranteed to work under these
        conditions (see comments at start of file) */
     return eslENORESULT;
   }
 
-  xE = get_xE(dsq, L, om);
+  return p7_SSVFilter_Finish(om, get_xE(dsq, L, om), ret_sc);
+}
+
+
+/* Function:  p7_SSVFilter_Finish()
+ * Synopsis:  Turn the SSV filter's raw maximum into a score.
+ *
+ * Purpose:   Given the maximum biased diagonal score <xE> that an SSV
+ *            kernel found for some target sequence, do the overflow
+ *            and J state checks described at the start of this file
+ *            and calculate the SSV score in nats, using the length
+ *            configuration that <om> currently has. <xE> itself
+ *            doesn't depend on the target length (the begin score is
+ *            always -128), so a kernel that scores many sequences at
+ *            once can leave this step to the caller, one target
+ *            length at a time.
+ *
+ * Returns:   as <p7_SSVFilter()>, with the score in <*ret_sc>.
+ */
+int
+p7_SSVFilter_Finish(const P7_OPROFILE *om, uint16_t xE, float *ret_sc)
+{
+  /* Use 16 bit values to avoid overflow due to moved baseline */
+  uint16_t  xJ;
+
+  if (om->tjb_b + om->tbm_b + om->tec_b + om->bias_b >= 127) return eslENORESULT;
 
   if (xE >= 255 - om->bias_b)
     {
@@ -924,3 +970,155 @@ p7_SSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc)
 }
 
 
+/* Function:  p7_SSVFilter_Batch()
+ * Synopsis:  SSV filter for up to 32 target sequences at once.
+ *
+ * Purpose:   Calculate the SSV filter's raw maximum for each of the
+ *            <n> (at most <p7O_ISSV_LANES>) digital sequences
+ *            <dsq[0..n-1]> of lengths <L[0..n-1]> against <om>, and
+ *            return them in <ret_xE[0..n-1]>. Pass each of these to
+ *            <p7_SSVFilter_Finish()>, with <om> configured for that
+ *            sequence's length, to get the same result that
+ *            <p7_SSVFilter()> would have.
+ *
+ *            Instead of striping the model, the inter-sequence kernel
+ *            gives each sequence a vector lane, so its work doesn't
+ *            depend on rounding M up to a whole number of vectors, and
+ *            the per-sequence costs of the pipeline can be skipped for
+ *            sequences that fail. All lanes run for the longest
+ *            sequence, so a batch should be of similar lengths.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslENORESULT> if there's no inter-sequence kernel for
+ *            this processor, or <om> is longer than <p7O_ISSV_MAXM>;
+ *            use <p7_SSVFilter()> on each sequence instead.
+ *
+ * Throws:    <eslEINVAL> if <n> is out of range.
+ */
+int
+p7_SSVFilter_Batch(const ESL_DSQ **dsq, const int *L, int n, const P7_OPROFILE *om, uint16_t *ret_xE)
+{
+  if (p7_simd_Kernels()->SSVFilter_Batch == NULL || om->sbv_isq == NULL) return eslENORESULT;
+  return (*p7_simd_Kernels()->SSVFilter_Batch)(dsq, L, n, om, ret_xE);
+}
+/*------------------ end, p7_SSVFilter() ------------------------*/
+
+
+
+/*****************************************************************
+ * 3. p7_SSVFilter_Pack(): one sequence, many profiles
+ *****************************************************************/
+
+/* Function:  p7_SSVFilter_Pack()
+ * Synopsis:  SSV filter for one sequence against a pack of profiles.
+ *
+ * Purpose:   Calculate the SSV filter's raw maximum for digital
+ *            sequence <dsq> of length <L> against each of the
+ *            <pk->n> profiles in pack <pk> (see
+ *            <p7_oprofile_SetPack()>), and return them in
+ *            <ret_xE[0..pk->n-1]>. Pass <ret_xE[s]> to
+ *            <p7_SSVFilter_Finish()> with profile <s>, configured for
+ *            length <L>, to get the same result that
+ *            <p7_SSVFilter()> would have.
+ *
+ *            This is hmmscan's counterpart of <p7_SSVFilter_Batch()>.
+ *            Each profile gets a byte lane, and since all the lanes
+ *            see the same residue, the scores for a row are one
+ *            aligned load per model position, with no shuffling: the
+ *            whole pack is scored in one pass over <dsq>, for about
+ *            the work of one striped filter call on its longest
+ *            profile.
+ *
+ *            The DP is the same as get_xE()'s, H(i,k) = H(i-1,k-1) -
+ *            sbv(k, x_i) with a -128 begin and signed saturation, done
+ *            in bands of <p7O_PACK_BAND> positions whose cells stay in
+ *            registers for the whole of <dsq>. Only the last column
+ *            of a band is kept, in <pk->dpv>, for the next band to
+ *            start its diagonals from.
+ *
+ * Returns:   <eslOK> on success, with the raw maxima in
+ *            <ret_xE[0..pk->n-1]>.
+ *
+ * Throws:    <eslEINVAL> if <pk> is empty.
+ *            <eslEMEM> if the DP workspace can't be reallocated.
+ */
+int
+p7_SSVFilter_Pack(const ESL_DSQ *dsq, int L, P7_OM_PACK *pk, uint16_t *ret_xE)
+{
+  int status;
+
+  if (pk->n < 1) ESL_EXCEPTION(eslEINVAL, "no profiles in the pack");
+
+  if (L+1 > pk->allocR)
+    {
+      if (pk->dpv_mem) free(pk->dpv_mem);
+      ESL_ALLOC(pk->dpv_mem, (size_t) (L+1) * 32 + 31);
+      pk->dpv    = (void *) (((unsigned long int) pk->dpv_mem + 31) & (~0x1f));
+      pk->allocR = L+1;
+    }
+  return (*p7_simd_Kernels()->SSVFilter_Pack)(dsq, L, pk, ret_xE);
+
+ ERROR:
+  pk->dpv    = NULL;
+  pk->allocR = 0;
+  return status;
+}
+
+/* Function:  p7_SSVFilter_Pack_sse()
+ * Synopsis:  SSE implementation of <p7_SSVFilter_Pack()>.
+ *
+ * Purpose:   Same as <p7_SSVFilter_Pack()>. A 128-bit vector holds
+ *            half the lanes of the pack, so this does the two halves
+ *            one after the other.
+ */
+int
+p7_SSVFilter_Pack_sse(const ESL_DSQ *dsq, int L, P7_OM_PACK *pk, uint16_t *ret_xE)
+{
+  const __m128i *tbl = (const __m128i *) pk->sbv; /* [x][k][half] interleaved scores        */
+  const __m128i *t;                /* scores for x_i, positions k0.. of this half                */
+  __m128i *cv        = (__m128i *) pk->dpv;       /* H(i,k0-1): last column of previous band */
+  __m128i  beginv    = _mm_set1_epi8(-128);
+  __m128i  xEv;                    /* running maximum, per lane                                  */
+  __m128i  inv, nextv;             /* H(i-1,k0-1) for this row, and for the next                 */
+  __m128i  h0, h1, h2, h3, h4, h5, h6, h7; /* H(i,k0..k0+7)                                      */
+  union { __m128i v; uint8_t b[16]; } u;
+  int      M = pk->M;
+  int      half, i, k0, s;
+
+  for (half = 0; half * 16 < pk->n; half++)
+    {
+      xEv = beginv;
+      for (i = 0; i <= L; i++) cv[i] = beginv;
+
+      for (k0 = 0; k0 < M; k0 += p7O_PACK_BAND)
+	{
+	  h0 = h1 = h2 = h3 = h4 = h5 = h6 = h7 = beginv;
+	  inv = cv[0];
+	  for (i = 1; i <= L; i++)
+	    {
+	      t     = tbl + ((dsq[i] * M + k0) * 2 + half);
+	      nextv = cv[i];
+
+	      /* last column first, so each cell still has its H(i-1,k-1) */
+	      h7 = _mm_subs_epi8(h6,  t[14]);
+	      h6 = _mm_subs_epi8(h5,  t[12]);
+	      h5 = _mm_subs_epi8(h4,  t[10]);
+	      h4 = _mm_subs_epi8(h3,  t[8]);
+	      h3 = _mm_subs_epi8(h2,  t[6]);
+	      h2 = _mm_subs_epi8(h1,  t[4]);
+	      h1 = _mm_subs_epi8(h0,  t[2]);
+	      h0 = _mm_subs_epi8(inv, t[0]);
+	      cv[i] = h7;
+	      inv   = nextv;
+
+	      xEv = _mm_max_epu8(xEv, _mm_max_epu8(_mm_max_epu8(_mm_max_epu8(h0, h1), _mm_max_epu8(h2, h3)),
+						     _mm_max_epu8(_mm_max_epu8(h4, h5), _mm_max_epu8(h6, h7))));
+	    }
+	}
+
+      u.v = xEv;
+      for (s = half * 16; s < pk->n && s < half * 16 + 16; s++) ret_xE[s] = u.b[s - half * 16];
+    }
+  return eslOK;
+}
+/*------------------ end, p7_SSVFilter_Pack() -------------------*/
@@ -0,0 +1,860 @@
+/* The SSV filter implementation; AVX2 version.
+ *
+ * A 32-lane (256-bit) port of Bjarne Knudsen's SSE p7_SSVFilter() in
+ * ssvfilter.c; see the introduction there for how and why the
+ * calculation works. Only the vector width changes:
+ *
+ *   - the scores come from <om->sbv_avx>, the 32-way striped copy of
+ *     <om->sbv> made by p7_oprofile_RestripeMSV(), which carries the
+ *     same p7O_EXTRA_SB wraparound vectors;
+ *   - the one-byte shift in CONVERT_STEP has to cross the two
+ *     128-bit lanes of an AVX2 register (p7_avx_leftshift_one());
+ *   - x86-64 has 16 ymm registers, the same as xmm, so MAX_BANDS is
+ *     unchanged.
+ *
+ * The overflow and J state checks in p7_SSVFilter_avx2() are the
+ * same as in p7_SSVFilter(), and scores are identical.
+ *
+ * This file is compiled with HMMER_AVX2_CFLAGS. Nothing in it may be
+ * called unless the processor supports AVX2.
+ *
+ * It also has the inter-sequence SSV kernel behind
+ * p7_SSVFilter_Batch(), which scores 32 target sequences at a time,
+ * one per byte lane, for short queries; and the multi-model kernel
+ * behind p7_SSVFilter_Pack(), which scores one sequence against 32
+ * profiles at a time, for hmmscan.
+ *
+ * Contents:
+ *   1. Band calculations
+ *   2. p7_SSVFilter_avx2() implementation
+ *   3. p7_SSVFilter_Batch_avx2(): inter-sequence SSV
+ *   4. p7_SSVFilter_Pack_avx2(): multi-model SSV
+ *   5. Unit tests
+ *   6. Test driver
+ */
+#include <p7_config.h>
+#ifdef HMMER_AVX2
+
+#include <math.h>
+
+#include <immintrin.h>		/* AVX2 */
+
+#include "easel.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+#include "impl_avx.h"
+
+/*****************************************************************
+ * 1. Band calculations
+ *****************************************************************/
+
+/* See ssvfilter.c for the choice of MAX_BANDS. */
+#ifdef __x86_64__ /* 64 bit version */
+#define  MAX_BANDS 14
+#else
+#define  MAX_BANDS 6
+#endif
+
+
+#define STEP_SINGLE(sv)                         \
+  sv   = _mm256_subs_epi8(sv, *rsc); rsc++;     \
+  xEv  = _mm256_max_epu8(xEv, sv);
+
+
+#define LENGTH_CHECK(label)                     \
+  if (i >= L) goto label;
+
+
+#define NO_CHECK(label)
+
+
+#define STEP_BANDS_1()                          \
+  STEP_SINGLE(sv00)
+
+#define STEP_BANDS_2()                          \
+  STEP_BANDS_1()                                \
+  STEP_SINGLE(sv01)
+
+#define STEP_BANDS_3()                          \
+  STEP_BANDS_2()                                \
+  STEP_SINGLE(sv02)
+
+#define STEP_BANDS_4()                          \
+  STEP_BANDS_3()                                \
+  STEP_SINGLE(sv03)
+
+#define STEP_BANDS_5()                          \
+  STEP_BANDS_4()                                \
+  STEP_SINGLE(sv04)
+
+#define STEP_BANDS_6()                          \
+  STEP_BANDS_5()                                \
+  STEP_SINGLE(sv05)
+
+#define STEP_BANDS_7()                          \
+  STEP_BANDS_6()                                \
+  STEP_SINGLE(sv06)
+
+#define STEP_BANDS_8()                          \
+  STEP_BANDS_7()                                \
+  STEP_SINGLE(sv07)
+
+#define STEP_BANDS_9()                          \
+  STEP_BANDS_8()                                \
+  STEP_SINGLE(sv08)
+
+#define STEP_BANDS_10()                         \
+  STEP_BANDS_9()                                \
+  STEP_SINGLE(sv09)
+
+#define STEP_BANDS_11()                         \
+  STEP_BANDS_10()                               \
+  STEP_SINGLE(sv10)
+
+#define STEP_BANDS_12()                         \
+  STEP_BANDS_11()                               \
+  STEP_SINGLE(sv11)
+
+#define STEP_BANDS_13()                         \
+  STEP_BANDS_12()                               \
+  STEP_SINGLE(sv12)
+
+#define STEP_BANDS_14()                         \
+  STEP_BANDS_13()                               \
+  STEP_SINGLE(sv13)
+
+
+#define CONVERT_STEP(step, length_check, label, sv, pos)        \
+  length_check(label)                                           \
+  rsc = (__m256i *) om->sbv_avx[dsq[i]] + pos;                  \
+  step()                                                        \
+  sv = p7_avx_leftshift_one(sv);                                \
+  sv = _mm256_or_si256(sv, beginv);                             \
+  i++;
+
+
+#define CONVERT_1(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv00, Q - 1)
+
+#define CONVERT_2(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv01, Q - 2)  \
+  CONVERT_1(step, LENGTH_CHECK, label)
+
+#define CONVERT_3(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv02, Q - 3)  \
+  CONVERT_2(step, LENGTH_CHECK, label)
+
+#define CONVERT_4(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv03, Q - 4)  \
+  CONVERT_3(step, LENGTH_CHECK, label)
+
+#define CONVERT_5(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv04, Q - 5)  \
+  CONVERT_4(step, LENGTH_CHECK, label)
+
+#define CONVERT_6(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv05, Q - 6)  \
+  CONVERT_5(step, LENGTH_CHECK, label)
+
+#define CONVERT_7(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv06, Q - 7)  \
+  CONVERT_6(step, LENGTH_CHECK, label)
+
+#define CONVERT_8(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv07, Q - 8)  \
+  CONVERT_7(step, LENGTH_CHECK, label)
+
+#define CONVERT_9(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv08, Q - 9)  \
+  CONVERT_8(step, LENGTH_CHECK, label)
+
+#define CONVERT_10(step, LENGTH_CHECK, label)           \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv09, Q - 10) \
+  CONVERT_9(step, LENGTH_CHECK, label)
+
+#define CONVERT_11(step, LENGTH_CHECK, label)           \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv10, Q - 11) \
+  CONVERT_10(step, LENGTH_CHECK, label)
+
+#define CONVERT_12(step, LENGTH_CHECK, label)           \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv11, Q - 12) \
+  CONVERT_11(step, LENGTH_CHECK, label)
+
+#define CONVERT_13(step, LENGTH_CHECK, label)           \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv12, Q - 13) \
+  CONVERT_12(step, LENGTH_CHECK, label)
+
+#define CONVERT_14(step, LENGTH_CHECK, label)           \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv13, Q - 14) \
+  CONVERT_13(step, LENGTH_CHECK, label)
+
+
+#define RESET_1()                               \
+  register __m256i sv00 = beginv;
+
+#define RESET_2()                               \
+  RESET_1()                                     \
+  register __m256i sv01 = beginv;
+
+#define RESET_3()                               \
+  RESET_2()                                     \
+  register __m256i sv02 = beginv;
+
+#define RESET_4()                               \
+  RESET_3()                                     \
+  register __m256i sv03 = beginv;
+
+#define RESET_5()                               \
+  RESET_4()                                     \
+  register __m256i sv04 = beginv;
+
+#define RESET_6()                               \
+  RESET_5()                                     \
+  register __m256i sv05 = beginv;
+
+#define RESET_7()                               \
+  RESET_6()                                     \
+  register __m256i sv06 = beginv;
+
+#define RESET_8()                               \
+  RESET_7()                                     \
+  register __m256i sv07 = beginv;
+
+#define RESET_9()                               \
+  RESET_8()                                     \
+  register __m256i sv08 = beginv;
+
+#define RESET_10()                              \
+  RESET_9()                                     \
+  register __m256i sv09 = beginv;
+
+#define RESET_11()                              \
+  RESET_10()                                    \
+  register __m256i sv10 = beginv;
+
+#define RESET_12()                              \
+  RESET_11()                                    \
+  register __m256i sv11 = beginv;
+
+#define RESET_13()                              \
+  RESET_12()                                    \
+  register __m256i sv12 = beginv;
+
+#define RESET_14()                              \
+  RESET_13()                                    \
+  register __m256i sv13 = beginv;
+
+
+#define CALC(reset, step, convert, width)                   \
+  int i;                                                    \
+  int i2;                                                   \
+  int Q        = p7O_NQB_AVX(om->M);                        \
+  __m256i *rsc;                                             \
+                                                            \
+  int w = width;                                            \
+                                                            \
+  dsq++;                                                    \
+                                                            \
+  reset()                                                   \
+                                                            \
+  for (i = 0; i < L && i < Q - q - w; i++)                  \
+    {                                                       \
+      rsc = (__m256i *) om->sbv_avx[dsq[i]] + i + q;        \
+      step()                                                \
+    }                                                       \
+                                                            \
+  i = Q - q - w;                                            \
+  convert(step, LENGTH_CHECK, done1)                        \
+done1:                                                      \
+                                                            \
+ for (i2 = Q - q; i2 < L - Q; i2 += Q)                      \
+   {                                                        \
+     for (i = 0; i < Q - w; i++)                            \
+       {                                                    \
+         rsc = (__m256i *) om->sbv_avx[dsq[i2 + i]] + i;    \
+         step()                                             \
+       }                                                    \
+                                                            \
+     i += i2;                                               \
+     convert(step, NO_CHECK, )                              \
+   }                                                        \
+                                                            \
+ for (i = 0; i2 + i < L && i < Q - w; i++)                  \
+   {                                                        \
+     rsc = (__m256i *) om->sbv_avx[dsq[i2 + i]] + i;        \
+     step()                                                 \
+   }                                                        \
+                                                            \
+ i+=i2;                                                     \
+ convert(step, LENGTH_CHECK, done2)                         \
+done2:                                                      \
+                                                            \
+ return xEv;
+
+
+static __m256i
+calc_band_avx2_1(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_1, STEP_BANDS_1, CONVERT_1, 1)
+}
+
+static __m256i
+calc_band_avx2_2(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_2, STEP_BANDS_2, CONVERT_2, 2)
+}
+
+static __m256i
+calc_band_avx2_3(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_3, STEP_BANDS_3, CONVERT_3, 3)
+}
+
+static __m256i
+calc_band_avx2_4(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_4, STEP_BANDS_4, CONVERT_4, 4)
+}
+
+static __m256i
+calc_band_avx2_5(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_5, STEP_BANDS_5, CONVERT_5, 5)
+}
+
+static __m256i
+calc_band_avx2_6(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_6, STEP_BANDS_6, CONVERT_6, 6)
+}
+
+#if MAX_BANDS > 6 /* Only include needed functions to limit object file size */
+static __m256i
+calc_band_avx2_7(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_7, STEP_BANDS_7, CONVERT_7, 7)
+}
+
+static __m256i
+calc_band_avx2_8(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_8, STEP_BANDS_8, CONVERT_8, 8)
+}
+
+static __m256i
+calc_band_avx2_9(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_9, STEP_BANDS_9, CONVERT_9, 9)
+}
+
+static __m256i
+calc_band_avx2_10(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_10, STEP_BANDS_10, CONVERT_10, 10)
+}
+
+static __m256i
+calc_band_avx2_11(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_11, STEP_BANDS_11, CONVERT_11, 11)
+}
+
+static __m256i
+calc_band_avx2_12(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_12, STEP_BANDS_12, CONVERT_12, 12)
+}
+
+static __m256i
+calc_band_avx2_13(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_13, STEP_BANDS_13, CONVERT_13, 13)
+}
+
+static __m256i
+calc_band_avx2_14(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_14, STEP_BANDS_14, CONVERT_14, 14)
+}
+#endif /* MAX_BANDS > 6 */
+
+
+
+/*****************************************************************
+ * 2. p7_SSVFilter_avx2() implementation
+ *****************************************************************/
+
+static uint8_t
+get_xE_avx2(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om)
+{
+  __m256i xEv;		           /* E state: keeps max for Mk->E as we go                     */
+  __m256i beginv;                  /* begin scores                                              */
+
+  int q;			   /* counter over vectors 0..nq-1                              */
+  int Q        = p7O_NQB_AVX(om->M); /* segment length: # of vectors                            */
+
+  int bands;                       /* the number of bands (rounds) to use                       */
+
+  int last_q = 0;                  /* for saving the last q value to find band width            */
+  int i;                           /* counter for bands                                         */
+
+  /* function pointers for the various number of vectors to use */
+  __m256i (*fs[MAX_BANDS + 1]) (const ESL_DSQ *, int, const P7_OPROFILE *, int, __m256i, __m256i)
+    = {NULL
+       , calc_band_avx2_1,  calc_band_avx2_2,  calc_band_avx2_3,  calc_band_avx2_4,  calc_band_avx2_5,  calc_band_avx2_6
+#if MAX_BANDS > 6
+       , calc_band_avx2_7,  calc_band_avx2_8,  calc_band_avx2_9,  calc_band_avx2_10, calc_band_avx2_11, calc_band_avx2_12
+       , calc_band_avx2_13, calc_band_avx2_14
+#endif
+  };
+
+  beginv =  _mm256_set1_epi8(-128);
+  xEv    =  beginv;
+
+  /* Use the highest number of bands but no more than MAX_BANDS */
+  bands = (Q + MAX_BANDS - 1) / MAX_BANDS;
+
+  for (i = 0; i < bands; i++) {
+    q = (Q * (i + 1)) / bands;
+
+    xEv = fs[q-last_q](dsq, L, om, last_q, beginv, xEv);
+
+    last_q = q;
+  }
+
+  return p7_avx_hmax_epu8(xEv);
+}
+
+
+/* Function:  p7_SSVFilter_avx2()
+ * Synopsis:  Calculates SSV score, without the J state; AVX2 version.
+ *
+ * Purpose:   Same as <p7_SSVFilter()>: calculates the SSV score of
+ *            sequence <dsq> of length <L> against optimized profile
+ *            <om>, ignoring the J state, and returns it (in nats) in
+ *            <*ret_sc>. Uses <om->sbv_avx>, so <om> must carry AVX2
+ *            scores.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> if the score is known to overflow the MSV
+ *            filter's range; <*ret_sc> is <eslINFINITY>.
+ *            <eslENORESULT> if the J state might have been used, or
+ *            an overflow might not happen in the MSV filter; the
+ *            caller must then do the full MSV calculation.
+ */
+int
+p7_SSVFilter_avx2(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc)
+{
+  if (om->tjb_b + om->tbm_b + om->tec_b + om->bias_b >= 127) {
+    /* the optimizations are not guaranteed to work under these
+       conditions (see comments at start of ssvfilter.c) */
+    return eslENORESULT;
+  }
+
+  return p7_SSVFilter_Finish(om, get_xE_avx2(dsq, L, om), ret_sc);
+}
+/*------------------ end, p7_SSVFilter_avx2() -------------------*/
+
+
+
+/*****************************************************************
+ * 3. p7_SSVFilter_Batch_avx2(): inter-sequence SSV
+ *****************************************************************/
+
+/* Residue code for lanes whose sequence has ended. Its score in
+ * <om->sbv_isq> is 127, like any code >= Kp; see
+ * p7_oprofile_RestripeMSV().
+ */
+#define ISSV_PADCODE 31
+
+/* Function:  p7_SSVFilter_Batch_avx2()
+ * Synopsis:  AVX2 implementation of <p7_SSVFilter_Batch()>.
+ *
+ * Purpose:   Same as <p7_SSVFilter_Batch()>. Byte lane <s> of every
+ *            vector belongs to sequence <dsq[s]>. The DP is the one
+ *            that the striped get_xE() does a diagonal at a time,
+ *            done here a row at a time: with the same -128 begin
+ *            score and signed saturated subtraction,
+ *
+ *               H(i,k) = H(i-1,k-1) - sbv(k, x_i)
+ *
+ *            and the same unsigned maximum over all cells. The score
+ *            for each lane's residue x_i is looked up in position
+ *            k's 32-entry table in <om->sbv_isq> with two byte
+ *            shuffles, merged with an OR. Cells past M never raise the
+ *            maximum, so leaving them out changes nothing, and the
+ *            results are identical to get_xE().
+ *
+ *            Lanes run for the longest of the <L>; shorter sequences
+ *            are padded with a code whose cost saturates the row.
+ *
+ * Returns:   <eslOK> on success, with the raw maxima in
+ *            <ret_xE[0..n-1]>.
+ *
+ * Throws:    <eslEINVAL> if <n> is out of range, or <om> has no
+ *            inter-sequence SSV tables.
+ */
+int
+p7_SSVFilter_Batch_avx2(const ESL_DSQ **dsq, const int *L, int n, const P7_OPROFILE *om, uint16_t *ret_xE)
+{
+  __m256i  H[p7O_ISSV_MAXM];       /* one row: H(i,k) for k=1..M, all lanes            */
+  __m256i  xEv;                    /* running maximum, per lane                         */
+  __m256i  xv;                     /* residue x_i, per lane                             */
+  __m256i  lov, hiv;               /* shuffle indices into lower/upper table (0x80: zero) */
+  __m256i  prevv, curv;            /* H(i-1,k-1) and H(i-1,k)                           */
+  __m256i  scv;                    /* sbv(k, x_i), per lane                             */
+  __m256i  fifteenv = _mm256_set1_epi8(15);
+  __m256i  sixteenv = _mm256_set1_epi8(16);
+  __m256i  zapv     = _mm256_set1_epi8((char) 0x80);
+  const __m256i *tbl;              /* om->sbv_isq tables for position k                 */
+  union { __m256i v; uint8_t b[32]; } row;
+  int      M    = om->M;
+  int      maxL = 0;
+  int      i, k, s;
+
+  if (n < 1 || n > p7O_ISSV_LANES)          ESL_EXCEPTION(eslEINVAL, "bad number of sequences for inter-sequence SSV");
+  if (om->sbv_isq == NULL || M > p7O_ISSV_MAXM) ESL_EXCEPTION(eslEINVAL, "profile has no inter-sequence SSV tables");
+
+  for (s = 0; s < n; s++) maxL = ESL_MAX(maxL, L[s]);
+  for (k = 0; k < M; k++) H[k] = _mm256_set1_epi8(-128);
+  xEv = _mm256_set1_epi8(-128);
+
+  for (i = 1; i <= maxL; i++)
+    {
+      for (s = 0; s < n;              s++) row.b[s] = (i <= L[s]) ? dsq[s][i] : ISSV_PADCODE;
+      for (     ; s < p7O_ISSV_LANES; s++) row.b[s] = ISSV_PADCODE;
+      xv  = row.v;
+      /* pshufb writes zero wherever the index has its high bit set, so each lane
+       * selects from exactly one of the two tables and an OR merges them.
+       */
+      hiv = _mm256_cmpgt_epi8(xv, fifteenv);
+      lov = _mm256_or_si256(xv, _mm256_and_si256(hiv, zapv));
+      hiv = _mm256_or_si256(_mm256_sub_epi8(xv, sixteenv), _mm256_andnot_si256(hiv, zapv));
+
+      prevv = _mm256_set1_epi8(-128); /* begin */
+      tbl   = (const __m256i *) om->sbv_isq;
+      for (k = 0; k < M; k++)
+	{
+	  scv   = _mm256_or_si256(_mm256_shuffle_epi8(tbl[0], lov), _mm256_shuffle_epi8(tbl[1], hiv));
+	  tbl  += 2;
+	  curv  = H[k];
+	  H[k]  = _mm256_subs_epi8(prevv, scv);
+	  xEv   = _mm256_max_epu8(xEv, H[k]);
+	  prevv = curv;
+	}
+    }
+
+  row.v = xEv;
+  for (s = 0; s < n; s++) ret_xE[s] = row.b[s];
+  return eslOK;
+}
+/*--------------- end, p7_SSVFilter_Batch_avx2() ----------------*/
+
+
+
+/*****************************************************************
+ * 4. p7_SSVFilter_Pack_avx2(): multi-model SSV
+ *****************************************************************/
+
+/* Function:  p7_SSVFilter_Pack_avx2()
+ * Synopsis:  AVX2 implementation of <p7_SSVFilter_Pack()>.
+ *
+ * Purpose:   Same as <p7_SSVFilter_Pack()>, and the same band
+ *            calculation as <p7_SSVFilter_Pack_sse()>, with all 32
+ *            lanes of the pack in one vector.
+ */
+int
+p7_SSVFilter_Pack_avx2(const ESL_DSQ *dsq, int L, P7_OM_PACK *pk, uint16_t *ret_xE)
+{
+  const __m256i *tbl = (const __m256i *) pk->sbv; /* [x][k] interleaved scores               */
+  const __m256i *t;                /* scores for x_i, positions k0..                             */
+  __m256i *cv        = (__m256i *) pk->dpv;       /* H(i,k0-1): last column of previous band */
+  __m256i  beginv    = _mm256_set1_epi8(-128);
+  __m256i  xEv;                    /* running maximum, per lane                                  */
+  __m256i  inv, nextv;             /* H(i-1,k0-1) for this row, and for the next                 */
+  __m256i  h0, h1, h2, h3, h4, h5, h6, h7; /* H(i,k0..k0+7)                                      */
+  union { __m256i v; uint8_t b[32]; } u;
+  int      M = pk->M;
+  int      i, k0, s;
+
+  xEv = beginv;
+  for (i = 0; i <= L; i++) cv[i] = beginv;
+
+  for (k0 = 0; k0 < M; k0 += p7O_PACK_BAND)
+    {
+      h0 = h1 = h2 = h3 = h4 = h5 = h6 = h7 = beginv;
+      inv = cv[0];
+      for (i = 1; i <= L; i++)
+	{
+	  t     = tbl + (dsq[i] * M + k0);
+	  nextv = cv[i];
+
+	  h7 = _mm256_subs_epi8(h6,  t[7]);
+	  h6 = _mm256_subs_epi8(h5,  t[6]);
+	  h5 = _mm256_subs_epi8(h4,  t[5]);
+	  h4 = _mm256_subs_epi8(h3,  t[4]);
+	  h3 = _mm256_subs_epi8(h2,  t[3]);
+	  h2 = _mm256_subs_epi8(h1,  t[2]);
+	  h1 = _mm256_subs_epi8(h0,  t[1]);
+	  h0 = _mm256_subs_epi8(inv, t[0]);
+	  cv[i] = h7;
+	  inv   = nextv;
+
+	  xEv = _mm256_max_epu8(xEv, _mm256_max_epu8(_mm256_max_epu8(_mm256_max_epu8(h0, h1), _mm256_max_epu8(h2, h3)),
+						     _mm256_max_epu8(_mm256_max_epu8(h4, h5), _mm256_max_epu8(h6, h7))));
+	}
+    }
+
+  u.v = xEv;
+  for (s = 0; s < pk->n; s++) ret_xE[s] = u.b[s];
+  return eslOK;
+}
+/*--------------- end, p7_SSVFilter_Pack_avx2() -----------------*/
+
+
+
+/*****************************************************************
+ * 5. Unit tests
+ *****************************************************************/
+#ifdef p7SSVFILTER_AVX2_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* utest_ssv_filter()
+ *
+ * Whenever the AVX2 SSV filter returns a score (eslOK), it must be
+ * identical (within machine error) to the score of generic Viterbi
+ * DP on a profile configured to mimic the MSV filter, as in the
+ * msvfilter utest. Models of length <M> are sampled for a variety of
+ * <M>, so that many different band widths and wraparound paths in
+ * the calc_band_*() functions are exercised.
+ */
+static void
+utest_ssv_filter(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  ESL_DSQ     *dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_GMX      *gx  = p7_gmx_Create(M, L);
+  float sc1, sc2;
+  int   status;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  p7_profile_SameAsMF(om, gm);
+
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+      status = p7_SSVFilter_avx2(dsq, L, om, &sc1);
+      if (status == eslENORESULT) continue;
+      if (status != eslOK) esl_fatal("avx2 ssv filter unit test failed: unexpected status %d", status);
+
+      p7_GViterbi (dsq, L, gm, gx, &sc2);
+      sc2 = sc2 / om->scale_b - 3.0f;
+      if (fabs(sc1-sc2) > 0.001) esl_fatal("avx2 ssv filter unit test failed: scores differ (%.2f, %.2f)", sc1, sc2);
+    }
+
+  free(dsq);
+  p7_hmm_Destroy(hmm);
+  p7_gmx_Destroy(gx);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+
+/* utest_batch()
+ *
+ * The inter-sequence SSV filter must give exactly the same results as
+ * the striped one, sequence by sequence, including for batches with
+ * fewer than 32 sequences and of mixed lengths up to <L>.
+ */
+static void
+utest_batch(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char          *msg = "avx2 inter-sequence ssv filter unit test failed";
+  P7_HMM        *hmm = NULL;
+  P7_PROFILE    *gm  = NULL;
+  P7_OPROFILE   *om  = NULL;
+  ESL_DSQ       *dsq[p7O_ISSV_LANES];
+  int            len[p7O_ISSV_LANES];
+  uint16_t       xE[p7O_ISSV_LANES];
+  float          sc1, sc2;
+  int            status1, status2;
+  int            n, s;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  for (s = 0; s < p7O_ISSV_LANES; s++) dsq[s] = malloc(sizeof(ESL_DSQ) * (L+2));
+
+  while (N--)
+    {
+      n = 1 + esl_rnd_Roll(r, p7O_ISSV_LANES);
+      for (s = 0; s < n; s++) {
+	len[s] = 1 + esl_rnd_Roll(r, L);
+	esl_rsq_xfIID(r, bg->f, abc->K, len[s], dsq[s]);
+      }
+      if (p7_SSVFilter_Batch_avx2((const ESL_DSQ **) dsq, len, n, om, xE) != eslOK) esl_fatal(msg);
+
+      for (s = 0; s < n; s++) {
+	p7_oprofile_ReconfigMSVLength(om, len[s]);
+	status1 = p7_SSVFilter_Finish(om, xE[s], &sc1);
+	status2 = p7_SSVFilter_avx2(dsq[s], len[s], om, &sc2);
+	if (status1 != status2)                   esl_fatal(msg);
+	if (status1 != eslENORESULT && sc1 != sc2) esl_fatal(msg);
+      }
+    }
+
+  for (s = 0; s < p7O_ISSV_LANES; s++) free(dsq[s]);
+  p7_hmm_Destroy(hmm);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+
+/* utest_pack()
+ *
+ * The multi-model SSV filter, SSE and AVX2, must give the same
+ * results as the striped one, profile by profile, for a pack of <n>
+ * profiles of mixed lengths up to <M>. (The raw maxima may differ
+ * once a cell overflows, but p7_SSVFilter_Finish() catches that
+ * before it looks at them.)
+ */
+static void
+utest_pack(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int n, int L, int N)
+{
+  char          *msg = "avx2 multi-model ssv filter unit test failed";
+  P7_HMM        *hmm[p7O_PACK_LANES];
+  P7_PROFILE    *gm[p7O_PACK_LANES];
+  P7_OPROFILE   *om[p7O_PACK_LANES];
+  P7_OM_PACK    *pk  = p7_oprofile_CreatePack();
+  ESL_DSQ       *dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  uint16_t       xE1[p7O_PACK_LANES], xE2[p7O_PACK_LANES];
+  float          sc1, sc2, sc3;
+  int            status1, status2, status3;
+  int            len, s;
+
+  for (s = 0; s < n; s++)
+    p7_oprofile_Sample(r, abc, bg, 1 + esl_rnd_Roll(r, M), L, &hmm[s], &gm[s], &om[s]);
+  if (p7_oprofile_SetPack(pk, om, n) != eslOK) esl_fatal(msg);
+
+  while (N--)
+    {
+      len = 1 + esl_rnd_Roll(r, L);
+      esl_rsq_xfIID(r, bg->f, abc->K, len, dsq);
+      if (p7_SSVFilter_Pack     (dsq, len, pk, xE1) != eslOK) esl_fatal(msg);
+      if (p7_SSVFilter_Pack_sse (dsq, len, pk, xE2) != eslOK) esl_fatal(msg);
+
+      for (s = 0; s < n; s++) {
+	p7_oprofile_ReconfigMSVLength(om[s], len);
+	status1 = p7_SSVFilter_Finish(om[s], xE1[s], &sc1);
+	status2 = p7_SSVFilter_Finish(om[s], xE2[s], &sc2);
+	status3 = p7_SSVFilter_avx2(dsq, len, om[s], &sc3);
+	if (status1 != status3 || status2 != status3)                 esl_fatal(msg);
+	if (status3 != eslENORESULT && (sc1 != sc3 || sc2 != sc3))    esl_fatal(msg);
+      }
+    }
+
+  for (s = 0; s < n; s++) {
+    p7_hmm_Destroy(hmm[s]);
+    p7_profile_Destroy(gm[s]);
+    p7_oprofile_Destroy(om[s]);
+  }
+  p7_oprofile_DestroyPack(pk);
+  free(dsq);
+}
+#endif /*p7SSVFILTER_AVX2_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+
+/*****************************************************************
+ * 6. Test driver
+ *****************************************************************/
+#ifdef p7SSVFILTER_AVX2_TESTDRIVE
+/*
+   ./ssvfilter_avx2_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "size of random sequences to sample",             0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the AVX2 SSVFilter() implementations";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+  int             Mtest[] = { 1, 31, 32, 33, 145, 500, 1000 };  /* 1, 2, 2, 2, 5, 16, 32 vectors */
+  int             j;
+
+  /* Nothing to test if this processor can't run AVX2 */
+  if (p7_simd_Level() < p7_SIMD_AVX2) {
+    if (esl_opt_GetBoolean(go, "-v")) printf("AVX2 not supported by this processor; skipping tests\n");
+    esl_getopts_Destroy(go);
+    esl_randomness_Destroy(r);
+    return eslOK;
+  }
+
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("SSVFilter_avx2() tests, protein\n");
+  for (j = 0; j < sizeof(Mtest) / sizeof(int); j++)
+    {
+      utest_ssv_filter(r, abc, bg, Mtest[j], L, N);
+      utest_ssv_filter(r, abc, bg, Mtest[j], 1, 10);   /* size 1 sequences */
+      if (Mtest[j] <= p7O_ISSV_MAXM) utest_batch(r, abc, bg, Mtest[j], L, N);
+    }
+  utest_pack(r, abc, bg, p7O_PACK_MAXM, p7O_PACK_LANES, L, N);
+  utest_pack(r, abc, bg, 500,           7,              L, N);
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("SSVFilter_avx2() tests, DNA\n");
+  utest_ssv_filter(r, abc, bg, 145, L, N);
+  utest_batch     (r, abc, bg, 32,  L, N);
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7SSVFILTER_AVX2_TESTDRIVE*/
+
+
+
+#else /*! HMMER_AVX2*/
+/* Provide a test driver that trivially passes, so `make check` works
+ * the same whether or not AVX2 filters were configured in.
+ */
+#ifdef p7SSVFILTER_AVX2_TESTDRIVE
+int main(void) { return 0; }
+#endif
+void p7_ssvfilter_avx2_silence_hack(void) { return; }
+#endif /*HMMER_AVX2 or not*/
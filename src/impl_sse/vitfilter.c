@@ -78,9 +78,21 @@
  *            J2/65 for initial benchmarking
  *            J2/66 for precision maximization
  *            J4/138-140 for reimplementation in 16-bit precision
+ *
+ * Note:      Dispatches to the widest implementation the processor
+ *            supports (see simd.c); this one is <p7_ViterbiFilter_sse()>.
  */
 int
 p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+  return (*p7_simd_Kernels()->ViterbiFilter)(dsq, L, om, ox, ret_sc);
+}
+
+/* Function:  p7_ViterbiFilter_sse()
+ * Synopsis:  SSE implementation of <p7_ViterbiFilter()>.
+ */
+int
+p7_ViterbiFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
 {
   register __m128i mpv, dpv, ipv;  /* previous row values                                       */
   register __m128i sv;		   /* temp storage of 1 curr row value in progress              */
@@ -287,10 +299,24 @@ p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, f
  *            limited dynamic range.)
  *
  * Xref:      See p7_ViterbiFilter()
+ *
+ * Note:      Dispatches to the widest implementation the processor
+ *            supports (see simd.c); this one is
+ *            <p7_ViterbiFilter_longtarget_sse()>.
  */
 int
 p7_ViterbiFilter_longtarget(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox,
                             float filtersc, double P, P7_HMM_WINDOWLIST *windowlist)
+{
+  return (*p7_simd_Kernels()->ViterbiFilter_longtarget)(dsq, L, om, ox, filtersc, P, windowlist);
+}
+
+/* Function:  p7_ViterbiFilter_longtarget_sse()
+ * Synopsis:  SSE implementation of <p7_ViterbiFilter_longtarget()>.
+ */
+int
+p7_ViterbiFilter_longtarget_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox,
+                                float filtersc, double P, P7_HMM_WINDOWLIST *windowlist)
 {
   register __m128i mpv, dpv, ipv;  /* previous row values                                       */
   register __m128i sv;       /* temp storage of 1 curr row value in progress              */
@@ -314,6 +340,7 @@ p7_ViterbiFilter_longtarget(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7
 
   int z;
   union { __m128i v; int16_t i[8]; } tmp;
+
   windowlist->count = 0;
 
 /*
@@ -0,0 +1,636 @@
+/* Viterbi filter implementation; AVX-512BW version.
+ *
+ * Same algorithm as the SSE p7_ViterbiFilter() and
+ * p7_ViterbiFilter_longtarget() in vitfilter.c, with 32 sword lanes
+ * per 512-bit vector instead of 8. The profile's Viterbi filter
+ * scores are restriped for this width by p7_oprofile_RestripeVF()
+ * (<om->rwv_avx512>, <om->twv_avx512>), and the one-row DP matrix
+ * lives in <ox->dpv> rather than <ox->dpw[0]>.
+ *
+ * This file is compiled with HMMER_AVX512_CFLAGS. Nothing in it may be
+ * called unless the processor supports AVX-512F and AVX-512BW.
+ *
+ * Contents:
+ *   1. Viterbi filter implementation.
+ *   2. Benchmark driver.
+ *   3. Unit tests.
+ *   4. Test driver.
+ */
+#include <p7_config.h>
+#ifdef HMMER_AVX512
+
+#include <stdio.h>
+#include <math.h>
+
+#include <immintrin.h>		/* AVX-512 */
+
+#include "easel.h"
+#include "esl_gumbel.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+#include "impl_avx.h"
+
+
+/*****************************************************************
+ * 1. Viterbi filter implementation.
+ *****************************************************************/
+
+/* Function:  p7_ViterbiFilter_avx512()
+ * Synopsis:  Calculates Viterbi score, vewy vewy fast, in limited precision; AVX-512 version.
+ *
+ * Purpose:   Same as <p7_ViterbiFilter()>: calculates an approximation
+ *            of the Viterbi score for sequence <dsq> of length <L>
+ *            residues, using optimized profile <om>, and a
+ *            preallocated one-row DP matrix <ox>. Return the
+ *            estimated Viterbi score (in nats) in <ret_sc>. Scores
+ *            are identical to the SSE implementation's.
+ *
+ * Args:      dsq     - digital target sequence, 1..L
+ *            L       - length of dsq in residues
+ *            om      - optimized profile, with AVX-512 scores
+ *            ox      - DP matrix
+ *            ret_sc  - RETURN: Viterbi score (in nats)
+ *
+ * Returns:   <eslOK> on success;
+ *            <eslERANGE> if the score overflows; in this case
+ *            <*ret_sc> is <eslINFINITY>, and the sequence can
+ *            be treated as a high-scoring hit.
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small, if <om> has
+ *            no AVX-512 scores, or if profile isn't in a local
+ *            alignment mode.
+ *
+ * Xref:      See p7_ViterbiFilter()
+ */
+int
+p7_ViterbiFilter_avx512(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+  register __m512i mpv, dpv, ipv;  /* previous row values                                       */
+  register __m512i sv;		   /* temp storage of 1 curr row value in progress              */
+  register __m512i dcv;		   /* delayed storage of D(i,q+1)                               */
+  register __m512i xEv;		   /* E state: keeps max for Mk->E as we go                     */
+  register __m512i xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  register __m512i Dmaxv;          /* keeps track of maximum D cell on row                      */
+  int16_t  xE, xB, xC, xJ, xN;	   /* special states' scores                                    */
+  int16_t  Dmax;		   /* maximum D cell score on row                               */
+  int i;			   /* counter over sequence positions 1..L                      */
+  int q;			   /* counter over vectors 0..nq-1                              */
+  int Q        = p7O_NQW_AVX512(om->M); /* segment length: # of vectors                         */
+  __m512i *dp  = (__m512i *) ox->dpv;   /* using {MDI}MX(q) macro requires initialization of <dp> */
+  __m512i *rsc;			   /* will point at om->rwv_avx512[x] for residue x[i]          */
+  __m512i *tsc;			   /* will point into (and step thru) om->twv_avx512            */
+  __m512i  negInfv;
+
+  /* Check that the DP matrix and profile are ok for us. */
+  if (om->rwv_avx512 == NULL)                                       ESL_EXCEPTION(eslEINVAL, "profile has no AVX-512 scores");
+  if ((int64_t) Q * p7X_NSCELLS * sizeof(__m512i) > ox->allocV)     ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+  if (om->mode != p7_LOCAL && om->mode != p7_UNILOCAL)              ESL_EXCEPTION(eslEINVAL, "Fast filter only works for local alignment");
+  ox->M   = om->M;
+
+  /* -infinity is -32768; unlike the SSE version, negInfv is splatted: the shifts mask it into element 0 */
+  negInfv = _mm512_set1_epi16(-32768);
+
+  for (q = 0; q < Q; q++)
+    MMXo(q) = IMXo(q) = DMXo(q) = negInfv;
+  xN   = om->base_w;
+  xB   = xN + om->xw[p7O_N][p7O_MOVE];
+  xJ   = -32768;
+  xC   = -32768;
+  xE   = -32768;
+
+  for (i = 1; i <= L; i++)
+    {
+      rsc   = (__m512i *) om->rwv_avx512[dsq[i]];
+      tsc   = (__m512i *) om->twv_avx512;
+      dcv   = negInfv;
+      xEv   = negInfv;
+      Dmaxv = negInfv;
+      xBv   = _mm512_set1_epi16(xB);
+
+      /* Right shifts by 1 value, with -32768 shifted on */
+      mpv = p7_avx512_leftshift_epi16(MMXo(Q-1), negInfv);
+      dpv = p7_avx512_leftshift_epi16(DMXo(Q-1), negInfv);
+      ipv = p7_avx512_leftshift_epi16(IMXo(Q-1), negInfv);
+
+      for (q = 0; q < Q; q++)
+      {
+        /* Calculate new MMXo(i,q); don't store it yet, hold it in sv. */
+        sv   =                       _mm512_adds_epi16(xBv, *tsc);  tsc++;
+        sv   = _mm512_max_epi16 (sv, _mm512_adds_epi16(mpv, *tsc)); tsc++;
+        sv   = _mm512_max_epi16 (sv, _mm512_adds_epi16(ipv, *tsc)); tsc++;
+        sv   = _mm512_max_epi16 (sv, _mm512_adds_epi16(dpv, *tsc)); tsc++;
+        sv   = _mm512_adds_epi16(sv, *rsc);                         rsc++;
+        xEv  = _mm512_max_epi16(xEv, sv);
+
+        /* Load {MDI}(i-1,q) into mpv, dpv, ipv;
+         * {MDI}MX(q) is then the current, not the prev row
+         */
+        mpv = MMXo(q);
+        dpv = DMXo(q);
+        ipv = IMXo(q);
+
+        /* Do the delayed stores of {MD}(i,q) now that memory is usable */
+        MMXo(q) = sv;
+        DMXo(q) = dcv;
+
+        /* Calculate the next D(i,q+1) partially: M->D only;
+         * delay storage, holding it in dcv
+         */
+        dcv   = _mm512_adds_epi16(sv, *tsc);  tsc++;
+        Dmaxv = _mm512_max_epi16(dcv, Dmaxv);
+
+        /* Calculate and store I(i,q) */
+        sv     =                       _mm512_adds_epi16(mpv, *tsc);  tsc++;
+        IMXo(q)= _mm512_max_epi16 (sv, _mm512_adds_epi16(ipv, *tsc)); tsc++;
+      }
+
+      /* Now the "special" states, which start from Mk->E (->C, ->J->B) */
+      xE = p7_avx512_hmax_epi16(xEv);
+      if (xE >= 32767) { *ret_sc = eslINFINITY; return eslERANGE; }	/* immediately detect overflow */
+      xN = xN + om->xw[p7O_N][p7O_LOOP];
+      xC = ESL_MAX(xC + om->xw[p7O_C][p7O_LOOP], xE + om->xw[p7O_E][p7O_MOVE]);
+      xJ = ESL_MAX(xJ + om->xw[p7O_J][p7O_LOOP], xE + om->xw[p7O_E][p7O_LOOP]);
+      xB = ESL_MAX(xJ + om->xw[p7O_J][p7O_MOVE], xN + om->xw[p7O_N][p7O_MOVE]);
+      /* and now xB will carry over into next i, and xC carries over after i=L */
+
+      /* Finally the "lazy F" loop (sensu [Farrar07]); see p7_ViterbiFilter().
+       * With 32 lanes, the serialized D->D path can need up to 31 more passes
+       * across segment boundaries instead of 7, but the test that stops
+       * early is the same.
+       */
+      Dmax = p7_avx512_hmax_epi16(Dmaxv);
+      if (Dmax + om->ddbound_w > xB)
+	{
+	  /* Now we're obligated to do at least one complete DD path to be sure. */
+	  /* dcv has carried through from end of q loop above */
+	  dcv = p7_avx512_leftshift_epi16(dcv, negInfv);
+	  tsc = (__m512i *) om->twv_avx512 + 7*Q;	/* set tsc to start of the DD's */
+	  for (q = 0; q < Q; q++)
+	    {
+	      DMXo(q) = _mm512_max_epi16(dcv, DMXo(q));
+	      dcv     = _mm512_adds_epi16(DMXo(q), *tsc); tsc++;
+	    }
+
+	  do {
+	    dcv = p7_avx512_leftshift_epi16(dcv, negInfv);
+	    tsc = (__m512i *) om->twv_avx512 + 7*Q;	/* set tsc to start of the DD's */
+	    for (q = 0; q < Q; q++)
+	      {
+		if (! p7_avx512_any_gt_epi16(dcv, DMXo(q))) break;
+		DMXo(q) = _mm512_max_epi16(dcv, DMXo(q));
+		dcv     = _mm512_adds_epi16(DMXo(q), *tsc);   tsc++;
+	      }
+	  } while (q == Q);
+	}
+      else  /* not calculating DD? then just store the last M->D vector calc'ed.*/
+	DMXo(0) = p7_avx512_leftshift_epi16(dcv, negInfv);
+    } /* end loop over sequence residues 1..L */
+
+  /* finally C->T */
+  if (xC > -32768)
+    {
+      *ret_sc = (float) xC + (float) om->xw[p7O_C][p7O_MOVE] - (float) om->base_w;
+      *ret_sc /= om->scale_w;
+      *ret_sc -= 3.0; /* the NN/CC/JJ=0,-3nat approximation: see J5/36. */
+    }
+  else  *ret_sc = -eslINFINITY;
+  return eslOK;
+}
+/*---------------- end, p7_ViterbiFilter_avx512() ---------------*/
+
+
+
+/* Function:  p7_ViterbiFilter_longtarget_avx512()
+ * Synopsis:  Finds windows within potentially long sequence blocks with Viterbi
+ *            scores above threshold; AVX-512 version.
+ *
+ * Purpose:   Same as <p7_ViterbiFilter_longtarget()>: calculates an
+ *            approximation of the Viterbi score for regions of
+ *            sequence <dsq>, using optimized profile <om>, and a pre-
+ *            allocated one-row DP matrix <ox>, and captures the
+ *            positions at which such regions exceed the score
+ *            required to be significant in the eyes of the calling
+ *            function (usually p=0.001).
+ *
+ * Args:      dsq        - digital target sequence, 1..L
+ *            L          - length of dsq in residues
+ *            om         - optimized profile, with AVX-512 scores
+ *            ox         - DP matrix
+ *            filtersc   - null or bias correction, required for translating a P-value threshold into a score threshold
+ *            P          - p-value below which a region is captured as being above threshold
+ *            windowlist - RETURN: preallocated array of hit windows (start and end of diagonal) for the above-threshold areas
+ *
+ * Returns:   <eslOK> on success;
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small, if <om> has
+ *            no AVX-512 scores, or if profile isn't in a local
+ *            alignment mode.
+ *
+ * Xref:      See p7_ViterbiFilter_longtarget()
+ */
+int
+p7_ViterbiFilter_longtarget_avx512(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox,
+                                   float filtersc, double P, P7_HMM_WINDOWLIST *windowlist)
+{
+  register __m512i mpv, dpv, ipv;  /* previous row values                                       */
+  register __m512i sv;             /* temp storage of 1 curr row value in progress              */
+  register __m512i dcv;            /* delayed storage of D(i,q+1)                               */
+  register __m512i xEv;            /* E state: keeps max for Mk->E as we go                     */
+  register __m512i xBv;            /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  register __m512i Dmaxv;          /* keeps track of maximum D cell on row                      */
+  int16_t  xE, xB, xC, xJ, xN;     /* special states' scores                                    */
+  int16_t  Dmax;                   /* maximum D cell score on row                               */
+  int i;                           /* counter over sequence positions 1..L                      */
+  int q;                           /* counter over vectors 0..nq-1                              */
+  int Q        = p7O_NQW_AVX512(om->M); /* segment length: # of vectors                         */
+  __m512i *dp  = (__m512i *) ox->dpv;   /* using {MDI}MX(q) macro requires initialization of <dp> */
+  __m512i *rsc;                    /* will point at om->rwv_avx512[x] for residue x[i]          */
+  __m512i *tsc;                    /* will point into (and step thru) om->twv_avx512            */
+  __m512i  negInfv;
+  int16_t  sc_thresh;
+  float    invP;
+  int      z;
+  union { __m512i v; int16_t i[32]; } tmp;
+
+  windowlist->count = 0;
+
+  /* Score threshold for <P>: see p7_ViterbiFilter_longtarget() */
+  invP = esl_gumbel_invsurv(P, om->evparam[p7_VMU],  om->evparam[p7_VLAMBDA]);
+  sc_thresh =   (int) ceil ( ( (filtersc + (eslCONST_LOG2 * invP) + 3.0) * om->scale_w )
+                - (float)om->xw[p7O_E][p7O_MOVE] - (float)om->xw[p7O_C][p7O_MOVE] + (float)om->base_w );
+
+  /* Check that the DP matrix and profile are ok for us. */
+  if (om->rwv_avx512 == NULL)                                       ESL_EXCEPTION(eslEINVAL, "profile has no AVX-512 scores");
+  if ((int64_t) Q * p7X_NSCELLS * sizeof(__m512i) > ox->allocV)     ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+  if (om->mode != p7_LOCAL && om->mode != p7_UNILOCAL)              ESL_EXCEPTION(eslEINVAL, "Fast filter only works for local alignment");
+  ox->M   = om->M;
+
+  negInfv = _mm512_set1_epi16(-32768);
+
+  for (q = 0; q < Q; q++)
+    MMXo(q) = IMXo(q) = DMXo(q) = negInfv;
+  xN   = om->base_w;
+  xB   = xN + om->xw[p7O_N][p7O_MOVE];
+  xJ   = -32768;
+  xC   = -32768;
+  xE   = -32768;
+
+  for (i = 1; i <= L; i++)
+  {
+      rsc   = (__m512i *) om->rwv_avx512[dsq[i]];
+      tsc   = (__m512i *) om->twv_avx512;
+      dcv   = negInfv;
+      xEv   = negInfv;
+      Dmaxv = negInfv;
+      xBv   = _mm512_set1_epi16(xB);
+
+      mpv = p7_avx512_leftshift_epi16(MMXo(Q-1), negInfv);
+      dpv = p7_avx512_leftshift_epi16(DMXo(Q-1), negInfv);
+      ipv = p7_avx512_leftshift_epi16(IMXo(Q-1), negInfv);
+
+      for (q = 0; q < Q; q++)
+      {
+        sv   =                       _mm512_adds_epi16(xBv, *tsc);  tsc++;
+        sv   = _mm512_max_epi16 (sv, _mm512_adds_epi16(mpv, *tsc)); tsc++;
+        sv   = _mm512_max_epi16 (sv, _mm512_adds_epi16(ipv, *tsc)); tsc++;
+        sv   = _mm512_max_epi16 (sv, _mm512_adds_epi16(dpv, *tsc)); tsc++;
+        sv   = _mm512_adds_epi16(sv, *rsc);                         rsc++;
+        xEv  = _mm512_max_epi16(xEv, sv);
+
+        mpv = MMXo(q);
+        dpv = DMXo(q);
+        ipv = IMXo(q);
+
+        MMXo(q) = sv;
+        DMXo(q) = dcv;
+
+        dcv   = _mm512_adds_epi16(sv, *tsc);  tsc++;
+        Dmaxv = _mm512_max_epi16(dcv, Dmaxv);
+
+        sv     =                       _mm512_adds_epi16(mpv, *tsc);  tsc++;
+        IMXo(q)= _mm512_max_epi16 (sv, _mm512_adds_epi16(ipv, *tsc)); tsc++;
+      }
+
+      /* Now the "special" states, which start from Mk->E (->C, ->J->B) */
+      xE = p7_avx512_hmax_epi16(xEv);
+
+      if (xE >= sc_thresh) {
+        //hit score threshold. Add a window to the list, then reset scores.
+
+        /* Unpack and unstripe, then find the position responsible for the hit */
+        for (q = 0; q < Q; q++) {
+          tmp.v = MMXo(q);
+          for (z = 0; z < 32; z++)  { // unstripe
+            if ( tmp.i[z] == xE && (q+Q*z+1) <= om->M) {
+              // (q+Q*z+1) is the model position k at which the xE score is found
+              p7_hmmwindow_new(windowlist, 0, i, i-1, (q+Q*z+1), 1, 0.0, p7_NOCOMPLEMENT, L );
+            }
+          }
+          MMXo(q) = IMXo(q) = DMXo(q) = negInfv; //reset score to start search for next vit window.
+        }
+
+      } else {
+
+        xN = xN + om->xw[p7O_N][p7O_LOOP];
+        xC = ESL_MAX(xC + om->xw[p7O_C][p7O_LOOP], xE + om->xw[p7O_E][p7O_MOVE]);
+        xJ = ESL_MAX(xJ + om->xw[p7O_J][p7O_LOOP], xE + om->xw[p7O_E][p7O_LOOP]);
+        xB = ESL_MAX(xJ + om->xw[p7O_J][p7O_MOVE], xN + om->xw[p7O_N][p7O_MOVE]);
+
+        /* "lazy F" loop; see p7_ViterbiFilter_avx512() */
+        Dmax = p7_avx512_hmax_epi16(Dmaxv);
+        if (Dmax + om->ddbound_w > xB)
+        {
+          dcv = p7_avx512_leftshift_epi16(dcv, negInfv);
+          tsc = (__m512i *) om->twv_avx512 + 7*Q;  /* set tsc to start of the DD's */
+          for (q = 0; q < Q; q++)
+          {
+            DMXo(q) = _mm512_max_epi16(dcv, DMXo(q));
+            dcv     = _mm512_adds_epi16(DMXo(q), *tsc); tsc++;
+          }
+
+          do {
+            dcv = p7_avx512_leftshift_epi16(dcv, negInfv);
+            tsc = (__m512i *) om->twv_avx512 + 7*Q;  /* set tsc to start of the DD's */
+            for (q = 0; q < Q; q++)
+            {
+              if (! p7_avx512_any_gt_epi16(dcv, DMXo(q))) break;
+              DMXo(q) = _mm512_max_epi16(dcv, DMXo(q));
+              dcv     = _mm512_adds_epi16(DMXo(q), *tsc);   tsc++;
+            }
+          } while (q == Q);
+        }
+        else  /* not calculating DD? then just store the last M->D vector calc'ed.*/
+          DMXo(0) = p7_avx512_leftshift_epi16(dcv, negInfv);
+      }
+  } /* end loop over sequence residues 1..L */
+
+  return eslOK;
+}
+/*---------------- end, p7_ViterbiFilter_longtarget_avx512() ----*/
+
+
+
+
+/*****************************************************************
+ * 2. Benchmark driver.
+ *****************************************************************/
+#ifdef p7VITFILTER_AVX512_BENCHMARK
+/*
+   ./vitfilter_avx512_benchmark <hmmfile>            runs benchmark
+   ./vitfilter_avx512_benchmark -N100 -c <hmmfile>   compare scores to SSE impl
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-c",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "compare scores to generic implementation (debug)", 0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",        eslARG_INT,    "400", NULL, "n>0", NULL,  NULL, NULL, "length of random target seqs",                     0 },
+  { "-N",        eslARG_INT,  "20000", NULL, "n>0", NULL,  NULL, NULL, "number of random target seqs",                     0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <hmmfile>";
+static char banner[] = "benchmark driver for AVX-512 Viterbi filter";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *hmmfile = esl_opt_GetArg(go, 1);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc     = NULL;
+  P7_HMMFILE     *hfp     = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_BG          *bg      = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_OMX         *ox      = NULL;
+  P7_GMX         *gx      = NULL;
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  ESL_DSQ        *dsq     = malloc(sizeof(ESL_DSQ) * (L+2));
+  int             i;
+  float           sc1, sc2;
+  double          base_time, bench_time, Mcs;
+
+  if (p7_simd_Level() < p7_SIMD_AVX512) p7_Fail("AVX-512BW isn't supported by this processor (or is disabled by HMMER_SIMD)");
+
+  if (p7_hmmfile_Open(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
+  if (p7_hmmfile_Read(hfp, &abc, &hmm)           != eslOK) p7_Fail("Failed to read HMM");
+
+  bg = p7_bg_Create(abc);
+  p7_bg_SetLength(bg, L);
+  gm = p7_profile_Create(hmm->M, abc);
+  p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+  om = p7_oprofile_Create(gm->M, abc);
+  p7_oprofile_Convert(gm, om);
+  p7_oprofile_ReconfigLength(om, L);
+
+  ox = p7_omx_Create(gm->M, 0, 0);
+  gx = p7_gmx_Create(gm->M, L);
+
+  /* Get a baseline time: how long it takes just to generate the sequences */
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+  esl_stopwatch_Stop(w);
+  base_time = w->user;
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+      p7_ViterbiFilter_avx512(dsq, L, om, ox, &sc1);
+
+      if (esl_opt_GetBoolean(go, "-c"))
+	{
+	  p7_GViterbi(dsq, L, gm, gx, &sc2);
+	  printf("%.4f %.4f\n", sc1, sc2);
+	}
+    }
+  esl_stopwatch_Stop(w);
+  bench_time = w->user - base_time;
+  Mcs        = (double) N * (double) L * (double) gm->M * 1e-6 / (double) bench_time;
+  esl_stopwatch_Display(stdout, w, "# CPU time: ");
+  printf("# M    = %d\n",   gm->M);
+  printf("# %.1f Mc/s\n", Mcs);
+
+  free(dsq);
+  p7_omx_Destroy(ox);
+  p7_gmx_Destroy(gx);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  p7_hmmfile_Close(hfp);
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7VITFILTER_AVX512_BENCHMARK*/
+/*---------------- end, benchmark driver ------------------------*/
+
+
+
+
+/*****************************************************************
+ * 3. Unit tests.
+ *****************************************************************/
+#ifdef p7VITFILTER_AVX512_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* Same test as the SSE vitfilter utest: scores must be identical
+ * (within machine error) to scores of generic DP with scores rounded
+ * the same way. Do this for a random model of length <M>, for <N>
+ * test sequences of length <L>.
+ */
+static void
+utest_viterbi_filter(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  ESL_DSQ     *dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *ox  = p7_omx_Create(M, 0, 0);
+  P7_GMX      *gx  = p7_gmx_Create(M, L);
+  float sc1, sc2;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  p7_profile_SameAsVF(om, gm);	/* round and scale the scores in <gm> the same as in <om> */
+
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+
+      p7_ViterbiFilter_avx512(dsq, L, om, ox, &sc1);
+      p7_GViterbi            (dsq, L, gm, gx, &sc2);
+
+      sc2 /= om->scale_w;
+      sc2 -= 3.0;
+
+      if (fabs(sc1-sc2) > 0.001) esl_fatal("avx512 viterbi filter unit test failed: scores differ (%.2f, %.2f)", sc1, sc2);
+    }
+
+  free(dsq);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(ox);
+  p7_gmx_Destroy(gx);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+#endif /*p7VITFILTER_AVX512_TESTDRIVE*/
+/*---------------- end, unit tests ------------------------------*/
+
+
+
+
+/*****************************************************************
+ * 4. Test driver
+ *****************************************************************/
+#ifdef p7VITFILTER_AVX512_TESTDRIVE
+/*
+   ./vitfilter_avx512_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "size of random sequences to sample",             0 },
+  { "-M",        eslARG_INT,    "145", NULL, NULL,  NULL,  NULL, NULL, "size of random models to sample",                0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the AVX-512 Viterbi filter";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  /* Nothing to test if this processor can't run AVX-512BW */
+  if (p7_simd_Level() < p7_SIMD_AVX512) {
+    if (esl_opt_GetBoolean(go, "-v")) printf("AVX-512BW not supported by this processor; skipping tests\n");
+    esl_getopts_Destroy(go);
+    esl_randomness_Destroy(r);
+    return eslOK;
+  }
+
+  /* First round of tests for DNA alphabets.  */
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("ViterbiFilter_avx512() tests, DNA\n");
+  utest_viterbi_filter(r, abc, bg, M, L, N);
+  utest_viterbi_filter(r, abc, bg, 1, L, 10);
+  utest_viterbi_filter(r, abc, bg, M, 1, 10);
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  /* Second round of tests for amino alphabets.  */
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("ViterbiFilter_avx512() tests, protein\n");
+  utest_viterbi_filter(r, abc, bg, M, L, N);
+  utest_viterbi_filter(r, abc, bg, 1, L, 10);
+  utest_viterbi_filter(r, abc, bg, M, 1, 10);
+  utest_viterbi_filter(r, abc, bg, 33, L, 10);   /* crosses one 32-lane vector            */
+  utest_viterbi_filter(r, abc, bg, 1000, L, 10); /* long D->D paths across many segments  */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7VITFILTER_AVX512_TESTDRIVE*/
+/*---------------- end, test driver -----------------------------*/
+
+
+
+#else /*! HMMER_AVX512*/
+/* Provide a test driver that trivially passes, so `make check` works
+ * the same whether or not the AVX-512 filter was configured in.
+ */
+#ifdef p7VITFILTER_AVX512_TESTDRIVE
+int main(void) { return 0; }
+#endif
+void p7_vitfilter_avx512_silence_hack(void) { return; }
+#endif /*HMMER_AVX512 or not*/
@@ -67,6 +67,15 @@ static uint32_t  v3a_pmagic = 0xe8b3f0f3; /* 3/a binary profile file, VMX: "h3ps
  * legacied. (SRE, 27 Oct 10)
  */
 
+/* Files pressed by the SSE and NEON implementations (3/f, and the
+ * 3/g format with aligned vector blocks that SSE now writes) have a
+ * different layout. We only recognize them, to say so.
+ */
+static uint32_t  sse_v3g_fmagic = 0xb3e7e6f3; /* 3/g binary MSV file, SSE:     "3gfs" = 0x 33 67 66 73  + 0x80808080 */
+static uint32_t  sse_v3g_pmagic = 0xb3e7f0f3; /* 3/g binary profile file, SSE: "3gps" = 0x 33 67 70 73  + 0x80808080 */
+static uint32_t  sse_v3f_fmagic = 0xb3e6e6f3; /* 3/f binary MSV file, SSE:     "3ffs" = 0x 33 66 66 73  + 0x80808080 */
+static uint32_t  sse_v3f_pmagic = 0xb3e6f0f3; /* 3/f binary profile file, SSE: "3fps" = 0x 33 66 70 73  + 0x80808080 */
+
 
 /*****************************************************************
  *# 1. Writing optimized profiles to two files.
@@ -254,6 +263,7 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
   if (magic == v3c_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "this is an outdated HMM database format (3/c); please hmmpress your HMM file again");
   if (magic == v3d_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "this is an outdated HMM database format (3/d); please hmmpress your HMM file again");
   if (magic == v3e_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "this is an outdated HMM database format (3/e); please hmmpress your HMM file again");
+  if (magic == sse_v3f_fmagic || magic == sse_v3g_fmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles were pressed for SSE/NEON, not VMX; please hmmpress your HMM file again on this machine");
   if (magic != v3f_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
 
   if (! fread( (char *) &M,         sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
@@ -371,6 +381,7 @@ p7_oprofile_ReadInfoMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **r
   if (magic == v3c_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "this is an outdated HMM database format (3/c); please hmmpress your HMM file again");
   if (magic == v3d_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "this is an outdated HMM database format (3/d); please hmmpress your HMM file again");
   if (magic == v3e_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "this is an outdated HMM database format (3/e); please hmmpress your HMM file again");
+  if (magic == sse_v3f_fmagic || magic == sse_v3g_fmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles were pressed for SSE/NEON, not VMX; please hmmpress your HMM file again on this machine");
   if (magic != v3f_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
 
   if (! fread( (char *) &M,         sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
@@ -514,6 +525,7 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   if (magic == v3c_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "this is an outdated HMM database format (3/c); please hmmpress your HMM file again");
   if (magic == v3d_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "this is an outdated HMM database format (3/d); please hmmpress your HMM file again");
   if (magic == v3e_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "this is an outdated HMM database format (3/e); please hmmpress your HMM file again");
+  if (magic == sse_v3f_pmagic || magic == sse_v3g_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles were pressed for SSE/NEON, not VMX; please hmmpress your HMM file again on this machine");
   if (magic != v3f_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad magic; not an HMM database file?");
 
   if (! fread( (char *) &M,              sizeof(int),           1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read model size M");
@@ -357,7 +357,7 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   om2->nj        = om1->nj;
   om2->max_length = om1->max_length;
 
-  om2->clone     = om1->clone;
+  om2->clone     = 0;		/* a copy owns its memory, even if <om1> is a clone */
 
   return om2;
 
@@ -373,6 +373,15 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
  * Incept:    SRE, Sun Nov 25 12:03:19 2007 [Casa de Gatos]
  *
  * Purpose:   Quick copy of an optimized profile used in mutiple threads.
+ *            Only the structure itself is copied: the striped score
+ *            vectors stay shared and must be treated as read-only.
+ *            What a clone owns is its length configuration (<L> and
+ *            the N/C/J costs in <tjb_b>, <xw>, <xf>), so each thread
+ *            can <p7_oprofile_ReconfigLength()> its clone for its own
+ *            targets while all threads read one copy of the scores.
+ *            The original must outlive its clones, and nothing that
+ *            rewrites scores (e.g. <p7_oprofile_Update*EmissionScores()>)
+ *            may be called on a clone; use <p7_oprofile_Copy()> then.
  *
  * Throws:    <NULL> on allocation error.
  */
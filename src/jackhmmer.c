@@ -30,15 +30,22 @@
 #endif 
 
 #include "hmmer.h"
+#include "p7_dsqdb.h"
+#include "p7_pstage.h"
+#include "p7_wsched.h"
 
 typedef struct {
 #ifdef HMMER_THREADS
   ESL_WORK_QUEUE   *queue;
+  P7_WSCHED        *wsched;      /* work-stealing scheduler over <dsqdb>, or NULL to use <queue> */
+  P7_PSTAGE        *pstage;      /* staged search (--postcpu): queue to postprocessing threads, or NULL */
 #endif
   P7_BG            *bg;
   P7_PIPELINE      *pli;
   P7_TOPHITS       *th;
   P7_OPROFILE      *om;
+  P7_DSQDB         *dsqdb;       /* pressed target database, or NULL */
+  int               do_lsort;    /* TRUE to search each block in order of target length */
 } WORKER_INFO;
 
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
@@ -67,6 +74,7 @@ static ESL_OPTIONS options[] = {
   { "-A",           eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,    NULL,  NULL,            "save multiple alignment of hits to file <f>",                  2 },
   { "--tblout",     eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,    NULL,  NULL,            "save parseable table of per-sequence hits to file <f>",        2 },
   { "--domtblout",  eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,    NULL,  NULL,            "save parseable table of per-domain hits to file <f>",          2 },
+  { "--pjson",      eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,    NULL,  NULL,            "time each pipeline stage; save profiles to <f> as JSON lines", 2 },
   { "--chkhmm",     eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,    NULL,  NULL,            "save HMM checkpoints to files <f>-<iteration>.hmm",            2 },
   { "--chkali",     eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,    NULL,  NULL,            "save alignment checkpoints to files <f>-<iteration>.sto",      2 },
   { "--acc",        eslARG_NONE,        FALSE, NULL, NULL,      NULL,    NULL,  NULL,            "prefer accessions over names in output",                       2 },
@@ -134,12 +142,15 @@ static ESL_OPTIONS options[] = {
   { "--nonull2",    eslARG_NONE,         NULL, NULL, NULL,      NULL,    NULL,  NULL,            "turn off biased composition score corrections",               12 },
   { "-Z",           eslARG_REAL,        FALSE, NULL, "x>0",     NULL,    NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,        FALSE, NULL, "x>0",     NULL,    NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
+  { "--maxhits",    eslARG_INT,         FALSE, NULL, "n>0",     NULL,    "-Z",  NULL,            "keep only the top <n> hits (bounded memory; requires -Z)",     12 },
   { "--seed",       eslARG_INT,          "42", NULL, "n>=0",    NULL,    NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
   { "--qformat",    eslARG_STRING,       NULL, NULL, NULL,      NULL,    NULL,  NULL,            "assert query <seqfile> is in format <s>: no autodetection",   12 },
   { "--tformat",    eslARG_STRING,       NULL, NULL, NULL,      NULL,    NULL,  NULL,            "assert target <seqdb> is in format <s>>: no autodetection",   12 },
+  { "--lsort",      eslARG_NONE,        FALSE, NULL, NULL,      NULL,    NULL,  NULL,            "search each block of targets in order of length",             12 },
 
 #ifdef HMMER_THREADS
   { "--cpu",        eslARG_INT,      p7_NCPU,"HMMER_NCPU","n>=0", NULL,    NULL,  CPUOPTS,       "number of parallel CPU workers to use for multithreads",      12 },
+  { "--postcpu",    eslARG_INT,      "0",            NULL,"n>=0", NULL,    NULL,  CPUOPTS,       "number of separate threads for domain postprocessing",        12 },
 #endif
 #ifdef HMMER_MPI
   { "--stall",      eslARG_NONE,       FALSE, NULL,  NULL,      NULL,  "--mpi", NULL,            "arrest after start: for debugging MPI under gdb",             12 },  
@@ -168,12 +179,15 @@ struct cfg_s {
 
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
-static int  serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp);
+static int  serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, P7_DSQDB *dsqdb);
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
 
-static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp);
+static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, P7_DSQDB *dsqdb);
+static int  steal_loop (ESL_THREADS *obj, P7_WSCHED *wsched, P7_DSQDB *dsqdb);
 static void pipeline_thread(void *arg);
+static void postproc_thread(void *arg);
+static void search_block(WORKER_INFO *info, ESL_SQ_BLOCK *block);
 #endif 
 
 #ifdef HMMER_MPI
@@ -292,6 +306,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "-A")           && fprintf(ofp, "# MSA of hits saved to file:       %s\n",             esl_opt_GetString(go, "-A"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--tblout")     && fprintf(ofp, "# per-seq hits tabular output:     %s\n",             esl_opt_GetString(go, "--tblout"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domtblout")  && fprintf(ofp, "# per-dom hits tabular output:     %s\n",             esl_opt_GetString(go, "--domtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--pjson")      && fprintf(ofp, "# per-stage profile (JSON):        %s\n",             esl_opt_GetString(go, "--pjson"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--chkhmm")     && fprintf(ofp, "# HMM checkpoint files output:     %s-<i>.hmm\n",     esl_opt_GetString(go, "--chkhmm"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--chkali")     && fprintf(ofp, "# MSA checkpoint files output:     %s-<i>.sto\n",     esl_opt_GetString(go, "--chkali"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--acc")        && fprintf(ofp, "# prefer accessions over names:    yes\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -346,6 +361,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--nonull2")    && fprintf(ofp, "# null2 bias corrections:          off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")           && fprintf(ofp, "# sequence search space set to:    %.0f\n",           esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")       && fprintf(ofp, "# domain search space set to:      %.0f\n",           esl_opt_GetReal(go, "--domZ"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--maxhits")    && fprintf(ofp, "# max hits kept per query:         %d\n",             esl_opt_GetInteger(go, "--maxhits"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))
     {
       if (esl_opt_GetInteger(go, "--seed") == 0  && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -355,6 +371,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--tformat")    && fprintf(ofp, "# target <seqdb> format asserted:  %s\n",             esl_opt_GetString(go, "--tformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_THREADS
   if (esl_opt_IsUsed(go, "--cpu")        && fprintf(ofp, "# number of worker threads:        %d\n",             esl_opt_GetInteger(go, "--cpu"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--postcpu")    && fprintf(ofp, "# postprocessing threads:          %d\n",             esl_opt_GetInteger(go, "--postcpu"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
 #ifdef HMMER_MPI
   if (esl_opt_IsUsed(go, "--mpi")        && fprintf(ofp, "# MPI:                             on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -431,10 +448,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *afp      = NULL;               /* alignment output file (-A option)               */
   FILE            *tblfp    = NULL;		  /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;		  /* output stream for tabular per-seq (--domtblout) */
+  FILE            *pjfp     = NULL;		  /* output stream for pipeline profiles (--pjson)   */
   int              qformat  = eslSQFILE_UNKNOWN;  /* format of qfile                                 */
   int              dbformat = eslSQFILE_UNKNOWN;  /* format of dbfile                                */
   ESL_SQFILE      *qfp      = NULL;		  /* open qfile                                      */
   ESL_SQFILE      *dbfp     = NULL;               /* open dbfile                                     */
+  P7_DSQDB        *dsqdb    = NULL;               /* ... or open pressed sequence database           */
   ESL_ALPHABET    *abc      = NULL;               /* sequence alphabet                               */
   P7_BG           *bg       = NULL;		  /* null model                                      */
   P7_BUILDER      *bld      = NULL;               /* HMM construction configuration                  */
@@ -453,14 +472,20 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              i;
   int              ncpus    = 0;
+  int              npost    = 0;                  /* # of postprocessing threads, in a staged search */
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thv      = NULL;               /* hit lists of workers 1.., for merging */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
   ESL_WORK_QUEUE  *queue    = NULL;
+  P7_WSCHED       *wsched   = NULL;
+  ESL_THREADS     *postObj  = NULL;
+  P7_PSTAGE       *pstage   = NULL;
 #endif
+  char             errbuf[eslERRBUFSIZE];
 
   /* Initializations */
   abc           = esl_alphabet_Create(eslAMINO);
@@ -504,15 +529,23 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     p7_Fail("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout"));
   if (esl_opt_IsOn(go, "--domtblout") && (domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  
     p7_Fail("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout"));
+  if (esl_opt_IsOn(go, "--pjson")     && (pjfp     = fopen(esl_opt_GetString(go, "--pjson"),     "w")) == NULL)
+    p7_Fail("Failed to open pipeline profile output file %s for writing\n", esl_opt_GetString(go, "--pjson"));
 
-  /* Open the target sequence database for sequential access. */
-  status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
+  /* Open the target sequence database for sequential access: a pressed
+   * one (see makedsqdb) if it is one and no format was given.
+   */
+  status = (dbformat == eslSQFILE_UNKNOWN ? p7_dsqdb_Open(cfg->dbfile, &dsqdb, errbuf) : eslENOTFOUND);
+  if      (status == eslEFORMAT)   p7_Fail("Pressed sequence database %s is corrupt.\n%s\n", cfg->dbfile, errbuf);
+  else if (status == eslENOTFOUND) status = esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
+  else if (status != eslOK)        p7_Fail("Unexpected error %d opening pressed sequence database %s\n", status, cfg->dbfile);
   if      (status == eslENOTFOUND) p7_Fail("Failed to open target sequence database %s for reading\n",      cfg->dbfile);
   else if (status == eslEFORMAT)   p7_Fail("Target sequence database file %s is empty or misformatted\n",   cfg->dbfile);
   else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
   else if (status != eslOK)        p7_Fail("Unexpected error %d opening target sequence database file %s\n", status, cfg->dbfile);
+  if (dsqdb && dsqdb->alphatype != eslAMINO) p7_Fail("Pressed sequence database %s isn't protein\n", cfg->dbfile);
   
-  if (! esl_sqfile_IsRewindable(dbfp)) 
+  if (dbfp && ! esl_sqfile_IsRewindable(dbfp)) 
     p7_Fail("Target sequence file %s isn't rewindable; jackhmmer requires that it is", cfg->dbfile);
 
   /* Open the query sequence file  */
@@ -530,11 +563,27 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     {
       threadObj = esl_threads_Create(&pipeline_thread);
       queue = esl_workqueue_Create(ncpus * 2);
+
+      /* A pressed database needs no reader: workers fetch their own
+       * targets by index, and steal from each other when they run out.
+       */
+      if (dsqdb && (wsched = p7_wsched_Create(ncpus)) == NULL) p7_Fail("Failed to create work-stealing scheduler");
+
+      /* A staged search: the <ncpus> workers only filter, and hand
+       * the targets that pass to <npost> more that do the rest.
+       */
+      if ((npost = esl_opt_GetInteger(go, "--postcpu")) > 0)
+	{
+	  postObj = esl_threads_Create(&postproc_thread);
+	  if ((pstage = p7_pstage_Create(ncpus, npost)) == NULL) p7_Fail("Failed to create pipeline stage queue");
+	}
     }
 #endif
 
-  infocnt = (ncpus == 0) ? 1 : ncpus;
+  /* in a staged search, workers ncpus.. are the postprocessing ones */
+  infocnt = (ncpus == 0) ? 1 : ncpus + npost;
   ESL_ALLOC(info, (ptrdiff_t) sizeof(*info) * infocnt);
+  ESL_ALLOC(thv,  (ptrdiff_t) sizeof(P7_TOPHITS *) * infocnt);
 
   /* Ready to begin */
   output_header(ofp, go, cfg->qfile, cfg->dbfile);
@@ -545,8 +594,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       info[i].th    = NULL;
       info[i].om    = NULL;
       info[i].bg    = p7_bg_Clone(bg);
+      info[i].dsqdb = dsqdb;
+      info[i].do_lsort = esl_opt_GetBoolean(go, "--lsort");
 #ifdef HMMER_THREADS
-      info[i].queue = queue;
+      info[i].queue  = queue;
+      info[i].wsched = wsched;
+      info[i].pstage = pstage;
 #endif
     }
 
@@ -628,48 +681,68 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  }
 
 	  /* Create new processing pipeline and top hits list; destroy old. (TODO: reuse rather than recreate) */
+#ifdef HMMER_THREADS
+	  if (pstage) p7_pstage_Reset(pstage);
+#endif
 	  for (i = 0; i < infocnt; ++i)
 	    {
 	      info[i].th  = p7_tophits_Create();
+	      if (esl_opt_IsOn(go, "--maxhits")) p7_tophits_SetMaxHits(info[i].th, esl_opt_GetInteger(go, "--maxhits"));
 	      info[i].om  = p7_oprofile_Clone(om);
 	      info[i].pli = p7_pipeline_Create(go, om->M, 400, FALSE, p7_SEARCH_SEQS); /* 400 is a dummy length for now */
+	      info[i].pli->report_thr = infocnt;
+	      info[i].pli->do_profile = (pjfp != NULL);
 	      p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
 
 #ifdef HMMER_THREADS
-	      if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+	      if (ncpus > 0) esl_threads_AddThread((i < ncpus ? threadObj : postObj), &info[i]);
 #endif
 	    }
 
 #ifdef HMMER_THREADS
-	  if (ncpus > 0) sstatus = thread_loop(threadObj, queue, dbfp);
-	  else           sstatus = serial_loop(info, dbfp);
+	  if (pstage) esl_threads_WaitForStart(postObj);
+
+	  if      (wsched)    sstatus = steal_loop (threadObj, wsched, dsqdb);
+	  else if (ncpus > 0) sstatus = thread_loop(threadObj, queue, dbfp, dsqdb);
+	  else                sstatus = serial_loop(info, dbfp, dsqdb);
+
+	  /* filtering is done; the postprocessing threads finish what's queued */
+	  if (pstage && sstatus == eslEOF)
+	    {
+	      p7_pstage_Close(pstage);
+	      esl_threads_WaitForFinish(postObj);
+	    }
 #else
-	  sstatus = serial_loop(info, dbfp);
+	  sstatus = serial_loop(info, dbfp, dsqdb);
 #endif
 	  switch(sstatus)
 	    {
 	    case eslEFORMAT:
 	      p7_Fail("Parse failed (sequence file %s):\n%s\n",
-			dbfp->filename, esl_sqfile_GetErrorBuf(dbfp));
+			cfg->dbfile, dsqdb ? dsqdb->errbuf : esl_sqfile_GetErrorBuf(dbfp));
 	      break;
 	    case eslEOF:
 	      /* do nothing */
 	      break;
 	    default:
 	      p7_Fail("Unexpected error %d reading sequence file %s",
-			sstatus, dbfp->filename);
+			sstatus, cfg->dbfile);
 	    }
 
 	  /* merge the results of the search results */
 	  for (i = 1; i < infocnt; ++i)
 	    {
-	      p7_tophits_Merge(info[0].th, info[i].th);
+	      thv[i-1] = info[i].th;
 	      p7_pipeline_Merge(info[0].pli, info[i].pli);
 
 	      p7_pipeline_Destroy(info[i].pli);
-	      p7_tophits_Destroy(info[i].th);
 	      p7_oprofile_Destroy(info[i].om);
 	    }
+	  if (p7_tophits_MergeN(info[0].th, thv, infocnt-1, infocnt) != eslOK) p7_Fail("Failed to merge hit lists");
+	  for (i = 1; i < infocnt; ++i) p7_tophits_Destroy(thv[i-1]);
+#ifdef HMMER_THREADS
+	  if (pstage) p7_pstage_Account(pstage, info[0].pli);
+#endif
 
 	  /* Print the results. */
 	  p7_tophits_SortBySortkey(info->th);
@@ -692,6 +765,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
 	  esl_stopwatch_Stop(w);
 	  p7_pli_Statistics(ofp, info->pli, w);
+	  if (pjfp) p7_pli_WriteProfile(pjfp, qsq->name, info->pli, w);
 
 
 	  /* Convergence test */
@@ -709,7 +783,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  else if (iteration < maxiterations)
 	    { if (fprintf(ofp, "@@ Continuing to next round.\n\n")           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
 
-	  esl_sqfile_Position(dbfp, 0);
+	  if (dsqdb) p7_dsqdb_Position(dsqdb, 0);
+	  else       esl_sqfile_Position(dbfp, 0);
 	} /* end iteration loop */
 
       /* Because we destroy/create the hitlist, om, pipeline, and msa above, rather than create/destroy,
@@ -740,7 +815,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       p7_trace_Destroy(qtr);
       esl_sq_Reuse(qsq);
       esl_keyhash_Reuse(kh);
-      esl_sqfile_Position(dbfp, 0);
+      if (dsqdb) p7_dsqdb_Position(dsqdb, 0);
+      else       esl_sqfile_Position(dbfp, 0);
     }
   if      (qstatus == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n",
 					    qfp->filename, esl_sqfile_GetErrorBuf(qfp));
@@ -765,15 +841,20 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
 	esl_sq_DestroyBlock(block);
       esl_workqueue_Destroy(queue);
+      p7_wsched_Destroy(wsched);
       esl_threads_Destroy(threadObj);
+      if (postObj) esl_threads_Destroy(postObj);
+      p7_pstage_Destroy(pstage);
     }
 #endif
 
   free(info);
+  free(thv);
 
   esl_keyhash_Destroy(kh);
   esl_sqfile_Close(qfp);
-  esl_sqfile_Close(dbfp);
+  if (dbfp)  esl_sqfile_Close(dbfp);
+  if (dsqdb) p7_dsqdb_Close(dsqdb);
   esl_sq_Destroy(qsq);  
   esl_stopwatch_Destroy(w);
   p7_builder_Destroy(bld);
@@ -784,6 +865,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (afp      != NULL)   fclose(afp);
   if (tblfp    != NULL)   fclose(tblfp);
   if (domtblfp != NULL)   fclose(domtblfp);
+  if (pjfp     != NULL)   fclose(pjfp);
 
   return eslOK;
 
@@ -985,6 +1067,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *afp      = NULL;               /* alignment output file (-A option)               */
   FILE            *tblfp    = NULL;		  /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;		  /* output stream for tabular per-seq (--domtblout) */
+  FILE            *pjfp     = NULL;		  /* output stream for pipeline profiles (--pjson)   */
   int              qformat  = eslSQFILE_UNKNOWN;  /* format of qfile                                 */
   int              dbformat = eslSQFILE_UNKNOWN;  /* format of dbfile                                */
   ESL_SQFILE      *qfp      = NULL;		  /* open qfile                                      */
@@ -1055,6 +1138,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     mpi_failure("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblfp"));
   if (esl_opt_IsOn(go, "--domtblout") && (domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  
     mpi_failure("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblfp"));
+  if (esl_opt_IsOn(go, "--pjson")     && (pjfp     = fopen(esl_opt_GetString(go, "--pjson"),     "w")) == NULL)
+    mpi_failure("Failed to open pipeline profile output file %s for writing\n", esl_opt_GetString(go, "--pjson"));
 
   /* Open the target sequence database for sequential access. */
   status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
@@ -1151,7 +1236,9 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
 	  /* Create new processing pipeline and top hits list; destroy old. (TODO: reuse rather than recreate) */
 	  th  = p7_tophits_Create();
+	  if (esl_opt_IsOn(go, "--maxhits")) p7_tophits_SetMaxHits(th, esl_opt_GetInteger(go, "--maxhits"));
 	  pli = p7_pipeline_Create(go, om->M, 400, FALSE, p7_SEARCH_SEQS); /* 400 is a dummy length for now */
+	  pli->do_profile = esl_opt_IsOn(go, "--pjson");
 	  p7_pli_NewModel(pli, om, bg);
 
 	  /* Send to all the workers the optimized model to search with */
@@ -1246,6 +1333,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
 	  esl_stopwatch_Stop(w);
 	  p7_pli_Statistics(ofp, pli, w);
+	  if (pjfp) p7_pli_WriteProfile(pjfp, qsq->name, pli, w);
 
 	  /* Convergence test */
 	  if (fprintf(ofp, "\n")                                             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -1356,6 +1444,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (afp      != NULL)   fclose(afp);
   if (tblfp    != NULL)   fclose(tblfp);
   if (domtblfp != NULL)   fclose(domtblfp);
+  if (pjfp     != NULL)   fclose(pjfp);
 
   return eslOK;
 
@@ -1466,7 +1555,9 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 
 	  /* Create new processing pipeline and top hits list; destroy old. (TODO: reuse rather than recreate) */
 	  th  = p7_tophits_Create();
+	  if (esl_opt_IsOn(go, "--maxhits")) p7_tophits_SetMaxHits(th, esl_opt_GetInteger(go, "--maxhits"));
 	  pli = p7_pipeline_Create(go, om->M, 400, FALSE, p7_SEARCH_SEQS); /* 400 is a dummy length for now */
+	  pli->do_profile = esl_opt_IsOn(go, "--pjson");
 	  p7_pli_NewModel(pli, om, bg);
 
 	  /* receive a sequence block from the master */
@@ -1598,7 +1689,7 @@ checkpoint_msa(int nquery, ESL_MSA *msa, char *basename, int iteration)
 }
 
 static int
-serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp)
+serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, P7_DSQDB *dsqdb)
 {
   int      sstatus;
   ESL_SQ   *dbsq     = NULL;   /* one target sequence (digital)  */
@@ -1606,15 +1697,15 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp)
   dbsq = esl_sq_CreateDigital(info->om->abc);
 
   /* Main loop: */
-  while ((sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
+  while ((sstatus = (dsqdb ? p7_dsqdb_Read(dsqdb, dbsq) : esl_sqio_Read(dbfp, dbsq))) == eslOK)
     {
       p7_pli_NewSeq(info->pli, dbsq);
-      p7_bg_SetLength(info->bg, dbsq->n);
-      p7_oprofile_ReconfigLength(info->om, dbsq->n);
+      p7_pli_SetLength(info->pli, info->om, info->bg, dbsq->n);
       
       p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
 
-      esl_sq_Reuse(dbsq);
+      if (dsqdb) p7_dsqdb_ReuseSeq(dbsq);
+      else       esl_sq_Reuse(dbsq);
       p7_pipeline_Reuse(info->pli);
     }
 
@@ -1625,7 +1716,7 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp)
 
 #ifdef HMMER_THREADS
 static int
-thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp)
+thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, P7_DSQDB *dsqdb)
 {
   int  status  = eslOK;
   int  sstatus = eslOK;
@@ -1643,7 +1734,8 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp)
   while (sstatus == eslOK)
     {
       block = (ESL_SQ_BLOCK *) newBlock;
-      sstatus = esl_sqio_ReadBlock(dbfp, block, -1, -1, /*max_init_window=*/FALSE, FALSE);
+      if (dsqdb) sstatus = p7_dsqdb_ReadBlock(dsqdb, block, -1);
+      else       sstatus = esl_sqio_ReadBlock(dbfp, block, -1, -1, /*max_init_window=*/FALSE, FALSE);
       if (sstatus == eslEOF)
 	{
 	  if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
@@ -1670,26 +1762,66 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp)
   return sstatus;
 }
 
+/* steal_loop()
+ * The threaded search of a pressed database: no reader, no queue.
+ * The targets from the current position of <dsqdb> on are dealt out
+ * to the workers' deques in <wsched>, and the workers fetch their
+ * targets themselves (see pipeline_thread()).
+ */
+static int
+steal_loop(ESL_THREADS *obj, P7_WSCHED *wsched, P7_DSQDB *dsqdb)
+{
+  p7_wsched_Reset(wsched, dsqdb->next, dsqdb->nseq, BLOCK_SIZE);
+
+  esl_threads_WaitForStart(obj);
+  esl_threads_WaitForFinish(obj);
+
+  p7_dsqdb_Position(dsqdb, dsqdb->nseq);
+  return eslEOF;
+}
+
 static void 
 pipeline_thread(void *arg)
 {
-  int i;
   int status;
   int workeridx;
   WORKER_INFO   *info;
   ESL_THREADS   *obj;
-
   ESL_SQ_BLOCK  *block = NULL;
   void          *newBlock;
-
+  int64_t        lo, hi;
+  
   impl_Init();
 
-
   obj = (ESL_THREADS *) arg;
   esl_threads_Started(obj, &workeridx);
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
 
+  /* A pressed database: take ranges of targets from our own deque,
+   * or steal them, and fetch them into our own block.
+   */
+  if (info->wsched)
+    {
+      block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, info->om->abc);
+      if (block == NULL) p7_Fail("Failed to allocate sequence block");
+
+      while ((status = p7_wsched_Next(info->wsched, workeridx, &lo, &hi)) == eslOK)
+	{
+	  status = p7_dsqdb_FetchBlock(info->dsqdb, block, lo, (int) (hi - lo));
+	  if      (status == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n", info->dsqdb->filename, info->dsqdb->errbuf);
+	  else if (status != eslOK)      p7_Fail("Unexpected error %d reading sequence file %s", status, info->dsqdb->filename);
+
+	  search_block(info, block);
+	}
+      if (status != eslEOF) p7_Fail("Work-stealing scheduler failed");
+
+      esl_sq_DestroyBlock(block);
+      p7_tophits_SortBySortkey(info->th);  /* here in the worker, so the master only has to merge */
+      esl_threads_Finished(obj, workeridx);
+      return;
+    }
+
   status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
   if (status != eslOK) p7_Fail("Work queue worker failed");
 
@@ -1697,20 +1829,7 @@ pipeline_thread(void *arg)
   block = (ESL_SQ_BLOCK *) newBlock;
   while (block->count > 0)
     {
-      /* Main loop: */
-      for (i = 0; i < block->count; ++i)
-	{
-	  ESL_SQ *dbsq = block->list + i;
-
-	  p7_pli_NewSeq(info->pli, dbsq);
-	  p7_bg_SetLength(info->bg, dbsq->n);
-	  p7_oprofile_ReconfigLength(info->om, dbsq->n);
-
-	  p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
-
-	  esl_sq_Reuse(dbsq);
-	  p7_pipeline_Reuse(info->pli);
-	}
+      search_block(info, block);
 
       status = esl_workqueue_WorkerUpdate(info->queue, block, &newBlock);
       if (status != eslOK) p7_Fail("Work queue worker failed");
@@ -1721,9 +1840,84 @@ pipeline_thread(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) p7_Fail("Work queue worker failed");
 
+  p7_tophits_SortBySortkey(info->th);
   esl_threads_Finished(obj, workeridx);
   return;
 }
+
+/* postproc_thread()
+ * A postprocessing worker of a staged search (--postcpu): finishes
+ * the search of each target that passed some filter worker's
+ * filters, with its own pipeline and copy of the query.
+ */
+static void
+postproc_thread(void *arg)
+{
+  int            status;
+  int            workeridx;
+  WORKER_INFO   *info;
+  ESL_THREADS   *obj;
+  P7_SURVIVOR    sv;
+
+  impl_Init();
+
+  obj = (ESL_THREADS *) arg;
+  esl_threads_Started(obj, &workeridx);
+
+  info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+
+  while ((status = p7_pstage_Pop(info->pstage, &sv)) == eslOK)
+    {
+      p7_pli_SetLength(info->pli, info->om, info->bg, sv.sq->n);
+      p7_pli_Postprocess(info->pli, info->om, info->bg, sv.sq, NULL, sv.fwdsc, info->th);
+
+      p7_pipeline_Reuse(info->pli);
+      esl_sq_Destroy(sv.sq);
+    }
+  if (status != eslEOF) p7_Fail("Pipeline stage queue failed");
+
+  p7_tophits_SortBySortkey(info->th);
+  esl_threads_Finished(obj, workeridx);
+  return;
+}
+
+/* search_block()
+ * Search the query against a block of targets, recycling each
+ * target sequence as we go.
+ */
+static void
+search_block(WORKER_INFO *info, ESL_SQ_BLOCK *block)
+{
+  ESL_SQ *dbsq;
+  float   fwdsc;
+  int     i, j;
+
+  /* With --lsort, targets of the same length are searched one after
+   * another, and only the first of them reconfigures the length model.
+   */
+  if (info->do_lsort && p7_pli_SortByLength(info->pli, block->list, block->count) != eslOK)
+    esl_fatal("Failed to sort target block by length");
+
+  for (j = 0; j < block->count; ++j)
+    {
+      i    = (info->do_lsort ? info->pli->order[j] : j);
+      dbsq = block->list + i;
+
+      p7_pli_NewSeq(info->pli, dbsq);
+      p7_pli_SetLength(info->pli, info->om, info->bg, dbsq->n);
+
+      /* in a staged search, targets that pass the filters go to the postprocessing threads */
+      if (! info->pstage)
+	p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
+      else if (p7_pli_Filter(info->pli, info->om, info->bg, dbsq, &fwdsc) == eslOK &&
+	       p7_pstage_Push(info->pstage, dbsq, 0, fwdsc) != eslOK)
+	p7_Fail("Failed to queue target for postprocessing");
+
+      if (info->dsqdb) p7_dsqdb_ReuseSeq(dbsq);
+      else             esl_sq_Reuse(dbsq);
+      p7_pipeline_Reuse(info->pli);
+    }
+}
 #endif   /* HMMER_THREADS */
 
 
@@ -0,0 +1,429 @@
+/* Benchmarking the dynamic programming kernels side by side.
+ *
+ * Each implementation file has its own benchmark driver, each with
+ * its own options and output format, which makes it tedious to
+ * compare one build against another. This driver runs all the
+ * vector kernels of whichever implementation HMMER was built with
+ * (impl_sse, impl_neon, impl_vmx) and all the generic kernels, on
+ * sampled profiles and iid random target sequences, over a grid of
+ * model lengths M and target lengths L. For each kernel and (M,L) it
+ * reports the rate in billions of DP cells per second (GCUPS), its
+ * standard deviation over replicate timings, and cycles per cell.
+ *
+ * The results can be saved as a tab-delimited table (--tsv) and a
+ * later run compared to a saved one (--compare): for instance, the
+ * same build under --simd sse and --simd avx2, an SSE build against
+ * a NEON one, or a branch against the release.
+ *
+ * Contents:
+ *   1. Benchmark driver
+ */
+#include <p7_config.h>
+
+/*****************************************************************
+ * 1. Benchmark driver
+ *****************************************************************/
+#ifdef p7KERNELS_BENCHMARK
+/*
+   gcc -O3 -o kernels_benchmark -I. -L. -I../easel -L../easel -Dp7KERNELS_BENCHMARK kernels.c -lhmmer -leasel -lm
+   ./kernels_benchmark
+   ./kernels_benchmark --kernels msv,vit,fwdparser --Mlist 100,400 --Llist 400 --tsv before.tsv
+   ./kernels_benchmark --kernels msv,vit,fwdparser --Mlist 100,400 --Llist 400 --compare before.tsv
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stats.h"
+
+#include "hmmer.h"
+
+#define NPOOL 8			/* # of different target seqs the sequence-consuming kernels cycle through */
+
+static ESL_OPTIONS options[] = {
+  /* name           type         default                env  range toggles reqs incomp  help                                                 docgroup*/
+  { "-h",         eslARG_NONE,       FALSE,              NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",                        0 },
+  { "-s",         eslARG_INT,         "42",              NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                               0 },
+  { "--Mlist",    eslARG_STRING, "50,100,200,400,800",   NULL, NULL,  NULL,  NULL, NULL, "comma-separated model lengths M to benchmark",                0 },
+  { "--Llist",    eslARG_STRING, "100,400,1000",         NULL, NULL,  NULL,  NULL, NULL, "comma-separated target lengths L to benchmark",               0 },
+  { "--kernels",  eslARG_STRING,      NULL,              NULL, NULL,  NULL,  NULL, NULL, "comma-separated kernels to run (default: all; see --list)",   0 },
+  { "--list",     eslARG_NONE,       FALSE,              NULL, NULL,  NULL,  NULL, NULL, "list the kernels and exit",                                   0 },
+  { "--reps",     eslARG_INT,          "5",              NULL, "n>0", NULL,  NULL, NULL, "time each kernel and (M,L) <n> times",                        0 },
+  { "--mintime",  eslARG_REAL,       "0.1",              NULL, "x>0", NULL,  NULL, NULL, "run each timing for at least <x> seconds",                    0 },
+  { "--ghz",      eslARG_REAL,        NULL,              NULL, "x>0", NULL,  NULL, NULL, "clock rate for cycles/cell, instead of the timestamp counter",0 },
+  { "--tsv",      eslARG_OUTFILE,     NULL,              NULL, NULL,  NULL,  NULL, NULL, "also save results as a tab-delimited table to file <f>",      0 },
+  { "--compare",  eslARG_INFILE,      NULL,              NULL, NULL,  NULL,  NULL, NULL, "compare rates to a table saved by an earlier --tsv",          0 },
+#if defined (eslENABLE_SSE)
+  { "--simd",     eslARG_STRING,      NULL,      "HMMER_SIMD", NULL,  NULL,  NULL, NULL, "vector instructions to use: sse, avx2, avx512, or auto",      0 },
+#endif
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "benchmark driver for the vector and generic DP kernels";
+
+/* Everything the kernels need for one (M,L) point of the grid.
+ * Kernels that need another kernel's output (Backward, decoding,
+ * optimal accuracy, null2) use matrices computed once, for the first
+ * sequence of the pool, before timing starts.
+ */
+struct kbench_s {
+  int          M, L;
+  ESL_DSQ     *dsq[NPOOL];
+  P7_PROFILE  *gm;
+  P7_OPROFILE *om;
+  P7_OMX      *ox;		/* one-row, for the filters          */
+  P7_OMX      *oxp;		/* one-row, for the Backward parser  */
+  P7_OMX      *fwdp;		/* one-row, Forward parser result    */
+  P7_OMX      *fwd, *bck, *pp;	/* full, Forward/Backward/posteriors */
+  P7_OMX      *oxf;		/* full, scratch for timed full DP   */
+  P7_GMX      *gx;		/* scratch for timed generic DP      */
+  P7_GMX      *gfwd, *gbck, *gpp;
+  float       *null2;
+};
+
+/* Each kernel is wrapped to a common signature. <dsq> is the target
+ * for kernels that take one.
+ */
+static int k_msv      (struct kbench_s *kb, const ESL_DSQ *dsq) { float sc; return p7_MSVFilter     (dsq, kb->L, kb->om, kb->ox,  &sc); }
+#if defined (eslENABLE_SSE) || defined (eslENABLE_NEON)
+static int k_ssv      (struct kbench_s *kb, const ESL_DSQ *dsq) { float sc; return p7_SSVFilter     (dsq, kb->L, kb->om,          &sc); }
+#endif
+static int k_vit      (struct kbench_s *kb, const ESL_DSQ *dsq) { float sc; return p7_ViterbiFilter (dsq, kb->L, kb->om, kb->ox,  &sc); }
+static int k_vitscore (struct kbench_s *kb, const ESL_DSQ *dsq) { float sc; return p7_ViterbiScore  (dsq, kb->L, kb->om, kb->ox,  &sc); }
+static int k_fwdparser(struct kbench_s *kb, const ESL_DSQ *dsq) { float sc; return p7_ForwardParser (dsq, kb->L, kb->om, kb->ox,  &sc); }
+static int k_bckparser(struct kbench_s *kb, const ESL_DSQ *dsq) { float sc; return p7_BackwardParser(kb->dsq[0], kb->L, kb->om, kb->fwdp, kb->oxp, &sc); }
+static int k_fwd      (struct kbench_s *kb, const ESL_DSQ *dsq) { float sc; return p7_Forward       (dsq, kb->L, kb->om, kb->oxf, &sc); }
+static int k_bck      (struct kbench_s *kb, const ESL_DSQ *dsq) { float sc; return p7_Backward      (kb->dsq[0], kb->L, kb->om, kb->fwd, kb->oxf, &sc); }
+static int k_decoding (struct kbench_s *kb, const ESL_DSQ *dsq) {           return p7_Decoding      (kb->om, kb->fwd, kb->bck, kb->oxf);       }
+static int k_optacc   (struct kbench_s *kb, const ESL_DSQ *dsq) { float e;  return p7_OptimalAccuracy(kb->om, kb->pp, kb->oxf, &e);            }
+static int k_null2    (struct kbench_s *kb, const ESL_DSQ *dsq) {           return p7_Null2_ByExpectation(kb->om, kb->pp, kb->null2);         }
+static int k_gmsv     (struct kbench_s *kb, const ESL_DSQ *dsq) { float sc; return p7_GMSV          (dsq, kb->L, kb->gm, kb->gx, 2.0, &sc);   }
+static int k_gvit     (struct kbench_s *kb, const ESL_DSQ *dsq) { float sc; return p7_GViterbi      (dsq, kb->L, kb->gm, kb->gx, &sc);        }
+static int k_gfwd     (struct kbench_s *kb, const ESL_DSQ *dsq) { float sc; return p7_GForward      (dsq, kb->L, kb->gm, kb->gx, &sc);        }
+static int k_gbck     (struct kbench_s *kb, const ESL_DSQ *dsq) { float sc; return p7_GBackward     (dsq, kb->L, kb->gm, kb->gx, &sc);        }
+static int k_gdecoding(struct kbench_s *kb, const ESL_DSQ *dsq) {           return p7_GDecoding     (kb->gm, kb->gfwd, kb->gbck, kb->gx);      }
+static int k_goptacc  (struct kbench_s *kb, const ESL_DSQ *dsq) { float e;  return p7_GOptimalAccuracy(kb->gm, kb->gpp, kb->gx, &e);          }
+static int k_gnull2   (struct kbench_s *kb, const ESL_DSQ *dsq) {           return p7_GNull2_ByExpectation(kb->gm, kb->gpp, kb->null2);       }
+
+static const struct kernel_s {
+  char *name;
+  int (*run)(struct kbench_s *kb, const ESL_DSQ *dsq);
+  char *desc;
+} kernels[] = {
+#if defined (eslENABLE_SSE) || defined (eslENABLE_NEON)
+  { "ssv",       k_ssv,       "SSV filter (p7_SSVFilter)"                        },
+#endif
+  { "msv",       k_msv,       "MSV filter (p7_MSVFilter)"                        },
+  { "vit",       k_vit,       "Viterbi filter (p7_ViterbiFilter)"                },
+  { "vitscore",  k_vitscore,  "float Viterbi score (p7_ViterbiScore)"            },
+  { "fwdparser", k_fwdparser, "Forward parser (p7_ForwardParser)"                },
+  { "bckparser", k_bckparser, "Backward parser (p7_BackwardParser)"              },
+  { "fwd",       k_fwd,       "full Forward (p7_Forward)"                        },
+  { "bck",       k_bck,       "full Backward (p7_Backward)"                      },
+  { "decoding",  k_decoding,  "posterior decoding (p7_Decoding)"                 },
+  { "optacc",    k_optacc,    "optimal accuracy (p7_OptimalAccuracy)"            },
+  { "null2",     k_null2,     "null2 by expectation (p7_Null2_ByExpectation)"    },
+  { "gmsv",      k_gmsv,      "generic MSV (p7_GMSV)"                            },
+  { "gvit",      k_gvit,      "generic Viterbi (p7_GViterbi)"                    },
+  { "gfwd",      k_gfwd,      "generic Forward (p7_GForward)"                    },
+  { "gbck",      k_gbck,      "generic Backward (p7_GBackward)"                  },
+  { "gdecoding", k_gdecoding, "generic decoding (p7_GDecoding)"                  },
+  { "goptacc",   k_goptacc,   "generic optimal accuracy (p7_GOptimalAccuracy)"   },
+  { "gnull2",    k_gnull2,    "generic null2 (p7_GNull2_ByExpectation)"          },
+};
+#define NKERNELS (sizeof(kernels) / sizeof(struct kernel_s))
+
+/* One row of a table saved by --tsv, for --compare. */
+struct baseline_s {
+  char   kernel[32];
+  int    M, L;
+  double gcups;
+};
+
+static void
+parse_intlist(const char *s, const char *optname, int **ret_v, int *ret_n)
+{
+  char *buf = NULL;
+  char *p;
+  char *tok;
+  int  *v   = NULL;
+  int   n   = 0;
+
+  if (esl_strdup(s, -1, &buf) != eslOK) p7_Fail("allocation failed");
+  p = buf;
+  while (esl_strtok(&p, ",", &tok) == eslOK)
+    {
+      if ((v = realloc(v, sizeof(int) * (n+1))) == NULL) p7_Fail("allocation failed");
+      v[n] = atoi(tok);
+      if (v[n] <= 0) p7_Fail("%s: %s isn't a positive integer", optname, tok);
+      n++;
+    }
+  if (n == 0) p7_Fail("%s: empty list", optname);
+  free(buf);
+  *ret_v = v;
+  *ret_n = n;
+}
+
+/* Which kernels --kernels asks for; use[k] TRUE/FALSE. */
+static void
+select_kernels(const char *s, int *use)
+{
+  char *buf = NULL;
+  char *p;
+  char *tok;
+  int   k;
+
+  for (k = 0; k < NKERNELS; k++) use[k] = (s == NULL);
+  if (s == NULL) return;
+
+  if (esl_strdup(s, -1, &buf) != eslOK) p7_Fail("allocation failed");
+  p = buf;
+  while (esl_strtok(&p, ",", &tok) == eslOK)
+    {
+      for (k = 0; k < NKERNELS; k++)
+	if (strcmp(tok, kernels[k].name) == 0) break;
+      if (k == NKERNELS) p7_Fail("--kernels: no kernel %s in this build (see --list)", tok);
+      use[k] = TRUE;
+    }
+  free(buf);
+}
+
+static void
+read_baseline(const char *tsvfile, struct baseline_s **ret_b, int *ret_nb)
+{
+  FILE              *fp = NULL;
+  struct baseline_s *b  = NULL;
+  int                nb = 0;
+  char               line[1024];
+
+  if ((fp = fopen(tsvfile, "r")) == NULL) p7_Fail("Failed to open %s for reading", tsvfile);
+  while (fgets(line, sizeof(line), fp) != NULL)
+    {
+      if (line[0] == '#' || line[0] == '\n') continue;
+      if ((b = realloc(b, sizeof(struct baseline_s) * (nb+1))) == NULL) p7_Fail("allocation failed");
+      if (sscanf(line, "%*s %31s %d %d %*s %*s %lf", b[nb].kernel, &(b[nb].M), &(b[nb].L), &(b[nb].gcups)) != 4)
+	p7_Fail("%s isn't a table saved by --tsv:\n%s", tsvfile, line);
+      nb++;
+    }
+  fclose(fp);
+  *ret_b  = b;
+  *ret_nb = nb;
+}
+
+static double
+baseline_gcups(const struct baseline_s *b, int nb, const char *kernel, int M, int L)
+{
+  int i;
+  for (i = 0; i < nb; i++)
+    if (b[i].M == M && b[i].L == L && strcmp(b[i].kernel, kernel) == 0) return b[i].gcups;
+  return 0.;
+}
+
+/* Timestamp counter ticks, where there's one; else 0. */
+static uint64_t
+read_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static void
+kbench_Setup(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, struct kbench_s *kb)
+{
+  float sc;
+  int   i;
+
+  kb->M = M;
+  kb->L = L;
+  p7_bg_SetLength(bg, L);
+  if (p7_oprofile_Sample(r, abc, bg, M, L, NULL, &(kb->gm), &(kb->om)) != eslOK) p7_Fail("failed to sample a profile");
+
+  for (i = 0; i < NPOOL; i++)
+    {
+      if ((kb->dsq[i] = malloc(sizeof(ESL_DSQ) * (L+2))) == NULL) p7_Fail("allocation failed");
+      esl_rsq_xfIID(r, bg->f, abc->K, L, kb->dsq[i]);
+    }
+
+  kb->ox   = p7_omx_Create(M, 0, L);
+  kb->oxp  = p7_omx_Create(M, 0, L);
+  kb->fwdp = p7_omx_Create(M, 0, L);
+  kb->fwd  = p7_omx_Create(M, L, L);
+  kb->bck  = p7_omx_Create(M, L, L);
+  kb->pp   = p7_omx_Create(M, L, L);
+  kb->oxf  = p7_omx_Create(M, L, L);
+  kb->gx   = p7_gmx_Create(M, L);
+  kb->gfwd = p7_gmx_Create(M, L);
+  kb->gbck = p7_gmx_Create(M, L);
+  kb->gpp  = p7_gmx_Create(M, L);
+  if ((kb->null2 = malloc(sizeof(float) * abc->Kp)) == NULL) p7_Fail("allocation failed");
+
+  p7_ForwardParser(kb->dsq[0], L, kb->om, kb->fwdp,          &sc);
+  p7_Forward      (kb->dsq[0], L, kb->om, kb->fwd,           &sc);
+  p7_Backward     (kb->dsq[0], L, kb->om, kb->fwd, kb->bck,  &sc);
+  p7_Decoding     (kb->om, kb->fwd, kb->bck, kb->pp);
+  p7_GForward     (kb->dsq[0], L, kb->gm, kb->gfwd, &sc);
+  p7_GBackward    (kb->dsq[0], L, kb->gm, kb->gbck, &sc);
+  p7_GDecoding    (kb->gm, kb->gfwd, kb->gbck, kb->gpp);
+}
+
+static void
+kbench_Cleanup(struct kbench_s *kb)
+{
+  int i;
+  for (i = 0; i < NPOOL; i++) free(kb->dsq[i]);
+  p7_omx_Destroy(kb->ox);   p7_omx_Destroy(kb->oxp); p7_omx_Destroy(kb->fwdp);
+  p7_omx_Destroy(kb->fwd);  p7_omx_Destroy(kb->bck); p7_omx_Destroy(kb->pp);  p7_omx_Destroy(kb->oxf);
+  p7_gmx_Destroy(kb->gx);   p7_gmx_Destroy(kb->gfwd); p7_gmx_Destroy(kb->gbck); p7_gmx_Destroy(kb->gpp);
+  p7_oprofile_Destroy(kb->om);
+  p7_profile_Destroy(kb->gm);
+  free(kb->null2);
+}
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS       *go       = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS    *r        = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET      *abc      = esl_alphabet_Create(eslAMINO);
+  P7_BG             *bg       = p7_bg_Create(abc);
+  int                nreps    = esl_opt_GetInteger(go, "--reps");
+  double             mintime  = esl_opt_GetReal   (go, "--mintime");
+  double             ghz      = esl_opt_IsOn(go, "--ghz") ? esl_opt_GetReal(go, "--ghz") : 0.;
+  FILE              *tsvfp    = NULL;
+  struct baseline_s *base     = NULL;
+  int                nbase    = 0;
+  int               *Mv       = NULL;
+  int               *Lv       = NULL;
+  int                nM, nL;
+  int                use[NKERNELS];
+  double            *gcups    = NULL;
+  double            *cpc      = NULL;
+  struct kbench_s    kb;
+  const char        *impl;
+  uint64_t           t0, ns, tsc;
+  double             cells, mean, var, sd, cycles, oldrate;
+  int                ncalls;
+  int                have_cycles;
+  int                a, b, k, rep, i;
+
+  if (esl_opt_GetBoolean(go, "--list"))
+    {
+      for (k = 0; k < NKERNELS; k++) printf("%-10s %s\n", kernels[k].name, kernels[k].desc);
+      exit(0);
+    }
+
+#if defined (eslENABLE_SSE)
+  if (esl_opt_IsOn(go, "--simd")) {
+    int level;
+    if (p7_simd_Parse(esl_opt_GetString(go, "--simd"), &level) != eslOK) p7_Fail("--simd must be one of sse, avx2, avx512, or auto\n");
+    p7_simd_Set(level);
+  }
+  impl = p7_simd_Name(p7_simd_Level());
+#elif defined (eslENABLE_NEON)
+  impl = "neon";
+#elif defined (eslENABLE_VMX)
+  impl = "vmx";
+#else
+  impl = "unknown";
+#endif
+
+  parse_intlist(esl_opt_GetString(go, "--Mlist"), "--Mlist", &Mv, &nM);
+  parse_intlist(esl_opt_GetString(go, "--Llist"), "--Llist", &Lv, &nL);
+  select_kernels(esl_opt_GetString(go, "--kernels"), use);
+  if (esl_opt_IsOn(go, "--compare")) read_baseline(esl_opt_GetString(go, "--compare"), &base, &nbase);
+  if (esl_opt_IsOn(go, "--tsv") && (tsvfp = fopen(esl_opt_GetString(go, "--tsv"), "w")) == NULL)
+    p7_Fail("Failed to open %s for writing", esl_opt_GetString(go, "--tsv"));
+
+  have_cycles = (ghz > 0. || read_tsc() > 0);
+  if ((gcups = malloc(sizeof(double) * nreps)) == NULL) p7_Fail("allocation failed");
+  if ((cpc   = malloc(sizeof(double) * nreps)) == NULL) p7_Fail("allocation failed");
+
+  printf("# vector kernels: %s\n", impl);
+  printf("# reps:           %d of at least %.3fs each\n", nreps, mintime);
+  printf("# cycles/cell:    %s\n", ghz > 0. ? "from --ghz" : (have_cycles ? "timestamp counter ticks" : "n/a (use --ghz)"));
+  printf("#\n");
+  printf("# %-10s %5s %5s %9s %9s %9s %6s %10s%s\n", "kernel", "M", "L", "ncalls", "GCUPS", "sd", "cv%", "cycles/cell", base ? "    vs-base" : "");
+  printf("# %-10s %5s %5s %9s %9s %9s %6s %10s%s\n", "----------", "-----", "-----", "---------", "---------", "---------", "------", "-----------", base ? "  ---------" : "");
+  if (tsvfp) {
+    fprintf(tsvfp, "# kernels_benchmark: %s, reps=%d, mintime=%g, cycles=%s\n", impl, nreps, mintime, ghz > 0. ? "ghz" : (have_cycles ? "tsc" : "none"));
+    fprintf(tsvfp, "#impl\tkernel\tM\tL\tncalls\treps\tgcups\tgcups_sd\tcv\tcycles_per_cell\n");
+  }
+
+  for (a = 0; a < nM; a++)
+    for (b = 0; b < nL; b++)
+      {
+	kbench_Setup(r, abc, bg, Mv[a], Lv[b], &kb);
+	cells = (double) kb.M * (double) kb.L;
+
+	for (k = 0; k < NKERNELS; k++)
+	  {
+	    if (! use[k]) continue;
+
+	    /* One untimed call to warm caches and to size the timings. */
+	    (*kernels[k].run)(&kb, kb.dsq[0]);
+	    t0 = p7_pli_Clock();
+	    (*kernels[k].run)(&kb, kb.dsq[1]);
+	    ns = ESL_MAX(1, p7_pli_Clock() - t0);
+	    ncalls = (int) ESL_MAX(1., ceil(mintime * 1e9 / (double) ns));
+
+	    for (rep = 0; rep < nreps; rep++)
+	      {
+		tsc = read_tsc();
+		t0  = p7_pli_Clock();
+		for (i = 0; i < ncalls; i++)
+		  (*kernels[k].run)(&kb, kb.dsq[i % NPOOL]);
+		ns  = ESL_MAX(1, p7_pli_Clock() - t0);
+		tsc = read_tsc() - tsc;
+
+		gcups[rep] = (double) ncalls * cells / (double) ns;
+		cycles     = (ghz > 0. ? (double) ns * ghz : (double) tsc);
+		cpc[rep]   = cycles / ((double) ncalls * cells);
+	      }
+
+	    esl_stats_DMean(gcups, nreps, &mean, &var);
+	    sd = (nreps > 1 ? sqrt(var) : 0.);
+	    esl_stats_DMean(cpc, nreps, &cycles, NULL);
+	    oldrate = (base ? baseline_gcups(base, nbase, kernels[k].name, kb.M, kb.L) : 0.);
+
+	    printf("  %-10s %5d %5d %9d %9.4f %9.4f %6.2f ", kernels[k].name, kb.M, kb.L, ncalls, mean, sd, 100. * sd / mean);
+	    if (have_cycles) printf("%11.3f", cycles); else printf("%11s", "-");
+	    if      (base && oldrate > 0.) printf("  %8.3fx", mean / oldrate);
+	    else if (base)                 printf("  %9s", "-");
+	    printf("\n");
+
+	    if (tsvfp) {
+	      fprintf(tsvfp, "%s\t%s\t%d\t%d\t%d\t%d\t%.6f\t%.6f\t%.4f\t", impl, kernels[k].name, kb.M, kb.L, ncalls, nreps, mean, sd, sd / mean);
+	      if (have_cycles) fprintf(tsvfp, "%.4f\n", cycles); else fprintf(tsvfp, "-\n");
+	    }
+	    fflush(stdout);
+	  }
+	kbench_Cleanup(&kb);
+      }
+
+  if (tsvfp) fclose(tsvfp);
+  free(gcups);
+  free(cpc);
+  free(base);
+  free(Mv);
+  free(Lv);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7KERNELS_BENCHMARK*/
+/*------------------ end, benchmark driver ----------------------*/
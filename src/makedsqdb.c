@@ -0,0 +1,156 @@
+/* makedsqdb: press a sequence database into digitized binary files,
+ * for faster hmmsearch, phmmer, jackhmmer, and hmmpgmd runs.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer.h"
+#include "p7_dsqdb.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type         default  env  range     toggles      reqs   incomp               help                                          docgroup*/
+  { "-h",          eslARG_NONE,    FALSE, NULL, NULL,      NULL,      NULL,    NULL,              "show brief help on version and usage",          0 },
+  { "-f",          eslARG_NONE,    FALSE, NULL, NULL,      NULL,      NULL,    NULL,              "force: overwrite any previous pressed files",   0 },
+  { "--amino",     eslARG_NONE,    FALSE, NULL, NULL,      NULL,      NULL,    "--dna,--rna",     "<seqfile> contains protein sequences",          0 },
+  { "--dna",       eslARG_NONE,    FALSE, NULL, NULL,      NULL,      NULL,    "--amino,--rna",   "<seqfile> contains DNA sequences",              0 },
+  { "--rna",       eslARG_NONE,    FALSE, NULL, NULL,      NULL,      NULL,    "--amino,--dna",   "<seqfile> contains RNA sequences",              0 },
+  { "--informat",  eslARG_STRING,  NULL,  NULL, NULL,      NULL,      NULL,    NULL,              "assert <seqfile> is in format <s>: no autodetection", 0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <seqfile> <dsqfile>";
+static char banner[] = "press a sequence database for faster searches";
+
+static char *read_dbinfo(const char *seqfile);
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go        = p7_CreateDefaultApp(options, 2, argc, argv, banner, usage);
+  char           *seqfile   = esl_opt_GetArg(go, 1);
+  char           *dsqfile   = esl_opt_GetArg(go, 2);
+  char           *namesfile = NULL;
+  char           *dbinfo    = NULL;
+  ESL_ALPHABET   *abc       = NULL;
+  ESL_SQFILE     *sqfp      = NULL;
+  FILE           *dfp       = NULL;
+  FILE           *nfp       = NULL;
+  int             infmt     = eslSQFILE_UNKNOWN;
+  int             alphatype = eslUNKNOWN;
+  int64_t         nseq, nres;
+  off_t           offset;
+  int             status;
+  char            errbuf[eslERRBUFSIZE];
+
+  if (strcmp(dsqfile, "-") == 0) p7_Fail("Can't use - for <dsqfile> argument: pressed files must be seekable\n");
+  if ((status = esl_sprintf(&namesfile, "%s.names", dsqfile)) != eslOK) p7_Fail("esl_sprintf() failed");
+
+  if (! esl_opt_GetBoolean(go, "-f") && esl_FileExists(dsqfile))   p7_Fail("Pressed sequence file %s already exists;\nDelete it first, or use -f\n", dsqfile);
+  if (! esl_opt_GetBoolean(go, "-f") && esl_FileExists(namesfile)) p7_Fail("Pressed names file %s already exists;\nDelete it first, or use -f\n",    namesfile);
+
+  if (esl_opt_IsOn(go, "--informat")) {
+    infmt = esl_sqio_EncodeFormat(esl_opt_GetString(go, "--informat"));
+    if (infmt == eslSQFILE_UNKNOWN) p7_Fail("%s is not a recognized sequence file format\n", esl_opt_GetString(go, "--informat"));
+  }
+
+  /* An hmmpgmd database starts with a "#..." line, followed by FASTA;
+   * keep the line so hmmpgmd can load the pressed database too.
+   */
+  if (strcmp(seqfile, "-") != 0 && (dbinfo = read_dbinfo(seqfile)) != NULL) infmt = eslSQFILE_FASTA;
+
+  status = esl_sqfile_Open(seqfile, infmt, NULL, &sqfp);
+  if      (status == eslENOTFOUND) p7_Fail("Failed to open sequence file %s for reading\n",          seqfile);
+  else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",            seqfile);
+  else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
+  else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, seqfile);
+
+  if (dbinfo) {
+    /* position the parser after the "#..." line, as p7_seqcache_Open() does */
+    fseek(sqfp->data.ascii.fp, 0L, SEEK_SET);
+    if (fgets(errbuf, sizeof(errbuf), sqfp->data.ascii.fp) == NULL) p7_Fail("Failed to reread the first line of %s\n", seqfile);
+    while (strchr(errbuf, '\n') == NULL && fgets(errbuf, sizeof(errbuf), sqfp->data.ascii.fp) != NULL) ;
+    offset = ftello(sqfp->data.ascii.fp);
+    if (esl_sqfile_Position(sqfp, offset) != eslOK) p7_Fail("Failed to position %s after its first line\n", seqfile);
+  }
+
+  if      (esl_opt_GetBoolean(go, "--amino")) alphatype = eslAMINO;
+  else if (esl_opt_GetBoolean(go, "--dna"))   alphatype = eslDNA;
+  else if (esl_opt_GetBoolean(go, "--rna"))   alphatype = eslRNA;
+  else if (dbinfo)                            alphatype = eslAMINO;   /* hmmpgmd databases are protein */
+  else {
+    status = esl_sqfile_GuessAlphabet(sqfp, &alphatype);
+    if      (status == eslENOALPHABET) p7_Fail("Couldn't guess alphabet from first sequence in %s; use --amino, --dna, or --rna\n", seqfile);
+    else if (status == eslEFORMAT)     p7_Fail("Parse failed (sequence file %s):\n%s\n", seqfile, esl_sqfile_GetErrorBuf(sqfp));
+    else if (status == eslENODATA)     p7_Fail("Sequence file %s contains no data\n", seqfile);
+    else if (status != eslOK)          p7_Fail("Failed to guess alphabet of %s (error code %d)\n", seqfile, status);
+  }
+  abc = esl_alphabet_Create(alphatype);
+  esl_sqfile_SetDigital(sqfp, abc);
+
+  if ((dfp = fopen(dsqfile,   "wb")) == NULL) p7_Fail("Failed to open pressed sequence file %s for writing\n", dsqfile);
+  if ((nfp = fopen(namesfile, "wb")) == NULL) p7_Fail("Failed to open pressed names file %s for writing\n",    namesfile);
+
+  printf("Working...    ");
+  fflush(stdout);
+
+  status = p7_dsqdb_Write(sqfp, dbinfo, dfp, nfp, &nseq, &nres, errbuf);
+  if (fclose(dfp) != 0 && status == eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to close %s", dsqfile);
+  if (fclose(nfp) != 0 && status == eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to close %s", namesfile);
+  if (status != eslOK) goto ERROR;
+
+  printf("done.\n");
+  printf("Pressed %" PRId64 " %s sequences (%" PRId64 " residues).\n", nseq, esl_abc_DecodeType(alphatype), nres);
+  printf("Residues and index pressed into: %s\n", dsqfile);
+  printf("Names and descriptions into:     %s\n", namesfile);
+
+  free(namesfile);
+  if (dbinfo) free(dbinfo);
+  esl_sqfile_Close(sqfp);
+  esl_alphabet_Destroy(abc);
+  esl_getopts_Destroy(go);
+  exit(0);
+
+ ERROR:
+  fprintf(stderr, "\n%s\n", errbuf);
+  remove(dsqfile);   /* don't leave partial/corrupt files */
+  remove(namesfile);
+  free(namesfile);
+  if (dbinfo) free(dbinfo);
+  esl_sqfile_Close(sqfp);
+  esl_alphabet_Destroy(abc);
+  esl_getopts_Destroy(go);
+  exit(1);
+}
+
+
+/* read_dbinfo()
+ * If <seqfile> is a plain file whose first line starts with '#', the
+ * hmmpgmd database line, return a copy of that line (without its
+ * newline); else return NULL.
+ */
+static char *
+read_dbinfo(const char *seqfile)
+{
+  FILE *fp     = NULL;
+  char *dbinfo = NULL;
+  char  buffer[512];
+  int   n;
+
+  if ((fp = fopen(seqfile, "r")) == NULL) return NULL;
+  if (fgets(buffer, sizeof(buffer), fp) != NULL && buffer[0] == '#')
+    {
+      n = strlen(buffer);
+      while (n > 0 && (buffer[n-1] == '\n' || buffer[n-1] == '\r')) buffer[--n] = '\0';
+      if (esl_strdup(buffer, n, &dbinfo) != eslOK) dbinfo = NULL;
+    }
+  fclose(fp);
+  return dbinfo;
+}
@@ -0,0 +1,81 @@
+/* makeseqcache: write a snapshot of an hmmpgmd sequence database, so
+ * that hmmpgmd workers can map it at startup instead of parsing,
+ * digitizing and sorting the database every time.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer.h"
+#include "cachedb.h"
+#include "cachedb_shard.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type         default  env  range     toggles      reqs        incomp  help                                             docgroup*/
+  { "-h",          eslARG_NONE,    FALSE, NULL, NULL,      NULL,      NULL,         NULL, "show brief help on version and usage",             0 },
+  { "-f",          eslARG_NONE,    FALSE, NULL, NULL,      NULL,      NULL,         NULL, "force: overwrite any previous snapshot",           0 },
+  { "--nshards",   eslARG_INT,       "1", NULL, "n>0",     NULL,      NULL,         NULL, "database is split into <n> shards (hmmpgmd_shard)", 0 },
+  { "--shard",     eslARG_INT,       "0", NULL, "n>=0",    NULL,      NULL,         NULL, "write the snapshot of shard <n> (0..nshards-1)",   0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <seqdb>";
+static char banner[] = "snapshot an hmmpgmd sequence database for fast worker startup";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go       = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *seqfile  = esl_opt_GetArg(go, 1);
+  int             shard    = esl_opt_GetInteger(go, "--shard");
+  int             nshards  = esl_opt_GetInteger(go, "--nshards");
+  char           *snapfile = NULL;
+  P7_SEQCACHE    *cache    = NULL;
+  FILE           *fp       = NULL;
+  int             status;
+  char            errbuf[eslERRBUFSIZE];
+
+  if (shard >= nshards) p7_Fail("--shard %d is out of range: shards are numbered 0..%d\n", shard, nshards-1);
+  if (p7_seqcache_SnapshotName(seqfile, shard, nshards, &snapfile) != eslOK) p7_Fail("esl_sprintf() failed");
+  if (! esl_opt_GetBoolean(go, "-f") && esl_FileExists(snapfile)) p7_Fail("Snapshot %s already exists;\nDelete it first, or use -f\n", snapfile);
+
+  /* load the database itself, not an old snapshot of it */
+  if (esl_FileExists(snapfile) && remove(snapfile) != 0) p7_Fail("Failed to remove old snapshot %s\n", snapfile);
+
+  if (nshards > 1) status = p7_seqcache_Open_shard(seqfile, &cache, errbuf, shard, nshards);
+  else             status = p7_seqcache_Open(seqfile, &cache, errbuf);
+  if (status != eslOK) p7_Fail("Failed to load sequence database %s (error %d)\n%s\n", seqfile, status, errbuf);
+
+  if ((fp = fopen(snapfile, "wb")) == NULL) p7_Fail("Failed to open snapshot %s for writing\n", snapfile);
+
+  printf("Working...    ");
+  fflush(stdout);
+
+  status = p7_seqcache_WriteSnapshot(cache, fp, errbuf);
+  if (fclose(fp) != 0 && status == eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to close %s", snapfile);
+  if (status != eslOK) goto ERROR;
+
+  printf("done.\n");
+  if (nshards > 1) printf("Snapshot of shard %d of %d of %s (%u sequences) written to: %s\n", shard, nshards, seqfile, cache->count, snapfile);
+  else             printf("Snapshot of %s (%u sequences) written to: %s\n", seqfile, cache->count, snapfile);
+
+  free(snapfile);
+  p7_seqcache_Close(cache);
+  esl_getopts_Destroy(go);
+  exit(0);
+
+ ERROR:
+  fprintf(stderr, "\n%s\n", errbuf);
+  remove(snapfile);   /* don't leave a partial/corrupt snapshot */
+  free(snapfile);
+  p7_seqcache_Close(cache);
+  esl_getopts_Destroy(go);
+  exit(1);
+}
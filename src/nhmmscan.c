@@ -458,6 +458,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         info[i].th  = p7_tophits_Create();
         info[i].pli = p7_pipeline_Create(go, 100, 100, TRUE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
         info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
+        info[i].pli->report_thr = infocnt;
 
         p7_pli_NewSeq(info[i].pli, qsq);
         info[i].qsq = qsq;
@@ -90,6 +90,27 @@
  */
 P7_ALIDISPLAY *
 p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq)
+{
+  return p7_alidisplay_CreateIn(NULL, tr, which, om, sq, ntsq);
+}
+
+/* Function:  p7_alidisplay_CreateIn()
+ * Synopsis:  Create an alignment display in an arena.
+ *
+ * Purpose:   Same as <p7_alidisplay_Create()>, but the alignment
+ *            display (structure and strings both) is allocated in
+ *            <arena>, usually a hit list's, instead of on the heap. It
+ *            is freed along with the arena, and must not be
+ *            <p7_alidisplay_Destroy()>'ed. A <NULL> <arena> means the
+ *            heap, same as <p7_alidisplay_Create()>.
+ *
+ * Returns:   ptr to the new alignment display.
+ *
+ * Throws:    <NULL> on allocation failure, or if something's internally corrupt 
+ *            in the data.
+ */
+P7_ALIDISPLAY *
+p7_alidisplay_CreateIn(P7_ARENA *arena, const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq)
 {
   P7_ALIDISPLAY *ad       = NULL;
   char          *Alphabet = om->abc->sym;
@@ -144,12 +165,22 @@ p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const
   sq_acclen   = strlen(sq->acc);                            n += sq_acclen   + 1; /* sq->acc is "\0" when unset */
   sq_desclen  = strlen(sq->desc);                           n += sq_desclen  + 1; /* same for desc              */
  
-  ESL_ALLOC(ad, sizeof(P7_ALIDISPLAY));
-  ad->mem = NULL;
+  if (arena)
+    {	/* one allocation for both; in an arena, that's just a pointer bump */
+      if ((ad = p7_arena_Alloc(arena, sizeof(P7_ALIDISPLAY) + sizeof(char) * n)) == NULL) { status = eslEMEM; goto ERROR; }
+      ad->memsize = sizeof(char) * n;
+      ad->mem     = (char *) ad + sizeof(P7_ALIDISPLAY);
+    }
+  else
+    {
+      ESL_ALLOC(ad, sizeof(P7_ALIDISPLAY));
+      ad->mem = NULL;
+
+      ad->memsize = sizeof(char) * n;
+      ESL_ALLOC(ad->mem, ad->memsize);
+    }
 
   pos = 0; 
-  ad->memsize = sizeof(char) * n;
-  ESL_ALLOC(ad->mem, ad->memsize);
   if (om->rf[0]  != 0) { ad->rfline = ad->mem + pos; pos += z2-z1+2; } else { ad->rfline = NULL; }
   //if (om->mm[0]  != 0) { ad->mmline = ad->mem + pos; pos += z2-z1+2; } else { ad->mmline = NULL; }
   ad->mmline = NULL;
@@ -253,7 +284,7 @@ p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const
   return ad;
 
  ERROR:
-  p7_alidisplay_Destroy(ad);
+  if (! arena) p7_alidisplay_Destroy(ad);
   return NULL;
 }
 
@@ -322,11 +353,32 @@ extern P7_ALIDISPLAY *p7_alidisplay_Create_empty()
  */
 P7_ALIDISPLAY *
 p7_alidisplay_Clone(const P7_ALIDISPLAY *ad)
+{
+  return p7_alidisplay_CloneIn(NULL, ad);
+}
+
+/* Function:  p7_alidisplay_CloneIn()
+ * Synopsis:  Make a duplicate of an ALIDISPLAY in an arena.
+ *
+ * Purpose:   Same as <p7_alidisplay_Clone()>, but the duplicate is
+ *            allocated in <arena> (see <p7_alidisplay_CreateIn()>).
+ *            A <NULL> <arena> means the heap.
+ *
+ * Returns:   pointer to new <P7_ALIDISPLAY>
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_ALIDISPLAY *
+p7_alidisplay_CloneIn(P7_ARENA *arena, const P7_ALIDISPLAY *ad)
 {
   P7_ALIDISPLAY *ad2 = NULL;
   int status;
 
-  ESL_ALLOC(ad2, sizeof(P7_ALIDISPLAY));
+  if (arena)
+    {
+      if ((ad2 = p7_arena_Alloc(arena, sizeof(P7_ALIDISPLAY) + sizeof(char) * ad->memsize)) == NULL) { status = eslEMEM; goto ERROR; }
+    }
+  else ESL_ALLOC(ad2, sizeof(P7_ALIDISPLAY));
   ad2->rfline  = ad2->mmline = ad2->csline = ad2->model   = ad2->mline  = ad2->aseq = ad2->ntseq = ad2->ppline = NULL;
   ad2->hmmname = ad2->hmmacc = ad2->hmmdesc = NULL;
   ad2->sqname  = ad2->sqacc  = ad2->sqdesc  = NULL;
@@ -335,7 +387,8 @@ p7_alidisplay_Clone(const P7_ALIDISPLAY *ad)
 
   if (ad->memsize) 		/* serialized */
     {
-      ESL_ALLOC(ad2->mem, sizeof(char) * ad->memsize);
+      if (arena) ad2->mem = (char *) ad2 + sizeof(P7_ALIDISPLAY);
+      else       ESL_ALLOC(ad2->mem, sizeof(char) * ad->memsize);
       ad2->memsize = ad->memsize;
       memcpy(ad2->mem, ad->mem, ad->memsize);
 
@@ -365,26 +418,26 @@ p7_alidisplay_Clone(const P7_ALIDISPLAY *ad)
     }
   else				/* deserialized */
     {
-      if ( esl_strdup(ad->rfline, -1, &(ad2->rfline)) != eslOK) goto ERROR;
-      if ( esl_strdup(ad->mmline, -1, &(ad2->mmline)) != eslOK) goto ERROR;
-      if ( esl_strdup(ad->csline, -1, &(ad2->csline)) != eslOK) goto ERROR;
-      if ( esl_strdup(ad->model,  -1, &(ad2->model))  != eslOK) goto ERROR;
-      if ( esl_strdup(ad->mline,  -1, &(ad2->mline))  != eslOK) goto ERROR;
-      if ( esl_strdup(ad->aseq,   -1, &(ad2->aseq))   != eslOK) goto ERROR;
-      if ( esl_strdup(ad->ntseq,  -1, &(ad2->ntseq))  != eslOK) goto ERROR;
-      if ( esl_strdup(ad->ppline, -1, &(ad2->ppline)) != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->rfline, -1, &(ad2->rfline)) != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->mmline, -1, &(ad2->mmline)) != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->csline, -1, &(ad2->csline)) != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->model,  -1, &(ad2->model))  != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->mline,  -1, &(ad2->mline))  != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->aseq,   -1, &(ad2->aseq))   != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->ntseq,  -1, &(ad2->ntseq))  != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->ppline, -1, &(ad2->ppline)) != eslOK) goto ERROR;
       ad2->N = ad->N;
 
-      if ( esl_strdup(ad->hmmname, -1, &(ad2->hmmname)) != eslOK) goto ERROR;
-      if ( esl_strdup(ad->hmmacc,  -1, &(ad2->hmmacc))  != eslOK) goto ERROR;
-      if ( esl_strdup(ad->hmmdesc, -1, &(ad2->hmmdesc)) != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->hmmname, -1, &(ad2->hmmname)) != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->hmmacc,  -1, &(ad2->hmmacc))  != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->hmmdesc, -1, &(ad2->hmmdesc)) != eslOK) goto ERROR;
       ad2->hmmfrom = ad->hmmfrom;
       ad2->hmmto   = ad->hmmto;
       ad2->M       = ad->M;
 
-      if ( esl_strdup(ad->sqname,  -1, &(ad2->sqname)) != eslOK) goto ERROR;
-      if ( esl_strdup(ad->sqacc,   -1, &(ad2->sqacc))  != eslOK) goto ERROR;
-      if ( esl_strdup(ad->sqdesc,  -1, &(ad2->sqdesc)) != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->sqname,  -1, &(ad2->sqname)) != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->sqacc,   -1, &(ad2->sqacc))  != eslOK) goto ERROR;
+      if ( p7_arena_Strdup(arena, ad->sqdesc,  -1, &(ad2->sqdesc)) != eslOK) goto ERROR;
       ad2->sqfrom  = ad->sqfrom;
       ad2->sqto    = ad->sqto;
       ad2->L       = ad->L;      
@@ -393,7 +446,7 @@ p7_alidisplay_Clone(const P7_ALIDISPLAY *ad)
   return ad2;
 
  ERROR:
-  if (ad2) p7_alidisplay_Destroy(ad2);
+  if (ad2 && ! arena) p7_alidisplay_Destroy(ad2);
   return NULL;
 }
 
@@ -0,0 +1,423 @@
+/* P7_ARENA: bulk storage for hit lists.
+ *
+ * A search that reports many hits makes many small allocations per
+ * hit - the target's name, accession and description, its domain
+ * list, and two per domain for each alignment display - and frees
+ * them all again when the hit list goes away. With several worker
+ * threads doing this at once, they contend in malloc(). Instead,
+ * each hit list (and so each worker) gets its own arena: allocation
+ * bumps a pointer in a large block, and the blocks are freed all at
+ * once, or handed over whole to another hit list when lists are
+ * merged.
+ *
+ * Contents:
+ *    1. The P7_ARENA object.
+ *    2. Unit tests.
+ *    3. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+
+#include "hmmer.h"
+
+/* Allocations are rounded up to this, so anything we put in the
+ * arena (P7_DOMAIN arrays, P7_ALIDISPLAYs) is suitably aligned.
+ */
+#define p7_ARENA_ALIGN 16
+
+/*****************************************************************
+ * 1. The P7_ARENA object.
+ *****************************************************************/
+
+/* Function:  p7_arena_Create()
+ * Synopsis:  Create a new, empty arena.
+ *
+ * Purpose:   Create a new arena. No storage is allocated until the
+ *            first <p7_arena_Alloc()>.
+ *
+ * Returns:   ptr to the new arena.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_ARENA *
+p7_arena_Create(void)
+{
+  P7_ARENA *arena = NULL;
+  int       status;
+
+  ESL_ALLOC(arena, sizeof(P7_ARENA));
+  arena->head      = NULL;
+  arena->blocksize = p7_ARENA_BLOCKSIZE;
+  arena->markblk   = NULL;
+  arena->markused  = 0;
+  return arena;
+
+ ERROR:
+  return NULL;
+}
+
+
+/* Function:  p7_arena_Alloc()
+ * Synopsis:  Allocate <n> bytes from an arena.
+ *
+ * Purpose:   Return a pointer to <n> bytes of uninitialized storage
+ *            in <arena>, starting a new block if the current one is
+ *            full. The storage is only freed along with the whole
+ *            arena; don't <free()> it.
+ *
+ *            If <arena> is <NULL>, allocate from the heap instead;
+ *            then the caller does <free()> it. This lets code that
+ *            fills in a hit work the same way whether or not its hit
+ *            list has an arena.
+ *
+ * Returns:   ptr to the storage.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+void *
+p7_arena_Alloc(P7_ARENA *arena, size_t n)
+{
+  P7_ARENABLOCK *blk = NULL;
+  void          *p   = NULL;
+  size_t         size;
+  int            status;
+
+  if (arena == NULL) { ESL_ALLOC(p, ESL_MAX(n, 1)); return p; }
+
+  n = (n + p7_ARENA_ALIGN - 1) & ~((size_t) p7_ARENA_ALIGN - 1);
+  if (arena->head == NULL || arena->head->used + n > arena->head->size)
+    {
+      size = ESL_MAX(arena->blocksize, n);
+      ESL_ALLOC(blk, sizeof(P7_ARENABLOCK) + size);
+      blk->mem   = (char *) blk + sizeof(P7_ARENABLOCK);
+      blk->size  = size;
+      blk->used  = 0;
+      blk->next  = arena->head;
+      arena->head = blk;
+      arena->blocksize = ESL_MIN(arena->blocksize * 2, p7_ARENA_MAXBLOCK);
+    }
+
+  p = arena->head->mem + arena->head->used;
+  arena->head->used += n;
+  return p;
+
+ ERROR:
+  return NULL;
+}
+
+
+/* Function:  p7_arena_Strdup()
+ * Synopsis:  Duplicate a string into an arena.
+ *
+ * Purpose:   Like <esl_strdup()>, but the copy of <s> is allocated in
+ *            <arena> (or on the heap, if <arena> is <NULL>). If <n>
+ *            is known to be the length of <s>, pass it; else pass -1.
+ *            A <NULL> <s> gives a <NULL> <*ret_s>.
+ *
+ * Returns:   <eslOK> on success, and <*ret_s> points to the copy.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <*ret_s> is <NULL>.
+ */
+int
+p7_arena_Strdup(P7_ARENA *arena, const char *s, int64_t n, char **ret_s)
+{
+  char *new = NULL;
+
+  if (s == NULL) { *ret_s = NULL; return eslOK; }
+  if (n < 0) n = strlen(s);
+
+  if ((new = p7_arena_Alloc(arena, n+1)) == NULL) { *ret_s = NULL; return eslEMEM; }
+  memcpy(new, s, n);
+  new[n] = '\0';
+  *ret_s = new;
+  return eslOK;
+}
+
+
+/* Function:  p7_arena_Mark()
+ * Synopsis:  Remember the arena's current position.
+ *
+ * Purpose:   Remember how much of <arena> is allocated now, so that a
+ *            later <p7_arena_Rewind()> can give back everything
+ *            allocated since: for example, alignment displays made
+ *            for a target that then turns out not to be reported.
+ *            There is one mark; marking again moves it. Don't
+ *            <p7_arena_Adopt()> into an arena between its mark and
+ *            its rewind.
+ *
+ *            A <NULL> <arena> is a no-op.
+ */
+void
+p7_arena_Mark(P7_ARENA *arena)
+{
+  if (arena == NULL) return;
+  arena->markblk  = arena->head;
+  arena->markused = (arena->head ? arena->head->used : 0);
+}
+
+
+/* Function:  p7_arena_Rewind()
+ * Synopsis:  Free everything allocated since the mark.
+ *
+ * Purpose:   Free all the storage in <arena> that was allocated since
+ *            the last <p7_arena_Mark()>, or since the arena was
+ *            created or reset if it hasn't been marked. Pointers into
+ *            that storage are invalid afterwards.
+ *
+ *            A <NULL> <arena> is a no-op.
+ */
+void
+p7_arena_Rewind(P7_ARENA *arena)
+{
+  P7_ARENABLOCK *blk;
+
+  if (arena == NULL) return;
+  while (arena->head != arena->markblk)
+    {
+      blk         = arena->head;
+      arena->head = blk->next;
+      free(blk);
+    }
+  if (arena->head) arena->head->used = arena->markused;
+}
+
+
+/* Function:  p7_arena_Reset()
+ * Synopsis:  Free everything in an arena, for reuse.
+ *
+ * Purpose:   Free all the storage in <arena>, keeping its newest
+ *            (and largest) block to allocate from again. All
+ *            pointers into the arena are invalid afterwards.
+ *
+ *            A <NULL> <arena> is a no-op.
+ */
+void
+p7_arena_Reset(P7_ARENA *arena)
+{
+  P7_ARENABLOCK *blk;
+
+  if (arena == NULL || arena->head == NULL) return;
+  while ((blk = arena->head->next) != NULL)
+    {
+      arena->head->next = blk->next;
+      free(blk);
+    }
+  arena->head->used = 0;
+  arena->markblk    = arena->head;
+  arena->markused   = 0;
+}
+
+
+/* Function:  p7_arena_Adopt()
+ * Synopsis:  Move all the storage of one arena into another.
+ *
+ * Purpose:   Move all of <src>'s blocks to <dst>, without copying
+ *            anything, so that whatever was allocated in <src> now
+ *            lives as long as <dst> does. <src> is left empty, and
+ *            can be reused or destroyed. <p7_tophits_Merge()> uses
+ *            this to take over the storage of the hits it merges.
+ *
+ *            <dst> keeps allocating from its current block.
+ */
+void
+p7_arena_Adopt(P7_ARENA *dst, P7_ARENA *src)
+{
+  P7_ARENABLOCK *tail;
+
+  if (src == NULL || src->head == NULL) return;
+
+  if (dst->head == NULL)
+    dst->head = src->head;
+  else
+    {
+      for (tail = src->head; tail->next; tail = tail->next) ;
+      tail->next      = dst->head->next;
+      dst->head->next = src->head;
+    }
+  src->head     = NULL;
+  src->markblk  = NULL;
+  src->markused = 0;
+}
+
+
+/* Function:  p7_arena_Sizeof()
+ * Synopsis:  Return the allocated size of an arena, in bytes.
+ */
+size_t
+p7_arena_Sizeof(const P7_ARENA *arena)
+{
+  P7_ARENABLOCK *blk;
+  size_t         n = 0;
+
+  if (arena == NULL) return 0;
+  n += sizeof(P7_ARENA);
+  for (blk = arena->head; blk; blk = blk->next)
+    n += sizeof(P7_ARENABLOCK) + blk->size;
+  return n;
+}
+
+
+/* Function:  p7_arena_Destroy()
+ * Synopsis:  Free an arena and everything allocated in it.
+ */
+void
+p7_arena_Destroy(P7_ARENA *arena)
+{
+  P7_ARENABLOCK *blk;
+
+  if (arena == NULL) return;
+  while ((blk = arena->head) != NULL)
+    {
+      arena->head = blk->next;
+      free(blk);
+    }
+  free(arena);
+}
+/*-------------------- end, P7_ARENA ----------------------------*/
+
+
+
+/*****************************************************************
+ * 2. Unit tests.
+ *****************************************************************/
+#ifdef p7ARENA_TESTDRIVE
+#include "esl_random.h"
+
+/* Fill an arena with <n> random strings, more than fit in one
+ * block; check they're all intact and aligned; rewind away half of
+ * them; then move the arena into another one, destroy the emptied
+ * source, and check the survivors again.
+ */
+static void
+utest_strings(ESL_RANDOMNESS *rng, int n)
+{
+  char       msg[] = "arena strings test failed";
+  P7_ARENA  *a1    = p7_arena_Create();
+  P7_ARENA  *a2    = p7_arena_Create();
+  char     **s     = malloc(sizeof(char *) * n);
+  int       *len   = malloc(sizeof(int)    * n);
+  char      *p;
+  int        i, j;
+
+  if (!a1 || !a2 || !s || !len) esl_fatal(msg);
+
+  /* a few strings in <a2>, so Adopt() has something to splice into */
+  if (p7_arena_Strdup(a2, "resident", -1, &p) != eslOK) esl_fatal(msg);
+
+  for (i = 0; i < n; i++)
+    {
+      if (i == n/2) p7_arena_Mark(a1);
+      len[i] = esl_rnd_Roll(rng, 1000);
+      if ((s[i] = p7_arena_Alloc(a1, len[i]+1)) == NULL)                 esl_fatal(msg);
+      if (((size_t) s[i]) % p7_ARENA_ALIGN != 0)                          esl_fatal(msg);
+      for (j = 0; j < len[i]; j++) s[i][j] = 'a' + (i+j) % 26;
+      s[i][len[i]] = '\0';
+    }
+  if (p7_arena_Sizeof(a1) <= p7_ARENA_BLOCKSIZE) esl_fatal(msg); /* make sure we crossed blocks */
+
+  p7_arena_Rewind(a1);
+  n = n/2;
+  for (i = 0; i < n; i++)
+    for (j = 0; j <= len[i]; j++)
+      if (s[i][j] != (j == len[i] ? '\0' : 'a' + (i+j) % 26)) esl_fatal(msg);
+
+  p7_arena_Adopt(a2, a1);
+  if (p7_arena_Sizeof(a1) != sizeof(P7_ARENA)) esl_fatal(msg);
+  p7_arena_Destroy(a1);
+
+  for (i = 0; i < n; i++)
+    for (j = 0; j <= len[i]; j++)
+      if (s[i][j] != (j == len[i] ? '\0' : 'a' + (i+j) % 26)) esl_fatal(msg);
+  if (strcmp(p, "resident") != 0) esl_fatal(msg);
+
+  p7_arena_Reset(a2);
+  if (p7_arena_Sizeof(a2) > sizeof(P7_ARENA) + sizeof(P7_ARENABLOCK) + p7_ARENA_MAXBLOCK) esl_fatal(msg);
+
+  free(s);
+  free(len);
+  p7_arena_Destroy(a2);
+}
+
+/* Rewinding gives the same storage back, and a request larger than
+ * a block gets a block of its own.
+ */
+static void
+utest_rewind(void)
+{
+  char      msg[] = "arena rewind test failed";
+  P7_ARENA *a     = p7_arena_Create();
+  void     *p1, *p2;
+  char     *big;
+
+  if (a == NULL) esl_fatal(msg);
+
+  p7_arena_Mark(a);
+  if ((p1 = p7_arena_Alloc(a, 100)) == NULL) esl_fatal(msg);
+  p7_arena_Rewind(a);
+  if (a->head != NULL)                       esl_fatal(msg);
+
+  if ((p1 = p7_arena_Alloc(a, 100)) == NULL) esl_fatal(msg);
+  p7_arena_Mark(a);
+  if ((p2 = p7_arena_Alloc(a, 100)) == NULL) esl_fatal(msg);
+  if ((big = p7_arena_Alloc(a, 4 * p7_ARENA_MAXBLOCK)) == NULL) esl_fatal(msg);
+  memset(big, 'x', 4 * p7_ARENA_MAXBLOCK);
+  p7_arena_Rewind(a);
+  if (p7_arena_Alloc(a, 100) != p2)          esl_fatal(msg);
+
+  /* NULL arena: heap allocation, caller frees */
+  if (p7_arena_Strdup(NULL, "heap", -1, &big) != eslOK || strcmp(big, "heap") != 0) esl_fatal(msg);
+  free(big);
+  if (p7_arena_Strdup(a, NULL, -1, &big) != eslOK || big != NULL) esl_fatal(msg);
+
+  p7_arena_Destroy(a);
+}
+#endif /*p7ARENA_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+/*****************************************************************
+ * 3. Test driver.
+ *****************************************************************/
+#ifdef p7ARENA_TESTDRIVE
+/* gcc -g -Wall -Dp7ARENA_TESTDRIVE -I. -I../easel -L. -L../easel -o p7_arena_utest p7_arena.c -lhmmer -leasel -lm
+ */
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+static ESL_OPTIONS options[] = {
+  /* name  type         default  env   range togs  reqs  incomp  help                            docgrp */
+  {"-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                0},
+  {"-s",  eslARG_INT,       "0", NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",      0},
+  {"-N",  eslARG_INT,   "10000", NULL, "n>=1000",NULL, NULL, NULL, "number of strings to allocate",      0},
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the P7_ARENA allocator";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  int             N   = esl_opt_GetInteger(go, "-N");
+
+  fprintf(stderr, "## %s\n", argv[0]);
+  fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+  utest_strings(rng, N);
+  utest_rewind();
+
+  fprintf(stderr, "#  status = ok\n");
+
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7ARENA_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
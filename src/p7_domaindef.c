@@ -81,6 +81,8 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ddef->sp   = NULL;
   ddef->tr   = NULL;
   ddef->dcl  = NULL;
+  ddef->arena = NULL;
+  ddef->prof  = NULL;
 
   /* level 2 alloc: posterior prob arrays */
   ESL_ALLOC(ddef->mocc, sizeof(float) * (Lalloc+1));
@@ -593,6 +595,19 @@ is_multidomain_region(P7_DOMAINDEF *ddef, int i, int j)
  *    
  * <wrk> has had its zero row clobbered as working space for a null2 calculation.
  */
+/* profile_stage()
+ * Charge the time since <t0> and <ncells> DP cells to stage <stage>
+ * of the pipeline profile <ddef->prof>, if the caller gave us one.
+ */
+static void
+profile_stage(P7_DOMAINDEF *ddef, int stage, uint64_t t0, uint64_t ncells)
+{
+  if (! ddef->prof) return;
+  ddef->prof[stage].ncalls++;
+  ddef->prof[stage].ns     += p7_pli_Clock() - t0;
+  ddef->prof[stage].ncells += ncells;
+}
+
 static int
 region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int ireg, int jreg, 
 		      const P7_OMX *fwd, P7_OMX *wrk, int *ret_nc)
@@ -603,6 +618,7 @@ region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *
   int    nc;
   int    pos;
   float  null2[p7_MAXCODE];
+  uint64_t t0;
 
   esl_vec_FSet(ddef->n2sc+ireg, Lr, 0.0); /* zero the null2 scores in region */
 
@@ -623,7 +639,9 @@ region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *
 	{
 	  p7_spensemble_Add(ddef->sp, t, ddef->tr->sqfrom[d]+ireg-1, ddef->tr->sqto[d]+ireg-1, ddef->tr->hmmfrom[d], ddef->tr->hmmto[d]);
 
+	  t0 = ddef->prof ? p7_pli_Clock() : 0;
 	  p7_Null2_ByTrace(om, ddef->tr, ddef->tr->tfrom[d], ddef->tr->tto[d], wrk, null2);
+	  profile_stage(ddef, p7_PLI_NULL2, t0, (uint64_t) om->M * (ddef->tr->sqto[d] - ddef->tr->sqfrom[d] + 1));
 	  
 	  /* residues outside domains get bumped +1: because f'(x) = f(x), so f'(x)/f(x) = 1 in these segments */
 	  for (; pos <= ddef->tr->sqfrom[d]; pos++) ddef->n2sc[ireg+pos-1] += 1.0;
@@ -825,6 +843,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
   int            status;
   int            max_env_extra = 20;
   int            orig_L;
+  uint64_t       t0;
 
 
   if (long_target) {
@@ -865,7 +884,9 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
     ddef->nalloc *= 2;
   }
   dom = &(ddef->dcl[ddef->ndom]);
-  dom->ad             = p7_alidisplay_Create(ddef->tr, 0, om, sq, ntsq);
+  t0  = ddef->prof ? p7_pli_Clock() : 0;
+  dom->ad             = p7_alidisplay_CreateIn(ddef->arena, ddef->tr, 0, om, sq, ntsq);
+  profile_stage(ddef, p7_PLI_ALIDISPLAY, t0, ddef->tr->N);
   dom->scores_per_pos = NULL;
 
 
@@ -915,8 +936,10 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
          if (ddef->tr->i[z] > 0) ddef->tr->i[z] += i-1;
 
        /* store the results in it, first destroying the old alidisplay object */
-       p7_alidisplay_Destroy(dom->ad);
-       dom->ad            = p7_alidisplay_Create(ddef->tr, 0, om, sq, NULL);
+       if (! ddef->arena) p7_alidisplay_Destroy(dom->ad);
+       t0                 = ddef->prof ? p7_pli_Clock() : 0;
+       dom->ad            = p7_alidisplay_CreateIn(ddef->arena, ddef->tr, 0, om, sq, NULL);
+       profile_stage(ddef, p7_PLI_ALIDISPLAY, t0, ddef->tr->N);
     }
 
     /* Estimate bias correction, by computing what the score would've been without
@@ -946,7 +969,9 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
      * do it now, by the expectation (posterior decoding) method.
      */
       if (!null2_is_done) {
+        t0 = ddef->prof ? p7_pli_Clock() : 0;
         p7_Null2_ByExpectation(om, ox2, null2);
+        profile_stage(ddef, p7_PLI_NULL2, t0, (uint64_t) om->M * Ld);
         for (pos = i; pos <= j; pos++)
           ddef->n2sc[pos]  = logf(null2[sq->dsq[pos]]);
       }
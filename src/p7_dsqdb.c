@@ -0,0 +1,801 @@
+/* P7_DSQDB: a pressed sequence database.
+ *
+ * makedsqdb digitizes a sequence file once and writes it as two
+ * binary files, so that search programs don't have to parse and
+ * digitize the same FASTA database every time they read it:
+ *
+ *   <dbfile>        residue file: a header, then every digital
+ *                   sequence back to back with shared sentinels
+ *                   (dsq[0], residues, dsq[L+1] == next dsq[0]),
+ *                   then a length index of P7_DSQDB_ENTRY's.
+ *   <dbfile>.names  names file: the hmmpgmd "#..." database line of
+ *                   the source (if any), then name\0acc\0desc\0 for
+ *                   each sequence.
+ *
+ * The reader maps both files (or reads them into memory, without
+ * mmap()) and hands out sequences whose <dsq> points straight into
+ * the residue file. Such sequences must be recycled with
+ * p7_dsqdb_ReuseSeq(), not esl_sq_Reuse(), which would write
+ * sentinels into the map.
+ *
+ * Contents:
+ *    1. Writing a pressed sequence database.
+ *    2. Reading a pressed sequence database.
+ *    3. Unit tests.
+ *    4. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer.h"
+#include "p7_dsqdb.h"
+
+static uint32_t  v3a_dmagic = 0xb3e1e4f3; /* 3/a binary residue file, sse: "3ads" = 0x 33 61 64 73  + 0x80808080 */
+static uint32_t  v3a_nmagic = 0xb3e1eef3; /* 3/a binary names file,        "3ans" = 0x 33 61 6e 73  + 0x80808080 */
+
+#define p7_DSQDB_HDRSIZE 40	/* magic, alphatype, nseq, nres, maxL, idxoff */
+
+static int  write_header(FILE *dfp, int32_t alphatype, int64_t nseq, int64_t nres, int64_t maxL, int64_t idxoff);
+static int  fill_seq    (P7_DSQDB *db, int64_t i, ESL_SQ *sq);
+
+static uint32_t
+byteswap32(uint32_t x)
+{
+  return ((x & 0xff) << 24) | ((x & 0xff00) << 8) | ((x >> 8) & 0xff00) | (x >> 24);
+}
+
+
+/*****************************************************************
+ * 1. Writing a pressed sequence database.
+ *****************************************************************/
+
+/* Function:  p7_dsqdb_Write()
+ * Synopsis:  Press a digital sequence file into binary residue and names files.
+ *
+ * Purpose:   Read every sequence from <sqfp>, which must be open in
+ *            digital mode, and write them as a pressed sequence
+ *            database: residues and the length index to <dfp>,
+ *            names, accessions, and descriptions to <nfp>. <dbinfo>
+ *            is an hmmpgmd "#..." database line to keep with the
+ *            database, or <NULL>.
+ *
+ *            <dfp> must be seekable; the header is rewritten with
+ *            the final counts once all sequences have been read.
+ *
+ *            Optionally return the number of sequences and residues
+ *            in <*opt_nseq> and <*opt_nres>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEFORMAT> if <sqfp> can't be parsed, and <eslEWRITE>
+ *            on any write failure; in either case <errbuf> contains
+ *            a user-directed message.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_dsqdb_Write(ESL_SQFILE *sqfp, const char *dbinfo, FILE *dfp, FILE *nfp, int64_t *opt_nseq, int64_t *opt_nres, char *errbuf)
+{
+  ESL_SQ         *sq       = NULL;
+  FILE           *ifp      = NULL;  /* index is spooled to a tmpfile until all residues are written */
+  ESL_DSQ         sentinel = eslDSQ_SENTINEL;
+  char            zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  char            buf[4096];
+  P7_DSQDB_ENTRY  e;
+  int64_t         nseq     = 0;
+  int64_t         nres     = 0;
+  int64_t         maxL     = 0;
+  int64_t         idxoff;
+  off_t           noff;
+  size_t          n;
+  int             status;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (sqfp->abc == NULL) ESL_EXCEPTION(eslEINVAL, "sequence file must be opened in digital mode");
+
+  if ((sq  = esl_sq_CreateDigital(sqfp->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+  if ((ifp = tmpfile())                        == NULL) ESL_XFAIL(eslEWRITE, errbuf, "failed to open a temporary file for the index");
+
+  if (dbinfo == NULL) dbinfo = "";
+  if (fwrite(&v3a_nmagic, sizeof(uint32_t), 1, nfp)                != 1)                  ESL_XFAIL(eslEWRITE, errbuf, "failed to write names file magic");
+  if (fwrite(dbinfo,      sizeof(char), strlen(dbinfo)+1, nfp)     != strlen(dbinfo)+1)   ESL_XFAIL(eslEWRITE, errbuf, "failed to write database info line");
+
+  /* placeholder header; counts aren't known until the end */
+  if (write_header(dfp, sqfp->abc->type, 0, 0, 0, 0)               != eslOK)              ESL_XFAIL(eslEWRITE, errbuf, "failed to write residue file header");
+  if (fwrite(&sentinel, sizeof(ESL_DSQ), 1, dfp)                   != 1)                  ESL_XFAIL(eslEWRITE, errbuf, "failed to write leading sentinel");
+
+  while ((status = esl_sqio_Read(sqfp, sq)) == eslOK)
+    {
+      /* the sequence's leading sentinel is the trailing one of the previous sequence */
+      if ((e.doff = ftello(dfp))                                     == -1)                 ESL_XFAIL(eslEWRITE, errbuf, "failed to ftello() residue file position");
+      if ((noff   = ftello(nfp))                                     == -1)                 ESL_XFAIL(eslEWRITE, errbuf, "failed to ftello() names file position");
+      e.doff -= 1;
+      e.L     = sq->n;
+      e.noff  = noff;
+
+      if (sq->n > 0 && fwrite(sq->dsq+1, sizeof(ESL_DSQ), sq->n, dfp) != (size_t) sq->n)    ESL_XFAIL(eslEWRITE, errbuf, "failed to write residues of %s", sq->name);
+      if (fwrite(&sentinel, sizeof(ESL_DSQ), 1, dfp)                 != 1)                  ESL_XFAIL(eslEWRITE, errbuf, "failed to write sentinel");
+      if (fwrite(sq->name,  sizeof(char), strlen(sq->name)+1, nfp)   != strlen(sq->name)+1) ESL_XFAIL(eslEWRITE, errbuf, "failed to write name of %s", sq->name);
+      if (fwrite(sq->acc,   sizeof(char), strlen(sq->acc)+1,  nfp)   != strlen(sq->acc)+1)  ESL_XFAIL(eslEWRITE, errbuf, "failed to write accession of %s", sq->name);
+      if (fwrite(sq->desc,  sizeof(char), strlen(sq->desc)+1, nfp)   != strlen(sq->desc)+1) ESL_XFAIL(eslEWRITE, errbuf, "failed to write description of %s", sq->name);
+      if (fwrite(&e, sizeof(P7_DSQDB_ENTRY), 1, ifp)                 != 1)                  ESL_XFAIL(eslEWRITE, errbuf, "failed to write index entry of %s", sq->name);
+
+      nseq++;
+      nres += sq->n;
+      maxL  = ESL_MAX(maxL, sq->n);
+      esl_sq_Reuse(sq);
+    }
+  if      (status == eslEFORMAT) ESL_XFAIL(eslEFORMAT, errbuf, "Parse failed (sequence file %s):\n%s\n", sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
+  else if (status != eslEOF)     ESL_XFAIL(status,     errbuf, "Unexpected error %d reading sequence file %s", status, sqfp->filename);
+
+  /* the index goes after the residues, 8-byte aligned so it can be used in place */
+  if ((idxoff = ftello(dfp)) == -1) ESL_XFAIL(eslEWRITE, errbuf, "failed to ftello() residue file position");
+  if (idxoff % 8) {
+    if (fwrite(zeros, sizeof(char), 8 - idxoff % 8, dfp) != (size_t) (8 - idxoff % 8)) ESL_XFAIL(eslEWRITE, errbuf, "failed to pad residue file");
+    idxoff += 8 - idxoff % 8;
+  }
+  rewind(ifp);
+  while ((n = fread(buf, sizeof(char), sizeof(buf), ifp)) > 0)
+    if (fwrite(buf, sizeof(char), n, dfp) != n) ESL_XFAIL(eslEWRITE, errbuf, "failed to write length index");
+  if (ferror(ifp)) ESL_XFAIL(eslEWRITE, errbuf, "failed to read back the temporary index file");
+
+  if (fseeko(dfp, 0, SEEK_SET)                                      != 0)     ESL_XFAIL(eslEWRITE, errbuf, "residue file must be seekable");
+  if (write_header(dfp, sqfp->abc->type, nseq, nres, maxL, idxoff) != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "failed to rewrite residue file header");
+  if (fseeko(dfp, 0, SEEK_END)                                      != 0)     ESL_XFAIL(eslEWRITE, errbuf, "failed to fseeko() to end of residue file");
+
+  fclose(ifp);
+  esl_sq_Destroy(sq);
+  if (opt_nseq) *opt_nseq = nseq;
+  if (opt_nres) *opt_nres = nres;
+  return eslOK;
+
+ ERROR:
+  if (ifp) fclose(ifp);
+  if (sq)  esl_sq_Destroy(sq);
+  if (opt_nseq) *opt_nseq = 0;
+  if (opt_nres) *opt_nres = 0;
+  return status;
+}
+
+static int
+write_header(FILE *dfp, int32_t alphatype, int64_t nseq, int64_t nres, int64_t maxL, int64_t idxoff)
+{
+  if (fwrite(&v3a_dmagic, sizeof(uint32_t), 1, dfp) != 1) return eslEWRITE;
+  if (fwrite(&alphatype,  sizeof(int32_t),  1, dfp) != 1) return eslEWRITE;
+  if (fwrite(&nseq,       sizeof(int64_t),  1, dfp) != 1) return eslEWRITE;
+  if (fwrite(&nres,       sizeof(int64_t),  1, dfp) != 1) return eslEWRITE;
+  if (fwrite(&maxL,       sizeof(int64_t),  1, dfp) != 1) return eslEWRITE;
+  if (fwrite(&idxoff,     sizeof(int64_t),  1, dfp) != 1) return eslEWRITE;
+  return eslOK;
+}
+/*------------- end, writing a pressed database -----------------*/
+
+
+
+/*****************************************************************
+ * 2. Reading a pressed sequence database.
+ *****************************************************************/
+
+/* Function:  p7_dsqdb_Open()
+ * Synopsis:  Open a pressed sequence database.
+ *
+ * Purpose:   Open the pressed sequence database <filename> and its
+ *            names file <filename>.names, and return the open
+ *            database in <*ret_db>. Both files are memory-mapped
+ *            where the system allows it, and otherwise read into
+ *            memory.
+ *
+ *            Programs that accept either a pressed database or an
+ *            ordinary sequence file call this first, and fall back
+ *            to <esl_sqfile_Open()> on <eslENOTFOUND>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslENOTFOUND> if <filename> can't be opened or isn't a
+ *            pressed sequence database.
+ *
+ *            <eslEFORMAT> if it is one but is corrupt, was pressed
+ *            on a machine of the other byte order, or its names file
+ *            is missing or bad.
+ *
+ *            On any error, <*ret_db> is <NULL> and <errbuf> contains
+ *            a user-directed message.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_dsqdb_Open(const char *filename, P7_DSQDB **ret_db, char *errbuf)
+{
+  P7_DSQDB *db    = NULL;
+  char     *nfile = NULL;
+  uint32_t  magic;
+  int32_t   alphatype;
+  int64_t   idxoff;
+  int       status;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (strcmp(filename, "-") == 0) ESL_XFAIL(eslENOTFOUND, errbuf, "standard input can't be a pressed sequence database");
+
+  ESL_ALLOC(db, sizeof(P7_DSQDB));
+  db->filename  = NULL;
+  db->alphatype = eslUNKNOWN;
+  db->nseq      = 0;
+  db->nres      = 0;
+  db->maxL      = 0;
+  db->dbinfo    = NULL;
+  db->dmem      = NULL;
+  db->dsize     = 0;
+  db->dmapped   = FALSE;
+  db->nmem      = NULL;
+  db->nsize     = 0;
+  db->nmapped   = FALSE;
+  db->idx       = NULL;
+  db->next      = 0;
+  db->errbuf[0] = '\0';
+
+  if ((status = esl_strdup(filename, -1, &db->filename)) != eslOK) goto ERROR;
+
+  status = p7_dsqdb_MapFile(filename, &db->dmem, &db->dsize, &db->dmapped);
+  if      (status == eslENOTFOUND) ESL_XFAIL(eslENOTFOUND, errbuf, "failed to open %s", filename);
+  else if (status != eslOK)        goto ERROR;
+
+  if (db->dsize >= sizeof(uint32_t)) memcpy(&magic, db->dmem, sizeof(uint32_t));
+  else                               magic = 0;
+  if (magic == byteswap32(v3a_dmagic)) ESL_XFAIL(eslEFORMAT,   errbuf, "%s was pressed on a machine of the other byte order; press it again here", filename);
+  if (magic != v3a_dmagic)             ESL_XFAIL(eslENOTFOUND, errbuf, "%s is not a pressed sequence database", filename);
+  if (db->dsize < p7_DSQDB_HDRSIZE+1)  ESL_XFAIL(eslEFORMAT,   errbuf, "%s is truncated", filename);
+
+  memcpy(&alphatype, db->dmem +  4, sizeof(int32_t));
+  memcpy(&db->nseq,  db->dmem +  8, sizeof(int64_t));
+  memcpy(&db->nres,  db->dmem + 16, sizeof(int64_t));
+  memcpy(&db->maxL,  db->dmem + 24, sizeof(int64_t));
+  memcpy(&idxoff,    db->dmem + 32, sizeof(int64_t));
+  db->alphatype = alphatype;
+
+  if (db->nseq < 0 || idxoff < p7_DSQDB_HDRSIZE+1 || idxoff % 8 ||
+      (size_t) idxoff + db->nseq * sizeof(P7_DSQDB_ENTRY) > db->dsize)
+    ESL_XFAIL(eslEFORMAT, errbuf, "%s is corrupt: bad header or truncated index", filename);
+  db->idx = (const P7_DSQDB_ENTRY *) (db->dmem + idxoff);
+
+  if ((status = esl_sprintf(&nfile, "%s.names", filename)) != eslOK) goto ERROR;
+  status = p7_dsqdb_MapFile(nfile, &db->nmem, &db->nsize, &db->nmapped);
+  if      (status == eslENOTFOUND) ESL_XFAIL(eslEFORMAT, errbuf, "%s is a pressed sequence database, but its names file %s is missing", filename, nfile);
+  else if (status != eslOK)        goto ERROR;
+
+  if (db->nsize >= sizeof(uint32_t)) memcpy(&magic, db->nmem, sizeof(uint32_t));
+  else                               magic = 0;
+  if (magic != v3a_nmagic)           ESL_XFAIL(eslEFORMAT, errbuf, "%s is not the names file of a pressed sequence database", nfile);
+  /* every string in the names file is \0-terminated, so they can be used in place */
+  if (db->nsize < sizeof(uint32_t)+1 || db->nmem[db->nsize-1] != '\0') ESL_XFAIL(eslEFORMAT, errbuf, "names file %s is truncated", nfile);
+
+  db->dbinfo = (db->nmem[sizeof(uint32_t)] == '\0' ? NULL : db->nmem + sizeof(uint32_t));
+
+  free(nfile);
+  *ret_db = db;
+  return eslOK;
+
+ ERROR:
+  if (nfile) free(nfile);
+  if (db)    p7_dsqdb_Close(db);
+  *ret_db = NULL;
+  return status;
+}
+
+
+/* Function:  p7_dsqdb_Read()
+ * Synopsis:  Read the next sequence from a pressed database.
+ *
+ * Purpose:   Read the next sequence from <db> into <sq>, a digital
+ *            sequence object. Its name, accession, and description
+ *            are copied, but <sq->dsq> points into the database:
+ *            <sq> must be recycled with <p7_dsqdb_ReuseSeq()>, not
+ *            <esl_sq_Reuse()>, and must not be modified.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEOF> if no sequences remain.
+ *            <eslEFORMAT> if the index entry is corrupt; <db->errbuf>
+ *            contains a user-directed message.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_dsqdb_Read(P7_DSQDB *db, ESL_SQ *sq)
+{
+  int status;
+
+  if (db->next >= db->nseq) return eslEOF;
+  if ((status = fill_seq(db, db->next, sq)) != eslOK) return status;
+  db->next++;
+  return eslOK;
+}
+
+
+/* Function:  p7_dsqdb_ReadBlock()
+ * Synopsis:  Read the next block of sequences from a pressed database.
+ *
+ * Purpose:   Fill <block> with the next sequences of <db>, the
+ *            pressed-database counterpart of <esl_sqio_ReadBlock()>:
+ *            at most <block->listSize> sequences, at most <max_seqs>
+ *            of them (or no limit, if <max_seqs> is negative), and
+ *            no more once the block holds <p7_DSQDB_BLOCKRES>
+ *            residues. Since sequences are never split, every block
+ *            is <complete>.
+ *
+ *            The same caveats as <p7_dsqdb_Read()> apply to every
+ *            sequence in the block.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEOF> if no sequences remain; <block->count> is 0.
+ *            <eslEFORMAT> if an index entry is corrupt; <db->errbuf>
+ *            contains a user-directed message.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_dsqdb_ReadBlock(P7_DSQDB *db, ESL_SQ_BLOCK *block, int max_seqs)
+{
+  int64_t nres = 0;
+  int     status;
+
+  block->count        = 0;
+  block->complete     = TRUE;
+  block->first_seqidx = db->next;
+
+  while (block->count < block->listSize && (max_seqs < 0 || block->count < max_seqs) &&
+         nres < p7_DSQDB_BLOCKRES && db->next < db->nseq)
+    {
+      if ((status = fill_seq(db, db->next, block->list + block->count)) != eslOK) return status;
+      nres += block->list[block->count].n;
+      block->count++;
+      db->next++;
+    }
+  return (block->count ? eslOK : eslEOF);
+}
+
+
+/* Function:  p7_dsqdb_FetchBlock()
+ * Synopsis:  Fetch a given range of sequences into a block.
+ *
+ * Purpose:   Fill <block> with the <n> sequences numbered <from>
+ *            to <from+n-1> in <db>. Unlike <p7_dsqdb_ReadBlock()>,
+ *            this doesn't use or move the read position of <db>, so
+ *            several threads can fetch from one open database at
+ *            once, each into its own block.
+ *
+ *            The same caveats as <p7_dsqdb_Read()> apply to every
+ *            sequence in the block.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEFORMAT> if an index entry is corrupt; <db->errbuf>
+ *            contains a user-directed message.
+ *
+ * Throws:    <eslEINVAL> if the range is out of bounds or larger
+ *            than the block.
+ *            <eslEMEM> on allocation failure.
+ */
+int
+p7_dsqdb_FetchBlock(P7_DSQDB *db, ESL_SQ_BLOCK *block, int64_t from, int n)
+{
+  int i;
+  int status;
+
+  if (from < 0 || n < 0 || from + n > db->nseq) ESL_EXCEPTION(eslEINVAL, "no such sequence range %" PRId64 "..%" PRId64, from, from+n-1);
+  if (n > block->listSize)                      ESL_EXCEPTION(eslEINVAL, "block too small for %d sequences", n);
+
+  block->count        = 0;
+  block->complete     = TRUE;
+  block->first_seqidx = from;
+  for (i = 0; i < n; i++)
+    {
+      if ((status = fill_seq(db, from + i, block->list + i)) != eslOK) return status;
+      block->count++;
+    }
+  return eslOK;
+}
+
+
+/* Function:  p7_dsqdb_ReuseSeq()
+ * Synopsis:  Recycle a sequence read from a pressed database.
+ *
+ * Purpose:   Reinitialize <sq>, which was filled by <p7_dsqdb_Read()>
+ *            or <p7_dsqdb_ReadBlock()>, for reuse. Its <dsq> is
+ *            dropped rather than reset, since it belongs to the
+ *            database.
+ */
+void
+p7_dsqdb_ReuseSeq(ESL_SQ *sq)
+{
+  sq->dsq    = NULL;
+  sq->salloc = 0;
+  esl_sq_Reuse(sq);
+}
+
+
+/* Function:  p7_dsqdb_Position()
+ * Synopsis:  Reposition a pressed database to a given sequence.
+ *
+ * Purpose:   Make sequence number <idx> (0..nseq-1) of <db> the next
+ *            one read. <idx> may be <nseq>, for an immediate EOF.
+ *            <p7_dsqdb_Position(db, 0)> rewinds.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <idx> is out of range.
+ */
+int
+p7_dsqdb_Position(P7_DSQDB *db, int64_t idx)
+{
+  if (idx < 0 || idx > db->nseq) ESL_EXCEPTION(eslEINVAL, "no such sequence index %" PRId64, idx);
+  db->next = idx;
+  return eslOK;
+}
+
+
+/* Function:  p7_dsqdb_PositionByKey()
+ * Synopsis:  Reposition a pressed database to a named sequence.
+ *
+ * Purpose:   Make the first sequence of <db> whose name or accession
+ *            is <key> the next one read. There is no SSI index, so
+ *            this is a linear scan of the names; it's meant for
+ *            one-time positioning like hmmsearch's --restrictdb_stkey.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> if <key> isn't found; <db> is unchanged.
+ */
+int
+p7_dsqdb_PositionByKey(P7_DSQDB *db, const char *key)
+{
+  const char *name;
+  const char *acc;
+  int64_t     i;
+
+  for (i = 0; i < db->nseq; i++)
+    {
+      if (db->idx[i].noff < 0 || (size_t) db->idx[i].noff >= db->nsize) return eslENOTFOUND;
+      name = db->nmem + db->idx[i].noff;
+      acc  = name + strlen(name) + 1;
+      if (strcmp(name, key) == 0 || ((size_t) (acc - db->nmem) < db->nsize && strcmp(acc, key) == 0))
+        {
+          db->next = i;
+          return eslOK;
+        }
+    }
+  return eslENOTFOUND;
+}
+
+
+/* Function:  p7_dsqdb_Close()
+ * Synopsis:  Close a pressed sequence database.
+ *
+ * Purpose:   Unmap or free the contents of <db>, and free it. Any
+ *            sequence still pointing into <db> is invalid afterwards.
+ */
+void
+p7_dsqdb_Close(P7_DSQDB *db)
+{
+  if (db)
+    {
+      if (db->dmem)     p7_dsqdb_UnmapFile(db->dmem, db->dsize, db->dmapped);
+      if (db->nmem)     p7_dsqdb_UnmapFile(db->nmem, db->nsize, db->nmapped);
+      if (db->filename) free(db->filename);
+      free(db);
+    }
+}
+
+
+/* Function:  p7_dsqdb_MapFile()
+ * Synopsis:  Map a binary file read-only, or read it into memory.
+ *
+ * Purpose:   Map <filename> read-only, or if mmap() isn't available
+ *            or fails, read it into an allocated buffer; <*ret_mapped>
+ *            says which. Release it with <p7_dsqdb_UnmapFile()>.
+ *            Also used for hmmpgmd's sequence cache snapshots.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> if it can't be opened or read, isn't a
+ *            regular file, or is empty.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_dsqdb_MapFile(const char *filename, char **ret_mem, size_t *ret_size, int *ret_mapped)
+{
+  FILE   *fp   = NULL;
+  char   *mem  = NULL;
+  off_t   size = 0;
+  int     status;
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+  struct stat st;
+  void       *p;
+#endif
+
+  *ret_mapped = FALSE;
+  if ((fp = fopen(filename, "rb")) == NULL) { status = eslENOTFOUND; goto ERROR; }
+
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+  if (fstat(fileno(fp), &st) != 0 || ! S_ISREG(st.st_mode) || st.st_size == 0) { status = eslENOTFOUND; goto ERROR; }
+  size = st.st_size;
+
+  if ((p = mmap(NULL, (size_t) size, PROT_READ, MAP_PRIVATE, fileno(fp), 0)) != MAP_FAILED)
+    {
+      fclose(fp);
+      *ret_mem    = (char *) p;
+      *ret_size   = (size_t) size;
+      *ret_mapped = TRUE;
+      return eslOK;
+    }
+#else
+  if (fseeko(fp, 0, SEEK_END) != 0 || (size = ftello(fp)) <= 0 || fseeko(fp, 0, SEEK_SET) != 0) { status = eslENOTFOUND; goto ERROR; }
+#endif
+
+  ESL_ALLOC(mem, sizeof(char) * size);
+  if (fread(mem, sizeof(char), size, fp) != (size_t) size) { status = eslENOTFOUND; goto ERROR; }
+  fclose(fp);
+  *ret_mem  = mem;
+  *ret_size = (size_t) size;
+  return eslOK;
+
+ ERROR:
+  if (fp)  fclose(fp);
+  if (mem) free(mem);
+  *ret_mem  = NULL;
+  *ret_size = 0;
+  return status;
+}
+
+/* Function:  p7_dsqdb_UnmapFile()
+ * Synopsis:  Release a file loaded by p7_dsqdb_MapFile().
+ */
+void
+p7_dsqdb_UnmapFile(char *mem, size_t size, int is_mapped)
+{
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+  if (is_mapped) { munmap(mem, size); return; }
+#endif
+  free(mem);
+}
+
+
+/* fill_seq()
+ * Point <sq> at sequence <i> of <db>. A <dsq> that <sq> allocated
+ * itself is freed; one that already points into a database is simply
+ * replaced.
+ */
+static int
+fill_seq(P7_DSQDB *db, int64_t i, ESL_SQ *sq)
+{
+  const P7_DSQDB_ENTRY *e = db->idx + i;
+  const char           *name, *acc, *desc;
+  int                   status;
+
+  if (e->doff < p7_DSQDB_HDRSIZE || e->L < 0 || (size_t) (e->doff + e->L + 2) > db->dsize ||
+      e->noff < (int64_t) sizeof(uint32_t) || (size_t) e->noff >= db->nsize)
+    ESL_FAIL(eslEFORMAT, db->errbuf, "%s is corrupt: bad index entry for sequence %" PRId64, db->filename, i+1);
+
+  /* the names file ends in \0, so at worst acc and desc are empty strings at its end */
+  name = db->nmem + e->noff;
+  acc  = name + strlen(name) + 1;  if ((size_t) (acc  - db->nmem) >= db->nsize) acc  = db->nmem + db->nsize - 1;
+  desc = acc  + strlen(acc)  + 1;  if ((size_t) (desc - db->nmem) >= db->nsize) desc = db->nmem + db->nsize - 1;
+
+  if ((status = esl_sq_SetName     (sq, name)) != eslOK) return status;
+  if ((status = esl_sq_SetAccession(sq, acc))  != eslOK) return status;
+  if ((status = esl_sq_SetDesc     (sq, desc)) != eslOK) return status;
+
+  if (sq->dsq && (sq->dsq < (ESL_DSQ *) db->dmem || sq->dsq >= (ESL_DSQ *) (db->dmem + db->dsize)))
+    free(sq->dsq);
+  sq->dsq    = (ESL_DSQ *) (db->dmem + e->doff);
+  sq->salloc = 0;
+  sq->n      = e->L;
+  sq->start  = 1;
+  sq->end    = e->L;
+  sq->C      = 0;
+  sq->W      = e->L;
+  sq->L      = e->L;
+  sq->idx    = i;
+  sq->roff   = -1;
+  sq->hoff   = -1;
+  sq->doff   = -1;
+  sq->eoff   = -1;
+  return eslOK;
+}
+/*------------- end, reading a pressed database -----------------*/
+
+
+
+/*****************************************************************
+ * 3. Unit tests.
+ *****************************************************************/
+#ifdef p7DSQDB_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_vectorops.h"
+
+/* utest_roundtrip()
+ * Press <nseq> random sequences and read them back with every
+ * reader: Read(), ReadBlock(), Position(), PositionByKey().
+ */
+static void
+utest_roundtrip(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int nseq)
+{
+  char          msg[]        = "p7_dsqdb roundtrip unit test failed";
+  char          seqfile[32]  = "tmp-hmmerXXXXXX";
+  char          dbfile[32]   = "tmp-hmmerXXXXXX";
+  char         *namesfile    = NULL;
+  char          errbuf[eslERRBUFSIZE];
+  ESL_SQ      **sqarr        = NULL;
+  ESL_SQ       *sq           = NULL;
+  ESL_SQ_BLOCK *block        = NULL;
+  ESL_SQFILE   *sqfp         = NULL;
+  P7_DSQDB     *db           = NULL;
+  FILE         *fp           = NULL;
+  FILE         *nfp          = NULL;
+  float        *p            = NULL;
+  int64_t       nseq_w, nres_w;
+  int64_t       nres         = 0;
+  int           i, k, n;
+
+  if ((sqarr = malloc(sizeof(ESL_SQ *) * nseq)) == NULL) esl_fatal(msg);
+  if ((p     = malloc(sizeof(float) * abc->K))  == NULL) esl_fatal(msg);
+  esl_vec_FSet(p, abc->K, 1.0 / (float) abc->K);
+
+  /* a random sequence file */
+  if (esl_tmpfile_named(seqfile, &fp) != eslOK) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      n = 1 + esl_rnd_Roll(rng, 300);
+      if ((sqarr[i] = esl_sq_CreateDigital(abc))              == NULL)  esl_fatal(msg);
+      if (esl_sq_GrowTo(sqarr[i], n)                          != eslOK) esl_fatal(msg);
+      if (esl_rsq_xfIID(rng, p, abc->K, n, sqarr[i]->dsq)     != eslOK) esl_fatal(msg);
+      sqarr[i]->n = n;
+      if (esl_sq_FormatName(sqarr[i], "seq%d", i)             != eslOK) esl_fatal(msg);
+      if (i % 2 && esl_sq_FormatDesc(sqarr[i], "random sequence %d", i) != eslOK) esl_fatal(msg);
+      if (esl_sqio_Write(fp, sqarr[i], eslSQFILE_FASTA, FALSE) != eslOK) esl_fatal(msg);
+      nres += n;
+    }
+  fclose(fp);
+
+  /* an ordinary sequence file isn't a pressed database */
+  if (p7_dsqdb_Open(seqfile, &db, errbuf) != eslENOTFOUND) esl_fatal(msg);
+
+  /* press it */
+  if (esl_sqfile_OpenDigital(abc, seqfile, eslSQFILE_FASTA, NULL, &sqfp) != eslOK) esl_fatal(msg);
+  if (esl_tmpfile_named(dbfile, &fp)                                     != eslOK) esl_fatal(msg);
+  if (esl_sprintf(&namesfile, "%s.names", dbfile)                        != eslOK) esl_fatal(msg);
+  if ((nfp = fopen(namesfile, "wb"))                                     == NULL)  esl_fatal(msg);
+  if (p7_dsqdb_Write(sqfp, "#test", fp, nfp, &nseq_w, &nres_w, errbuf)   != eslOK) esl_fatal(msg);
+  if (nseq_w != nseq || nres_w != nres)                                            esl_fatal(msg);
+  fclose(fp);
+  fclose(nfp);
+  esl_sqfile_Close(sqfp);
+
+  if (p7_dsqdb_Open(dbfile, &db, errbuf)                                 != eslOK) esl_fatal(msg);
+  if (db->nseq != nseq || db->nres != nres || db->alphatype != abc->type)          esl_fatal(msg);
+  if (db->dbinfo == NULL || strcmp(db->dbinfo, "#test") != 0)                      esl_fatal(msg);
+
+  /* a range, out of order */
+  if ((block = esl_sq_CreateDigitalBlock(7, abc)) == NULL)  esl_fatal(msg);
+  k = esl_rnd_Roll(rng, nseq);
+  n = ESL_MIN(7, nseq - k);
+  if (p7_dsqdb_FetchBlock(db, block, k, n)        != eslOK) esl_fatal(msg);
+  if (block->count != n || block->first_seqidx != k)        esl_fatal(msg);
+  for (i = 0; i < n; i++)
+    {
+      if (strcmp(block->list[i].name, sqarr[k+i]->name) != 0)                 esl_fatal(msg);
+      if (memcmp(block->list[i].dsq+1, sqarr[k+i]->dsq+1, sqarr[k+i]->n) != 0) esl_fatal(msg);
+      p7_dsqdb_ReuseSeq(block->list + i);
+    }
+
+  /* one at a time; FetchBlock() didn't move the read position */
+  if ((sq = esl_sq_CreateDigital(abc)) == NULL) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      if (p7_dsqdb_Read(db, sq)                    != eslOK)     esl_fatal(msg);
+      if (strcmp(sq->name, sqarr[i]->name)         != 0)         esl_fatal(msg);
+      if (strcmp(sq->desc, sqarr[i]->desc)         != 0)         esl_fatal(msg);
+      if (sq->n != sqarr[i]->n || sq->idx != i)                  esl_fatal(msg);
+      if (sq->dsq[0] != eslDSQ_SENTINEL || sq->dsq[sq->n+1] != eslDSQ_SENTINEL) esl_fatal(msg);
+      if (memcmp(sq->dsq+1, sqarr[i]->dsq+1, sq->n) != 0)        esl_fatal(msg);
+      p7_dsqdb_ReuseSeq(sq);
+    }
+  if (p7_dsqdb_Read(db, sq) != eslEOF) esl_fatal(msg);
+
+  /* in blocks, after a rewind */
+  if (p7_dsqdb_Position(db, 0)                    != eslOK) esl_fatal(msg);
+  i = 0;
+  while (p7_dsqdb_ReadBlock(db, block, -1) == eslOK)
+    {
+      if (block->first_seqidx != i || ! block->complete) esl_fatal(msg);
+      for (k = 0; k < block->count; k++, i++)
+        {
+          if (strcmp(block->list[k].name, sqarr[i]->name)             != 0) esl_fatal(msg);
+          if (memcmp(block->list[k].dsq+1, sqarr[i]->dsq+1, sqarr[i]->n) != 0) esl_fatal(msg);
+          p7_dsqdb_ReuseSeq(block->list + k);
+        }
+    }
+  if (i != nseq) esl_fatal(msg);
+
+  /* by name */
+  k = esl_rnd_Roll(rng, nseq);
+  if (p7_dsqdb_PositionByKey(db, sqarr[k]->name) != eslOK)        esl_fatal(msg);
+  if (p7_dsqdb_Read(db, sq)                      != eslOK)        esl_fatal(msg);
+  if (strcmp(sq->name, sqarr[k]->name)           != 0)            esl_fatal(msg);
+  p7_dsqdb_ReuseSeq(sq);
+  if (p7_dsqdb_PositionByKey(db, "no-such-seq")  != eslENOTFOUND) esl_fatal(msg);
+
+  p7_dsqdb_Close(db);
+
+  /* without its names file, a pressed database is a format error */
+  remove(namesfile);
+  if (p7_dsqdb_Open(dbfile, &db, errbuf) != eslEFORMAT) esl_fatal(msg);
+
+  for (i = 0; i < nseq; i++) esl_sq_Destroy(sqarr[i]);
+  free(sqarr);
+  free(p);
+  free(namesfile);
+  esl_sq_DestroyBlock(block);
+  esl_sq_Destroy(sq);
+  remove(seqfile);
+  remove(dbfile);
+}
+#endif /*p7DSQDB_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+/*****************************************************************
+ * 4. Test driver.
+ *****************************************************************/
+#ifdef p7DSQDB_TESTDRIVE
+/* gcc -g -Wall -Dp7DSQDB_TESTDRIVE -I. -I../easel -L. -L../easel -o p7_dsqdb_utest p7_dsqdb.c -lhmmer -leasel -lm
+ */
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name  type         default  env   range togs  reqs  incomp  help                    docgrp */
+  {"-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",            0},
+  {"-s",  eslARG_INT,       "0", NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",  0},
+  {"-N",  eslARG_INT,     "100", NULL, "n>0",NULL, NULL, NULL, "number of random sequences",     0},
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for pressed sequence databases";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go     = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *aa_abc = esl_alphabet_Create(eslAMINO);
+  ESL_ALPHABET   *nt_abc = esl_alphabet_Create(eslDNA);
+  int             N      = esl_opt_GetInteger(go, "-N");
+
+  fprintf(stderr, "## %s\n", argv[0]);
+  fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+  utest_roundtrip(rng, aa_abc, N);
+  utest_roundtrip(rng, nt_abc, N);
+
+  fprintf(stderr, "#  status = ok\n");
+
+  esl_alphabet_Destroy(aa_abc);
+  esl_alphabet_Destroy(nt_abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7DSQDB_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
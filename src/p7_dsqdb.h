@@ -0,0 +1,57 @@
+/* P7_DSQDB: a pressed sequence database, digitized and indexed by
+ * makedsqdb, that search programs read in place.
+ */
+#ifndef P7_DSQDB_INCLUDED
+#define P7_DSQDB_INCLUDED
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+/* p7_dsqdb_ReadBlock() stops adding sequences to a block once it
+ * holds this many residues, as esl_sqio_ReadBlock() does.
+ */
+#define p7_DSQDB_BLOCKRES  (1024 * 1024)
+
+/* One entry in the length index of a pressed sequence database. */
+typedef struct {
+  int64_t doff;			/* offset of dsq[0] (the leading sentinel) in the residue file */
+  int64_t L;			/* length of the sequence                                      */
+  int64_t noff;			/* offset of its name, acc, desc strings in the names file     */
+} P7_DSQDB_ENTRY;
+
+typedef struct {
+  char                 *filename;  /* name of the residue file; names are in <filename>.names   */
+  int                   alphatype; /* eslAMINO, eslDNA, ...                                     */
+  int64_t               nseq;      /* number of sequences                                       */
+  int64_t               nres;      /* total number of residues                                  */
+  int64_t               maxL;      /* length of the longest sequence                            */
+  const char           *dbinfo;    /* hmmpgmd "#..." database line of the source, or NULL       */
+
+  char                 *dmem;      /* contents of the residue file, mapped or read into memory  */
+  size_t                dsize;     /* size of <dmem> in bytes                                   */
+  int                   dmapped;   /* TRUE if <dmem> is mmap()'ed, not malloc()'ed              */
+  char                 *nmem;      /* contents of the names file                                */
+  size_t                nsize;     /* size of <nmem> in bytes                                   */
+  int                   nmapped;   /* TRUE if <nmem> is mmap()'ed                               */
+  const P7_DSQDB_ENTRY *idx;       /* [0..nseq-1] length index, in <dmem>                       */
+
+  int64_t               next;      /* index of the next sequence to read                        */
+  char                  errbuf[eslERRBUFSIZE];
+} P7_DSQDB;
+
+extern int  p7_dsqdb_Write(ESL_SQFILE *sqfp, const char *dbinfo, FILE *dfp, FILE *nfp, int64_t *opt_nseq, int64_t *opt_nres, char *errbuf);
+extern int  p7_dsqdb_Open(const char *filename, P7_DSQDB **ret_db, char *errbuf);
+extern int  p7_dsqdb_Read(P7_DSQDB *db, ESL_SQ *sq);
+extern int  p7_dsqdb_ReadBlock(P7_DSQDB *db, ESL_SQ_BLOCK *block, int max_seqs);
+extern int  p7_dsqdb_FetchBlock(P7_DSQDB *db, ESL_SQ_BLOCK *block, int64_t from, int n);
+extern void p7_dsqdb_ReuseSeq(ESL_SQ *sq);
+extern int  p7_dsqdb_Position(P7_DSQDB *db, int64_t idx);
+extern int  p7_dsqdb_PositionByKey(P7_DSQDB *db, const char *key);
+extern void p7_dsqdb_Close(P7_DSQDB *db);
+extern int  p7_dsqdb_MapFile(const char *filename, char **ret_mem, size_t *ret_size, int *ret_mapped);
+extern void p7_dsqdb_UnmapFile(char *mem, size_t size, int is_mapped);
+
+#endif /*P7_DSQDB_INCLUDED*/
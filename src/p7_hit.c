@@ -64,6 +64,7 @@ extern P7_HIT *p7_hit_Create_empty(){
   the_hit->seqidx = 0;
   the_hit->subseq_start = 0;
   the_hit->dcl = NULL;
+  the_hit->in_arena = FALSE;
   the_hit->offset = 0;
 
   return the_hit;
@@ -168,6 +169,7 @@ extern int p7_hit_Copy(const P7_HIT *src, P7_HIT *dst){
   dst->acc = acc;
   dst->desc = desc;
   dst->dcl = dcl;
+  dst->in_arena = FALSE;  // the copy is on the heap, even if <src> is in an arena
   return eslOK;
     
 ERROR:
@@ -623,6 +625,7 @@ extern int p7_hit_Deserialize(const uint8_t *buf, uint32_t *n, P7_HIT *ret_obj){
   }
 
   ESL_ALLOC(ret_obj->dcl, ret_obj->ndom * sizeof(P7_DOMAIN));
+  ret_obj->in_arena = FALSE;  // deserialized hits are always on the heap
 
   *n = ptr- buf; // reset n to point just past fixed-length fields
 
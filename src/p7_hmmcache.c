@@ -26,6 +26,11 @@
  *            a cached profile database in memory. Return a ptr to the 
  *            cached profile database in <*ret_cache>. 
  *            
+ *            If the pressed files can be memory-mapped (see
+ *            <p7_oprofile_Map()>), the profiles' score vectors are
+ *            left in the maps instead of being copied, and several
+ *            daemons caching the same database share its pages.
+ *            
  *            Caller may optionally provide an <errbuf> ptr to
  *            at least <eslERRBUFSIZE> bytes, to capture an 
  *            informative error message on failure. 
@@ -61,11 +66,21 @@ p7_hmmcache_Open(char *hmmfile, P7_HMMCACHE **ret_cache, char *errbuf)
   cache->list      = NULL;
   cache->lalloc    = 4096;	/* allocation chunk size for <list> of ptrs  */
   cache->n         = 0;
+#if defined (eslENABLE_SSE)
+  cache->perm      = NULL;
+  cache->pack      = NULL;
+  cache->wpack     = NULL;
+  cache->npack     = 0;
+  cache->hfp       = NULL;
+#endif
 
   if ( ( status = esl_strdup(hmmfile, -1, &cache->name) != eslOK)) goto ERROR; 
   ESL_ALLOC(cache->list, sizeof(P7_OPROFILE *) * cache->lalloc);
 
   if ( (status = p7_hmmfile_Open(hmmfile, NULL, &hfp, errbuf)) != eslOK) goto ERROR;  // eslENOTFOUND | eslEFORMAT 
+#if defined (eslENABLE_SSE)
+  p7_oprofile_Map(hfp);		/* if it fails (older pressed format, say), profiles are read and copied as usual */
+#endif
 
   while ((status = p7_oprofile_ReadMSV(hfp, &(cache->abc), &om)) == eslOK) /* eslEFORMAT | eslEINCOMPAT */
     {
@@ -83,7 +98,10 @@ p7_hmmcache_Open(char *hmmfile, P7_HMMCACHE **ret_cache, char *errbuf)
   if (status != eslEOF)  { strncpy(errbuf, hfp->errbuf, eslERRBUFSIZE); goto ERROR; }
 
   //printf("\nfinal:: %d  memory %" PRId64 "\n", inx, total_mem);
-  p7_hmmfile_Close(hfp);
+#if defined (eslENABLE_SSE)
+  if (hfp->fmap != NULL) { cache->hfp = hfp; hfp = NULL; } /* profiles point into its maps */
+#endif
+  if (hfp) p7_hmmfile_Close(hfp);
   *ret_cache = cache;
   return eslOK;
 
@@ -111,6 +129,16 @@ p7_hmmcache_Sizeof(P7_HMMCACHE *cache)
   for (i = 0; i < cache->n; i++)
     n += p7_oprofile_Sizeof(cache->list[i]);
 
+#if defined (eslENABLE_SSE)
+  if (cache->pack)
+    {
+      n += sizeof(uint32_t) * cache->n;                                              /* cache->perm  */
+      n += sizeof(uint32_t) * ((cache->n + p7_HMMCACHE_PACKWIN - 1) / p7_HMMCACHE_PACKWIN + 1); /* cache->wpack */
+      n += sizeof(P7_OM_PACK *) * cache->npack;                                      /* cache->pack  */
+      for (i = 0; i < cache->npack; i++)
+	n += sizeof(P7_OM_PACK) + cache->pack[i]->allocS + 31;
+    }
+#endif
   return n;
 }
   
@@ -146,6 +174,98 @@ p7_hmmcache_SetNumericNames(P7_HMMCACHE *cache)
 }
 
 
+#if defined (eslENABLE_SSE)
+static int
+pack_key_compare(const void *a, const void *b)
+{
+  int64_t x = *(const int64_t *) a;
+  int64_t y = *(const int64_t *) b;
+  return (x > y) - (x < y);
+}
+#endif
+
+/* Function:  p7_hmmcache_Pack()
+ * Synopsis:  Interleave the short profiles in a cache.
+ *
+ * Purpose:   Make the packs of short profiles that a scan of <cache>
+ *            uses for the multi-model SSV filter (see
+ *            <p7_pli_SSVPack()>). Within each window of
+ *            <p7_HMMCACHE_PACKWIN> consecutive profiles, sort them by
+ *            length, and pack the ones with M <= <p7O_PACK_MAXM>,
+ *            <p7O_PACK_LANES> at a time, so that each pack's lanes
+ *            are of similar length. The profiles themselves stay where
+ *            they are in <cache->list>, so their indices (and numeric
+ *            names) don't change.
+ *
+ *            A pack is worth making only because a cache is scanned
+ *            many times: it costs more than a scan of its profiles.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_hmmcache_Pack(P7_HMMCACHE *cache)
+{
+#if defined (eslENABLE_SSE)
+  P7_OPROFILE *lane[p7O_PACK_LANES];
+  int64_t     *key  = NULL;	/* (M << 32) | index, to sort a window */
+  uint32_t     nwin = (cache->n + p7_HMMCACHE_PACKWIN - 1) / p7_HMMCACHE_PACKWIN;
+  uint32_t     w, lo, hi, i, j;
+  int          n;
+  int          status;
+
+  if (cache->pack) return eslOK;
+
+  ESL_ALLOC(key,          sizeof(int64_t)      * p7_HMMCACHE_PACKWIN);
+  ESL_ALLOC(cache->perm,  sizeof(uint32_t)     * ESL_MAX(1, cache->n));
+  ESL_ALLOC(cache->wpack, sizeof(uint32_t)     * (nwin + 1));
+  ESL_ALLOC(cache->pack,  sizeof(P7_OM_PACK *) * (cache->n / p7O_PACK_LANES + nwin + 1));
+  cache->npack = 0;
+
+  for (w = 0; w < nwin; w++)
+    {
+      lo = w * p7_HMMCACHE_PACKWIN;
+      hi = ESL_MIN(cache->n, lo + p7_HMMCACHE_PACKWIN);
+      for (i = lo; i < hi; i++) key[i-lo] = ((int64_t) cache->list[i]->M << 32) | i;
+      qsort(key, hi-lo, sizeof(int64_t), pack_key_compare);
+      for (i = lo; i < hi; i++) cache->perm[i] = (uint32_t) (key[i-lo] & 0xffffffff);
+
+      cache->wpack[w] = cache->npack;
+      for (i = lo; i < hi && cache->list[cache->perm[i]]->M <= p7O_PACK_MAXM; i += n)
+	{
+	  for (n = 0, j = i; j < hi && n < p7O_PACK_LANES && cache->list[cache->perm[j]]->M <= p7O_PACK_MAXM; j++, n++)
+	    lane[n] = cache->list[cache->perm[j]];
+
+	  if ((cache->pack[cache->npack] = p7_oprofile_CreatePack()) == NULL)  { status = eslEMEM; goto ERROR; }
+	  cache->npack++;
+	  if ((status = p7_oprofile_SetPack(cache->pack[cache->npack-1], lane, n)) != eslOK) goto ERROR;
+	}
+    }
+  cache->wpack[nwin] = cache->npack;
+
+  free(key);
+  return eslOK;
+
+ ERROR:
+  if (cache->pack) {
+    for (w = 0; w < cache->npack; w++) p7_oprofile_DestroyPack(cache->pack[w]);
+    free(cache->pack);
+  }
+  if (cache->perm)  free(cache->perm);
+  if (cache->wpack) free(cache->wpack);
+  cache->pack  = NULL;
+  cache->perm  = NULL;
+  cache->wpack = NULL;
+  cache->npack = 0;
+  if (key) free(key);
+  return status;
+#else
+  return eslOK;
+#endif
+}
+
+
 /* Function:  p7_hmmcache_Close()
  * Synopsis:  Free a profile cache.
  */
@@ -163,6 +283,17 @@ p7_hmmcache_Close(P7_HMMCACHE *cache)
 	p7_oprofile_Destroy(cache->list[i]);
       free(cache->list);
     }
+#if defined (eslENABLE_SSE)
+  if (cache->pack)
+    {
+      for (i = 0; i < cache->npack; i++)
+	p7_oprofile_DestroyPack(cache->pack[i]);
+      free(cache->pack);
+    }
+  if (cache->perm)  free(cache->perm);
+  if (cache->wpack) free(cache->wpack);
+  if (cache->hfp)   p7_hmmfile_Close(cache->hfp); /* after the profiles that point into its maps */
+#endif
   free(cache);
 }
 
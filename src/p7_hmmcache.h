@@ -6,6 +6,12 @@
 #include "esl_alphabet.h"
 #include "hmmer.h"
 
+/* p7_hmmcache_Pack() sorts profiles by length within windows of this
+ * many consecutive ones, so a scan over a range of the cache can use
+ * the packs of every window the range covers.
+ */
+#define p7_HMMCACHE_PACKWIN 256
+
 typedef struct {
   char               *name;        /* name of the hmm database              */
   ESL_ALPHABET       *abc;         /* alphabet for database                 */
@@ -13,11 +19,31 @@ typedef struct {
   P7_OPROFILE       **list;        /* list of profiles [0 .. n-1]           */
   uint32_t            lalloc;	   /* allocated length of <list>            */
   uint32_t            n;           /* number of entries in <list>           */
+
+#if defined (eslENABLE_SSE)
+  /* Optional, made by p7_hmmcache_Pack(): in window w of
+   * p7_HMMCACHE_PACKWIN consecutive profiles, <perm> lists their
+   * <list> indices by increasing M, and packs wpack[w]..wpack[w+1]-1
+   * interleave the first ones, p7O_PACK_LANES at a time, for the
+   * multi-model SSV filter. The rest are too long to pack.
+   */
+  uint32_t           *perm;        /* [0..n-1] indices, sorted in windows   */
+  P7_OM_PACK        **pack;        /* [0..npack-1] packs; NULL if unpacked  */
+  uint32_t           *wpack;       /* [0..nwin] first pack of each window   */
+  uint32_t            npack;       /* number of packs                       */
+
+  /* If the pressed files could be memory-mapped, the score vectors
+   * of the profiles in <list> point into the maps of this open file,
+   * so it stays open until p7_hmmcache_Close().
+   */
+  P7_HMMFILE         *hfp;         /* mapped HMM database, or NULL          */
+#endif
 } P7_HMMCACHE;
 
 extern int    p7_hmmcache_Open (char *hmmfile, P7_HMMCACHE **ret_cache, char *errbuf);
 extern size_t p7_hmmcache_Sizeof         (P7_HMMCACHE *cache);
 extern int    p7_hmmcache_SetNumericNames(P7_HMMCACHE *cache);
+extern int    p7_hmmcache_Pack           (P7_HMMCACHE *cache);
 extern void   p7_hmmcache_Close          (P7_HMMCACHE *cache);
 
 #endif /*P7_HMMCACHE_INCLUDED*/
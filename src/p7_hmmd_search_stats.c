@@ -358,6 +358,9 @@ extern int p7_hmmd_search_stats_Deserialize(const uint8_t *buf, uint32_t *n, HMM
   ret_obj->nincluded = esl_ntoh64(network_64bit);
   ptr += sizeof(uint64_t);
 
+  // The pipeline profile isn't part of the serialized object; see p7_hmmd_search_stats_DeserializeProfile()
+  memset(ret_obj->prof, 0, sizeof(P7_PLI_PROFILE) * p7_PLI_NSTAGES);
+
   // seventh field: hit_offsets array, if any
   memcpy(&network_64bit, ptr, sizeof(uint64_t));
   ptr += sizeof(uint64_t);
@@ -391,6 +394,103 @@ ERROR:
   return eslEMEM;
 }
 
+
+/* Function:  p7_hmmd_search_stats_SerializeProfile
+ * Synopsis:  Serializes the pipeline profile of a HMMD_SEARCH_STATS object
+ *
+ * Purpose:   Converts the per-stage pipeline profile <obj->prof> into a stream of bytes in network
+ *            byte order: calls, nanoseconds and cells for each stage, <HMMD_SEARCH_PROFILE_SERIAL_SIZE>
+ *            bytes in all.  The profile is not part of the serialized HMMD_SEARCH_STATS object, whose
+ *            layout clients depend on.  A worker searching with --profile serializes it after its hits,
+ *            and the master reads it if a worker's message goes on past the hits.
+ *
+ * Inputs:    obj, buf, n, nalloc: as for p7_hmmd_search_stats_Serialize()
+ *
+ * Returns:   On success: returns eslOK, and updates *buf, *n and *nalloc as p7_hmmd_search_stats_Serialize() does.
+ *
+ * Throws:    Returns eslEMEM if unable to allocate or re-allocate memory.  Returns eslEINVAL if obj == NULL,
+ *            buf == NULL, or n == NULL.
+ */
+extern int p7_hmmd_search_stats_SerializeProfile(const HMMD_SEARCH_STATS *obj, uint8_t **buf, uint32_t *n, uint32_t *nalloc){
+  int status;
+  int ser_size = HMMD_SEARCH_PROFILE_SERIAL_SIZE;
+  uint8_t *ptr;
+  uint64_t network_64bit;
+  int s;
+
+  if((obj == NULL) || (buf == NULL) || (n == NULL)){
+    return(eslEINVAL);
+  }
+
+  if (*buf == NULL){
+    ESL_ALLOC(*buf, ser_size);
+    *n = 0;
+    *nalloc = ser_size;
+  }
+  else if(*n + ser_size > *nalloc){
+    ESL_REALLOC(*buf, *n + ser_size);
+    *nalloc = *n + ser_size;
+  }
+
+  ptr = *buf + *n;
+  for (s = 0; s < p7_PLI_NSTAGES; s++)
+    {
+      network_64bit = esl_hton64(obj->prof[s].ncalls);
+      memcpy((void *) ptr, (void *) &network_64bit, sizeof(uint64_t));
+      ptr += sizeof(uint64_t);
+      network_64bit = esl_hton64(obj->prof[s].ns);
+      memcpy((void *) ptr, (void *) &network_64bit, sizeof(uint64_t));
+      ptr += sizeof(uint64_t);
+      network_64bit = esl_hton64(obj->prof[s].ncells);
+      memcpy((void *) ptr, (void *) &network_64bit, sizeof(uint64_t));
+      ptr += sizeof(uint64_t);
+    }
+
+  *n = ptr - *buf;
+  return(eslOK);
+
+ERROR:
+  return(eslEMEM);
+}
+
+
+/* Function:  p7_hmmd_search_stats_DeserializeProfile
+ * Synopsis:  Deserializes the pipeline profile of a HMMD_SEARCH_STATS object
+ *
+ * Purpose:   Reads a pipeline profile serialized by p7_hmmd_search_stats_SerializeProfile() from
+ *            buf, starting at position *n, into ret_obj->prof.
+ *
+ * Returns:   On success: returns eslOK, and updates *n to point to the position after the profile.
+ *
+ * Throws:    Returns eslEINVAL if buf, n or ret_obj is NULL.
+ */
+extern int p7_hmmd_search_stats_DeserializeProfile(const uint8_t *buf, uint32_t *n, HMMD_SEARCH_STATS *ret_obj){
+  const uint8_t *ptr;
+  uint64_t network_64bit;
+  int s;
+
+  if ((buf == NULL) || (ret_obj == NULL) || (n == NULL)){
+      return(eslEINVAL);
+  }
+
+  ptr = buf + *n;
+  for (s = 0; s < p7_PLI_NSTAGES; s++)
+    {
+      memcpy(&network_64bit, ptr, sizeof(uint64_t));
+      ret_obj->prof[s].ncalls = esl_ntoh64(network_64bit);
+      ptr += sizeof(uint64_t);
+      memcpy(&network_64bit, ptr, sizeof(uint64_t));
+      ret_obj->prof[s].ns     = esl_ntoh64(network_64bit);
+      ptr += sizeof(uint64_t);
+      memcpy(&network_64bit, ptr, sizeof(uint64_t));
+      ret_obj->prof[s].ncells = esl_ntoh64(network_64bit);
+      ptr += sizeof(uint64_t);
+    }
+
+  *n = ptr - buf;
+  return eslOK;
+}
+
 /*****************************************************************
  * 2. Unit tests
  *****************************************************************/      
@@ -405,6 +505,7 @@ ERROR:
  * HMMD_SEARCH_STATS objects.
  */
 static int hmmd_search_stats_Same(const HMMD_SEARCH_STATS *first, const HMMD_SEARCH_STATS *second){
+  int s;
   if((first == NULL)||(second==NULL)){ // we've been passed bad pointers
     return eslFAIL;
   }
@@ -474,6 +575,14 @@ static int hmmd_search_stats_Same(const HMMD_SEARCH_STATS *first, const HMMD_SEA
     return eslFAIL;
   }
 
+  for (s = 0; s < p7_PLI_NSTAGES; s++){
+    if(first->prof[s].ncalls != second->prof[s].ncalls ||
+       first->prof[s].ns     != second->prof[s].ns     ||
+       first->prof[s].ncells != second->prof[s].ncells){
+      return eslFAIL;
+    }
+  }
+
   if(((first->hit_offsets != NULL) && (second->hit_offsets == NULL)) ||
       ((first->hit_offsets == NULL) && (second->hit_offsets != NULL))){ // one object has a hit_offsets array and the other doesn't
     return eslFAIL;
@@ -551,6 +660,11 @@ utest_serialize()
       serial[i].nhits       = rand() % 10000; // keep the size of the hit_offsets array reasonable
       serial[i].nreported   = rand();
       serial[i].nincluded   = rand();
+      for (j = 0; j < p7_PLI_NSTAGES; j++){
+	serial[i].prof[j].ncalls = rand();
+	serial[i].prof[j].ns     = (((uint64_t) rand()) << 32) + ((uint64_t) rand());
+	serial[i].prof[j].ncells = (((uint64_t) rand()) << 32) + ((uint64_t) rand());
+      }
 
       if ((rand() % 2) == 0){ // 50% chance of hit_offsets array
 	ESL_ALLOC(serial[i].hit_offsets, serial[i].nhits * sizeof(uint64_t));
@@ -561,6 +675,9 @@ utest_serialize()
       else serial[i].hit_offsets = NULL;
 
       if (p7_hmmd_search_stats_Serialize(&(serial[i]), buffer, &pos, &buffer_size) != eslOK) esl_fatal(msg);
+
+      // as a worker does with --profile, the profile follows (here, for half of them)
+      if ((i % 2) == 0 && p7_hmmd_search_stats_SerializeProfile(&(serial[i]), buffer, &pos, &buffer_size) != eslOK) esl_fatal(msg);
     }
   
   // Should now have 100 serialized structures in buffer
@@ -569,6 +686,10 @@ utest_serialize()
   for (i = 0; i < 100; i++)
     {
       if (p7_hmmd_search_stats_Deserialize(*buffer, &pos, deserial) != eslOK) esl_fatal(msg);
+      if ((i % 2) == 0) {
+        if (p7_hmmd_search_stats_DeserializeProfile(*buffer, &pos, deserial) != eslOK) esl_fatal(msg);
+      }
+      else memset(serial[i].prof, 0, sizeof(P7_PLI_PROFILE) * p7_PLI_NSTAGES); // Deserialize() zeroes it
       if (hmmd_search_stats_Same(&(serial[i]), deserial)            != eslOK) esl_fatal(msg);
     }
 
@@ -614,6 +735,7 @@ utest_serialize_error_conditions()
   foo.nhits       = 7;
   foo.nreported   = 8;
   foo.nincluded   = 9;
+  memset(foo.prof, 0, sizeof(foo.prof));
   foo.hit_offsets = NULL;
 
   // Test 1: _Serialize returns error if passed NULL buffer
@@ -686,6 +808,7 @@ utest_deserialize_error_conditions()
   foo.nhits = 7;
   foo.nreported = 8;
   foo.nincluded = 9;
+  memset(foo.prof, 0, sizeof(foo.prof));
   foo.hit_offsets = NULL;
 
   // Test 1: should return eslEINVAL if buf == NULL
@@ -16,6 +16,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
 
 #ifdef HMMER_THREADS
 #include <pthread.h>
@@ -179,6 +182,11 @@ p7_hmmfile_OpenBuffer(const char *buffer, int size, P7_HMMFILE **ret_hfp)
   hfp->efp          = NULL;
   hfp->ffp          = NULL;
   hfp->pfp          = NULL;
+  hfp->fmap         = NULL;
+  hfp->fmapsize     = 0;
+  hfp->fmapoff      = 0;
+  hfp->pmap         = NULL;
+  hfp->pmapsize     = 0;
   hfp->ssi          = NULL;
   hfp->errbuf[0]    = '\0';
   hfp->rr_errbuf[0] = '\0';
@@ -249,6 +257,11 @@ open_engine(const char *filename, char *env, P7_HMMFILE **ret_hfp, int do_ascii_
   hfp->efp          = NULL;
   hfp->ffp          = NULL;
   hfp->pfp          = NULL;
+  hfp->fmap         = NULL;
+  hfp->fmapsize     = 0;
+  hfp->fmapoff      = 0;
+  hfp->pmap         = NULL;
+  hfp->pmapsize     = 0;
   hfp->ssi          = NULL;
   hfp->errbuf[0]    = '\0';
   hfp->rr_errbuf[0] = '\0';
@@ -438,6 +451,10 @@ p7_hmmfile_Close(P7_HMMFILE *hfp)
   if (!hfp->do_gzip && !hfp->do_stdin && hfp->f != NULL) fclose(hfp->f);
   if (hfp->ffp   != NULL) fclose(hfp->ffp);
   if (hfp->pfp   != NULL) fclose(hfp->pfp);
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+  if (hfp->fmap  != NULL) munmap(hfp->fmap, hfp->fmapsize);
+  if (hfp->pmap  != NULL) munmap(hfp->pmap, hfp->pmapsize);
+#endif
   if (hfp->fname != NULL) free(hfp->fname);
   if (hfp->efp   != NULL) esl_fileparser_Destroy(hfp->efp);
   if (hfp->ssi   != NULL) esl_ssi_Close(hfp->ssi);
@@ -8,9 +8,12 @@
  */
 #include <p7_config.h>
 
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h> 
+#include <time.h>
+#include <sys/time.h>
 
 #include "easel.h"
 #include "esl_exponential.h"
@@ -106,6 +109,11 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
 
   pli->do_alignment_score_calc = 0;
   pli->long_targets = long_targets;
+  pli->ssv_fail     = NULL;
+  pli->ssv_key      = NULL;
+  pli->order        = NULL;
+  pli->ssv_nalloc   = 0;
+  pli->cfgL         = -1;
 
   if ((pli->fwd = p7_omx_Create(M_hint, L_hint, L_hint)) == NULL) goto ERROR;
   if ((pli->bck = p7_omx_Create(M_hint, L_hint, L_hint)) == NULL) goto ERROR;
@@ -247,6 +255,9 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
   pli->mode            = mode;
   pli->show_accessions = (go && esl_opt_GetBoolean(go, "--acc")   ? TRUE  : FALSE);
   pli->show_alignments = (go && esl_opt_GetBoolean(go, "--noali") ? FALSE : TRUE);
+  pli->report_thr      = 1;
+  pli->do_profile      = FALSE;
+  memset(pli->prof, 0, sizeof(P7_PLI_PROFILE) * p7_PLI_NSTAGES);
   pli->hfp             = NULL;
   pli->errbuf[0]       = '\0';
 
@@ -297,6 +308,9 @@ p7_pipeline_Destroy(P7_PIPELINE *pli)
   p7_omx_Destroy(pli->bck);
   esl_randomness_Destroy(pli->r);
   p7_domaindef_Destroy(pli->ddef);
+  if (pli->ssv_fail) free(pli->ssv_fail);
+  if (pli->ssv_key)  free(pli->ssv_key);
+  if (pli->order)    free(pli->order);
   free(pli);
 }
 /*---------------- end, P7_PIPELINE object ----------------------*/
@@ -498,6 +512,7 @@ p7_pli_NewModel(P7_PIPELINE *pli, const P7_OPROFILE *om, P7_BG *bg)
   if (pli->Z_setby == p7_ZSETBY_NTARGETS && pli->mode == p7_SCAN_MODELS) pli->Z = pli->nmodels;
 
   if (pli->do_biasfilter) p7_bg_SetFilter(bg, om->M, om->compo);
+  pli->cfgL = -1;		/* new model, or SetFilter() reset <bg>'s filter length */
 
   if (pli->mode == p7_SEARCH_SEQS)
     status = p7_pli_NewModelThresholds(pli, om);
@@ -598,6 +613,330 @@ p7_pli_NewSeq(P7_PIPELINE *pli, const ESL_SQ *sq)
   // and ignore anything having to do with nseqs.
 }
 
+/* Function:  p7_pli_SetLength()
+ * Synopsis:  Set target length of <om>,<bg>, unless they're already set.
+ *
+ * Purpose:   Before running <p7_Pipeline()> in search mode on a target
+ *            sequence of length <L>, set the length models of the
+ *            query <om> and the null model <bg>, the same as calling
+ *            <p7_bg_SetLength(bg, L)> and
+ *            <p7_oprofile_ReconfigLength(om, L)>; but skip both if
+ *            the last call on this <pli> already set them for <L>.
+ *            <p7_Pipeline()> in search mode leaves the length
+ *            configuration of <om> and <bg> as it found them, so
+ *            consecutive targets of the same length (see
+ *            <p7_pli_SortByLength()>) need only one reconfiguration.
+ *
+ *            The caller must use the same <om> and <bg> with <pli>
+ *            throughout, and must not reconfigure their lengths some
+ *            other way between calls. <p7_pli_NewModel()> and
+ *            <p7_pli_SSVBlock()> forget the cached length.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_pli_SetLength(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, int L)
+{
+  if (L != pli->cfgL)
+    {
+      p7_bg_SetLength(bg, L);
+      p7_oprofile_ReconfigLength(om, L);
+      pli->cfgL = L;
+    }
+  return eslOK;
+}
+
+/* profile_stage()
+ * If <pli> is profiling, charge the time since <*t> and <ncells> DP
+ * cells to pipeline stage <stage>, and restart the clock at <*t> for
+ * the next stage.
+ */
+static void
+profile_stage(P7_PIPELINE *pli, int stage, uint64_t *t, uint64_t ncells)
+{
+  uint64_t now;
+
+  if (! pli->do_profile) return;
+  now = p7_pli_Clock();
+  pli->prof[stage].ncalls++;
+  pli->prof[stage].ns     += now - *t;
+  pli->prof[stage].ncells += ncells;
+  *t = now;
+}
+
+/* profile_time(), profile_count()
+ * The two halves of profile_stage(), for the SSV prefilters, which
+ * work on many targets at once but only learn afterwards which of
+ * them p7_Pipeline() won't see: charge the time since <*t> to
+ * <stage> and restart the clock; and count one call of <stage> on
+ * <ncells> DP cells.
+ */
+static void
+profile_time(P7_PIPELINE *pli, int stage, uint64_t *t)
+{
+  uint64_t now;
+
+  if (! pli->do_profile) return;
+  now = p7_pli_Clock();
+  pli->prof[stage].ns += now - *t;
+  *t = now;
+}
+
+static void
+profile_count(P7_PIPELINE *pli, int stage, uint64_t ncells)
+{
+  if (! pli->do_profile) return;
+  pli->prof[stage].ncalls++;
+  pli->prof[stage].ncells += ncells;
+}
+
+static int
+ssv_key_compare(const void *a, const void *b)
+{
+  int64_t ka = *(const int64_t *) a;
+  int64_t kb = *(const int64_t *) b;
+  return (ka > kb) - (ka < kb);
+}
+
+static int
+grow_blockwork(P7_PIPELINE *pli, int nseq)
+{
+  int status;
+
+  if (nseq > pli->ssv_nalloc) {
+    ESL_REALLOC(pli->ssv_fail, sizeof(char)    * nseq);
+    ESL_REALLOC(pli->ssv_key,  sizeof(int64_t) * nseq);
+    ESL_REALLOC(pli->order,    sizeof(int)     * nseq);
+    pli->ssv_nalloc = nseq;
+  }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* Function:  p7_pli_SortByLength()
+ * Synopsis:  Order a block of target seqs by length.
+ *
+ * Purpose:   Set <pli->order[0..nseq-1]> to the indices of the target
+ *            sequences <sq[0..nseq-1]> in order of increasing length,
+ *            ties in their original order. A caller that runs
+ *            <p7_Pipeline()> on the block in this order, using
+ *            <p7_pli_SetLength()>, reconfigures the length of the
+ *            query and null model only once per distinct length in
+ *            the block. Hit lists are sorted at the end anyway, so
+ *            results are the same as in the original order.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_pli_SortByLength(P7_PIPELINE *pli, const ESL_SQ *sq, int nseq)
+{
+  int i;
+  int status;
+
+  if ((status = grow_blockwork(pli, nseq)) != eslOK) return status;
+
+  for (i = 0; i < nseq; i++)
+    pli->ssv_key[i] = (sq[i].n << 32) | i;
+  qsort(pli->ssv_key, nseq, sizeof(int64_t), ssv_key_compare);
+  for (i = 0; i < nseq; i++)
+    pli->order[i] = (int) (pli->ssv_key[i] & 0xffffffff);
+  return eslOK;
+}
+
+/* Function:  p7_pli_SSVBlock()
+ * Synopsis:  Inter-sequence SSV prefilter for a block of target seqs.
+ *
+ * Purpose:   In search mode, before running <p7_Pipeline()> on each of
+ *            the <nseq> target sequences <sq[0..nseq-1]> in turn,
+ *            score them all against the query <om> with the
+ *            inter-sequence SSV filter, which does up to
+ *            <p7O_ISSV_LANES> sequences at once. For a short query
+ *            this is much faster than the striped filter, and the
+ *            sequences that fail (most of them) don't need the rest of
+ *            the per-sequence setup either.
+ *
+ *            On return, <pli->ssv_fail[i]> is TRUE if sequence <i>
+ *            certainly fails the MSV filter threshold F1; the caller
+ *            skips <p7_Pipeline()> for it, but still counts it with
+ *            <p7_pli_NewSeq()>. Sequences that pass, or for which the
+ *            SSV shortcut is inconclusive, get FALSE and go through
+ *            <p7_Pipeline()> as usual, which recalculates their filter
+ *            score with the striped filter. Results are exactly the
+ *            same as running <p7_Pipeline()> on every sequence.
+ *
+ *            The lanes of one batch run for the longest sequence in
+ *            it, so the block is batched in order of length.
+ *
+ *            Uses <bg> and the MSV length configuration of <om> as
+ *            workspace; the caller sets both for each sequence it
+ *            runs <p7_Pipeline()> on anyway.
+ *
+ * Returns:   <eslOK> if <pli->ssv_fail[0..nseq-1]> are set.
+ *            <eslENORESULT> if the prefilter doesn't apply: not in
+ *            search mode, no filtering (<--max>), a query longer than
+ *            <p7O_ISSV_MAXM>, or no inter-sequence kernel for this
+ *            processor. The caller runs <p7_Pipeline()> on every
+ *            sequence.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_pli_SSVBlock(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, int nseq)
+{
+#if defined (eslENABLE_SSE)
+  const ESL_DSQ *dsq[p7O_ISSV_LANES];
+  int            L[p7O_ISSV_LANES];
+  uint16_t       xE[p7O_ISSV_LANES];
+  int            idx[p7O_ISSV_LANES];
+  float          usc, nullsc, seq_score;
+  double         P;
+  uint64_t       t = 0;
+  int            nsort;		/* # of seqs we try: those the pipeline would take */
+  int            i, j, s, n;
+  int            status;
+
+  if (pli->mode != p7_SEARCH_SEQS || pli->long_targets) return eslENORESULT;
+  if (pli->F1 >= 1.0 || om->M > p7O_ISSV_MAXM)         return eslENORESULT;
+  if ((status = grow_blockwork(pli, nseq)) != eslOK)   return status;
+  pli->cfgL = -1;		/* we use <bg>, <om> lengths as workspace */
+
+  /* Sort by length, carrying the index in the low 32 bits. Lengths
+   * that p7_Pipeline() rejects or skips are left to it.
+   */
+  for (nsort = 0, i = 0; i < nseq; i++)
+    {
+      pli->ssv_fail[i] = FALSE;
+      if (sq[i].n > 0 && sq[i].n <= 100000)
+	pli->ssv_key[nsort++] = (sq[i].n << 32) | i;
+    }
+  qsort(pli->ssv_key, nsort, sizeof(int64_t), ssv_key_compare);
+
+  for (j = 0; j < nsort; j += n)
+    {
+      n = ESL_MIN(p7O_ISSV_LANES, nsort - j);
+      for (s = 0; s < n; s++) {
+	idx[s] = (int) (pli->ssv_key[j+s] & 0xffffffff);
+	dsq[s] = sq[idx[s]].dsq;
+	L[s]   = sq[idx[s]].n;
+      }
+
+      if (pli->do_profile) t = p7_pli_Clock();
+      status = p7_SSVFilter_Batch(dsq, L, n, om, xE);
+      if      (status == eslENORESULT) return eslENORESULT;
+      else if (status != eslOK)        return status;
+      profile_time(pli, p7_PLI_MSV, &t);
+
+      /* same score and F1 test as the start of p7_Pipeline(); a target
+       * that fails is charged to the null and MSV stages here, since
+       * p7_Pipeline() won't see it.
+       */
+      for (s = 0; s < n; s++)
+	{
+	  p7_bg_SetLength(bg, L[s]);
+	  p7_bg_NullOne  (bg, dsq[s], L[s], &nullsc);
+	  profile_time(pli, p7_PLI_NULLONE, &t);
+	  p7_oprofile_ReconfigMSVLength(om, L[s]);
+	  status = p7_SSVFilter_Finish(om, xE[s], &usc);
+	  profile_time(pli, p7_PLI_MSV, &t);
+	  if (status != eslOK) continue;
+
+	  seq_score = (usc - nullsc) / eslCONST_LOG2;
+	  P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
+	  if (P > pli->F1)
+	    {
+	      pli->ssv_fail[idx[s]] = TRUE;
+	      profile_count(pli, p7_PLI_NULLONE, L[s]);
+	      profile_count(pli, p7_PLI_MSV,     (uint64_t) om->M * L[s]);
+	    }
+	}
+    }
+  return eslOK;
+#else
+  return eslENORESULT;
+#endif
+}
+
+#if defined (eslENABLE_SSE)
+/* Function:  p7_pli_SSVPack()
+ * Synopsis:  Multi-model SSV prefilter for a pack of profiles.
+ *
+ * Purpose:   In a scan pipeline, score target sequence <sq> against
+ *            the <pk->n> profiles <om[0..pk->n-1]>, which are
+ *            interleaved in that order in pack <pk>, with the
+ *            multi-model SSV filter: one pass over <sq> for all of
+ *            them.
+ *
+ *            On return, <pli->ssv_fail[s]> is TRUE if profile <s>
+ *            certainly fails the MSV filter threshold F1; the caller
+ *            skips <p7_Pipeline()> for it, but still counts it with
+ *            <p7_pli_NewModel()>. Profiles that pass, or for which
+ *            the SSV shortcut is inconclusive, get FALSE and go
+ *            through <p7_Pipeline()> as usual. Results are exactly
+ *            the same as running <p7_Pipeline()> on every profile.
+ *
+ *            Uses <bg> and the MSV length configuration of each
+ *            <om[s]> as workspace; the caller sets both for each
+ *            profile it runs <p7_Pipeline()> on anyway.
+ *
+ * Returns:   <eslOK> if <pli->ssv_fail[0..pk->n-1]> are set.
+ *            <eslENORESULT> if the prefilter doesn't apply: not in
+ *            scan mode, no filtering (<--max>), or a target length
+ *            that <p7_Pipeline()> skips or rejects. The caller runs
+ *            <p7_Pipeline()> on every profile.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_pli_SSVPack(P7_PIPELINE *pli, P7_OPROFILE **om, P7_OM_PACK *pk, P7_BG *bg, const ESL_SQ *sq)
+{
+  uint16_t  xE[p7O_PACK_LANES];
+  float     usc, nullsc, seq_score;
+  double    P;
+  uint64_t  t = 0;
+  int       s;
+  int       status;
+
+  if (pli->mode != p7_SCAN_MODELS || pli->long_targets) return eslENORESULT;
+  if (pli->F1 >= 1.0 || sq->n == 0 || sq->n > 100000)  return eslENORESULT;
+
+  if ((status = grow_blockwork(pli, pk->n)) != eslOK) return status;
+  if (pli->do_profile) t = p7_pli_Clock();
+  if ((status = p7_SSVFilter_Pack(sq->dsq, sq->n, pk, xE)) != eslOK) return status;
+  profile_time(pli, p7_PLI_MSV, &t);
+  pli->cfgL = -1;
+
+  /* same score and F1 test as the start of p7_Pipeline(); a profile
+   * that fails is charged to the null and MSV stages here, since
+   * p7_Pipeline() won't see it.
+   */
+  p7_bg_SetLength(bg, sq->n);
+  p7_bg_NullOne  (bg, sq->dsq, sq->n, &nullsc);
+  profile_time(pli, p7_PLI_NULLONE, &t);
+  for (s = 0; s < pk->n; s++)
+    {
+      pli->ssv_fail[s] = FALSE;
+      p7_oprofile_ReconfigMSVLength(om[s], sq->n);
+      status = p7_SSVFilter_Finish(om[s], xE[s], &usc);
+      profile_time(pli, p7_PLI_MSV, &t);
+      if (status != eslOK) continue;
+
+      seq_score = (usc - nullsc) / eslCONST_LOG2;
+      P = esl_gumbel_surv(seq_score,  om[s]->evparam[p7_MMU],  om[s]->evparam[p7_MLAMBDA]);
+      if (P > pli->F1)
+	{
+	  pli->ssv_fail[s] = TRUE;
+	  profile_count(pli, p7_PLI_NULLONE, sq->n);
+	  profile_count(pli, p7_PLI_MSV,     (uint64_t) om[s]->M * sq->n);
+	}
+    }
+  return eslOK;
+}
+#endif /*eslENABLE_SSE*/
+
 /* Function:  p7_pipeline_Merge()
  * Synopsis:  Merge the pipeline statistics
  *
@@ -617,6 +956,8 @@ p7_pli_NewSeq(P7_PIPELINE *pli, const ESL_SQ *sq)
 int
 p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
 {
+  int s;
+
   /* if we are searching a sequence database, we need to keep track of the
    * number of sequences and residues processed.
    */
@@ -643,6 +984,13 @@ p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
   p1->pos_past_fwd  += p2->pos_past_fwd;
   p1->pos_output    += p2->pos_output;
 
+  for (s = 0; s < p7_PLI_NSTAGES; s++)
+    {
+      p1->prof[s].ncalls += p2->prof[s].ncalls;
+      p1->prof[s].ns     += p2->prof[s].ns;
+      p1->prof[s].ncells += p2->prof[s].ncells;
+    }
+
   if (p1->Z_setby == p7_ZSETBY_NTARGETS)
     {
       p1->Z += (p1->mode == p7_SCAN_MODELS) ? p2->nmodels : p2->nseqs;
@@ -655,122 +1003,156 @@ p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
   return eslOK;
 }
 
-/* Function:  p7_Pipeline()
- * Synopsis:  HMMER3's accelerated seq/profile comparison pipeline.
- *
- * Purpose:   Run H3's accelerated pipeline to compare profile <om>
- *            against sequence <sq>. If a significant hit is found,
- *            information about it is added to the <hitlist>. The pipeline 
- *            accumulates beancounting information about how many comparisons
- *            flow through the pipeline while it's active.
- *            
- * Returns:   <eslOK> on success. If a significant hit is obtained,
- *            its information is added to the growing <hitlist>. 
- *            
- *            <eslEINVAL> if (in a scan pipeline) we're supposed to
- *            set GA/TC/NC bit score thresholds but the model doesn't
- *            have any.
- *            
- *            <eslERANGE> on numerical overflow errors in the
- *            optimized vector implementations; particularly in
- *            posterior decoding. I don't believe this is possible for
- *            multihit local models, but I'm set up to catch it
- *            anyway. We may emit a warning to the user, but cleanly
- *            skip the problematic sequence and continue.
- *
- * Throws:    <eslEMEM> on allocation failure.
- *
- *            <eslETYPE> if <sq> is more than 100K long, which can
- *            happen when someone uses hmmsearch/hmmscan instead of
- *            nhmmer/nhmmscan on a genome DNA seq db.
- *
- * Xref:      J4/25.
- *
- * Note:      Error handling needs improvement. The <eslETYPE> exception
- *            was added as a late bugfix. It really should be an <eslEINVAL>
- *            normal error (because it's a user error). But then we need
- *            all our p7_Pipeline() calls to check their return status
- *            and handle normal errors appropriately, which we haven't 
- *            been careful enough about. [SRE H9/4]
+/* pipeline_filters()
+ * The acceleration filters at the start of p7_Pipeline(), through
+ * the Forward parser. Returns <eslOK> if <sq> passes them all, with
+ * its null model score in <*ret_nullsc>, its Forward score in
+ * <*ret_fwdsc>, and its Forward parser matrix in <pli->oxf>; or
+ * <eslFAIL> if it is filtered out. Other returns and exceptions are
+ * those of p7_Pipeline().
  */
-int
-p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_TOPHITS *hitlist)
+static int
+pipeline_filters(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, float *ret_nullsc, float *ret_fwdsc)
 {
-  P7_HIT          *hit     = NULL;     /* ptr to the current hit output data      */
   float            usc, vfsc, fwdsc;   /* filter scores                           */
   float            filtersc;           /* HMM null filter score                   */
   float            nullsc;             /* null model score                        */
-  float            seqbias;  
-  float            seq_score;          /* the corrected per-seq bit score */
-  float            sum_score;           /* the corrected reconstruction score for the seq */
-  float            pre_score, pre2_score; /* uncorrected bit scores for seq */
-  double           P;                /* P-value of a hit */
-  double           lnP;              /* log P-value of a hit */
-  int              Ld;               /* # of residues in envelopes */
-  int              d;
+  float            seq_score;          /* filter bit score                        */
+  double           P;                  /* P-value of a filter score               */
+  uint64_t         ML  = (uint64_t) om->M * sq->n;   /* DP cells, for profiling */
+  uint64_t         t;
   int              status;
   
-  if (sq->n == 0) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
+  if (sq->n == 0) return eslFAIL;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
   if (sq->n > 100000) ESL_EXCEPTION(eslETYPE, "Target sequence length > 100K, over comparison pipeline limit.\n(Did you mean to use nhmmer/nhmmscan?)");
 
   p7_omx_GrowTo(pli->oxf, om->M, 0, sq->n);    /* expand the one-row omx if needed */
+  t = pli->do_profile ? p7_pli_Clock() : 0;
 
   /* Base null model score (we could calculate this in NewSeq(), for a scan pipeline) */
   p7_bg_NullOne  (bg, sq->dsq, sq->n, &nullsc);
+  profile_stage(pli, p7_PLI_NULLONE, &t, sq->n);
 
   /* First level filter: the MSV filter, multihit with <om> */
   p7_MSVFilter(sq->dsq, sq->n, om, pli->oxf, &usc);
+  profile_stage(pli, p7_PLI_MSV, &t, ML);
   seq_score = (usc - nullsc) / eslCONST_LOG2;
   P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
-  if (P > pli->F1) return eslOK;
+  if (P > pli->F1) return eslFAIL;
   pli->n_past_msv++;
 
   /* biased composition HMM filtering */
   if (pli->do_biasfilter)
     {
       p7_bg_FilterScore(bg, sq->dsq, sq->n, &filtersc);
+      profile_stage(pli, p7_PLI_BIAS, &t, sq->n);
       seq_score = (usc - filtersc) / eslCONST_LOG2;
       P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
-      if (P > pli->F1) return eslOK;
+      if (P > pli->F1) return eslFAIL;
     }
   else filtersc = nullsc;
   pli->n_past_bias++;
 
-  /* In scan mode, if it passes the MSV filter, read the rest of the profile */
+  /* In scan mode, if it passes the MSV filter, read the rest of the profile,
+   * unless an earlier query in an hmmscan --qbatch batch already did.
+   */
   if (pli->mode == p7_SCAN_MODELS)
     {
-      if (pli->hfp) p7_oprofile_ReadRest(pli->hfp, om);
+      if (pli->hfp && om->base_w == 0 && om->scale_w == 0) p7_oprofile_ReadRest(pli->hfp, om);
       p7_oprofile_ReconfigRestLength(om, sq->n);
       if ((status = p7_pli_NewModelThresholds(pli, om)) != eslOK) return status; /* pli->errbuf has err msg set */
     }
+  if (pli->do_profile) t = p7_pli_Clock(); /* reading the profile isn't a filter's time */
 
   /* Second level filter: ViterbiFilter(), multihit with <om> */
   if (P > pli->F2)
     {
       p7_ViterbiFilter(sq->dsq, sq->n, om, pli->oxf, &vfsc);  
+      profile_stage(pli, p7_PLI_VIT, &t, ML);
       seq_score = (vfsc-filtersc) / eslCONST_LOG2;
       P  = esl_gumbel_surv(seq_score,  om->evparam[p7_VMU],  om->evparam[p7_VLAMBDA]);
-      if (P > pli->F2) return eslOK;
+      if (P > pli->F2) return eslFAIL;
     }
   pli->n_past_vit++;
 
 
   /* Parse it with Forward and obtain its real Forward score. */
   p7_ForwardParser(sq->dsq, sq->n, om, pli->oxf, &fwdsc);
+  profile_stage(pli, p7_PLI_FWD, &t, ML);
   seq_score = (fwdsc-filtersc) / eslCONST_LOG2;
   P = esl_exp_surv(seq_score,  om->evparam[p7_FTAU],  om->evparam[p7_FLAMBDA]);
-  if (P > pli->F3) return eslOK;
+  if (P > pli->F3) return eslFAIL;
   pli->n_past_fwd++;
 
+  *ret_nullsc = nullsc;
+  *ret_fwdsc  = fwdsc;
+  return eslOK;
+}
+
+/* drop_domains()
+ * The domains in <ddef> won't be reported. If their alignment
+ * displays were made in <arena>, give that space back (and forget
+ * the pointers to it, so p7_domaindef_Reuse() doesn't free them);
+ * else p7_domaindef_Reuse() frees them as usual.
+ */
+static void
+drop_domains(P7_DOMAINDEF *ddef, P7_ARENA *arena)
+{
+  int d;
+
+  if (! arena) return;
+  for (d = 0; d < ddef->ndom; d++) ddef->dcl[d].ad = NULL;
+  p7_arena_Rewind(arena);
+}
+
+/* pipeline_postprocess()
+ * The rest of p7_Pipeline(), for a target <sq> that passed
+ * pipeline_filters() with null score <nullsc> and Forward score
+ * <fwdsc>, and whose Forward parser matrix is in <pli->oxf>: domain
+ * definition, scoring, and adding the hit to <hitlist>.
+ */
+static int
+pipeline_postprocess(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, float nullsc, float fwdsc, P7_TOPHITS *hitlist)
+{
+  P7_HIT          *hit     = NULL;     /* ptr to the current hit output data      */
+  float            seqbias;  
+  float            seq_score;          /* the corrected per-seq bit score */
+  float            sum_score;           /* the corrected reconstruction score for the seq */
+  float            pre_score, pre2_score; /* uncorrected bit scores for seq */
+  double           lnP;              /* log P-value of a hit */
+  double           sortkey;          /* its rank in the hit list */
+  int              Ld;               /* # of residues in envelopes */
+  int              d;
+  uint64_t         ML  = (uint64_t) om->M * sq->n;   /* DP cells, for profiling */
+  uint64_t         t, tsub;
+  int              status;
+
   /* ok, it's for real. Now a Backwards parser pass, and hand it to domain definition workflow */
   p7_omx_GrowTo(pli->oxb, om->M, 0, sq->n);
+  t = pli->do_profile ? p7_pli_Clock() : 0;
   p7_BackwardParser(sq->dsq, sq->n, om, pli->oxf, pli->oxb, NULL);
+  profile_stage(pli, p7_PLI_BCK, &t, ML);
 
+  /* Alignment displays are made in the hit list's arena, where a
+   * reported hit keeps them; if the target isn't reported, we rewind.
+   */
+  p7_arena_Mark(hitlist->arena);
+  pli->ddef->arena = hitlist->arena;
+  pli->ddef->prof  = pli->do_profile ? pli->prof : NULL;
+  tsub             = pli->prof[p7_PLI_NULL2].ns + pli->prof[p7_PLI_ALIDISPLAY].ns;
   status = p7_domaindef_ByPosteriorHeuristics(sq, ntsq, om, pli->oxf, pli->oxb, pli->fwd, pli->bck, pli->ddef, bg, FALSE, NULL, NULL, NULL);
-  if (status != eslOK) ESL_FAIL(status, pli->errbuf, "domain definition workflow failure"); /* eslERANGE can happen  */
-  if (pli->ddef->nregions   == 0) return eslOK; /* score passed threshold but there's no discrete domains here       */
-  if (pli->ddef->nenvelopes == 0) return eslOK; /* rarer: region was found, stochastic clustered, no envelopes found */
-  if (pli->ddef->ndom       == 0) return eslOK; /* even rarer: envelope found, no domain identified {iss131}         */
+  pli->ddef->arena = NULL;
+  pli->ddef->prof  = NULL;
+  t += pli->prof[p7_PLI_NULL2].ns + pli->prof[p7_PLI_ALIDISPLAY].ns - tsub; /* domaindef timed those itself */
+  profile_stage(pli, p7_PLI_DOMDEF, &t, ML);
+  if (status != eslOK) { drop_domains(pli->ddef, hitlist->arena); ESL_FAIL(status, pli->errbuf, "domain definition workflow failure"); } /* eslERANGE can happen  */
+  if (pli->ddef->nregions   == 0 ||   /* score passed threshold but there's no discrete domains here       */
+      pli->ddef->nenvelopes == 0 ||   /* rarer: region was found, stochastic clustered, no envelopes found */
+      pli->ddef->ndom       == 0)     /* even rarer: envelope found, no domain identified {iss131}         */
+    {
+      drop_domains(pli->ddef, hitlist->arena);
+      return eslOK;
+    }
 
 
   /* Calculate the null2-corrected per-seq score */
@@ -832,20 +1214,23 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   /* Apply thresholding and determine whether to put this
    * target into the hit list. E-value thresholding may
    * only be a lower bound for now, so this list may be longer
-   * than eventually reported.
+   * than eventually reported. A bounded hit list may also turn
+   * it away, if it already holds enough better ones.
    */
-  lnP =  esl_exp_logsurv (seq_score,  om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA]);
-  if (p7_pli_TargetReportable(pli, seq_score, lnP))
+  lnP     = esl_exp_logsurv (seq_score,  om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA]);
+  sortkey = pli->inc_by_E ? -lnP : seq_score; /* per-seq output sorts on bit score if inclusion is by score  */
+  if (p7_pli_TargetReportable(pli, seq_score, lnP) && p7_tophits_Admit(hitlist, sortkey))
     {
       p7_tophits_CreateNextHit(hitlist, &hit);
+      hit->in_arena = (hitlist->arena != NULL);
       if (pli->mode == p7_SEARCH_SEQS) {
-        if (                       (status  = esl_strdup(sq->name, -1, &(hit->name)))  != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
-        if (sq->acc[0]  != '\0' && (status  = esl_strdup(sq->acc,  -1, &(hit->acc)))   != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
-        if (sq->desc[0] != '\0' && (status  = esl_strdup(sq->desc, -1, &(hit->desc)))  != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
+        if (                       (status  = p7_arena_Strdup(hitlist->arena, sq->name, -1, &(hit->name)))  != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
+        if (sq->acc[0]  != '\0' && (status  = p7_arena_Strdup(hitlist->arena, sq->acc,  -1, &(hit->acc)))   != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
+        if (sq->desc[0] != '\0' && (status  = p7_arena_Strdup(hitlist->arena, sq->desc, -1, &(hit->desc)))  != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
       } else {
-        if ((status  = esl_strdup(om->name, -1, &(hit->name)))  != eslOK) esl_fatal("allocation failure");
-        if ((status  = esl_strdup(om->acc,  -1, &(hit->acc)))   != eslOK) esl_fatal("allocation failure");
-        if ((status  = esl_strdup(om->desc, -1, &(hit->desc)))  != eslOK) esl_fatal("allocation failure");
+        if ((status  = p7_arena_Strdup(hitlist->arena, om->name, -1, &(hit->name)))  != eslOK) esl_fatal("allocation failure");
+        if ((status  = p7_arena_Strdup(hitlist->arena, om->acc,  -1, &(hit->acc)))   != eslOK) esl_fatal("allocation failure");
+        if ((status  = p7_arena_Strdup(hitlist->arena, om->desc, -1, &(hit->desc)))  != eslOK) esl_fatal("allocation failure");
       } 
       hit->ndom       = pli->ddef->ndom;
       hit->nexpected  = pli->ddef->nexpected;
@@ -859,7 +1244,7 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
 
       hit->score      = seq_score; /* BITS */
       hit->lnP        = lnP;
-      hit->sortkey    = pli->inc_by_E ? -lnP : seq_score; /* per-seq output sorts on bit score if inclusion is by score  */
+      hit->sortkey    = sortkey;
 
       hit->sum_score  = sum_score; /* BITS */
       hit->sum_lnP    = esl_exp_logsurv (hit->sum_score,  om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA]);
@@ -871,9 +1256,22 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
        * because we probably need to know # of significant
        * hits found to set domZ, and thence threshold and
        * count reported domains.
+       *
+       * With an arena, the domain list is copied into it, and
+       * <ddef> keeps its own list to reuse; the alignment displays
+       * are already there, and now belong to the hit.
        */
-      hit->dcl         = pli->ddef->dcl;
-      pli->ddef->dcl   = NULL;
+      if (hitlist->arena)
+	{
+	  if ((hit->dcl = p7_arena_Alloc(hitlist->arena, sizeof(P7_DOMAIN) * hit->ndom)) == NULL) ESL_EXCEPTION(eslEMEM, "allocation failure");
+	  memcpy(hit->dcl, pli->ddef->dcl, sizeof(P7_DOMAIN) * hit->ndom);
+	  for (d = 0; d < hit->ndom; d++) pli->ddef->dcl[d].ad = NULL;
+	}
+      else
+	{
+	  hit->dcl         = pli->ddef->dcl;
+	  pli->ddef->dcl   = NULL;
+	}
       hit->best_domain = 0;
       for (d = 0; d < hit->ndom; d++)
       {
@@ -929,14 +1327,140 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
           }
         }
       }
-	  
+
+      if (hitlist->maxhits && hitlist->N >= 2 * hitlist->maxhits &&
+	  (status = p7_tophits_Trim(hitlist)) != eslOK)
+	ESL_EXCEPTION(status, "failed to trim hit list");
     }
+  else drop_domains(pli->ddef, hitlist->arena);
 
   return eslOK;
 }
 
 
 
+/* Function:  p7_Pipeline()
+ * Synopsis:  HMMER3's accelerated seq/profile comparison pipeline.
+ *
+ * Purpose:   Run H3's accelerated pipeline to compare profile <om>
+ *            against sequence <sq>. If a significant hit is found,
+ *            information about it is added to the <hitlist>. The pipeline 
+ *            accumulates beancounting information about how many comparisons
+ *            flow through the pipeline while it's active.
+ *            
+ * Returns:   <eslOK> on success. If a significant hit is obtained,
+ *            its information is added to the growing <hitlist>. 
+ *            
+ *            <eslEINVAL> if (in a scan pipeline) we're supposed to
+ *            set GA/TC/NC bit score thresholds but the model doesn't
+ *            have any.
+ *            
+ *            <eslERANGE> on numerical overflow errors in the
+ *            optimized vector implementations; particularly in
+ *            posterior decoding. I don't believe this is possible for
+ *            multihit local models, but I'm set up to catch it
+ *            anyway. We may emit a warning to the user, but cleanly
+ *            skip the problematic sequence and continue.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ *
+ *            <eslETYPE> if <sq> is more than 100K long, which can
+ *            happen when someone uses hmmsearch/hmmscan instead of
+ *            nhmmer/nhmmscan on a genome DNA seq db.
+ *
+ * Xref:      J4/25.
+ *
+ * Note:      Error handling needs improvement. The <eslETYPE> exception
+ *            was added as a late bugfix. It really should be an <eslEINVAL>
+ *            normal error (because it's a user error). But then we need
+ *            all our p7_Pipeline() calls to check their return status
+ *            and handle normal errors appropriately, which we haven't 
+ *            been careful enough about. [SRE H9/4]
+ */
+int
+p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_TOPHITS *hitlist)
+{
+  float nullsc, fwdsc;
+  int   status;
+
+  status = pipeline_filters(pli, om, bg, sq, &nullsc, &fwdsc);
+  if      (status == eslFAIL) return eslOK;
+  else if (status != eslOK)   return status;
+
+  return pipeline_postprocess(pli, om, bg, sq, ntsq, nullsc, fwdsc, hitlist);
+}
+
+
+/* Function:  p7_pli_Filter()
+ * Synopsis:  The filter half of the pipeline, for a staged search.
+ *
+ * Purpose:   Run the acceleration filters of <p7_Pipeline()>, through
+ *            the Forward filter, comparing profile <om> to target
+ *            sequence <sq> in a search pipeline <pli>. The caller
+ *            has configured <om> and <bg> for the length of <sq>, as
+ *            for <p7_Pipeline()>.
+ *
+ *            A target that passes is handed, with its Forward score
+ *            <*ret_fwdsc>, to <p7_pli_Postprocess()>, which may be
+ *            run later, in another thread, with another pipeline and
+ *            a clone of <om>. This way a few targets with many
+ *            domains don't hold up the filtering of the rest (see
+ *            <p7_pstage.c>). Filter statistics are counted in <pli>.
+ *
+ * Returns:   <eslOK> if <sq> passes all the filters, and
+ *            <*ret_fwdsc> is its Forward score in nats.
+ *
+ *            <eslFAIL> if it is filtered out.
+ *
+ * Throws:    <eslETYPE> if <sq> is more than 100K long, as
+ *            <p7_Pipeline()>.
+ */
+int
+p7_pli_Filter(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, float *ret_fwdsc)
+{
+  float nullsc;
+
+  return pipeline_filters(pli, om, bg, sq, &nullsc, ret_fwdsc);
+}
+
+
+/* Function:  p7_pli_Postprocess()
+ * Synopsis:  The postprocessing half of the pipeline, for a staged search.
+ *
+ * Purpose:   Finish the comparison of profile <om> to target sequence
+ *            <sq>, which passed <p7_pli_Filter()> with Forward score
+ *            <fwdsc>, in pipeline <pli>: Backward, domain definition,
+ *            null2 corrections, and alignments; a significant hit is
+ *            added to <hitlist>, exactly as <p7_Pipeline()> would
+ *            have. The caller has configured <om> and <bg> for the
+ *            length of <sq>. <pli> and <om> need not be the ones
+ *            <p7_pli_Filter()> used, so long as they were created for
+ *            the same search.
+ *
+ *            The Backward parser needs the scale factors of the
+ *            Forward parser matrix, which this <pli> doesn't have, so
+ *            the Forward parser is rerun first. That costs about as
+ *            much as the Backward parser; postprocessing takes
+ *            several times that.
+ *
+ * Returns:   <eslOK> on success, and as <p7_Pipeline()>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_pli_Postprocess(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, float fwdsc, P7_TOPHITS *hitlist)
+{
+  float nullsc;
+
+  p7_omx_GrowTo(pli->oxf, om->M, 0, sq->n);
+  p7_bg_NullOne(bg, sq->dsq, sq->n, &nullsc);
+  p7_ForwardParser(sq->dsq, sq->n, om, pli->oxf, NULL);
+
+  return pipeline_postprocess(pli, om, bg, sq, ntsq, nullsc, fwdsc, hitlist);
+}
+
+
+
 /* Function:  p7_pli_computeAliScores()
  * Synopsis:  Compute per-position scores for the alignment for a domain
  *
@@ -1706,6 +2230,11 @@ ERROR:
 }
 
 
+/* Stage names in profile output, in p7_plistage_e order */
+static const char *pli_stagename[p7_PLI_NSTAGES] = {
+  "nullone", "msv", "bias", "viterbi", "forward", "backward", "domaindef", "null2", "alidisplay"
+};
+
 /* Function:  p7_pli_Statistics()
  * Synopsis:  Final statistics output from a processing pipeline.
  *
@@ -1716,12 +2245,17 @@ ERROR:
  *            stopwatch that was timing the pipeline, then the report
  *            includes timing information.
  *
+ *            If the pipeline was profiling (<pli->do_profile>), the
+ *            report includes the time, DP cells, and GCUPS of each
+ *            pipeline stage.
+ *
  * Returns:   <eslOK> on success.
  */
 int
 p7_pli_Statistics(FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w)
 {
   double ntargets; 
+  int    s;
 
   fprintf(ofp, "Internal pipeline statistics summary:\n");
   fprintf(ofp, "-------------------------------------\n");
@@ -1790,6 +2324,24 @@ p7_pli_Statistics(FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w)
       fprintf(ofp, "Domain search space  (domZ): %15.0f  %s\n", pli->domZ, pli->domZ_setby == p7_ZSETBY_OPTION ? "[as set by --domZ on cmdline]" : "[number of targets reported over threshold]");
   }
 
+  if (pli->npost_thr > 0) {	/* staged search: how well the two thread pools were balanced */
+      fprintf(ofp, "Filter threads:              %15d  (%" PRId64 " waits on a full queue)\n",
+          pli->nfilter_thr, pli->n_qfull);
+      fprintf(ofp, "Postprocessing threads:      %15d  (%" PRId64 " waits on an empty queue; at most %d targets queued)\n",
+          pli->npost_thr, pli->n_qempty, pli->qpeak);
+  }
+
+  if (pli->do_profile) {	/* per-stage profile: times are summed over threads */
+      fprintf(ofp, "Pipeline stage profile:      %15s  %12s  %12s  %8s\n", "calls", "seconds", "Mcells", "GCUPS");
+      for (s = 0; s < p7_PLI_NSTAGES; s++)
+        fprintf(ofp, "  %-26s %15" PRIu64 "  %12.3f  %12.1f  %8.3f\n",
+            pli_stagename[s],
+            pli->prof[s].ncalls,
+            (double) pli->prof[s].ns * 1e-9,
+            (double) pli->prof[s].ncells * 1e-6,
+            pli->prof[s].ns ? (double) pli->prof[s].ncells / (double) pli->prof[s].ns : 0.);
+  }
+
   if (w != NULL) {
     esl_stopwatch_Display(ofp, w, "# CPU time: ");
     fprintf(ofp, "# Mc/sec: %.2f\n", 
@@ -1798,6 +2350,156 @@ p7_pli_Statistics(FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w)
 
   return eslOK;
 }
+
+
+/* Function:  p7_pli_Clock()
+ * Synopsis:  Read the clock used to profile pipeline stages.
+ *
+ * Purpose:   Returns a wall clock time in nanoseconds, from some
+ *            arbitrary origin; only differences between two calls
+ *            mean anything. Uses a monotonic clock where the system
+ *            has one, else <gettimeofday()> (microsecond resolution).
+ */
+uint64_t
+p7_pli_Clock(void)
+{
+#if defined (HAVE_CLOCK_GETTIME) && defined (CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+#else
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (uint64_t) tv.tv_sec * 1000000000ULL + (uint64_t) tv.tv_usec * 1000ULL;
+#endif
+}
+
+
+/* json_append()
+ * Append printf-formatted text to the growing string <*s>, which
+ * holds <*n> chars (plus '\0') in an allocation of <*nalloc>.
+ */
+static int
+json_append(char **s, int *n, int *nalloc, const char *fmt, ...)
+{
+  va_list ap;
+  int     len;
+  int     status;
+
+  va_start(ap, fmt);
+  len = vsnprintf(*s + *n, *nalloc - *n, fmt, ap);
+  va_end(ap);
+  if (len < 0) ESL_EXCEPTION(eslESYS, "vsnprintf() failed");
+
+  if (*n + len >= *nalloc)
+    {
+      *nalloc = 2 * (*n + len + 1);
+      ESL_REALLOC(*s, sizeof(char) * *nalloc);
+      va_start(ap, fmt);
+      vsnprintf(*s + *n, *nalloc - *n, fmt, ap);
+      va_end(ap);
+    }
+  *n += len;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* Function:  p7_pli_ProfileJSON()
+ * Synopsis:  Format a pipeline's stage profile as one line of JSON.
+ *
+ * Purpose:   Format the per-stage profile of pipeline <pli>, after a
+ *            search with query <qname>, as a single JSON object on
+ *            one line: the query name, the number of targets and
+ *            residues (or nodes) compared, the elapsed time from
+ *            stopwatch <w> if it's non-<NULL>, and for each stage its
+ *            number of calls, nanoseconds, DP cells, and GCUPS
+ *            (billions of cells per second). Return the
+ *            <\0>-terminated string, without a newline, in
+ *            <*ret_json>; caller frees it.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <*ret_json> is
+ *            <NULL>.
+ */
+int
+p7_pli_ProfileJSON(const P7_PIPELINE *pli, const char *qname, const ESL_STOPWATCH *w, char **ret_json)
+{
+  char       *s      = NULL;
+  int         n      = 0;
+  int         nalloc = 1024;
+  const char *c;
+  int         st;
+  int         status;
+
+  ESL_ALLOC(s, sizeof(char) * nalloc);
+  s[0] = '\0';
+
+  if ((status = json_append(&s, &n, &nalloc, "{\"query\":\"")) != eslOK) goto ERROR;
+  for (c = (qname ? qname : ""); *c; c++)
+    {
+      if      (*c == '"' || *c == '\\') status = json_append(&s, &n, &nalloc, "\\%c", *c);
+      else if ((unsigned char) *c < 0x20) status = json_append(&s, &n, &nalloc, "\\u%04x", (unsigned char) *c);
+      else                                status = json_append(&s, &n, &nalloc, "%c", *c);
+      if (status != eslOK) goto ERROR;
+    }
+  if ((status = json_append(&s, &n, &nalloc, "\",\"mode\":\"%s\"", pli->mode == p7_SCAN_MODELS ? "scan" : "search")) != eslOK) goto ERROR;
+  if ((status = json_append(&s, &n, &nalloc, ",\"nmodels\":%" PRId64 ",\"nnodes\":%" PRId64 ",\"nseqs\":%" PRId64 ",\"nres\":%" PRId64,
+			    pli->nmodels, pli->nnodes, pli->nseqs, pli->nres)) != eslOK) goto ERROR;
+  if (w && (status = json_append(&s, &n, &nalloc, ",\"elapsed\":%.6f", w->elapsed)) != eslOK) goto ERROR;
+  if ((status = json_append(&s, &n, &nalloc, ",\"stages\":[")) != eslOK) goto ERROR;
+  for (st = 0; st < p7_PLI_NSTAGES; st++)
+    if ((status = json_append(&s, &n, &nalloc, "%s{\"stage\":\"%s\",\"calls\":%" PRIu64 ",\"ns\":%" PRIu64 ",\"cells\":%" PRIu64 ",\"gcups\":%.6g}",
+			      st ? "," : "",
+			      pli_stagename[st],
+			      pli->prof[st].ncalls,
+			      pli->prof[st].ns,
+			      pli->prof[st].ncells,
+			      pli->prof[st].ns ? (double) pli->prof[st].ncells / (double) pli->prof[st].ns : 0.)) != eslOK) goto ERROR;
+  if ((status = json_append(&s, &n, &nalloc, "]}")) != eslOK) goto ERROR;
+
+  *ret_json = s;
+  return eslOK;
+
+ ERROR:
+  free(s);
+  *ret_json = NULL;
+  return status;
+}
+
+/* Function:  p7_pli_WriteProfile()
+ * Synopsis:  Write a pipeline's stage profile as one line of JSON.
+ *
+ * Purpose:   Write the per-stage profile of pipeline <pli>, after a
+ *            search with query <qname>, to <ofp>: the JSON object of
+ *            <p7_pli_ProfileJSON()>, and a newline.
+ *
+ *            One line per query makes the output easy to stream to
+ *            other tools (<jq>, for example).
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslEWRITE> on a write
+ *            error.
+ */
+int
+p7_pli_WriteProfile(FILE *ofp, const char *qname, const P7_PIPELINE *pli, const ESL_STOPWATCH *w)
+{
+  char *json = NULL;
+  int   status;
+
+  if ((status = p7_pli_ProfileJSON(pli, qname, w, &json)) != eslOK) return status;
+  fputs(json, ofp);
+  fputc('\n', ofp);
+  free(json);
+
+  if (ferror(ofp)) ESL_EXCEPTION_SYS(eslEWRITE, "pipeline profile write failed");
+  return eslOK;
+}
 /*------------------- end, pipeline API -------------------------*/
 
 
@@ -0,0 +1,504 @@
+/* P7_PSTAGE: hands targets from filter threads to postprocessing
+ * threads, in a staged search.
+ *
+ * Most of the time of a search goes to the acceleration filters, and
+ * is spread evenly over the targets; the few targets that pass them
+ * cost far more each, in Backward, domain definition, null2, and
+ * alignment, most of all the ones with many domains. When a worker
+ * does both, as in p7_Pipeline(), a run of such targets stalls its
+ * filtering. In a staged search, filter threads run only
+ * p7_pli_Filter(), and push the targets that pass (a copy of the
+ * sequence, and its Forward score) onto a bounded queue; a separate
+ * pool of postprocessing threads pops them and runs
+ * p7_pli_Postprocess(). The two pools are sized independently, and
+ * the queue counts how often each one waited on the other, which
+ * p7_pli_Statistics() reports.
+ *
+ * Results are the same as an ordinary search: hit lists are sorted
+ * once everything is in, and domain definition reseeds its random
+ * number generator for each target.
+ *
+ * Contents:
+ *    1. The P7_PSTAGE object.
+ *    2. Unit tests.
+ *    3. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "easel.h"
+#include "esl_sq.h"
+
+#include "hmmer.h"
+#include "p7_pstage.h"
+
+#ifdef HMMER_THREADS
+
+/*****************************************************************
+ * 1. The P7_PSTAGE object.
+ *****************************************************************/
+
+/* Function:  p7_pstage_Create()
+ * Synopsis:  Create the queue between <nfilter> filter threads and <npost> postprocessing threads.
+ *
+ * Purpose:   Create an empty, open queue of targets, with room for
+ *            <p7_PSTAGE_DEPTH> of them per postprocessing thread.
+ *            <nfilter> and <npost> are only recorded, for
+ *            statistics.
+ *
+ * Returns:   a pointer to the new queue.
+ *
+ * Throws:    <NULL> on allocation, mutex, or condition variable
+ *            initialization failure.
+ */
+P7_PSTAGE *
+p7_pstage_Create(int nfilter, int npost)
+{
+  P7_PSTAGE *ps = NULL;
+  int        status;
+
+  ESL_ALLOC(ps, sizeof(P7_PSTAGE));
+  ps->nalloc  = ESL_MAX(1, npost) * p7_PSTAGE_DEPTH;
+  ps->nfilter = nfilter;
+  ps->npost   = npost;
+  ps->sv      = NULL;
+
+  ESL_ALLOC(ps->sv, sizeof(P7_SURVIVOR) * ps->nalloc);
+  ps->n = 0;
+  p7_pstage_Reset(ps);
+
+  if (pthread_mutex_init(&ps->mutex, NULL) != 0)    ESL_XEXCEPTION(eslESYS, "mutex init failed");
+  if (pthread_cond_init(&ps->notempty, NULL) != 0) { pthread_mutex_destroy(&ps->mutex); ESL_XEXCEPTION(eslESYS, "cond init failed"); }
+  if (pthread_cond_init(&ps->notfull,  NULL) != 0) { pthread_mutex_destroy(&ps->mutex); pthread_cond_destroy(&ps->notempty); ESL_XEXCEPTION(eslESYS, "cond init failed"); }
+  return ps;
+
+ ERROR:
+  if (ps) { free(ps->sv); free(ps); }
+  return NULL;
+}
+
+
+/* Function:  p7_pstage_Reset()
+ * Synopsis:  Empty and reopen the queue, for a new search.
+ *
+ * Purpose:   Discard any targets left in <ps>, reopen it, and zero
+ *            its statistics.
+ *
+ *            Must not be called while threads are using <ps>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_pstage_Reset(P7_PSTAGE *ps)
+{
+  for (; ps->n > 0; ps->n--)
+    {
+      esl_sq_Destroy(ps->sv[ps->head].sq);
+      ps->head = (ps->head + 1) % ps->nalloc;
+    }
+  ps->head   = 0;
+  ps->closed = FALSE;
+  ps->nfull  = 0;
+  ps->nempty = 0;
+  ps->peak   = 0;
+  return eslOK;
+}
+
+
+/* Function:  p7_pstage_Push()
+ * Synopsis:  A filter thread queues a target that passed.
+ *
+ * Purpose:   Queue a copy of target <sq>, which passed the filters
+ *            with Forward score <fwdsc> against query <q> of the
+ *            current batch (0, for tools that search one query at a
+ *            time). The caller can reuse <sq> at once. If the queue
+ *            is full, wait for a postprocessing thread to make room.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ *            <eslESYS> if a mutex or condition variable operation fails.
+ *            <eslEINVAL> if <ps> has been closed.
+ */
+int
+p7_pstage_Push(P7_PSTAGE *ps, const ESL_SQ *sq, int q, float fwdsc)
+{
+  ESL_SQ *copy = NULL;
+  int     slot;
+  int     status;
+
+  /* copy outside the lock; filter threads mostly contend with each other here */
+  if ((copy = esl_sq_CreateDigital(sq->abc)) == NULL) ESL_EXCEPTION(eslEMEM, "allocation failed");
+  if ((status = esl_sq_Copy(sq, copy)) != eslOK)      { esl_sq_Destroy(copy); return status; }
+
+  if (pthread_mutex_lock(&ps->mutex) != 0) ESL_XEXCEPTION(eslESYS, "mutex lock failed");
+  if (ps->closed) { pthread_mutex_unlock(&ps->mutex); ESL_XEXCEPTION(eslEINVAL, "push to closed pipeline stage"); }
+  if (ps->n == ps->nalloc)
+    {
+      ps->nfull++;
+      while (ps->n == ps->nalloc)
+	if (pthread_cond_wait(&ps->notfull, &ps->mutex) != 0) { pthread_mutex_unlock(&ps->mutex); ESL_XEXCEPTION(eslESYS, "cond wait failed"); }
+    }
+
+  slot = (ps->head + ps->n) % ps->nalloc;
+  ps->sv[slot].sq    = copy;
+  ps->sv[slot].q     = q;
+  ps->sv[slot].fwdsc = fwdsc;
+  ps->n++;
+  ps->peak = ESL_MAX(ps->peak, ps->n);
+
+  if (pthread_cond_signal(&ps->notempty) != 0) { pthread_mutex_unlock(&ps->mutex); ESL_EXCEPTION(eslESYS, "cond signal failed"); }  /* <copy> is queued now */
+  if (pthread_mutex_unlock(&ps->mutex)   != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+  return eslOK;
+
+ ERROR:
+  esl_sq_Destroy(copy);
+  return status;
+}
+
+
+/* Function:  p7_pstage_Close()
+ * Synopsis:  Filtering is done: no more targets will be pushed.
+ *
+ * Purpose:   Mark <ps> closed, once all the filter threads have
+ *            finished. Postprocessing threads drain what's left,
+ *            then <p7_pstage_Pop()> tells them they're done.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslESYS> if a mutex or condition variable operation fails.
+ */
+int
+p7_pstage_Close(P7_PSTAGE *ps)
+{
+  if (pthread_mutex_lock(&ps->mutex)        != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+  ps->closed = TRUE;
+  if (pthread_cond_broadcast(&ps->notempty) != 0) { pthread_mutex_unlock(&ps->mutex); ESL_EXCEPTION(eslESYS, "cond broadcast failed"); }
+  if (pthread_mutex_unlock(&ps->mutex)      != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+  return eslOK;
+}
+
+
+/* Function:  p7_pstage_Pop()
+ * Synopsis:  A postprocessing thread takes the oldest queued target.
+ *
+ * Purpose:   Take the oldest target in the queue into <*ret_sv>,
+ *            waiting for one if the queue is empty and still open.
+ *            The caller owns <ret_sv->sq>, and frees it with
+ *            <esl_sq_Destroy()> when it's done with it.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEOF> if the queue is empty and closed; <ret_sv->sq>
+ *            is <NULL>.
+ *
+ * Throws:    <eslESYS> if a mutex or condition variable operation fails.
+ */
+int
+p7_pstage_Pop(P7_PSTAGE *ps, P7_SURVIVOR *ret_sv)
+{
+  ret_sv->sq = NULL;
+
+  if (pthread_mutex_lock(&ps->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+  if (ps->n == 0 && ! ps->closed)
+    {
+      ps->nempty++;
+      while (ps->n == 0 && ! ps->closed)
+	if (pthread_cond_wait(&ps->notempty, &ps->mutex) != 0) { pthread_mutex_unlock(&ps->mutex); ESL_EXCEPTION(eslESYS, "cond wait failed"); }
+    }
+
+  if (ps->n == 0)
+    {
+      if (pthread_mutex_unlock(&ps->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+      return eslEOF;
+    }
+
+  *ret_sv  = ps->sv[ps->head];
+  ps->head = (ps->head + 1) % ps->nalloc;
+  ps->n--;
+
+  if (pthread_cond_signal(&ps->notfull) != 0) { pthread_mutex_unlock(&ps->mutex); ESL_EXCEPTION(eslESYS, "cond signal failed"); }
+  if (pthread_mutex_unlock(&ps->mutex)  != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+  return eslOK;
+}
+
+
+/* Function:  p7_pstage_Account()
+ * Synopsis:  Record the queue's statistics in a pipeline, for output.
+ *
+ * Purpose:   Copy the thread pool sizes and the wait counts of <ps>
+ *            into <pli>, typically the merged pipeline of a query,
+ *            so <p7_pli_Statistics()> reports them. With several
+ *            queries per pass over the targets (hmmsearch --qbatch),
+ *            the counts are those of the whole pass.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_pstage_Account(const P7_PSTAGE *ps, P7_PIPELINE *pli)
+{
+  pli->nfilter_thr = ps->nfilter;
+  pli->npost_thr   = ps->npost;
+  pli->n_qfull     = ps->nfull;
+  pli->n_qempty    = ps->nempty;
+  pli->qpeak       = ps->peak;
+  return eslOK;
+}
+
+
+/* Function:  p7_pstage_Destroy()
+ * Synopsis:  Free a pipeline stage queue, and any targets left in it.
+ */
+void
+p7_pstage_Destroy(P7_PSTAGE *ps)
+{
+  if (ps == NULL) return;
+  p7_pstage_Reset(ps);
+  pthread_mutex_destroy(&ps->mutex);
+  pthread_cond_destroy(&ps->notempty);
+  pthread_cond_destroy(&ps->notfull);
+  free(ps->sv);
+  free(ps);
+}
+/*------------------ end, P7_PSTAGE object ----------------------*/
+
+
+
+/*****************************************************************
+ * 2. Unit tests.
+ *****************************************************************/
+#ifdef p7PSTAGE_TESTDRIVE
+#include "esl_alphabet.h"
+#include "esl_threads.h"
+
+struct utest_filter_s {
+  P7_PSTAGE *ps;
+  ESL_SQ    *sq;		/* target this thread pushes over and over */
+  int        q;			/* this thread's number                    */
+  int        n;			/* # of targets it pushes                  */
+};
+
+struct utest_post_s {
+  P7_PSTAGE *ps;
+  int       *seen;		/* [q*n + i]: # of times target i of filter thread q was popped */
+  int        n;
+  int64_t    npopped;
+};
+
+/* utest_filter()
+ * Push <n> copies of our target, numbered by their Forward score,
+ * reusing our own <sq> right away as a filter thread does.
+ */
+static void
+utest_filter(void *arg)
+{
+  ESL_THREADS           *obj = (ESL_THREADS *) arg;
+  struct utest_filter_s *fk;
+  int                    w, i;
+
+  esl_threads_Started(obj, &w);
+  fk = (struct utest_filter_s *) esl_threads_GetData(obj, w);
+
+  for (i = 0; i < fk->n; i++)
+    if (p7_pstage_Push(fk->ps, fk->sq, fk->q, (float) i) != eslOK) esl_fatal("p7_pstage: Push() failed");
+
+  esl_threads_Finished(obj, w);
+}
+
+/* utest_post()
+ * Drain the queue, checking each target and counting it. Each is
+ * handed to exactly one postprocessing thread, so writes to <seen>
+ * don't race.
+ */
+static void
+utest_post(void *arg)
+{
+  ESL_THREADS         *obj = (ESL_THREADS *) arg;
+  struct utest_post_s *pk;
+  P7_SURVIVOR          sv;
+  int                  w;
+  int                  status;
+
+  esl_threads_Started(obj, &w);
+  pk = (struct utest_post_s *) esl_threads_GetData(obj, w);
+
+  while ((status = p7_pstage_Pop(pk->ps, &sv)) == eslOK)
+    {
+      if (sv.sq == NULL || sv.sq->n != 10 + sv.q)    esl_fatal("p7_pstage: bad target");
+      if (sv.fwdsc < 0. || sv.fwdsc >= (float) pk->n) esl_fatal("p7_pstage: bad score");
+      pk->seen[sv.q * pk->n + (int) sv.fwdsc]++;
+      pk->npopped++;
+      esl_sq_Destroy(sv.sq);
+    }
+  if (status != eslEOF || sv.sq != NULL) esl_fatal("p7_pstage: Pop() failed");
+
+  esl_threads_Finished(obj, w);
+}
+
+/* utest_threads()
+ * <nfilter> threads each push <n> targets while <npost> threads pop
+ * them: every target comes out exactly once, intact, and the
+ * postprocessing threads stop when the queue is closed and drained.
+ * Do it twice, to check that Reset() reopens the queue.
+ */
+static void
+utest_threads(ESL_ALPHABET *abc, int nfilter, int npost, int n)
+{
+  char                   msg[]   = "p7_pstage threads unit test failed";
+  char                   resid[] = "ACDEFGHIKLMNPQRSTVWY";
+  P7_PSTAGE             *ps      = NULL;
+  ESL_THREADS           *fobj    = NULL;
+  ESL_THREADS           *pobj    = NULL;
+  struct utest_filter_s *fk      = NULL;
+  struct utest_post_s   *pk      = NULL;
+  int                   *seen    = NULL;
+  int64_t                ntot;
+  int                    round, w, i;
+
+  if ((ps   = p7_pstage_Create(nfilter, npost))                     == NULL) esl_fatal(msg);
+  if ((fobj = esl_threads_Create(&utest_filter))                    == NULL) esl_fatal(msg);
+  if ((pobj = esl_threads_Create(&utest_post))                      == NULL) esl_fatal(msg);
+  if ((fk   = malloc(sizeof(struct utest_filter_s) * nfilter))      == NULL) esl_fatal(msg);
+  if ((pk   = malloc(sizeof(struct utest_post_s)   * npost))        == NULL) esl_fatal(msg);
+  if ((seen = malloc(sizeof(int) * nfilter * ESL_MAX(1, n)))        == NULL) esl_fatal(msg);
+
+  if (nfilter > 10) esl_fatal(msg);
+  for (w = 0; w < nfilter; w++)	/* filter thread w's target has length 10+w */
+    {
+      if ((fk[w].sq = esl_sq_CreateFrom("target", resid + 10 - w, NULL, NULL, NULL)) == NULL) esl_fatal(msg);
+      if (esl_sq_Digitize(abc, fk[w].sq) != eslOK)                                            esl_fatal(msg);
+    }
+
+  for (round = 0; round < 2; round++)
+    {
+      for (i = 0; i < nfilter * n; i++) seen[i] = 0;
+      if (p7_pstage_Reset(ps) != eslOK) esl_fatal(msg);
+
+      for (w = 0; w < npost; w++)
+	{
+	  pk[w].ps      = ps;
+	  pk[w].seen    = seen;
+	  pk[w].n       = n;
+	  pk[w].npopped = 0;
+	  esl_threads_AddThread(pobj, &pk[w]);
+	}
+      for (w = 0; w < nfilter; w++)
+	{
+	  fk[w].ps = ps;
+	  fk[w].q  = w;
+	  fk[w].n  = n;
+	  esl_threads_AddThread(fobj, &fk[w]);
+	}
+      esl_threads_WaitForStart(pobj);
+      esl_threads_WaitForStart(fobj);
+      esl_threads_WaitForFinish(fobj);
+      if (p7_pstage_Close(ps) != eslOK) esl_fatal(msg);
+      esl_threads_WaitForFinish(pobj);
+
+      for (ntot = 0, w = 0; w < npost; w++) ntot += pk[w].npopped;
+      if (ntot != (int64_t) nfilter * n) esl_fatal(msg);
+      for (i = 0; i < nfilter * n; i++) if (seen[i] != 1) esl_fatal(msg);
+      if (ps->n != 0 || ps->peak > ps->nalloc)  esl_fatal(msg);
+      if (n > 0 && ps->peak < 1)                esl_fatal(msg);
+    }
+
+  for (w = 0; w < nfilter; w++) esl_sq_Destroy(fk[w].sq);
+  free(seen);
+  free(pk);
+  free(fk);
+  esl_threads_Destroy(pobj);
+  esl_threads_Destroy(fobj);
+  p7_pstage_Destroy(ps);
+}
+
+/* utest_leftovers()
+ * Targets left in the queue are freed by Reset() and Destroy(); once
+ * closed, pops run it dry without waiting.
+ */
+static void
+utest_leftovers(ESL_ALPHABET *abc)
+{
+  char         msg[] = "p7_pstage leftovers unit test failed";
+  P7_PSTAGE   *ps    = NULL;
+  ESL_SQ      *sq    = NULL;
+  P7_SURVIVOR  sv;
+  int          i;
+
+  if ((ps = p7_pstage_Create(1, 1))                              == NULL)  esl_fatal(msg);
+  if ((sq = esl_sq_CreateFrom("target", "ACDEF", NULL, NULL, NULL)) == NULL) esl_fatal(msg);
+  if (esl_sq_Digitize(abc, sq)                                   != eslOK) esl_fatal(msg);
+
+  for (i = 0; i < ps->nalloc; i++)
+    if (p7_pstage_Push(ps, sq, 0, 1.0) != eslOK) esl_fatal(msg);
+  if (p7_pstage_Reset(ps) != eslOK || ps->n != 0)  esl_fatal(msg);
+
+  for (i = 0; i < 3; i++)
+    if (p7_pstage_Push(ps, sq, 0, (float) i) != eslOK) esl_fatal(msg);
+  if (p7_pstage_Close(ps) != eslOK)                    esl_fatal(msg);
+
+  for (i = 0; i < 2; i++)
+    {
+      if (p7_pstage_Pop(ps, &sv) != eslOK || sv.fwdsc != (float) i || sv.sq->n != 5) esl_fatal(msg);
+      esl_sq_Destroy(sv.sq);
+    }
+  if (ps->n != 1) esl_fatal(msg);
+
+  esl_sq_Destroy(sq);
+  p7_pstage_Destroy(ps);	/* frees the one that's left */
+}
+#endif /*p7PSTAGE_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+#endif /*HMMER_THREADS*/
+
+
+
+/*****************************************************************
+ * 3. Test driver.
+ *****************************************************************/
+#ifdef p7PSTAGE_TESTDRIVE
+/* gcc -g -Wall -Dp7PSTAGE_TESTDRIVE -I. -I../easel -L. -L../easel -o p7_pstage_utest p7_pstage.c -lhmmer -leasel -lm -lpthread
+ */
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name  type         default  env   range togs  reqs  incomp  help                               docgrp */
+  {"-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                       0},
+  {"-N",  eslARG_INT,    "10000", NULL, "n>=0",NULL, NULL, NULL, "number of targets per filter thread",     0},
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the staged pipeline queue";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS  *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+#ifdef HMMER_THREADS
+  ESL_ALPHABET *abc = esl_alphabet_Create(eslAMINO);
+  int           N   = esl_opt_GetInteger(go, "-N");
+#endif
+
+  fprintf(stderr, "## %s\n", argv[0]);
+
+#ifdef HMMER_THREADS
+  utest_leftovers(abc);
+
+  utest_threads(abc, 1, 1, N);
+  utest_threads(abc, 4, 1, N);	/* postprocessing is the bottleneck: queue fills */
+  utest_threads(abc, 1, 4, N);	/* filtering is: postprocessing threads wait */
+  utest_threads(abc, 8, 3, N);
+  utest_threads(abc, 2, 2, 0);	/* nothing passes */
+
+  esl_alphabet_Destroy(abc);
+#else
+  fprintf(stderr, "#  (no threads: nothing to test)\n");
+#endif
+
+  fprintf(stderr, "#  status = ok\n");
+
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7PSTAGE_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
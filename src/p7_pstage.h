@@ -0,0 +1,58 @@
+/* P7_PSTAGE: a queue of targets that passed the acceleration filters,
+ * from the filter threads of a staged search to its postprocessing
+ * threads.
+ */
+#ifndef P7_PSTAGE_INCLUDED
+#define P7_PSTAGE_INCLUDED
+
+#include <p7_config.h>
+
+#ifdef HMMER_THREADS
+#include <stdint.h>
+#include <pthread.h>
+
+#include "easel.h"
+#include "esl_sq.h"
+
+#include "hmmer.h"
+
+/* Queue slots per postprocessing thread. Each slot holds a copy of a
+ * target, so this bounds memory; a full queue makes filter threads
+ * wait.
+ */
+#define p7_PSTAGE_DEPTH 64
+
+typedef struct {
+  ESL_SQ *sq;			/* copy of the target; belongs to whoever popped it */
+  int     q;			/* which query of a batch it passed the filters for */
+  float   fwdsc;		/* its Forward filter score (nats)                   */
+} P7_SURVIVOR;
+
+typedef struct {
+  P7_SURVIVOR     *sv;		/* circular queue, [0..nalloc-1]                  */
+  int              nalloc;
+  int              head;	/* index of the oldest queued target in <sv>      */
+  int              n;		/* # of targets queued                            */
+  int              closed;	/* TRUE once filtering is done: no more pushes    */
+
+  int              nfilter;	/* # of filter threads                            */
+  int              npost;	/* # of postprocessing threads                    */
+  int64_t          nfull;	/* # of times a filter thread waited on a full queue     */
+  int64_t          nempty;	/* # of times a postproc thread waited on an empty queue */
+  int              peak;	/* most targets queued at once                    */
+
+  pthread_mutex_t  mutex;	/* guards all of the above                        */
+  pthread_cond_t   notempty;
+  pthread_cond_t   notfull;
+} P7_PSTAGE;
+
+extern P7_PSTAGE *p7_pstage_Create (int nfilter, int npost);
+extern int        p7_pstage_Reset  (P7_PSTAGE *ps);
+extern int        p7_pstage_Push   (P7_PSTAGE *ps, const ESL_SQ *sq, int q, float fwdsc);
+extern int        p7_pstage_Close  (P7_PSTAGE *ps);
+extern int        p7_pstage_Pop    (P7_PSTAGE *ps, P7_SURVIVOR *ret_sv);
+extern int        p7_pstage_Account(const P7_PSTAGE *ps, P7_PIPELINE *pli);
+extern void       p7_pstage_Destroy(P7_PSTAGE *ps);
+
+#endif /*HMMER_THREADS*/
+#endif /*P7_PSTAGE_INCLUDED*/
@@ -12,6 +12,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
 
 #include "easel.h"
 #include "hmmer.h"
@@ -38,13 +41,18 @@ p7_tophits_Create(void)
   ESL_ALLOC(h, sizeof(P7_TOPHITS));
   h->hit    = NULL;
   h->unsrt  = NULL;
+  h->arena  = NULL;
 
   ESL_ALLOC(h->hit,   sizeof(P7_HIT *) * default_nalloc);
   ESL_ALLOC(h->unsrt, sizeof(P7_HIT)   * default_nalloc);
+  if ((h->arena = p7_arena_Create()) == NULL) goto ERROR;
   h->Nalloc    = default_nalloc;
   h->N         = 0;
   h->nreported = 0;
   h->nincluded = 0;
+  h->maxhits   = 0;
+  h->minkey    = -eslINFINITY;
+  h->ntrimmed  = 0;
   h->is_sorted_by_sortkey = TRUE; /* but only because there's 0 hits */
   h->is_sorted_by_seqidx  = FALSE;
   h->hit[0]    = h->unsrt;        /* if you're going to call it "sorted" when it contains just one hit, you need this */
@@ -76,6 +84,9 @@ p7_tophits_Clone(const P7_TOPHITS *h)
   
   h2->nreported = h->nreported;
   h2->nincluded = h->nincluded;
+  h2->maxhits   = h->maxhits;
+  h2->minkey    = h->minkey;
+  h2->ntrimmed  = h->ntrimmed;
   h2->is_sorted_by_sortkey = h->is_sorted_by_sortkey;
   h2->is_sorted_by_seqidx = h->is_sorted_by_seqidx;
   
@@ -84,6 +95,7 @@ p7_tophits_Clone(const P7_TOPHITS *h)
   
   h2->hit = NULL;
   h2->unsrt = NULL;
+  h2->arena = NULL;   // the copied hits are on the heap
   
   ESL_ALLOC(h2->hit,   sizeof(P7_HIT *) * h2->N);
   ESL_ALLOC(h2->unsrt, sizeof(P7_HIT)   * h2->N);
@@ -206,6 +218,7 @@ p7_tophits_CreateNextHit(P7_TOPHITS *h, P7_HIT **ret_hit)
   hit->nincluded    = 0;
   hit->best_domain  = -1;
   hit->dcl          = NULL;
+  hit->in_arena     = FALSE;
   hit->offset       = 0;
 
   *ret_hit = hit;
@@ -274,10 +287,11 @@ p7_tophits_Add(P7_TOPHITS *h,
 {
   int status;
 
-  if ((status = p7_tophits_Grow(h))                           != eslOK) return status;
-  if ((status = esl_strdup(name, -1, &(h->unsrt[h->N].name))) != eslOK) return status;
-  if ((status = esl_strdup(acc,  -1, &(h->unsrt[h->N].acc)))  != eslOK) return status;
-  if ((status = esl_strdup(desc, -1, &(h->unsrt[h->N].desc))) != eslOK) return status;
+  if ((status = p7_tophits_Grow(h))                                      != eslOK) return status;
+  if ((status = p7_arena_Strdup(h->arena, name, -1, &(h->unsrt[h->N].name))) != eslOK) return status;
+  if ((status = p7_arena_Strdup(h->arena, acc,  -1, &(h->unsrt[h->N].acc)))  != eslOK) return status;
+  if ((status = p7_arena_Strdup(h->arena, desc, -1, &(h->unsrt[h->N].desc))) != eslOK) return status;
+  h->unsrt[h->N].in_arena   = (h->arena != NULL);
   h->unsrt[h->N].sortkey    = sortkey;
   h->unsrt[h->N].score      = score;
   h->unsrt[h->N].pre_score  = 0.0;
@@ -466,6 +480,15 @@ p7_tophits_SortByModelnameAndAlipos(P7_TOPHITS *h)
  *            not access it further, and may as well free
  *            it immediately.
  *
+ *            Hits are moved, not copied: <h1> takes over
+ *            the memory of <h2>'s hits, including all the
+ *            blocks of <h2>'s arena.
+ *
+ *            If <h1> is bounded (see <p7_tophits_SetMaxHits()>),
+ *            the merged list is trimmed back to its top
+ *            <h1->maxhits> hits, and <h2>'s count of trimmed
+ *            hits is added to <h1>'s.
+ *
  * Returns:   <eslOK> on success.
  *
  * Throws:    <eslEMEM> on allocation failure, and
@@ -474,61 +497,520 @@ p7_tophits_SortByModelnameAndAlipos(P7_TOPHITS *h)
 int
 p7_tophits_Merge(P7_TOPHITS *h1, P7_TOPHITS *h2)
 {
-  void    *p;
-  P7_HIT **new_hit = NULL;
-  P7_HIT  *ori1    = h1->unsrt;    /* original base of h1's data */
-  P7_HIT  *new2;
-  int      i,j,k;
-  uint64_t Nalloc = h1->N + h2->N;
-  int      status;
-
-  if(h2->N <= 0) return eslOK;
-  
-  /* Make sure the two lists are sorted */
+  return p7_tophits_MergeN(h1, &h2, 1, 1);
+}
+
+
+/* Function:  p7_tophits_MergeN()
+ * Synopsis:  Merge many top hits lists at once.
+ *
+ * Purpose:   Merge the <k> lists <hv[0..k-1]> into <h1>, the way
+ *            <p7_tophits_Merge()> merges one: upon return <h1> holds
+ *            the sorted, merged list, and the lists in <hv> are
+ *            effectively destroyed (caller should just free them).
+ *
+ *            This is for gathering the hit lists of a threaded
+ *            search. Rather than merging them into <h1> one at a
+ *            time, which copies the growing list <k> times, the data
+ *            of all the lists are moved once and their sorted orders
+ *            are merged in one k-way pass (see
+ *            <p7_tophits_MergeHitArrays()>), using up to <nthreads>
+ *            threads. The lists should already be sorted by sortkey,
+ *            preferably by the threads that made them; any that
+ *            aren't are sorted here.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and
+ *            <h1> and all of <hv> remain valid.
+ */
+int
+p7_tophits_MergeN(P7_TOPHITS *h1, P7_TOPHITS **hv, int k, int nthreads)
+{
+  void      *p;
+  P7_HIT   **new_hit = NULL;
+  P7_HIT  ***lists   = NULL;
+  uint64_t  *nlist   = NULL;
+  P7_HIT    *ori1    = h1->unsrt;    /* original base of h1's data */
+  P7_HIT    *base;
+  uint64_t   Nalloc  = h1->N;
+  uint64_t   i;
+  int        j;
+  int        status;
+
+  for (j = 0; j < k; j++)
+    {
+      h1->ntrimmed    += hv[j]->ntrimmed;
+      hv[j]->ntrimmed  = 0;
+      Nalloc          += hv[j]->N;
+    }
+  if (Nalloc == h1->N) return eslOK;
+
+  /* Make sure all the lists are sorted */
   if ((status = p7_tophits_SortBySortkey(h1)) != eslOK) goto ERROR;
-  if ((status = p7_tophits_SortBySortkey(h2)) != eslOK) goto ERROR;
+  for (j = 0; j < k; j++)
+    if ((status = p7_tophits_SortBySortkey(hv[j])) != eslOK) goto ERROR;
 
-  /* Attempt our allocations, so we fail early if we fail. 
+  /* Attempt our allocations, so we fail early if we fail.
    * Reallocating h1->unsrt screws up h1->hit, so fix it.
    */
-  ESL_RALLOC(h1->unsrt, p, sizeof(P7_HIT) * Nalloc);
+  ESL_ALLOC (lists,   sizeof(P7_HIT **)   * (k+1));
+  ESL_ALLOC (nlist,   sizeof(uint64_t)    * (k+1));
   ESL_ALLOC (new_hit, sizeof(P7_HIT *)    * Nalloc);
+  ESL_RALLOC(h1->unsrt, p, sizeof(P7_HIT) * Nalloc);
   for (i = 0; i < h1->N; i++)
     h1->hit[i] = h1->unsrt + (h1->hit[i] - ori1);
 
-  /* Append h2's unsorted data array to h1. h2's data begin at <new2> */
-  new2 = h1->unsrt + h1->N;
-  memcpy(new2, h2->unsrt, sizeof(P7_HIT) * h2->N);
+  /* Append each list's unsorted data array to h1's, and point its
+   * sorted order at where its hits are now.
+   */
+  lists[0] = h1->hit;
+  nlist[0] = h1->N;
+  base     = h1->unsrt + h1->N;
+  for (j = 0; j < k; j++)
+    {
+      memcpy(base, hv[j]->unsrt, sizeof(P7_HIT) * hv[j]->N);
+      for (i = 0; i < hv[j]->N; i++)
+	hv[j]->hit[i] = base + (hv[j]->hit[i] - hv[j]->unsrt);
+      lists[j+1] = hv[j]->hit;
+      nlist[j+1] = hv[j]->N;
+      base      += hv[j]->N;
+    }
 
-  /* Merge the sorted hit lists */
-  for (i=0,j=0,k=0; i < h1->N && j < h2->N ; k++)
-    new_hit[k] = (hit_sorter_by_sortkey(&h1->hit[i], &h2->hit[j]) > 0) ? new2 + (h2->hit[j++] - h2->unsrt) : h1->hit[i++];
-  while (i < h1->N) new_hit[k++] = h1->hit[i++];
-  while (j < h2->N) new_hit[k++] = new2 + (h2->hit[j++] - h2->unsrt);
+  if ((status = p7_tophits_MergeHitArrays(lists, nlist, k+1, new_hit, nthreads)) != eslOK)
+    { /* put each list's sorted order back the way it was */
+      for (base = h1->unsrt + h1->N, j = 0; j < k; j++)
+	{
+	  for (i = 0; i < hv[j]->N; i++)
+	    hv[j]->hit[i] = hv[j]->unsrt + (hv[j]->hit[i] - base);
+	  base += hv[j]->N;
+	}
+      goto ERROR;
+    }
 
-  /* h2 now turns over management of name, acc, desc memory to h1;
-   * nullify its pointers, to prevent double free.  */
-  for (i = 0; i < h2->N; i++)
-  {
-      h2->unsrt[i].name = NULL;
-      h2->unsrt[i].acc  = NULL;
-      h2->unsrt[i].desc = NULL;
-      h2->unsrt[i].dcl  = NULL;
-  }
+  /* Each list now turns over management of name, acc, desc memory to h1;
+   * nullify its pointers, to prevent double free. ... and turns over its
+   * arena, where hits that are <in_arena> live.
+   */
+  for (j = 0; j < k; j++)
+    {
+      for (i = 0; i < hv[j]->N; i++)
+	{
+	  hv[j]->unsrt[i].name = NULL;
+	  hv[j]->unsrt[i].acc  = NULL;
+	  hv[j]->unsrt[i].desc = NULL;
+	  hv[j]->unsrt[i].dcl  = NULL;
+	}
+      if      (! h1->arena)   { h1->arena = hv[j]->arena; hv[j]->arena = NULL; }
+      else if (  hv[j]->arena) p7_arena_Adopt(h1->arena, hv[j]->arena);
+    }
 
   /* Construct the new grown h1 */
   free(h1->hit);
+  free(lists);
+  free(nlist);
   h1->hit    = new_hit;
   h1->Nalloc = Nalloc;
-  h1->N     += h2->N;
+  h1->N      = Nalloc;
   /* and is_sorted is TRUE, as a side effect of p7_tophits_Sort() above. */
+
+  if (h1->maxhits && h1->N > h1->maxhits) return p7_tophits_Trim(h1);
   return eslOK;
-  
+
+ ERROR:
+  if (new_hit) free(new_hit);
+  if (lists)   free(lists);
+  if (nlist)   free(nlist);
+  return status;
+}
+
+
+/* A k-way merge of sorted hit arrays, split into segments that
+ * threads can merge independently.
+ *
+ * The output is cut into segments at "splitter" hits taken from a
+ * sample of the inputs. Each input array is cut at the first hit that
+ * doesn't sort before a splitter, so segment <t> of every input sorts
+ * entirely before segment <t+1> of every other; each segment is then
+ * an ordinary k-way merge, written to its own stretch of the output.
+ */
+typedef struct {
+  P7_HIT        ***lists;	/* the sorted input arrays, [0..k-1]                    */
+  const uint64_t  *lo;		/* this segment of list j is lists[j][lo[j]..hi[j]-1]   */
+  const uint64_t  *hi;
+  int              k;
+  uint64_t        *pos;		/* scratch: current position in each list, [0..k-1]     */
+  int             *heap;	/* scratch: a heap of list indices, [0..k-1]            */
+  P7_HIT         **out;		/* where this segment's merged hits go                  */
+} MERGE_SEGMENT;
+
+/* merge_before(): TRUE if the next hit of list <a> goes before that of <b>; ties go to the lower list */
+static int
+merge_before(const MERGE_SEGMENT *seg, int a, int b)
+{
+  int c = hit_sorter_by_sortkey(&(seg->lists[a][seg->pos[a]]), &(seg->lists[b][seg->pos[b]]));
+  return (c < 0 || (c == 0 && a < b));
+}
+
+static void
+merge_siftdown(MERGE_SEGMENT *seg, int n, int i)
+{
+  int *heap = seg->heap;
+  int  c, tmp;
+
+  while ((c = 2*i+1) < n)
+    {
+      if (c+1 < n && merge_before(seg, heap[c+1], heap[c])) c++;
+      if (! merge_before(seg, heap[c], heap[i])) break;
+      tmp = heap[i]; heap[i] = heap[c]; heap[c] = tmp;
+      i = c;
+    }
+}
+
+static void
+merge_segment(MERGE_SEGMENT *seg)
+{
+  P7_HIT **out = seg->out;
+  int      n   = 0;
+  int      i, j;
+
+  for (j = 0; j < seg->k; j++)
+    {
+      seg->pos[j] = seg->lo[j];
+      if (seg->pos[j] < seg->hi[j]) seg->heap[n++] = j;
+    }
+  for (i = n/2-1; i >= 0; i--) merge_siftdown(seg, n, i);
+
+  while (n > 0)
+    {
+      j      = seg->heap[0];
+      *out++ = seg->lists[j][seg->pos[j]++];
+      if (seg->pos[j] == seg->hi[j]) seg->heap[0] = seg->heap[--n];
+      merge_siftdown(seg, n, 0);
+    }
+}
+
+#ifdef HMMER_THREADS
+static void *
+merge_segment_thread(void *arg)
+{
+  merge_segment((MERGE_SEGMENT *) arg);
+  return NULL;
+}
+#endif
+
+/* merge_cut(): index of the first hit in <v[0..n-1]> that doesn't sort before <split> */
+static uint64_t
+merge_cut(P7_HIT **v, uint64_t n, P7_HIT *split)
+{
+  uint64_t lo = 0;
+  uint64_t hi = n;
+  uint64_t mid;
+
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (v[mid] != split && hit_sorter_by_sortkey(&(v[mid]), &split) < 0) lo = mid + 1;
+      else                                                                hi = mid;
+    }
+  return lo;
+}
+
+
+/* Function:  p7_tophits_MergeHitArrays()
+ * Synopsis:  k-way merge of sorted arrays of hit pointers.
+ *
+ * Purpose:   Merge the <k> arrays of hit pointers <lists[0..k-1]>, of
+ *            lengths <nlist[0..k-1]>, each already sorted by sortkey
+ *            (as <p7_tophits_SortBySortkey()> sorts), into <out>,
+ *            which caller provides with room for all of them. Hits
+ *            that tie go in list order.
+ *
+ *            With <nthreads> > 1, and enough hits to be worth it
+ *            (<p7_TOPHITS_MERGECHUNK> per thread), the output is split
+ *            into up to <nthreads> segments that are merged in
+ *            parallel.
+ *
+ *            Only the pointers are merged; the hits themselves stay
+ *            where they are. <p7_tophits_MergeN()> uses this for hit
+ *            lists; hmmpgmd's master uses it directly on the hits
+ *            its workers send.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; the contents of <out>
+ *            are undefined, and <lists> are unchanged.
+ */
+int
+p7_tophits_MergeHitArrays(P7_HIT ***lists, const uint64_t *nlist, int k, P7_HIT **out, int nthreads)
+{
+  MERGE_SEGMENT *seg    = NULL;
+  P7_HIT       **sample = NULL;
+  uint64_t      *cut    = NULL;	/* segment t of list j is [cut[t*k+j], cut[(t+1)*k+j]) */
+  uint64_t      *pos    = NULL;
+  int           *heap   = NULL;
+  uint64_t       total  = 0;
+  uint64_t       off;
+  int            nseg   = 1;
+  int            nsample, m;
+  int            t, j, s;
+  int            status;
+#ifdef HMMER_THREADS
+  pthread_t     *tid    = NULL;
+  int           *alive  = NULL;
+#endif
+
+  for (j = 0; j < k; j++) total += nlist[j];
+  if (total == 0) return eslOK;
+#ifdef HMMER_THREADS
+  if (nthreads > 1) nseg = (int) ESL_MIN((uint64_t) nthreads, total / p7_TOPHITS_MERGECHUNK);
+  if (nseg < 1)     nseg = 1;
+#endif
+
+  ESL_ALLOC(seg,  sizeof(MERGE_SEGMENT) * nseg);
+  ESL_ALLOC(cut,  sizeof(uint64_t) * (nseg+1) * k);
+  ESL_ALLOC(pos,  sizeof(uint64_t) * nseg * k);
+  ESL_ALLOC(heap, sizeof(int)      * nseg * k);
+
+  for (j = 0; j < k; j++) { cut[j] = 0; cut[nseg*k + j] = nlist[j]; }
+
+  /* Choose nseg-1 splitters, evenly spaced through a sorted sample
+   * of evenly spaced hits from each list.
+   */
+  if (nseg > 1)
+    {
+      m = 4 * nseg;
+      ESL_ALLOC(sample, sizeof(P7_HIT *) * m * k);
+      for (nsample = 0, j = 0; j < k; j++)
+	for (s = 0; s < m && s < nlist[j]; s++) sample[nsample++] = lists[j][(nlist[j] * s) / ESL_MIN(m, nlist[j])];
+      qsort(sample, nsample, sizeof(P7_HIT *), hit_sorter_by_sortkey);
+
+      for (t = 1; t < nseg; t++)
+	for (j = 0; j < k; j++)
+	  cut[t*k + j] = merge_cut(lists[j], nlist[j], sample[(nsample * t) / nseg]);
+    }
+
+  for (off = 0, t = 0; t < nseg; t++)
+    {
+      seg[t].lists = lists;
+      seg[t].lo    = cut + t*k;
+      seg[t].hi    = cut + (t+1)*k;
+      seg[t].k     = k;
+      seg[t].pos   = pos  + t*k;
+      seg[t].heap  = heap + t*k;
+      seg[t].out   = out  + off;
+      for (j = 0; j < k; j++) off += seg[t].hi[j] - seg[t].lo[j];
+    }
+
+#ifdef HMMER_THREADS
+  if (nseg > 1)
+    {
+      ESL_ALLOC(tid,   sizeof(pthread_t) * nseg);
+      ESL_ALLOC(alive, sizeof(int)       * nseg);
+      for (t = 1; t < nseg; t++)
+	alive[t] = (pthread_create(&(tid[t]), NULL, merge_segment_thread, &(seg[t])) == 0);
+      merge_segment(&(seg[0]));
+      for (t = 1; t < nseg; t++)
+	{
+	  if (alive[t]) pthread_join(tid[t], NULL);
+	  else          merge_segment(&(seg[t]));    /* couldn't start a thread for it: do it ourselves */
+	}
+      free(tid);
+      free(alive);
+    }
+  else
+#endif
+    merge_segment(&(seg[0]));
+
+  free(seg);
+  free(cut);
+  free(pos);
+  free(heap);
+  if (sample) free(sample);
+  return eslOK;
+
+ ERROR:
+#ifdef HMMER_THREADS
+  if (tid)    free(tid);
+  if (alive)  free(alive);
+#endif
+  if (seg)    free(seg);
+  if (cut)    free(cut);
+  if (pos)    free(pos);
+  if (heap)   free(heap);
+  if (sample) free(sample);
+  return status;
+}
+
+
+/* free_hit()
+ * Free the memory of one hit that isn't in its list's arena.
+ */
+static void
+free_hit(P7_HIT *hit)
+{
+  int j;
+
+  if (hit->dcl != NULL)
+    for (j = 0; j < hit->ndom; j++)
+      if (hit->dcl[j].scores_per_pos != NULL) free(hit->dcl[j].scores_per_pos);
+  if (hit->in_arena) return;
+
+  if (hit->name != NULL) free(hit->name);
+  if (hit->acc  != NULL) free(hit->acc);
+  if (hit->desc != NULL) free(hit->desc);
+  if (hit->dcl  != NULL) {
+    for (j = 0; j < hit->ndom; j++)
+      if (hit->dcl[j].ad != NULL) p7_alidisplay_Destroy(hit->dcl[j].ad);
+    free(hit->dcl);
+  }
+}
+
+/* copy_hit_to_arena()
+ * Copy the arena-held parts of hit <src> (name, acc, desc, domain
+ * list and its alignment displays) into <arena>, making <dst> an
+ * <in_arena> hit that doesn't depend on <src>'s arena. Everything
+ * else is a shallow copy; in particular <dst> takes over the
+ * heap-allocated <scores_per_pos> arrays, if any.
+ */
+static int
+copy_hit_to_arena(P7_ARENA *arena, const P7_HIT *src, P7_HIT *dst)
+{
+  int d;
+  int status;
+
+  *dst = *src;
+  if ((status = p7_arena_Strdup(arena, src->name, -1, &(dst->name))) != eslOK) return status;
+  if ((status = p7_arena_Strdup(arena, src->acc,  -1, &(dst->acc)))  != eslOK) return status;
+  if ((status = p7_arena_Strdup(arena, src->desc, -1, &(dst->desc))) != eslOK) return status;
+  if (src->dcl)
+    {
+      if ((dst->dcl = p7_arena_Alloc(arena, sizeof(P7_DOMAIN) * src->ndom)) == NULL) return eslEMEM;
+      memcpy(dst->dcl, src->dcl, sizeof(P7_DOMAIN) * src->ndom);
+      for (d = 0; d < src->ndom; d++)
+	if (src->dcl[d].ad && (dst->dcl[d].ad = p7_alidisplay_CloneIn(arena, src->dcl[d].ad)) == NULL) return eslEMEM;
+    }
+  dst->in_arena = TRUE;
+  return eslOK;
+}
+
+
+/* Function:  p7_tophits_SetMaxHits()
+ * Synopsis:  Bound a hit list to its top hits.
+ *
+ * Purpose:   Keep no more than the <maxhits> best hits (by sortkey)
+ *            in hit list <h>, so that its memory stays flat however
+ *            many targets are reportable. <maxhits> of 0 means no
+ *            bound, the default.
+ *
+ *            The pipeline asks <p7_tophits_Admit()> before it adds a
+ *            hit, and calls <p7_tophits_Trim()> when the list has
+ *            grown to twice <maxhits>, so a bounded list holds at
+ *            most 2*<maxhits> hits at any time. Hits that are
+ *            dropped are counted in <h->ntrimmed>.
+ *
+ *            This only makes sense when reporting thresholds are
+ *            known before the search ends: with E-value thresholds,
+ *            that means the search space <Z> has to be set in
+ *            advance (<-Z>), not counted as targets go by. Then every
+ *            hit in the list is reportable, and every trimmed hit
+ *            was too; <p7_tophits_Threshold()> counts them in the
+ *            domain search space <domZ>, so E-values of the hits that
+ *            are kept are the same as in an unbounded search.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_tophits_SetMaxHits(P7_TOPHITS *h, uint64_t maxhits)
+{
+  h->maxhits = maxhits;
+  h->minkey  = -eslINFINITY;
+  return eslOK;
+}
+
+
+/* Function:  p7_tophits_Admit()
+ * Synopsis:  Check whether a bounded hit list has room for a hit.
+ *
+ * Purpose:   Return <TRUE> if a hit with sort key <sortkey> could
+ *            still make it into the top <h->maxhits> of a bounded hit
+ *            list <h>, and is worth adding. If not, count it as
+ *            trimmed and return <FALSE>; caller doesn't add it.
+ *
+ *            An unbounded list, or one that hasn't been trimmed yet,
+ *            admits everything.
+ */
+int
+p7_tophits_Admit(P7_TOPHITS *h, double sortkey)
+{
+  if (h->maxhits && sortkey < h->minkey) { h->ntrimmed++; return FALSE; }
+  return TRUE;
+}
+
+
+/* Function:  p7_tophits_Trim()
+ * Synopsis:  Cut a bounded hit list back to its top hits.
+ *
+ * Purpose:   If hit list <h> is bounded and holds more than
+ *            <h->maxhits> hits, sort it, and keep only the top
+ *            <h->maxhits>. Dropped hits are freed and counted in
+ *            <h->ntrimmed>, and <h->minkey> is raised to the sort key
+ *            of the worst hit kept, so <p7_tophits_Admit()> can turn
+ *            away hits that can't make the list.
+ *
+ *            Kept hits in <h>'s arena are copied into a new one and
+ *            the old arena is freed, so trimming gives back the
+ *            memory of dropped hits' alignment displays too.
+ *
+ *            Upon return, <h> is sorted by sortkey.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <h> is unchanged.
+ */
+int
+p7_tophits_Trim(P7_TOPHITS *h)
+{
+  P7_HIT   *unsrt = NULL;
+  P7_ARENA *arena = NULL;
+  uint64_t  i;
+  int       status;
+
+  if (! h->maxhits || h->N <= h->maxhits) return eslOK;
+
+  p7_tophits_SortBySortkey(h);
+
+  ESL_ALLOC(unsrt, sizeof(P7_HIT) * h->Nalloc);
+  if (h->arena && (arena = p7_arena_Create()) == NULL) { status = eslEMEM; goto ERROR; }
+  for (i = 0; i < h->maxhits; i++)
+    {
+      if (h->hit[i]->in_arena) { if ((status = copy_hit_to_arena(arena, h->hit[i], &(unsrt[i]))) != eslOK) goto ERROR; }
+      else                     unsrt[i] = *(h->hit[i]);
+    }
+
+  /* Kept hits have moved; their heap memory, if any, is now <unsrt>'s. Free the rest. */
+  for (i = h->maxhits; i < h->N; i++)
+    free_hit(h->hit[i]);
+
+  free(h->unsrt);
+  p7_arena_Destroy(h->arena);
+  h->unsrt     = unsrt;
+  h->arena     = arena;
+  h->ntrimmed += h->N - h->maxhits;
+  h->N         = h->maxhits;
+  for (i = 0; i < h->N; i++) h->hit[i] = h->unsrt + i;
+  h->minkey    = h->unsrt[h->N-1].sortkey;
+  h->is_sorted_by_sortkey = TRUE;
+  h->is_sorted_by_seqidx  = FALSE;
+  return eslOK;
+
  ERROR:
-  if (new_hit != NULL) free(new_hit);
+  if (unsrt) free(unsrt);
+  p7_arena_Destroy(arena);
   return status;
 }
 
+
 /* Function:  p7_tophits_GetMaxPositionLength()
  * Synopsis:  Returns maximum position length in hit list (targets).
  *
@@ -644,6 +1126,18 @@ p7_tophits_GetMaxShownLength(P7_TOPHITS *h)
 }
 
 
+/* free_hits()
+ * Free the memory of the hits in <h> that aren't in its arena.
+ */
+static void
+free_hits(P7_TOPHITS *h)
+{
+  int i;
+
+  for (i = 0; i < h->N; i++)
+    free_hit(&(h->unsrt[i]));
+}
+
 /* Function:  p7_tophits_Reuse()
  * Synopsis:  Reuse a hit list, freeing internals.
  *
@@ -655,24 +1149,12 @@ p7_tophits_GetMaxShownLength(P7_TOPHITS *h)
 int
 p7_tophits_Reuse(P7_TOPHITS *h)
 {
-  int i, j;
-
   if (h == NULL) return eslOK;
-  if (h->unsrt != NULL) 
-  {
-    for (i = 0; i < h->N; i++)
-    {
-      if (h->unsrt[i].name != NULL) free(h->unsrt[i].name);
-      if (h->unsrt[i].acc  != NULL) free(h->unsrt[i].acc);
-      if (h->unsrt[i].desc != NULL) free(h->unsrt[i].desc);
-      if (h->unsrt[i].dcl  != NULL) {
-        for (j = 0; j < h->unsrt[i].ndom; j++)
-          if (h->unsrt[i].dcl[j].ad != NULL) p7_alidisplay_Destroy(h->unsrt[i].dcl[j].ad);
-        free(h->unsrt[i].dcl);
-      }
-    }
-  }
+  if (h->unsrt != NULL) free_hits(h);
+  p7_arena_Reset(h->arena);
   h->N         = 0;
+  h->minkey    = -eslINFINITY;
+  h->ntrimmed  = 0;
   h->is_sorted_by_seqidx = FALSE;
   h->is_sorted_by_sortkey = TRUE;  /* because there are 0 hits */
   h->hit[0]    = h->unsrt;
@@ -685,26 +1167,14 @@ p7_tophits_Reuse(P7_TOPHITS *h)
 void
 p7_tophits_Destroy(P7_TOPHITS *h)
 {
-  int i,j;
   if (h == NULL) return;
   if (h->hit   != NULL) free(h->hit);
   if (h->unsrt != NULL) 
   {
-    for (i = 0; i < h->N; i++)
-    {
-      if (h->unsrt[i].name != NULL) free(h->unsrt[i].name);
-      if (h->unsrt[i].acc  != NULL) free(h->unsrt[i].acc);
-      if (h->unsrt[i].desc != NULL) free(h->unsrt[i].desc);
-      if (h->unsrt[i].dcl  != NULL) {
-        for (j = 0; j < h->unsrt[i].ndom; j++) {
-          if (h->unsrt[i].dcl[j].ad             != NULL) p7_alidisplay_Destroy(h->unsrt[i].dcl[j].ad);
-	  if (h->unsrt[i].dcl[j].scores_per_pos != NULL) free (h->unsrt[i].dcl->scores_per_pos);
-	}
-        free(h->unsrt[i].dcl);
-      }
-    }
+    free_hits(h);
     free(h->unsrt);
   }
+  p7_arena_Destroy(h->arena);
   free(h);
   return;
 }
@@ -719,6 +1189,218 @@ p7_tophits_Destroy(P7_TOPHITS *h)
  * 2. Standard (human-readable) output of pipeline results
  *****************************************************************/
 
+/* Rendering the per-hit records of a report in parallel.
+ *
+ * Each report below prints a header, one record per reported hit, and
+ * maybe a footer. A record depends only on its hit and on field widths
+ * that are fixed before the loop, so the records of a big list can be
+ * rendered on <pli->report_thr> threads: in chunks of
+ * <p7_TOPHITS_REPORTCHUNK> reported hits, each chunk into its own
+ * memory stream. The calling thread writes the chunks to <ofp> in
+ * order, one fwrite() apiece, and renders a chunk itself whenever the
+ * next one it needs hasn't been claimed yet. Threads don't render more
+ * than a few chunks per thread ahead of the writer, which bounds the
+ * memory used. The output is byte for byte what printing the records
+ * one at a time gives.
+ */
+typedef struct report_fmt_s REPORT_FMT;
+struct report_fmt_s {
+  P7_TOPHITS  *th;
+  P7_PIPELINE *pli;
+  char        *qname;		/* tabular reports: query name and accession       */
+  char        *qacc;
+  int          textw;		/* max width of text lines; 0 = unlimited           */
+  int          namew;		/* field widths, set before the loop over hits      */
+  int          posw;
+  int          descw;
+  int          qnamew;
+  int          qaccw;
+  int          tnamew;
+  int          taccw;
+  int          hinc;		/* target list: first reported hit that isn't included, or -1 */
+  int        (*print_hit)(FILE *ofp, const REPORT_FMT *f, int h);
+};
+
+#if defined (HMMER_THREADS) && defined (HAVE_OPEN_MEMSTREAM)
+typedef struct {
+  const REPORT_FMT *f;
+  int              *cut;	/* chunk c is hits cut[c]..cut[c+1]-1; [0..nchunk]   */
+  int               nchunk;
+  char            **buf;	/* [c]: rendered text of chunk c, or NULL           */
+  size_t           *len;	/* [c]: its length in bytes                         */
+  int              *status;	/* [c]: eslOK, or the error from rendering chunk c  */
+  char             *done;	/* [c]: TRUE once chunk c is rendered               */
+  int               next;	/* next chunk to render                             */
+  int               nwritten;	/* # of chunks written to the output                */
+  int               window;	/* most chunks rendered ahead of the writer         */
+  int               halt;	/* TRUE if the writer quit: stop rendering          */
+  pthread_mutex_t   mutex;	/* guards next, nwritten, halt, done[] and status[] */
+  pthread_cond_t    cond;
+} REPORT_JOB;
+
+static int
+render_chunk(REPORT_JOB *job, int c)
+{
+  const REPORT_FMT *f      = job->f;
+  FILE             *fp     = NULL;
+  int               status = eslOK;
+  int               h;
+
+  if ((fp = open_memstream(&(job->buf[c]), &(job->len[c]))) == NULL) return eslEMEM;
+  for (h = job->cut[c]; h < job->cut[c+1] && status == eslOK; h++)
+    if (f->th->hit[h]->flags & p7_IS_REPORTED)
+      status = (*f->print_hit)(fp, f, h);
+  if (fclose(fp) != 0 && status == eslOK) status = eslEMEM;
+  return status;
+}
+
+/* claim_chunk()
+ * With <job->mutex> held: take chunk <c> for rendering, render it
+ * with the mutex released, and mark it done.
+ */
+static void
+claim_chunk(REPORT_JOB *job, int c)
+{
+  int status;
+
+  job->next = c+1;
+  pthread_mutex_unlock(&(job->mutex));
+  status = render_chunk(job, c);
+  pthread_mutex_lock(&(job->mutex));
+  job->status[c] = status;
+  job->done[c]   = TRUE;
+  pthread_cond_broadcast(&(job->cond));
+}
+
+static void *
+report_thread(void *arg)
+{
+  REPORT_JOB *job = (REPORT_JOB *) arg;
+
+  pthread_mutex_lock(&(job->mutex));
+  for (;;)
+    {
+      while (! job->halt && job->next < job->nchunk && job->next >= job->nwritten + job->window)
+	pthread_cond_wait(&(job->cond), &(job->mutex));
+      if (job->halt || job->next >= job->nchunk) break;
+      claim_chunk(job, job->next);
+    }
+  pthread_mutex_unlock(&(job->mutex));
+  return NULL;
+}
+
+static int
+report_hits_threaded(FILE *ofp, const REPORT_FMT *f)
+{
+  REPORT_JOB  job;
+  pthread_t  *tid    = NULL;
+  int         nthr   = 0;
+  int         nrep   = 0;
+  int         c, h, t;
+  int         status;
+
+  job.f      = f;
+  job.cut    = NULL;
+  job.buf    = NULL;
+  job.len    = NULL;
+  job.status = NULL;
+  job.done   = NULL;
+
+  for (h = 0; h < f->th->N; h++)
+    if (f->th->hit[h]->flags & p7_IS_REPORTED) nrep++;
+  job.nchunk = (nrep + p7_TOPHITS_REPORTCHUNK - 1) / p7_TOPHITS_REPORTCHUNK;
+
+  ESL_ALLOC(job.cut,    sizeof(int)    * (job.nchunk+1));
+  ESL_ALLOC(job.buf,    sizeof(char *) * ESL_MAX(1, job.nchunk));
+  ESL_ALLOC(job.len,    sizeof(size_t) * ESL_MAX(1, job.nchunk));
+  ESL_ALLOC(job.status, sizeof(int)    * ESL_MAX(1, job.nchunk));
+  ESL_ALLOC(job.done,   sizeof(char)   * ESL_MAX(1, job.nchunk));
+  ESL_ALLOC(tid,        sizeof(pthread_t) * f->pli->report_thr);
+
+  for (c = 0, nrep = 0, h = 0; h < f->th->N; h++)
+    if (f->th->hit[h]->flags & p7_IS_REPORTED)
+      {
+	if (nrep % p7_TOPHITS_REPORTCHUNK == 0) job.cut[c++] = h;
+	nrep++;
+      }
+  job.cut[job.nchunk] = f->th->N;
+  for (c = 0; c < job.nchunk; c++) { job.buf[c] = NULL; job.len[c] = 0; job.status[c] = eslOK; job.done[c] = FALSE; }
+  job.next     = 0;
+  job.nwritten = 0;
+  job.window   = 4 * f->pli->report_thr;
+  job.halt     = FALSE;
+
+  if (pthread_mutex_init(&job.mutex, NULL) != 0)    ESL_XEXCEPTION(eslESYS, "mutex init failed");
+  if (pthread_cond_init(&job.cond, NULL)   != 0)  { pthread_mutex_destroy(&job.mutex); ESL_XEXCEPTION(eslESYS, "cond init failed"); }
+
+  /* If a thread can't be started, the writer renders the chunks itself. */
+  for (t = 0; t < f->pli->report_thr; t++)
+    if (pthread_create(&tid[nthr], NULL, report_thread, &job) == 0) nthr++;
+
+  status = eslOK;
+  for (c = 0; c < job.nchunk; c++)
+    {
+      pthread_mutex_lock(&job.mutex);
+      if (job.next == c) claim_chunk(&job, c);
+      while (! job.done[c]) pthread_cond_wait(&job.cond, &job.mutex);
+      pthread_mutex_unlock(&job.mutex);
+
+      if (job.status[c] != eslOK) { status = job.status[c]; break; }
+      if (fwrite(job.buf[c], sizeof(char), job.len[c], ofp) != job.len[c]) { status = eslEWRITE; break; }
+      free(job.buf[c]);
+      job.buf[c] = NULL;
+
+      pthread_mutex_lock(&job.mutex);
+      job.nwritten++;
+      pthread_cond_broadcast(&job.cond);
+      pthread_mutex_unlock(&job.mutex);
+    }
+
+  pthread_mutex_lock(&job.mutex);
+  job.halt = TRUE;
+  pthread_cond_broadcast(&job.cond);
+  pthread_mutex_unlock(&job.mutex);
+  for (t = 0; t < nthr; t++) pthread_join(tid[t], NULL);
+  pthread_cond_destroy(&job.cond);
+  pthread_mutex_destroy(&job.mutex);
+
+  for (c = 0; c < job.nchunk; c++) free(job.buf[c]);
+  free(job.cut); free(job.buf); free(job.len); free(job.status); free(job.done);
+  free(tid);
+  if      (status == eslEWRITE) ESL_EXCEPTION_SYS(eslEWRITE, "hit list: write failed");
+  else if (status != eslOK)     ESL_EXCEPTION(status, "hit list: failed to render records");
+  return eslOK;
+
+ ERROR:
+  free(job.cut); free(job.buf); free(job.len); free(job.status); free(job.done);
+  free(tid);
+  return status;
+}
+#endif /*HMMER_THREADS && HAVE_OPEN_MEMSTREAM*/
+
+/* report_hits()
+ * Print the record of each reported hit in <f->th> to <ofp>, in
+ * rank order, using <f->print_hit()>. Renders them in parallel when
+ * the pipeline allows more than one reporting thread and there are
+ * enough of them.
+ */
+static int
+report_hits(FILE *ofp, const REPORT_FMT *f)
+{
+  int h;
+  int status;
+
+#if defined (HMMER_THREADS) && defined (HAVE_OPEN_MEMSTREAM)
+  if (f->pli->report_thr > 1 && f->th->nreported >= 2 * p7_TOPHITS_REPORTCHUNK)
+    return report_hits_threaded(ofp, f);
+#endif
+  for (h = 0; h < f->th->N; h++)
+    if (f->th->hit[h]->flags & p7_IS_REPORTED)
+      if ((status = (*f->print_hit)(ofp, f, h)) != eslOK) return status;
+  return eslOK;
+}
+
+
 /* workaround_bug_h74(): 
  * Different envelopes, identical alignment
  * 
@@ -959,8 +1641,10 @@ p7_tophits_Threshold(P7_TOPHITS *th, P7_PIPELINE *pli)
       if (th->hit[h]->flags & p7_IS_INCLUDED)  th->nincluded++;
   }
   
-  /* Now we can determined domZ, the effective search space in which additional domains are found */
-  if (pli->domZ_setby == p7_ZSETBY_NTARGETS) pli->domZ = (double) th->nreported;
+  /* Now we can determined domZ, the effective search space in which additional domains are found.
+   * Hits trimmed from a bounded list were reportable too (see p7_tophits_SetMaxHits()).
+   */
+  if (pli->domZ_setby == p7_ZSETBY_NTARGETS) pli->domZ = (double) (th->nreported + th->ntrimmed);
 
 
   /* Second pass is over domains, flagging reportable/includable ones. 
@@ -1101,6 +1785,78 @@ p7_tophits_CompareRanking(P7_TOPHITS *th, ESL_KEYHASH *kh, int *opt_nnew)
 }
 
 
+static int
+print_target(FILE *ofp, const REPORT_FMT *f, int h)
+{
+  P7_TOPHITS  *th  = f->th;
+  P7_PIPELINE *pli = f->pli;
+  char         newness;
+  int          d   = th->hit[h]->best_domain;
+  char        *showname;
+
+  if (h == f->hinc)
+    {
+      if (fprintf(ofp, "  ------ inclusion threshold ------\n") < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+    }
+
+  if (pli->show_accessions)
+    {   /* the --acc option: report accessions rather than names if possible */
+      if (th->hit[h]->acc != NULL && th->hit[h]->acc[0] != '\0') showname = th->hit[h]->acc;
+      else                                                       showname = th->hit[h]->name;
+    }
+  else
+    showname = th->hit[h]->name;
+
+  if      (th->hit[h]->flags & p7_IS_NEW)     newness = '+';
+  else if (th->hit[h]->flags & p7_IS_DROPPED) newness = '-';
+  else                                        newness = ' ';
+
+  if (pli->long_targets) 
+    {
+      if (fprintf(ofp, "%c %9.2g %6.1f %5.1f  %-*s %*" PRId64 " %*" PRId64 "",
+		  newness,
+		  exp(th->hit[h]->lnP), // * pli->Z,
+		  th->hit[h]->score,
+		  eslCONST_LOG2R * th->hit[h]->dcl[d].dombias, // an nhmmer hit is really a domain, so this is the hit's bias correction
+		  f->namew, showname,
+		  f->posw, th->hit[h]->dcl[d].iali,
+		  f->posw, th->hit[h]->dcl[d].jali) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+    }
+  else
+    {
+      if (fprintf(ofp, "%c %9.2g %6.1f %5.1f  %9.2g %6.1f %5.1f  %5.1f %2d  %-*s ",
+		  newness,
+		  exp(th->hit[h]->lnP) * pli->Z,
+		  th->hit[h]->score,
+		  th->hit[h]->pre_score - th->hit[h]->score, /* bias correction */
+		  exp(th->hit[h]->dcl[d].lnP) * pli->Z,
+		  th->hit[h]->dcl[d].bitscore,
+		  eslCONST_LOG2R * th->hit[h]->dcl[d].dombias, /* convert NATS to BITS at last moment */
+		  th->hit[h]->nexpected,
+		  th->hit[h]->nreported,
+		  f->namew, showname) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+    }
+
+  if (f->textw > 0) 
+    {
+      if (fprintf(ofp, " %-.*s\n", f->descw, th->hit[h]->desc == NULL ? "" : th->hit[h]->desc) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+    }
+  else 
+    {
+      if (fprintf(ofp, " %s\n",           th->hit[h]->desc == NULL ? "" : th->hit[h]->desc) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+    }
+  /* do NOT use *s with unlimited (INT_MAX) line length. Some systems
+   * have an fprintf() bug here (we found one on an Opteron/SUSE Linux
+   * system (#h66)
+   */
+  return eslOK;
+}
+
 /* Function:  p7_tophits_Targets()
  * Synopsis:  Format and write a top target hits list to an output stream.
  *
@@ -1112,6 +1868,9 @@ p7_tophits_CompareRanking(P7_TOPHITS *th, ESL_KEYHASH *kh, int *opt_nnew)
  *            <p7_tophits_Sort()> and thresholded (see
  *            <p7_tophits_Threshold>).
  *
+ *            If <pli->report_thr> is more than 1, a long list is
+ *            formatted on that many threads; the output is the same.
+ *
  * Returns:   <eslOK> on success.
  * 
  * Throws:    <eslEWRITE> on write failure.
@@ -1119,42 +1878,44 @@ p7_tophits_CompareRanking(P7_TOPHITS *th, ESL_KEYHASH *kh, int *opt_nnew)
 int
 p7_tophits_Targets(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw)
 {
-  char   newness;
-  int    h;
-  int    d;
-  int    namew;
-  int    posw;
-  int    descw;
-  char  *showname;
+  REPORT_FMT f;
+  int        h;
+  int        status;
 
-  int    have_printed_incthresh = FALSE;
+  f.th        = th;
+  f.pli       = pli;
+  f.textw     = textw;
+  f.print_hit = print_target;
 
   /* when --acc is on, we'll show accession if available, and fall back to name */
-  if (pli->show_accessions) namew = ESL_MAX(8, p7_tophits_GetMaxShownLength(th));
-  else                      namew = ESL_MAX(8, p7_tophits_GetMaxNameLength(th));
+  if (pli->show_accessions) f.namew = ESL_MAX(8, p7_tophits_GetMaxShownLength(th));
+  else                      f.namew = ESL_MAX(8, p7_tophits_GetMaxNameLength(th));
 
+  /* the inclusion threshold line goes above the first reported hit that isn't included */
+  for (f.hinc = -1, h = 0; h < th->N; h++)
+    if ((th->hit[h]->flags & p7_IS_REPORTED) && ! (th->hit[h]->flags & p7_IS_INCLUDED)) { f.hinc = h; break; }
 
   if (pli->long_targets) 
   {
-      posw = ESL_MAX(6, p7_tophits_GetMaxPositionLength(th));
+      f.posw = ESL_MAX(6, p7_tophits_GetMaxPositionLength(th));
 
-      if (textw >  0)           descw = ESL_MAX(32, textw - namew - 2*posw - 32); /* 32 chars excluding desc and two posw's is from the format: 2 + 9+2 +6+2 +5+2 +<name>+1 +<startpos>+1 +<endpos>+1 +1 */
-      else                      descw = 0;                               /* unlimited desc length is handled separately */
+      if (textw >  0)           f.descw = ESL_MAX(32, textw - f.namew - 2*f.posw - 32); /* 32 chars excluding desc and two posw's is from the format: 2 + 9+2 +6+2 +5+2 +<name>+1 +<startpos>+1 +<endpos>+1 +1 */
+      else                      f.descw = 0;                               /* unlimited desc length is handled separately */
 
       if (fprintf(ofp, "Scores for complete hit%s:\n",     pli->mode == p7_SEARCH_SEQS ? "s" : "") < 0)
         ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
       if (fprintf(ofp, "  %9s %6s %5s  %-*s %*s %*s  %s\n",
-      "E-value", " score", " bias", namew, (pli->mode == p7_SEARCH_SEQS ? "Sequence":"Model"), posw, "start", posw, "end", "Description") < 0)
+      "E-value", " score", " bias", f.namew, (pli->mode == p7_SEARCH_SEQS ? "Sequence":"Model"), f.posw, "start", f.posw, "end", "Description") < 0)
         ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
       if (fprintf(ofp, "  %9s %6s %5s  %-*s %*s %*s  %s\n",
-      "-------", "------", "-----", namew, "--------", posw, "-----", posw, "-----", "-----------") < 0)
+      "-------", "------", "-----", f.namew, "--------", f.posw, "-----", f.posw, "-----", "-----------") < 0)
         ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
   }
   else 
   {
-
-      if (textw >  0)           descw = ESL_MAX(32, textw - namew - 61); /* 61 chars excluding desc is from the format: 2 + 22+2 +22+2 +8+2 +<name>+1 */
-      else                      descw = 0;                               /* unlimited desc length is handled separately */
+      f.posw = 0;
+      if (textw >  0)           f.descw = ESL_MAX(32, textw - f.namew - 61); /* 61 chars excluding desc is from the format: 2 + 22+2 +22+2 +8+2 +<name>+1 */
+      else                      f.descw = 0;                               /* unlimited desc length is handled separately */
 
 
       /* The minimum width of the target table is 111 char: 47 from fields, 8 from min name, 32 from min desc, 13 spaces */
@@ -1163,92 +1924,217 @@ p7_tophits_Targets(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw)
       if (fprintf(ofp, "  %22s  %22s  %8s\n",                              " --- full sequence ---",        " --- best 1 domain ---",   "-#dom-") < 0) 
         ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
       if (fprintf(ofp, "  %9s %6s %5s  %9s %6s %5s  %5s %2s  %-*s %s\n", 
-      "E-value", " score", " bias", "E-value", " score", " bias", "  exp",  "N", namew, (pli->mode == p7_SEARCH_SEQS ? "Sequence":"Model"), "Description") < 0)
+      "E-value", " score", " bias", "E-value", " score", " bias", "  exp",  "N", f.namew, (pli->mode == p7_SEARCH_SEQS ? "Sequence":"Model"), "Description") < 0)
         ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
       if (fprintf(ofp, "  %9s %6s %5s  %9s %6s %5s  %5s %2s  %-*s %s\n", 
-      "-------", "------", "-----", "-------", "------", "-----", " ----", "--", namew, "--------", "-----------") < 0)
+      "-------", "------", "-----", "-------", "------", "-----", " ----", "--", f.namew, "--------", "-----------") < 0)
         ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
   }
 
-  for (h = 0; h < th->N; h++)
+  if ((status = report_hits(ofp, &f)) != eslOK) return status;
+
+  if (th->nreported == 0)
+    { 
+      if (fprintf(ofp, "\n   [No hits detected that satisfy reporting thresholds]\n") < 0)
+        ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+    }
+  if (th->ntrimmed > 0)
     {
-      if (th->hit[h]->flags & p7_IS_REPORTED)
-	{
-	  d    = th->hit[h]->best_domain;
+      if (fprintf(ofp, "\n   [%" PRIu64 " more hits satisfy reporting thresholds; only the top %" PRIu64 " are shown]\n", th->ntrimmed, th->maxhits) < 0)
+        ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+    }
+  return eslOK;
+}
 
-	  if (! (th->hit[h]->flags & p7_IS_INCLUDED) && ! have_printed_incthresh) 
-	    {
-	      if (fprintf(ofp, "  ------ inclusion threshold ------\n") < 0)
-		ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
-	      have_printed_incthresh = TRUE;
-	    }
 
-	  if (pli->show_accessions)
-	    {   /* the --acc option: report accessions rather than names if possible */
-	      if (th->hit[h]->acc != NULL && th->hit[h]->acc[0] != '\0') showname = th->hit[h]->acc;
-	      else                                                       showname = th->hit[h]->name;
-	    }
-	  else
-	    showname = th->hit[h]->name;
+static int
+print_domains(FILE *ofp, const REPORT_FMT *f, int h)
+{
+  P7_TOPHITS  *th  = f->th;
+  P7_PIPELINE *pli = f->pli;
+  int          d;
+  int          nd;
+  int          namew, descw;
+  char        *showname;
+  int          status;
+
+  if (pli->show_accessions && th->hit[h]->acc != NULL && th->hit[h]->acc[0] != '\0')
+    {
+      showname = th->hit[h]->acc;
+      namew    = strlen(th->hit[h]->acc);
+    }
+  else
+    {
+      showname = th->hit[h]->name;
+      namew = strlen(th->hit[h]->name);
+    }
+
+  if (f->textw > 0)
+    {
+      descw = ESL_MAX(32, f->textw - namew - 5);
+      if (fprintf(ofp, ">> %s  %-.*s\n", showname, descw, (th->hit[h]->desc == NULL ? "" : th->hit[h]->desc)) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+    }
+  else
+    {
+      if (fprintf(ofp, ">> %s  %s\n",    showname,        (th->hit[h]->desc == NULL ? "" : th->hit[h]->desc)) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+    }
+
+  if (th->hit[h]->nreported == 0)
+    {
+      if (fprintf(ofp,"   [No individual domains that satisfy reporting thresholds (although complete target did)]\n\n") < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+      return eslOK;
+    }
 
-	  if      (th->hit[h]->flags & p7_IS_NEW)     newness = '+';
-	  else if (th->hit[h]->flags & p7_IS_DROPPED) newness = '-';
-	  else                                        newness = ' ';
 
-	  if (pli->long_targets) 
+  if (pli->long_targets)
+    {
+      /* The dna hit table is 119 char wide:
+	     score  bias    Evalue hmmfrom  hmm to     alifrom    ali to      envfrom    env to       hqfrom     hq to   sq len      acc
+	     ------ ----- --------- ------- -------    --------- ---------    --------- ---------    --------- --------- ---------    ----
+	 !     82.7 104.4   4.9e-22     782     998 .. 241981174 241980968 .. 241981174 241980966 .. 241981174 241980968 234234233   0.78
+       */
+      if (fprintf(ofp, "   %6s %5s %9s %9s %9s %2s %9s %9s %2s %9s %9s    %9s %2s %4s\n",  "score",  "bias",  "  Evalue", "hmmfrom",  "hmm to", "  ", " alifrom ",  " ali to ", "  ",  " envfrom ",  " env to ",  (pli->mode == p7_SEARCH_SEQS ? "  sq len " : " mod len "), "  ",  "acc")  < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+      if (fprintf(ofp, "   %6s %5s %9s %9s %9s %2s %9s %9s %2s %9s %9s    %9s %2s %4s\n",  "------", "-----", "---------", "-------", "-------", "  ", "---------", "---------", "  ", "---------", "---------",  "---------", "  ", "----") < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+    }
+  else
+    {
+      /* The domain table is 101 char wide:
+	  #     score  bias  c-Evalue  i-Evalue hmmfrom   hmmto    alifrom  ali to    envfrom  env to     acc
+	 ---   ------ ----- --------- --------- ------- -------    ------- -------    ------- -------    ----
+	   1 ?  123.4  23.1   9.7e-11    6.8e-9       3    1230 ..       1     492 []       2     490 .] 0.90
+	 123 ! 1234.5 123.4 123456789 123456789 1234567 1234567 .. 1234567 1234567 [] 1234567 1234568 .] 0.12
+      */
+      if (fprintf(ofp, " %3s   %6s %5s %9s %9s %7s %7s %2s %7s %7s %2s %7s %7s %2s %4s\n",    "#",  "score",  "bias",  "c-Evalue",  "i-Evalue", "hmmfrom",  "hmm to", "  ", "alifrom",  "ali to", "  ", "envfrom",  "env to", "  ",  "acc")  < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+      if (fprintf(ofp, " %3s   %6s %5s %9s %9s %7s %7s %2s %7s %7s %2s %7s %7s %2s %4s\n",  "---", "------", "-----", "---------", "---------", "-------", "-------", "  ", "-------", "-------", "  ", "-------", "-------", "  ", "----")  < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+    }
+
+
+  /* Domain hit table for each reported domain in this reported sequence. */
+  nd = 0;
+  for (d = 0; d < th->hit[h]->ndom; d++)
+    {
+      if (th->hit[h]->dcl[d].is_reported)
+	{
+	  nd++;
+	  if (pli->long_targets)
 	    {
-	      if (fprintf(ofp, "%c %9.2g %6.1f %5.1f  %-*s %*" PRId64 " %*" PRId64 "",
-			  newness,
-			  exp(th->hit[h]->lnP), // * pli->Z,
-			  th->hit[h]->score,
-			  eslCONST_LOG2R * th->hit[h]->dcl[d].dombias, // an nhmmer hit is really a domain, so this is the hit's bias correction
-			  namew, showname,
-			  posw, th->hit[h]->dcl[d].iali,
-			  posw, th->hit[h]->dcl[d].jali) < 0)
-		ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+	      if (fprintf(ofp, " %c %6.1f %5.1f %9.2g %9d %9d %c%c %9" PRId64 " %9" PRId64 " %c%c %9" PRId64 " %9" PRId64 " %c%c %9" PRId64 "    %4.2f\n",
+			  //nd,
+			  th->hit[h]->dcl[d].is_included ? '!' : '?',
+			  th->hit[h]->dcl[d].bitscore,
+			  th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
+			  exp(th->hit[h]->dcl[d].lnP),
+			  th->hit[h]->dcl[d].ad->hmmfrom,
+			  th->hit[h]->dcl[d].ad->hmmto,
+			  (th->hit[h]->dcl[d].ad->hmmfrom == 1) ? '[' : '.',
+			  (th->hit[h]->dcl[d].ad->hmmto   == th->hit[h]->dcl[d].ad->M) ? ']' : '.',
+			  th->hit[h]->dcl[d].ad->sqfrom,
+			  th->hit[h]->dcl[d].ad->sqto,
+			  (th->hit[h]->dcl[d].ad->sqfrom == 1) ? '[' : '.',
+			  (th->hit[h]->dcl[d].ad->sqto   == th->hit[h]->dcl[d].ad->L) ? ']' : '.',
+			  th->hit[h]->dcl[d].ienv,
+			  th->hit[h]->dcl[d].jenv,
+			  (th->hit[h]->dcl[d].ienv == 1) ? '[' : '.',
+			  (th->hit[h]->dcl[d].jenv == th->hit[h]->dcl[d].ad->L) ? ']' : '.',
+			  th->hit[h]->dcl[d].ad->L,
+			  (th->hit[h]->dcl[d].oasc / (1.0 + fabs((float) (th->hit[h]->dcl[d].jenv - th->hit[h]->dcl[d].ienv))))) < 0)
+		ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
 	    }
 	  else
 	    {
-	      if (fprintf(ofp, "%c %9.2g %6.1f %5.1f  %9.2g %6.1f %5.1f  %5.1f %2d  %-*s ",
-			  newness,
-			  exp(th->hit[h]->lnP) * pli->Z,
-			  th->hit[h]->score,
-			  th->hit[h]->pre_score - th->hit[h]->score, /* bias correction */
-			  exp(th->hit[h]->dcl[d].lnP) * pli->Z,
+	      if (fprintf(ofp, " %3d %c %6.1f %5.1f %9.2g %9.2g %7d %7d %c%c",
+			  nd,
+			  th->hit[h]->dcl[d].is_included ? '!' : '?',
 			  th->hit[h]->dcl[d].bitscore,
-			  eslCONST_LOG2R * th->hit[h]->dcl[d].dombias, /* convert NATS to BITS at last moment */
-			  th->hit[h]->nexpected,
-			  th->hit[h]->nreported,
-			  namew, showname) < 0)
-		ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+			  th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
+			  exp(th->hit[h]->dcl[d].lnP) * pli->domZ,
+			  exp(th->hit[h]->dcl[d].lnP) * pli->Z,
+			  th->hit[h]->dcl[d].ad->hmmfrom,
+			  th->hit[h]->dcl[d].ad->hmmto,
+			  (th->hit[h]->dcl[d].ad->hmmfrom == 1) ? '[' : '.',
+			  (th->hit[h]->dcl[d].ad->hmmto   == th->hit[h]->dcl[d].ad->M ) ? ']' : '.') < 0)
+		ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+
+	      if (fprintf(ofp, " %7" PRId64 " %7" PRId64 " %c%c",
+			  th->hit[h]->dcl[d].ad->sqfrom,
+			  th->hit[h]->dcl[d].ad->sqto,
+			  (th->hit[h]->dcl[d].ad->sqfrom == 1) ? '[' : '.',
+			  (th->hit[h]->dcl[d].ad->sqto   == th->hit[h]->dcl[d].ad->L) ? ']' : '.') < 0)
+		ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+
+	      if (fprintf(ofp, " %7" PRId64 " %7" PRId64 " %c%c",
+			  th->hit[h]->dcl[d].ienv,
+			  th->hit[h]->dcl[d].jenv,
+			  (th->hit[h]->dcl[d].ienv == 1) ? '[' : '.',
+			  (th->hit[h]->dcl[d].jenv == th->hit[h]->dcl[d].ad->L) ? ']' : '.') < 0)
+		ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");                                               
+
+	      if (fprintf(ofp, " %4.2f\n",
+			  (th->hit[h]->dcl[d].oasc / (1.0 + fabs((float) (th->hit[h]->dcl[d].jenv - th->hit[h]->dcl[d].ienv))))) < 0)
+		ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
 	    }
 
-	  if (textw > 0) 
-	    {
-	      if (fprintf(ofp, " %-.*s\n", descw, th->hit[h]->desc == NULL ? "" : th->hit[h]->desc) < 0)
-		ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
-	    }
-	  else 
-	    {
-	      if (fprintf(ofp, " %s\n",           th->hit[h]->desc == NULL ? "" : th->hit[h]->desc) < 0)
-		ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
-	    }
-	  /* do NOT use *s with unlimited (INT_MAX) line length. Some systems
-	   * have an fprintf() bug here (we found one on an Opteron/SUSE Linux
-	   * system (#h66)
-	   */
 	}
-    }
+    } // end of domain table in this reported sequence.
 
-  if (th->nreported == 0)
+  /* Alignment data for each reported domain in this reported sequence. */
+  if (pli->show_alignments)
+    {
+      if (pli->long_targets)
+	{
+	  if (fprintf(ofp, "\n  Alignment:\n") < 0)
+	    ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	}
+      else
+	{
+	  if (fprintf(ofp, "\n  Alignments for each domain:\n") < 0)
+	    ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	  nd = 0;
+	}
+
+      for (d = 0; d < th->hit[h]->ndom; d++)
+	if (th->hit[h]->dcl[d].is_reported)
+	  {
+	    nd++;
+	    if (!pli->long_targets)
+	      {
+		if (fprintf(ofp, "  == domain %d", nd ) < 0)
+		  ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	      }
+	    if (fprintf(ofp, "  score: %.1f bits", th->hit[h]->dcl[d].bitscore) < 0)
+	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	    if (!pli->long_targets)
+	      {
+		if (fprintf(ofp, ";  conditional E-value: %.2g\n",  exp(th->hit[h]->dcl[d].lnP) * pli->domZ) < 0)
+		  ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	      }
+	    else
+	      {
+		if (fprintf(ofp, "\n") < 0)
+		  ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	      }
+
+	    if ((status = p7_alidisplay_Print(ofp, th->hit[h]->dcl[d].ad, 40, f->textw, pli)) != eslOK) return status;
+
+	    if (fprintf(ofp, "\n") < 0)
+	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	  }
+    }
+  else // alignment reporting is off:
     { 
-      if (fprintf(ofp, "\n   [No hits detected that satisfy reporting thresholds]\n") < 0)
-        ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+      if (fprintf(ofp, "\n") < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
     }
   return eslOK;
 }
 
-
 /* Function:  p7_tophits_Domains()
  * Synopsis:  Standard output format for top domain hits and alignments.
  *
@@ -1266,11 +2152,13 @@ p7_tophits_Targets(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw)
 int
 p7_tophits_Domains(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw)
 {
-  int   h, d;
-  int   nd;
-  int   namew, descw;
-  char *showname;
-  int   status;
+  REPORT_FMT f;
+  int        status;
+
+  f.th        = th;
+  f.pli       = pli;
+  f.textw     = textw;
+  f.print_hit = print_domains;
 
   if (pli->long_targets) 
     {
@@ -1286,185 +2174,7 @@ p7_tophits_Domains(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw)
         ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
     }
 
-  for (h = 0; h < th->N; h++)
-    if (th->hit[h]->flags & p7_IS_REPORTED)
-      {
-	if (pli->show_accessions && th->hit[h]->acc != NULL && th->hit[h]->acc[0] != '\0')
-	  {
-	    showname = th->hit[h]->acc;
-	    namew    = strlen(th->hit[h]->acc);
-	  }
-	else
-	  {
-	    showname = th->hit[h]->name;
-	    namew = strlen(th->hit[h]->name);
-	  }
-
-	if (textw > 0)
-	  {
-	    descw = ESL_MAX(32, textw - namew - 5);
-	    if (fprintf(ofp, ">> %s  %-.*s\n", showname, descw, (th->hit[h]->desc == NULL ? "" : th->hit[h]->desc)) < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	  }
-	else
-	  {
-	    if (fprintf(ofp, ">> %s  %s\n",    showname,        (th->hit[h]->desc == NULL ? "" : th->hit[h]->desc)) < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	  }
-
-	if (th->hit[h]->nreported == 0)
-	  {
-	    if (fprintf(ofp,"   [No individual domains that satisfy reporting thresholds (although complete target did)]\n\n") < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	    continue;
-	  }
-
-
-	if (pli->long_targets)
-	  {
-	    /* The dna hit table is 119 char wide:
-                   score  bias    Evalue hmmfrom  hmm to     alifrom    ali to      envfrom    env to       hqfrom     hq to   sq len      acc
-                   ------ ----- --------- ------- -------    --------- ---------    --------- ---------    --------- --------- ---------    ----
-               !     82.7 104.4   4.9e-22     782     998 .. 241981174 241980968 .. 241981174 241980966 .. 241981174 241980968 234234233   0.78
-             */
-	    if (fprintf(ofp, "   %6s %5s %9s %9s %9s %2s %9s %9s %2s %9s %9s    %9s %2s %4s\n",  "score",  "bias",  "  Evalue", "hmmfrom",  "hmm to", "  ", " alifrom ",  " ali to ", "  ",  " envfrom ",  " env to ",  (pli->mode == p7_SEARCH_SEQS ? "  sq len " : " mod len "), "  ",  "acc")  < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	    if (fprintf(ofp, "   %6s %5s %9s %9s %9s %2s %9s %9s %2s %9s %9s    %9s %2s %4s\n",  "------", "-----", "---------", "-------", "-------", "  ", "---------", "---------", "  ", "---------", "---------",  "---------", "  ", "----") < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	  }
-	else
-	  {
-	    /* The domain table is 101 char wide:
-                #     score  bias  c-Evalue  i-Evalue hmmfrom   hmmto    alifrom  ali to    envfrom  env to     acc
-               ---   ------ ----- --------- --------- ------- -------    ------- -------    ------- -------    ----
-                 1 ?  123.4  23.1   9.7e-11    6.8e-9       3    1230 ..       1     492 []       2     490 .] 0.90
-               123 ! 1234.5 123.4 123456789 123456789 1234567 1234567 .. 1234567 1234567 [] 1234567 1234568 .] 0.12
-	    */
-	    if (fprintf(ofp, " %3s   %6s %5s %9s %9s %7s %7s %2s %7s %7s %2s %7s %7s %2s %4s\n",    "#",  "score",  "bias",  "c-Evalue",  "i-Evalue", "hmmfrom",  "hmm to", "  ", "alifrom",  "ali to", "  ", "envfrom",  "env to", "  ",  "acc")  < 0)
-              ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	    if (fprintf(ofp, " %3s   %6s %5s %9s %9s %7s %7s %2s %7s %7s %2s %7s %7s %2s %4s\n",  "---", "------", "-----", "---------", "---------", "-------", "-------", "  ", "-------", "-------", "  ", "-------", "-------", "  ", "----")  < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	  }
-		
-	  
-	/* Domain hit table for each reported domain in this reported sequence. */
-	nd = 0;
-	for (d = 0; d < th->hit[h]->ndom; d++)
-	  {
-	    if (th->hit[h]->dcl[d].is_reported)
-	      {
-		nd++;
-		if (pli->long_targets)
-		  {
-		    if (fprintf(ofp, " %c %6.1f %5.1f %9.2g %9d %9d %c%c %9" PRId64 " %9" PRId64 " %c%c %9" PRId64 " %9" PRId64 " %c%c %9" PRId64 "    %4.2f\n",
-				//nd,
-				th->hit[h]->dcl[d].is_included ? '!' : '?',
-				th->hit[h]->dcl[d].bitscore,
-				th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
-				exp(th->hit[h]->dcl[d].lnP),
-				th->hit[h]->dcl[d].ad->hmmfrom,
-				th->hit[h]->dcl[d].ad->hmmto,
-				(th->hit[h]->dcl[d].ad->hmmfrom == 1) ? '[' : '.',
-				(th->hit[h]->dcl[d].ad->hmmto   == th->hit[h]->dcl[d].ad->M) ? ']' : '.',
-				th->hit[h]->dcl[d].ad->sqfrom,
-				th->hit[h]->dcl[d].ad->sqto,
-				(th->hit[h]->dcl[d].ad->sqfrom == 1) ? '[' : '.',
-				(th->hit[h]->dcl[d].ad->sqto   == th->hit[h]->dcl[d].ad->L) ? ']' : '.',
-				th->hit[h]->dcl[d].ienv,
-				th->hit[h]->dcl[d].jenv,
-				(th->hit[h]->dcl[d].ienv == 1) ? '[' : '.',
-				(th->hit[h]->dcl[d].jenv == th->hit[h]->dcl[d].ad->L) ? ']' : '.',
-				th->hit[h]->dcl[d].ad->L,
-				(th->hit[h]->dcl[d].oasc / (1.0 + fabs((float) (th->hit[h]->dcl[d].jenv - th->hit[h]->dcl[d].ienv))))) < 0)
-		      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		  }
-		else
-		  {
-		    if (fprintf(ofp, " %3d %c %6.1f %5.1f %9.2g %9.2g %7d %7d %c%c",
-				nd,
-				th->hit[h]->dcl[d].is_included ? '!' : '?',
-				th->hit[h]->dcl[d].bitscore,
-				th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
-				exp(th->hit[h]->dcl[d].lnP) * pli->domZ,
-				exp(th->hit[h]->dcl[d].lnP) * pli->Z,
-				th->hit[h]->dcl[d].ad->hmmfrom,
-				th->hit[h]->dcl[d].ad->hmmto,
-				(th->hit[h]->dcl[d].ad->hmmfrom == 1) ? '[' : '.',
-				(th->hit[h]->dcl[d].ad->hmmto   == th->hit[h]->dcl[d].ad->M ) ? ']' : '.') < 0)
-		      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-			
-		    if (fprintf(ofp, " %7" PRId64 " %7" PRId64 " %c%c",
-				th->hit[h]->dcl[d].ad->sqfrom,
-				th->hit[h]->dcl[d].ad->sqto,
-				(th->hit[h]->dcl[d].ad->sqfrom == 1) ? '[' : '.',
-				(th->hit[h]->dcl[d].ad->sqto   == th->hit[h]->dcl[d].ad->L) ? ']' : '.') < 0)
-		      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-						
-		    if (fprintf(ofp, " %7" PRId64 " %7" PRId64 " %c%c",
-				th->hit[h]->dcl[d].ienv,
-				th->hit[h]->dcl[d].jenv,
-				(th->hit[h]->dcl[d].ienv == 1) ? '[' : '.',
-				(th->hit[h]->dcl[d].jenv == th->hit[h]->dcl[d].ad->L) ? ']' : '.') < 0)
-		      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");						   
-		    
-		    if (fprintf(ofp, " %4.2f\n",
-				(th->hit[h]->dcl[d].oasc / (1.0 + fabs((float) (th->hit[h]->dcl[d].jenv - th->hit[h]->dcl[d].ienv))))) < 0)
-		      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		  }
-            
-	      }
-	  } // end of domain table in this reported sequence.
-
-	/* Alignment data for each reported domain in this reported sequence. */
-	if (pli->show_alignments)
-	  {
-	    if (pli->long_targets)
-	      {
-		if (fprintf(ofp, "\n  Alignment:\n") < 0)
-		  ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	      }
-	    else
-	      {
-		if (fprintf(ofp, "\n  Alignments for each domain:\n") < 0)
-		  ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		nd = 0;
-	      }
-
-	    for (d = 0; d < th->hit[h]->ndom; d++)
-	      if (th->hit[h]->dcl[d].is_reported)
-		{
-		  nd++;
-		  if (!pli->long_targets)
-		    {
-		      if (fprintf(ofp, "  == domain %d", nd ) < 0)
-			ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		    }
-		  if (fprintf(ofp, "  score: %.1f bits", th->hit[h]->dcl[d].bitscore) < 0)
-		    ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		  if (!pli->long_targets)
-		    {
-		      if (fprintf(ofp, ";  conditional E-value: %.2g\n",  exp(th->hit[h]->dcl[d].lnP) * pli->domZ) < 0)
-			ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		    }
-		  else
-		    {
-		      if (fprintf(ofp, "\n") < 0)
-			ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		    }
-
-		  if ((status = p7_alidisplay_Print(ofp, th->hit[h]->dcl[d].ad, 40, textw, pli)) != eslOK) return status;
-		  
-		  if (fprintf(ofp, "\n") < 0)
-		    ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		}
-	  }
-	else // alignment reporting is off:
-	  { 
-	    if (fprintf(ofp, "\n") < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	  }
-
-      } // end, loop over all reported hits
+  if ((status = report_hits(ofp, &f)) != eslOK) return status;
 
   if (th->nreported == 0)
     {
@@ -1590,6 +2300,63 @@ p7_tophits_Alignment(const P7_TOPHITS *th, const ESL_ALPHABET *abc,
  * 3. Tabular (parsable) output of pipeline results.
  *****************************************************************/
 
+static int
+print_tabular_target(FILE *ofp, const REPORT_FMT *f, int h)
+{
+  P7_TOPHITS  *th    = f->th;
+  P7_PIPELINE *pli   = f->pli;
+  char        *qname = f->qname;
+  char        *qacc  = f->qacc;
+  int          d     = th->hit[h]->best_domain;
+
+  if (pli->long_targets) 
+    {
+      if (fprintf(ofp, "%-*s %-*s %-*s %-*s %7d %7d %*" PRId64 " %*" PRId64 " %*" PRId64 " %*" PRId64 " %*" PRId64 " %6s %9.2g %6.1f %5.1f  %s\n",
+		  f->tnamew, th->hit[h]->name,
+		  f->taccw,  th->hit[h]->acc ? th->hit[h]->acc : "-",
+		  f->qnamew, qname,
+		  f->qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
+		  th->hit[h]->dcl[d].ad->hmmfrom,
+		  th->hit[h]->dcl[d].ad->hmmto,
+		  f->posw, th->hit[h]->dcl[d].iali,
+		  f->posw, th->hit[h]->dcl[d].jali,
+		  f->posw, th->hit[h]->dcl[d].ienv,
+		  f->posw, th->hit[h]->dcl[d].jenv,
+		  f->posw, th->hit[h]->dcl[0].ad->L,
+		  (th->hit[h]->dcl[d].iali < th->hit[h]->dcl[d].jali ? "   +  "  :  "   -  "),
+		  exp(th->hit[h]->lnP),
+		  th->hit[h]->score,
+		  th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
+		  th->hit[h]->desc == NULL ? "-" :  th->hit[h]->desc ) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
+    }
+  else
+    {
+      if (fprintf(ofp, "%-*s %-*s %-*s %-*s %9.2g %6.1f %5.1f %9.2g %6.1f %5.1f %5.1f %3d %3d %3d %3d %3d %3d %3d %s\n",
+		  f->tnamew, th->hit[h]->name,
+		  f->taccw,  th->hit[h]->acc ? th->hit[h]->acc : "-",
+		  f->qnamew, qname,
+		  f->qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
+		  exp(th->hit[h]->lnP) * pli->Z,
+		  th->hit[h]->score,
+		  th->hit[h]->pre_score - th->hit[h]->score, /* bias correction */
+		  exp(th->hit[h]->dcl[d].lnP) * pli->Z,
+		  th->hit[h]->dcl[d].bitscore,
+		  th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
+		  th->hit[h]->nexpected,
+		  th->hit[h]->nregions,
+		  th->hit[h]->nclustered,
+		  th->hit[h]->noverlaps,
+		  th->hit[h]->nenvelopes,
+		  th->hit[h]->ndom,
+		  th->hit[h]->nreported,
+		  th->hit[h]->nincluded,
+		  (th->hit[h]->desc == NULL ? "-" : th->hit[h]->desc)) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
+    }
+  return eslOK;
+}
+
 /* Function:  p7_tophits_TabularTargets()
  * Synopsis:  Output parsable table of per-sequence hits.
  *
@@ -1614,7 +2381,19 @@ p7_tophits_TabularTargets(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7
   int qaccw  = ((qacc != NULL) ? ESL_MAX(10, strlen(qacc)) : 10);
   int taccw  = ESL_MAX(10, p7_tophits_GetMaxAccessionLength(th));
   int posw   = (pli->long_targets ? ESL_MAX(7, p7_tophits_GetMaxPositionLength(th)) : 0);
-  int h,d;
+  REPORT_FMT f;
+  int status;
+
+  f.th        = th;
+  f.pli       = pli;
+  f.qname     = qname;
+  f.qacc      = qacc;
+  f.qnamew    = qnamew;
+  f.tnamew    = tnamew;
+  f.qaccw     = qaccw;
+  f.taccw     = taccw;
+  f.posw      = posw;
+  f.print_hit = print_tabular_target;
 
   if (show_header)
   {
@@ -1640,60 +2419,64 @@ p7_tophits_TabularTargets(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7
       }
   }
 
-  for (h = 0; h < th->N; h++)
-    if (th->hit[h]->flags & p7_IS_REPORTED)    
-    {
-        d    = th->hit[h]->best_domain;
-        if (pli->long_targets) 
-        {
-            if (fprintf(ofp, "%-*s %-*s %-*s %-*s %7d %7d %*" PRId64 " %*" PRId64 " %*" PRId64 " %*" PRId64 " %*" PRId64 " %6s %9.2g %6.1f %5.1f  %s\n",
-                tnamew, th->hit[h]->name,
-                taccw,  th->hit[h]->acc ? th->hit[h]->acc : "-",
-                qnamew, qname,
-                qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
-                th->hit[h]->dcl[d].ad->hmmfrom,
-                th->hit[h]->dcl[d].ad->hmmto,
-                posw, th->hit[h]->dcl[d].iali,
-                posw, th->hit[h]->dcl[d].jali,
-                posw, th->hit[h]->dcl[d].ienv,
-                posw, th->hit[h]->dcl[d].jenv,
-                posw, th->hit[h]->dcl[0].ad->L,
-                (th->hit[h]->dcl[d].iali < th->hit[h]->dcl[d].jali ? "   +  "  :  "   -  "),
-                exp(th->hit[h]->lnP),
-                th->hit[h]->score,
-                th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
-                th->hit[h]->desc == NULL ? "-" :  th->hit[h]->desc ) < 0)
-                  ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
-        }
-        else
-        {
-                if (fprintf(ofp, "%-*s %-*s %-*s %-*s %9.2g %6.1f %5.1f %9.2g %6.1f %5.1f %5.1f %3d %3d %3d %3d %3d %3d %3d %s\n",
-                tnamew, th->hit[h]->name,
-                taccw,  th->hit[h]->acc ? th->hit[h]->acc : "-",
-                qnamew, qname,
-                qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
-                exp(th->hit[h]->lnP) * pli->Z,
-                th->hit[h]->score,
-                th->hit[h]->pre_score - th->hit[h]->score, /* bias correction */
-                exp(th->hit[h]->dcl[d].lnP) * pli->Z,
-                th->hit[h]->dcl[d].bitscore,
-                th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
-                th->hit[h]->nexpected,
-                th->hit[h]->nregions,
-                th->hit[h]->nclustered,
-                th->hit[h]->noverlaps,
-                th->hit[h]->nenvelopes,
-                th->hit[h]->ndom,
-                th->hit[h]->nreported,
-                th->hit[h]->nincluded,
-                (th->hit[h]->desc == NULL ? "-" : th->hit[h]->desc)) < 0)
-                  ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
-        }
-    }
+  if ((status = report_hits(ofp, &f)) != eslOK) return status;
   return eslOK;
 }
 
 
+static int
+print_tabular_domains(FILE *ofp, const REPORT_FMT *f, int h)
+{
+  P7_TOPHITS  *th    = f->th;
+  P7_PIPELINE *pli   = f->pli;
+  char        *qname = f->qname;
+  char        *qacc  = f->qacc;
+  int          tlen, qlen;
+  int          d, nd;
+
+  nd = 0;
+  for (d = 0; d < th->hit[h]->ndom; d++)
+    if (th->hit[h]->dcl[d].is_reported)
+      {
+	nd++;
+
+	/* in hmmsearch, targets are seqs and queries are HMMs;
+	 * in hmmscan, the reverse.  but in the ALIDISPLAY
+	 * structure, lengths L and M are for seq and HMMs, not
+	 * for query and target, so sort it out.
+	 */
+	if (pli->mode == p7_SEARCH_SEQS) { qlen = th->hit[h]->dcl[d].ad->M; tlen = th->hit[h]->dcl[d].ad->L;  }
+	else                             { qlen = th->hit[h]->dcl[d].ad->L; tlen = th->hit[h]->dcl[d].ad->M;  }
+
+	if (fprintf(ofp, "%-*s %-*s %5d %-*s %-*s %5d %9.2g %6.1f %5.1f %3d %3d %9.2g %9.2g %6.1f %5.1f %5d %5d %5" PRId64 " %5" PRId64 " %5" PRId64 " %5" PRId64 " %4.2f %s\n",
+		    f->tnamew, th->hit[h]->name,
+		    f->taccw,  th->hit[h]->acc ? th->hit[h]->acc : "-",
+		    tlen,
+		    f->qnamew, qname,
+		    f->qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
+		    qlen,
+		    exp(th->hit[h]->lnP) * pli->Z,
+		    th->hit[h]->score,
+		    th->hit[h]->pre_score - th->hit[h]->score, /* bias correction */
+		    nd,
+		    th->hit[h]->nreported,
+		    exp(th->hit[h]->dcl[d].lnP) * pli->domZ,
+		    exp(th->hit[h]->dcl[d].lnP) * pli->Z,
+		    th->hit[h]->dcl[d].bitscore,
+		    th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* NATS to BITS at last moment */
+		    th->hit[h]->dcl[d].ad->hmmfrom,
+		    th->hit[h]->dcl[d].ad->hmmto,
+		    th->hit[h]->dcl[d].ad->sqfrom,
+		    th->hit[h]->dcl[d].ad->sqto,
+		    th->hit[h]->dcl[d].ienv,
+		    th->hit[h]->dcl[d].jenv,
+		    (th->hit[h]->dcl[d].oasc / (1.0 + fabs((float) (th->hit[h]->dcl[d].jenv - th->hit[h]->dcl[d].ienv)))),
+		    (th->hit[h]->desc ?  th->hit[h]->desc : "-")) < 0)
+	  ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
+      }
+  return eslOK;
+}
+
 /* Function:  p7_tophits_TabularDomains()
  * Synopsis:  Output parseable table of per-domain hits
  *
@@ -1718,8 +2501,18 @@ p7_tophits_TabularDomains(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7
   int tnamew = ESL_MAX(20, p7_tophits_GetMaxNameLength(th));
   int qaccw  = (qacc ? ESL_MAX(10, strlen(qacc)) : 10);
   int taccw  = ESL_MAX(10, p7_tophits_GetMaxAccessionLength(th));
-  int tlen, qlen;
-  int h,d,nd;
+  REPORT_FMT f;
+  int status;
+
+  f.th        = th;
+  f.pli       = pli;
+  f.qname     = qname;
+  f.qacc      = qacc;
+  f.qnamew    = qnamew;
+  f.tnamew    = tnamew;
+  f.qaccw     = qaccw;
+  f.taccw     = taccw;
+  f.print_hit = print_tabular_domains;
 
   if (show_header)
     {
@@ -1733,53 +2526,7 @@ p7_tophits_TabularDomains(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7
            ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
     }
 
-  for (h = 0; h < th->N; h++)
-    if (th->hit[h]->flags & p7_IS_REPORTED)
-    {
-        nd = 0;
-        for (d = 0; d < th->hit[h]->ndom; d++)
-          if (th->hit[h]->dcl[d].is_reported)
-          {
-              nd++;
-
-              /* in hmmsearch, targets are seqs and queries are HMMs;
-               * in hmmscan, the reverse.  but in the ALIDISPLAY
-               * structure, lengths L and M are for seq and HMMs, not
-               * for query and target, so sort it out.
-               */
-              if (pli->mode == p7_SEARCH_SEQS) { qlen = th->hit[h]->dcl[d].ad->M; tlen = th->hit[h]->dcl[d].ad->L;  }
-              else                             { qlen = th->hit[h]->dcl[d].ad->L; tlen = th->hit[h]->dcl[d].ad->M;  }
-
-
-
-              if (fprintf(ofp, "%-*s %-*s %5d %-*s %-*s %5d %9.2g %6.1f %5.1f %3d %3d %9.2g %9.2g %6.1f %5.1f %5d %5d %5" PRId64 " %5" PRId64 " %5" PRId64 " %5" PRId64 " %4.2f %s\n",
-                tnamew, th->hit[h]->name,
-                taccw,  th->hit[h]->acc ? th->hit[h]->acc : "-",
-                tlen,
-                qnamew, qname,
-                qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
-                qlen,
-                exp(th->hit[h]->lnP) * pli->Z,
-                th->hit[h]->score,
-                th->hit[h]->pre_score - th->hit[h]->score, /* bias correction */
-                nd,
-                th->hit[h]->nreported,
-                exp(th->hit[h]->dcl[d].lnP) * pli->domZ,
-                exp(th->hit[h]->dcl[d].lnP) * pli->Z,
-                th->hit[h]->dcl[d].bitscore,
-                th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* NATS to BITS at last moment */
-                th->hit[h]->dcl[d].ad->hmmfrom,
-                th->hit[h]->dcl[d].ad->hmmto,
-                th->hit[h]->dcl[d].ad->sqfrom,
-                th->hit[h]->dcl[d].ad->sqto,
-                th->hit[h]->dcl[d].ienv,
-                th->hit[h]->dcl[d].jenv,
-                (th->hit[h]->dcl[d].oasc / (1.0 + fabs((float) (th->hit[h]->dcl[d].jenv - th->hit[h]->dcl[d].ienv)))),
-                (th->hit[h]->desc ?  th->hit[h]->desc : "-")) < 0)
-                  ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
-
-          }
-      }
+  if ((status = report_hits(ofp, &f)) != eslOK) return status;
   return eslOK;
 }
 
@@ -1945,6 +2692,7 @@ p7_tophits_TabularXfam(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PI
       }
       free (domHitlist->unsrt);
       free (domHitlist->hit);
+      p7_arena_Destroy(domHitlist->arena);
       free (domHitlist);
   }
   return eslOK;
@@ -1954,6 +2702,7 @@ p7_tophits_TabularXfam(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PI
   {
       free (domHitlist->unsrt);
       free (domHitlist->hit);
+      p7_arena_Destroy(domHitlist->arena);
       free (domHitlist);
   }
   return status;
@@ -2193,6 +2942,172 @@ static ESL_OPTIONS options[] = {
 static char usage[]  = "[-options]";
 static char banner[] = "test driver for P7_TOPHITS";
 
+static int
+cmp_keys_descending(const void *vp1, const void *vp2)
+{
+  double k1 = *((double *) vp1);
+  double k2 = *((double *) vp2);
+  return (k1 < k2 ? 1 : (k1 > k2 ? -1 : 0));
+}
+
+/* utest_trim()
+ * Stream <N> random hits through a list bounded to <K>, the way the
+ * pipeline does, and merge in an unbounded list too. The bounded list
+ * must end up with exactly the top <K> of everything, with names
+ * intact after being copied between arenas, and must count the rest
+ * as trimmed.
+ */
+static void
+utest_trim(ESL_RANDOMNESS *r, int N, int K)
+{
+  char        msg[] = "tophits trim unit test failed";
+  P7_TOPHITS *h1    = p7_tophits_Create();
+  P7_TOPHITS *h2    = p7_tophits_Create();
+  double     *keys  = malloc(sizeof(double) * 2 * N);
+  double     *top   = malloc(sizeof(double) * 2 * N);
+  char        name[32];
+  int         i;
+
+  if (!h1 || !h2 || !keys || !top) esl_fatal(msg);
+  if (p7_tophits_SetMaxHits(h1, K) != eslOK) esl_fatal(msg);
+
+  for (i = 0; i < 2*N; i++)
+    {
+      keys[i] = top[i] = esl_random(r);
+      snprintf(name, 32, "%d", i);
+      if (i < N)
+	{
+	  if (! p7_tophits_Admit(h1, keys[i])) continue;
+	  if (p7_tophits_Add(h1, name, NULL, NULL, keys[i], (float) keys[i], keys[i], (float) keys[i], keys[i], i, i, N, i, i, N, 1, 1, NULL) != eslOK) esl_fatal(msg);
+	  if (h1->N >= 2*K && p7_tophits_Trim(h1) != eslOK) esl_fatal(msg);
+	  if (h1->N >= 2*K) esl_fatal(msg);
+	}
+      else if (p7_tophits_Add(h2, name, NULL, NULL, keys[i], (float) keys[i], keys[i], (float) keys[i], keys[i], i, i, N, i, i, N, 1, 1, NULL) != eslOK) esl_fatal(msg);
+    }
+
+  if (p7_tophits_Merge(h1, h2)    != eslOK) esl_fatal(msg);
+  if (h1->N                       != ESL_MIN(K, 2*N))     esl_fatal(msg);
+  if (h1->N + h1->ntrimmed        != 2*N)                 esl_fatal(msg);
+  if (! h1->is_sorted_by_sortkey)                         esl_fatal(msg);
+
+  qsort(top, 2*N, sizeof(double), cmp_keys_descending);
+  for (i = 0; i < h1->N; i++)
+    {
+      if (h1->hit[i]->sortkey != top[i])                  esl_fatal(msg);
+      if (keys[atoi(h1->hit[i]->name)] != top[i])         esl_fatal(msg);
+    }
+
+  p7_tophits_Destroy(h1);
+  p7_tophits_Destroy(h2);
+  free(keys);
+  free(top);
+}
+
+/* utest_mergen()
+ * Scatter <N> random hits over <k>+1 lists of random sizes, some
+ * empty, and merge them all with p7_tophits_MergeN() on <nthreads>
+ * threads. Every hit must come out exactly once, in sorted order.
+ */
+static void
+utest_mergen(ESL_RANDOMNESS *r, int N, int k, int nthreads)
+{
+  char         msg[] = "tophits k-way merge unit test failed";
+  P7_TOPHITS **hv    = malloc(sizeof(P7_TOPHITS *) * (k+1));
+  char        *seen  = calloc(N, sizeof(char));
+  char         name[32];
+  double       key;
+  int          i, j;
+
+  if (!hv || !seen) esl_fatal(msg);
+  for (j = 0; j <= k; j++)
+    if ((hv[j] = p7_tophits_Create()) == NULL) esl_fatal(msg);
+
+  for (i = 0; i < N; i++)
+    {
+      j   = (k > 1 && esl_random(r) < 0.5) ? 1 : esl_rnd_Roll(r, k+1);  /* list 1 gets more; some may get none */
+      key = esl_random(r);
+      snprintf(name, 32, "%d", i);
+      if (p7_tophits_Add(hv[j], name, NULL, NULL, key, (float) key, key, (float) key, key, i, i, N, i, i, N, 1, 1, NULL) != eslOK) esl_fatal(msg);
+    }
+  for (j = 1; j <= k; j++)
+    if (esl_random(r) < 0.5) p7_tophits_SortBySortkey(hv[j]);  /* MergeN must sort the others itself */
+
+  if (p7_tophits_MergeN(hv[0], hv+1, k, nthreads) != eslOK) esl_fatal(msg);
+  if (hv[0]->N != N)                                         esl_fatal(msg);
+  for (i = 0; i < N; i++)
+    {
+      if (i > 0 && hv[0]->hit[i-1]->sortkey < hv[0]->hit[i]->sortkey) esl_fatal(msg);
+      j = atoi(hv[0]->hit[i]->name);
+      if (j < 0 || j >= N || seen[j]) esl_fatal(msg);
+      seen[j] = 1;
+    }
+
+  for (j = 0; j <= k; j++) p7_tophits_Destroy(hv[j]);
+  free(hv);
+  free(seen);
+}
+
+/* utest_report()
+ * Reports formatted on several threads must be byte-identical to
+ * the same reports formatted serially.
+ */
+static void
+report_all(FILE *fp, P7_TOPHITS *th, P7_PIPELINE *pli, int nthreads)
+{
+  char msg[] = "tophits report unit test failed";
+
+  pli->report_thr = nthreads;
+  if (p7_tophits_Targets       (fp, th, pli, 120)                    != eslOK) esl_fatal(msg);
+  if (p7_tophits_Targets       (fp, th, pli, 0)                      != eslOK) esl_fatal(msg);
+  if (p7_tophits_Domains       (fp, th, pli, 120)                    != eslOK) esl_fatal(msg);
+  if (p7_tophits_TabularTargets(fp, "query", "QACC", th, pli, TRUE)  != eslOK) esl_fatal(msg);
+  if (p7_tophits_TabularDomains(fp, "query", NULL,   th, pli, FALSE) != eslOK) esl_fatal(msg);
+  rewind(fp);
+}
+
+static void
+utest_report(ESL_RANDOMNESS *r, int N, int nthreads)
+{
+  char         msg[] = "tophits report unit test failed";
+  P7_TOPHITS  *th    = p7_tophits_Create();
+  P7_PIPELINE *pli   = p7_pipeline_Create(NULL, 100, 100, FALSE, p7_SEARCH_SEQS);
+  FILE        *fp1   = tmpfile();
+  FILE        *fp2   = tmpfile();
+  char         name[32];
+  double       key;
+  int          c1, c2;
+  int          i;
+
+  if (!th || !pli || !fp1 || !fp2) esl_fatal(msg);
+  for (i = 0; i < N; i++)
+    {
+      key = esl_random(r);
+      snprintf(name, 32, "seq%d", i);
+      if (p7_tophits_Add(th, name, (i % 3 ? name : NULL), (i % 5 ? "a description" : NULL), key, 100. * key, -100. * key, 0., 0., i, i, N, i, i, N, 1, 1, NULL) != eslOK) esl_fatal(msg);
+      if ((th->unsrt[i].dcl = p7_arena_Alloc(th->arena, sizeof(P7_DOMAIN))) == NULL) esl_fatal(msg);
+      memset(th->unsrt[i].dcl, 0, sizeof(P7_DOMAIN));
+      th->unsrt[i].dcl[0].bitscore = 100. * key;
+      th->unsrt[i].dcl[0].lnP      = -100. * key;
+      if (esl_random(r) < 0.9) { th->unsrt[i].flags |= p7_IS_REPORTED; th->nreported++; }
+      if (key > 0.5)             th->unsrt[i].flags |= p7_IS_INCLUDED;
+    }
+  p7_tophits_SortBySortkey(th);
+  pli->Z = pli->domZ = N;
+
+  report_all(fp1, th, pli, 1);
+  report_all(fp2, th, pli, nthreads);
+  do {
+    c1 = fgetc(fp1);
+    c2 = fgetc(fp2);
+    if (c1 != c2) esl_fatal(msg);
+  } while (c1 != EOF);
+
+  fclose(fp1);
+  fclose(fp2);
+  p7_pipeline_Destroy(pli);
+  p7_tophits_Destroy(th);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -2238,6 +3153,13 @@ main(int argc, char **argv)
   
   if (p7_tophits_GetMaxNameLength(h3) != strlen(name)) esl_fatal("GetMaxNameLength() failed");
 
+  utest_trim(r, N, N/4+1);
+  utest_trim(r, N, 2*N+1);
+  utest_mergen(r, N, 7, 1);
+  utest_mergen(r, 4 * p7_TOPHITS_MERGECHUNK + N, 7, 4);  /* big enough to merge in parallel */
+  utest_report(r, N, 4);
+  utest_report(r, 10 * p7_TOPHITS_REPORTCHUNK + N, 4);    /* big enough to format in parallel */
+
   p7_tophits_Destroy(h1);
   p7_tophits_Destroy(h2);
   p7_tophits_Destroy(h3);
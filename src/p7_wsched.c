@@ -0,0 +1,383 @@
+/* P7_WSCHED: a work-stealing scheduler over a range of target indices.
+ *
+ * A pressed sequence database (see p7_dsqdb.c) can hand out any
+ * target by its index, so worker threads don't need a reader thread
+ * to parse blocks for them and a shared queue to pass them on. The
+ * scheduler deals the range of indices to be searched into one
+ * contiguous deque per worker. A worker takes indices from the front
+ * of its own deque; once that is empty, it steals the back half of
+ * another worker's deque. Each deque has its own mutex, which its
+ * owner holds only briefly and which is contended only while
+ * stealing, near the end of the search.
+ *
+ * Takes shrink geometrically as a deque runs down, so the last
+ * indices of a deque go one at a time: a worker that happens to
+ * hold a few long, high-scoring targets doesn't keep the targets
+ * behind them from the other workers.
+ *
+ * Contents:
+ *    1. The P7_WSCHED object.
+ *    2. Unit tests.
+ *    3. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "easel.h"
+
+#include "hmmer.h"
+#include "p7_wsched.h"
+
+#ifdef HMMER_THREADS
+
+/*****************************************************************
+ * 1. The P7_WSCHED object.
+ *****************************************************************/
+
+static int64_t take_size(int64_t n, int64_t grain);
+
+/* Function:  p7_wsched_Create()
+ * Synopsis:  Create a work-stealing scheduler for <nworkers> threads.
+ *
+ * Purpose:   Create a scheduler with one empty deque for each of
+ *            <nworkers> worker threads, numbered 0..nworkers-1.
+ *            Deal it a range of indices with <p7_wsched_Reset()>.
+ *
+ * Returns:   a pointer to the new scheduler.
+ *
+ * Throws:    <NULL> on allocation or mutex initialization failure.
+ */
+P7_WSCHED *
+p7_wsched_Create(int nworkers)
+{
+  P7_WSCHED *ws = NULL;
+  int        w;
+  int        status;
+
+  ESL_ALLOC(ws, sizeof(P7_WSCHED));
+  ws->dq       = NULL;
+  ws->nworkers = 0;
+  ws->grain    = 1;
+
+  ESL_ALLOC(ws->dq, sizeof(P7_WDEQUE) * nworkers);
+  for (w = 0; w < nworkers; w++)
+    {
+      if (pthread_mutex_init(&(ws->dq[w].mutex), NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+      ws->dq[w].lo = ws->dq[w].hi = 0;
+      ws->nworkers++;
+    }
+  return ws;
+
+ ERROR:
+  p7_wsched_Destroy(ws);
+  return NULL;
+}
+
+
+/* Function:  p7_wsched_Reset()
+ * Synopsis:  Deal a range of indices out to the workers.
+ *
+ * Purpose:   Deal indices <from>..<to>-1 out to the deques of <ws>,
+ *            in contiguous, near-equal ranges: worker 0 gets the
+ *            first, and so on. A worker's ordinary take from its own
+ *            deque is set to about 1/<p7_WSCHED_NTAKES> of its range,
+ *            at least 1 and at most <maxgrain>, which the caller
+ *            sets to the most indices it can handle at once (the
+ *            size of its sequence block, say).
+ *
+ *            Must not be called while workers are using <ws>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_wsched_Reset(P7_WSCHED *ws, int64_t from, int64_t to, int64_t maxgrain)
+{
+  int64_t n = ESL_MAX(0, to - from);
+  int     w;
+
+  ws->grain = n / ((int64_t) ws->nworkers * p7_WSCHED_NTAKES);
+  ws->grain = ESL_MAX(1, ESL_MIN(maxgrain, ws->grain));
+
+  for (w = 0; w < ws->nworkers; w++)
+    {
+      ws->dq[w].lo = from + n *  w    / ws->nworkers;
+      ws->dq[w].hi = from + n * (w+1) / ws->nworkers;
+    }
+  return eslOK;
+}
+
+
+/* Function:  p7_wsched_Next()
+ * Synopsis:  Get worker <w>'s next range of indices.
+ *
+ * Purpose:   Worker <w> asks for work. It takes up to <ws->grain>
+ *            indices from the front of its own deque; fewer, as the
+ *            deque runs down. If its deque is empty, it steals the
+ *            back half of the next nonempty deque after its own,
+ *            keeps one take of it, and puts the rest in its own
+ *            deque, where others can steal it in turn.
+ *
+ *            The range is returned as <*ret_lo>..<*ret_hi>-1, and
+ *            belongs to worker <w> alone.
+ *
+ *            Each worker must only ask with its own <w>.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEOF> if every deque is empty; <*ret_lo> and
+ *            <*ret_hi> are 0. Indices still out are all in the hands
+ *            of other workers, so the caller is done.
+ *
+ * Throws:    <eslESYS> if a mutex operation fails.
+ */
+int
+p7_wsched_Next(P7_WSCHED *ws, int w, int64_t *ret_lo, int64_t *ret_hi)
+{
+  P7_WDEQUE *own = ws->dq + w;
+  P7_WDEQUE *vic;
+  int64_t    lo, hi, n, k;
+  int        v;
+
+  *ret_lo = *ret_hi = 0;
+
+  /* our own deque, from the front */
+  if (pthread_mutex_lock(&own->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+  k        = take_size(own->hi - own->lo, ws->grain);
+  lo       = own->lo;
+  own->lo += k;
+  if (pthread_mutex_unlock(&own->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+
+  if (k > 0) { *ret_lo = lo; *ret_hi = lo + k; return eslOK; }
+
+  /* it's empty: steal the back half of someone else's */
+  n  = 0;
+  hi = 0;
+  for (v = (w+1) % ws->nworkers; v != w; v = (v+1) % ws->nworkers)
+    {
+      vic = ws->dq + v;
+      if (pthread_mutex_lock(&vic->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+      n        = (vic->hi - vic->lo + 1) / 2;
+      hi       = vic->hi;
+      vic->hi -= n;
+      if (pthread_mutex_unlock(&vic->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+      if (n > 0) break;
+    }
+  if (n == 0) return eslEOF;
+
+  /* keep one take of it; the rest becomes our own deque */
+  lo = hi - n;
+  k  = take_size(n, ws->grain);
+  if (pthread_mutex_lock(&own->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+  own->lo = lo + k;
+  own->hi = hi;
+  if (pthread_mutex_unlock(&own->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+
+  *ret_lo = lo;
+  *ret_hi = lo + k;
+  return eslOK;
+}
+
+
+/* Function:  p7_wsched_Destroy()
+ * Synopsis:  Free a work-stealing scheduler.
+ */
+void
+p7_wsched_Destroy(P7_WSCHED *ws)
+{
+  int w;
+
+  if (ws == NULL) return;
+  if (ws->dq)
+    {
+      for (w = 0; w < ws->nworkers; w++) pthread_mutex_destroy(&(ws->dq[w].mutex));
+      free(ws->dq);
+    }
+  free(ws);
+}
+
+
+/* take_size()
+ * How many of the <n> indices left in a deque to take at once: a full
+ * <grain> while there are plenty, then half of what's left, rounded
+ * up, so the last few go one at a time.
+ */
+static int64_t
+take_size(int64_t n, int64_t grain)
+{
+  if (n <= 0) return 0;
+  return ESL_MIN(grain, (n + 1) / 2);
+}
+/*------------------ end, P7_WSCHED object ----------------------*/
+
+
+
+/*****************************************************************
+ * 2. Unit tests.
+ *****************************************************************/
+#ifdef p7WSCHED_TESTDRIVE
+#include "esl_threads.h"
+
+struct utest_worker_s {
+  P7_WSCHED *ws;
+  int64_t    from;		/* range being searched is [from, to)      */
+  int64_t   *seen;		/* [0..to-from-1] # of times each was taken */
+  int64_t    ntaken;		/* # of indices this worker took            */
+};
+
+/* utest_worker()
+ * Drain the scheduler, counting the indices taken. Each index should
+ * be handed to exactly one worker, so writes to <seen> don't race.
+ */
+static void
+utest_worker(void *arg)
+{
+  ESL_THREADS           *obj = (ESL_THREADS *) arg;
+  struct utest_worker_s *wk;
+  int64_t                lo, hi, i;
+  int                    w;
+  int                    status;
+
+  esl_threads_Started(obj, &w);
+  wk = (struct utest_worker_s *) esl_threads_GetData(obj, w);
+
+  while ((status = p7_wsched_Next(wk->ws, w, &lo, &hi)) == eslOK)
+    {
+      if (hi <= lo || hi - lo > wk->ws->grain) esl_fatal("p7_wsched: bad range");
+      for (i = lo; i < hi; i++) wk->seen[i - wk->from]++;
+      wk->ntaken += hi - lo;
+    }
+  if (status != eslEOF) esl_fatal("p7_wsched: Next() failed");
+
+  esl_threads_Finished(obj, w);
+}
+
+/* utest_steal()
+ * One worker, asking alone, must drain all the deques by stealing,
+ * with takes no bigger than the grain.
+ */
+static void
+utest_steal(int nworkers, int64_t from, int64_t to, int64_t maxgrain)
+{
+  char       msg[] = "p7_wsched steal unit test failed";
+  P7_WSCHED *ws    = NULL;
+  int64_t   *seen  = NULL;
+  int64_t    lo, hi, i;
+  int        status;
+
+  if ((ws   = p7_wsched_Create(nworkers))              == NULL)  esl_fatal(msg);
+  if ((seen = calloc(ESL_MAX(1, to - from), sizeof(int64_t))) == NULL) esl_fatal(msg);
+  if (p7_wsched_Reset(ws, from, to, maxgrain)         != eslOK) esl_fatal(msg);
+  if (ws->grain < 1 || ws->grain > maxgrain)                    esl_fatal(msg);
+
+  while ((status = p7_wsched_Next(ws, nworkers-1, &lo, &hi)) == eslOK)
+    {
+      if (lo < from || hi > to || hi <= lo || hi - lo > ws->grain) esl_fatal(msg);
+      for (i = lo; i < hi; i++) seen[i - from]++;
+    }
+  if (status != eslEOF || lo != 0 || hi != 0) esl_fatal(msg);
+  for (i = 0; i < to - from; i++) if (seen[i] != 1) esl_fatal(msg);
+
+  /* it stays empty */
+  if (p7_wsched_Next(ws, 0, &lo, &hi) != eslEOF) esl_fatal(msg);
+
+  free(seen);
+  p7_wsched_Destroy(ws);
+}
+
+/* utest_threads()
+ * <nworkers> threads drain the scheduler together: every index is
+ * taken exactly once.
+ */
+static void
+utest_threads(int nworkers, int64_t from, int64_t to)
+{
+  char                   msg[] = "p7_wsched threads unit test failed";
+  P7_WSCHED             *ws    = NULL;
+  ESL_THREADS           *obj   = NULL;
+  struct utest_worker_s *wk    = NULL;
+  int64_t               *seen  = NULL;
+  int64_t                ntot  = 0;
+  int64_t                i;
+  int                    w;
+
+  if ((ws   = p7_wsched_Create(nworkers))                       == NULL) esl_fatal(msg);
+  if ((obj  = esl_threads_Create(&utest_worker))                == NULL) esl_fatal(msg);
+  if ((wk   = malloc(sizeof(struct utest_worker_s) * nworkers)) == NULL) esl_fatal(msg);
+  if ((seen = calloc(ESL_MAX(1, to - from), sizeof(int64_t)))   == NULL) esl_fatal(msg);
+
+  p7_wsched_Reset(ws, from, to, 100);
+  for (w = 0; w < nworkers; w++)
+    {
+      wk[w].ws     = ws;
+      wk[w].from   = from;
+      wk[w].seen   = seen;
+      wk[w].ntaken = 0;
+      esl_threads_AddThread(obj, &wk[w]);
+    }
+  esl_threads_WaitForStart(obj);
+  esl_threads_WaitForFinish(obj);
+
+  for (w = 0; w < nworkers; w++) ntot += wk[w].ntaken;
+  if (ntot != to - from) esl_fatal(msg);
+  for (i = 0; i < to - from; i++) if (seen[i] != 1) esl_fatal(msg);
+
+  free(seen);
+  free(wk);
+  esl_threads_Destroy(obj);
+  p7_wsched_Destroy(ws);
+}
+#endif /*p7WSCHED_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+#endif /*HMMER_THREADS*/
+
+
+
+/*****************************************************************
+ * 3. Test driver.
+ *****************************************************************/
+#ifdef p7WSCHED_TESTDRIVE
+/* gcc -g -Wall -Dp7WSCHED_TESTDRIVE -I. -I../easel -L. -L../easel -o p7_wsched_utest p7_wsched.c -lhmmer -leasel -lm -lpthread
+ */
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name  type         default  env   range togs  reqs  incomp  help                    docgrp */
+  {"-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",            0},
+  {"-N",  eslARG_INT,  "100000", NULL, "n>0",NULL, NULL, NULL, "number of indices to schedule",  0},
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the work-stealing scheduler";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS *go = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+#ifdef HMMER_THREADS
+  int64_t      N  = esl_opt_GetInteger(go, "-N");
+#endif
+
+  fprintf(stderr, "## %s\n", argv[0]);
+
+#ifdef HMMER_THREADS
+  utest_steal(1,  0,  N,  1000);
+  utest_steal(8,  5,  5+N, 1000);
+  utest_steal(8,  0,  3,  1000); /* fewer indices than workers */
+  utest_steal(4,  7,  7,  1000); /* nothing to do */
+  utest_steal(16, 0,  N,  1);
+
+  utest_threads(1, 0, N);
+  utest_threads(8, 3, 3+N);
+  utest_threads(8, 0, 5);
+#else
+  fprintf(stderr, "#  (no threads: nothing to test)\n");
+#endif
+
+  fprintf(stderr, "#  status = ok\n");
+
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7WSCHED_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
@@ -0,0 +1,40 @@
+/* P7_WSCHED: a work-stealing scheduler that deals a range of target
+ * indices out to worker threads.
+ */
+#ifndef P7_WSCHED_INCLUDED
+#define P7_WSCHED_INCLUDED
+
+#include <p7_config.h>
+
+#ifdef HMMER_THREADS
+#include <stdint.h>
+#include <pthread.h>
+
+/* p7_wsched_Reset() sizes a worker's ordinary take so that each one
+ * makes about this many takes from its own deque.
+ */
+#define p7_WSCHED_NTAKES 64
+
+/* One worker's deque: a contiguous range of indices. The owner takes
+ * from the front, thieves from the back.
+ */
+typedef struct {
+  pthread_mutex_t  mutex;	/* guards <lo>, <hi>                             */
+  int64_t          lo;		/* the worker's remaining indices are [lo, hi)  */
+  int64_t          hi;
+  char             pad[64];	/* keeps hot fields of adjacent deques on different cache lines */
+} P7_WDEQUE;
+
+typedef struct {
+  P7_WDEQUE *dq;		/* [0..nworkers-1] one deque per worker          */
+  int        nworkers;
+  int64_t    grain;		/* most indices a worker takes from its own deque at once */
+} P7_WSCHED;
+
+extern P7_WSCHED *p7_wsched_Create (int nworkers);
+extern int        p7_wsched_Reset  (P7_WSCHED *ws, int64_t from, int64_t to, int64_t maxgrain);
+extern int        p7_wsched_Next   (P7_WSCHED *ws, int w, int64_t *ret_lo, int64_t *ret_hi);
+extern void       p7_wsched_Destroy(P7_WSCHED *ws);
+
+#endif /*HMMER_THREADS*/
+#endif /*P7_WSCHED_INCLUDED*/
@@ -29,15 +29,22 @@
 #endif
 
 #include "hmmer.h"
+#include "p7_dsqdb.h"
+#include "p7_pstage.h"
+#include "p7_wsched.h"
 
 typedef struct {
 #ifdef HMMER_THREADS
   ESL_WORK_QUEUE   *queue;
+  P7_WSCHED        *wsched;      /* work-stealing scheduler over <dsqdb>, or NULL to use <queue> */
+  P7_PSTAGE        *pstage;      /* staged search (--postcpu): queue to postprocessing threads, or NULL */
 #endif
   P7_BG            *bg;
   P7_PIPELINE      *pli;
   P7_TOPHITS       *th;
   P7_OPROFILE      *om;
+  P7_DSQDB         *dsqdb;       /* pressed target database, or NULL */
+  int               do_lsort;    /* TRUE to search each block in order of target length */
 } WORKER_INFO;
 
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
@@ -63,6 +70,7 @@ static ESL_OPTIONS options[] = {
   { "--tblout",     eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,  NULL,  NULL,              "save parseable table of per-sequence hits to file <f>",        2 },
   { "--domtblout",  eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,  NULL,  NULL,              "save parseable table of per-domain hits to file <f>",          2 },
   { "--pfamtblout", eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,  NULL,  NULL,              "save table of hits and domains to file, in Pfam format <f>",   2 },
+  { "--pjson",      eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,  NULL,  NULL,              "time each pipeline stage; save profiles to <f> as JSON lines", 2 },
   { "--acc",        eslARG_NONE,        FALSE, NULL, NULL,      NULL,  NULL,  NULL,              "prefer accessions over names in output",                       2 },
   { "--noali",      eslARG_NONE,        FALSE, NULL, NULL,      NULL,  NULL,  NULL,              "don't output alignments, so output is smaller",                2 },
   { "--notextw",    eslARG_NONE,         NULL, NULL, NULL,      NULL,  NULL, "--textw",          "unlimit ASCII text output line width",                         2 },
@@ -104,11 +112,14 @@ static ESL_OPTIONS options[] = {
   { "--nonull2",    eslARG_NONE,        NULL,  NULL, NULL,      NULL,  NULL,  NULL,              "turn off biased composition score corrections",               12 },
   { "-Z",           eslARG_REAL,       FALSE, NULL, "x>0",     NULL,  NULL,  NULL,              "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,       FALSE, NULL, "x>0",     NULL,  NULL,  NULL,              "set # of significant seqs, for domain E-value calculation",   12 },
+  { "--maxhits",    eslARG_INT,        FALSE, NULL, "n>0",     NULL,  "-Z",  NULL,              "keep only the top <n> hits (bounded memory; requires -Z)",     12 },
   { "--seed",       eslARG_INT,         "42",  NULL, "n>=0",    NULL,  NULL,  NULL,              "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
   { "--qformat",    eslARG_STRING,      NULL, NULL, NULL,      NULL,  NULL,  NULL,              "assert query <seqfile> is in format <s>: no autodetection",   12 },
   { "--tformat",    eslARG_STRING,      NULL, NULL, NULL,      NULL,  NULL,  NULL,              "assert target <seqdb> is in format <s>>: no autodetection",   12 },
+  { "--lsort",      eslARG_NONE,       FALSE, NULL, NULL,      NULL,  NULL,  NULL,              "search each block of targets in order of length",             12 },
 #ifdef HMMER_THREADS
   { "--cpu",        eslARG_INT,  p7_NCPU,"HMMER_NCPU", "n>=0",NULL,  NULL,  CPUOPTS,            "number of parallel CPU workers to use for multithreads",      12 },
+  { "--postcpu",    eslARG_INT,  "0",            NULL, "n>=0",NULL,  NULL,  CPUOPTS,            "number of separate threads for domain postprocessing",        12 },
 #endif
 #ifdef HMMER_MPI
   { "--stall",      eslARG_NONE,   FALSE, NULL, NULL,      NULL,"--mpi", NULL,              "arrest after start: for debugging MPI under gdb",             12 },  
@@ -147,13 +158,16 @@ struct cfg_s {
 };
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
-static int  serial_loop  (WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs);
+static int  serial_loop  (WORKER_INFO *info, ESL_SQFILE *dbfp, P7_DSQDB *dsqdb, int n_targetseqs);
 
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
 
-static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_targetseqs);
+static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, P7_DSQDB *dsqdb, int n_targetseqs);
+static int  steal_loop (ESL_THREADS *obj, P7_WSCHED *wsched, P7_DSQDB *dsqdb, int n_targetseqs);
 static void pipeline_thread(void *arg);
+static void postproc_thread(void *arg);
+static void search_block(WORKER_INFO *info, ESL_SQ_BLOCK *block);
 #endif 
 
 #ifdef HMMER_MPI
@@ -243,6 +257,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--tblout")    && fprintf(ofp, "# per-seq hits tabular output:     %s\n",             esl_opt_GetString(go, "--tblout"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domtblout") && fprintf(ofp, "# per-dom hits tabular output:     %s\n",             esl_opt_GetString(go, "--domtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--pfamtblout")&& fprintf(ofp, "# pfam-style tabular hit output:   %s\n",             esl_opt_GetString(go, "--pfamtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--pjson")     && fprintf(ofp, "# per-stage profile (JSON):        %s\n",             esl_opt_GetString(go, "--pjson"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--acc")       && fprintf(ofp, "# prefer accessions over names:    yes\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--noali")     && fprintf(ofp, "# show alignments in output:       no\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--notextw")   && fprintf(ofp, "# max ASCII text line length:      unlimited\n")                                            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -281,6 +296,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--Eft")       && fprintf(ofp, "# tail mass for Fwd exp tau fit:   %f\n",             esl_opt_GetReal   (go, "--Eft"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")          && fprintf(ofp, "# sequence search space set to:    %.0f\n",           esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")      && fprintf(ofp, "# domain search space set to:      %.0f\n",           esl_opt_GetReal(go, "--domZ"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--maxhits")   && fprintf(ofp, "# max hits kept per query:         %d\n",             esl_opt_GetInteger(go, "--maxhits"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
     if (esl_opt_GetInteger(go, "--seed") == 0 && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
     else if (                                    fprintf(ofp, "# random number seed set to:       %d\n",      esl_opt_GetInteger(go, "--seed"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -289,6 +305,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--tformat")   && fprintf(ofp, "# target <seqdb> format asserted:  %s\n",            esl_opt_GetString(go, "--tformat"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_THREADS
   if (esl_opt_IsUsed(go, "--cpu")       && fprintf(ofp, "# number of worker threads:        %d\n",            esl_opt_GetInteger(go, "--cpu"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");  
+  if (esl_opt_IsUsed(go, "--postcpu")   && fprintf(ofp, "# postprocessing threads:          %d\n",            esl_opt_GetInteger(go, "--postcpu"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
 #ifdef HMMER_MPI
   if (esl_opt_IsUsed(go, "--mpi")       && fprintf(ofp, "# MPI:                             on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -384,11 +401,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;		  /* output stream for tabular per-seq (--tblout)     */
   FILE            *domtblfp = NULL;		  /* output stream for tabular per-seq (--domtblout)  */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam tabular output (--pfamtblout)    */
+  FILE            *pjfp     = NULL;              /* output stream for pipeline profiles (--pjson)   */
   int              qformat  = eslSQFILE_UNKNOWN;  /* format of qfile                                  */
   ESL_SQFILE      *qfp      = NULL;		  /* open qfile                                       */
   ESL_SQ          *qsq      = NULL;               /* query sequence                                   */
   int              dbformat = eslSQFILE_UNKNOWN;  /* format of dbfile                                 */
   ESL_SQFILE      *dbfp     = NULL;               /* open dbfile                                      */
+  P7_DSQDB        *dsqdb    = NULL;               /* ... or open pressed sequence database            */
   ESL_ALPHABET    *abc      = NULL;               /* sequence alphabet                                */
   P7_BG           *bg       = NULL;		  /* null model (copies made of this into threads)    */
   P7_BUILDER      *bld      = NULL;               /* HMM construction configuration                   */
@@ -401,13 +420,19 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              sstatus  = eslOK;
   int              i;
   int              ncpus    = 0;
+  int              npost    = 0;                  /* # of postprocessing threads, in a staged search */
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thv      = NULL;               /* hit lists of workers 1.., for merging */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
   ESL_WORK_QUEUE  *queue    = NULL;
+  P7_WSCHED       *wsched   = NULL;
+  ESL_THREADS     *postObj  = NULL;
+  P7_PSTAGE       *pstage   = NULL;
 #endif
+  char             errbuf[eslERRBUFSIZE];
 
   /* Initializations */
   abc     = esl_alphabet_Create(eslAMINO);
@@ -453,16 +478,23 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--tblout"))    { if ((tblfp    = fopen(esl_opt_GetString(go, "--tblout"),    "w")) == NULL)  p7_Fail("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblfp")); }
   if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  p7_Fail("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblfp")); }
   if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+  if (esl_opt_IsOn(go, "--pjson"))     { if ((pjfp     = fopen(esl_opt_GetString(go, "--pjson"),     "w")) == NULL)  esl_fatal("Failed to open pipeline profile output file %s for writing\n", esl_opt_GetString(go, "--pjson")); }
 
-  /* Open the target sequence database for sequential access. */
-  status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
+  /* Open the target sequence database for sequential access: a pressed
+   * one (see makedsqdb) if it is one and no format was given.
+   */
+  status = (dbformat == eslSQFILE_UNKNOWN ? p7_dsqdb_Open(cfg->dbfile, &dsqdb, errbuf) : eslENOTFOUND);
+  if      (status == eslEFORMAT)   p7_Fail("Pressed sequence database %s is corrupt.\n%s\n", cfg->dbfile, errbuf);
+  else if (status == eslENOTFOUND) status = esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
+  else if (status != eslOK)        p7_Fail("Unexpected error %d opening pressed sequence database %s\n", status, cfg->dbfile);
   if      (status == eslENOTFOUND) p7_Fail("Failed to open target sequence database %s for reading\n",      cfg->dbfile);
   else if (status == eslEFORMAT)   p7_Fail("Target sequence database file %s is empty or misformatted\n",   cfg->dbfile);
   else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
   else if (status != eslOK)        p7_Fail("Unexpected error %d opening target sequence database file %s\n", status, cfg->dbfile);
+  if (dsqdb && dsqdb->alphatype != eslAMINO) p7_Fail("Pressed sequence database %s isn't protein\n", cfg->dbfile);
 
 
-  if (esl_opt_IsUsed(go, "--restrictdb_stkey") || esl_opt_IsUsed(go, "--restrictdb_n")) {
+  if (dbfp && (esl_opt_IsUsed(go, "--restrictdb_stkey") || esl_opt_IsUsed(go, "--restrictdb_n"))) {
     if (esl_opt_IsUsed(go, "--ssifile"))
       esl_sqfile_OpenSSI(dbfp, esl_opt_GetString(go, "--ssifile"));
     else
@@ -485,11 +517,27 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     {
       threadObj = esl_threads_Create(&pipeline_thread);
       queue = esl_workqueue_Create(ncpus * 2);
+
+      /* A pressed database needs no reader: workers fetch their own
+       * targets by index, and steal from each other when they run out.
+       */
+      if (dsqdb && (wsched = p7_wsched_Create(ncpus)) == NULL) p7_Fail("Failed to create work-stealing scheduler");
+
+      /* A staged search: the <ncpus> workers only filter, and hand
+       * the targets that pass to <npost> more that do the rest.
+       */
+      if ((npost = esl_opt_GetInteger(go, "--postcpu")) > 0)
+	{
+	  postObj = esl_threads_Create(&postproc_thread);
+	  if ((pstage = p7_pstage_Create(ncpus, npost)) == NULL) p7_Fail("Failed to create pipeline stage queue");
+	}
     }
 #endif
 
-  infocnt = (ncpus <= 0) ? 1 : ncpus;    
+  /* in a staged search, workers ncpus.. are the postprocessing ones */
+  infocnt = (ncpus <= 0) ? 1 : ncpus + npost;
   ESL_ALLOC(info, (ptrdiff_t) sizeof(*info) * infocnt); 
+  ESL_ALLOC(thv,  (ptrdiff_t) sizeof(P7_TOPHITS *) * infocnt);
 
   /* Show header output */
   output_header(ofp, go, cfg->qfile, cfg->dbfile);
@@ -500,8 +548,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       info[i].th    = NULL;
       info[i].om    = NULL;
       info[i].bg    = p7_bg_Clone(bg);
+      info[i].dsqdb = dsqdb;
+      info[i].do_lsort = esl_opt_GetBoolean(go, "--lsort");
 #ifdef HMMER_THREADS
-      info[i].queue = queue;
+      info[i].queue  = queue;
+      info[i].wsched = wsched;
+      info[i].pstage = pstage;
 #endif
     }
 
@@ -533,7 +585,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       esl_stopwatch_Start(w);
 
       /* seqfile may need to be rewound (multiquery mode) */
-      if (nquery > 1)
+      if (nquery > 1 && dsqdb)
+        p7_dsqdb_Position(dsqdb, 0);
+      else if (nquery > 1)
       {
         if (! esl_sqfile_IsRewindable(dbfp)) p7_Fail("Target sequence file %s isn't rewindable; can't search it with multiple queries", cfg->dbfile);
 
@@ -542,7 +596,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       }
 
       if ( cfg->firstseq_key != NULL ) { //it's tempting to want to do this once and capture the offset position for future passes, but ncbi files make this non-trivial, so this keeps it general
-        sstatus = esl_sqfile_PositionByKey(dbfp, cfg->firstseq_key);
+        sstatus = (dsqdb ? p7_dsqdb_PositionByKey(dsqdb, cfg->firstseq_key) : esl_sqfile_PositionByKey(dbfp, cfg->firstseq_key));
         if (sstatus != eslOK)
           p7_Fail("Failure setting restrictdb_stkey to %d\n", cfg->firstseq_key);
       }
@@ -556,50 +610,70 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Build the model */
       p7_SingleBuilder(bld, qsq, info[0].bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
 
+#ifdef HMMER_THREADS
+      if (pstage) p7_pstage_Reset(pstage);
+#endif
       for (i = 0; i < infocnt; ++i)
       {
         /* Create processing pipeline and hit list */
         info[i].th  = p7_tophits_Create();
+        if (esl_opt_IsOn(go, "--maxhits")) p7_tophits_SetMaxHits(info[i].th, esl_opt_GetInteger(go, "--maxhits"));
         info[i].om  = p7_oprofile_Clone(om);
         info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+        info[i].pli->report_thr = infocnt;
+        info[i].pli->do_profile = (pjfp != NULL);
         p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
 
 #ifdef HMMER_THREADS
-        if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+        if (ncpus > 0) esl_threads_AddThread((i < ncpus ? threadObj : postObj), &info[i]);
 #endif
       }
 
 #ifdef HMMER_THREADS
-      if (ncpus > 0) sstatus = thread_loop(threadObj, queue, dbfp, cfg->n_targetseq);
-      else           sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
+      if (pstage) esl_threads_WaitForStart(postObj);
+
+      if      (wsched)    sstatus = steal_loop (threadObj, wsched, dsqdb, cfg->n_targetseq);
+      else if (ncpus > 0) sstatus = thread_loop(threadObj, queue, dbfp, dsqdb, cfg->n_targetseq);
+      else                sstatus = serial_loop(info, dbfp, dsqdb, cfg->n_targetseq);
+
+      /* filtering is done; the postprocessing threads finish what's queued */
+      if (pstage && sstatus == eslEOF)
+	{
+	  p7_pstage_Close(pstage);
+	  esl_threads_WaitForFinish(postObj);
+	}
 #else
-      sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
+      sstatus = serial_loop(info, dbfp, dsqdb, cfg->n_targetseq);
 #endif
       switch(sstatus)
       {
       case eslEFORMAT:
         p7_Fail("Parse failed (sequence file %s):\n%s\n",
-            dbfp->filename, esl_sqfile_GetErrorBuf(dbfp));
+            cfg->dbfile, dsqdb ? dsqdb->errbuf : esl_sqfile_GetErrorBuf(dbfp));
         break;
       case eslEOF:
         /* do nothing */
         break;
       default:
         p7_Fail("Unexpected error %d reading sequence file %s",
-            sstatus, dbfp->filename);
+            sstatus, cfg->dbfile);
       }
 
 
       /* merge the results of the search results */
       for (i = 1; i < infocnt; ++i)
       {
-        p7_tophits_Merge(info[0].th, info[i].th);
+        thv[i-1] = info[i].th;
         p7_pipeline_Merge(info[0].pli, info[i].pli);
 
         p7_pipeline_Destroy(info[i].pli);
-        p7_tophits_Destroy(info[i].th);
         p7_oprofile_Destroy(info[i].om);
       }
+      if (p7_tophits_MergeN(info[0].th, thv, infocnt-1, infocnt) != eslOK) p7_Fail("Failed to merge hit lists");
+      for (i = 1; i < infocnt; ++i) p7_tophits_Destroy(thv[i-1]);
+#ifdef HMMER_THREADS
+      if (pstage) p7_pstage_Account(pstage, info[0].pli);
+#endif
 
       /* Print the results.  */
       p7_tophits_SortBySortkey(info->th);
@@ -613,6 +687,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
       esl_stopwatch_Stop(w);
       p7_pli_Statistics(ofp, info->pli, w);
+      if (pjfp) p7_pli_WriteProfile(pjfp, qsq->name, info->pli, w);
       if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
       fflush(ofp);
 
@@ -668,12 +743,17 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
 	esl_sq_DestroyBlock(block);
       esl_workqueue_Destroy(queue);
+      p7_wsched_Destroy(wsched);
       esl_threads_Destroy(threadObj);
+      if (postObj) esl_threads_Destroy(postObj);
+      p7_pstage_Destroy(pstage);
     }
 #endif
 
   free(info);
-  esl_sqfile_Close(dbfp);
+  free(thv);
+  if (dbfp)  esl_sqfile_Close(dbfp);
+  if (dsqdb) p7_dsqdb_Close(dsqdb);
   esl_sqfile_Close(qfp);
   esl_stopwatch_Destroy(w);
   esl_sq_Destroy(qsq);
@@ -686,6 +766,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp    != NULL)   fclose(tblfp);
   if (domtblfp != NULL)   fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (pjfp)          fclose(pjfp);
   return eslOK;
 
  ERROR:
@@ -870,6 +951,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;		  /* output stream for tabular per-seq (--tblout)     */
   FILE            *domtblfp = NULL;		  /* output stream for tabular per-seq (--domtblout)  */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam-style tabular output  (--pfamtblout) */
+  FILE            *pjfp     = NULL;              /* output stream for pipeline profiles (--pjson)   */
   int              qformat  = eslSQFILE_UNKNOWN;  /* format of qfile                                  */
   P7_BG           *bg       = NULL;	          /* null model                                      */
   ESL_SQFILE      *qfp      = NULL;		  /* open qfile                                       */
@@ -950,6 +1032,9 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     mpi_failure("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblfp"));
   if (esl_opt_IsOn(go, "--pfamtblout") && (pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)
     mpi_failure("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout"));
+
+  if (esl_opt_IsOn(go, "--pjson") && (pjfp = fopen(esl_opt_GetString(go, "--pjson"), "w")) == NULL)
+    mpi_failure("Failed to open pipeline profile output file %s for writing\n", esl_opt_GetString(go, "--pjson"));
     
   /* Open the target sequence database for sequential access. */
   status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
@@ -1021,7 +1106,9 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
       /* Create processing pipeline and hit list */
       th  = p7_tophits_Create(); 
+      if (esl_opt_IsOn(go, "--maxhits")) p7_tophits_SetMaxHits(th, esl_opt_GetInteger(go, "--maxhits"));
       pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+      pli->do_profile = esl_opt_IsOn(go, "--pjson");
       p7_pli_NewModel(pli, om, bg);
 
       /* Main loop: */
@@ -1126,6 +1213,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
       esl_stopwatch_Stop(w);
       p7_pli_Statistics(ofp, pli, w);
+      if (pjfp) p7_pli_WriteProfile(pjfp, qsq->name, pli, w);
       if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
       /* Output the results in an MSA (-A option) */
@@ -1209,6 +1297,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp    != NULL)   fclose(tblfp);
   if (domtblfp != NULL)   fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (pjfp)          fclose(pjfp);
   return eslOK;
 
  ERROR:
@@ -1314,7 +1403,9 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 
       /* Create processing pipeline and hit list */
       th  = p7_tophits_Create(); 
+      if (esl_opt_IsOn(go, "--maxhits")) p7_tophits_SetMaxHits(th, esl_opt_GetInteger(go, "--maxhits"));
       pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+      pli->do_profile = esl_opt_IsOn(go, "--pjson");
       p7_pli_NewModel(pli, om, bg);
 
       /* receive a sequence block from the master */
@@ -1391,7 +1482,7 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 
 
 static int
-serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs)
+serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, P7_DSQDB *dsqdb, int n_targetseqs)
 {
   int      sstatus   = eslOK;
   ESL_SQ   *dbsq     = NULL;   /* one target sequence (digital)  */
@@ -1400,16 +1491,17 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs)
   dbsq = esl_sq_CreateDigital(info->om->abc);
 
   /* Main loop: */
-  while ((n_targetseqs==-1 || seq_cnt<n_targetseqs) && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
+  while ((n_targetseqs==-1 || seq_cnt<n_targetseqs) &&
+         (sstatus = (dsqdb ? p7_dsqdb_Read(dsqdb, dbsq) : esl_sqio_Read(dbfp, dbsq))) == eslOK)
     {
       p7_pli_NewSeq(info->pli, dbsq);
-      p7_bg_SetLength(info->bg, dbsq->n);
-      p7_oprofile_ReconfigLength(info->om, dbsq->n);
+      p7_pli_SetLength(info->pli, info->om, info->bg, dbsq->n);
       
       p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
 
       seq_cnt++;
-      esl_sq_Reuse(dbsq);
+      if (dsqdb) p7_dsqdb_ReuseSeq(dbsq);
+      else       esl_sq_Reuse(dbsq);
       p7_pipeline_Reuse(info->pli);
     }
 
@@ -1423,7 +1515,7 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs)
 
 #ifdef HMMER_THREADS
 static int
-thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_targetseqs)
+thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, P7_DSQDB *dsqdb, int n_targetseqs)
 {
   int  status  = eslOK;
   int  sstatus = eslOK;
@@ -1447,7 +1539,8 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
         block->count = 0;
         sstatus = eslEOF;
       } else {
-        sstatus = esl_sqio_ReadBlock(dbfp, block, -1, n_targetseqs, /*max_init_window=*/FALSE, FALSE);
+        if (dsqdb) sstatus = p7_dsqdb_ReadBlock(dsqdb, block, n_targetseqs);
+        else       sstatus = esl_sqio_ReadBlock(dbfp, block, -1, n_targetseqs, /*max_init_window=*/FALSE, FALSE);
         n_targetseqs -= block->count;
       }
 
@@ -1477,16 +1570,37 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
   return sstatus;
 }
 
+/* steal_loop()
+ * The threaded search of a pressed database: no reader, no queue.
+ * The range of targets to search, from the current position of
+ * <dsqdb>, is dealt out to the workers' deques in <wsched>, and the
+ * workers fetch their targets themselves (see pipeline_thread()).
+ */
+static int
+steal_loop(ESL_THREADS *obj, P7_WSCHED *wsched, P7_DSQDB *dsqdb, int n_targetseqs)
+{
+  int64_t from = dsqdb->next;
+  int64_t to   = (n_targetseqs < 0 ? dsqdb->nseq : ESL_MIN(dsqdb->nseq, from + n_targetseqs));
+
+  p7_wsched_Reset(wsched, from, to, BLOCK_SIZE);
+
+  esl_threads_WaitForStart(obj);
+  esl_threads_WaitForFinish(obj);
+
+  p7_dsqdb_Position(dsqdb, to);
+  return eslEOF;
+}
+
 static void 
 pipeline_thread(void *arg)
 {
-  int i;
   int status;
   int workeridx;
   WORKER_INFO   *info;
   ESL_THREADS   *obj;
   ESL_SQ_BLOCK  *block = NULL;
   void          *newBlock;
+  int64_t        lo, hi;
   
   impl_Init();
 
@@ -1495,6 +1609,30 @@ pipeline_thread(void *arg)
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
 
+  /* A pressed database: take ranges of targets from our own deque,
+   * or steal them, and fetch them into our own block.
+   */
+  if (info->wsched)
+    {
+      block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, info->om->abc);
+      if (block == NULL) p7_Fail("Failed to allocate sequence block");
+
+      while ((status = p7_wsched_Next(info->wsched, workeridx, &lo, &hi)) == eslOK)
+	{
+	  status = p7_dsqdb_FetchBlock(info->dsqdb, block, lo, (int) (hi - lo));
+	  if      (status == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n", info->dsqdb->filename, info->dsqdb->errbuf);
+	  else if (status != eslOK)      p7_Fail("Unexpected error %d reading sequence file %s", status, info->dsqdb->filename);
+
+	  search_block(info, block);
+	}
+      if (status != eslEOF) p7_Fail("Work-stealing scheduler failed");
+
+      esl_sq_DestroyBlock(block);
+      p7_tophits_SortBySortkey(info->th);  /* here in the worker, so the master only has to merge */
+      esl_threads_Finished(obj, workeridx);
+      return;
+    }
+
   status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
   if (status != eslOK) p7_Fail("Work queue worker failed");
 
@@ -1502,20 +1640,7 @@ pipeline_thread(void *arg)
   block = (ESL_SQ_BLOCK *) newBlock;
   while (block->count > 0)
     {
-      /* Main loop: */
-      for (i = 0; i < block->count; ++i)
-	{
-	  ESL_SQ *dbsq = block->list + i;
-
-	  p7_pli_NewSeq(info->pli, dbsq);
-	  p7_bg_SetLength(info->bg, dbsq->n);
-	  p7_oprofile_ReconfigLength(info->om, dbsq->n);
-	  
-	  p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
-	  
-	  esl_sq_Reuse(dbsq);
-	  p7_pipeline_Reuse(info->pli);
-	}
+      search_block(info, block);
 
       status = esl_workqueue_WorkerUpdate(info->queue, block, &newBlock);
       if (status != eslOK) p7_Fail("Work queue worker failed");
@@ -1526,9 +1651,84 @@ pipeline_thread(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) p7_Fail("Work queue worker failed");
 
+  p7_tophits_SortBySortkey(info->th);
   esl_threads_Finished(obj, workeridx);
   return;
 }
+
+/* postproc_thread()
+ * A postprocessing worker of a staged search (--postcpu): finishes
+ * the search of each target that passed some filter worker's
+ * filters, with its own pipeline and copy of the query.
+ */
+static void
+postproc_thread(void *arg)
+{
+  int            status;
+  int            workeridx;
+  WORKER_INFO   *info;
+  ESL_THREADS   *obj;
+  P7_SURVIVOR    sv;
+
+  impl_Init();
+
+  obj = (ESL_THREADS *) arg;
+  esl_threads_Started(obj, &workeridx);
+
+  info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+
+  while ((status = p7_pstage_Pop(info->pstage, &sv)) == eslOK)
+    {
+      p7_pli_SetLength(info->pli, info->om, info->bg, sv.sq->n);
+      p7_pli_Postprocess(info->pli, info->om, info->bg, sv.sq, NULL, sv.fwdsc, info->th);
+
+      p7_pipeline_Reuse(info->pli);
+      esl_sq_Destroy(sv.sq);
+    }
+  if (status != eslEOF) p7_Fail("Pipeline stage queue failed");
+
+  p7_tophits_SortBySortkey(info->th);
+  esl_threads_Finished(obj, workeridx);
+  return;
+}
+
+/* search_block()
+ * Search the query against a block of targets, recycling each
+ * target sequence as we go.
+ */
+static void
+search_block(WORKER_INFO *info, ESL_SQ_BLOCK *block)
+{
+  ESL_SQ *dbsq;
+  float   fwdsc;
+  int     i, j;
+
+  /* With --lsort, targets of the same length are searched one after
+   * another, and only the first of them reconfigures the length model.
+   */
+  if (info->do_lsort && p7_pli_SortByLength(info->pli, block->list, block->count) != eslOK)
+    esl_fatal("Failed to sort target block by length");
+
+  for (j = 0; j < block->count; ++j)
+    {
+      i    = (info->do_lsort ? info->pli->order[j] : j);
+      dbsq = block->list + i;
+
+      p7_pli_NewSeq(info->pli, dbsq);
+      p7_pli_SetLength(info->pli, info->om, info->bg, dbsq->n);
+
+      /* in a staged search, targets that pass the filters go to the postprocessing threads */
+      if (! info->pstage)
+	p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
+      else if (p7_pli_Filter(info->pli, info->om, info->bg, dbsq, &fwdsc) == eslOK &&
+	       p7_pstage_Push(info->pstage, dbsq, 0, fwdsc) != eslOK)
+	p7_Fail("Failed to queue target for postprocessing");
+
+      if (info->dsqdb) p7_dsqdb_ReuseSeq(dbsq);
+      else             esl_sq_Reuse(dbsq);
+      p7_pipeline_Reuse(info->pli);
+    }
+}
 #endif   /* HMMER_THREADS */
 
 